@@ -0,0 +1,31 @@
+// Shared scaffolding for the benchmark kernels. Each kernel loops forever;
+// run-bench.sh stops spike with --instructions and times it.
+
+#define MSTATUS_FS 0x6000
+#define MSTATUS_VS 0x0600
+#define MSTATUS_MPP_S 0x0800
+
+// Start on hart 0 only; the others wait forever.
+#define BENCH_START_HART0 \
+  .section .text.init;    \
+  .globl _start;          \
+_start:                   \
+  csrr t0, mhartid;       \
+1:                        \
+  bnez t0, 1b;
+
+// Start on every hart.
+#define BENCH_START_ALL_HARTS \
+  .section .text.init;    \
+  .globl _start;          \
+_start:
+
+// HTIF mailboxes, so spike doesn't warn about their absence
+#define BENCH_HTIF        \
+  .section .tohost, "aw", @progbits; \
+  .align 6;               \
+  .globl tohost;          \
+tohost: .dword 0;         \
+  .align 6;               \
+  .globl fromhost;        \
+fromhost: .dword 0;
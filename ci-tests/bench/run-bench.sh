@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+# Build the benchmark kernels and report spike's instruction rate on each.
+#
+# Usage: run-bench.sh [spike] [instructions]
+#
+# Kernels are built with $RISCV_PREFIX-gcc (default riscv64-unknown-elf-).
+# Extra spike options, e.g. a --tlb or --icache size to compare, can be
+# passed in $SPIKE_FLAGS.
+
+set -e
+
+SPIKE="${1:-spike}"
+INSTRUCTIONS="${2:-100000000}"
+CC="${RISCV_PREFIX:-riscv64-unknown-elf-}gcc"
+SRC="$( cd "$( dirname "${BASH_SOURCE[0]}" )" >/dev/null 2>&1 && pwd )"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# name, ISA, extra spike options
+run() {
+  local name="$1" isa="$2" flags="$3"
+  "$CC" -march="$isa" -mabi=lp64d -nostdlib -nostartfiles -static \
+    -T "$SRC"/link.ld "$SRC"/"$name".S -o "$WORK"/"$name".elf
+  local start end
+  start=$(date +%s%N)
+  "$SPIKE" --isa="$isa" $flags $SPIKE_FLAGS --instructions="$INSTRUCTIONS" \
+    "$WORK"/"$name".elf
+  end=$(date +%s%N)
+  awk -v name="$name" -v n="$INSTRUCTIONS" -v ns=$((end - start)) \
+    'BEGIN { printf "%-10s %8.1f MIPS\n", name, n / (ns / 1000.0) }'
+}
+
+run alu rv64gc
+run branch rv64gc
+run memstream rv64gc
+run tlb rv64gc
+run csr rv64gc
+run fp rv64gc
+run rvv rv64gcv
+run amo rv64gc -p4
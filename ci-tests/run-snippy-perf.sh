@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+# Throughput of spike on long randomized snippy streams, one per category
+# of snippy-tests/*.yaml, compared with the previous run in a history file.
+#
+# Usage: run-snippy-perf.sh <workdir> <spike> [history]
+#
+# Like generate-snippy-tests.sh, this expects ./llvm-snippy and
+# riscv64-linux-gnu-gcc. $SNIPPY_PERF_INSTRS sets the stream length
+# (default 1000000). Results are appended to the history file (default
+# <workdir>/snippy-perf.tsv) as date, revision, category and MIPS.
+
+set -e
+
+WORKDIR="$1"
+SPIKE="$2"
+HISTORY="${3:-$WORKDIR/snippy-perf.tsv}"
+INSTRS="${SNIPPY_PERF_INSTRS:-1000000}"
+CI="$( cd "$( dirname "${BASH_SOURCE[0]}" )" >/dev/null 2>&1 && pwd )"
+CONFIGDIR="$CI"/snippy-tests
+RESULTDIR="$WORKDIR"/snippy-perf
+REV=$(git -C "$CI" rev-parse --short HEAD 2>/dev/null || echo unknown)
+DATE=$(date +%Y-%m-%dT%H:%M:%S)
+
+mkdir -p "$RESULTDIR"
+cp "$CONFIGDIR"/linker-entry.ld "$RESULTDIR"
+touch "$HISTORY"
+
+# The configs share one layout: a 128 KiB code section at 0x80020000, then
+# data at 0x80040000 and the stack at 0x80050000. Grow the code section to
+# hold the stream and move the other two above it.
+CODE_SIZE=$(( (INSTRS * 4 + 0xfffff) & ~0xfffff ))
+DATA_BASE=$(printf "0x%x" $(( 0x80020000 + CODE_SIZE )))
+STACK_BASE=$(printf "0x%x" $(( 0x80020000 + CODE_SIZE + 0x10000 )))
+CODE_SIZE=$(printf "0x%x" $CODE_SIZE)
+
+now_ns() {
+  date +%s%N
+}
+
+# category, config, boot code, -march, -mabi
+perf() {
+  local name="$1" config="$2" boot="$3" arch="$4" abi="$5"
+  local yaml="$RESULTDIR"/"$name".yaml elf="$RESULTDIR"/"$name".elf
+  sed -e "s/num-instrs: .*/num-instrs: $INSTRS/" \
+      -e "s/SIZE:      0x20000/SIZE:      $CODE_SIZE/" \
+      -e "s/0x80040000/$DATA_BASE/g" \
+      -e "s/0x80050000/$STACK_BASE/g" \
+      "$CONFIGDIR"/"$config" > "$yaml"
+  if ! "$CI"/generate-snippy-test.sh "$yaml" "$elf" "$CONFIGDIR"/"$boot" \
+       riscv64-unknown-elf "$arch" "$abi" > "$RESULTDIR"/"$name".log 2>&1; then
+    cat "$RESULTDIR"/"$name".log
+    exit 1
+  fi
+
+  local isa=rv64imafdcv_zicsr
+  local retired start mid end
+  retired=$("$SPIKE" --isa=$isa --insn-stats "$elf" 2>&1 |
+            awk '$3 == "retired" { n += $4 } END { print n }')
+  # time the run less the cost of starting up and loading the stream
+  start=$(now_ns)
+  "$SPIKE" --isa=$isa --instructions=1 "$elf"
+  mid=$(now_ns)
+  "$SPIKE" --isa=$isa "$elf"
+  end=$(now_ns)
+
+  local mips last
+  mips=$(awk -v n="$retired" -v ns=$(( (end - mid) - (mid - start) )) \
+         'BEGIN { printf "%.1f", ns > 0 ? n / (ns / 1000.0) : 0 }')
+  last=$(awk -F'\t' -v name="$name" '$3 == name { last = $4 } END { print last }' "$HISTORY")
+  printf "%s\t%s\t%s\t%s\n" "$DATE" "$REV" "$name" "$mips" >> "$HISTORY"
+
+  if [ -n "$last" ]; then
+    awk -v name="$name" -v mips="$mips" -v last="$last" -v n="$retired" \
+      'BEGIN { printf "%-10s %8.1f MIPS (%+.1f%% vs %.1f) over %d insns\n",
+               name, mips, last > 0 ? 100 * (mips - last) / last : 0, last, n }'
+  else
+    printf "%-10s %8.1f MIPS over %d insns\n" "$name" "$mips" "$retired"
+  fi
+}
+
+perf basic basic.yaml boot-code.s rv64i_zicsr lp64
+perf atomic atomic.yaml boot-code.s rv64ia_zicsr lp64
+perf compressed compressed.yaml boot-code.s rv64ic_zicsr lp64
+perf single-fp single-fp.yaml boot-code-f.s rv64if_zicsr lp64f
+perf double-fp double-fp.yaml boot-code-f.s rv64ifd_zicsr lp64d
+perf vector vector.yaml boot-code-vf.s rv64gcv lp64d
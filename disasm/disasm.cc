@@ -591,6 +591,23 @@ std::string disassembler_t::disassemble(insn_t insn) const
   return disasm_insn ? disasm_insn->to_string(insn) : "unknown";
 }
 
+const std::string& disasm_cache_t::disassemble(insn_t insn)
+{
+  auto it = index.find(insn.bits());
+  if (it != index.end()) {
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->second;
+  }
+
+  if (index.size() >= capacity) {
+    index.erase(lru.back().first);
+    lru.pop_back();
+  }
+  lru.emplace_front(insn.bits(), disasm->disassemble(insn));
+  index.emplace(insn.bits(), lru.begin());
+  return lru.front().second;
+}
+
 static void NOINLINE add_noarg_insn(disassembler_t* d, const char* name, uint32_t match, uint32_t mask)
 {
   d->add_insn(new disasm_insn_t(name, match, mask, {}));
@@ -2291,45 +2308,71 @@ disassembler_t::disassembler_t(const isa_parser_t *isa, bool strict)
     add_unknown_insns(this);
   }
 
-  // Now, reverse the lists, because we search them back-to-front (so that
-  // custom instructions later added with add_insn have highest priority).
-  for (size_t i = 0; i < HASH_SIZE+1; i++)
-    std::reverse(chain[i].begin(), chain[i].end());
+  // custom instructions later added with add_insn have highest priority
+  built = true;
 }
 
-const disasm_insn_t* disassembler_t::probe_once(insn_t insn, size_t idx) const
+const disassembler_t::entry_t* disassembler_t::first_match(const chain_t& chain, insn_t insn)
 {
-  for (auto it = chain[idx].rbegin(); it != chain[idx].rend(); ++it)
-    if (*(*it) == insn)
-      return *it;
+  for (const entry_t& e : chain)
+    if (*e.insn == insn)
+      return &e;
 
   return NULL;
 }
 
 const disasm_insn_t* disassembler_t::lookup(insn_t insn) const
 {
-  if (auto p = probe_once(insn, hash(insn.bits(), MASK1)))
-    return p;
+  insn_bits_t bits = insn.bits();
+
+  // The three chains of masks covering the major opcode stand for what
+  // was one, so the first match in priority order among them wins; then
+  // come the compressed chain and the rest, as before.
+  const entry_t* best = first_match(by_f6[f6_index(bits)], insn);
+  for (const chain_t* c : {&by_f3[f3_index(bits)], &by_op[bits & 0x7f]})
+    if (auto e = first_match(*c, insn); e && (!best || e->prio < best->prio))
+      best = e;
+  if (best)
+    return best->insn;
+
+  if (auto e = first_match(by_rvc[rvc_index(bits)], insn))
+    return e->insn;
 
-  if (auto p = probe_once(insn, hash(insn.bits(), MASK2)))
-    return p;
+  if (auto e = first_match(other, insn))
+    return e->insn;
 
-  return probe_once(insn, HASH_SIZE);
+  return base ? base->lookup(insn) : NULL;
 }
 
 void NOINLINE disassembler_t::add_insn(disasm_insn_t* insn)
 {
-  size_t idx =
-    (insn->get_mask() & MASK1) == MASK1 ? hash(insn->get_match(), MASK1) :
-    (insn->get_mask() & MASK2) == MASK2 ? hash(insn->get_match(), MASK2) :
-    HASH_SIZE;
+  insn_bits_t match = insn->get_match(), mask = insn->get_mask();
+  chain_t& chain =
+    (mask & MASK_F6) == MASK_F6 ? by_f6[f6_index(match)] :
+    (mask & MASK_F3) == MASK_F3 ? by_f3[f3_index(match)] :
+    (mask & MASK1) == MASK1 ? by_op[match & 0x7f] :
+    (mask & MASK2) == MASK2 ? by_rvc[rvc_index(match)] :
+    other;
+
+  if (built)
+    chain.insert(chain.begin(), {--late_prio, insn});
+  else
+    chain.push_back({next_prio++, insn});
+}
 
-  chain[idx].push_back(insn);
+template<typename F> void disassembler_t::for_each_chain(F f)
+{
+  for (auto& c : by_op) f(c);
+  for (auto& c : by_f3) f(c);
+  for (auto& c : by_f6) f(c);
+  for (auto& c : by_rvc) f(c);
+  f(other);
 }
 
 disassembler_t::~disassembler_t()
 {
-  for (size_t i = 0; i < HASH_SIZE+1; i++)
-    for (size_t j = 0; j < chain[i].size(); j++)
-      delete chain[i][j];
+  for_each_chain([](chain_t& chain) {
+    for (const entry_t& e : chain)
+      delete e.insn;
+  });
 }
@@ -1,5 +1,7 @@
 #include "isa_parser.h"
 #include <cstring>
+#include <map>
+#include <mutex>
 #include <stdexcept>
 
 static std::string strtolower(const char* str)
@@ -599,3 +601,15 @@ isa_parser_t::isa_parser_t(const char* str, const char *priv)
       max_isa |= 1UL << (ch - 'A');
   }
 }
+
+std::shared_ptr<const isa_parser_t> isa_parser_t::get(const char* str, const char *priv)
+{
+  static std::mutex lock;
+  static std::map<std::pair<std::string, std::string>, std::shared_ptr<const isa_parser_t>> cache;
+
+  std::lock_guard<std::mutex> guard(lock);
+  auto& entry = cache[{str, priv}];
+  if (!entry)
+    entry = std::make_shared<const isa_parser_t>(str, priv);
+  return entry;
+}
@@ -0,0 +1,146 @@
+// dpi_bench.c
+// Measures the cost of the DPI calls a lockstep testbench makes, without an
+// RTL simulator: step the model, read back state, compare it with a
+// "DUT" copy, repeat.
+//   ./dpi_bench <elf> [instructions] [harts] [isa] [mix]
+// mix is a comma-separated list of what to read after each step: pc, gpr,
+// fpr, csr, vreg, snapshot (default "pc,gpr,csr"); "none" only steps.
+// Reports ns per retired instruction for stepping alone and for the mix.
+
+#include "spike_dpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIX_PC       0x01
+#define MIX_GPR      0x02
+#define MIX_FPR      0x04
+#define MIX_CSR      0x08
+#define MIX_VREG     0x10
+#define MIX_SNAPSHOT 0x20
+
+static const uint32_t csrs[] = { 0x300 /* mstatus */, 0x341 /* mepc */,
+                                 0x342 /* mcause */, 0x343 /* mtval */ };
+#define N_CSRS (sizeof(csrs) / sizeof(csrs[0]))
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int parse_mix(const char *s)
+{
+    static const struct { const char *name; int flag; } names[] = {
+        { "pc", MIX_PC }, { "gpr", MIX_GPR }, { "fpr", MIX_FPR },
+        { "csr", MIX_CSR }, { "vreg", MIX_VREG }, { "snapshot", MIX_SNAPSHOT },
+        { "none", 0 },
+    };
+    int mix = 0;
+    char *copy = strdup(s);
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        size_t i;
+        for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+            if (strcmp(tok, names[i].name) == 0)
+                break;
+        if (i == sizeof(names) / sizeof(names[0])) {
+            fprintf(stderr, "unknown mix entry %s\n", tok);
+            exit(2);
+        }
+        mix |= names[i].flag;
+    }
+    free(copy);
+    return mix;
+}
+
+// Step n times, reading back what mix asks for. Returns the number of
+// steps taken (fewer if the target writes tohost) and the time in *ns.
+static long run(void *h, long n, int harts, int mix, double *ns)
+{
+    static spike_snapshot_t snap;
+    uint64_t regs[32], dut[32] = { 0 }, csr_vals[N_CSRS];
+    int vreg_qwords = spike_get_vlenb(h, 0) * 32 / 8;
+    uint64_t *vregs = vreg_qwords ? malloc(vreg_qwords * sizeof(uint64_t)) : NULL;
+    uint64_t mismatches = 0;
+
+    double t0 = now_ns();
+    long i;
+    for (i = 0; i < n; i++) {
+        if (spike_step(h) != SPIKE_TOHOST_NONE)
+            break;
+        unsigned hart = i % harts;
+        if (mix & MIX_PC)
+            mismatches += spike_get_pc(h, hart) == dut[0];
+        if (mix & MIX_GPR) {
+            spike_get_all_gprs(h, hart, regs);
+            mismatches += memcmp(regs, dut, sizeof(regs)) != 0;
+        }
+        if (mix & MIX_FPR) {
+            spike_get_all_fprs(h, hart, regs);
+            mismatches += memcmp(regs, dut, sizeof(regs)) != 0;
+        }
+        if (mix & MIX_CSR) {
+            for (size_t c = 0; c < N_CSRS; c++)
+                csr_vals[c] = spike_get_csr(h, hart, csrs[c]);
+            mismatches += memcmp(csr_vals, dut, sizeof(csr_vals)) != 0;
+        }
+        if ((mix & MIX_VREG) && vregs)
+            mismatches += spike_get_all_vregs(h, hart, vregs, vreg_qwords) < 0;
+        if (mix & MIX_SNAPSHOT)
+            mismatches += spike_get_snapshot(h, hart, &snap) != 1;
+    }
+    *ns = now_ns() - t0;
+
+    // keep the comparisons from being optimised away
+    if (mismatches == (uint64_t)-1)
+        printf("\n");
+    free(vregs);
+    return i;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <elf> [instructions] [harts] [isa] [mix]\n", argv[0]);
+        return 2;
+    }
+    long n = argc > 2 ? atol(argv[2]) : 1000000;
+    int harts = argc > 3 ? atoi(argv[3]) : 1;
+    if (argc > 4)
+        spike_set_isa(argv[4]);
+    int mix = parse_mix(argc > 5 ? argv[5] : "pc,gpr,csr");
+
+    if (spike_set_harts(harts) < 0) {
+        fprintf(stderr, "bad hart count %d\n", harts);
+        return 2;
+    }
+
+    double base_ns, mix_ns;
+    long base_n, mix_n;
+    for (int pass = 0; pass < 2; pass++) {
+        void *h = spike_create(argv[1]);
+        if (!h) {
+            fprintf(stderr, "spike_create failed\n");
+            return 1;
+        }
+        spike_set_lockstep(h, 1);
+        if (pass == 0) {
+            base_n = run(h, n, harts, 0, &base_ns);
+        } else {
+            spike_set_snapshot_csrs(h, csrs, N_CSRS);
+            mix_n = run(h, n, harts, mix, &mix_ns);
+        }
+        spike_delete(h);
+    }
+
+    if (!base_n || !mix_n) {
+        fprintf(stderr, "target exited before its first instruction\n");
+        return 1;
+    }
+    printf("step only: %.1f ns/insn (%ld insns)\n", base_ns / base_n, base_n);
+    printf("step+mix:  %.1f ns/insn (%ld insns), %.1f ns/insn in reads\n",
+           mix_ns / mix_n, mix_n, mix_ns / mix_n - base_ns / base_n);
+    return 0;
+}
@@ -0,0 +1,284 @@
+// dpi_remote.cc
+// Client side of the remote DPI mode: the spike_remote_* entry points, which
+// forward to an instance in spike_dpi_server over a socket (see
+// dpi_remote.h). Commits to check are batched into frames, and several
+// frames are kept in flight, so that the round trip is paid per window
+// rather than per instruction.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "dpi_remote.h"
+#include "spike_dpi.h"
+
+namespace {
+
+struct remote_t {
+    int fd = -1;
+    size_t batch = 64;
+    int window = 4;
+    bool broken = false;
+    std::vector<spike_commit_t> pending;  // posted, not sent yet
+    int in_flight = 0;                    // CHECK frames awaiting their reply
+    uint64_t next_seq = 0;                // of the next result to arrive
+    std::deque<spike_remote_result_t> results;
+
+    ~remote_t() { if (fd >= 0) close(fd); }
+};
+
+int connect_to(const char *addr)
+{
+    std::string a(addr);
+    if (a.compare(0, 5, "unix:") == 0) {
+        sockaddr_un sa = {};
+        sa.sun_family = AF_UNIX;
+        if (a.size() - 5 >= sizeof(sa.sun_path)) return -1;
+        strcpy(sa.sun_path, a.c_str() + 5);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr *)&sa, sizeof(sa)) == 0)
+            return fd;
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    size_t colon = a.rfind(':');
+    if (colon == std::string::npos) return -1;
+    std::string host = a.substr(0, colon), port = a.substr(colon + 1);
+    addrinfo hints = {}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0)
+        return -1;
+    int fd = -1;
+    for (addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// Reads the reply to the oldest CHECK frame in flight into results
+bool receive_results(remote_t *r)
+{
+    remote_frame_t f;
+    if (!remote_recv_frame(r->fd, &f) || f.op != REMOTE_CHECK) return false;
+    for (uint32_t i = 0; i < f.count; i++) {
+        char head[8];
+        if (!remote_recv(r->fd, head, sizeof(head))) return false;
+        remote_reader_t res(head, sizeof(head));
+        spike_remote_result_t out = {};
+        out.seq = r->next_seq++;
+        out.result = (int32_t)res.u32();
+        uint32_t report_len = res.u32();
+        size_t keep = std::min<size_t>(report_len, sizeof(out.report) - 1);
+        if (!remote_recv(r->fd, out.report, keep)) return false;
+        for (size_t skip = report_len - keep; skip; ) {
+            char junk[256];
+            size_t n = std::min(skip, sizeof(junk));
+            if (!remote_recv(r->fd, junk, n)) return false;
+            skip -= n;
+        }
+        r->results.push_back(out);
+    }
+    r->in_flight--;
+    return true;
+}
+
+// Sends a frame, reading the replies to the CHECK frames in flight while the
+// socket is full: the server stops reading while it cannot write a reply,
+// so a window larger than the socket buffers would otherwise deadlock
+bool send_frame(remote_t *r, uint32_t op, uint32_t count, uint32_t arg, int64_t value,
+                const remote_buf_t *payload = nullptr)
+{
+    remote_buf_t b;
+    remote_put_header(b, op, count, arg, payload ? payload->data.size() : 0, value);
+    if (payload) b.bytes(payload->data.data(), payload->data.size());
+
+    const char *p = b.data.data();
+    size_t len = b.data.size();
+    while (len) {
+        pollfd pfd = { r->fd, short(POLLOUT | (r->in_flight ? POLLIN : 0)), 0 };
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (pfd.revents & POLLIN) {
+            if (!receive_results(r)) return false;
+            continue;
+        }
+        if (!(pfd.revents & POLLOUT)) return false;
+        ssize_t n = send(r->fd, p, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool send_pending(remote_t *r)
+{
+    if (r->pending.empty()) return true;
+    if (r->in_flight >= r->window && !receive_results(r)) return false;
+    remote_buf_t commits;
+    for (const spike_commit_t &c : r->pending)
+        remote_put_commit(commits, c);
+    if (!send_frame(r, REMOTE_CHECK, r->pending.size(), 0, 0, &commits))
+        return false;
+    r->pending.clear();
+    r->in_flight++;
+    return true;
+}
+
+// Sends what is pending and waits for every reply, before a call whose
+// reply comes after them
+bool drain(remote_t *r)
+{
+    if (!send_pending(r)) return false;
+    while (r->in_flight)
+        if (!receive_results(r)) return false;
+    return true;
+}
+
+remote_t *as_remote(void *remote)
+{
+    remote_t *r = static_cast<remote_t *>(remote);
+    return r && !r->broken ? r : nullptr;
+}
+
+// Marks the connection broken when a call fails, so later ones fail fast
+template<typename T>
+T fail(remote_t *r, T ret)
+{
+    r->broken = true;
+    return ret;
+}
+
+}  // namespace
+
+void *spike_remote_connect(const char *addr, const char *filename, int batch, int window)
+{
+    if (!addr || !filename || batch <= 0 || window <= 0) return nullptr;
+    remote_t *r = new remote_t;
+    r->batch = batch;
+    r->window = window;
+    r->pending.reserve(batch);
+    r->fd = connect_to(addr);
+    remote_frame_t f;
+    if (r->fd < 0 ||
+        !remote_send_frame(r->fd, REMOTE_HELLO, REMOTE_VERSION, 0, 0, filename, strlen(filename)) ||
+        !remote_recv_frame(r->fd, &f) || f.op != REMOTE_HELLO || f.value != 1) {
+        delete r;
+        return nullptr;
+    }
+    return r;
+}
+
+void spike_remote_close(void *remote)
+{
+    remote_t *r = static_cast<remote_t *>(remote);
+    if (!r) return;
+    if (!r->broken && drain(r))
+        send_frame(r, REMOTE_BYE, 0, 0, 0);
+    delete r;
+}
+
+void spike_remote_set_check_config(void *remote, uint32_t flags, uint32_t xpr_mask, uint32_t fpr_mask)
+{
+    remote_t *r = as_remote(remote);
+    if (!r) return;
+    // ordered after the commits posted so far, as a local call would be
+    if (!send_pending(r) || !send_frame(r, REMOTE_CHECK_CONFIG, flags, xpr_mask, fpr_mask))
+        fail(r, 0);
+}
+
+int spike_remote_check_post(void *remote, const spike_commit_t *dut)
+{
+    remote_t *r = as_remote(remote);
+    if (!r || !dut) return -1;
+    r->pending.push_back(*dut);
+    if (r->pending.size() >= r->batch && !send_pending(r)) return fail(r, -1);
+    return 0;
+}
+
+int spike_remote_flush(void *remote)
+{
+    remote_t *r = as_remote(remote);
+    if (!r) return -1;
+    return send_pending(r) ? 0 : fail(r, -1);
+}
+
+int spike_remote_check_poll(void *remote, spike_remote_result_t *out, int max, int wait)
+{
+    remote_t *r = as_remote(remote);
+    if (!r || !out || max < 0) return -1;
+    if (wait && r->results.empty()) {
+        if (!send_pending(r)) return fail(r, -1);
+        if (r->in_flight && !receive_results(r)) return fail(r, -1);
+    }
+    // take the replies that have already arrived, without blocking
+    pollfd p = { r->fd, POLLIN, 0 };
+    while (r->in_flight && (int)r->results.size() < max && poll(&p, 1, 0) == 1)
+        if (!receive_results(r)) return fail(r, -1);
+    int n = std::min<int>(max, r->results.size());
+    std::copy_n(r->results.begin(), n, out);
+    r->results.erase(r->results.begin(), r->results.begin() + n);
+    return n;
+}
+
+int spike_remote_step(void *remote, uint64_t n)
+{
+    remote_t *r = as_remote(remote);
+    if (!r) return -1;
+    remote_frame_t f;
+    if (!drain(r) || !send_frame(r, REMOTE_STEP, 0, 0, (int64_t)n) ||
+        !remote_recv_frame(r->fd, &f) || f.op != REMOTE_STEP)
+        return fail(r, -1);
+    return (int)f.value;
+}
+
+uint64_t spike_remote_get_pc(void *remote, unsigned hartid)
+{
+    remote_t *r = as_remote(remote);
+    if (!r) return 0;
+    remote_frame_t f;
+    if (!drain(r) || !send_frame(r, REMOTE_PC, 0, hartid, 0) ||
+        !remote_recv_frame(r->fd, &f) || f.op != REMOTE_PC)
+        return fail(r, 0);
+    return (uint64_t)f.value;
+}
+
+int spike_remote_get_all_gprs(void *remote, unsigned hartid, uint64_t out[32])
+{
+    remote_t *r = as_remote(remote);
+    if (!r || !out) return 0;
+    remote_frame_t f;
+    char buf[32 * 8];
+    if (!drain(r) || !send_frame(r, REMOTE_GPRS, 0, hartid, 0) ||
+        !remote_recv_frame(r->fd, &f) || f.op != REMOTE_GPRS || f.len != sizeof(buf) ||
+        !remote_recv(r->fd, buf, sizeof(buf)))
+        return fail(r, 0);
+    remote_reader_t gprs(buf, sizeof(buf));
+    for (int i = 0; i < 32; i++)
+        out[i] = gprs.u64();
+    return (int)f.value;
+}
@@ -0,0 +1,204 @@
+// dpi_remote.h
+// Wire format of the remote DPI mode, between the spike_remote_* client in
+// libspike_dpi.so and spike_dpi_server. A frame is a header of
+// REMOTE_FRAME_BYTES and len payload bytes. Every field is written on its
+// own, little-endian, so the two ends need not share byte order or struct
+// layout; the hello frame checks that they speak the same REMOTE_VERSION.
+
+#ifndef _SPIKE_DPI_REMOTE_H
+#define _SPIKE_DPI_REMOTE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+#include <vector>
+
+#include "spike_dpi.h"
+
+#define REMOTE_MAGIC 0x524b5053  // "SPKR"
+#define REMOTE_VERSION 2
+#define REMOTE_FRAME_BYTES 32
+
+enum remote_op_t : uint32_t {
+    REMOTE_HELLO,        // payload: ELF path; count: REMOTE_VERSION;
+                         // reply value: 1 if the instance was created, else 0
+    REMOTE_CHECK_CONFIG, // count: flags, arg: xpr_mask, value: fpr_mask; no reply
+    REMOTE_CHECK,        // payload: count commits (remote_put_commit); reply:
+                         // count results (i32 code, u32 length, report)
+    REMOTE_STEP,         // value: n; reply value: spike_step status of the last
+    REMOTE_PC,           // arg: hartid; reply value: pc
+    REMOTE_GPRS,         // arg: hartid; reply payload: 32 u64
+    REMOTE_BYE,          // no reply; the server deletes the instance
+};
+
+// The header, as u32 magic, op, count, arg, then u64 len, value
+struct remote_frame_t {
+    uint32_t magic;
+    uint32_t op;
+    uint32_t count;
+    uint32_t arg;
+    uint64_t len;
+    int64_t value;
+};
+
+// Bytes to send, appended a field at a time
+struct remote_buf_t {
+    std::vector<char> data;
+
+    void u32(uint32_t v) { put(v, 4); }
+    void u64(uint64_t v) { put(v, 8); }
+    void bytes(const void *p, size_t n) { data.insert(data.end(), (const char *)p, (const char *)p + n); }
+
+    void put(uint64_t v, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            data.push_back(char(v >> (8 * i)));
+    }
+};
+
+// Fields read back from received bytes; ok turns false on reading past the
+// end, and what is read after that is 0
+struct remote_reader_t {
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    remote_reader_t(const void *data, size_t len) : p((const char *)data), end(p + len) {}
+
+    uint32_t u32() { return (uint32_t)get(4); }
+    uint64_t u64() { return get(8); }
+
+    uint64_t get(size_t n)
+    {
+        if (size_t(end - p) < n) {
+            ok = false;
+            return 0;
+        }
+        uint64_t v = 0;
+        for (size_t i = 0; i < n; i++)
+            v |= uint64_t((uint8_t)p[i]) << (8 * i);
+        p += n;
+        return v;
+    }
+};
+
+static inline void remote_put_header(remote_buf_t &b, uint32_t op, uint32_t count, uint32_t arg,
+                                     uint64_t len, int64_t value)
+{
+    b.u32(REMOTE_MAGIC);
+    b.u32(op);
+    b.u32(count);
+    b.u32(arg);
+    b.u64(len);
+    b.u64((uint64_t)value);
+}
+
+// Only the register writes and accesses in use are sent
+static inline void remote_put_commit(remote_buf_t &b, const spike_commit_t &c)
+{
+    uint32_t n_regs = std::min<uint32_t>(c.n_regs, SPIKE_COMMIT_MAX_REGS);
+    uint32_t n_mems = std::min<uint32_t>(c.n_mems, SPIKE_COMMIT_MAX_MEMS);
+    b.u32(c.hartid);
+    b.u32(c.retired);
+    b.u64(c.pc);
+    b.u64(c.insn);
+    b.u64(c.npc);
+    b.u32(c.priv);
+    b.u32(c.overflow);
+    b.u32(n_regs);
+    for (uint32_t i = 0; i < n_regs; i++) {
+        b.u32(c.regs[i].type);
+        b.u32(c.regs[i].idx);
+        b.u64(c.regs[i].value[0]);
+        b.u64(c.regs[i].value[1]);
+    }
+    b.u32(n_mems);
+    for (uint32_t i = 0; i < n_mems; i++) {
+        b.u64(c.mems[i].addr);
+        b.u64(c.mems[i].value);
+        b.u32(c.mems[i].size);
+        b.u32(c.mems[i].is_store);
+    }
+}
+
+static inline bool remote_get_commit(remote_reader_t &r, spike_commit_t &c)
+{
+    c = {};
+    c.hartid = r.u32();
+    c.retired = r.u32();
+    c.pc = r.u64();
+    c.insn = r.u64();
+    c.npc = r.u64();
+    c.priv = r.u32();
+    c.overflow = r.u32();
+    c.n_regs = r.u32();
+    if (c.n_regs > SPIKE_COMMIT_MAX_REGS) return false;
+    for (uint32_t i = 0; i < c.n_regs; i++) {
+        c.regs[i].type = r.u32();
+        c.regs[i].idx = r.u32();
+        c.regs[i].value[0] = r.u64();
+        c.regs[i].value[1] = r.u64();
+    }
+    c.n_mems = r.u32();
+    if (c.n_mems > SPIKE_COMMIT_MAX_MEMS) return false;
+    for (uint32_t i = 0; i < c.n_mems; i++) {
+        c.mems[i].addr = r.u64();
+        c.mems[i].value = r.u64();
+        c.mems[i].size = r.u32();
+        c.mems[i].is_store = r.u32();
+    }
+    return r.ok;
+}
+
+static inline bool remote_send(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static inline bool remote_recv(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static inline bool remote_send_frame(int fd, uint32_t op, uint32_t count, uint32_t arg,
+                                     int64_t value, const void *payload = nullptr, uint64_t len = 0)
+{
+    remote_buf_t b;
+    remote_put_header(b, op, count, arg, len, value);
+    b.bytes(payload, len);
+    return remote_send(fd, b.data.data(), b.data.size());
+}
+
+static inline bool remote_recv_frame(int fd, remote_frame_t *f)
+{
+    char buf[REMOTE_FRAME_BYTES];
+    if (!remote_recv(fd, buf, sizeof(buf))) return false;
+    remote_reader_t r(buf, sizeof(buf));
+    f->magic = r.u32();
+    f->op = r.u32();
+    f->count = r.u32();
+    f->arg = r.u32();
+    f->len = r.u64();
+    f->value = (int64_t)r.u64();
+    return f->magic == REMOTE_MAGIC;
+}
+
+#endif
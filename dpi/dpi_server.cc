@@ -0,0 +1,152 @@
+// dpi_server.cc
+// spike_dpi_server: hosts Spike instances for the remote DPI mode
+// (spike_remote_* in spike_dpi.h), one per connection, each on a thread
+// of its own. A bare port listens on the loopback interface only; give a
+// host (0.0.0.0, [::] or a name) to take connections from other machines.
+//   ./spike_dpi_server <port> | <host>:<port> | unix:<path>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "dpi_remote.h"
+#include "spike_dpi.h"
+
+static void serve(int fd)
+{
+    void *handle = nullptr;
+    std::vector<char> buf;
+    remote_frame_t f;
+
+    while (remote_recv_frame(fd, &f)) {
+        if (f.len > (uint64_t(1) << 30)) break;
+        buf.resize(f.len);
+        if (f.len && !remote_recv(fd, buf.data(), f.len)) break;
+
+        if (f.op == REMOTE_HELLO) {
+            bool ok = !handle && f.count == REMOTE_VERSION;
+            if (ok) handle = spike_create(std::string(buf.begin(), buf.end()).c_str());
+            if (!remote_send_frame(fd, REMOTE_HELLO, 0, 0, handle ? 1 : 0) || !handle) break;
+        } else if (!handle || f.op == REMOTE_BYE) {
+            break;
+        } else if (f.op == REMOTE_CHECK_CONFIG) {
+            spike_set_check_config(handle, f.count, f.arg, (uint32_t)f.value);
+        } else if (f.op == REMOTE_CHECK) {
+            remote_reader_t in(buf.data(), buf.size());
+            remote_buf_t results;
+            char report[256];
+            uint32_t i = 0;
+            for (spike_commit_t c; i < f.count && remote_get_commit(in, c); i++) {
+                report[0] = 0;
+                int code = spike_check_commit(handle, &c, report, sizeof(report));
+                uint32_t report_len = code == SPIKE_CHECK_OK ? 0 : strlen(report);
+                results.u32((uint32_t)code);
+                results.u32(report_len);
+                results.bytes(report, report_len);
+            }
+            if (i != f.count || in.p != in.end) break;
+            // one write for the whole reply
+            if (!remote_send_frame(fd, REMOTE_CHECK, f.count, 0, 0, results.data.data(), results.data.size()))
+                break;
+        } else if (f.op == REMOTE_STEP) {
+            int status = 0;
+            for (int64_t i = 0; i < f.value && status >= 0; i++)
+                status = spike_step(handle);
+            if (!remote_send_frame(fd, REMOTE_STEP, 0, 0, status)) break;
+        } else if (f.op == REMOTE_PC) {
+            if (!remote_send_frame(fd, REMOTE_PC, 0, 0, (int64_t)spike_get_pc(handle, f.arg))) break;
+        } else if (f.op == REMOTE_GPRS) {
+            uint64_t gprs[32] = {0};
+            int n = spike_get_all_gprs(handle, f.arg, gprs);
+            remote_buf_t out;
+            for (uint64_t x : gprs)
+                out.u64(x);
+            if (!remote_send_frame(fd, REMOTE_GPRS, 0, 0, n, out.data.data(), out.data.size())) break;
+        } else {
+            break;
+        }
+    }
+
+    if (handle) spike_delete(handle);
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <port> | <host>:<port> | unix:<path>\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string addr = argv[1];
+    bool unix_socket = addr.compare(0, 5, "unix:") == 0;
+    int lfd = -1, rc = -1;
+    if (unix_socket) {
+        sockaddr_un sa = {};
+        sa.sun_family = AF_UNIX;
+        if (addr.size() - 5 >= sizeof(sa.sun_path)) {
+            fprintf(stderr, "socket path too long: %s\n", addr.c_str() + 5);
+            return 1;
+        }
+        strcpy(sa.sun_path, addr.c_str() + 5);
+        unlink(sa.sun_path);
+        lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (lfd >= 0)
+            rc = bind(lfd, (sockaddr *)&sa, sizeof(sa));
+    } else {
+        // the instances run whatever ELF a client names, so other hosts
+        // are only let in when asked for
+        size_t colon = addr.rfind(':');
+        std::string host = colon == std::string::npos ? "127.0.0.1" : addr.substr(0, colon);
+        std::string port = colon == std::string::npos ? addr : addr.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+        addrinfo hints = {}, *res = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        int gai = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+        if (gai != 0) {
+            fprintf(stderr, "%s: %s\n", addr.c_str(), gai_strerror(gai));
+            return 1;
+        }
+        for (addrinfo *ai = res; ai && rc < 0; ai = ai->ai_next) {
+            if (lfd >= 0) close(lfd);
+            lfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (lfd < 0) continue;
+            int one = 1;
+            setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            rc = bind(lfd, ai->ai_addr, ai->ai_addrlen);
+        }
+        freeaddrinfo(res);
+    }
+    if (lfd < 0 || rc < 0 || listen(lfd, 64) < 0) {
+        perror(addr.c_str());
+        return 1;
+    }
+
+    for (;;) {
+        int fd = accept(lfd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            return 1;
+        }
+        if (!unix_socket) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        std::thread(serve, fd).detach();
+    }
+}
@@ -4,24 +4,760 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <cinttypes>
 #include <cstring>
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 #include <optional>
 #include <memory>
 #include <iostream>
 #include <algorithm>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <cerrno>
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc
+#endif
 
 #include "sim.h"        // sim_t, processor_t, device / memory types
+#include "mmu.h"        // mmu_t::probe_insn
+#include "disasm.h"     // csr_name
 #include "config.h"     // cfg_t
+#include "commit_trace.h" // commit_trace_reader_t
+#include "mem_image.h"    // load_mem_image
+#include "softfloat.h"  // softfloat_setHostFP
+#include "host_cpu.h"   // host_simd_name
+#include "call_tracer.h" // call_tracer_t
+#include "coverage.h"    // coverage_t
+#include "input_log.h"   // input_log_t
+#include "rocc.h"        // rocc_insn_union_t
+#include "state_export.h" // export_fprs, export_vregs
+#include "decode_macros.h" // PC_SERIALIZE_AFTER
 #include "spdlog_wrapper.h"
+#include <spdlog/async.h>
+#include "spike_dpi.h"
 
 using namespace std;
 
+// Turns the commit log of each retired instruction into a spike_commit_t,
+// appending to the buffer of the spike_step_commit/spike_step_n call in
+// progress. Commits past the buffer capacity, or outside any such call, are
+// dropped.
+class commit_capture_t : public commit_observer_t {
+public:
+    spike_commit_t *buf = nullptr;
+    size_t cap = 0;
+    size_t count = 0;
+
+    void begin(spike_commit_t *b, size_t c) { buf = b; cap = c; count = 0; }
+    void end() { buf = nullptr; cap = 0; count = 0; }
+    void on_commit(processor_t *p, reg_t pc, insn_t insn) override;
+};
+
+// Folds the register and memory writes of each retired instruction into a
+// per-hart 64-bit hash, for spike_enable_state_hash. See spike_dpi.h for the
+// exact recipe the DUT side reproduces.
+class state_hash_t : public commit_observer_t {
+public:
+    struct hart_t {
+        uint64_t hash = SPIKE_STATE_HASH_SEED;
+        uint64_t count = 0;
+    };
+    uint32_t types = 0;            // bit per SPIKE_REG_* type hashed
+    std::vector<hart_t> harts;     // by hart id
+
+    void on_commit(processor_t *p, reg_t pc, insn_t insn) override;
+
+private:
+    static uint64_t mix(uint64_t h, uint64_t x) { return (h ^ x) * 0x100000001b3ull; }
+};
+
+// Flags stores to the HTIF tohost word. Hooked on every hart as a memory
+// tracer, so only the tohost page's store TLB entries carry the tracer flag
+// and all other stores keep the fast path.
+class tohost_watch_t : public memtracer_t {
+public:
+    reg_t addr = 0;
+    bool registered = false;
+    std::atomic<bool> hit{false};
+    // Stopped on a hit while spike_run_until waits for tohost
+    const std::vector<processor_t*> *stop_harts = nullptr;
+
+    bool interested_in_range(uint64_t begin, uint64_t end, access_type type) override
+    {
+        return type == STORE && begin < addr + 8 && addr < end;
+    }
+    void trace(uint64_t a, size_t bytes, access_type type) override
+    {
+        if (type == STORE && a < addr + 8 && addr < a + bytes) {
+            hit.store(true, std::memory_order_release);
+            if (stop_harts)
+                for (processor_t *p : *stop_harts)
+                    if (p) p->request_stop();
+        }
+    }
+    void clean_invalidate(uint64_t, size_t, bool, bool) override {}
+};
+
+// Forwards one hart's memory accesses to a spike_set_mem_observer callback
+class dpi_mem_observer_t : public mmu_observer_t {
+public:
+    dpi_mem_observer_t(processor_t *p, spike_mem_observer_fn fn, void *user)
+        : p(p), fn(fn), user(user) { p->get_mmu()->set_observer(this); }
+    ~dpi_mem_observer_t() override { p->get_mmu()->set_observer(nullptr); }
+
+    void fetch(reg_t addr, insn_bits_t insn, reg_t len) override
+    {
+        uint64_t bits = insn;
+        fn(user, p->get_id(), SPIKE_MEM_FETCH, addr, &bits, len);
+    }
+    void load(reg_t addr, const uint8_t *bytes, reg_t len) override
+    {
+        fn(user, p->get_id(), SPIKE_MEM_LOAD, addr, bytes, len);
+    }
+    void store(reg_t addr, const uint8_t *bytes, reg_t len) override
+    {
+        fn(user, p->get_id(), SPIKE_MEM_STORE, addr, bytes, len);
+    }
+
+private:
+    processor_t *p;
+    spike_mem_observer_fn fn;
+    void *user;
+};
+
+// Run-ahead state: a worker thread steps the golden model ahead of the DUT
+// and hands commit records to spike_check_commit through a single-producer,
+// single-consumer ring. The ring capacity is the run-ahead horizon.
+//
+// The worker parks at a barrier entry in front of anything the DUT must
+// drive (pending interrupts, MMIO accesses); the consumer then steps that
+// instruction itself and releases the worker. Calls that read hart state
+// pause it between instructions with runahead_pause_t, and so see the
+// model as of the last record the worker produced.
+struct runahead_t {
+    enum kind_t { COMMIT, BARRIER };
+    struct entry_t {
+        kind_t kind;
+        spike_commit_t rec;
+    };
+
+    std::vector<entry_t> ring;
+    std::atomic<uint64_t> head{0};      // next entry to pop, written by the consumer
+    std::atomic<uint64_t> tail{0};      // next entry to fill, written by the worker
+    std::atomic<uint32_t> wake{0};      // bumped whenever the worker may proceed
+    std::atomic<bool> blocked{false};   // worker is parked behind a barrier entry
+    std::atomic<bool> stop{false};
+    std::atomic<bool> pause{false};     // set while a caller wants the worker parked
+    std::thread worker;
+    std::mutex pause_lock;
+    std::condition_variable pause_cv;
+    bool parked = false;                // guarded by pause_lock
+
+    explicit runahead_t(size_t horizon) : ring(horizon) {}
+
+    bool running() const { return worker.joinable(); }
+    bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+    void wake_worker()
+    {
+        wake.fetch_add(1, std::memory_order_release);
+        wake.notify_one();
+    }
+
+    void halt()
+    {
+        if (!running()) return;
+        stop.store(true, std::memory_order_release);
+        wake_worker();
+        worker.join();
+    }
+
+    // Called by the worker between instructions while pause is set
+    void park()
+    {
+        std::unique_lock<std::mutex> lk(pause_lock);
+        parked = true;
+        pause_cv.notify_all();
+        pause_cv.wait(lk, [&]{ return !pause.load(std::memory_order_acquire); });
+        parked = false;
+    }
+};
+
+// Keeps the run-ahead worker, if any, parked between instructions for its
+// lifetime, so the caller may read (or write) hart state.
+class runahead_pause_t {
+public:
+    explicit runahead_pause_t(runahead_t *ra) : ra(ra && ra->running() ? ra : nullptr)
+    {
+        if (!this->ra) return;
+        std::unique_lock<std::mutex> lk(this->ra->pause_lock);
+        this->ra->pause.store(true, std::memory_order_release);
+        this->ra->wake_worker();
+        this->ra->pause_cv.wait(lk, [&]{ return this->ra->parked; });
+    }
+    ~runahead_pause_t()
+    {
+        if (!ra) return;
+        {
+            std::lock_guard<std::mutex> lk(ra->pause_lock);
+            ra->pause.store(false, std::memory_order_release);
+        }
+        ra->pause_cv.notify_all();
+    }
+    runahead_pause_t(const runahead_pause_t&) = delete;
+    runahead_pause_t& operator=(const runahead_pause_t&) = delete;
+private:
+    runahead_t *ra;
+};
+
+// A forked copy of the whole process, parked inside spike_checkpoint until
+// spike_restore wakes it. The kernel's copy-on-write keeps it cheap.
+struct checkpoint_t {
+    int id;
+    pid_t pid;
+    int wake_fd;        // write end of the child's wake pipe
+};
+
+static void checkpoint_discard(const checkpoint_t &c)
+{
+    close(c.wake_fd);
+    kill(c.pid, SIGKILL);
+    waitpid(c.pid, nullptr, 0);
+}
+
+// Pre-recorded golden trace (spike --commit-trace) consumed by an instance
+// opened with spike_open_replay, mapped read-only.
+struct trace_replay_t {
+    void *data = MAP_FAILED;
+    size_t len = 0;
+    std::unique_ptr<commit_trace_reader_t> reader;
+    commit_trace_record_t rec;
+
+    ~trace_replay_t() { if (data != MAP_FAILED) munmap(data, len); }
+};
+
+// The comparator rules of spike_load_check_rules, compiled so that a
+// commit looks up what it may differ in rather than matching the rules.
+// ignore masks hold the bits that are not compared; a copy rule compares
+// nothing and has the DUT's value written into the golden model instead.
+struct check_rules_t {
+    struct rule_t {
+        uint64_t ignore = 0;
+        bool copy = false;
+        void add(uint64_t mask, bool c) { ignore |= mask; copy |= c; }
+    };
+    // by CSR address: its writes, and the rd of csrr* instructions reading it
+    std::vector<rule_t> csr_write = std::vector<rule_t>(4096);
+    std::vector<rule_t> csr_read = std::vector<rule_t>(4096);
+    // rd or fd of instructions with (insn & mask) == match, by the major
+    // opcode (bits 6:0) they can match
+    struct insn_rule_t { uint32_t match, mask; rule_t rule; };
+    std::vector<std::vector<insn_rule_t>> insns = std::vector<std::vector<insn_rule_t>>(128);
+    // rd of loads from [begin, end), whose values are not compared either.
+    // Once the file is read (index_load_rules), the ranges are disjoint and
+    // sorted, overlapping rules merged, for a binary search by address.
+    struct load_rule_t { uint64_t begin, end; rule_t rule; };
+    std::vector<load_rule_t> loads;
+};
+
+// Calls into the library by entry point, for spike_set_call_profile. Time
+// is counted in ticks of the TSC on x86 and in nanoseconds elsewhere, and
+// converted with the rate seen since the profile started.
+struct call_profile_t {
+    struct entry_t {
+        uint64_t calls = 0;
+        uint64_t ticks = 0;         // in the call, lock wait included
+        uint64_t wait_ticks = 0;    // waiting for the instance or hart lock
+        uint64_t max_ticks = 0;
+        uint64_t hist[64] = {};     // calls by floor(log2(ticks))
+    };
+    std::string path;               // written at spike_delete, stderr if empty
+    std::mutex lock;                // per-hart calls run concurrently
+    // keyed by the function name of the guard, which is a string literal
+    std::unordered_map<const char*, entry_t> entries;
+    uint64_t start_ticks = now();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void add(const char *fn, uint64_t ticks, uint64_t wait)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        entry_t &e = entries[fn];
+        e.calls++;
+        e.ticks += ticks;
+        e.wait_ticks += wait;
+        e.max_ticks = std::max(e.max_ticks, ticks);
+        e.hist[ticks ? 63 - __builtin_clzll(ticks) : 0]++;
+    }
+
+    // One line per entry point, costliest first, then its histogram
+    void write()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        FILE *f = path.empty() ? stderr : fopen(path.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "[dpi] call profile: cannot open %s\n", path.c_str());
+            return;
+        }
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        uint64_t ticks = now() - start_ticks;
+        double ns_per_tick = ticks ? ns / (double)ticks : 1.0;
+
+        std::vector<std::pair<const char*, const entry_t*>> order;
+        for (const auto &e : entries) order.push_back({e.first, &e.second});
+        std::sort(order.begin(), order.end(),
+                  [](const auto &a, const auto &b) { return a.second->ticks > b.second->ticks; });
+        fprintf(f, "[dpi] call profile over %.3f s: calls, total and lock wait ms, mean and max us\n", ns / 1e9);
+        for (const auto &[fn, e] : order) {
+            fprintf(f, "%-32s %12" PRIu64 " %12.3f %12.3f %10.3f %10.3f\n", fn, e->calls,
+                    e->ticks * ns_per_tick / 1e6, e->wait_ticks * ns_per_tick / 1e6,
+                    e->ticks * ns_per_tick / 1e3 / e->calls, e->max_ticks * ns_per_tick / 1e3);
+            std::string hist;
+            for (int b = 0; b < 64; ++b) {
+                if (!e->hist[b]) continue;
+                char bucket[64];
+                snprintf(bucket, sizeof(bucket), " <%.0fns:%" PRIu64, (double)(2ull << b) * ns_per_tick, e->hist[b]);
+                hist += bucket;
+            }
+            fprintf(f, "  %s\n", hist.c_str());
+        }
+        if (f != stderr) fclose(f);
+    }
+};
+
+// One golden model instance. SystemVerilog only ever sees it as a chandle.
+// Each instance owns its configuration, memories and simulator, and has its
+// own lock, so independent testbenches in one process never contend.
+struct spike_ctx_t {
+    // Held exclusively by ordinary calls; spike_step_hart holds it shared
+    // plus the stepped hart's entry in hart_mutex, so different harts can
+    // advance on different threads.
+    std::shared_mutex mutex;
+    std::vector<std::unique_ptr<std::mutex>> hart_mutex;
+    std::string isa;
+    std::string priv;
+    cfg_t cfg;
+    std::vector<std::pair<reg_t, abstract_mem_t*>> mems;
+    std::unique_ptr<sim_t> sim;
+    std::vector<processor_t*> harts;   // indexed by hartid, null for holes
+    reg_t reset_pc = 0;                // pc the harts start from
+
+    // CSRs reported by spike_get_snapshot, in caller order
+    std::vector<uint32_t> snapshot_csrs;
+
+    // CSRs resolved by spike_resolve_csr; the index is the handle. Reset
+    // recreates the CSR objects, so spike_reset binds them again.
+    struct csr_handle_t {
+        unsigned hartid;
+        uint32_t addr;
+        csr_t_p csr;
+    };
+    std::vector<csr_handle_t> csr_handles;
+
+    // Set when a single thread owns the handle; entry points then skip the
+    // instance lock entirely.
+    bool lockstep = false;
+
+    // Installed on every hart by the first spike_step_commit
+    commit_capture_t commit_capture;
+    bool capturing = false;
+
+    // spike_set_mismatch_history: the last history_len golden commits of
+    // each hart, written in place by spike_check_commit, and where they go
+    // on a mismatch (stderr if empty)
+    struct history_t {
+        std::vector<spike_commit_t> ring;
+        uint64_t n = 0;
+    };
+    size_t history_len = 0;
+    std::vector<history_t> history;
+    std::string history_path;
+
+    // Set by spike_enable_state_hash; installed on every hart the first time
+    state_hash_t state_hash;
+    bool state_hashing = false;
+
+    // Set by spike_set_check_sampling; sample_rng is 0 for fixed windows.
+    // sample_tail is what is left of the current period after its window.
+    uint64_t sample_period = 0, sample_window = 0;
+    uint64_t sample_rng = 0, sample_tail = 0;
+
+    // Last nonzero tohost value, latched until spike_ack_tohost
+    tohost_watch_t tohost_watch;
+    std::atomic<uint64_t> tohost{0};
+
+    // What spike_check_commit compares
+    uint32_t check_flags = SPIKE_CHECK_DEFAULT;
+    uint32_t check_xpr_mask = ~0u;
+    uint32_t check_fpr_mask = ~0u;
+    std::vector<uint32_t> check_csr_ignore;
+    // Set by spike_load_check_rules
+    std::unique_ptr<check_rules_t> check_rules;
+
+    // Set by spike_set_runahead; kept after the worker stops until its
+    // records have been consumed.
+    std::unique_ptr<runahead_t> runahead;
+
+    // Set by spike_set_guest_profile
+    std::unique_ptr<guest_profiler_t> guest_profiler;
+
+    // Set by spike_set_metrics, which also has the calls taking the
+    // instance lock counted and timed
+    std::unique_ptr<metrics_writer_t> metrics;
+    std::atomic<uint64_t> dpi_calls{0}, dpi_ns{0};
+    // Set by spike_set_call_profile
+    std::unique_ptr<call_profile_t> call_profile;
+    // CALL_TIME_* bits of what call_timer_t records
+    std::atomic<unsigned> call_timing{0};
+
+    // Set by spike_set_call_trace, by hart id
+    std::map<unsigned, std::unique_ptr<call_tracer_t>> call_tracers;
+
+    // Set by spike_set_coverage, by hart id
+    std::map<unsigned, std::unique_ptr<coverage_t>> coverage;
+    // Set by spike_set_input_log
+    std::unique_ptr<input_log_t> input_log;
+
+    // Set by spike_set_mem_observer, by hart id
+    std::map<unsigned, std::unique_ptr<dpi_mem_observer_t>> mem_observers;
+
+    // spike_enable_rocc: the requests not yet taken, and one extension per
+    // hart, which the harts refer to until sim is deleted
+    std::deque<spike_rocc_req_t> rocc_queue;
+    uint64_t rocc_seq = 0;
+    std::vector<std::unique_ptr<extension_t>> rocc;
+
+    // DUT-driven MMIO window and interrupt events. dut_irq_pending mirrors
+    // dut_sync->pending_interrupts(), and dut_irq_due[h] dut_sync->next_due(h)
+    // for the run-ahead worker.
+    std::shared_ptr<dut_sync_device_t> dut_sync;
+    reg_t dut_sync_base = 0;
+    bool dut_sync_mapped = false;
+    std::atomic<bool> dut_irq_pending{false};
+    std::vector<std::atomic<uint64_t>> dut_irq_due;
+
+    // Shared-memory view published after every step (spike_publish_state).
+    // shm_csr_handles index csr_handles, n_harts x n_csrs, hart-major.
+    spike_shm_t *shm = nullptr;
+    size_t shm_bytes = 0;
+    std::string shm_name;
+    std::vector<int> shm_csr_handles;
+
+    // Set instead of sim for instances opened with spike_open_replay
+    std::unique_ptr<trace_replay_t> replay;
+
+    // Rolling window of checkpoints, oldest first
+    std::deque<checkpoint_t> checkpoints;
+    size_t checkpoint_window = 4;
+    int next_checkpoint_id = 1;
+
+    // Lines the harts have written that spike_take_dirty_lines has not
+    // returned yet (spike_track_stores)
+    std::vector<reg_t> dirty_lines;
+    reg_t dirty_line_size = 0;
+    // spike_get_page_hashes results by page, good while stores are tracked
+    // and sim->external_writes is page_hash_writes
+    std::unordered_map<reg_t, uint64_t> page_hashes;
+    uint64_t page_hash_writes = 0;
+
+    ~spike_ctx_t()
+    {
+        for (auto &c : checkpoints) checkpoint_discard(c);
+        if (shm) {
+            munmap(shm, shm_bytes);
+            shm_unlink(shm_name.c_str());
+        }
+        if (runahead) runahead->halt();
+        guest_profiler.reset();
+        metrics.reset();
+        if (call_profile) call_profile->write();
+        call_tracers.clear();
+        coverage.clear();
+        input_log.reset();
+        mem_observers.clear();
+        // sim_t refers to cfg and mems, so it must go first
+        sim.reset();
+        for (auto &m : mems) delete m.second;
+    }
+};
+
+static inline spike_ctx_t *as_ctx(void *handle)
+{
+    return static_cast<spike_ctx_t*>(handle);
+}
+
+// The custom-0..3 opcodes of a hart under spike_enable_rocc, all handled by
+// dpi_rocc_insn.
+class dpi_rocc_t : public extension_t {
+public:
+    explicit dpi_rocc_t(spike_ctx_t *ctx) : ctx(ctx) {}
+    const char *name() const override { return "dpi_rocc"; }
+    std::vector<insn_desc_t> get_instructions(const processor_t &) override;
+    std::vector<disasm_insn_t*> get_disasms(const processor_t *) override { return {}; }
+
+    spike_ctx_t *ctx;
+};
+
+static reg_t dpi_rocc_insn(processor_t *p, insn_t insn, reg_t pc)
+{
+    spike_ctx_t *ctx = static_cast<dpi_rocc_t*>(p->get_extension("dpi_rocc"))->ctx;
+    state_t *state = p->get_state();
+    rocc_insn_union_t u;
+    u.i = insn;
+
+    spike_rocc_req_t r = {};
+    r.seq = ctx->rocc_seq++;
+    r.pc = pc;
+    r.rs1_val = u.r.xs1 ? state->XPR[insn.rs1()] : 0;
+    r.rs2_val = u.r.xs2 ? state->XPR[insn.rs2()] : 0;
+    r.hartid = p->get_id();
+    r.insn = insn.bits();
+    ctx->rocc_queue.push_back(r);
+
+    if (u.r.xd && insn.rd() != 0) {
+        p->set_xpr_pending(p->get_xpr_pending() | reg_t(1) << insn.rd());
+        // Serializing ends a fast-loop chain, so the hart re-checks
+        // slow_path() and watches for the pending register from here on.
+        state->pc = pc + 4;
+        return PC_SERIALIZE_AFTER;
+    }
+    return pc + 4;
+}
+
+std::vector<insn_desc_t> dpi_rocc_t::get_instructions(const processor_t &)
+{
+    std::vector<insn_desc_t> insns;
+    for (insn_bits_t opcode : {ROCC_OPCODE0, ROCC_OPCODE1, ROCC_OPCODE2, ROCC_OPCODE3})
+        insns.push_back({opcode, ROCC_OPCODE_MASK,
+                         dpi_rocc_insn, dpi_rocc_insn, dpi_rocc_insn, dpi_rocc_insn,
+                         dpi_rocc_insn, dpi_rocc_insn, dpi_rocc_insn, dpi_rocc_insn});
+    return insns;
+}
+
+// Counts a DPI call and its host time, lock waits included, for
+// spike_set_metrics (CALL_TIME_METRICS) and spike_set_call_profile
+// (CALL_TIME_PROFILE). With neither on it costs one load.
+enum { CALL_TIME_METRICS = 1, CALL_TIME_PROFILE = 2 };
+class call_timer_t {
+public:
+    call_timer_t(spike_ctx_t *ctx, const char *fn)
+        : ctx(ctx), fn(fn), mode(ctx->call_timing.load(std::memory_order_relaxed)) {}
+    void start()
+    {
+        if (likely(!mode)) return;
+        if (mode & CALL_TIME_METRICS) t0 = std::chrono::steady_clock::now();
+        if (mode & CALL_TIME_PROFILE) c0 = call_profile_t::now();
+    }
+    void locked() { if (unlikely(mode & CALL_TIME_PROFILE)) c1 = call_profile_t::now(); }
+    void stop()
+    {
+        if (likely(!mode)) return;
+        if (mode & CALL_TIME_METRICS) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0);
+            ctx->dpi_calls.fetch_add(1, std::memory_order_relaxed);
+            ctx->dpi_ns.fetch_add((uint64_t)ns.count(), std::memory_order_relaxed);
+        }
+        // the profile is only dropped under the exclusive instance lock
+        if ((mode & CALL_TIME_PROFILE) && ctx->call_profile)
+            ctx->call_profile->add(fn, call_profile_t::now() - c0, c1 - c0);
+    }
+private:
+    spike_ctx_t *ctx;
+    const char *fn;
+    unsigned mode;
+    std::chrono::steady_clock::time_point t0;
+    uint64_t c0 = 0, c1 = 0;
+};
+
+// Takes the instance lock unless the instance is in lockstep mode. The
+// entry point it is taken in is what spike_set_call_profile reports.
+class ctx_guard_t {
+public:
+    explicit ctx_guard_t(spike_ctx_t *ctx, const char *fn = __builtin_FUNCTION())
+        : m(ctx->lockstep ? nullptr : &ctx->mutex), timing(ctx, fn)
+    {
+        timing.start();
+        if (m) m->lock();
+        timing.locked();
+    }
+    ~ctx_guard_t() { timing.stop(); if (m) m->unlock(); }
+    ctx_guard_t(const ctx_guard_t&) = delete;
+    ctx_guard_t& operator=(const ctx_guard_t&) = delete;
+private:
+    std::shared_mutex *m;
+    call_timer_t timing;
+};
+
+// Shares the instance with other per-hart calls and owns one hart.
+class hart_guard_t {
+public:
+    hart_guard_t(spike_ctx_t *ctx, std::mutex *hart, const char *fn = __builtin_FUNCTION())
+        : m(ctx->lockstep ? nullptr : &ctx->mutex), h(hart), timing(ctx, fn)
+    {
+        timing.start();
+        if (m) m->lock_shared();
+        h->lock();
+        timing.locked();
+    }
+    ~hart_guard_t() { timing.stop(); h->unlock(); if (m) m->unlock_shared(); }
+    hart_guard_t(const hart_guard_t&) = delete;
+    hart_guard_t& operator=(const hart_guard_t&) = delete;
+private:
+    std::shared_mutex *m;
+    std::mutex *h;
+    call_timer_t timing;
+};
+
+// True while run-ahead owns the model or still holds unconsumed records.
+static inline bool ctx_running_ahead(const spike_ctx_t *ctx)
+{
+    return ctx->runahead && (ctx->runahead->running() || !ctx->runahead->empty());
+}
+
+// Applies due DUT interrupt events. Returns how many instructions may run
+// before the next one. Caller holds the instance lock and owns the model.
+static void ctx_update_irq_due(spike_ctx_t *ctx)
+{
+    for (size_t h = 0; h < ctx->dut_irq_due.size(); h++)
+        ctx->dut_irq_due[h].store(ctx->dut_sync->next_due(h), std::memory_order_release);
+}
+
+static reg_t ctx_sync_irqs(spike_ctx_t *ctx)
+{
+    if (!ctx->dut_irq_pending.load(std::memory_order_relaxed)) return reg_t(-1);
+    reg_t next = ctx->dut_sync->sync();
+    ctx->dut_irq_pending.store(ctx->dut_sync->pending_interrupts() != 0, std::memory_order_release);
+    ctx_update_irq_due(ctx);
+    return next;
+}
+
+static inline processor_t *ctx_hart(const spike_ctx_t *ctx, unsigned hartid)
+{
+    return hartid < ctx->harts.size() ? ctx->harts[hartid] : nullptr;
+}
+
+static csr_t_p ctx_find_csr(const spike_ctx_t *ctx, unsigned hartid, uint32_t addr)
+{
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return nullptr;
+    auto &csrmap = p->get_state()->csrmap;
+    auto it = csrmap.find(addr);
+    return it == csrmap.end() ? nullptr : it->second;
+}
+
+// Index of the csr_handles entry for the CSR, added if there is none yet,
+// so that republishing or resolving a CSR again does not grow the table
+static int ctx_csr_handle(spike_ctx_t *ctx, unsigned hartid, uint32_t addr)
+{
+    for (size_t i = 0; i < ctx->csr_handles.size(); ++i)
+        if (ctx->csr_handles[i].hartid == hartid && ctx->csr_handles[i].addr == addr)
+            return (int)i;
+    ctx->csr_handles.push_back({hartid, addr, ctx_find_csr(ctx, hartid, addr)});
+    return (int)ctx->csr_handles.size() - 1;
+}
+
+static int tohost_status(uint64_t tohost)
+{
+    if (!tohost) return SPIKE_TOHOST_NONE;
+    if (!(tohost & 1)) return SPIKE_TOHOST_SYSCALL;
+    return tohost == 1 ? SPIKE_TOHOST_PASS : SPIKE_TOHOST_FAIL;
+}
+
+// Latches tohost after the target stored to it and clears the word, as
+// htif_t::run does. Returns the latched status.
+static int ctx_poll_tohost(spike_ctx_t *ctx)
+{
+    if (ctx->tohost_watch.hit.exchange(false, std::memory_order_acquire)) {
+        char *host = ctx->sim->dpi_addr_to_mem(ctx->tohost_watch.addr);
+        target_endian<uint64_t> raw;
+        if (host) {
+            std::memcpy(&raw, host, sizeof raw);
+            if (uint64_t v = ctx->sim->from_target(raw)) {
+                ctx->tohost.store(v, std::memory_order_relaxed);
+                std::memset(host, 0, sizeof raw);
+                ctx->sim->external_writes++;
+            }
+        }
+    }
+    return tohost_status(ctx->tohost.load(std::memory_order_relaxed));
+}
+
+// Refreshes the shared-memory view. Caller owns the model.
+static void ctx_publish(spike_ctx_t *ctx)
+{
+    spike_shm_t *shm = ctx->shm;
+    const uint32_t n_csrs = shm->n_csrs;
+    for (uint32_t i = 0; i < shm->n_harts; ++i) {
+        spike_shm_hart_t *h = &shm->hart[i];
+        processor_t *p = ctx_hart(ctx, h->hartid);
+        if (!p) continue;
+        state_t *st = p->get_state();
+
+        // seqlock: odd while the record is being rewritten
+        uint32_t seq = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        h->pc = st->pc;
+        h->instret = st->minstret->read();
+        h->priv = (uint32_t)st->prv;
+        for (int r = 0; r < NXPR; ++r) h->xpr[r] = (uint64_t)st->XPR[r];
+        for (int r = 0; r < NFPR; ++r) {
+            uint64_t v = 0;
+            std::memcpy(&v, &st->FPR[r], std::min(sizeof(st->FPR[r]), sizeof(v)));
+            h->fpr[r] = v;
+        }
+        const int *handles = &ctx->shm_csr_handles[(size_t)i * n_csrs];
+        for (uint32_t c = 0; c < n_csrs; ++c) {
+            const csr_t *csr = ctx->csr_handles[handles[c]].csr.get();
+            h->csr[c] = csr ? (uint64_t)csr->read() : 0;
+        }
+
+        __atomic_store_n(&h->seq, seq + 2, __ATOMIC_RELEASE);
+    }
+}
+
+static void ctx_unpublish(spike_ctx_t *ctx)
+{
+    if (!ctx->shm) return;
+    munmap(ctx->shm, ctx->shm_bytes);
+    shm_unlink(ctx->shm_name.c_str());
+    ctx->shm = nullptr;
+    ctx->shm_bytes = 0;
+    ctx->shm_name.clear();
+    ctx->shm_csr_handles.clear();
+}
+
+// Protects the defaults/overrides below, which apply to the next spike_create.
 static std::mutex g_mutex;
-static sim_t *g_sim = nullptr;
 
 // Defaults and overrides
 static std::string g_isa_default = "RV64GC";
@@ -33,6 +769,19 @@ static std::optional<std::string> g_isa_override;
 static std::optional<uint64_t>    g_dram_base_override;
 static std::optional<size_t>      g_dram_size_override;
 static std::optional<uint64_t>    g_initial_pc_override;
+static size_t g_tlb_entries = 256;
+static size_t g_tlb_ways = 1;
+static size_t g_icache_entries = 1024;
+static size_t g_block_cache_entries = 0;
+static size_t g_vector_threads = 1;
+static bool g_machine_only = false;
+static size_t g_interleave = 5000;
+static size_t g_insns_per_rtc_tick = 100;
+static bool g_skip_idle_harts = false;
+static bool g_wfi_fast_forward = false;
+static size_t g_nharts = 1;
+static int g_mem_backend = SPIKE_MEM_SPARSE;
+static std::string g_mem_image;
 
 extern "C" {
 
@@ -50,6 +799,50 @@ void dpi_set_log_level(const char* level_cstr)
     else if (level == "off") spdlog::set_level(spdlog::level::off);
 }
 
+/* Async logging. The default logger is replaced by one posting to a
+   background thread, over the same sinks and at the same level; it is
+   flushed every second and on switching back. */
+int dpi_set_log_async(const char* policy_cstr, uint64_t queue_size)
+{
+    std::lock_guard<std::mutex> lk(g_mutex);
+    if (!policy_cstr) return -1;
+    std::string policy(policy_cstr);
+    bool async = true;
+    spdlog::async_overflow_policy overflow = spdlog::async_overflow_policy::block;
+    if (policy == "sync") async = false;
+    else if (policy == "block") overflow = spdlog::async_overflow_policy::block;
+    else if (policy == "overrun") overflow = spdlog::async_overflow_policy::overrun_oldest;
+#if SPDLOG_VERSION >= 11200
+    else if (policy == "discard") overflow = spdlog::async_overflow_policy::discard_new;
+#endif
+    else return -1;
+
+    try {
+        auto current = spdlog::default_logger();
+        auto &sinks = current->sinks();
+        current->flush();
+        std::shared_ptr<spdlog::logger> logger;
+        if (async) {
+            // drop the old pool only once no logger posts to it
+            spdlog::set_default_logger(std::make_shared<spdlog::logger>(
+                current->name(), sinks.begin(), sinks.end()));
+            spdlog::init_thread_pool(queue_size ? (size_t)queue_size : 8192, 1);
+            logger = std::make_shared<spdlog::async_logger>(
+                current->name(), sinks.begin(), sinks.end(), spdlog::thread_pool(), overflow);
+        } else {
+            logger = std::make_shared<spdlog::logger>(current->name(), sinks.begin(), sinks.end());
+        }
+        logger->set_level(current->level());
+        logger->flush_on(current->flush_level());
+        spdlog::set_default_logger(logger);
+        spdlog::flush_every(std::chrono::seconds(1));
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << "[dpi] dpi_set_log_async failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
 /* Set ISA/DRAM/PC overrides (call before spike_create to take effect) */
 void spike_set_isa(const char* isa_cstr)
 {
@@ -70,31 +863,169 @@ void spike_set_dram_size(uint64_t size)
     g_dram_size_override = (size_t)size;
 }
 
-void spike_set_pc(uint64_t pc)
+void spike_set_machine_only(int enable)
 {
     std::lock_guard<std::mutex> lk(g_mutex);
-    if (g_sim) {
-        try { g_sim->dpi_set_pc((reg_t)pc); } catch (...) {}
-    } else {
+    g_machine_only = enable != 0;
+}
+
+int spike_set_interleave(uint64_t insns)
+{
+    if (!insns) return -1;
+    std::lock_guard<std::mutex> lk(g_mutex);
+    g_interleave = (size_t)insns;
+    return 0;
+}
+
+int spike_set_rtc_tick(uint64_t insns)
+{
+    if (!insns) return -1;
+    std::lock_guard<std::mutex> lk(g_mutex);
+    g_insns_per_rtc_tick = (size_t)insns;
+    return 0;
+}
+
+void spike_set_skip_idle_harts(int enable)
+{
+    std::lock_guard<std::mutex> lk(g_mutex);
+    g_skip_idle_harts = enable != 0;
+}
+
+int spike_set_harts(int n)
+{
+    if (n <= 0) return -1;
+    std::lock_guard<std::mutex> lk(g_mutex);
+    g_nharts = (size_t)n;
+    return 0;
+}
+
+void spike_set_wfi_fast_forward(int enable)
+{
+    std::lock_guard<std::mutex> lk(g_mutex);
+    g_wfi_fast_forward = enable != 0;
+}
+
+int spike_set_mem_backend(int kind)
+{
+    if (kind != SPIKE_MEM_SPARSE && kind != SPIKE_MEM_FLAT && kind != SPIKE_MEM_FLAT_HUGE)
+        return -1;
+    std::lock_guard<std::mutex> lk(g_mutex);
+    g_mem_backend = kind;
+    return 0;
+}
+
+void spike_set_mem_image(const char *path)
+{
+    std::lock_guard<std::mutex> lk(g_mutex);
+    g_mem_image = path ? path : "";
+}
+
+void spike_set_pc(void *handle, uint64_t pc)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) {
+        std::lock_guard<std::mutex> lk(g_mutex);
         g_initial_pc_override = pc;
+        return;
     }
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    if (!ctx->sim) return;
+    try { ctx->sim->dpi_set_pc((reg_t)pc); } catch (...) {}
 }
 
-/* Create Spike instance and load ELF */
-void spike_create(const char *filename)
+/* Open a replay instance: spike_check_commit compares against a recorded
+   binary trace instead of a live model. Returns null on failure. */
+void *spike_open_replay(const char *trace_path)
+{
+    if (!trace_path) return nullptr;
+    std::unique_ptr<spike_ctx_t> ctx(new spike_ctx_t());
+    std::unique_ptr<trace_replay_t> r(new trace_replay_t());
+
+    int fd = open(trace_path, O_RDONLY);
+    if (fd < 0) {
+        std::fprintf(stderr, "[dpi] spike_open_replay: cannot open %s\n", trace_path);
+        return nullptr;
+    }
+    off_t len = lseek(fd, 0, SEEK_END);
+    if (len > 0) {
+        r->len = (size_t)len;
+        r->data = mmap(nullptr, r->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (r->data == MAP_FAILED) {
+        std::fprintf(stderr, "[dpi] spike_open_replay: cannot map %s\n", trace_path);
+        return nullptr;
+    }
+    // one sequential pass: let the kernel read ahead aggressively
+    madvise(r->data, r->len, MADV_SEQUENTIAL);
+    madvise(r->data, r->len, MADV_WILLNEED);
+
+    r->reader.reset(new commit_trace_reader_t(static_cast<const uint8_t*>(r->data), r->len));
+    if (!r->reader->valid()) {
+        std::fprintf(stderr, "[dpi] spike_open_replay: %s is not a commit trace\n", trace_path);
+        return nullptr;
+    }
+    ctx->replay = std::move(r);
+    return ctx.release();
+}
+
+// tohost must be RAM for the watch to read it back
+static void ctx_watch_tohost(spike_ctx_t *ctx)
+{
+    ctx->tohost_watch.addr = ctx->sim->get_tohost_addr();
+    if (ctx->tohost_watch.registered || !ctx->tohost_watch.addr ||
+        !ctx->sim->dpi_addr_to_mem(ctx->tohost_watch.addr))
+        return;
+    for (processor_t *p : ctx->harts)
+        if (p) p->get_mmu()->register_memtracer(&ctx->tohost_watch);
+    ctx->tohost_watch.registered = true;
+}
+
+/* Create Spike instance and load ELF. Returns a handle, or null on failure. */
+void *spike_create(const char *filename)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (g_sim) return;
     if (!filename) {
         std::fprintf(stderr, "[dpi] spike_create: filename is null\n");
-        return;
+        return nullptr;
+    }
+
+    startup_profile_t profile;
+    std::unique_ptr<spike_ctx_t> ctx(new spike_ctx_t());
+    reg_t dram_base;
+    size_t dram_size;
+    uint64_t pc;
+    int mem_backend;
+    std::string mem_image;
+    size_t nharts;
+    {
+        std::lock_guard<std::mutex> lk(g_mutex);
+        ctx->isa = g_isa_override.value_or(g_isa_default);
+        dram_base = (reg_t) (g_dram_base_override.value_or(g_dram_base_default));
+        dram_size = g_dram_size_override.value_or(g_dram_size_default);
+        pc = g_initial_pc_override.value_or(g_initial_pc_default);
+        ctx->cfg.tlb_entries = g_tlb_entries;
+        ctx->cfg.tlb_ways = g_tlb_ways;
+        ctx->cfg.icache_entries = g_icache_entries;
+        ctx->cfg.block_cache_entries = g_block_cache_entries;
+        ctx->cfg.vector_threads = g_vector_threads;
+        ctx->cfg.machine_only_handlers = g_machine_only;
+        ctx->cfg.interleave = g_interleave;
+        ctx->cfg.insns_per_rtc_tick = g_insns_per_rtc_tick;
+        ctx->cfg.skip_idle_harts = g_skip_idle_harts;
+        ctx->cfg.wfi_fast_forward = g_wfi_fast_forward;
+        nharts = g_nharts;
+        mem_backend = g_mem_backend;
+        mem_image = g_mem_image;
     }
 
-    cfg_t *config = new cfg_t();
-    config->isa = strdup(g_isa_override.value_or(g_isa_default).c_str());
+    ctx->priv = "M";
+    cfg_t *config = &ctx->cfg;
+    config->isa = ctx->isa.c_str();
     spdlog::debug("Using ISA: {}", config->isa);
-    config->priv = strdup("M");
-    config->hartids = std::vector<size_t>{0};
+    config->priv = ctx->priv.c_str();
+    config->hartids.clear();
+    for (size_t i = 0; i < nharts; i++) config->hartids.push_back(i);
 
     debug_module_config_t dm_config{};
     dm_config.progbufsize = 2;
@@ -106,142 +1037,1923 @@ void spike_create(const char *filename)
     dm_config.support_abstract_fpr_access = true;
     dm_config.support_haltgroups = true;
     dm_config.support_impebreak = true;
+    dm_config.support_direct_register_access = true;
 
     std::vector<device_factory_sargs_t> empty_factories;
     std::vector<std::string> htif_args;
     htif_args.push_back(std::string("+payload=") + filename);
     htif_args.push_back(std::string(filename));
+    profile.mark("config");
+
+    try {
+        abstract_mem_t *m;
+        if (!mem_image.empty())
+            m = new flat_mem_t((reg_t)dram_size, mem_image);
+        else if (mem_backend == SPIKE_MEM_SPARSE)
+            m = new mem_t((reg_t)dram_size);
+        else
+            m = new flat_mem_t((reg_t)dram_size, mem_backend == SPIKE_MEM_FLAT_HUGE);
+        ctx->mems.push_back(std::make_pair(dram_base, m));
+        profile.mark("dram");
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[dpi] dram allocation failed: %s\n", e.what());
+        return nullptr;
+    } catch (...) {
+        std::fprintf(stderr, "[dpi] dram allocation unknown failure\n");
+        return nullptr;
+    }
+
+    // The ELF's segments are copied in while sim_t is built, and htif_t
+    // then skips them; the future joins the copy however this returns.
+    std::future<std::vector<std::pair<reg_t, reg_t>>> preload =
+        std::async(std::launch::async, [&ctx, filename] { return preload_elf(filename, ctx->mems); });
+
+    try {
+        ctx->sim.reset(new sim_t(config,
+                          /*halted*/ false,
+                          /*mems*/ ctx->mems,
+                          /*plugin_device_factories*/ empty_factories,
+                          /*args*/ htif_args,
+                          /*dm_config*/ dm_config,
+                          /*log_path*/ "dpi_spike.log",
+                          /*dtb_enabled*/ false,
+                          /*dtb_file*/ nullptr,
+                          /*socket_enabled*/ false,
+                          /*cmd_file*/ nullptr,
+                          /*instruction_limit*/ std::nullopt));
+        profile.mark("sim_t");
+        ctx->sim->set_debug(false);
+        try {
+            ctx->sim->set_preloaded(preload.get());
+        } catch (const std::exception &e) {
+            // htif_t loads it all, and reports what is wrong with it
+            spdlog::debug("spike_create: ELF preload: {}", e.what());
+        }
+        profile.mark("elf preload");
+        ctx->sim->start();
+        profile.mark("elf load");
+        ctx->sim->dpi_reset();
+        profile.mark("reset");
+
+        ctx->reset_pc = pc;
+        try { ctx->sim->dpi_set_pc((reg_t)pc); } catch (...) {}
+
+        // mapped onto the bus by spike_map_dut_mmio
+        ctx->dut_sync = std::make_shared<dut_sync_device_t>(ctx->sim.get(), 0);
+
+        for (auto &h : ctx->sim->get_harts()) {
+            if (h.first >= ctx->harts.size()) ctx->harts.resize(h.first + 1, nullptr);
+            ctx->harts[h.first] = h.second;
+        }
+        for (size_t i = 0; i < ctx->harts.size(); i++)
+            ctx->hart_mutex.emplace_back(new std::mutex());
+        ctx->dut_irq_due = std::vector<std::atomic<uint64_t>>(ctx->harts.size());
+        ctx_update_irq_due(ctx.get());
+        // Harts may run concurrently under spike_step_hart
+        if (nharts > 1)
+            for (processor_t *p : ctx->harts)
+                if (p) p->get_mmu()->set_shared_memory(true);
+        ctx_watch_tohost(ctx.get());
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[dpi] spike_create exception: %s\n", e.what());
+        return nullptr;
+    } catch (...) {
+        std::fprintf(stderr, "[dpi] spike_create unknown exception\n");
+        return nullptr;
+    }
+
+    if (spdlog::should_log(spdlog::level::debug)) {
+        double total = 0;
+        for (auto &ph : profile.get_phases()) {
+            spdlog::debug("spike_create: {:<14} {:10.1f} us", ph.first, ph.second);
+            total += ph.second;
+        }
+        for (auto &ph : ctx->sim->get_startup_profile().get_phases())
+            spdlog::debug("spike_create:   sim_t {:<12} {:8.1f} us", ph.first, ph.second);
+        for (auto &ph : ctx->sim->get_core(0)->get_startup_profile().get_phases())
+            spdlog::debug("spike_create:   hart0 {:<12} {:8.1f} us", ph.first, ph.second);
+        spdlog::debug("spike_create: {:<14} {:10.1f} us", "total", total);
+    }
+
+    return ctx.release();
+}
+
+/* Delete instance */
+void spike_delete(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    {
+        // wait for any call still running on another thread
+        std::lock_guard<std::shared_mutex> lk(ctx->mutex);
+    }
+    delete ctx;
+}
+
+/* Lockstep (single-owner) mode. While enabled, calls on this handle take no
+   lock, so the caller must guarantee only one thread uses it. Toggle only
+   while no other thread is inside a call on the handle. */
+void spike_set_lockstep(void *handle, int enable)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    std::lock_guard<std::shared_mutex> lk(ctx->mutex);
+    ctx->lockstep = enable != 0;
+}
+
+/* Step */
+int spike_step(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        ctx_sync_irqs(ctx);
+        ctx->sim->dpi_step(1);
+        if (ctx->shm) ctx_publish(ctx);
+        return ctx_poll_tohost(ctx);
+    } catch (...) {
+        return -1;
+    }
+}
+
+int spike_step_hart(void *handle, unsigned hartid, uint64_t n)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !n) return -1;
+    if (hartid >= ctx->hart_mutex.size() || !ctx->harts[hartid]) return -1;
+    hart_guard_t guard(ctx, ctx->hart_mutex[hartid].get());
+    if (ctx_running_ahead(ctx) || ctx->capturing) return -1;
+    try {
+        if (ctx->sim->dpi_step_hart(hartid, (size_t)n) < 0) return -1;
+        return ctx_poll_tohost(ctx);
+    } catch (...) {
+        return -1;
+    }
+}
+
+/* Run until */
+int spike_run_until(void *handle, const spike_until_t *cond)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !cond || cond->kind > SPIKE_UNTIL_TOHOST) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    processor_t *p = ctx_hart(ctx, cond->hartid);
+    if (!p) return -1;
+
+    auto instret = [p]() { return (uint64_t)p->get_state()->minstret->read(); };
+    if (cond->kind == SPIKE_UNTIL_INSTRET && instret() >= cond->value) return 1;
+    if (ctx->tohost.load(std::memory_order_relaxed))
+        return cond->kind == SPIKE_UNTIL_TOHOST ? 1 : 2;
+
+    // Both conditions are checked inside processor_t::step, which returns
+    // early and makes sim_t::step return with it.
+    if (cond->kind == SPIKE_UNTIL_PC) p->set_stop_pc((reg_t)cond->value);
+    ctx->tohost_watch.stop_harts = &ctx->harts;
+
+    int rc = 0;
+    try {
+        uint64_t left = cond->max_insns ? cond->max_insns : UINT64_MAX;
+        while (left > 0) {
+            uint64_t chunk = std::min<uint64_t>(left, ctx_sync_irqs(ctx));
+            if (cond->kind == SPIKE_UNTIL_INSTRET)
+                chunk = std::min<uint64_t>(chunk, cond->value - instret());
+            ctx->sim->dpi_step((size_t)chunk);
+            left -= chunk;
+
+            if (cond->kind == SPIKE_UNTIL_PC && p->get_stop_hit()) { rc = 1; break; }
+            if (cond->kind == SPIKE_UNTIL_INSTRET && instret() >= cond->value) { rc = 1; break; }
+            if (ctx_poll_tohost(ctx) != SPIKE_TOHOST_NONE) {
+                rc = cond->kind == SPIKE_UNTIL_TOHOST ? 1 : 2;
+                break;
+            }
+        }
+    } catch (...) {
+        rc = -1;
+    }
+
+    ctx->tohost_watch.stop_harts = nullptr;
+    for (processor_t *h : ctx->harts)
+        if (h) h->set_stop_pc(reg_t(-1));
+    if (ctx->shm) ctx_publish(ctx);
+    return rc;
+}
+
+/* HTIF tohost */
+int spike_tohost_status(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !ctx->sim) return -1;
+    return tohost_status(ctx->tohost.load(std::memory_order_relaxed));
+}
+
+uint64_t spike_get_tohost(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    return ctx->tohost.load(std::memory_order_relaxed);
+}
+
+int spike_ack_tohost(void *handle, uint64_t fromhost)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    ctx->tohost.store(0, std::memory_order_relaxed);
+    if (!fromhost) return 0;
+    char *host = ctx->sim->dpi_addr_to_mem(ctx->sim->get_fromhost_addr());
+    if (!ctx->sim->get_fromhost_addr() || !host) return -1;
+    target_endian<uint64_t> raw = ctx->sim->to_target(fromhost);
+    std::memcpy(host, &raw, sizeof raw);
+    ctx->sim->external_writes++;
+    return 0;
+}
+
+/* Shared-memory state */
+int spike_publish_state(void *handle, const char *name, const uint32_t *csr_addrs, int n_csrs)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    // the run-ahead worker publishes too
+    if (ctx->runahead && ctx->runahead->running()) return 0;
+
+    ctx_unpublish(ctx);
+    if (!name) return 1;
+    if (n_csrs < 0 || n_csrs > SPIKE_SHM_MAX_CSRS || (n_csrs > 0 && !csr_addrs)) return 0;
+
+    std::vector<unsigned> hartids;
+    for (size_t i = 0; i < ctx->harts.size(); ++i)
+        if (ctx->harts[i]) hartids.push_back((unsigned)i);
+    size_t bytes = sizeof(spike_shm_t) + hartids.size() * sizeof(spike_shm_hart_t);
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return 0;
+    void *mem = MAP_FAILED;
+    if (ftruncate(fd, (off_t)bytes) == 0)
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        shm_unlink(name);
+        return 0;
+    }
+
+    spike_shm_t *shm = static_cast<spike_shm_t*>(mem);
+    std::memset(shm, 0, bytes);
+    shm->version = SPIKE_SHM_VERSION;
+    shm->n_harts = (uint32_t)hartids.size();
+    shm->n_csrs = (uint32_t)n_csrs;
+    shm->hart_size = (uint32_t)sizeof(spike_shm_hart_t);
+    for (size_t i = 0; i < hartids.size(); ++i) {
+        spike_shm_hart_t *h = &shm->hart[i];
+        h->hartid = hartids[i];
+        for (int c = 0; c < n_csrs; ++c) {
+            h->csr_addr[c] = csr_addrs[c];
+            ctx->shm_csr_handles.push_back(ctx_csr_handle(ctx, hartids[i], csr_addrs[c]));
+        }
+    }
+
+    ctx->shm = shm;
+    ctx->shm_bytes = bytes;
+    ctx->shm_name = name;
+    ctx_publish(ctx);
+    // readers treat the magic as "layout complete"
+    __atomic_store_n(&shm->magic, (uint32_t)SPIKE_SHM_MAGIC, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Checkpoints */
+int spike_checkpoint(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    // the worker thread would not exist in the copy
+    if (ctx->runahead && ctx->runahead->running()) return -1;
+
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    fflush(nullptr);
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(fds[1]);
+#ifdef __linux__
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+        if (getppid() != parent) _exit(0);
+        // the other checkpoints belong to the original process
+        for (auto &c : ctx->checkpoints) close(c.wake_fd);
+        ctx->checkpoints.clear();
+
+        char go;
+        ssize_t r;
+        do {
+            r = read(fds[0], &go, 1);
+        } while (r < 0 && errno == EINTR);
+        close(fds[0]);
+        if (r != 1) _exit(0);
+        return 0;
+    }
+
+    close(fds[0]);
+    ctx->checkpoints.push_back(checkpoint_t{ctx->next_checkpoint_id++, pid, fds[1]});
+    while (ctx->checkpoints.size() > ctx->checkpoint_window) {
+        checkpoint_discard(ctx->checkpoints.front());
+        ctx->checkpoints.pop_front();
+    }
+    return ctx->checkpoints.back().id;
+}
+
+int spike_restore(void *handle, int id)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+
+    auto it = std::find_if(ctx->checkpoints.begin(), ctx->checkpoints.end(),
+                           [id](const checkpoint_t &c) { return c.id == id; });
+    if (it == ctx->checkpoints.end()) return -1;
+    checkpoint_t target = *it;
+    ctx->checkpoints.erase(it);
+    for (auto &c : ctx->checkpoints) checkpoint_discard(c);
+    ctx->checkpoints.clear();
+
+    fflush(nullptr);
+    ssize_t w;
+    do {
+        w = write(target.wake_fd, "g", 1);
+    } while (w < 0 && errno == EINTR);
+    close(target.wake_fd);
+    if (w != 1) {
+        kill(target.pid, SIGKILL);
+        waitpid(target.pid, nullptr, 0);
+        return -1;
+    }
+
+    int status = 0;
+    while (waitpid(target.pid, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void spike_set_checkpoint_window(void *handle, int n)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || n < 1) return;
+    ctx_guard_t guard(ctx);
+    ctx->checkpoint_window = (size_t)n;
+    while (ctx->checkpoints.size() > ctx->checkpoint_window) {
+        checkpoint_discard(ctx->checkpoints.front());
+        ctx->checkpoints.pop_front();
+    }
+}
+
+/* Commit log */
+void spike_enable_commit_log(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return;
+    if (ctx_running_ahead(ctx)) return;
+    ctx->sim->configure_log(false, true);
+}
+
+/* Reset */
+void spike_reset(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return;
+    if (ctx_running_ahead(ctx)) return;
+    try { ctx->sim->dpi_reset(); } catch (...) {}
+    ctx->page_hashes.clear();
+    ctx->tohost_watch.hit.store(false);
+    ctx->tohost.store(0);
+    for (auto &h : ctx->csr_handles) h.csr = ctx_find_csr(ctx, h.hartid, h.addr);
+}
+
+int spike_reload(void *handle, const char *filename)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    try {
+        ctx->sim->reload(filename ? filename : "");
+        ctx->sim->dpi_set_pc(ctx->reset_pc);
+        ctx_watch_tohost(ctx);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[dpi] spike_reload: %s\n", e.what());
+        return -1;
+    }
+    ctx->tohost_watch.hit.store(false);
+    ctx->tohost.store(0);
+    ctx->dirty_lines.clear();
+    ctx->page_hashes.clear();
+    ctx->rocc_queue.clear();
+    for (auto &h : ctx->csr_handles) h.csr = ctx_find_csr(ctx, h.hartid, h.addr);
+    if (ctx->shm) ctx_publish(ctx);
+    return 0;
+}
+
+/* Commit capture */
+void commit_capture_t::on_commit(processor_t *p, reg_t pc, insn_t insn)
+{
+    if (count == cap) return;
+    spike_commit_t *out = &buf[count++];
+    state_t *st = p->get_state();
+
+    out->hartid = p->get_id();
+    out->retired = 1;
+    out->pc = pc;
+    out->insn = insn.bits();
+    out->npc = 0;
+    out->priv = (uint32_t)st->last_inst_priv;
+    out->overflow = 0;
+    out->n_regs = 0;
+    out->n_mems = 0;
+
+    for (auto &item : st->log_reg_write) {
+        uint32_t type = item.first & 0xf;
+        // x0 writes and the vector-config marker carry no value
+        if (item.first == 0 || type == 3) continue;
+        if (out->n_regs == SPIKE_COMMIT_MAX_REGS) { out->overflow = 1; break; }
+        spike_reg_write_t &r = out->regs[out->n_regs++];
+        r.type = type;
+        r.idx = (uint32_t)(item.first >> 4);
+        if (type == SPIKE_REG_V) {
+            // the log only names the vreg; take its value from the vector unit
+            r.value[0] = r.value[1] = 0;
+            std::memcpy(r.value, &p->VU.elt<uint8_t>(r.idx, 0),
+                        std::min<size_t>(sizeof(r.value), p->VU.VLEN / 8));
+        } else {
+            r.value[0] = item.second.v[0];
+            r.value[1] = item.second.v[1];
+        }
+    }
+
+    auto add_mems = [out](const commit_log_mem_t &log, uint32_t is_store) {
+        for (auto &m : log) {
+            if (out->n_mems == SPIKE_COMMIT_MAX_MEMS) { out->overflow = 1; return; }
+            spike_mem_access_t &a = out->mems[out->n_mems++];
+            a.addr = std::get<0>(m);
+            a.value = std::get<1>(m);
+            a.size = (uint32_t)std::get<2>(m);
+            a.is_store = is_store;
+        }
+    };
+    add_mems(st->log_mem_read, 0);
+    add_mems(st->log_mem_write, 1);
+}
+
+void state_hash_t::on_commit(processor_t *p, reg_t pc, insn_t insn)
+{
+    if (p->get_id() >= harts.size()) return;
+    hart_t &hh = harts[p->get_id()];
+    state_t *st = p->get_state();
+    uint64_t h = mix(hh.hash, pc);
+
+    // log_reg_write iterates in ascending (idx << 4 | type) order
+    for (auto &item : st->log_reg_write) {
+        uint32_t type = item.first & 0xf;
+        if (item.first == 0 || type == 3 || !(types & (1u << type))) continue;
+        uint64_t v[2] = { item.second.v[0], item.second.v[1] };
+        if (type == SPIKE_REG_V) {
+            v[0] = v[1] = 0;
+            std::memcpy(v, &p->VU.elt<uint8_t>(item.first >> 4, 0),
+                        std::min<size_t>(sizeof(v), p->VU.VLEN / 8));
+        }
+        h = mix(mix(mix(h, item.first), v[0]), v[1]);
+    }
+    for (auto &m : st->log_mem_write)
+        h = mix(mix(mix(h, std::get<0>(m)), std::get<1>(m)), std::get<2>(m));
+
+    hh.hash = h;
+    hh.count++;
+}
+
+static void ctx_start_capture(spike_ctx_t *ctx)
+{
+    if (ctx->capturing) return;
+    for (processor_t *p : ctx->harts)
+        if (p) p->add_commit_observer(&ctx->commit_capture);
+    ctx->capturing = true;
+}
+
+// Steps one instruction into out. Caller holds the instance lock, or is the
+// run-ahead worker, which leaves DUT interrupt events to the consumer.
+static int ctx_step_commit(spike_ctx_t *ctx, spike_commit_t *out, bool sync_irqs = true)
+{
+    ctx_start_capture(ctx);
+    if (sync_irqs) ctx_sync_irqs(ctx);
+
+    // Prefill for the trap case, where no commit is reported
+    processor_t *p = ctx->sim->dpi_next_proc();
+    state_t *st = p->get_state();
+    out->hartid = p->get_id();
+    out->retired = 0;
+    out->pc = st->pc;
+    insn_bits_t insn;
+    out->insn = p->get_mmu()->probe_insn(st->pc, &insn) ? insn : 0;
+    out->priv = (uint32_t)st->prv;
+    out->overflow = 0;
+    out->n_regs = 0;
+    out->n_mems = 0;
+
+    ctx->commit_capture.begin(out, 1);
+    try {
+        ctx->sim->dpi_step(1);
+    } catch (...) {
+        ctx->commit_capture.end();
+        throw;
+    }
+    ctx->commit_capture.end();
+    if (ctx->shm) ctx_publish(ctx);
+    ctx_poll_tohost(ctx);
+
+    out->npc = st->pc;
+    return out->retired ? 1 : 0;
+}
+
+int spike_step_commit(void *handle, spike_commit_t *out)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try { return ctx_step_commit(ctx, out); } catch (...) { return -1; }
+}
+
+int spike_step_n(void *handle, int n, spike_commit_t *buf, int cap)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !buf || n <= 0 || cap <= 0) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        ctx_start_capture(ctx);
+
+        ctx->commit_capture.begin(buf, (size_t)cap);
+        // Split the group at DUT interrupt events so each lands on its
+        // exact instret; a chunk that retires short of its length trapped.
+        size_t left = (size_t)std::min(n, cap);
+        while (left > 0) {
+            size_t chunk = (size_t)std::min<reg_t>(left, ctx_sync_irqs(ctx));
+            size_t before = ctx->commit_capture.count;
+            ctx->sim->dpi_step(chunk);
+            if (ctx->commit_capture.count - before < chunk) break;
+            if (ctx->tohost_watch.hit.load(std::memory_order_relaxed)) break;
+            left -= chunk;
+        }
+        size_t count = ctx->commit_capture.count;
+        ctx->commit_capture.end();
+        if (ctx->shm) ctx_publish(ctx);
+        ctx_poll_tohost(ctx);
+
+        // Each record's npc is the pc of the next record on the same hart;
+        // the last one is wherever that hart stopped.
+        std::vector<uint64_t> next_pc(ctx->harts.size(), 0);
+        for (size_t h = 0; h < ctx->harts.size(); ++h)
+            if (ctx->harts[h]) next_pc[h] = ctx->harts[h]->get_state()->pc;
+        for (size_t i = count; i-- > 0; ) {
+            spike_commit_t &c = buf[i];
+            if (c.hartid >= next_pc.size()) continue;
+            c.npc = next_pc[c.hartid];
+            next_pc[c.hartid] = c.pc;
+        }
+        return (int)count;
+    } catch (...) {
+        ctx->commit_capture.end();
+        return -1;
+    }
+}
+
+/* DUT synchronization */
+int spike_map_dut_mmio(void *handle, uint64_t base, uint64_t size)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || size == 0) return 0;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return 0;
+    if (ctx->dut_sync_mapped || ctx_running_ahead(ctx)) return 0;
+    try {
+        ctx->dut_sync->set_size((reg_t)size);
+        ctx->sim->add_device((reg_t)base, ctx->dut_sync);
+    } catch (...) {
+        return 0;
+    }
+    ctx->dut_sync_base = (reg_t)base;
+    ctx->dut_sync_mapped = true;
+    return 1;
+}
+
+int spike_push_mmio_load(void *handle, uint64_t paddr, uint64_t value)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    if (!ctx->dut_sync_mapped || paddr < ctx->dut_sync_base ||
+        paddr - ctx->dut_sync_base >= ctx->dut_sync->size())
+        return 0;
+    ctx->dut_sync->push_load((reg_t)(paddr - ctx->dut_sync_base), value);
+    return 1;
+}
+
+int spike_schedule_irq(void *handle, unsigned hartid, uint64_t instret, uint64_t mip_mask, int raise)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !ctx_hart(ctx, hartid)) return 0;
+    ctx_guard_t guard(ctx);
+    ctx->dut_sync->schedule_interrupt(hartid, (reg_t)instret, (reg_t)mip_mask, raise != 0);
+    ctx->dut_irq_pending.store(true, std::memory_order_release);
+    ctx_update_irq_due(ctx);
+    return 1;
+}
+
+/* Run-ahead */
+// Something the DUT drives is about to happen on p: run-ahead must not
+// predict past it: a DUT interrupt event falling due, or an enabled
+// interrupt becoming pending, each once; a halt request from the debugger;
+// and debug mode, which the debugger drives throughout. Spike has no NMI
+// source of its own; an NMI the DUT takes reaches the model through
+// spike_schedule_irq like any other interrupt. seen_irqs holds the
+// enabled pending interrupts of p as of its previous instruction.
+static bool runahead_must_sync(const spike_ctx_t *ctx, processor_t *p, reg_t &seen_irqs)
+{
+    state_t *st = p->get_state();
+    reg_t irqs = st->mip->read() & st->mie->read();
+    bool new_irq = (irqs & ~seen_irqs) != 0;
+    seen_irqs = irqs;
+    return new_irq ||
+        st->minstret->read() >= ctx->dut_irq_due[p->get_id()].load(std::memory_order_acquire) ||
+        st->debug_mode || p->halt_request != processor_t::HR_NONE;
+}
+
+static void runahead_loop(spike_ctx_t *ctx, runahead_t *ra)
+{
+    const uint64_t cap = ra->ring.size();
+    uint64_t tail = ra->tail.load(std::memory_order_relaxed);
+    std::vector<reg_t> seen_irqs(ctx->harts.size(), 0);
+
+    while (!ra->stop.load(std::memory_order_acquire)) {
+        if (ra->pause.load(std::memory_order_acquire)) {
+            ra->park();
+            continue;
+        }
+        uint32_t w = ra->wake.load(std::memory_order_acquire);
+        if (ra->blocked.load(std::memory_order_acquire) ||
+            tail - ra->head.load(std::memory_order_acquire) == cap) {
+            ra->wake.wait(w, std::memory_order_acquire);
+            continue;
+        }
+
+        runahead_t::entry_t &e = ra->ring[tail % cap];
+        processor_t *p = ctx->sim->dpi_next_proc();
+        bool barrier = runahead_must_sync(ctx, p, seen_irqs[p->get_id()]);
+        if (!barrier) {
+            try {
+                ctx_step_commit(ctx, &e.rec, false);
+                barrier = p->get_mmio_barrier_hit();
+            } catch (...) {
+                // let the consumer repeat the step and see the error
+                barrier = true;
+            }
+        }
+
+        e.kind = barrier ? runahead_t::BARRIER : runahead_t::COMMIT;
+        if (barrier) ra->blocked.store(true, std::memory_order_release);
+        ra->tail.store(++tail, std::memory_order_release);
+        ra->tail.notify_one();
+    }
+}
+
+static void ctx_set_mmio_barrier(spike_ctx_t *ctx, bool value)
+{
+    for (processor_t *p : ctx->harts)
+        if (p) p->set_mmio_barrier(value);
+}
+
+// Produces the next golden commit, from the run-ahead ring when there is
+// one. Caller holds the instance lock.
+// Decodes the next replayed record into out. Returns 1, or -2 at the end of
+// the trace.
+static int ctx_replay_commit(spike_ctx_t *ctx, spike_commit_t *out)
+{
+    trace_replay_t *r = ctx->replay.get();
+    const commit_trace_record_t &rec = r->rec;
+    if (!r->reader->next(r->rec)) return -2;
+
+    out->hartid = rec.hartid;
+    out->retired = 1;
+    out->pc = rec.pc;
+    out->insn = rec.insn;
+    out->npc = 0;   // not recorded in the trace
+    out->priv = rec.priv;
+    out->overflow = 0;
+    out->n_regs = 0;
+    for (auto &item : rec.regs) {
+        uint32_t type = item.key & 0xf;
+        if (type == 3) continue;
+        if (out->n_regs == SPIKE_COMMIT_MAX_REGS) { out->overflow = 1; break; }
+        spike_reg_write_t &w = out->regs[out->n_regs++];
+        w.type = type;
+        w.idx = (uint32_t)(item.key >> 4);
+        if (type == SPIKE_REG_V) {
+            w.value[0] = w.value[1] = 0;
+            std::memcpy(w.value, &rec.vbytes[item.vdata], std::min<size_t>(sizeof(w.value), rec.vlenb));
+        } else {
+            w.value[0] = item.v[0];
+            w.value[1] = item.v[1];
+        }
+    }
+    out->n_mems = 0;
+    auto add_mems = [out](const std::vector<commit_trace_record_t::mem_access_t> &log, uint32_t is_store) {
+        for (auto &m : log) {
+            if (out->n_mems == SPIKE_COMMIT_MAX_MEMS) { out->overflow = 1; return; }
+            spike_mem_access_t &a = out->mems[out->n_mems++];
+            a.addr = m.addr;
+            a.value = m.value;
+            a.size = m.size;
+            a.is_store = is_store;
+        }
+    };
+    add_mems(rec.loads, 0);
+    add_mems(rec.stores, 1);
+    return 1;
+}
+
+static int ctx_next_commit(spike_ctx_t *ctx, spike_commit_t *out)
+{
+    if (ctx->replay) return ctx_replay_commit(ctx, out);
+
+    runahead_t *ra = ctx->runahead.get();
+    if (!ra) return ctx_step_commit(ctx, out);
+
+    uint64_t h = ra->head.load(std::memory_order_relaxed);
+    uint64_t t;
+    while ((t = ra->tail.load(std::memory_order_acquire)) == h) {
+        if (!ra->running()) {
+            // stopped and drained: back to stepping in this thread
+            ctx->runahead.reset();
+            return ctx_step_commit(ctx, out);
+        }
+        ra->tail.wait(t, std::memory_order_acquire);
+    }
+
+    runahead_t::entry_t &e = ra->ring[h % ra->ring.size()];
+    int rc;
+    if (e.kind == runahead_t::BARRIER) {
+        // the worker is parked, so the model is ours until it is released
+        ctx_set_mmio_barrier(ctx, false);
+        try {
+            rc = ctx_step_commit(ctx, out);
+        } catch (...) {
+            rc = -1;
+        }
+        ctx_set_mmio_barrier(ctx, ra->running());
+        ra->head.store(h + 1, std::memory_order_release);
+        ra->blocked.store(false, std::memory_order_release);
+    } else {
+        *out = e.rec;
+        rc = out->retired ? 1 : 0;
+        ra->head.store(h + 1, std::memory_order_release);
+    }
+    ra->wake_worker();
+    return rc;
+}
+
+int spike_set_runahead(void *handle, int horizon)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return 0;
+
+    if (ctx->runahead && ctx->runahead->running()) {
+        ctx->runahead->halt();
+        ctx_set_mmio_barrier(ctx, false);
+    }
+    if (horizon <= 0) return 1;
+    // a new ring can only start once the old one is drained
+    if (ctx->runahead && !ctx->runahead->empty()) return 0;
+
+    try {
+        ctx_start_capture(ctx);
+        ctx_set_mmio_barrier(ctx, true);
+        ctx->runahead.reset(new runahead_t((size_t)horizon));
+        ctx->runahead->worker = std::thread(runahead_loop, ctx, ctx->runahead.get());
+    } catch (...) {
+        ctx->runahead.reset();
+        ctx_set_mmio_barrier(ctx, false);
+        return 0;
+    }
+    return 1;
+}
+
+/* Comparator */
+static bool check_reg(const spike_ctx_t *ctx, uint32_t flags, uint32_t type, uint32_t idx)
+{
+    switch (type) {
+    case SPIKE_REG_X:
+        return (flags & SPIKE_CHECK_XPR) && ((ctx->check_xpr_mask >> idx) & 1);
+    case SPIKE_REG_F:
+        return (flags & SPIKE_CHECK_FPR) && ((ctx->check_fpr_mask >> idx) & 1);
+    case SPIKE_REG_V:
+        return flags & SPIKE_CHECK_VREG;
+    case SPIKE_REG_CSR:
+        return (flags & SPIKE_CHECK_CSR) &&
+            std::find(ctx->check_csr_ignore.begin(), ctx->check_csr_ignore.end(), idx) ==
+            ctx->check_csr_ignore.end();
+    }
+    return false;
+}
+
+static std::string reg_name(uint32_t type, uint32_t idx)
+{
+    switch (type) {
+    case SPIKE_REG_X: return "x" + std::to_string(idx);
+    case SPIKE_REG_F: return "f" + std::to_string(idx);
+    case SPIKE_REG_V: return "v" + std::to_string(idx);
+    }
+    return csr_name((int)idx);
+}
+
+// Bits of ignore are not compared, in X, F and CSR values
+static bool reg_value_equal(uint32_t type, int xlen, const uint64_t a[2], const uint64_t b[2],
+                            uint64_t ignore)
+{
+    switch (type) {
+    case SPIKE_REG_X:
+    case SPIKE_REG_CSR: {
+        uint64_t mask = xlen >= 64 ? ~0ULL : ((1ULL << xlen) - 1);
+        return ((a[0] ^ b[0]) & mask & ~ignore) == 0;
+    }
+    case SPIKE_REG_F:
+        return ((a[0] ^ b[0]) & ~ignore) == 0;
+    }
+    return a[0] == b[0] && a[1] == b[1];
+}
+
+static const check_rules_t::rule_t *load_rule(const check_rules_t &rules, uint64_t addr)
+{
+    auto l = std::upper_bound(rules.loads.begin(), rules.loads.end(), addr,
+                              [](uint64_t a, const check_rules_t::load_rule_t &r) { return a < r.begin; });
+    if (l == rules.loads.begin() || addr >= (--l)->end) return nullptr;
+    return &l->rule;
+}
+
+// What the rules allow in the rd or fd of the golden commit c
+static check_rules_t::rule_t dest_rule(const check_rules_t &rules, const spike_commit_t &c)
+{
+    check_rules_t::rule_t r;
+    const uint32_t insn = (uint32_t)c.insn;
+    // csrr* are SYSTEM with funct3 other than 0 and 4 (the hypervisor loads
+    // and stores), and read the CSR in bits 31:20
+    const uint32_t funct3 = insn >> 12 & 7;
+    if ((insn & 0x7f) == 0x73 && funct3 != 0 && funct3 != 4)
+        r = rules.csr_read[insn >> 20];
+    for (const auto &i : rules.insns[insn & 0x7f])
+        if ((insn & i.mask) == i.match) r.add(i.rule.ignore, i.rule.copy);
+    for (uint32_t m = 0; m < c.n_mems && m < SPIKE_COMMIT_MAX_MEMS && !rules.loads.empty(); ++m)
+        if (const check_rules_t::rule_t *l = c.mems[m].is_store ? nullptr : load_rule(rules, c.mems[m].addr))
+            r.add(l->ignore, l->copy);
+    return r;
+}
+
+static const spike_reg_write_t *find_reg(const spike_commit_t &c, uint32_t type, uint32_t idx)
+{
+    for (uint32_t i = 0; i < c.n_regs && i < SPIKE_COMMIT_MAX_REGS; ++i)
+        if (c.regs[i].type == type && c.regs[i].idx == idx) return &c.regs[i];
+    return nullptr;
+}
+
+static const spike_mem_access_t *find_access(const spike_commit_t &c, uint64_t addr, uint32_t is_store)
+{
+    for (uint32_t i = 0; i < c.n_mems && i < SPIKE_COMMIT_MAX_MEMS; ++i)
+        if (c.mems[i].is_store == is_store && c.mems[i].addr == addr) return &c.mems[i];
+    return nullptr;
+}
+
+// Compares the golden commit ref against the DUT's under the SPIKE_CHECK_*
+// flags and the rules, dest being dest_rule() of ref. Returns
+// SPIKE_CHECK_OK or the first mismatch found, with a description in why.
+static int compare_commit(const spike_ctx_t *ctx, uint32_t flags, int xlen, const spike_commit_t &ref,
+                          const spike_commit_t &dut, const check_rules_t::rule_t &dest, std::string &why)
+{
+    const check_rules_t *rules = ctx->check_rules.get();
+    char buf[256];
+
+    if (!ref.retired || !dut.retired) {
+        if (ref.retired != dut.retired) {
+            snprintf(buf, sizeof(buf), "%s took a trap, %s retired the instruction",
+                     ref.retired ? "dut" : "ref", ref.retired ? "ref" : "dut");
+            why = buf;
+            return SPIKE_MISMATCH_TRAP;
+        }
+        if ((flags & SPIKE_CHECK_PC) && ref.npc != dut.npc) {
+            snprintf(buf, sizeof(buf), "trap target ref 0x%016" PRIx64 " dut 0x%016" PRIx64,
+                     ref.npc, dut.npc);
+            why = buf;
+            return SPIKE_MISMATCH_PC;
+        }
+        return SPIKE_CHECK_OK;
+    }
+
+    if ((flags & SPIKE_CHECK_PC) && ref.pc != dut.pc) {
+        snprintf(buf, sizeof(buf), "pc ref 0x%016" PRIx64 " dut 0x%016" PRIx64, ref.pc, dut.pc);
+        why = buf;
+        return SPIKE_MISMATCH_PC;
+    }
+    if ((flags & SPIKE_CHECK_INSN) && ref.insn != dut.insn) {
+        snprintf(buf, sizeof(buf), "insn ref 0x%08" PRIx64 " dut 0x%08" PRIx64, ref.insn, dut.insn);
+        why = buf;
+        return SPIKE_MISMATCH_INSN;
+    }
+    // replayed traces do not record the next pc
+    if ((flags & SPIKE_CHECK_NPC) && ref.npc && ref.npc != dut.npc) {
+        snprintf(buf, sizeof(buf), "next pc ref 0x%016" PRIx64 " dut 0x%016" PRIx64, ref.npc, dut.npc);
+        why = buf;
+        return SPIKE_MISMATCH_PC;
+    }
+
+    for (uint32_t i = 0; i < ref.n_regs; ++i) {
+        const spike_reg_write_t &r = ref.regs[i];
+        if (!check_reg(ctx, flags, r.type, r.idx)) continue;
+        check_rules_t::rule_t rule;
+        if (r.type == SPIKE_REG_X || r.type == SPIKE_REG_F) rule = dest;
+        else if (r.type == SPIKE_REG_CSR && rules) rule = rules->csr_write[r.idx & 0xfff];
+        if (rule.copy) continue;
+        const spike_reg_write_t *d = find_reg(dut, r.type, r.idx);
+        if (!d) {
+            snprintf(buf, sizeof(buf), "%s written by ref (0x%016" PRIx64 ") but not by dut",
+                     reg_name(r.type, r.idx).c_str(), r.value[0]);
+            why = buf;
+            return SPIKE_MISMATCH_MISSING;
+        }
+        if (!reg_value_equal(r.type, xlen, r.value, d->value, rule.ignore)) {
+            snprintf(buf, sizeof(buf), "%s ref 0x%016" PRIx64 "%016" PRIx64 " dut 0x%016" PRIx64 "%016" PRIx64,
+                     reg_name(r.type, r.idx).c_str(), r.value[1], r.value[0], d->value[1], d->value[0]);
+            why = buf;
+            return SPIKE_MISMATCH_REG;
+        }
+    }
+    for (uint32_t i = 0; i < dut.n_regs && i < SPIKE_COMMIT_MAX_REGS; ++i) {
+        const spike_reg_write_t &d = dut.regs[i];
+        if (!check_reg(ctx, flags, d.type, d.idx) || find_reg(ref, d.type, d.idx)) continue;
+        snprintf(buf, sizeof(buf), "%s written by dut (0x%016" PRIx64 ") but not by ref",
+                 reg_name(d.type, d.idx).c_str(), d.value[0]);
+        why = buf;
+        return SPIKE_MISMATCH_EXTRA;
+    }
+
+    if (flags & (SPIKE_CHECK_MEM | SPIKE_CHECK_LOAD)) {
+        for (uint32_t i = 0; i < ref.n_mems && i < SPIKE_COMMIT_MAX_MEMS; ++i) {
+            const spike_mem_access_t &r = ref.mems[i];
+            if (!(flags & (r.is_store ? SPIKE_CHECK_MEM : SPIKE_CHECK_LOAD))) continue;
+            if (!r.is_store && rules && load_rule(*rules, r.addr)) continue;
+            const spike_mem_access_t *d = find_access(dut, r.addr, r.is_store);
+            if (!d || d->size != r.size || d->value != r.value) {
+                snprintf(buf, sizeof(buf), "%s 0x%016" PRIx64 " ref %u:0x%016" PRIx64 " dut %s",
+                         r.is_store ? "store" : "load", r.addr, r.size, r.value, d ? "differs" : "missing");
+                why = buf;
+                return SPIKE_MISMATCH_MEM;
+            }
+        }
+    }
+    return SPIKE_CHECK_OK;
+}
+
+void spike_set_check_config(void *handle, uint32_t flags, uint32_t xpr_mask, uint32_t fpr_mask)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    ctx_guard_t guard(ctx);
+    ctx->check_flags = flags;
+    ctx->check_xpr_mask = xpr_mask;
+    ctx->check_fpr_mask = fpr_mask;
+}
+
+int spike_set_check_csr_ignore(void *handle, const uint32_t *csr_addrs, int n)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || n < 0 || (n > 0 && !csr_addrs)) return 0;
+    ctx_guard_t guard(ctx);
+    ctx->check_csr_ignore.assign(csr_addrs, csr_addrs + n);
+    return n;
+}
+
+static int csr_number(const std::string &name)
+{
+    #define DECLARE_CSR(csr, number) if (name == #csr) return number;
+    #include "encoding.h"
+    #undef DECLARE_CSR
+    char *end;
+    unsigned long n = strtoul(name.c_str(), &end, 0);
+    return name.empty() || *end || n >= 4096 ? -1 : (int)n;
+}
+
+static bool insn_encoding(const std::string &name, uint32_t &match, uint32_t &mask)
+{
+    #define DECLARE_INSN(insn, m, k) if (name == #insn) { match = m; mask = k; return true; }
+    #include "encoding.h"
+    #undef DECLARE_INSN
+    return false;
+}
+
+static bool parse_u64(const std::string &s, uint64_t &v)
+{
+    char *end;
+    errno = 0;
+    v = strtoull(s.c_str(), &end, 0);
+    return !s.empty() && !*end && !errno;
+}
+
+// Compiles the rule on one line of a rules file into rules. Returns 1, 0
+// for a blank or comment line, or -1 with the reason in why.
+static int parse_check_rule(const std::string &line, check_rules_t &rules, std::string &why)
+{
+    std::vector<std::string> w;
+    size_t i = 0;
+    while (true) {
+        i = line.find_first_not_of(" \t\r", i);
+        if (i == std::string::npos || line[i] == '#') break;
+        size_t j = line.find_first_of(" \t\r#", i);
+        w.push_back(line.substr(i, j - i));
+        i = j;
+    }
+    if (w.empty()) return 0;
+
+    // the target takes one word, or two for instruction encodings and
+    // address ranges; the action and its mask follow
+    const std::string &kind = w[0];
+    size_t target_words = 1;
+    if (kind == "load" || (kind == "insn" && w.size() > 1 && isdigit((unsigned char)w[1][0])))
+        target_words = 2;
+    size_t a = 1 + target_words;
+    if (w.size() <= a) { why = "missing action"; return -1; }
+    check_rules_t::rule_t rule;
+    if (w[a] == "copy" && w.size() == a + 1) {
+        rule.copy = true;
+    } else if (w[a] == "ignore" && w.size() <= a + 2) {
+        rule.ignore = ~0ULL;
+        if (w.size() == a + 2 && !parse_u64(w[a + 1], rule.ignore)) { why = "bad mask " + w[a + 1]; return -1; }
+    } else {
+        why = "expected copy or ignore [mask]";
+        return -1;
+    }
+
+    if (kind == "csr" || kind == "read") {
+        int csr = csr_number(w[1]);
+        if (csr < 0) { why = "unknown CSR " + w[1]; return -1; }
+        (kind == "csr" ? rules.csr_write : rules.csr_read)[csr].add(rule.ignore, rule.copy);
+    } else if (kind == "insn") {
+        check_rules_t::insn_rule_t r{0, 0, rule};
+        uint64_t match, mask;
+        if (target_words == 2) {
+            if (!parse_u64(w[1], match) || !parse_u64(w[2], mask) || match > UINT32_MAX || mask > UINT32_MAX) {
+                why = "bad encoding " + w[1] + " " + w[2];
+                return -1;
+            }
+            r.match = (uint32_t)match;
+            r.mask = (uint32_t)mask;
+        } else if (!insn_encoding(w[1], r.match, r.mask)) {
+            why = "unknown instruction " + w[1];
+            return -1;
+        }
+        for (uint32_t opcode = 0; opcode < rules.insns.size(); ++opcode)
+            if ((opcode & r.mask & 0x7f) == (r.match & 0x7f))
+                rules.insns[opcode].push_back(r);
+    } else if (kind == "load") {
+        check_rules_t::load_rule_t r{0, 0, rule};
+        if (!parse_u64(w[1], r.begin) || !parse_u64(w[2], r.end) || r.begin >= r.end) {
+            why = "bad range " + w[1] + " " + w[2];
+            return -1;
+        }
+        rules.loads.push_back(r);
+    } else {
+        why = "unknown rule " + kind;
+        return -1;
+    }
+    return 1;
+}
+
+// Cuts the load rules as parsed into disjoint pieces, each with the rules
+// that cover it merged, in address order
+static void index_load_rules(check_rules_t &rules)
+{
+    std::vector<uint64_t> cuts;
+    for (const auto &l : rules.loads) {
+        cuts.push_back(l.begin);
+        cuts.push_back(l.end);
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+    std::vector<check_rules_t::load_rule_t> pieces;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        check_rules_t::load_rule_t piece{cuts[i], cuts[i + 1], {}};
+        bool covered = false;
+        for (const auto &l : rules.loads)
+            if (l.begin <= piece.begin && piece.end <= l.end) {
+                piece.rule.add(l.rule.ignore, l.rule.copy);
+                covered = true;
+            }
+        if (covered) pieces.push_back(piece);
+    }
+    rules.loads = std::move(pieces);
+}
+
+int spike_load_check_rules(void *handle, const char *path, char *err, int err_len)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!path) {
+        ctx->check_rules.reset();
+        return 0;
+    }
+    std::ifstream in(path);
+    if (!in) {
+        if (err && err_len > 0) snprintf(err, (size_t)err_len, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    try {
+        std::unique_ptr<check_rules_t> rules(new check_rules_t);
+        std::string line, why;
+        int n = 0;
+        for (int lineno = 1; std::getline(in, line); ++lineno) {
+            int rc = parse_check_rule(line, *rules, why);
+            if (rc < 0) {
+                if (err && err_len > 0) snprintf(err, (size_t)err_len, "%s:%d: %s", path, lineno, why.c_str());
+                return -1;
+            }
+            n += rc;
+        }
+        index_load_rules(*rules);
+        ctx->check_rules = std::move(rules);
+        return n;
+    } catch (...) {
+        return -1;
+    }
+}
+
+// Keeps ref in its hart's history ring; only a hart's first commit allocates
+static void ctx_record_history(spike_ctx_t *ctx, const spike_commit_t &ref)
+{
+    if (ref.hartid >= ctx->history.size()) ctx->history.resize(ref.hartid + 1);
+    spike_ctx_t::history_t &h = ctx->history[ref.hartid];
+    if (h.ring.size() != ctx->history_len) h.ring.resize(ctx->history_len);
+    h.ring[h.n++ % h.ring.size()] = ref;
+}
+
+static void ctx_dump_history(spike_ctx_t *ctx, const spike_commit_t &dut, const char *why)
+{
+    FILE *f = stderr;
+    if (!ctx->history_path.empty() && !(f = fopen(ctx->history_path.c_str(), "a"))) {
+        fprintf(stderr, "[dpi] mismatch history: cannot open %s\n", ctx->history_path.c_str());
+        f = stderr;
+    }
+    static const char reg_prefix[] = { 'x', 'f', 'v', '?', 'c' };
+    fprintf(f, "[dpi] mismatch: %s\n", why);
+    for (unsigned hartid = 0; hartid < ctx->history.size(); ++hartid) {
+        const spike_ctx_t::history_t &h = ctx->history[hartid];
+        if (!h.n) continue;
+        processor_t *p = ctx_hart(ctx, hartid);
+        uint64_t k = std::min<uint64_t>(h.n, h.ring.size());
+        fprintf(f, "hart%u: last %" PRIu64 " of %" PRIu64 " commits\n", hartid, k, h.n);
+        for (uint64_t i = h.n - k; i < h.n; ++i) {
+            const spike_commit_t &c = h.ring[i % h.ring.size()];
+            char where[96] = "";
+            uint64_t off = 0;
+            if (const char *sym = ctx->sim ? ctx->sim->find_symbol(c.pc, &off) : nullptr)
+                snprintf(where, sizeof(where), " <%.64s+0x%" PRIx64 ">", sym, off);
+            fprintf(f, "  #%" PRIu64 " %u 0x%016" PRIx64 "%s (0x%08" PRIx64 ") %s", i, c.priv, c.pc,
+                    where, c.insn, p ? p->disassemble(insn_t(c.insn)).c_str() : "");
+            for (uint32_t r = 0; r < c.n_regs; ++r) {
+                const spike_reg_write_t &w = c.regs[r];
+                fprintf(f, " %c%u 0x%016" PRIx64, w.type < 5 ? reg_prefix[w.type] : '?', w.idx, w.value[0]);
+            }
+            for (uint32_t m = 0; m < c.n_mems; ++m) {
+                const spike_mem_access_t &a = c.mems[m];
+                fprintf(f, " %s 0x%016" PRIx64 " %u:0x%016" PRIx64, a.is_store ? "st" : "ld",
+                        a.addr, a.size, a.value);
+            }
+            fprintf(f, "%s\n", c.overflow ? " ..." : "");
+        }
+    }
+    fprintf(f, "  dut hart%u 0x%016" PRIx64 " (0x%08" PRIx64 ")%s\n", dut.hartid, dut.pc, dut.insn,
+            dut.retired ? "" : " trap");
+    if (f != stderr) fclose(f);
+}
+
+int spike_set_mismatch_history(void *handle, int len, const char *path)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || len < 0) return -1;
+    ctx_guard_t guard(ctx);
+    ctx->history_len = (size_t)len;
+    ctx->history.clear();
+    ctx->history_path = path ? path : "";
+    return 0;
+}
+
+// Writes what the copy rules name of dut's results into hart p, whose
+// commit dut was just checked against
+static void ctx_copy_dut_values(spike_ctx_t *ctx, processor_t *p, const check_rules_t::rule_t &dest,
+                                const spike_commit_t &dut)
+{
+    const check_rules_t &rules = *ctx->check_rules;
+    state_t *st = p->get_state();
+    for (uint32_t i = 0; i < dut.n_regs && i < SPIKE_COMMIT_MAX_REGS; ++i) {
+        const spike_reg_write_t &w = dut.regs[i];
+        switch (w.type) {
+        case SPIKE_REG_X:
+            if (dest.copy && w.idx && w.idx < NXPR)
+                st->XPR.write(w.idx, p->get_xlen() == 32 ? (reg_t)(int32_t)w.value[0] : w.value[0]);
+            break;
+        case SPIKE_REG_F:
+            if (dest.copy && w.idx < NFPR) {
+                // narrower than FLEN 128, the upper half is the NaN box
+                freg_t f;
+                f.v[0] = w.value[0];
+                f.v[1] = p->get_flen() > 64 ? w.value[1] : ~0ULL;
+                st->FPR.write(w.idx, f);
+            }
+            break;
+        case SPIKE_REG_CSR:
+            if (rules.csr_write[w.idx & 0xfff].copy) {
+                try {
+                    p->put_csr((int)w.idx, w.value[0]);
+                } catch (...) {}
+            }
+            break;
+        }
+    }
+}
+
+// Draws the next golden commit and compares it with dut under flags, as
+// spike_check_commit. Caller holds the instance lock.
+static int ctx_check_commit(spike_ctx_t *ctx, const spike_commit_t *dut, uint32_t flags,
+                            char *report, int report_len)
+{
+    // traps are not part of a replayed trace
+    if (ctx->replay && !dut->retired) return SPIKE_CHECK_OK;
+    spike_commit_t ref;
+    int next = ctx_next_commit(ctx, &ref);
+    if (next == -2) {
+        if (report && report_len > 0)
+            snprintf(report, (size_t)report_len, "golden trace ended before dut pc 0x%016" PRIx64, dut->pc);
+        return SPIKE_MISMATCH_END;
+    }
+    if (next < 0) return -1;
+
+    processor_t *p = ctx_hart(ctx, ref.hartid);
+    int xlen = p ? p->get_state()->last_inst_xlen
+                 : ctx->replay ? ctx->replay->rec.xlen : 64;
+    if (ctx->history_len) ctx_record_history(ctx, ref);
+    std::string why;
+    check_rules_t::rule_t dest;
+    if (ctx->check_rules) dest = dest_rule(*ctx->check_rules, ref);
+    int rc = compare_commit(ctx, flags, xlen, ref, *dut, dest, why);
+    // the worker has already stepped past ref, so nothing can be copied
+    if (rc == SPIKE_CHECK_OK && ctx->check_rules && p && !ctx->runahead)
+        ctx_copy_dut_values(ctx, p, dest, *dut);
+    if (rc != SPIKE_CHECK_OK && ctx->history_len) ctx_dump_history(ctx, *dut, why.c_str());
+    if (rc != SPIKE_CHECK_OK && report && report_len > 0) {
+        // the hart's memoised disassembly; a replayed trace has no hart
+        const char *dis = p ? p->disassemble(insn_t(ref.insn)).c_str() : "";
+        char where[96] = "";
+        uint64_t off = 0;
+        if (const char *sym = ctx->sim ? ctx->sim->find_symbol(ref.pc, &off) : nullptr)
+            snprintf(where, sizeof(where), " <%.64s+0x%" PRIx64 ">", sym, off);
+        snprintf(report, (size_t)report_len, "hart%u pc 0x%016" PRIx64 "%s (0x%08" PRIx64 ") %s: %s",
+                 ref.hartid, ref.pc, where, ref.insn, dis, why.c_str());
+    }
+    return rc;
+}
+
+int spike_check_commit(void *handle, const spike_commit_t *dut, char *report, int report_len)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !dut) return -1;
+    ctx_guard_t guard(ctx);
+    try {
+        return ctx_check_commit(ctx, dut, ctx->check_flags, report, report_len);
+    } catch (...) {
+        return -1;
+    }
+}
+
+// The one memory access of an RVFI packet, from its byte mask
+static void rvfi_access(spike_commit_t &c, uint64_t addr, uint32_t mask, uint64_t data, uint32_t is_store)
+{
+    if (!mask) return;
+    unsigned lo = __builtin_ctz(mask);
+    unsigned size = __builtin_popcount(mask);
+    spike_mem_access_t &a = c.mems[c.n_mems++];
+    a.addr = addr + lo;
+    a.size = size;
+    a.value = size >= 8 ? data : (data >> (8 * lo)) & ((1ull << (8 * size)) - 1);
+    a.is_store = is_store;
+}
+
+int spike_check_rvfi(void *handle, unsigned hartid, const spike_rvfi_t *pkts, int n,
+                     char *report, int report_len)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || n < 0 || (n > 0 && !pkts)) return -1;
+    ctx_guard_t guard(ctx);
+
+    // retire ports need not be in program order
+    const spike_rvfi_t *order[64];
+    int count = 0;
+    for (int i = 0; i < n && count < 64; ++i)
+        if (pkts[i].valid) order[count++] = &pkts[i];
+    std::sort(order, order + count,
+              [](const spike_rvfi_t *a, const spike_rvfi_t *b) { return a->order < b->order; });
+
+    // RVFI carries no F, V or CSR writes
+    const uint32_t flags = ctx->check_flags & (SPIKE_CHECK_PC | SPIKE_CHECK_INSN | SPIKE_CHECK_NPC |
+                                               SPIKE_CHECK_XPR | SPIKE_CHECK_MEM | SPIKE_CHECK_LOAD);
+    try {
+        for (int i = 0; i < count; ++i) {
+            const spike_rvfi_t &r = *order[i];
+            spike_commit_t dut;
+            dut.hartid = hartid;
+            dut.retired = !r.trap;
+            dut.pc = r.pc_rdata;
+            dut.npc = r.pc_wdata;
+            dut.insn = r.insn;
+            dut.priv = r.mode;
+            dut.overflow = 0;
+            dut.n_regs = 0;
+            if (r.rd_addr) {
+                spike_reg_write_t &w = dut.regs[dut.n_regs++];
+                w.type = SPIKE_REG_X;
+                w.idx = r.rd_addr;
+                w.value[0] = r.rd_wdata;
+                w.value[1] = 0;
+            }
+            dut.n_mems = 0;
+            rvfi_access(dut, r.mem_addr, r.mem_rmask, r.mem_rdata, 0);
+            rvfi_access(dut, r.mem_addr, r.mem_wmask, r.mem_wdata, 1);
+            int rc = ctx_check_commit(ctx, &dut, flags, report, report_len);
+            if (rc != SPIKE_CHECK_OK) return rc;
+        }
+        return SPIKE_CHECK_OK;
+    } catch (...) {
+        return -1;
+    }
+}
+
+/* PC */
+uint64_t spike_get_pc(void *handle, unsigned hartid)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    return p ? (uint64_t)p->get_state()->pc : 0;
+}
+
+/* GPRs */
+int spike_get_all_gprs(void *handle, unsigned hartid, uint64_t out[32])
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return 0;
+    const state_t *st = p->get_state();
+    for (int i = 0; i < NXPR; ++i) out[i] = (uint64_t)st->XPR[i];
+    return NXPR;
+}
+
+/* CSR read (generic) */
+uint64_t spike_get_csr(void *handle, unsigned hartid, uint32_t csr_addr)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    if (!ctx->sim) return 0;
+    try { return ctx->sim->dpi_get_csr(hartid, csr_addr); } catch (...) { return 0; }
+}
+
+int spike_get_all_harts_status(void *handle, spike_hart_status_t *out, int n)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || (!out && n > 0) || n < 0) return -1;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    int count = 0;
+    for (size_t id = 0; id < ctx->harts.size(); id++) {
+        processor_t *p = ctx->harts[id];
+        if (!p) continue;
+        if (count < n) {
+            state_t *st = p->get_state();
+            spike_hart_status_t *s = &out[count];
+            s->hartid = (uint32_t)id;
+            s->priv = (uint32_t)st->prv;
+            s->virt = st->v ? 1 : 0;
+            s->flags = (p->is_waiting_for_interrupt() ? SPIKE_HART_WFI : 0) |
+                       (st->debug_mode ? SPIKE_HART_DEBUG : 0);
+            s->pc = st->pc;
+            s->instret = st->minstret->read();
+        }
+        count++;
+    }
+    return count;
+}
+
+/* CSR handles */
+int spike_resolve_csr(void *handle, unsigned hartid, uint32_t csr_addr)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx_find_csr(ctx, hartid, csr_addr)) return -1;
+    return ctx_csr_handle(ctx, hartid, csr_addr);
+}
+
+int spike_read_csrs(void *handle, const int *csr_handles, uint64_t *out, int n)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !csr_handles || !out || n < 0) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    const size_t count = ctx->csr_handles.size();
+    for (int i = 0; i < n; ++i) {
+        size_t h = (size_t)csr_handles[i];
+        const csr_t *csr = h < count ? ctx->csr_handles[h].csr.get() : nullptr;
+        out[i] = csr ? (uint64_t)csr->read() : 0;
+    }
+    return n;
+}
+
+/* CSR write (best-effort) */
+void spike_put_csr(void *handle, unsigned hartid, uint32_t csr_addr, uint64_t value)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    try {
+        processor_t* p = ctx_hart(ctx, hartid);
+        if (p) p->put_csr((int)csr_addr, value);
+    } catch (...) {}
+}
+
+/* --- Snapshot --- */
+int spike_set_snapshot_csrs(void *handle, const uint32_t *csr_addrs, int n)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || n < 0 || (n > 0 && !csr_addrs)) return 0;
+    ctx_guard_t guard(ctx);
+    n = std::min(n, SPIKE_SNAPSHOT_MAX_CSRS);
+    ctx->snapshot_csrs.assign(csr_addrs, csr_addrs + n);
+    return n;
+}
+
+int spike_get_snapshot(void *handle, unsigned hartid, spike_snapshot_t *out)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return 0;
+    state_t *st = p->get_state();
+
+    out->pc = st->pc;
+    insn_bits_t insn;
+    out->insn = p->get_mmu()->probe_insn(st->pc, &insn) ? insn : 0;
+    out->priv = (uint32_t)st->prv;
+    out->virt = st->v ? 1 : 0;
+
+    for (int i = 0; i < NXPR; ++i) out->xpr[i] = (uint64_t)st->XPR[i];
+    for (int i = 0; i < NFPR; ++i) {
+        uint64_t v = 0;
+        std::memcpy(&v, &st->FPR[i], std::min(sizeof(st->FPR[i]), sizeof(v)));
+        out->fpr[i] = v;
+    }
+
+    out->n_csrs = (uint32_t)ctx->snapshot_csrs.size();
+    for (size_t i = 0; i < ctx->snapshot_csrs.size(); ++i) {
+        uint32_t addr = ctx->snapshot_csrs[i];
+        out->csr_addr[i] = addr;
+        try { out->csr[i] = p->get_csr((int)addr); } catch (...) { out->csr[i] = 0; }
+    }
+
+    const vectorUnit_t &VU = p->VU;
+    out->vstart = VU.vstart ? VU.vstart->read() : 0;
+    out->vl = VU.vl ? VU.vl->read() : 0;
+    out->vtype = VU.vtype ? VU.vtype->read() : 0;
+    out->vxsat = VU.vxsat ? VU.vxsat->read() : 0;
+    out->vxrm = VU.vxrm ? VU.vxrm->read() : 0;
+    out->vlenb = VU.vlenb;
+    return 1;
+}
+
+/* Checkpoint files */
+int spike_save_checkpoint_file(void *handle, const char *path)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !path) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        ctx->sim->save_checkpoint(path);
+        return 1;
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[dpi] %s\n", e.what());
+        return -1;
+    }
+}
+
+int spike_load_checkpoint_file(void *handle, const char *path)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !path) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        ctx->sim->load_checkpoint(path);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[dpi] %s\n", e.what());
+        return -1;
+    }
+    ctx->page_hashes.clear();
+    ctx->tohost_watch.hit.store(false);
+    ctx->tohost.store(0);
+    if (ctx->shm) ctx_publish(ctx);
+    return 1;
+}
+
+/* Fast-forward hand-off */
+int spike_lookup_symbol(void *handle, const char *name, uint64_t *addr)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !name || !addr) return 0;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return 0;
+    auto a = ctx->sim->get_symbol_addr(name);
+    if (!a) return 0;
+    *addr = *a;
+    return 1;
+}
+
+int spike_find_symbol(void *handle, uint64_t addr, char *name, int name_len, uint64_t *offset)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !name || name_len <= 0) return 0;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return 0;
+    uint64_t off = 0;
+    const char *sym = ctx->sim->find_symbol(addr, &off);
+    if (!sym) return 0;
+    std::snprintf(name, name_len, "%s", sym);
+    if (offset) *offset = off;
+    return 1;
+}
+
+int64_t spike_get_signature(void *handle, void *buf, uint64_t cap)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || (!buf && cap)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        std::vector<uint8_t> sig;
+        if (!ctx->sim->get_signature(sig)) return 0;
+        if (cap) std::memcpy(buf, sig.data(), std::min<uint64_t>(cap, sig.size()));
+        return sig.size();
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[dpi] spike_get_signature: %s\n", e.what());
+        return -1;
+    }
+}
+
+int spike_export_state(void *handle, const char *dir)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !dir) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    std::string prefix = std::string(dir) + "/";
+
+    for (auto &m : ctx->mems) {
+        char name[64];
+        std::snprintf(name, sizeof name, "mem.0x%" PRIx64 ".bin", (uint64_t)m.first);
+        std::ofstream mem_file(prefix + name, std::ios::binary);
+        if (!mem_file) return -1;
+        m.second->dump(mem_file);
+        if (!mem_file) return -1;
+    }
+
+    FILE *out = std::fopen((prefix + "state.txt").c_str(), "w");
+    if (!out) return -1;
+    for (size_t h = 0; h < ctx->harts.size(); ++h) {
+        processor_t *p = ctx->harts[h];
+        if (!p) continue;
+        state_t *st = p->get_state();
+        std::fprintf(out, "hart %zx\n", h);
+        std::fprintf(out, "pc %016" PRIx64 "\n", (uint64_t)st->pc);
+        std::fprintf(out, "priv %x\n", (unsigned)st->prv);
+        std::fprintf(out, "virt %x\n", st->v ? 1 : 0);
+        for (int r = 0; r < NXPR; ++r)
+            std::fprintf(out, "x %x %016" PRIx64 "\n", r, (uint64_t)st->XPR[r]);
+        for (int r = 0; r < NFPR; ++r) {
+            uint64_t v = 0;
+            std::memcpy(&v, &st->FPR[r], std::min(sizeof(st->FPR[r]), sizeof(v)));
+            std::fprintf(out, "f %x %016" PRIx64 "\n", r, v);
+        }
 
-    reg_t dram_base = (reg_t) (g_dram_base_override.value_or(g_dram_base_default));
-    size_t dram_size = g_dram_size_override.value_or(g_dram_size_default);
+        std::vector<reg_t> addrs;
+        for (auto &c : st->csrmap) addrs.push_back(c.first);
+        std::sort(addrs.begin(), addrs.end());
+        for (reg_t a : addrs) {
+            // reading seed draws (and logs) fresh entropy; it holds no state
+            if (a == CSR_SEED) continue;
+            uint64_t v;
+            try { v = (uint64_t)st->csrmap[a]->read(); } catch (...) { continue; }
+            std::fprintf(out, "csr %03" PRIx64 " %016" PRIx64 "\n", (uint64_t)a, v);
+        }
 
-    std::vector<std::pair<reg_t, abstract_mem_t*>> mems;
-    abstract_mem_t *dram_mem = nullptr;
-    try {
-        mem_t *m = new mem_t((reg_t)dram_size);
-        dram_mem = reinterpret_cast<abstract_mem_t*>(m);
-        mems.push_back(std::make_pair(dram_base, dram_mem));
-    } catch (const std::exception &e) {
-        std::fprintf(stderr, "[dpi] dram allocation failed: %s\n", e.what());
-        delete config;
-        return;
-    } catch (...) {
-        std::fprintf(stderr, "[dpi] dram allocation unknown failure\n");
-        delete config;
-        return;
+        const vectorUnit_t &VU = p->VU;
+        if (VU.reg_file && VU.vlenb) {
+            const uint8_t *base = reinterpret_cast<const uint8_t*>(VU.reg_file);
+            for (int r = 0; r < NVPR; ++r) {
+                std::fprintf(out, "v %x ", r);
+                // most significant byte first
+                for (reg_t b = VU.vlenb; b-- > 0; )
+                    std::fprintf(out, "%02x", base[r * VU.vlenb + b]);
+                std::fprintf(out, "\n");
+            }
+        }
     }
+    bool ok = !std::ferror(out);
+    if (std::fclose(out) != 0) ok = false;
+    return ok ? 1 : -1;
+}
 
-    try {
-        g_sim = new sim_t(config,
-                          /*halted*/ false,
-                          /*mems*/ mems,
-                          /*plugin_device_factories*/ empty_factories,
-                          /*args*/ htif_args,
-                          /*dm_config*/ dm_config,
-                          /*log_path*/ "dpi_spike.log",
-                          /*dtb_enabled*/ false,
-                          /*dtb_file*/ nullptr,
-                          /*socket_enabled*/ false,
-                          /*cmd_file*/ nullptr,
-                          /*instruction_limit*/ std::nullopt);
-        g_sim->set_debug(false);
-        g_sim->start();
-        g_sim->dpi_reset();
+int spike_dump_mem_sparse(void *handle, const char *dir)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !dir) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
 
-        uint64_t pc = g_initial_pc_override.value_or(g_initial_pc_default);
-        try { g_sim->dpi_set_pc((reg_t)pc); } catch (...) {}
-    } catch (const std::exception &e) {
-        std::fprintf(stderr, "[dpi] spike_create exception: %s\n", e.what());
-        if (g_sim) { delete g_sim; g_sim = nullptr; }
-    } catch (...) {
-        std::fprintf(stderr, "[dpi] spike_create unknown exception\n");
-        if (g_sim) { delete g_sim; g_sim = nullptr; }
+    for (auto &m : ctx->mems) {
+        char name[64];
+        std::snprintf(name, sizeof name, "/mem.0x%" PRIx64 ".sparse", (uint64_t)m.first);
+        std::ofstream mem_file(std::string(dir) + name, std::ios::binary);
+        if (!mem_file) return -1;
+        m.second->dump_sparse(mem_file);
+        if (!mem_file) return -1;
     }
+    return 1;
 }
 
-/* Delete instance */
-void spike_delete()
+int spike_read_mem(void *handle, uint64_t paddr, void *buf, uint64_t len)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return;
-    delete g_sim;
-    g_sim = nullptr;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || (!buf && len)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    return ctx->sim->dpi_read_mem(paddr, len, buf) ? 0 : -1;
 }
 
-/* Step */
-int spike_step()
+int spike_write_mem(void *handle, uint64_t paddr, const void *buf, uint64_t len)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return -1;
-    try { return g_sim->dpi_step(1); } catch (...) { return -1; }
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || (!buf && len)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    return ctx->sim->dpi_write_mem(paddr, len, buf) ? 0 : -1;
 }
 
-/* Reset */
-void spike_reset()
+int spike_read_vmem(void *handle, unsigned hartid, uint64_t vaddr, uint64_t len, void *out)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return;
-    try { g_sim->dpi_reset(); } catch (...) {}
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || (!out && len)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return -1;
+    return p->get_mmu()->probe_load(vaddr, len, (uint8_t *)out) ? 0 : -1;
 }
 
-/* PC */
-uint64_t spike_get_pc(unsigned hartid)
+int spike_load_image(void *handle, const char *path, uint64_t paddr)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
-    try { return (uint64_t) g_sim->dpi_get_pc(hartid); } catch (...) { return 0; }
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !path) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        load_mem_image(path, paddr, ctx->mems);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[dpi] spike_load_image: %s\n", e.what());
+        return -1;
+    }
+    ctx->sim->external_writes++;
+    for (processor_t *p : ctx->harts)
+        if (p) p->get_mmu()->flush_icache();
+    return 1;
 }
 
-/* GPRs */
-int spike_get_all_gprs(unsigned hartid, uint64_t out[32])
+int spike_track_stores(void *handle, uint32_t line_bytes)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim || !out) return 0;
-    try { return g_sim->dpi_get_all_gprs(hartid, out); } catch (...) { return 0; }
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    if ((line_bytes & (line_bytes - 1)) || line_bytes > PGSIZE) return -1;
+
+    for (processor_t *p : ctx->harts)
+        if (p) p->get_mmu()->track_stores(line_bytes);
+    ctx->dirty_lines.clear();
+    ctx->dirty_line_size = line_bytes;
+    ctx->page_hashes.clear();
+    return 0;
 }
 
-/* CSR read (generic) */
-uint64_t spike_get_csr(unsigned hartid, uint32_t csr_addr)
+int spike_take_dirty_lines(void *handle, uint64_t *addrs, uint8_t *data, int max_lines)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
-    try { return g_sim->dpi_get_csr(hartid, csr_addr); } catch (...) { return 0; }
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || max_lines < 0 || (max_lines && !addrs)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    if (!ctx->dirty_line_size) return -1;
+
+    // harts may have written the same line
+    auto &lines = ctx->dirty_lines;
+    for (processor_t *p : ctx->harts)
+        if (p) p->get_mmu()->take_stores(lines);
+    std::sort(lines.begin(), lines.end());
+    lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+
+    size_t n = std::min(lines.size(), (size_t)max_lines);
+    for (size_t i = 0; i < n; ++i) {
+        addrs[i] = lines[i];
+        if (!data) continue;
+        uint8_t *dst = data + i * ctx->dirty_line_size;
+        if (char *src = ctx->sim->dpi_addr_to_mem(lines[i]))
+            std::memcpy(dst, src, ctx->dirty_line_size);
+        else
+            std::memset(dst, 0, ctx->dirty_line_size);
+    }
+    lines.erase(lines.begin(), lines.begin() + n);
+    return (int)n;
 }
 
-/* CSR write (best-effort) */
-void spike_put_csr(unsigned hartid, uint32_t csr_addr, uint64_t value)
+static uint64_t page_hash(const char *page)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return;
-    try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
-        if (p) p->put_csr((int)csr_addr, value);
-    } catch (...) {}
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < PGSIZE; ++i)
+        h = (h ^ (uint8_t)page[i]) * 0x100000001b3ULL;
+    return h;
 }
 
-/* --- Floating-point registers --- */
-/* Read 32 FPRs as raw bit patterns. Returns 32 or 0. */
-int spike_get_all_fprs(unsigned hartid, uint64_t out[32])
+int spike_get_page_hashes(void *handle, uint64_t base, int n, uint64_t *out)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim || !out) return 0;
-    try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
-        if (!p) return 0;
-        state_t* st = p->get_state();
-        if (!st) return 0;
-        // copy each FPR raw bytes into uint64_t (zero-extended if smaller)
-        size_t fpr_size = sizeof(st->FPR[0]);
-        for (int i = 0; i < 32; ++i) {
-            uint64_t v = 0;
-            size_t copy_bytes = std::min<size_t>(fpr_size, sizeof(uint64_t));
-            std::memcpy(&v, &st->FPR[i], copy_bytes);
-            out[i] = v;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || n < 0 || (n && !out) || base % PGSIZE) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+
+    // Drop what the harts, or anything else, have written since
+    auto &cache = ctx->page_hashes;
+    if (!ctx->dirty_line_size || ctx->sim->external_writes != ctx->page_hash_writes) {
+        cache.clear();
+        ctx->page_hash_writes = ctx->sim->external_writes;
+    }
+    std::vector<reg_t> written;
+    for (processor_t *p : ctx->harts)
+        if (p) p->get_mmu()->take_store_pages(written);
+    for (reg_t page : written)
+        cache.erase(page);
+
+    for (int i = 0; i < n; ++i) {
+        reg_t paddr = base + (reg_t)i * PGSIZE;
+        auto it = cache.find(paddr);
+        if (it != cache.end()) {
+            out[i] = it->second;
+            continue;
+        }
+        const char *page = ctx->sim->dpi_addr_to_mem(paddr);
+        if (!page) return -1;
+        out[i] = page_hash(page);
+        if (ctx->dirty_line_size)
+            cache.emplace(paddr, out[i]);
+    }
+    return n;
+}
+
+int64_t spike_mem_diff(void *handle, uint64_t paddr, uint64_t len, const void *dut,
+                       uint64_t *mismatches, uint64_t max_mismatches)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || (!dut && len) || (!mismatches && max_mismatches)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+
+    abstract_mem_t *mem = nullptr;
+    reg_t base = 0;
+    for (auto &m : ctx->mems) {
+        if (paddr >= m.first && len <= m.second->size() && paddr - m.first <= m.second->size() - len) {
+            mem = m.second;
+            base = m.first;
+        }
+    }
+    if (!mem) return -1;
+    if (len == 0) return 0;
+
+    // Only visit the pages the model holds, so that comparing a mostly
+    // untouched region neither allocates nor walks it
+    reg_t start = paddr - base, end = start + len;
+    std::vector<std::pair<reg_t, const char*>> pages;
+    mem->for_each_page([&](reg_t addr, char *page) {
+        if (addr + PGSIZE > start && addr < end)
+            pages.emplace_back(addr, page);
+    });
+
+    static const char zero[PGSIZE] = {0};
+    const char *d = (const char *)dut;
+    int64_t count = 0;
+    size_t next = 0;
+    for (reg_t pg = start & ~reg_t(PGSIZE - 1); pg < end; pg += PGSIZE) {
+        const char *page = zero;
+        if (next < pages.size() && pages[next].first == pg)
+            page = pages[next++].second;
+        reg_t lo = std::max(pg, start), hi = std::min(pg + PGSIZE, end);
+        const char *ref = page + (lo - pg), *cmp = d + (lo - start);
+        if (std::memcmp(ref, cmp, hi - lo) == 0)
+            continue;
+        for (reg_t i = 0; i < hi - lo; ++i) {
+            if (ref[i] == cmp[i]) continue;
+            if ((uint64_t)count < max_mismatches)
+                mismatches[count] = base + lo + i;
+            ++count;
         }
-        return 32;
-    } catch (...) {
-        return 0;
     }
+    return count;
+}
+
+/* --- Floating-point registers --- */
+/* Read 32 FPRs as raw bit patterns, the low 64 bits of each. Returns 32 or 0. */
+int spike_get_all_fprs(void *handle, unsigned hartid, uint64_t out[32])
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return 0;
+    return export_fprs(p, out, 1, nullptr);
+}
+
+int spike_get_all_fprs_wide(void *handle, unsigned hartid, uint64_t out[64], uint8_t *boxed)
+{
+    static_assert(SPIKE_FPR_BOXED_H == FPR_BOXED_H && SPIKE_FPR_BOXED_S == FPR_BOXED_S &&
+                  SPIKE_FPR_BOXED_D == FPR_BOXED_D, "NaN-boxing bits out of step");
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return 0;
+    return export_fprs(p, out, 2, boxed);
 }
 
 /* --- Vector registers dump --- */
@@ -249,45 +2961,36 @@ int spike_get_all_fprs(unsigned hartid, uint64_t out[32])
    out_size_qwords is the capacity of out[] in 64-bit words.
    Returns number of qwords written or 0 on error.
 */
-int spike_get_all_vregs(unsigned hartid, uint64_t *out, int out_size_qwords)
+int spike_get_all_vregs(void *handle, unsigned hartid, uint64_t *out, int out_size_qwords)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim || !out || out_size_qwords <= 0) return 0;
-    try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
-        if (!p) return 0;
-        vectorUnit_t &VU = p->VU;
-        if (!VU.reg_file) return 0;
-        reg_t VLEN = VU.get_vlen(); // bits
-        if (VLEN == 0) return 0;
-        size_t bytes_per_reg = (size_t)(VLEN >> 3);
-        const int nregs = 32; // architectural vector registers
-        size_t total_bytes = bytes_per_reg * (size_t)nregs;
-        size_t total_qwords = (total_bytes + 7) / 8;
-        int to_write = (int) std::min<size_t>((size_t)out_size_qwords, total_qwords);
-        const uint8_t *base = reinterpret_cast<const uint8_t*>(VU.reg_file);
-        for (int q = 0; q < to_write; ++q) {
-            size_t byte_idx = (size_t)q * 8;
-            uint64_t val = 0;
-            if (byte_idx < total_bytes) {
-                size_t copy_bytes = std::min<size_t>(8, total_bytes - byte_idx);
-                std::memcpy(&val, base + byte_idx, copy_bytes);
-            }
-            out[q] = val;
-        }
-        return to_write;
-    } catch (...) {
-        return 0;
-    }
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out || out_size_qwords <= 0) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return 0;
+    return export_vregs(p, out, (size_t)out_size_qwords);
+}
+
+/* Vector registers written since the previous call */
+int spike_get_dirty_vregs(void *handle, unsigned hartid, uint64_t *out, int out_size_qwords, uint32_t *mask)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    if (!ctx->sim) return -1;
+    try { return ctx->sim->dpi_get_dirty_vregs(hartid, out, out_size_qwords, mask); } catch (...) { return -1; }
 }
 
 /* VLEN in bits */
-int spike_get_vlen(unsigned hartid)
+int spike_get_vlen(void *handle, unsigned hartid)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         return (int)p->VU.get_vlen();
     } catch (...) {
@@ -296,12 +2999,13 @@ int spike_get_vlen(unsigned hartid)
 }
 
 /* vlenb in bytes (VLEN/8) */
-uint64_t spike_get_vlenb(unsigned hartid)
+uint64_t spike_get_vlenb(void *handle, unsigned hartid)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         return (uint64_t)p->VU.vlenb;
     } catch (...) {
@@ -312,12 +3016,14 @@ uint64_t spike_get_vlenb(unsigned hartid)
 /* Vector CSRs: vxsat, vxrm, vstart, vl, vtype */
 /* All return 0 on error. For csr-like fields (vstart/vl/vtype/vxrm/vxsat) try to read CSR object if present. */
 
-uint64_t spike_get_vxsat(unsigned hartid)
+uint64_t spike_get_vxsat(void *handle, unsigned hartid)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         // vxsat may be a csr_t_p (pointer-like); if present call read()
         if (p->VU.vxsat) {
@@ -329,12 +3035,14 @@ uint64_t spike_get_vxsat(unsigned hartid)
     }
 }
 
-uint64_t spike_get_vxrm(unsigned hartid)
+uint64_t spike_get_vxrm(void *handle, unsigned hartid)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         if (p->VU.vxrm) return (uint64_t) p->VU.vxrm->read();
         return 0;
@@ -343,12 +3051,14 @@ uint64_t spike_get_vxrm(unsigned hartid)
     }
 }
 
-uint64_t spike_get_vstart(unsigned hartid)
+uint64_t spike_get_vstart(void *handle, unsigned hartid)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         if (p->VU.vstart) return (uint64_t) p->VU.vstart->read();
         return 0;
@@ -357,12 +3067,14 @@ uint64_t spike_get_vstart(unsigned hartid)
     }
 }
 
-uint64_t spike_get_vl(unsigned hartid)
+uint64_t spike_get_vl(void *handle, unsigned hartid)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         if (p->VU.vl) return (uint64_t) p->VU.vl->read();
         // fallback: vlmax / setvl_count maybe available
@@ -372,12 +3084,14 @@ uint64_t spike_get_vl(unsigned hartid)
     }
 }
 
-uint64_t spike_get_vtype(unsigned hartid)
+uint64_t spike_get_vtype(void *handle, unsigned hartid)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         if (p->VU.vtype) return (uint64_t) p->VU.vtype->read();
         // fallback: construct vtype from vsew and vflmul if possible
@@ -391,12 +3105,14 @@ uint64_t spike_get_vtype(unsigned hartid)
 }
 
 /* Generic vector CSR reader by CSR address (useful if you want to read via CSR number) */
-uint64_t spike_get_vcsr(unsigned hartid, uint32_t csr_addr)
+uint64_t spike_get_vcsr(void *handle, unsigned hartid, uint32_t csr_addr)
 {
-    std::lock_guard<std::mutex> lk(g_mutex);
-    if (!g_sim) return 0;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return 0;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
     try {
-        processor_t* p = g_sim->get_core_by_id(hartid);
+        processor_t* p = ctx_hart(ctx, hartid);
         if (!p) return 0;
         state_t* st = p->get_state();
         if (!st) return 0;
@@ -410,4 +3126,540 @@ uint64_t spike_get_vcsr(unsigned hartid, uint32_t csr_addr)
     }
 }
 
+int spike_set_tlb(void *handle, uint64_t entries, uint64_t ways)
+{
+    auto pow2 = [](uint64_t v) { return v && !(v & (v - 1)); };
+    if (!pow2(entries) || !pow2(ways) || ways > entries) return -1;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) {
+        std::lock_guard<std::mutex> lk(g_mutex);
+        g_tlb_entries = (size_t)entries;
+        g_tlb_ways = (size_t)ways;
+        return 0;
+    }
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        for (processor_t *p : ctx->harts)
+            if (p) p->get_mmu()->configure_tlb((size_t)entries, (size_t)ways);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int spike_set_icache(void *handle, uint64_t entries)
+{
+    if (!entries || (entries & (entries - 1))) return -1;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) {
+        std::lock_guard<std::mutex> lk(g_mutex);
+        g_icache_entries = (size_t)entries;
+        return 0;
+    }
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        for (processor_t *p : ctx->harts)
+            if (p) p->get_mmu()->configure_icache((size_t)entries);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int spike_set_block_cache(void *handle, uint64_t entries)
+{
+    if (entries & (entries - 1)) return -1;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) {
+        std::lock_guard<std::mutex> lk(g_mutex);
+        g_block_cache_entries = (size_t)entries;
+        return 0;
+    }
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        for (processor_t *p : ctx->harts)
+            if (p) p->get_mmu()->configure_block_cache((size_t)entries);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int spike_set_vector_threads(void *handle, unsigned threads)
+{
+    if (!threads) return -1;
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) {
+        std::lock_guard<std::mutex> lk(g_mutex);
+        g_vector_threads = threads;
+        return 0;
+    }
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    try {
+        for (processor_t *p : ctx->harts)
+            if (p) p->VU.set_threads(threads);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int spike_get_mmu_stats(void *handle, unsigned hartid, spike_mmu_stats_t *out)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return -1;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return -1;
+    const mmu_stats_t &stats = p->get_mmu()->get_stats();
+    out->tlb_hits = stats.tlb_hits;
+    out->tlb_misses = stats.tlb_misses;
+    out->walks = stats.walks;
+    out->walk_cache_hits = stats.walk_cache_hits;
+    out->superpage_hits = stats.superpage_hits;
+    out->icache_hits = stats.icache_hits;
+    out->icache_refills = stats.icache_refills;
+    out->block_links = stats.block_links;
+    out->gstage_walks = stats.gstage_walks;
+    out->gstage_hits = stats.gstage_hits;
+    out->gstage_pte_loads = stats.gstage_pte_loads;
+    return 0;
+}
+
+int spike_get_hart_stats(void *handle, unsigned hartid, spike_hart_stats_t *out)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return -1;
+    ctx_guard_t guard(ctx);
+    runahead_pause_t pause(ctx->runahead.get());
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return -1;
+    const mmu_stats_t &m = p->get_mmu()->get_stats();
+    const hart_stats_t &h = p->get_stats();
+    out->tlb_misses_fetch = m.tlb_misses_fetch;
+    out->tlb_misses_load = m.tlb_misses_load;
+    out->tlb_misses_store = m.tlb_misses_store;
+    out->slow_tlb_miss = m.slow_tlb_miss;
+    out->slow_misaligned = m.slow_misaligned;
+    out->slow_flagged = m.slow_flagged;
+    out->slow_special = m.slow_special;
+    out->mmio_loads = m.mmio_loads;
+    out->mmio_stores = m.mmio_stores;
+    out->mmio_fetches = m.mmio_fetches;
+    out->opcode_cache_misses = h.opcode_cache_misses;
+    memcpy(out->exceptions, h.exceptions, sizeof(out->exceptions));
+    memcpy(out->interrupts, h.interrupts, sizeof(out->interrupts));
+    return 0;
+}
+
+int spike_get_footprint(void *handle, spike_footprint_t *out)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !out) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    footprint_t f = ctx->sim->get_footprint();
+    out->mem_bytes = f.mem_bytes;
+    out->mem_touched_bytes = f.mem_touched_bytes;
+    out->tlb_bytes = f.tlb_bytes;
+    out->icache_bytes = f.icache_bytes;
+    out->vreg_bytes = f.vreg_bytes;
+    out->log_buffer_bytes = f.log_buffer_bytes;
+    out->rss_bytes = f.rss_bytes;
+    out->peak_rss_bytes = f.peak_rss_bytes;
+    return 0;
+}
+
+void spike_clear_mmu_stats(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return;
+    ctx->sim->clear_hart_stats();
+}
+
+int spike_set_insn_stats(void *handle, int enable)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    if (ctx_running_ahead(ctx)) return -1;
+    for (processor_t *p : ctx->harts)
+        if (p) p->set_insn_stats(enable != 0);
+    return 0;
+}
+
+int spike_get_insn_count(void *handle, unsigned hartid, const char *mnemonic, uint64_t out[4])
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || !mnemonic || !out) return -1;
+    ctx_guard_t guard(ctx);
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p || ctx_running_ahead(ctx)) return -1;
+    std::string name = mnemonic;
+    std::replace(name.begin(), name.end(), '.', '_');
+    for (int i = 0; i < 4; i++)
+        out[i] = 0;
+    for (auto &c : p->get_insn_counts()) {
+        if (name != c.name)
+            continue;
+        for (int i = 0; i < 4; i++)
+            out[i] += c.count[i];
+    }
+    return 0;
+}
+
+int spike_dump_insn_stats(void *handle, const char *path)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    FILE *out = path ? fopen(path, "w") : stderr;
+    if (!out) {
+        fprintf(stderr, "[dpi] spike_dump_insn_stats: cannot open %s\n", path);
+        return -1;
+    }
+    for (processor_t *p : ctx->harts)
+        if (p) p->print_insn_stats(out);
+    if (path)
+        fclose(out);
+    else
+        fflush(out);
+    return 0;
+}
+
+void spike_clear_insn_stats(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return;
+    for (processor_t *p : ctx->harts)
+        if (p) p->clear_insn_counts();
+}
+
+int spike_set_guest_profile(void *handle, const char *path, uint32_t hz, int unwind)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    try {
+        ctx->guest_profiler.reset();
+        if (path)
+            ctx->guest_profiler.reset(new guest_profiler_t(ctx->sim.get(), path, hz, unwind != 0));
+        return 0;
+    } catch (const std::exception &e) {
+        fprintf(stderr, "[dpi] spike_set_guest_profile: %s\n", e.what());
+        return -1;
+    }
+}
+
+int spike_set_metrics(void *handle, const char *path, uint32_t interval_ms)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    try {
+        ctx->metrics.reset();
+        ctx->call_timing.fetch_and(~CALL_TIME_METRICS, std::memory_order_relaxed);
+        if (path) {
+            ctx->metrics.reset(new metrics_writer_t(ctx->sim.get(), path, interval_ms));
+            ctx->metrics->set_extra([ctx](FILE *f) {
+                fprintf(f, "# TYPE spike_dpi_calls counter\n");
+                fprintf(f, "spike_dpi_calls_total %" PRIu64 "\n", ctx->dpi_calls.load(std::memory_order_relaxed));
+                fprintf(f, "# TYPE spike_dpi_seconds counter\n");
+                fprintf(f, "spike_dpi_seconds_total %.6f\n", ctx->dpi_ns.load(std::memory_order_relaxed) / 1e9);
+            });
+            ctx->call_timing.fetch_or(CALL_TIME_METRICS, std::memory_order_relaxed);
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        fprintf(stderr, "[dpi] spike_set_metrics: %s\n", e.what());
+        return -1;
+    }
+}
+
+int spike_set_call_profile(void *handle, int enable, const char *path)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    try {
+        if (ctx->call_profile) {
+            ctx->call_timing.fetch_and(~CALL_TIME_PROFILE, std::memory_order_relaxed);
+            ctx->call_profile->write();
+            ctx->call_profile.reset();
+        }
+        if (enable) {
+            ctx->call_profile.reset(new call_profile_t());
+            ctx->call_profile->path = path ? path : "";
+            ctx->call_timing.fetch_or(CALL_TIME_PROFILE, std::memory_order_relaxed);
+        }
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int spike_get_dpi_calls(void *handle, uint64_t *calls, uint64_t *ns)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    if (calls) *calls = ctx->dpi_calls.load(std::memory_order_relaxed);
+    if (ns) *ns = ctx->dpi_ns.load(std::memory_order_relaxed);
+    return 0;
+}
+
+int spike_set_call_trace(void *handle, unsigned hartid, const char *path,
+                         const uint64_t *ranges, int n_ranges)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || n_ranges < 0 || (n_ranges > 0 && !ranges)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return -1;
+    try {
+        ctx->call_tracers.erase(hartid);
+        if (path) {
+            call_tracer_t::ranges_t r;
+            for (int i = 0; i < n_ranges; ++i)
+                r.emplace_back(ranges[2 * i], ranges[2 * i + 1]);
+            ctx->call_tracers[hartid].reset(new call_tracer_t(p, path, r));
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        fprintf(stderr, "[dpi] spike_set_call_trace: %s\n", e.what());
+        return -1;
+    }
+}
+
+int spike_set_coverage(void *handle, unsigned hartid, const char *path)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return -1;
+    try {
+        ctx->coverage.erase(hartid);
+        if (path) ctx->coverage[hartid].reset(new coverage_t(p, path));
+        return 0;
+    } catch (const std::exception &e) {
+        fprintf(stderr, "[dpi] spike_set_coverage: %s\n", e.what());
+        return -1;
+    }
+}
+
+int spike_set_input_log(void *handle, const char *path, int replay)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    try {
+        ctx->input_log.reset();
+        if (path) ctx->input_log.reset(new input_log_t(ctx->sim.get(), path, replay != 0));
+        return 0;
+    } catch (const std::exception &e) {
+        fprintf(stderr, "[dpi] spike_set_input_log: %s\n", e.what());
+        return -1;
+    }
+}
+
+int spike_set_mem_observer(void *handle, unsigned hartid, spike_mem_observer_fn fn, void *user)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return -1;
+    ctx->mem_observers.erase(hartid);
+    if (fn)
+        ctx->mem_observers[hartid].reset(new dpi_mem_observer_t(p, fn, user));
+    return 0;
+}
+
+int spike_enable_rocc(void *handle)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx) || !ctx->rocc.empty()) return -1;
+    for (const auto &[id, p] : ctx->sim->get_harts()) {
+        ctx->rocc.emplace_back(new dpi_rocc_t(ctx));
+        p->register_extension(ctx->rocc.back().get());
+    }
+    return 0;
+}
+
+int spike_rocc_take(void *handle, spike_rocc_req_t *buf, int cap)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || cap < 0 || (!buf && cap)) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    int n = std::min<size_t>(cap, ctx->rocc_queue.size());
+    std::copy_n(ctx->rocc_queue.begin(), n, buf);
+    ctx->rocc_queue.erase(ctx->rocc_queue.begin(), ctx->rocc_queue.begin() + n);
+    return n;
+}
+
+int spike_rocc_respond(void *handle, unsigned hartid, unsigned rd, uint64_t value)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p || rd == 0 || rd >= NXPR) return -1;
+    reg_t bit = reg_t(1) << rd;
+    if (!(p->get_xpr_pending() & bit)) return -1;
+    p->get_state()->XPR.write(rd, p->get_xlen() == 32 ? (reg_t)(int32_t)value : value);
+    p->set_xpr_pending(p->get_xpr_pending() & ~bit);
+    return 0;
+}
+
+int64_t spike_rocc_pending(void *handle, unsigned hartid)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim) return -1;
+    processor_t *p = ctx_hart(ctx, hartid);
+    if (!p) return -1;
+    return p->get_xpr_pending();
+}
+
+int spike_enable_state_hash(void *handle, uint32_t types)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx)) return -1;
+    ctx->state_hash.types = types;
+    ctx->state_hash.harts.assign(ctx->harts.size(), state_hash_t::hart_t());
+    if (!ctx->state_hashing) {
+        for (processor_t *p : ctx->harts)
+            if (p) p->add_commit_observer(&ctx->state_hash);
+        ctx->state_hashing = true;
+    }
+    return 0;
+}
+
+int spike_get_state_hash(void *handle, unsigned hartid, uint64_t *hash, uint64_t *count)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx_running_ahead(ctx) || !ctx->state_hashing) return -1;
+    if (hartid >= ctx->state_hash.harts.size() || !ctx_hart(ctx, hartid)) return -1;
+    const state_hash_t::hart_t &h = ctx->state_hash.harts[hartid];
+    if (hash) *hash = h.hash;
+    if (count) *count = h.count;
+    return 0;
+}
+
+int spike_set_check_sampling(void *handle, uint64_t period, uint64_t window, uint64_t seed)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx || window > period) return -1;
+    ctx_guard_t guard(ctx);
+    ctx->sample_period = period;
+    ctx->sample_window = window;
+    ctx->sample_rng = seed;
+    ctx->sample_tail = 0;
+    return 0;
+}
+
+int64_t spike_next_sample(void *handle, uint64_t *window)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sample_period) return -1;
+    const uint64_t slack = ctx->sample_period - ctx->sample_window;
+    uint64_t offset = slack;
+    if (ctx->sample_rng) {
+        // xorshift64*, as the window may start anywhere in its period
+        uint64_t &x = ctx->sample_rng;
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        offset = slack ? (x * 0x2545f4914f6cdd1dull) % (slack + 1) : 0;
+    }
+    uint64_t gap = ctx->sample_tail + offset;
+    ctx->sample_tail = slack - offset;
+    if (window) *window = ctx->sample_window;
+    return (int64_t)gap;
+}
+
+int spike_check_gap(void *handle, uint64_t n, const uint64_t *dut_hashes, char *report, int report_len)
+{
+    spike_ctx_t *ctx = as_ctx(handle);
+    if (!ctx) return -1;
+    ctx_guard_t guard(ctx);
+    if (!ctx->sim || ctx->replay || ctx_running_ahead(ctx)) return -1;
+    if (dut_hashes && !ctx->state_hashing) return -1;
+    try {
+        // observers other than the hash see nothing, so the gap stays on
+        // the fast path as far as they allow
+        if (ctx->capturing) ctx->commit_capture.begin(nullptr, 0);
+        uint64_t left = n;
+        while (left > 0 && !ctx->tohost_watch.hit.load(std::memory_order_relaxed)) {
+            reg_t chunk = std::min<reg_t>(left, ctx_sync_irqs(ctx));
+            ctx->sim->dpi_step(chunk);
+            left -= chunk;
+        }
+        if (ctx->capturing) ctx->commit_capture.end();
+        if (ctx->shm) ctx_publish(ctx);
+        ctx_poll_tohost(ctx);
+    } catch (...) {
+        if (ctx->capturing) ctx->commit_capture.end();
+        return -1;
+    }
+    if (!dut_hashes) return SPIKE_CHECK_OK;
+
+    for (unsigned hartid = 0; hartid < ctx->state_hash.harts.size(); ++hartid) {
+        const state_hash_t::hart_t &h = ctx->state_hash.harts[hartid];
+        if (!ctx_hart(ctx, hartid) || h.hash == dut_hashes[hartid]) continue;
+        if (report && report_len > 0)
+            snprintf(report, (size_t)report_len,
+                     "hart%u state hash ref 0x%016" PRIx64 " dut 0x%016" PRIx64 " after %" PRIu64 " commits",
+                     hartid, h.hash, dut_hashes[hartid], h.count);
+        return SPIKE_MISMATCH_HASH;
+    }
+    return SPIKE_CHECK_OK;
+}
+
+int spike_set_host_fp(int enable)
+{
+    if (!softfloat_setHostFP(enable != 0) && enable) {
+        fprintf(stderr, "[dpi] spike_set_host_fp: not supported on this host\n");
+        return -1;
+    }
+    return 0;
+}
+
+const char* spike_host_simd(void)
+{
+    return host_simd_name();
+}
+
 } // extern "C"
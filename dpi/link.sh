@@ -1,3 +1 @@
-find ../build -name '*.o' > all_objs.txt
-ar rcs libspike.a $(cat all_objs.txt)
-g++ -fPIC -O2 -std=c++17 -shared -pthread -Wl,-soname,libspike_dpi.so     -o libspike_dpi.so dpi_wrapper.cc libspike.a -ldl -lrt -lm -I../ -I../fesvr -I../riscv
\ No newline at end of file
+g++ -fPIC -O2 -std=c++2a -fvisibility=hidden -fvisibility-inlines-hidden -shared -pthread -Wl,-soname,libspike_dpi.so -Wl,--exclude-libs,ALL -o libspike_dpi.so dpi_wrapper.cc ../build/libriscv.a ../build/libsoftfloat.a ../build/libfesvr.a ../build/libdisasm.a ../build/libfdt.a -ldl -lrt -lm -I../ -iquote ../fesvr -iquote ../riscv
\ No newline at end of file
@@ -0,0 +1,814 @@
+// spike_dpi.h
+// C prototypes for the Spike DPI wrapper (libspike_dpi.so).
+// Every entry point is callable from SystemVerilog through "import DPI-C";
+// a spike instance handle maps to an SV chandle.
+
+#ifndef _SPIKE_DPI_H
+#define _SPIKE_DPI_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The library is built with hidden visibility; everything declared here is
+   exported. */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
+#define SPIKE_SNAPSHOT_MAX_CSRS 64
+
+/* Architectural state of one hart, filled by spike_get_snapshot in a single
+   call. The CSR list is chosen with spike_set_snapshot_csrs; csr[i] holds the
+   value of csr_addr[i]. Vector fields are zero when V is not present. */
+typedef struct {
+    uint64_t pc;
+    uint64_t insn;          /* bits of the instruction at pc, 0 if it faults */
+    uint32_t priv;          /* 0 = U, 1 = S, 3 = M */
+    uint32_t virt;          /* 1 when in VS/VU mode */
+    uint64_t xpr[32];
+    uint64_t fpr[32];       /* low 64 bits of each FPR */
+    uint32_t n_csrs;
+    uint32_t csr_addr[SPIKE_SNAPSHOT_MAX_CSRS];
+    uint64_t csr[SPIKE_SNAPSHOT_MAX_CSRS];
+    uint64_t vstart;
+    uint64_t vl;
+    uint64_t vtype;
+    uint64_t vxsat;
+    uint64_t vxrm;
+    uint64_t vlenb;
+} spike_snapshot_t;
+
+#define SPIKE_COMMIT_MAX_REGS 16
+#define SPIKE_COMMIT_MAX_MEMS 16
+
+/* Register kinds in spike_reg_write_t.type */
+#define SPIKE_REG_X    0
+#define SPIKE_REG_F    1
+#define SPIKE_REG_V    2
+#define SPIKE_REG_CSR  4
+
+typedef struct {
+    uint32_t type;          /* SPIKE_REG_* */
+    uint32_t idx;           /* register number, or CSR address */
+    uint64_t value[2];      /* low 128 bits, little-endian 64-bit words */
+} spike_reg_write_t;
+
+typedef struct {
+    uint64_t addr;
+    uint64_t value;         /* stored or loaded data; accesses wider than
+                               64 bits are split into 64-bit entries */
+    uint32_t size;          /* bytes */
+    uint32_t is_store;
+} spike_mem_access_t;
+
+/* Effects of one step, filled by spike_step_commit. When the step took a
+   trap or interrupt instead of retiring, retired is 0, pc/insn describe the
+   instruction that was about to execute and npc is the handler address; the
+   register and memory lists are then empty. Lists longer than the inline
+   arrays are truncated and flagged with overflow. */
+typedef struct {
+    uint32_t hartid;
+    uint32_t retired;
+    uint64_t pc;
+    uint64_t insn;
+    uint64_t npc;
+    uint32_t priv;          /* privilege the instruction executed in */
+    uint32_t overflow;
+    uint32_t n_regs;
+    spike_reg_write_t regs[SPIKE_COMMIT_MAX_REGS];
+    uint32_t n_mems;
+    spike_mem_access_t mems[SPIKE_COMMIT_MAX_MEMS];
+} spike_commit_t;
+
+/* spike_set_check_config flags */
+#define SPIKE_CHECK_PC      0x01
+#define SPIKE_CHECK_INSN    0x02
+#define SPIKE_CHECK_XPR     0x04
+#define SPIKE_CHECK_FPR     0x08
+#define SPIKE_CHECK_VREG    0x10
+#define SPIKE_CHECK_CSR     0x20
+#define SPIKE_CHECK_MEM     0x40    /* store address, size and data */
+#define SPIKE_CHECK_LOAD    0x80    /* load address, size and data (not in
+                                       replayed traces, which hold no load data) */
+#define SPIKE_CHECK_NPC     0x100   /* next pc of retired instructions (not in
+                                       replayed traces) */
+#define SPIKE_CHECK_DEFAULT (SPIKE_CHECK_PC | SPIKE_CHECK_INSN | SPIKE_CHECK_XPR | SPIKE_CHECK_FPR)
+
+/* spike_check_commit results */
+#define SPIKE_CHECK_OK          0
+#define SPIKE_MISMATCH_PC       1
+#define SPIKE_MISMATCH_INSN     2
+#define SPIKE_MISMATCH_REG      3   /* both wrote the register, values differ */
+#define SPIKE_MISMATCH_MISSING  4   /* golden model wrote a register the DUT did not */
+#define SPIKE_MISMATCH_EXTRA    5   /* DUT wrote a register the golden model did not */
+#define SPIKE_MISMATCH_MEM      6
+#define SPIKE_MISMATCH_TRAP     7   /* only one side took a trap */
+#define SPIKE_MISMATCH_END      8   /* replayed golden trace has no more records */
+#define SPIKE_MISMATCH_HASH     9   /* state hashes differ after spike_check_gap */
+
+#define SPIKE_SHM_MAGIC     0x314b5053u    /* "SPK1" */
+#define SPIKE_SHM_VERSION   1
+#define SPIKE_SHM_MAX_CSRS  16
+
+/* Per-hart record of the shared-memory view. seq is a seqlock: readers load
+   it (acquire), skip odd values, copy the record, and retry if seq changed
+   meanwhile. */
+typedef struct {
+    uint32_t seq;
+    uint32_t hartid;
+    uint64_t pc;
+    uint64_t instret;       /* minstret */
+    uint32_t priv;
+    uint32_t reserved;
+    uint64_t xpr[32];
+    uint64_t fpr[32];       /* low 64 bits of each FPR */
+    uint32_t csr_addr[SPIKE_SHM_MAX_CSRS];
+    uint64_t csr[SPIKE_SHM_MAX_CSRS];
+} spike_shm_hart_t;
+
+typedef struct {
+    uint32_t magic;         /* SPIKE_SHM_MAGIC once the layout is filled in */
+    uint32_t version;
+    uint32_t n_harts;
+    uint32_t n_csrs;        /* valid entries of csr_addr/csr per hart */
+    uint32_t hart_size;     /* sizeof(spike_shm_hart_t) */
+    uint32_t reserved;
+    spike_shm_hart_t hart[];
+} spike_shm_t;
+
+/* Per-hart MMU counters, filled by spike_get_mmu_stats */
+typedef struct {
+    uint64_t tlb_hits;          /* 0 unless built with --enable-tlb-hit-stats */
+    uint64_t tlb_misses;
+    uint64_t walks;             /* first-stage page-table walks */
+    uint64_t walk_cache_hits;   /* walks resumed from a cached table */
+    uint64_t superpage_hits;    /* TLB refills from a cached superpage */
+    uint64_t icache_hits;       /* 0 unless built with --enable-icache-stats */
+    uint64_t icache_refills;    /* ditto */
+    uint64_t block_links;       /* blocks entered through a hot predecessor */
+    uint64_t gstage_walks;      /* G-stage walks (H extension) */
+    uint64_t gstage_hits;       /* G-stage translations from the G-stage cache */
+    uint64_t gstage_pte_loads;  /* PTEs read by G-stage walks */
+} spike_mmu_stats_t;
+
+/* Per-hart hot-path counters, filled by spike_get_hart_stats */
+typedef struct {
+    uint64_t tlb_misses_fetch;  /* spike_mmu_stats_t.tlb_misses by access */
+    uint64_t tlb_misses_load;
+    uint64_t tlb_misses_store;  /* stores and AMOs */
+    /* loads and stores that left the inline fast path, by reason */
+    uint64_t slow_tlb_miss;     /* no TLB entry */
+    uint64_t slow_misaligned;   /* misaligned across a page, or trapping */
+    uint64_t slow_flagged;      /* page marked for MMIO, a tracer or triggers */
+    uint64_t slow_special;      /* H-mode, LR, shadow-stack or CMO access */
+    uint64_t mmio_loads;
+    uint64_t mmio_stores;
+    uint64_t mmio_fetches;
+    uint64_t opcode_cache_misses; /* decodes that fell back to the decode table */
+    uint64_t exceptions[64];    /* traps taken, by mcause */
+    uint64_t interrupts[64];    /* interrupts taken, by mcause without the MSB */
+} spike_hart_stats_t;
+
+/* Host memory of an instance in bytes, filled by spike_get_footprint */
+typedef struct {
+    uint64_t mem_bytes;         /* size of the memory regions */
+    uint64_t mem_touched_bytes; /* of which host pages have been materialised */
+    uint64_t tlb_bytes;         /* TLBs and walk caches, all harts */
+    uint64_t icache_bytes;      /* icaches, block caches and code-page index */
+    uint64_t vreg_bytes;        /* vector register files */
+    uint64_t log_buffer_bytes;  /* commit-log stream and writer buffers */
+    uint64_t rss_bytes;         /* the process's, shared by its instances */
+    uint64_t peak_rss_bytes;
+} spike_footprint_t;
+
+/* spike_hart_status_t.flags */
+#define SPIKE_HART_WFI      0x1     /* stalled in wfi */
+#define SPIKE_HART_DEBUG    0x2     /* in debug mode */
+
+/* Status of one hart, filled for every hart by spike_get_all_harts_status */
+typedef struct {
+    uint32_t hartid;
+    uint32_t priv;          /* 0 = U, 1 = S, 3 = M */
+    uint32_t virt;          /* 1 when in VS/VU mode */
+    uint32_t flags;         /* SPIKE_HART_* */
+    uint64_t pc;
+    uint64_t instret;       /* minstret */
+} spike_hart_status_t;
+
+/* Logging level: trace, debug, info, warn, error, critical, off */
+void dpi_set_log_level(const char* level_cstr);
+/* Log from a background thread through a queue of queue_size messages
+   (0 for 8192). policy says what a full queue does: "block" waits,
+   "overrun" drops the oldest message, "discard" (spdlog 1.12+) drops the
+   new one; "sync" logs on the calling thread again, the default. Call it
+   while no other spike_* call is running. Returns 0, or -1. */
+int dpi_set_log_async(const char* policy_cstr, uint64_t queue_size);
+
+/* Defaults for the next spike_create */
+void spike_set_isa(const char* isa_cstr);
+void spike_set_dram_base(uint64_t base);
+void spike_set_dram_size(uint64_t size);
+/* Nonzero: RV64 harts without S or U mode (the default "M" priv) run
+   handlers compiled with their privilege checks removed. */
+void spike_set_machine_only(int enable);
+/* Hart scheduling: instructions each hart runs per round (1 for lockstep
+   multi-hart difftest), instructions per RTC tick, and whether harts idle
+   in WFI are skipped. The counts must be nonzero; -1 otherwise. */
+int spike_set_interleave(uint64_t insns);
+int spike_set_rtc_tick(uint64_t insns);
+void spike_set_skip_idle_harts(int enable);
+/* Nonzero: when every hart waits in WFI, advance mtime (and mcycle) straight
+   to the next mtimecmp deadline. */
+void spike_set_wfi_fast_forward(int enable);
+/* Number of harts (hartids 0..n-1) of the next spike_create; -1 if n <= 0 */
+int spike_set_harts(int n);
+
+/* DRAM backends for spike_set_mem_backend */
+#define SPIKE_MEM_SPARSE     0  /* pages allocated on first touch (default) */
+#define SPIKE_MEM_FLAT       1  /* one mmap'ed region, O(1) translation */
+#define SPIKE_MEM_FLAT_HUGE  2  /* SPIKE_MEM_FLAT, advised onto huge pages */
+int spike_set_mem_backend(int kind);
+/* Map DRAM copy-on-write from a raw image of it (e.g. one written by the
+   interactive dumpmems command) so instances share its pages until they
+   write; overrides the backend. Null or "" clears it. */
+void spike_set_mem_image(const char *path);
+
+/* Set PC of a live instance, or the initial PC of the next spike_create
+   when handle is null. */
+void spike_set_pc(void *handle, uint64_t pc);
+
+/* Instance lifetime. spike_create returns null on failure. Distinct
+   handles may be used concurrently from different threads. */
+void *spike_create(const char *filename);
+void spike_delete(void *handle);
+
+/* Replay instance: spike_check_commit draws golden commits from a binary
+   trace written by spike --commit-trace (mmap'ed, read sequentially) rather
+   than a live model. Only the comparator entry points apply; DUT traps are
+   skipped since traces hold retired instructions only. Null on failure. */
+void *spike_open_replay(const char *trace_path);
+
+/* Single-owner mode: calls on the handle skip the instance lock. Only
+   enable when exactly one thread drives the handle. */
+void spike_set_lockstep(void *handle, int enable);
+
+/* Shared-memory view. Publishes a spike_shm_t under the POSIX shm name
+   (e.g. "/spike0") that is refreshed after every step, including those taken
+   by the run-ahead worker. n_csrs (at most SPIKE_SHM_MAX_CSRS) CSRs are
+   included per hart. A null name stops publishing and unlinks the object.
+   Returns 1 on success. */
+int spike_publish_state(void *handle, const char *name, const uint32_t *csr_addrs, int n_csrs);
+
+/* Checkpoints. spike_checkpoint forks a parked copy of the whole process
+   (simulator included) and returns its id; the most recent
+   spike_set_checkpoint_window (default 4) are kept. spike_restore wakes
+   checkpoint id, where spike_checkpoint returns 0, discards the others and
+   waits for the copy to exit, returning its exit status (-1 on error). The
+   copy typically calls spike_enable_commit_log and replays to the failure.
+   Not available while run-ahead is active. */
+int spike_checkpoint(void *handle);
+int spike_restore(void *handle, int id);
+void spike_set_checkpoint_window(void *handle, int n);
+
+/* Print every commit to the instance log file (dpi_spike.log) from now on */
+void spike_enable_commit_log(void *handle);
+
+/* Execution. spike_step returns -1 on error, otherwise the tohost status
+   (SPIKE_TOHOST_*), which is 0 until the target writes tohost. */
+int spike_step(void *handle);
+void spike_reset(void *handle);
+
+/* Fast reset for running many short tests on one instance: memory goes
+   back to its initial contents (zero, or the spike_set_mem_image image),
+   touching only the pages in use; the devices and every hart are reset;
+   filename (the current ELF again if null) is loaded and the harts start
+   from the instance's initial pc. Much cheaper than spike_delete plus
+   spike_create, which rebuild the harts, their decode tables and DRAM.
+   CSR handles stay valid. Returns 0, or -1 on error (the instance is then
+   left in an undefined state) or while run-ahead is active. */
+int spike_reload(void *handle, const char *filename);
+
+/* Advance only hart hartid by n instructions, bypassing the round-robin
+   of spike_step: other harts do not run, devices do not tick and DUT
+   interrupt events are not applied. Calls for different harts may run
+   concurrently from different threads; AMOs, store-conditionals and MMIO
+   are then serialised between them. Returns the tohost status like
+   spike_step, or -1 once commit capture (spike_step_commit) or run-ahead
+   is in use. */
+int spike_step_hart(void *handle, unsigned hartid, uint64_t n);
+
+/* HTIF tohost. Stores to the ELF's tohost symbol are caught on the store
+   path; the value is latched and the word cleared, as the HTIF host loop
+   does. The latch holds until spike_ack_tohost, which for a syscall can
+   also post the fromhost reply (0 writes nothing). spike_tohost_status
+   decodes the latch; the exit code of a FAIL is spike_get_tohost() >> 1.
+   Only tohost words in RAM are watched. */
+#define SPIKE_TOHOST_NONE    0
+#define SPIKE_TOHOST_PASS    1
+#define SPIKE_TOHOST_FAIL    2
+#define SPIKE_TOHOST_SYSCALL 3
+int spike_tohost_status(void *handle);
+uint64_t spike_get_tohost(void *handle);
+int spike_ack_tohost(void *handle, uint64_t fromhost);
+
+/* Run at full interpreter speed until a condition holds on hart hartid:
+   its pc reaches value (SPIKE_UNTIL_PC, on retirement or trap entry, after
+   at least one instruction), its minstret reaches value
+   (SPIKE_UNTIL_INSTRET), or the target writes tohost (SPIKE_UNTIL_TOHOST).
+   A tohost write ends any run. At most max_insns steps are taken (0 = no
+   limit), counted as spike_step does. DUT interrupt events are applied on
+   time. Returns 1 when the condition holds, 2 when a tohost write ended
+   the run first (see spike_tohost_status), 0 when max_insns ran out, -1
+   on error. */
+#define SPIKE_UNTIL_PC       0
+#define SPIKE_UNTIL_INSTRET  1
+#define SPIKE_UNTIL_TOHOST   2
+typedef struct {
+    uint32_t kind;
+    uint32_t hartid;
+    uint64_t value;
+    uint64_t max_insns;
+} spike_until_t;
+int spike_run_until(void *handle, const spike_until_t *cond);
+
+/* Step one instruction and report only what it changed. The first call puts
+   the instance in commit-capture mode, which runs on Spike's slower logged
+   path. Returns 1 when an instruction retired, 0 on trap, -1 on error. */
+int spike_step_commit(void *handle, spike_commit_t *out);
+
+/* Run up to n instructions (at most cap) in one step and write a record per
+   retired instruction to buf. Stops early when a trap is taken; the npc of
+   the last record is then the trap handler. Also stops soon after the
+   target writes tohost (see spike_tohost_status). Returns the number of records
+   written, or -1 on error. */
+int spike_step_n(void *handle, int n, spike_commit_t *buf, int cap);
+
+/* Comparator. spike_check_commit steps the golden model once and compares
+   its commit with the DUT's, which uses the same record layout (set retired
+   to 0 and npc to the handler when the DUT took a trap). X/F registers are
+   only compared when their bit is set in xpr_mask/fpr_mask. Returns
+   SPIKE_CHECK_OK, a SPIKE_MISMATCH_* code with a one-line report, or -1 on
+   error. */
+void spike_set_check_config(void *handle, uint32_t flags, uint32_t xpr_mask, uint32_t fpr_mask);
+int spike_set_check_csr_ignore(void *handle, const uint32_t *csr_addrs, int n);
+int spike_check_commit(void *handle, const spike_commit_t *dut, char *report, int report_len);
+
+/* Comparator rules for the known benign differences, read once from the file
+   at path and compiled into per-CSR tables and encoding masks, so that a
+   commit looks up what it may differ in. One rule per line, # starts a
+   comment:
+
+     csr  <csr>                      ignore [mask] | copy   writes of the CSR
+     read <csr>                      ignore [mask] | copy   rd of csrr* reading it
+     insn <name> | <match> <mask>    ignore [mask] | copy   rd/fd of the instruction
+     load <begin> <end>              ignore [mask] | copy   rd of loads from the range
+
+   <csr> is a name as in encoding.h (mcycle, time, mip) or a number, <name>
+   an instruction of encoding.h (fence_i). ignore leaves the bits of mask,
+   all by default, out of the compare; copy compares nothing and writes the
+   DUT's value into the golden model once the commit has matched, so that it
+   follows the DUT (as ignore while spike_set_runahead is on, or for a
+   replayed trace). The loads a load rule covers are not compared either.
+   For example "read mcycle copy", "csr mip ignore 0x80" and
+   "load 0x10000000 0x10001000 copy". Rules apply to every hart and are
+   kept across reloads; a NULL path drops them. Returns the number of rules,
+   or -1 with "path:line: reason" in err (and the old rules kept). */
+int spike_load_check_rules(void *handle, const char *path, char *err, int err_len);
+
+/* RVFI comparator. pkts holds the n retire ports of hart hartid for one
+   cycle, in the RISC-V Formal Interface layout below; the valid ones (at most 64) are taken in
+   order of their order field and each is checked as by spike_check_commit:
+   pc_rdata and insn, pc_wdata under SPIKE_CHECK_NPC (or as the handler
+   address under SPIKE_CHECK_PC when trap is set), rd_wdata under
+   SPIKE_CHECK_XPR, and the memory access its masks select under
+   SPIKE_CHECK_MEM/SPIKE_CHECK_LOAD. The rs fields, F, V and CSR writes are
+   not compared, since RVFI does not carry the latter. Returns
+   SPIKE_CHECK_OK when every port matches, else the first mismatch with the
+   same report as spike_check_commit (later ports are not stepped), or -1 on
+   error. */
+typedef struct {
+    uint64_t order;
+    uint64_t insn;
+    uint64_t pc_rdata;
+    uint64_t pc_wdata;
+    uint64_t rs1_rdata;
+    uint64_t rs2_rdata;
+    uint64_t rd_wdata;
+    uint64_t mem_addr;
+    uint64_t mem_rdata;
+    uint64_t mem_wdata;
+    uint32_t valid;
+    uint32_t trap;
+    uint32_t halt;
+    uint32_t intr;
+    uint32_t mode;
+    uint32_t ixl;
+    uint32_t rs1_addr;
+    uint32_t rs2_addr;
+    uint32_t rd_addr;
+    uint32_t mem_rmask;
+    uint32_t mem_wmask;
+    uint32_t reserved;
+} spike_rvfi_t;
+int spike_check_rvfi(void *handle, unsigned hartid, const spike_rvfi_t *pkts, int n,
+                     char *report, int report_len);
+
+/* Mismatch context. With len > 0, spike_check_commit keeps the last len
+   golden commits of each hart in a fixed ring (copied in place, nothing
+   allocated per commit) and, on a mismatch, appends them to path (stderr if
+   null), oldest first, one line each with pc, symbol, disassembly and the
+   register and memory writes, followed by the DUT commit. len 0 turns it
+   off. Returns 0, or -1 on error. */
+int spike_set_mismatch_history(void *handle, int len, const char *path);
+
+/* DUT synchronization. spike_map_dut_mmio places a DUT-driven window on the
+   bus (once per instance); each load from it consumes the value queued for
+   that address with spike_push_mmio_load, or repeats the last value seen
+   there. spike_schedule_irq sets (raise != 0) or clears mip_mask on a hart
+   once its minstret reaches instret, before the next instruction executes.
+   Return 1 on success. */
+int spike_map_dut_mmio(void *handle, uint64_t base, uint64_t size);
+int spike_push_mmio_load(void *handle, uint64_t paddr, uint64_t value);
+int spike_schedule_irq(void *handle, unsigned hartid, uint64_t instret, uint64_t mip_mask, int raise);
+
+/* Run-ahead. With horizon > 0 a worker thread steps the golden model up to
+   horizon instructions ahead of the DUT and spike_check_commit only pops and
+   compares. The worker stops in front of pending interrupts and MMIO
+   accesses, which spike_check_commit then executes in the caller's thread,
+   and while DUT interrupt events are pending; events must be scheduled
+   before the worker passes their instret.
+   horizon <= 0 stops the worker; records it already produced are still
+   consumed first. While run-ahead is active the stepping entry points fail
+   and state getters see the run-ahead position. Returns 1 on success. */
+int spike_set_runahead(void *handle, int horizon);
+
+/* Scalar state */
+uint64_t spike_get_pc(void *handle, unsigned hartid);
+int spike_get_all_gprs(void *handle, unsigned hartid, uint64_t out[32]);
+int spike_get_all_fprs(void *handle, unsigned hartid, uint64_t out[32]);
+/* All 128 bits of each FPR, low word first, so Q values are whole. boxed, if
+   not NULL, gets SPIKE_FPR_BOXED_* bits per FPR: set when it holds a value
+   NaN-boxed into FLEN bits from that precision. Returns 32 or 0. */
+#define SPIKE_FPR_BOXED_H 0x1
+#define SPIKE_FPR_BOXED_S 0x2
+#define SPIKE_FPR_BOXED_D 0x4
+int spike_get_all_fprs_wide(void *handle, unsigned hartid, uint64_t out[64], uint8_t boxed[32]);
+uint64_t spike_get_csr(void *handle, unsigned hartid, uint32_t csr_addr);
+/* Fills out[0..n) with the status of the harts in hartid order and returns
+   how many harts there are (more than n if out was too short), or -1. */
+int spike_get_all_harts_status(void *handle, spike_hart_status_t *out, int n);
+void spike_put_csr(void *handle, unsigned hartid, uint32_t csr_addr, uint64_t value);
+
+/* CSR handles. spike_resolve_csr binds a CSR once (-1 if it does not exist);
+   spike_read_csrs then reads n of them without any lookup, writing 0 for
+   invalid handles. Handles stay valid across spike_reset. */
+int spike_resolve_csr(void *handle, unsigned hartid, uint32_t csr_addr);
+int spike_read_csrs(void *handle, const int *csr_handles, uint64_t *out, int n);
+
+/* Snapshot. spike_set_snapshot_csrs selects which CSRs spike_get_snapshot
+   reads (at most SPIKE_SNAPSHOT_MAX_CSRS; returns the number kept).
+   spike_get_snapshot returns 1 on success, 0 on error. */
+int spike_set_snapshot_csrs(void *handle, const uint32_t *csr_addrs, int n);
+int spike_get_snapshot(void *handle, unsigned hartid, spike_snapshot_t *out);
+
+/* Checkpoint files (sim_t::save_checkpoint): every hart's registers and
+   CSRs, CLINT/PLIC/UART state and the nonzero memory pages. A file can be
+   loaded into any instance built with the same ISA, harts and memory
+   layout, in this process or another, which lets one long run be split into
+   many jobs that each start from a saved point. Unlike spike_checkpoint
+   these survive the process. Saving fails while a virtio-blk disk is
+   attached, since its image is not in the file. Return 1 on success, -1 on
+   error. */
+int spike_save_checkpoint_file(void *handle, const char *path);
+int spike_load_checkpoint_file(void *handle, const char *path);
+
+/* Fast-forward hand-off. Run the model past boot code with
+   spike_run_until (a symbol's address comes from spike_lookup_symbol,
+   which returns 1 when found), then spike_export_state writes what the RTL
+   needs to start from the same point into directory dir:
+     mem.0x<base>.bin  raw image of each memory region (loadable again
+                       with spike_set_mem_image)
+     state.txt         per hart, one "<name> <hex>..." entry per line:
+                       hart <id>, pc, priv, virt, x <n> <val>, f <n> <val>,
+                       csr <addr> <val> for every CSR, and v <n> <val>
+                       (most significant byte first) when V is present
+   Lockstep comparison then continues from there with spike_step_commit /
+   spike_check_commit. Returns 1 on success, -1 on error. */
+int spike_lookup_symbol(void *handle, const char *name, uint64_t *addr);
+int spike_export_state(void *handle, const char *dir);
+
+/* The reverse lookup, for naming pcs in mismatch reports: the function of
+   the loaded ELFs that addr falls in is copied (truncated to name_len) into name
+   and addr's offset from its start into *offset, if given. A binary search
+   over an index built at load time, so cheap enough to call per report.
+   Returns 1 when found, 0 otherwise. */
+int spike_find_symbol(void *handle, uint64_t addr, char *name, int name_len, uint64_t *offset);
+
+/* The arch-test signature: the bytes between the begin_signature and
+   end_signature symbols of the loaded ELF, copied into buf (at most cap
+   bytes) in one call, for comparison against the DUT's without writing
+   and parsing a signature file. Returns the signature's full length, 0 if
+   the program has none, or -1 on error. */
+int64_t spike_get_signature(void *handle, void *buf, uint64_t cap);
+
+/* Backdoor memory access. Copy len bytes between buf and physical memory at
+   paddr, page by page, so a range may span pages and memory regions; no
+   hart sees the accesses, and a write makes the harts decode instructions
+   afresh. From SV, pass an open array's storage (svGetArrayPtr) or a
+   fixed-size byte array. Return 0, or -1 if any part of the range is not
+   memory (a write then changes nothing). */
+int spike_read_mem(void *handle, uint64_t paddr, void *buf, uint64_t len);
+int spike_write_mem(void *handle, uint64_t paddr, const void *buf, uint64_t len);
+
+/* Reads len bytes at virtual address vaddr as a load by hart hartid would
+   see them now (privilege, MPRV, satp and pointer masking included), through
+   its TLB and page tables, without setting A/D bits, firing triggers or
+   tracing. Returns 0, or -1 if the load would fault or reach MMIO. */
+int spike_read_vmem(void *handle, unsigned hartid, uint64_t vaddr, uint64_t len, void *out);
+
+/* Preloads the image in path at physical address paddr, as RTL memories are
+   preloaded, without an ELF file: *.hex and *.vhx files are Verilog hex
+   (elf2hex output or $readmemh input, with @ addresses counted in words of
+   the first word's width), anything else raw binary. Returns 1 on success,
+   -1 on error (the image may then be partly loaded). */
+int spike_load_image(void *handle, const char *path, uint64_t paddr);
+
+/* Memory comparison. spike_dump_mem_sparse writes mem.0x<base>.sparse for
+   each memory region into directory dir, holding only the nonzero pages:
+   the magic "SPKSPARS" and the region size, then per page its index from
+   the region base and its 4 KiB of data (integers as host-endian uint64_t).
+   Returns 1 on success, -1 on error.
+   spike_mem_diff compares len bytes of the DUT's memory at dut against the
+   model's at paddr, which must lie within one region, page by page. The
+   addresses of the first max_mismatches differing bytes go into mismatches;
+   returns the number of differing bytes (0 if identical) or -1 on error. */
+int spike_dump_mem_sparse(void *handle, const char *dir);
+int64_t spike_mem_diff(void *handle, uint64_t paddr, uint64_t len, const void *dut,
+                       uint64_t *mismatches, uint64_t max_mismatches);
+
+/* Incremental memory comparison. spike_track_stores starts recording the
+   memory lines of line_bytes (a power of 2 up to 4096; 0 stops) that any
+   hart writes, including page-table A/D updates; returns 0, or -1 on error.
+   spike_take_dirty_lines returns up to max_lines of the lines written since
+   they were last taken, in ascending order: addrs gets their physical
+   addresses and, unless null, data their current contents (line_bytes per
+   line). Lines left over are returned by the next call, so call again while
+   it returns max_lines. Returns the number of lines, or -1 when tracking is
+   off or on error. */
+int spike_track_stores(void *handle, uint32_t line_bytes);
+int spike_take_dirty_lines(void *handle, uint64_t *addrs, uint8_t *data, int max_lines);
+
+/* Page hashes, so that a testbench compares n hashes and transfers only the
+   pages that differ. out[i] gets the 64-bit FNV-1a hash (offset basis
+   0xcbf29ce484222325, prime 0x100000001b3) of the PGSIZE bytes at
+   base + i * PGSIZE; base must be page aligned and every page RAM. While
+   spike_track_stores is on, hashes are cached and only those of pages
+   written since are computed again. Returns n, or -1 on error. */
+int spike_get_page_hashes(void *handle, uint64_t base, int n, uint64_t *out);
+
+/* Vector state */
+int spike_get_all_vregs(void *handle, unsigned hartid, uint64_t *out, int out_size_qwords);
+/* Copies only the vector registers written since the previous call, packed in
+   ascending order (VLEN/64 qwords each); *mask gets the registers copied.
+   Registers that do not fit in out stay pending. Returns the register count,
+   or -1 on error. */
+int spike_get_dirty_vregs(void *handle, unsigned hartid, uint64_t *out, int out_size_qwords, uint32_t *mask);
+int spike_get_vlen(void *handle, unsigned hartid);
+uint64_t spike_get_vlenb(void *handle, unsigned hartid);
+uint64_t spike_get_vxsat(void *handle, unsigned hartid);
+uint64_t spike_get_vxrm(void *handle, unsigned hartid);
+uint64_t spike_get_vstart(void *handle, unsigned hartid);
+uint64_t spike_get_vl(void *handle, unsigned hartid);
+uint64_t spike_get_vtype(void *handle, unsigned hartid);
+uint64_t spike_get_vcsr(void *handle, unsigned hartid, uint32_t csr_addr);
+
+/* MMU. spike_set_tlb resizes the TLBs of every hart to entries translations
+   in sets of ways (powers of 2, default 256:1), or sets the geometry for
+   the next spike_create when handle is null. Returns 0, or -1 on bad
+   arguments. spike_get_mmu_stats and spike_get_hart_stats counters accumulate
+   until spike_clear_mmu_stats, which resets both. */
+int spike_set_tlb(void *handle, uint64_t entries, uint64_t ways);
+/* Same for the decoded-instruction cache (power of 2, default 1024) */
+int spike_set_icache(void *handle, uint64_t entries);
+/* Execute from a cache of entries decoded basic blocks (power of 2) instead
+   of the icache; 0 (the default) turns it off */
+int spike_set_block_cache(void *handle, uint64_t entries);
+/* Split vector floating-point instructions of at least 256 elements,
+   unmasked and from vstart 0, between threads host threads per hart (at
+   most one per host CPU); 1 (the default) runs them on the hart's own
+   thread. Results and fflags are those
+   of the single-threaded loop. */
+int spike_set_vector_threads(void *handle, unsigned threads);
+int spike_get_mmu_stats(void *handle, unsigned hartid, spike_mmu_stats_t *out);
+int spike_get_hart_stats(void *handle, unsigned hartid, spike_hart_stats_t *out);
+void spike_clear_mmu_stats(void *handle);
+int spike_get_footprint(void *handle, spike_footprint_t *out);
+
+/* Instruction mix. spike_set_insn_stats turns counting on or off for every
+   hart (it enables the block cache if needed). spike_get_insn_count fills
+   out[4] with the retirements of one mnemonic (e.g. "c.addi") by privilege
+   mode (U, S, unused, M); spike_dump_insn_stats writes every hart's counts
+   per group and mnemonic to path (stderr if null). Return 0, or -1. */
+int spike_set_insn_stats(void *handle, int enable);
+int spike_get_insn_count(void *handle, unsigned hartid, const char *mnemonic, uint64_t out[4]);
+int spike_dump_insn_stats(void *handle, const char *path);
+void spike_clear_insn_stats(void *handle);
+
+/* Guest pc sampling for flame graphs: hz times a second of host time, the pc
+   of every hart (and with unwind, the return addresses up the frame-pointer
+   chain) is recorded at the end of the next scheduling round, so
+   spike_step_hart alone takes no samples. The folded stacks are written to
+   path when profiling is stopped by a null path, restarted, or at
+   spike_delete. Returns 0, or -1 if path cannot be opened or hz is 0. */
+int spike_set_guest_profile(void *handle, const char *path, uint32_t hz, int unwind);
+
+/* Throughput metrics for farm dashboards. Every interval_ms of host time,
+   at the end of the next scheduling round, path is rewritten (through a
+   rename, so it is never seen half written) in OpenMetrics text form with
+   per-hart instructions, MIPS over the interval, TLB misses, page walks,
+   MMIO accesses and traps, as spike --metrics writes (TLB hits and icache
+   hits and refills too in builds with the options that count them),
+   and spike_dpi_calls_total and spike_dpi_seconds_total, the calls into
+   this library and the host time spent in them (lock waits included).
+   Calls are only counted while metrics are on; a null path stops them,
+   writing a last snapshot, as spike_delete does. spike_get_dpi_calls reads
+   the two counters. Both return 0, or -1 if path cannot be written or
+   interval_ms is 0. */
+int spike_set_metrics(void *handle, const char *path, uint32_t interval_ms);
+int spike_get_dpi_calls(void *handle, uint64_t *calls, uint64_t *ns);
+
+/* Per-entry-point call profile, to find the calls a testbench spends its
+   DPI time in. While enabled, every call that takes the instance or a hart
+   lock is counted under its function name with its latency, measured with
+   the TSC on x86, the part of it spent waiting for the lock, and a log2
+   histogram of latencies. The table, costliest entry point first, is written
+   to path (stderr if null) when the profile is disabled or restarted, or at
+   spike_delete. When disabled it costs each call one load. Returns 0, or -1
+   on error. */
+int spike_set_call_profile(void *handle, int enable, const char *path);
+
+/* Function call/return tracing of one hart, in the binary format described
+   in riscv/call_tracer.h: one record per jal/jalr that links through ra or
+   t0, stamped with minstret. ranges holds n_ranges (base, size) pairs; only
+   jumps from or into them are written, or every one if n_ranges is 0. The
+   hart runs its per-instruction loop while traced. A null path stops
+   tracing and closes the file. Returns 0, or -1 on error. */
+int spike_set_call_trace(void *handle, unsigned hartid, const char *path,
+                         const uint64_t *ranges, int n_ranges);
+
+/* ISA functional coverage of one hart (instructions, CSR accesses, trap
+   causes, privilege changes and vsetvl configurations), in the format
+   described in riscv/coverage.h; spike-cov-merge sums the files of many
+   runs. The counts are written to path when collection is stopped by a
+   null path, restarted, or at spike_delete. Returns 0, or -1 on error. */
+int spike_set_coverage(void *handle, unsigned hartid, const char *path);
+
+/* Record (replay == 0) or replay the inputs that make runs differ, in the
+   format described in riscv/input_log.h: real-time mtime samples, terminal
+   input, seed CSR values and loads from the spike_map_dut_mmio window, so
+   a run can be repeated without the DUT. A replay takes the window's loads
+   from the log instead of spike_push_mmio_load. Terminal input is
+   process-wide, so only one instance should log at a time. A null path
+   stops. Returns 0, or -1 on error or while running ahead. */
+int spike_set_input_log(void *handle, const char *path, int replay);
+
+/* Memory observation of one hart (mmu_observer_t in riscv/mmu.h): fn is
+   called with user for every fetch, load and store that completes, with
+   its virtual address and len bytes of data as they are in target memory;
+   for a fetch, data points at the instruction bits as a host uint64_t. A
+   null fn detaches. While observed, the hart's loads and stores take the
+   MMU slow paths and it runs its per-instruction loop, at about the cost
+   of commit logging; without an observer nothing changes. Returns 0, or
+   -1 on error. */
+#define SPIKE_MEM_FETCH 0
+#define SPIKE_MEM_LOAD  1
+#define SPIKE_MEM_STORE 2
+typedef void (*spike_mem_observer_fn)(void *user, unsigned hartid, int kind,
+                                      uint64_t vaddr, const void *data, uint32_t len);
+int spike_set_mem_observer(void *handle, unsigned hartid, spike_mem_observer_fn fn, void *user);
+
+/* RoCC co-simulation, for an accelerator modelled in the testbench. After
+   spike_enable_rocc, the custom-0..3 opcodes of every hart no longer run in
+   spike: each is queued as a request, and spike_rocc_take moves up to cap
+   of them into buf, oldest first, returning how many (-1 on error), so one
+   call drains a whole batch. A request with xd set and a nonzero rd leaves
+   rd pending. The hart keeps executing until an instruction that may use a
+   pending register and stops in front of it (spike_step then retires
+   nothing) until spike_rocc_respond delivers the value; that returns 0, or
+   -1 if rd was not pending. spike_rocc_pending returns the hart's pending
+   registers as a mask, or -1 on error. spike_enable_rocc returns 0, or -1
+   on error or if already enabled. */
+typedef struct {
+    uint64_t seq;      /* issue order within the instance, from 0 */
+    uint64_t pc;
+    uint64_t rs1_val;  /* x[rs1] when the xs1 bit is set, else 0 */
+    uint64_t rs2_val;  /* x[rs2] when the xs2 bit is set, else 0 */
+    uint32_t hartid;
+    uint32_t insn;     /* the instruction: opcode, rd, xd/xs1/xs2, rs1, rs2, funct7 */
+} spike_rocc_req_t;
+int spike_enable_rocc(void *handle);
+int spike_rocc_take(void *handle, spike_rocc_req_t *buf, int cap);
+int spike_rocc_respond(void *handle, unsigned hartid, unsigned rd, uint64_t value);
+int64_t spike_rocc_pending(void *handle, unsigned hartid);
+
+/* Rolling state hash, for long runs where per-commit compares cost too
+   much. Once enabled, every retired instruction of a hart folds its effects
+   into that hart's 64-bit hash, starting from SPIKE_STATE_HASH_SEED, with
+   mix(h, x) = (h ^ x) * 0x100000001b3 (mod 2^64):
+     h = mix(h, pc)
+     for each register write, in ascending key order, whose SPIKE_REG_* type
+     has its bit set in types (x0 writes are never hashed):
+       h = mix(mix(mix(h, idx << 4 | type), value[0]), value[1])
+     for each memory store, in program order:
+       h = mix(mix(mix(h, addr), value), size)
+   with values laid out as in spike_commit_t. Trapping instructions retire
+   nothing and leave the hash alone. The DUT computes the same over its own
+   commits and compares every N instructions; on a mismatch, restore a
+   checkpoint and replay the window with spike_check_commit to find the
+   first bad commit. spike_enable_state_hash (again) restarts every hart
+   from the seed with a count of 0; spike_get_state_hash reads the hart's
+   hash and the number of instructions it covers. Both return 0, or -1 on
+   error or while run-ahead is active. */
+#define SPIKE_STATE_HASH_SEED  0xcbf29ce484222325ull
+int spike_enable_state_hash(void *handle, uint32_t types);
+int spike_get_state_hash(void *handle, unsigned hartid, uint64_t *hash, uint64_t *count);
+
+/* Commit sampling, for soak runs that cannot afford a compare per commit.
+   Every period commits, window consecutive ones are compared in full with
+   spike_check_commit; the others are only stepped, on the fast path, and
+   covered by the state hash. With a seed of 0 the window ends each period;
+   otherwise it starts at a pseudo-random point of it, the same for a given
+   seed. spike_next_sample returns how many commits to skip before the next
+   window (its length in *window), or -1 if sampling is off (period 0).
+   spike_check_gap steps the golden model over n commits (retired or
+   trapping, as the spike_check_commit calls they stand for), stopping
+   early when the target writes tohost, and then compares each hart's state
+   hash with dut_hashes[hartid] if that is not NULL, which needs
+   spike_enable_state_hash. A testbench loops:
+
+     gap = spike_next_sample(h, &window);
+     ... the DUT retires gap commits, hashing them ...
+     spike_check_gap(h, gap, dut_hashes, report, len);
+     ... spike_check_commit on each of the next window commits ...
+
+   A mismatch is found up to a period late; restore a checkpoint and rerun
+   that stretch in lockstep to find the first bad commit. spike_check_gap
+   returns SPIKE_CHECK_OK, SPIKE_MISMATCH_HASH with a report, or -1 on error,
+   with run-ahead active or for a replayed trace. */
+int spike_set_check_sampling(void *handle, uint64_t period, uint64_t window, uint64_t seed);
+int64_t spike_next_sample(void *handle, uint64_t *window);
+int spike_check_gap(void *handle, uint64_t n, const uint64_t *dut_hashes, char *report, int report_len);
+
+/* Remote mode, for RTL simulations on an emulator or on another host than
+   Spike. spike_remote_connect connects to spike_dpi_server at addr
+   ("host:port" over TCP, or "unix:<path>"; the server listens on loopback
+   unless started with a host) and has it create an instance from filename,
+   a path on the server's host; null on failure. A remote
+   handle takes only the spike_remote_* calls.
+   spike_remote_check_post queues one DUT commit for spike_check_commit on
+   the server and returns at once: commits go out batch to a frame, and up to
+   window frames are in flight before a post waits for the oldest reply, so
+   the round trip is paid per window rather than per instruction.
+   spike_remote_flush sends a partial batch. spike_remote_check_poll hands
+   out results in post order (seq counts posts from 0), up to max; with wait
+   it blocks until there is one or nothing is outstanding. Returns the count.
+   The state calls, spike_remote_step among them, wait for every result
+   outstanding first (keeping them for poll), so they see the model after
+   the commits posted. Calls return -1 (0 for the getters) once the
+   connection fails, and spike_remote_close ends the instance. */
+typedef struct {
+    uint64_t seq;
+    int32_t result;         /* as spike_check_commit returns it */
+    char report[256];
+} spike_remote_result_t;
+void *spike_remote_connect(const char *addr, const char *filename, int batch, int window);
+void spike_remote_close(void *remote);
+void spike_remote_set_check_config(void *remote, uint32_t flags, uint32_t xpr_mask, uint32_t fpr_mask);
+int spike_remote_check_post(void *remote, const spike_commit_t *dut);
+int spike_remote_flush(void *remote);
+int spike_remote_check_poll(void *remote, spike_remote_result_t *out, int max, int wait);
+int spike_remote_step(void *remote, uint64_t n);
+uint64_t spike_remote_get_pc(void *remote, unsigned hartid);
+int spike_remote_get_all_gprs(void *remote, unsigned hartid, uint64_t out[32]);
+
+/* Round-to-nearest F/D add, sub, mul, div and sqrt on the host FPU where
+   that is bit-exact (see softfloat_setHostFP). The setting is shared by every
+   simulator in the process. Returns 0, or -1 if the host cannot do it. */
+int spike_set_host_fp(int enable);
+
+/* The host SIMD level the vector fast paths were bound to when the library
+   was loaded: "avx512", "avx2", "sse2", "neon" or "scalar". */
+const char* spike_host_simd(void);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+// startup_bench.c
+// Measures spike_create/spike_delete latency for one ELF:
+//   ./startup_bench <elf> [iterations] [log-level]
+// A log level of "debug" also prints the per-phase breakdown of each
+// spike_create.
+
+#include "spike_dpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <elf> [iterations] [log-level]\n", argv[0]);
+        return 2;
+    }
+    int n = argc > 2 ? atoi(argv[2]) : 20;
+    if (argc > 3)
+        dpi_set_log_level(argv[3]);
+
+    double create = 0, destroy = 0, first = 0;
+    for (int i = 0; i < n; i++) {
+        double t0 = now_us();
+        void *h = spike_create(argv[1]);
+        double t1 = now_us();
+        if (!h) {
+            fprintf(stderr, "spike_create failed\n");
+            return 1;
+        }
+        spike_delete(h);
+        double t2 = now_us();
+        if (i == 0)
+            first = t1 - t0;
+        create += t1 - t0;
+        destroy += t2 - t1;
+    }
+    printf("spike_create: first %.1f us, mean %.1f us; spike_delete: mean %.1f us (%d runs)\n",
+           first, create / n, destroy / n, n);
+    return 0;
+}
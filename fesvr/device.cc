@@ -8,6 +8,7 @@
 #include <thread>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 using namespace std::placeholders;
 
@@ -81,9 +82,10 @@ void bcd_t::tick()
   }
 }
 
-disk_t::disk_t(const char* fn)
+disk_t::disk_t(const char* fn, bool copy_on_write)
+  : image(nullptr)
 {
-  fd = ::open(fn, O_RDWR);
+  int fd = ::open(fn, copy_on_write ? O_RDONLY : O_RDWR);
   if (fd < 0)
     throw std::runtime_error("could not open " + std::string(fn));
 
@@ -91,16 +93,38 @@ disk_t::disk_t(const char* fn)
   register_command(1, std::bind(&disk_t::handle_write, this, _1), "write");
 
   struct stat st;
-  if (fstat(fd, &st) < 0)
+  if (fstat(fd, &st) < 0) {
+    close(fd);
     throw std::runtime_error("could not stat " + std::string(fn));
+  }
 
   size = st.st_size;
+  if (size) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   copy_on_write ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("could not map " + std::string(fn));
+    }
+    image = (uint8_t*)p;
+  }
+  // the mapping keeps the file open
+  close(fd);
+
   id = "disk size=" + std::to_string(size);
 }
 
 disk_t::~disk_t()
 {
-  close(fd);
+  if (image)
+    munmap(image, size);
+}
+
+uint8_t* disk_t::image_range(const request_t& req)
+{
+  if (req.offset > size || req.size > size - req.offset)
+    throw std::runtime_error("access outside " + id + " @ " + std::to_string(req.offset));
+  return image + req.offset;
 }
 
 void disk_t::handle_read(command_t cmd)
@@ -108,11 +132,7 @@ void disk_t::handle_read(command_t cmd)
   request_t req;
   cmd.memif().read(cmd.payload(), sizeof(req), &req);
 
-  std::vector<uint8_t> buf(req.size);
-  if ((size_t)::pread(fd, buf.data(), buf.size(), req.offset) != req.size)
-    throw std::runtime_error("could not read " + id + " @ " + std::to_string(req.offset));
-
-  cmd.memif().write(req.addr, buf.size(), buf.data());
+  cmd.memif().write(req.addr, req.size, image_range(req));
   cmd.respond(req.tag);
 }
 
@@ -121,12 +141,7 @@ void disk_t::handle_write(command_t cmd)
   request_t req;
   cmd.memif().read(cmd.payload(), sizeof(req), &req);
 
-  std::vector<uint8_t> buf(req.size);
-  cmd.memif().read(req.addr, buf.size(), buf.data());
-
-  if ((size_t)::pwrite(fd, buf.data(), buf.size(), req.offset) != req.size)
-    throw std::runtime_error("could not write " + id + " @ " + std::to_string(req.offset));
-
+  cmd.memif().read(req.addr, req.size, image_range(req));
   cmd.respond(req.tag);
 }
 
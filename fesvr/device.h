@@ -72,10 +72,14 @@ class bcd_t : public device_t
   std::queue<command_t> pending_reads;
 };
 
+// A block device backed by a memory-mapped image file. Requests copy
+// straight between the mapping and target memory. With copy_on_write, the
+// image is mapped privately: writes land in this process's pages only, so
+// parallel runs can share one base image without modifying it.
 class disk_t : public device_t
 {
  public:
-  disk_t(const char* fn);
+  disk_t(const char* fn, bool copy_on_write = false);
   ~disk_t();
   const char* identity() { return id.c_str(); }
 
@@ -90,10 +94,12 @@ class disk_t : public device_t
 
   void handle_read(command_t cmd);
   void handle_write(command_t cmd);
+  // Host address of the image bytes a request covers
+  uint8_t* image_range(const request_t& req);
 
   std::string id;
   size_t size;
-  int fd;
+  uint8_t* image;
 };
 
 class null_device_t : public device_t
@@ -29,8 +29,18 @@
 
 #define PT_LOAD 1
 
+#define PF_X 1
+#define PF_W 2
+#define PF_R 4
+
 #define SHT_NOBITS 8
 
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define SHN_UNDEF 0
+#define ELF_ST_TYPE(info) ((info) & 0xf)
+
 typedef struct {
   uint8_t  e_ident[16];
   uint16_t e_type;
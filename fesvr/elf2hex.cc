@@ -1,19 +1,41 @@
 // See LICENSE for license details.
 
 #include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
 #include "htif_hexwriter.h"
 #include "memif.h"
 #include "elfloader.h"
+#include "option_parser.h"
+
+static void help()
+{
+  std::cerr << "Usage: elf2hex [--binary] [--threads=<n>] <width> <depth> <elf_file> [base]" << std::endl;
+  std::cerr << "  --binary       Write the image as raw bytes instead of hex lines" << std::endl;
+  std::cerr << "  --threads=<n>  Threads formatting hex lines [default: one per host CPU]" << std::endl;
+  exit(1);
+}
 
 int main(int argc, char** argv)
 {
-  if(argc < 4 || argc > 5)
-  {
-    std::cerr << "Usage: " << argv[0] << " <width> <depth> <elf_file> [base]" << std::endl;
-    return 1;
-  }
+  bool binary = false;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+  option_parser_t parser;
+  parser.help(&help);
+  parser.option(0, "binary", 0, [&](const char*){binary = true;});
+  parser.option(0, "threads", 1, [&](const char* s){threads = atoi(s);});
+  const char* const* args = parser.parse(argv);
+  int nargs = 0;
+  while (args[nargs])
+    nargs++;
 
-  unsigned width = atoi(argv[1]);
+  if(nargs < 3 || nargs > 4)
+    help();
+
+  unsigned width = atoi(args[0]);
   if(width == 0 || (width & (width-1)))
   {
     std::cerr << "width must be a power of 2" << std::endl;
@@ -21,8 +43,8 @@ int main(int argc, char** argv)
   }
 
   unsigned long long int base = 0;
-  if(argc==5) {
-    base = atoll(argv[4]);
+  if(nargs==4) {
+    base = atoll(args[3]);
     if(base & (width-1))
     {
       std::cerr << "base must be divisible by width" << std::endl;
@@ -30,18 +52,33 @@ int main(int argc, char** argv)
     }
   }
 
-  unsigned depth = atoi(argv[2]);
+  unsigned depth = atoi(args[1]);
   if(depth == 0 || (depth & (depth-1)))
   {
     std::cerr << "depth must be a power of 2" << std::endl;
     return 1;
   }
 
-  htif_hexwriter_t htif(base, width, depth);
-  memif_t memif(&htif);
-  reg_t entry;
-  load_elf(argv[3], &memif, &entry, 0);
-  std::cout << htif;
+  if(threads == 0)
+  {
+    std::cerr << "--threads must be positive" << std::endl;
+    return 1;
+  }
+
+  try {
+    htif_flat_hexwriter_t htif(base, width, depth);
+    memif_t memif(&htif);
+    reg_t entry;
+    load_elf(args[2], &memif, &entry, 0);
+    if(!(binary ? htif.write_binary(STDOUT_FILENO) : htif.write_hex(STDOUT_FILENO, threads)))
+    {
+      std::cerr << "write failed: " << strerror(errno) << std::endl;
+      return 1;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << argv[0] << ": " << e.what() << std::endl;
+    return 1;
+  }
 
   return 0;
 }
@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "elf.h"
+#include "elfloader.h"
 #include "memif.h"
 #include "byteorder.h"
 #include <cstring>
@@ -19,7 +20,8 @@
 #include <cerrno>
 
 std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t* entry,
-                                         reg_t load_offset, unsigned required_xlen = 0)
+                                         reg_t load_offset, unsigned required_xlen,
+                                         std::vector<elf_symbol_t>* ranges)
 {
   int fd = open(fn, O_RDONLY);
   struct stat s;
@@ -32,7 +34,12 @@ std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t*
   char* buf = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
   if (buf == MAP_FAILED)
       throw std::invalid_argument(std::string("Specified ELF can't be mapped: ") + strerror(errno));
-  close(fd);
+  // kept open for the segments mapped from it, until we return or throw
+  struct fd_closer_t {
+    int fd;
+    ~fd_closer_t() { close(fd); }
+  } fd_closer{fd};
+  const reg_t host_page = sysconf(_SC_PAGESIZE);
 
   assert(size >= sizeof(Elf64_Ehdr));
   const Elf64_Ehdr* eh64 = (const Elf64_Ehdr*)buf;
@@ -62,10 +69,20 @@ std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t*
     for (unsigned i = 0; i < bswap(eh->e_phnum); i++) {                        \
       if (bswap(ph[i].p_type) == PT_LOAD && bswap(ph[i].p_memsz)) {            \
         reg_t load_addr = bswap(ph[i].p_paddr) + load_offset;                  \
-        if (bswap(ph[i].p_filesz)) {                                           \
-          assert(size >= bswap(ph[i].p_offset) + bswap(ph[i].p_filesz));       \
-          memif->write(load_addr, bswap(ph[i].p_filesz),                       \
-                       (uint8_t*)buf + bswap(ph[i].p_offset));                 \
+        if (reg_t filesz = bswap(ph[i].p_filesz)) {                            \
+          reg_t offset = bswap(ph[i].p_offset);                                \
+          assert(size >= offset + filesz);                                     \
+          /* The whole pages of read-only segments are mapped from the file,   \
+             where the memory allows, rather than copied */                    \
+          reg_t mapped = 0;                                                    \
+          if (!(bswap(ph[i].p_flags) & PF_W) && offset % host_page == 0 &&     \
+              load_addr % host_page == 0)                                      \
+            mapped = filesz / host_page * host_page;                           \
+          if (mapped)                                                          \
+            memif->write_file(load_addr, mapped, buf + offset, fd, offset);    \
+          if (filesz > mapped)                                                 \
+            memif->write(load_addr + mapped, filesz - mapped,                  \
+                         (uint8_t*)buf + offset + mapped);                     \
         }                                                                      \
         if (size_t pad = bswap(ph[i].p_memsz) - bswap(ph[i].p_filesz)) {       \
           zeros.resize(pad);                                                   \
@@ -102,6 +119,13 @@ std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t*
         assert(bswap(sym[i].st_name) < bswap(sh[strtabidx].sh_size));          \
         assert(strnlen(strtab + bswap(sym[i].st_name), max_len) < max_len);    \
         symbols[strtab + bswap(sym[i].st_name)] = bswap(sym[i].st_value) + load_offset;      \
+        unsigned type = ELF_ST_TYPE(sym[i].st_info);                           \
+        if (ranges && strtab[bswap(sym[i].st_name)] &&                         \
+            bswap(sym[i].st_shndx) != SHN_UNDEF &&                             \
+            (type == STT_FUNC || type == STT_NOTYPE))                          \
+          ranges->push_back({bswap(sym[i].st_value) + load_offset,             \
+                             bswap(sym[i].st_size),                            \
+                             strtab + bswap(sym[i].st_name)});                 \
       }                                                                        \
     }                                                                          \
   } while (0)
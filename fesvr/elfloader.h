@@ -7,9 +7,20 @@
 #include "memif.h"
 #include <map>
 #include <string>
+#include <vector>
+
+// A code symbol and the bytes it covers (size 0 when the ELF gives none)
+struct elf_symbol_t {
+  uint64_t addr;
+  uint64_t size;
+  std::string name;
+};
 
 class memif_t;
+// When ranges is given, the defined function and untyped symbols of the ELF
+// are appended to it, in symbol table order.
 std::map<std::string, uint64_t> load_elf(const char* fn, memif_t* memif, reg_t* entry,
-                                         reg_t load_offset, unsigned required_xlen = 0);
+                                         reg_t load_offset, unsigned required_xlen = 0,
+                                         std::vector<elf_symbol_t>* ranges = nullptr);
 
 #endif
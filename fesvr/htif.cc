@@ -7,15 +7,20 @@
 #include "platform.h"
 #include "byteorder.h"
 #include "trap.h"
+#include "term.h"
 #include "../riscv/common.h"
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <queue>
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <iomanip>
 #include <stdio.h>
 #include <unistd.h>
 #include <signal.h>
@@ -38,12 +43,39 @@
 static volatile bool signal_exit = false;
 static void handle_signal(int sig)
 {
-  if (sig == SIGABRT || signal_exit) // someone set up us the bomb!
+  if (sig == SIGABRT || signal_exit) { // someone set up us the bomb!
+    // the console writer may be stuck behind whatever aborted
+    canonical_terminal_t::flush_on_abort();
     exit(-1);
+  }
   signal_exit = true;
   signal(sig, &handle_signal);
 }
 
+void htif_memif_t::read(addr_t addr, size_t len, void* bytes)
+{
+  if (!locking)
+    return memif_t::read(addr, len, bytes);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  memif_t::read(addr, len, bytes);
+}
+
+void htif_memif_t::write(addr_t addr, size_t len, const void* bytes)
+{
+  if (!locking)
+    return memif_t::write(addr, len, bytes);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  memif_t::write(addr, len, bytes);
+}
+
+void htif_memif_t::write_file(addr_t addr, size_t len, const void* bytes, int fd, uint64_t offset)
+{
+  if (!locking)
+    return memif_t::write_file(addr, len, bytes, fd, offset);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  memif_t::write_file(addr, len, bytes, fd, offset);
+}
+
 htif_t::htif_t()
   : mem(this), entry(DRAM_BASE), sig_addr(0), sig_len(0),
     tohost_addr(0), fromhost_addr(0), stopped(false),
@@ -142,12 +174,19 @@ std::map<std::string, uint64_t> htif_t::load_payload(const std::string& payload,
         memif_t::write(taddr, len, src);
     }
 
+    void write_file(addr_t taddr, size_t len, const void* src, int fd, uint64_t offset) override
+    {
+      if (!htif->is_address_preloaded(taddr, len))
+        memif_t::write_file(taddr, len, src, fd, offset);
+    }
+
    private:
     htif_t* htif;
   } preload_aware_memif(this);
 
   try {
-    return load_elf(path.c_str(), &preload_aware_memif, entry, load_offset, expected_xlen);
+    return load_elf(path.c_str(), &preload_aware_memif, entry, load_offset, expected_xlen,
+                    &symbol_index);
   } catch (mem_trap_t& t) {
     bad_address("loading payload " + payload, t.get_tval());
     abort();
@@ -161,12 +200,14 @@ void htif_t::load_symbols(std::map<std::string, uint64_t>& symbols)
     nop_memif_t(htif_t* htif) : memif_t(htif) {}
     void read(addr_t UNUSED addr, size_t UNUSED len, void UNUSED *bytes) override {}
     void write(addr_t UNUSED taddr, size_t UNUSED len, const void UNUSED *src) override {}
+    void write_file(addr_t UNUSED taddr, size_t UNUSED len, const void UNUSED *src,
+                    int UNUSED fd, uint64_t UNUSED offset) override {}
   } nop_memif(this);
 
   reg_t nop_entry;
   for (auto &s : symbol_elfs) {
     std::map<std::string, uint64_t> other_symbols = load_elf(s.c_str(), &nop_memif, &nop_entry,
-                                                             expected_xlen);
+                                                             0, expected_xlen, &symbol_index);
     symbols.merge(other_symbols);
   }
 
@@ -184,10 +225,26 @@ void htif_t::load_symbols(std::map<std::string, uint64_t>& symbols)
   }
 
   for (auto i : symbols) {
+    // section and file symbols have no name
+    if (i.first.empty())
+      continue;
     auto it = addr2symbol.find(i.second);
     if ( it == addr2symbol.end())
       addr2symbol[i.second] = i.first;
   }
+  symbol2addr.insert(symbols.begin(), symbols.end());
+
+  // Where several symbols share an address, keep the one with a size (the
+  // function rather than a label on its first instruction).
+  std::stable_sort(symbol_index.begin(), symbol_index.end(),
+                   [](const elf_symbol_t& a, const elf_symbol_t& b) {
+                     return a.addr < b.addr || (a.addr == b.addr && a.size > b.size);
+                   });
+  symbol_index.erase(std::unique(symbol_index.begin(), symbol_index.end(),
+                                 [](const elf_symbol_t& a, const elf_symbol_t& b) {
+                                   return a.addr == b.addr;
+                                 }),
+                     symbol_index.end());
 }
 
 void htif_t::load_program()
@@ -204,6 +261,39 @@ void htif_t::load_program()
   return;
 }
 
+void htif_t::set_program(const std::string& path)
+{
+  if (targs.empty())
+    targs.push_back(path);
+  else
+    targs[0] = path;
+}
+
+void htif_t::replace_program(const std::string& path)
+{
+  if (!path.empty())
+    set_program(path);
+  if (targs.empty() || targs[0] == "none")
+    throw std::runtime_error("no program to load");
+
+  forget_program();
+  load_program();
+}
+
+void htif_t::forget_program()
+{
+  addr2symbol.clear();
+  symbol2addr.clear();
+  symbol_index.clear();
+  sig_addr = sig_len = 0;
+  tohost_addr = fromhost_addr = 0;
+  {
+    std::lock_guard<std::mutex> guard(exit_lock);
+    exitcode.reset();
+  }
+  stopped = false;
+}
+
 const char* htif_t::get_symbol(uint64_t addr)
 {
   auto it = addr2symbol.find(addr);
@@ -214,35 +304,86 @@ const char* htif_t::get_symbol(uint64_t addr)
   return it->second.c_str();
 }
 
+const char* htif_t::find_symbol(uint64_t addr, uint64_t* offset) const
+{
+  auto it = std::upper_bound(symbol_index.begin(), symbol_index.end(), addr,
+                             [](uint64_t a, const elf_symbol_t& s) { return a < s.addr; });
+  if (it == symbol_index.begin())
+    return nullptr;
+  --it;
+  if (it->size && addr - it->addr >= it->size)
+    return nullptr;
+  if (offset)
+    *offset = addr - it->addr;
+  return it->name.c_str();
+}
+
+std::optional<std::pair<uint64_t, uint64_t>> htif_t::get_symbol_range(const std::string& name) const
+{
+  for (auto it = symbol_index.begin(); it != symbol_index.end(); ++it) {
+    if (it->name != name)
+      continue;
+    if (it->size)
+      return std::make_pair(it->addr, it->addr + it->size);
+    auto next = std::next(it);
+    return std::make_pair(it->addr, next == symbol_index.end() ? it->addr + 1 : next->addr);
+  }
+  return std::nullopt;
+}
+
+std::optional<uint64_t> htif_t::get_symbol_addr(const std::string& name) const
+{
+  auto it = symbol2addr.find(name);
+  if (it == symbol2addr.end())
+    return std::nullopt;
+  return it->second;
+}
+
 bool htif_t::should_exit() const {
-  return signal_exit || exitcode.has_value();
+  if (signal_exit)
+    return true;
+  std::lock_guard<std::mutex> guard(exit_lock);
+  return exitcode.has_value();
 }
 
 void htif_t::htif_exit(int exit_code) {
+  std::lock_guard<std::mutex> guard(exit_lock);
   exitcode = exit_code;
 }
 
+bool htif_t::get_signature(std::vector<uint8_t>& out)
+{
+  if (!sig_len)
+    return false;
+  out.resize(sig_len);
+  mem.read(sig_addr, sig_len, out.data());
+  return true;
+}
+
 void htif_t::stop()
 {
-  if (!sig_file.empty() && sig_len) // print final torture test signature
+  std::vector<uint8_t> buf;
+  if (!sig_file.empty() && get_signature(buf)) // print final torture test signature
   {
-    std::vector<uint8_t> buf(sig_len);
-    mem.read(sig_addr, sig_len, buf.data());
-
-    std::ofstream sigs(sig_file);
-    assert(sigs && "can't open signature file!");
-    sigs << std::setfill('0') << std::hex;
-
+    // Each line is line_size bytes, most significant first, zero-padded
+    // past the end; formatted into one buffer and written at once.
+    static const char hex[] = "0123456789abcdef";
+    size_t lines = (sig_len + line_size - 1) / line_size;
+    std::string text(lines * (2 * line_size + 1), '0');
+    char* p = text.data();
     for (addr_t i = 0; i < sig_len; i += line_size)
     {
-      for (addr_t j = line_size; j > 0; j--)
-          if (i+j <= sig_len)
-            sigs << std::setw(2) << (uint16_t)buf[i+j-1];
-          else
-            sigs << std::setw(2) << (uint16_t)0;
-      sigs << '\n';
+      for (addr_t j = line_size; j > 0; j--, p += 2)
+        if (i+j <= sig_len) {
+          p[0] = hex[buf[i+j-1] >> 4];
+          p[1] = hex[buf[i+j-1] & 0xf];
+        }
+      *p++ = '\n';
     }
 
+    std::ofstream sigs(sig_file, std::ios::binary);
+    assert(sigs && "can't open signature file!");
+    sigs.write(text.data(), text.size());
     sigs.close();
   }
 
@@ -271,6 +412,13 @@ int htif_t::run()
       idle();
   }
 
+  if (service_thread) {
+    run_service_thread();
+    canonical_terminal_t::flush();
+    stop();
+    return exit_code();
+  }
+
   while (!should_exit())
   {
     uint64_t tohost;
@@ -307,11 +455,107 @@ int htif_t::run()
     }
   }
 
+  canonical_terminal_t::flush();
   stop();
 
   return exit_code();
 }
 
+void htif_t::run_service_thread()
+{
+  // The command queue and shutdown flag are guarded by lock, and the
+  // response queue by fromhost_lock; the devices belong to the host thread.
+  // Neither lock is held while a command is serviced, so a slow host call
+  // does not hold up the harts. Target memory is guarded by mem.lock
+  // instead, which the simulation holds while the harts run and the host
+  // thread for each access it makes, so a command's memory accesses wait
+  // for the end of a quantum.
+  std::mutex lock;
+  std::condition_variable wake;
+  std::deque<uint64_t> commands;
+  bool shutdown = false;
+  std::mutex fromhost_lock;
+  std::queue<reg_t> fromhost_queue;
+
+  std::function<void(reg_t)> fromhost_callback = [&](reg_t x) {
+    std::lock_guard<std::mutex> guard(fromhost_lock);
+    fromhost_queue.push(x);
+  };
+
+  mem.set_locking(true);
+  std::thread host([&]() {
+    std::deque<uint64_t> pending;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        // wake up now and then to let devices like the console poll
+        if (commands.empty() && !shutdown)
+          wake.wait_for(guard, std::chrono::milliseconds(1));
+        if (shutdown)
+          break;
+        pending.swap(commands);
+      }
+
+      uint64_t tohost = 0;
+      try {
+        while (!pending.empty()) {
+          tohost = pending.front();
+          pending.pop_front();
+          command_t cmd(mem, tohost, fromhost_callback);
+          device_list.handle_command(cmd);
+        }
+        tohost = 0;
+        device_list.tick();
+      } catch (mem_trap_t& t) {
+        std::stringstream tohost_hex;
+        tohost_hex << std::hex << tohost;
+        bad_address("host was accessing memory on behalf of target (tohost = 0x" + tohost_hex.str() + ")", t.get_tval());
+      }
+    }
+  });
+
+  while (!should_exit())
+  {
+    uint64_t tohost;
+
+    try {
+      if ((tohost = from_target(mem.read_uint64(tohost_addr))) != 0)
+        mem.write_uint64(tohost_addr, target_endian<uint64_t>::zero);
+    } catch (mem_trap_t& t) {
+      bad_address("accessing tohost", t.get_tval());
+    }
+
+    if (tohost != 0) {
+      std::lock_guard<std::mutex> guard(lock);
+      commands.push_back(tohost);
+      wake.notify_one();
+    }
+
+    try {
+      std::lock_guard<std::mutex> guard(fromhost_lock);
+      if (!fromhost_queue.empty() && !mem.read_uint64(fromhost_addr)) {
+        mem.write_uint64(fromhost_addr, to_target(fromhost_queue.front()));
+        fromhost_queue.pop();
+      }
+    } catch (mem_trap_t& t) {
+      bad_address("accessing fromhost", t.get_tval());
+    }
+
+    if (tohost == 0) {
+      std::lock_guard<std::recursive_mutex> guard(mem.lock);
+      idle();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    shutdown = true;
+    wake.notify_one();
+  }
+  host.join();
+  mem.set_locking(false);
+}
+
 bool htif_t::done()
 {
   return stopped;
@@ -319,6 +563,7 @@ bool htif_t::done()
 
 int htif_t::exit_code()
 {
+  std::lock_guard<std::mutex> guard(exit_lock);
   return exitcode.value_or(0) >> 1;
 }
 
@@ -340,8 +585,6 @@ void htif_t::parse_arguments(int argc, char ** argv)
         else        dynamic_devices.push_back(new rfb_t);
         break;
       case HTIF_LONG_OPTIONS_OPTIND + 1:
-        // [TODO] Remove once disks are supported again
-        throw std::invalid_argument("--disk/+disk unsupported (use a ramdisk)");
         dynamic_devices.push_back(new disk_t(optarg));
         break;
       case HTIF_LONG_OPTIONS_OPTIND + 2:
@@ -362,6 +605,12 @@ void htif_t::parse_arguments(int argc, char ** argv)
       case HTIF_LONG_OPTIONS_OPTIND + 7:
         symbol_elfs.push_back(optarg);
         break;
+      case HTIF_LONG_OPTIONS_OPTIND + 8:
+        service_thread = true;
+        break;
+      case HTIF_LONG_OPTIONS_OPTIND + 9:
+        dynamic_devices.push_back(new disk_t(optarg, true));
+        break;
       case '?':
         if (!opterr)
           break;
@@ -408,6 +657,14 @@ void htif_t::parse_arguments(int argc, char ** argv)
           c = HTIF_LONG_OPTIONS_OPTIND + 7;
           optarg = optarg + 12;
         }
+        else if (arg == "+htif-thread") {
+          c = HTIF_LONG_OPTIONS_OPTIND + 8;
+          optarg = nullptr;
+        }
+        else if (arg.find("+cow-disk=") == 0) {
+          c = HTIF_LONG_OPTIONS_OPTIND + 9;
+          optarg = optarg + 10;
+        }
         else if (arg.find("+permissive-off") == 0) {
           if (opterr)
             throw std::invalid_argument("Found +permissive-off when not parsing permissively");
@@ -7,12 +7,33 @@
 #include "syscall.h"
 #include "device.h"
 #include "byteorder.h"
+#include "elfloader.h"
 #include "../riscv/platform.h"
 #include <string.h>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <assert.h>
 
+// The memif_t of an htif_t. Once set_locking(true), each access holds lock,
+// which the run() loop with a service thread also holds while the harts run,
+// so that target memory is only ever touched by one side at a time.
+class htif_memif_t : public memif_t
+{
+public:
+  htif_memif_t(chunked_memif_t* _cmemif) : memif_t(_cmemif) {}
+
+  void read(addr_t addr, size_t len, void* bytes) override;
+  void write(addr_t addr, size_t len, const void* bytes) override;
+  void write_file(addr_t addr, size_t len, const void* bytes, int fd, uint64_t offset) override;
+
+  void set_locking(bool on) { locking = on; }
+  std::recursive_mutex lock;
+
+private:
+  bool locking = false;
+};
+
 class htif_t : public chunked_memif_t
 {
  public:
@@ -31,6 +52,11 @@ class htif_t : public chunked_memif_t
   bool done();
   int exit_code();
   void set_expected_xlen(unsigned int m) { expected_xlen = m; }
+  // The program start() loads, in place of the first target argument
+  void set_program(const std::string& path);
+  // Where stop() writes the signature of the next program, replacing
+  // --signature
+  void set_signature_file(const std::string& path) { sig_file = path; }
   virtual memif_t& memif() { return mem; }
 
   template<typename T> inline T from_target(target_endian<T> n) const
@@ -51,6 +77,20 @@ class htif_t : public chunked_memif_t
 
   addr_t get_tohost_addr() { return tohost_addr; }
   addr_t get_fromhost_addr() { return fromhost_addr; }
+  // Whether devices are serviced on a host thread of their own (+htif-thread)
+  bool has_service_thread() const { return service_thread; }
+  // Address of a symbol of the loaded ELFs, if there is one
+  std::optional<uint64_t> get_symbol_addr(const std::string& name) const;
+  // The function (or untyped label) of the loaded ELFs that addr falls in,
+  // if any, found by binary search; *offset, when given, is addr's distance
+  // from its start. A symbol with no ELF size runs to the next one.
+  const char* find_symbol(uint64_t addr, uint64_t* offset = nullptr) const;
+  // The bytes [begin, end) of the function or label name, sized as for
+  // find_symbol, or nothing if the loaded ELFs have no such code symbol
+  std::optional<std::pair<uint64_t, uint64_t>> get_symbol_range(const std::string& name) const;
+  // The bytes between begin_signature and end_signature of the loaded
+  // program, read in one transfer; false if it has no signature
+  bool get_signature(std::vector<uint8_t>& out);
 
  protected:
   virtual void reset() = 0;
@@ -65,6 +105,12 @@ class htif_t : public chunked_memif_t
   virtual std::map<std::string, uint64_t> load_payload(const std::string& payload, reg_t* entry,
                                                        reg_t load_addr);
   virtual void load_program();
+  // Forgets the symbols and exit status of the current program and loads
+  // path (the same program again when empty) in its place
+  void replace_program(const std::string& path);
+  // Forgets the symbols and exit status of the current program only, so that
+  // a later start() loads the program afresh
+  void forget_program();
   virtual void load_symbols(std::map<std::string, uint64_t>&);
   virtual void idle() {}
 
@@ -86,11 +132,13 @@ class htif_t : public chunked_memif_t
 
  private:
   void parse_arguments(int argc, char ** argv);
+  // The run() loop when devices are serviced on a host thread of their own
+  void run_service_thread();
   void register_devices();
   void usage(const char * program_name);
   unsigned int expected_xlen = 0;
   const reg_t load_offset = DRAM_BASE;
-  memif_t mem;
+  htif_memif_t mem;
   reg_t entry;
   bool writezeros;
   std::vector<std::string> hargs;
@@ -101,9 +149,12 @@ class htif_t : public chunked_memif_t
   addr_t sig_len; // torture
   addr_t tohost_addr;
   addr_t fromhost_addr;
-  // Set to a value by htif_exit() when the simulation should exit.
+  // Set to a value by htif_exit() when the simulation should exit; guarded
+  // by exit_lock, since with a service thread its devices set it too.
   std::optional<int> exitcode;
+  mutable std::mutex exit_lock;
   bool stopped;
+  bool service_thread = false;
 
   device_list_t device_list;
   syscall_t syscall_proxy;
@@ -113,6 +164,9 @@ class htif_t : public chunked_memif_t
 
   std::vector<std::string> symbol_elfs;
   std::map<uint64_t, std::string> addr2symbol;
+  std::map<std::string, uint64_t> symbol2addr;
+  // Code symbols sorted by address, one per address, for find_symbol
+  std::vector<elf_symbol_t> symbol_index;
 
   friend class memif_t;
   friend class syscall_t;
@@ -142,10 +196,12 @@ class htif_t : public chunked_memif_t
        +payload=PATH\n\
       --symbol-elf=PATH    Populate the symbol table with the ELF file at PATH\n\
        +symbol-elf=PATH\n\
-\n\
-HOST OPTIONS (currently unsupported)\n\
-      --disk=DISK          Add DISK device. Use a ramdisk since this isn't\n\
-       +disk=DISK            supported\n\
+      --disk=DISK          Add a block device backed by the image file DISK\n\
+       +disk=DISK\n\
+      --cow-disk=DISK      Likewise, but keep writes private to this run and\n\
+       +cow-disk=DISK        leave DISK unmodified\n\
+      --htif-thread        Service HTIF devices on a host thread of their own,\n\
+       +htif-thread          so slow host I/O does not stall the simulation\n\
 \n\
 TARGET (RISC-V BINARY) OPTIONS\n\
   These are the options passed to the program executing on the emulated RISC-V\n\
@@ -162,6 +218,8 @@ TARGET (RISC-V BINARY) OPTIONS\n\
 {"signature-granularity",    required_argument, 0, HTIF_LONG_OPTIONS_OPTIND + 5 },     \
 {"target-argument",          required_argument, 0, HTIF_LONG_OPTIONS_OPTIND + 6 },     \
 {"symbol-elf",               required_argument, 0, HTIF_LONG_OPTIONS_OPTIND + 7 },     \
+{"htif-thread",              no_argument,       0, HTIF_LONG_OPTIONS_OPTIND + 8 },     \
+{"cow-disk",                 required_argument, 0, HTIF_LONG_OPTIONS_OPTIND + 9 },     \
 {0, 0, 0, 0}
 
 #endif // __HTIF_H
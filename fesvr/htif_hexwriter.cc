@@ -1,7 +1,15 @@
 // See LICENSE for license details.
 
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <cerrno>
+#include <cstring>
 #include <assert.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "htif_hexwriter.h"
 
 htif_hexwriter_t::htif_hexwriter_t(size_t b, size_t w, size_t d)
@@ -74,3 +82,110 @@ std::ostream& operator<< (std::ostream& o, const htif_hexwriter_t& h)
 
   return o;
 }
+
+htif_flat_hexwriter_t::htif_flat_hexwriter_t(size_t b, size_t w, size_t d)
+  : base(b), width(w), depth(d), size(w * d)
+{
+  void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("cannot map a " + std::to_string(size) + "-byte image: " + strerror(errno));
+  image = (uint8_t*)p;
+}
+
+htif_flat_hexwriter_t::~htif_flat_hexwriter_t()
+{
+  munmap(image, size);
+}
+
+uint8_t* htif_flat_hexwriter_t::at(addr_t taddr, size_t len) const
+{
+  if (taddr < base || taddr - base > size || len > size - (taddr - base))
+    throw std::runtime_error("segment outside the image");
+  return image + (taddr - base);
+}
+
+void htif_flat_hexwriter_t::read_chunk(addr_t taddr, size_t len, void* dst)
+{
+  memcpy(dst, at(taddr, len), len);
+}
+
+void htif_flat_hexwriter_t::write_chunk(addr_t taddr, size_t len, const void* src)
+{
+  memcpy(at(taddr, len), src, len);
+}
+
+void htif_flat_hexwriter_t::clear_chunk(addr_t taddr, size_t len)
+{
+  memset(at(taddr, len), 0, len);
+}
+
+bool htif_flat_hexwriter_t::write_bulk(addr_t taddr, size_t len, const void* src)
+{
+  write_chunk(taddr, len, src);
+  return true;
+}
+
+bool htif_flat_hexwriter_t::read_bulk(addr_t taddr, size_t len, void* dst)
+{
+  read_chunk(taddr, len, dst);
+  return true;
+}
+
+static bool write_all(int fd, const char* buf, size_t len)
+{
+  while (len) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool htif_flat_hexwriter_t::write_hex(int fd, unsigned threads) const
+{
+  static const char digits[] = "0123456789abcdef";
+  const size_t line_len = 2 * width + 1;
+  // lines per block: about 4 MiB of text, formatted by one thread
+  const size_t block_lines = std::max<size_t>(1, (4 << 20) / line_len);
+  threads = std::max(1u, threads);
+  std::vector<std::string> text(threads);
+
+  for (size_t line = 0; line < depth; line += threads * block_lines) {
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+      size_t first = line + t * block_lines;
+      size_t n = first < depth ? std::min(block_lines, depth - first) : 0;
+      text[t].resize(n * line_len);
+      auto format = [&, first, n, t] {
+        char* out = &text[t][0];
+        for (size_t l = first; l < first + n; l++) {
+          const uint8_t* bytes = image + l * width;
+          for (size_t j = width; j-- > 0; ) {
+            *out++ = digits[bytes[j] >> 4];
+            *out++ = digits[bytes[j] & 0xf];
+          }
+          *out++ = '\n';
+        }
+      };
+      if (t + 1 < threads)
+        workers.emplace_back(format);
+      else
+        format();
+    }
+    for (auto& w : workers)
+      w.join();
+    for (unsigned t = 0; t < threads; t++)
+      if (!write_all(fd, text[t].data(), text[t].size()))
+        return false;
+  }
+  return true;
+}
+
+bool htif_flat_hexwriter_t::write_binary(int fd) const
+{
+  return write_all(fd, (const char*)image, size);
+}
@@ -5,6 +5,7 @@
 
 #include <map>
 #include <vector>
+#include <stdint.h>
 #include <stdlib.h>
 #include "memif.h"
 
@@ -29,4 +30,40 @@ protected:
   friend std::ostream& operator<< (std::ostream&, const htif_hexwriter_t&);
 };
 
+// The same image in one flat buffer, for memories of a GiB and more: the
+// buffer is mapped on demand, so untouched parts cost nothing, loads are
+// copied in whole, and write_hex formats lines on several threads.
+class htif_flat_hexwriter_t : public chunked_memif_t
+{
+public:
+  // Throws std::runtime_error if the image cannot be mapped.
+  htif_flat_hexwriter_t(size_t b, size_t w, size_t d);
+  ~htif_flat_hexwriter_t();
+
+  // What operator<< writes for htif_hexwriter_t: depth lines of width
+  // bytes in hex, the highest address first. Returns false on a write
+  // error, with errno set.
+  bool write_hex(int fd, unsigned threads) const;
+  // The image as raw bytes, in address order
+  bool write_binary(int fd) const;
+
+protected:
+  size_t base;
+  size_t width;
+  size_t depth;
+  size_t size;
+  uint8_t* image;
+
+  uint8_t* at(addr_t taddr, size_t len) const;
+
+  void read_chunk(addr_t taddr, size_t len, void* dst);
+  void write_chunk(addr_t taddr, size_t len, const void* src);
+  void clear_chunk(addr_t taddr, size_t len);
+  bool write_bulk(addr_t taddr, size_t len, const void* src);
+  bool read_bulk(addr_t taddr, size_t len, void* dst);
+
+  size_t chunk_max_size() { return width; }
+  size_t chunk_align() { return width; }
+};
+
 #endif // __HTIF_HEXWRITER_H
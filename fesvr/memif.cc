@@ -8,6 +8,9 @@
 
 void memif_t::read(addr_t addr, size_t len, void* bytes)
 {
+  if (len > cmemif->chunk_max_size() && cmemif->read_bulk(addr, len, bytes))
+    return;
+
   size_t align = cmemif->chunk_align();
   if (len && (addr & (align-1)))
   {
@@ -39,8 +42,17 @@ void memif_t::read(addr_t addr, size_t len, void* bytes)
     cmemif->read_chunk(addr + pos, std::min(cmemif->chunk_max_size(), len - pos), (char*)bytes + pos);
 }
 
+void memif_t::write_file(addr_t addr, size_t len, const void* bytes, int fd, uint64_t offset)
+{
+  if (!cmemif->map_file(addr, len, fd, offset))
+    write(addr, len, bytes);
+}
+
 void memif_t::write(addr_t addr, size_t len, const void* bytes)
 {
+  if (len > cmemif->chunk_max_size() && cmemif->write_bulk(addr, len, bytes))
+    return;
+
   size_t align = cmemif->chunk_align();
   if (len && (addr & (align-1)))
   {
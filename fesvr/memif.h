@@ -23,6 +23,18 @@ public:
   virtual size_t chunk_align() = 0;
   virtual size_t chunk_max_size() = 0;
 
+  // Optional fast path for large writes such as ELF segments. Returns false
+  // if [taddr, taddr + len) cannot be written directly; memif_t then falls
+  // back to chunks.
+  virtual bool write_bulk(addr_t, size_t, const void*) { return false; }
+  // Likewise for large reads, such as proxied syscall buffers.
+  virtual bool read_bulk(addr_t, size_t, void*) { return false; }
+  // Optional: map the len bytes of file fd at offset to [taddr, taddr + len)
+  // copy-on-write, all three host-page aligned, so that instances loading
+  // the same file share its pages until they store to them. Returns false
+  // if the range cannot be mapped; memif_t then writes it.
+  virtual bool map_file(addr_t, size_t, int, uint64_t) { return false; }
+
   virtual endianness_t get_target_endianness() const {
     return endianness_little;
   }
@@ -39,6 +51,9 @@ public:
   // read and write byte arrays
   virtual void read(addr_t addr, size_t len, void* bytes);
   virtual void write(addr_t addr, size_t len, const void* bytes);
+  // write() bytes, which are the len bytes of file fd at offset, mapping
+  // them from the file instead where the target memory allows
+  virtual void write_file(addr_t addr, size_t len, const void* bytes, int fd, uint64_t offset);
 
   // read and write 8-bit words
   virtual target_endian<uint8_t> read_uint8(addr_t addr);
@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sched.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <cstdlib>
@@ -15,7 +16,8 @@ using namespace std::placeholders;
 rfb_t::rfb_t(int display)
   : sockfd(-1), afd(-1),
     memif(0), addr(0), width(0), height(0), bpp(0), display(display),
-    thread(pthread_self()), fb1(0), fb2(0), read_pos(0),
+    thread(pthread_self()), fb1(0), fb2(0), fb_out(0), fb_sent(0),
+    fb_ready(false), fb_sent_valid(false), read_pos(0),
     lock(PTHREAD_MUTEX_INITIALIZER)
 {
   register_command(0, std::bind(&rfb_t::handle_configure, this, _1), "configure");
@@ -69,6 +71,8 @@ void rfb_t::thread_main()
   serverinit += name;
   write(serverinit);
 
+  // a new client has nothing on screen yet
+  fb_sent_valid = false;
   pthread_mutex_unlock(&lock);
 
   while (memif == NULL)
@@ -76,16 +80,27 @@ void rfb_t::thread_main()
 
   while (memif != NULL)
   {
-    std::string s = read();
-    if (s.length() < 4)
-      break; //throw std::runtime_error("bad command");
+    // wake up now and then to send frames while the client is quiet
+    struct pollfd pfd = { afd, POLLIN, 0 };
+    int rc = poll(&pfd, 1, 10);
+    if (rc < 0)
+      break;
 
-    switch (s[0])
+    if (rc > 0)
     {
-      case 0: set_pixel_format(s); break;
-      case 2: set_encodings(s); break;
-      case 3: break;
+      std::string s = read();
+      if (s.length() < 4)
+        break; //throw std::runtime_error("bad command");
+
+      switch (s[0])
+      {
+        case 0: set_pixel_format(s); break;
+        case 2: set_encodings(s); break;
+        case 3: break;
+      }
     }
+
+    fb_update();
   }
 
   pthread_mutex_lock(&lock);
@@ -105,6 +120,8 @@ rfb_t::~rfb_t()
     pthread_join(thread, 0);
   delete [] fb1;
   delete [] fb2;
+  delete [] fb_out;
+  delete [] fb_sent;
 }
 
 void rfb_t::set_encodings(const std::string& s)
@@ -121,16 +138,70 @@ void rfb_t::set_pixel_format(const std::string& s)
 
 void rfb_t::fb_update()
 {
+  pthread_mutex_lock(&lock);
+  bool ready = fb_ready;
+  if (ready)
+  {
+    std::swap(fb1, fb_out);
+    fb_ready = false;
+  }
+  pthread_mutex_unlock(&lock);
+  if (!ready)
+    return;
+
+  // Send the tiles that changed since the last frame, each run of dirty
+  // tiles in a tile row as one raw rectangle.
+  size_t stride = size_t(width) * bpp/8;
+  std::string rects;
+  uint16_t nrects = 0;
+  for (uint16_t y = 0; y < height; y += FB_TILE)
+  {
+    uint16_t h = std::min(int(FB_TILE), height - y);
+    for (uint16_t x = 0; x < width; )
+    {
+      auto dirty = [&](uint16_t tx) {
+        if (!fb_sent_valid)
+          return true;
+        size_t w = std::min(int(FB_TILE), width - tx) * bpp/8;
+        for (uint16_t row = y; row < y + h; row++)
+        {
+          size_t off = row * stride + tx * bpp/8;
+          if (memcmp(fb_out + off, fb_sent + off, w) != 0)
+            return true;
+        }
+        return false;
+      };
+
+      if (!dirty(x))
+      {
+        x += FB_TILE;
+        continue;
+      }
+      uint16_t x0 = x;
+      while (x < width && dirty(x))
+        x += FB_TILE;
+      uint16_t w = std::min(int(x), int(width)) - x0;
+
+      rects += str(uint16_t(htons(x0)));
+      rects += str(uint16_t(htons(y)));
+      rects += str(uint16_t(htons(w)));
+      rects += str(uint16_t(htons(h)));
+      rects += str(uint32_t(htonl(0)));
+      for (uint16_t row = y; row < y + h; row++)
+        rects.append(fb_out + row * stride + x0 * bpp/8, size_t(w) * bpp/8);
+      nrects++;
+    }
+  }
+  std::swap(fb_out, fb_sent);
+  fb_sent_valid = true;
+  if (nrects == 0)
+    return;
+
   std::string u;
   u += str(uint8_t(0));
   u += str(uint8_t(0));
-  u += str(uint16_t(htons(1)));
-  u += str(uint16_t(htons(0)));
-  u += str(uint16_t(htons(0)));
-  u += str(uint16_t(htons(width)));
-  u += str(uint16_t(htons(height)));
-  u += str(uint32_t(htonl(0)));
-  u += std::string((char*)fb1, fb_bytes());
+  u += str(uint16_t(htons(nrects)));
+  u += rects;
 
   try
   {
@@ -141,22 +212,30 @@ void rfb_t::fb_update()
   }
 }
 
+void rfb_t::fb_publish()
+{
+  // Never wait on the rfb thread: if it is still busy with the previous
+  // frame, or no client is connected, this one is dropped.
+  if (pthread_mutex_trylock(&lock) == 0)
+  {
+    if (!fb_ready)
+    {
+      std::swap(fb1, fb2);
+      fb_ready = true;
+    }
+    pthread_mutex_unlock(&lock);
+  }
+}
+
 void rfb_t::tick()
 {
   if (fb_bytes() == 0 || memif == NULL)
     return;
 
-  memif->read(addr + read_pos, FB_ALIGN, const_cast<char*>(fb2 + read_pos));
+  memif->read(addr + read_pos, FB_ALIGN, fb2 + read_pos);
   read_pos = (read_pos + FB_ALIGN) % fb_bytes();
   if (read_pos == 0)
-  {
-    std::swap(fb1, fb2);
-    if (pthread_mutex_trylock(&lock) == 0)
-    {
-      fb_update();
-      pthread_mutex_unlock(&lock);
-    }
-  }
+    fb_publish();
 }
 
 std::string rfb_t::pixel_format()
@@ -215,6 +294,8 @@ void rfb_t::handle_configure(command_t cmd)
 
   fb1 = new char[fb_bytes()];
   fb2 = new char[fb_bytes()];
+  fb_out = new char[fb_bytes()];
+  fb_sent = new char[fb_bytes()];
   if (pthread_create(&thread, 0, rfb_thread_main, this))
     throw std::runtime_error("could not create thread");
   cmd.respond(1);
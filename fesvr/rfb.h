@@ -26,6 +26,8 @@ class rfb_t : public device_t
   friend void* rfb_thread_main(void*);
   std::string pixel_format();
   void fb_update();
+  // Hand a captured frame to the rfb thread, if it is ready for one
+  void fb_publish();
   void set_encodings(const std::string& s);
   void set_pixel_format(const std::string& s);
   void write(const std::string& s);
@@ -42,12 +44,20 @@ class rfb_t : public device_t
   uint16_t bpp;
   int display;
   pthread_t thread;
-  volatile char* volatile fb1;
-  volatile char* volatile fb2;
+  // fb2 is being captured by tick(); fb1 is the latest whole frame, valid
+  // when fb_ready. The rfb thread swaps fb1 for fb_out and sends what
+  // differs from fb_sent, the frame the client already has.
+  char* fb1;
+  char* fb2;
+  char* fb_out;
+  char* fb_sent;
+  bool fb_ready;
+  bool fb_sent_valid;
   size_t read_pos;
   pthread_mutex_t lock;
 
   static const int FB_ALIGN = 256;
+  static const int FB_TILE = 16;
 };
 
 #endif
@@ -212,7 +212,7 @@ void syscall_t::handle_syscall(command_t cmd)
 {
   if (cmd.payload() & 1) // test pass/fail
   {
-    htif->exitcode = cmd.payload();
+    htif->htif_exit(cmd.payload());
     if (htif->exit_code())
       std::cerr << "*** FAILED *** (tohost = " << htif->exit_code() << ")" << std::endl;
     return;
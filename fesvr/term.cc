@@ -1,9 +1,19 @@
 #include "term.h"
 #include <termios.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 class canonical_termios_t
 {
@@ -32,8 +42,173 @@ class canonical_termios_t
 
 static canonical_termios_t tios; // exit() will clean up for us
 
+// Output is batched into few large writes by a thread started with the
+// first byte; the static destructor drains it when the process exits. The
+// output is drained across fork(), and a child starts its own thread.
+class console_writer_t
+{
+ public:
+  static const size_t MAX_PENDING = 1 << 20;
+
+  console_writer_t() : fd(1), writing(false), stop(false)
+  {
+    pthread_atfork(prepare_fork, parent_fork, child_fork);
+  }
+
+  ~console_writer_t()
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+    }
+    data_cv.notify_one();
+    // the writer itself exits when a write fails
+    if (thread && thread->get_id() == std::this_thread::get_id())
+      thread->detach();
+    else if (thread)
+      thread->join();
+    if (fd != 1)
+      close(fd);
+  }
+
+  void put(char ch)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    if (!thread)
+      thread.reset(new std::thread(&console_writer_t::run, this));
+    if (pending.size() >= MAX_PENDING)
+      idle_cv.wait(guard, [&]{ return pending.size() < MAX_PENDING; });
+    pending.push_back(ch);
+    if (pending.size() == 1)
+      data_cv.notify_one();
+  }
+
+  void flush()
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    idle_cv.wait(guard, [&]{ return pending.empty() && !writing; });
+  }
+
+  void flush_on_abort()
+  {
+    if (thread && thread->get_id() == std::this_thread::get_id())
+      return;
+    // about a second for the writer to finish the batch it is writing
+    for (int tries = 0; tries < 1000; tries++) {
+      std::unique_lock<std::mutex> guard(lock, std::try_to_lock);
+      if (guard.owns_lock() && !writing) {
+        for (size_t done = 0; done < pending.size(); ) {
+          ssize_t n = ::write(fd, pending.data() + done, pending.size() - done);
+          if (n <= 0)
+            break;
+          done += n;
+        }
+        pending.clear();
+        return;
+      }
+      if (guard.owns_lock())
+        guard.unlock();
+      usleep(1000);
+    }
+  }
+
+  void set_fd(int new_fd)
+  {
+    flush();
+    std::lock_guard<std::mutex> guard(lock);
+    if (fd != 1)
+      close(fd);
+    fd = new_fd;
+  }
+
+ private:
+  static void prepare_fork();
+  static void parent_fork();
+  static void child_fork();
+
+  void run()
+  {
+    std::vector<char> out;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      data_cv.wait(guard, [&]{ return stop || !pending.empty(); });
+      if (pending.empty())
+        return;
+      out.swap(pending);
+      writing = true;
+      guard.unlock();
+      idle_cv.notify_all();
+
+      for (size_t done = 0; done < out.size(); ) {
+        ssize_t n = ::write(fd, out.data() + done, out.size() - done);
+        if (n <= 0)
+          abort();
+        done += n;
+      }
+      out.clear();
+
+      guard.lock();
+      writing = false;
+      idle_cv.notify_all();
+    }
+  }
+
+  int fd;
+  std::vector<char> pending;
+  bool writing;
+  bool stop;
+  std::mutex lock;
+  std::condition_variable data_cv;
+  std::condition_variable idle_cv;  // pending shrank or the writer went idle
+  std::unique_ptr<std::thread> thread;
+};
+
+static console_writer_t writer;
+
+void console_writer_t::prepare_fork()
+{
+  std::unique_lock<std::mutex> guard(writer.lock);
+  writer.idle_cv.wait(guard, [&]{ return writer.pending.empty() && !writer.writing; });
+  guard.release();
+}
+
+void console_writer_t::parent_fork()
+{
+  writer.lock.unlock();
+}
+
+void console_writer_t::child_fork()
+{
+  // The writer thread was not forked; its waits are forgotten with it
+  (void)writer.thread.release();
+  new (&writer.data_cv) std::condition_variable;
+  new (&writer.idle_cv) std::condition_variable;
+  writer.lock.unlock();
+}
+
+// Bytes already read from stdin but not yet returned by read()
+static unsigned char input[256];
+static size_t input_pos, input_len;
+
+static std::function<int()> input_hook;
+
+void canonical_terminal_t::set_input_hook(std::function<int()> hook)
+{
+  input_hook = std::move(hook);
+}
+
 int canonical_terminal_t::read()
 {
+  if (input_hook)
+    return input_hook();
+  return read_stdin();
+}
+
+int canonical_terminal_t::read_stdin()
+{
+  if (input_pos < input_len)
+    return input[input_pos++];
+
   struct pollfd pfd;
   pfd.fd = 0;
   pfd.events = POLLIN;
@@ -41,13 +216,34 @@ int canonical_terminal_t::read()
   if (ret <= 0 || !(pfd.revents & POLLIN))
     return -1;
 
-  unsigned char ch;
-  ret = ::read(0, &ch, 1);
-  return ret <= 0 ? -1 : ch;
+  // Take whatever is ready, so a paste costs one poll and one read
+  ssize_t n = ::read(0, input, sizeof(input));
+  if (n <= 0)
+    return -1;
+  input_pos = 1;
+  input_len = n;
+  return input[0];
 }
 
 void canonical_terminal_t::write(char ch)
 {
-  if (::write(1, &ch, 1) != 1)
-    abort();
+  writer.put(ch);
+}
+
+void canonical_terminal_t::flush()
+{
+  writer.flush();
+}
+
+void canonical_terminal_t::flush_on_abort()
+{
+  writer.flush_on_abort();
+}
+
+void canonical_terminal_t::set_output(const char* path)
+{
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    throw std::runtime_error(std::string("could not open console output `") + path + "': " + strerror(errno));
+  writer.set_fd(fd);
 }
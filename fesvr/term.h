@@ -1,11 +1,30 @@
 #ifndef _TERM_H
 #define _TERM_H
 
+#include <functional>
+
 class canonical_terminal_t
 {
  public:
+  // Returns the next byte of stdin, or -1 if none is ready; never blocks.
   static int read();
+  // While hook is set, read() returns what it returns instead, e.g. to
+  // record or replay the input; an empty hook restores stdin.
+  static void set_input_hook(std::function<int()> hook);
+  // read() from stdin, whatever the hook
+  static int read_stdin();
+  // Queues a byte for a helper thread to write out, so the caller only
+  // waits for the output if it is far behind.
   static void write(char);
+  // Returns once everything written so far has been output.
+  static void flush();
+  // The same from a signal handler about to end the process, as on abort:
+  // gives up rather than wait long on a lock or thread that may never
+  // come back.
+  static void flush_on_abort();
+  // Sends the output to path (a file, created or truncated, or a pipe)
+  // instead of stdout. Throws std::runtime_error if it cannot be opened.
+  static void set_output(const char* path);
 };
 
 #endif
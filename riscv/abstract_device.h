@@ -11,6 +11,8 @@
 #include <vector>
 
 class sim_t;
+class checkpoint_writer_t;
+class checkpoint_reader_t;
 
 class abstract_device_t {
  public:
@@ -18,7 +20,26 @@ class abstract_device_t {
   virtual bool store(reg_t addr, size_t len, const uint8_t* bytes) = 0;
   virtual reg_t size() = 0;
   virtual ~abstract_device_t() {}
+  // Devices are ticked with the rtc ticks elapsed since their previous
+  // tick, at the first round end at or after the time (in ticks since the
+  // simulation started) that next_tick returned after that tick. The
+  // default ticks every round; devices with nothing timed return NO_TICK
+  // and are never ticked again.
+  static const reg_t NO_TICK = reg_t(-1);
   virtual void tick(reg_t UNUSED rtc_ticks) {}
+  virtual reg_t next_tick(reg_t now) { return now; }
+  // Devices that are plain memory to the harts (scratchpads, framebuffers,
+  // TCMs) may return the host bytes at addr, backing the whole page around
+  // it; the harts then access that page through their TLBs like RAM, and
+  // load and store are no longer called for it.
+  virtual char* host_contents(reg_t UNUSED addr) { return nullptr; }
+  // State kept in sim_t checkpoints (see checkpoint.h). load_state must
+  // consume exactly what save_state wrote; devices without state keep these.
+  virtual void save_state(checkpoint_writer_t& UNUSED out) const {}
+  virtual void load_state(checkpoint_reader_t& UNUSED in) {}
+  // False for devices whose state lives outside what save_state writes
+  // (a disk image), so a checkpoint of them could not be restored.
+  virtual bool checkpointable() const { return true; }
 };
 
 // factory for devices which should show up in the DTS, and can be
@@ -9,6 +9,24 @@
 #include <cstddef>
 #include <type_traits>
 
+#ifdef __SIZEOF_INT128__
+// The host multiplies 64 by 64 bits into 128 in one instruction (mul, imul
+// or mulx on x86-64, umulh and smulh on AArch64)
+inline uint64_t mulhu(uint64_t a, uint64_t b)
+{
+  return ((unsigned __int128)a * b) >> 64;
+}
+
+inline int64_t mulh(int64_t a, int64_t b)
+{
+  return ((__int128)a * b) >> 64;
+}
+
+inline int64_t mulhsu(int64_t a, uint64_t b)
+{
+  return ((__int128)a * (__int128)b) >> 64;
+}
+#else
 inline uint64_t mulhu(uint64_t a, uint64_t b)
 {
   uint64_t t;
@@ -42,6 +60,35 @@ inline int64_t mulhsu(int64_t a, uint64_t b)
   uint64_t res = mulhu(a < 0 ? -(uint64_t)a : a, b);
   return negate ? ~res + ((uint64_t)a * b == 0) : res;
 }
+#endif
+
+// The high half of the double-width product of a and b, as VMULH and
+// VMULHU return it: below 64 bits through a 64-bit multiply, which holds
+// the whole product, at 64 through mulh() or mulhu()
+template<typename T>
+static inline T mulh_elt(T a, T b)
+{
+  constexpr int bits = sizeof(T) * 8;
+  if constexpr (bits == 64 && std::is_signed<T>::value)
+    return mulh(a, b);
+  else if constexpr (bits == 64)
+    return mulhu(a, b);
+  else if constexpr (std::is_signed<T>::value)
+    return ((int64_t)a * b) >> bits;
+  else
+    return ((uint64_t)a * b) >> bits;
+}
+
+// Same for VMULHSU, signed a by unsigned b
+template<typename T>
+static inline T mulhsu_elt(T a, typename std::make_unsigned<T>::type b)
+{
+  constexpr int bits = sizeof(T) * 8;
+  if constexpr (bits == 64)
+    return mulhsu(a, b);
+  else
+    return ((int64_t)a * (int64_t)b) >> bits;
+}
 
 //ref:  https://locklessinc.com/articles/sat_arithmetic/
 template<typename T, typename UT>
@@ -143,58 +190,27 @@ static inline uint64_t make_mask64(int pos, int len)
     return (UINT64_MAX >> (64 - len)) << pos;
 }
 
+// popcount, ctz and clz are the host's instructions where the build
+// targets them (POPCNT, TZCNT/BSF, LZCNT/BSR); ctz(0) and clz(0) are 0.
 static inline int popcount(uint64_t val)
 {
-  val = (val & 0x5555555555555555U) + ((val >>  1) & 0x5555555555555555U);
-  val = (val & 0x3333333333333333U) + ((val >>  2) & 0x3333333333333333U);
-  val = (val & 0x0f0f0f0f0f0f0f0fU) + ((val >>  4) & 0x0f0f0f0f0f0f0f0fU);
-  val = (val & 0x00ff00ff00ff00ffU) + ((val >>  8) & 0x00ff00ff00ff00ffU);
-  val = (val & 0x0000ffff0000ffffU) + ((val >> 16) & 0x0000ffff0000ffffU);
-  val = (val & 0x00000000ffffffffU) + ((val >> 32) & 0x00000000ffffffffU);
-  return val;
+  return __builtin_popcountll(val);
 }
 
 static inline int ctz(uint64_t val)
 {
-  if (!val)
-    return 0;
-
-  int res = 0;
-
-  if ((val << 32) == 0) res += 32, val >>= 32;
-  if ((val << 48) == 0) res += 16, val >>= 16;
-  if ((val << 56) == 0) res += 8, val >>= 8;
-  if ((val << 60) == 0) res += 4, val >>= 4;
-  if ((val << 62) == 0) res += 2, val >>= 2;
-  if ((val << 63) == 0) res += 1, val >>= 1;
-
-  return res;
+  return val ? __builtin_ctzll(val) : 0;
 }
 
 static inline int clz(uint64_t val)
 {
-  if (!val)
-    return 0;
-
-  int res = 0;
-
-  if ((val >> 32) == 0) res += 32, val <<= 32;
-  if ((val >> 48) == 0) res += 16, val <<= 16;
-  if ((val >> 56) == 0) res += 8, val <<= 8;
-  if ((val >> 60) == 0) res += 4, val <<= 4;
-  if ((val >> 62) == 0) res += 2, val <<= 2;
-  if ((val >> 63) == 0) res += 1, val <<= 1;
-
-  return res;
+  return val ? __builtin_clzll(val) : 0;
 }
 
 // Count number of contiguous 1 bits starting from the LSB.
 static inline int cto(uint64_t val)
 {
-  int res = 0;
-  while ((val & 1) == 1)
-    val >>= 1, res++;
-  return res;
+  return ~val ? __builtin_ctzll(~val) : 64;
 }
 
 static inline int log2(uint64_t val)
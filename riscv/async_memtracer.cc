@@ -0,0 +1,143 @@
+// See LICENSE for license details.
+
+#include "async_memtracer.h"
+#include <stdexcept>
+
+memtrace_ring_t::memtrace_ring_t(async_memtracer_t* owner, size_t consumers, unsigned type_mask)
+  : owner(owner), type_mask(type_mask), ring(SIZE), head(0), published_head(0), tail(0),
+    published(0), tails(new std::atomic<uint64_t>[consumers])
+{
+  for (size_t i = 0; i < consumers; i++)
+    tails[i] = 0;
+}
+
+uint64_t memtrace_ring_t::min_tail() const
+{
+  uint64_t res = head;
+  for (size_t i = 0; i < owner->consumers.size(); i++)
+    res = std::min(res, tails[i].load());
+  return res;
+}
+
+void memtrace_ring_t::publish()
+{
+  published_head = head;
+  published = head;
+  if (owner->waiting_consumers) {
+    std::lock_guard<std::mutex> guard(owner->lock);
+    owner->data_cv.notify_all();
+  }
+}
+
+void memtrace_ring_t::wait_for_space(uint64_t until)
+{
+  publish();
+  tail = min_tail();
+  if (tail >= until)
+    return;
+
+  std::unique_lock<std::mutex> guard(owner->lock);
+  owner->waiting_producers++;
+  owner->space_cv.wait(guard, [&]{ return (tail = min_tail()) >= until; });
+  owner->waiting_producers--;
+}
+
+async_memtracer_t::~async_memtracer_t()
+{
+  drain();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stop = true;
+  }
+  data_cv.notify_all();
+  for (auto& c : consumers)
+    c->thread.join();
+}
+
+void async_memtracer_t::add_consumer(const std::vector<memtracer_t*>& tracers)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (!rings.empty())
+    throw std::runtime_error("async_memtracer_t: consumers must be added before attaching");
+
+  consumers.emplace_back(new consumer_t);
+  for (auto t : tracers)
+    consumers.back()->tracers.hook(t);
+  consumers.back()->thread = std::thread(&async_memtracer_t::consume, this, consumers.back().get(),
+                                        consumers.size() - 1);
+}
+
+memtrace_ring_t* async_memtracer_t::attach()
+{
+  unsigned type_mask = 0;
+  for (auto& c : consumers)
+    for (access_type type : {LOAD, STORE, FETCH})
+      if (c->tracers.interested_in_range(0, UINT64_MAX, type))
+        type_mask |= 1 << type;
+
+  std::lock_guard<std::mutex> guard(lock);
+  rings.emplace_back(new memtrace_ring_t(this, consumers.size(), type_mask));
+  return rings.back().get();
+}
+
+void async_memtracer_t::drain()
+{
+  std::vector<memtrace_ring_t*> to_drain;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto& r : rings)
+      to_drain.push_back(r.get());
+  }
+  for (auto r : to_drain)
+    r->wait_for_space(r->head);
+}
+
+bool async_memtracer_t::pending(size_t id)
+{
+  for (auto& r : rings)
+    if (r->tails[id] != r->published)
+      return true;
+  return false;
+}
+
+void async_memtracer_t::consume(consumer_t* consumer, size_t id)
+{
+  memtracer_list_t& tracers = consumer->tracers;
+  std::vector<memtrace_ring_t*> local;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      waiting_consumers++;
+      data_cv.wait(guard, [&]{ return stop || pending(id); });
+      waiting_consumers--;
+      if (stop && !pending(id))
+        return;
+      local.clear();
+      for (auto& r : rings)
+        local.push_back(r.get());
+    }
+
+    for (auto r : local) {
+      uint64_t t = r->tails[id];
+      uint64_t h = r->published;
+      for (; t != h; t++) {
+        const memtrace_ring_t::record_t& rec = r->ring[t % memtrace_ring_t::SIZE];
+        access_type type = access_type(rec.type);
+        if (rec.op & memtrace_ring_t::CLEAN_INVAL) {
+          if (tracers.interested_in_range(rec.addr, rec.addr + rec.bytes, LOAD))
+            tracers.clean_invalidate(rec.addr, rec.bytes, rec.op & memtrace_ring_t::CLEAN,
+                                     rec.op & memtrace_ring_t::INVAL);
+        } else if (tracers.interested_in_range(rec.addr, rec.addr + rec.bytes, type)) {
+          tracers.trace(rec.addr, rec.bytes, type);
+        }
+      }
+      r->tails[id] = t;
+    }
+
+    if (waiting_producers) {
+      std::lock_guard<std::mutex> guard(lock);
+      space_cv.notify_all();
+    }
+  }
+}
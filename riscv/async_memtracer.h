@@ -0,0 +1,124 @@
+// See LICENSE for license details.
+#ifndef _RISCV_ASYNC_MEMTRACER_H
+#define _RISCV_ASYNC_MEMTRACER_H
+
+#include "memtracer.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class async_memtracer_t;
+
+// One MMU's accesses on their way to an async_memtracer_t. Only the hart
+// owning the MMU appends, without locking; records are published to the
+// consumer threads a batch at a time, and the producer blocks only when the
+// slowest consumer is a whole ring behind.
+class memtrace_ring_t
+{
+ public:
+  static const size_t SIZE = 1 << 16;
+  static const size_t BATCH = 1 << 12;
+
+  bool wants(access_type type) const { return type_mask & (1 << type); }
+
+  void trace(uint64_t addr, size_t bytes, access_type type)
+  {
+    if (wants(type))
+      append(addr, bytes, type, 0);
+  }
+
+  void clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval)
+  {
+    append(addr, bytes, LOAD, CLEAN_INVAL | (clean ? CLEAN : 0) | (inval ? INVAL : 0));
+  }
+
+  // Makes everything appended so far visible to the consumers.
+  void publish();
+
+ private:
+  friend class async_memtracer_t;
+
+  struct record_t {
+    uint64_t addr;
+    uint32_t bytes;
+    uint8_t type;
+    uint8_t op;
+  };
+  static const uint8_t CLEAN_INVAL = 1;
+  static const uint8_t CLEAN = 2;
+  static const uint8_t INVAL = 4;
+
+  memtrace_ring_t(async_memtracer_t* owner, size_t consumers, unsigned type_mask);
+
+  void append(uint64_t addr, size_t bytes, access_type type, uint8_t op)
+  {
+    if (head - tail == SIZE)
+      wait_for_space(head - SIZE + 1);
+    ring[head % SIZE] = {addr, uint32_t(bytes), uint8_t(type), op};
+    if (++head - published_head >= BATCH)
+      publish();
+  }
+  void wait_for_space(uint64_t until);
+  uint64_t min_tail() const;
+
+  async_memtracer_t* owner;
+  unsigned type_mask;
+  std::vector<record_t> ring;
+  uint64_t head;              // producer's: records appended
+  uint64_t published_head;    // producer's: last value published
+  uint64_t tail;              // producer's: min_tail() when last read
+  std::atomic<uint64_t> published;
+  std::unique_ptr<std::atomic<uint64_t>[]> tails;  // per consumer
+};
+
+// Replays the accesses of the MMUs attached to it through memtracer_t
+// models (typically cache_memtracer_t) on consumer threads, so that the
+// simulation only pays for appending to a ring. Every consumer sees every
+// access, in order per MMU; models that share state, such as an L1 pair
+// with a common miss handler, must be given to the same consumer.
+//
+// The models must not be used by anything else while attached, and their
+// statistics are only complete after drain().
+class async_memtracer_t
+{
+ public:
+  async_memtracer_t() : waiting_consumers(0), waiting_producers(0), stop(false) {}
+  ~async_memtracer_t();
+
+  // Starts a thread replaying the trace through tracers. Throws
+  // std::runtime_error once an MMU has been attached.
+  void add_consumer(const std::vector<memtracer_t*>& tracers);
+
+  // Returns the ring for a new producer (one MMU).
+  memtrace_ring_t* attach();
+
+  // Returns once the consumers have replayed everything appended so far.
+  // Must not race with the producers.
+  void drain();
+
+ private:
+  friend class memtrace_ring_t;
+
+  struct consumer_t {
+    memtracer_list_t tracers;
+    std::thread thread;
+  };
+
+  void consume(consumer_t* consumer, size_t id);
+  bool pending(size_t id);
+
+  std::vector<std::unique_ptr<consumer_t>> consumers;
+  std::vector<std::unique_ptr<memtrace_ring_t>> rings;
+  std::mutex lock;
+  std::condition_variable data_cv;
+  std::condition_variable space_cv;
+  std::atomic<unsigned> waiting_consumers;
+  std::atomic<unsigned> waiting_producers;
+  bool stop;
+};
+
+#endif
@@ -0,0 +1,60 @@
+// See LICENSE for license details.
+
+#include "bbv.h"
+#include "processor.h"
+#include "mmu.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+bbv_profiler_t::bbv_profiler_t(processor_t* proc, const char* path, uint64_t interval)
+  : proc(proc), out(fopen(path, "w"), &fclose), interval(interval), pending(0)
+{
+  if (!out) {
+    std::ostringstream oss;
+    oss << "Failed to open basic-block vector file `" << path << "': "
+        << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+
+  mmu_t* mmu = proc->get_mmu();
+  if (!mmu->block_cache_enabled())
+    mmu->configure_block_cache(mmu_t::DEFAULT_BLOCK_CACHE_ENTRIES);
+  mmu->set_block_profiling(true);
+  proc->set_bbv_profiler(this);
+}
+
+bbv_profiler_t::~bbv_profiler_t()
+{
+  proc->set_bbv_profiler(nullptr);
+  if (pending)
+    emit();
+  proc->get_mmu()->set_block_profiling(false);
+}
+
+void bbv_profiler_t::retired(uint64_t insns)
+{
+  // Intervals end on step() boundaries, so each is at most one step long;
+  // the excess counts towards the next one.
+  pending += insns;
+  if (pending < interval)
+    return;
+  pending -= interval;
+  emit();
+}
+
+void bbv_profiler_t::emit()
+{
+  proc->get_mmu()->take_block_counts(counts);
+  fputc('T', out.get());
+  for (auto& [pc, n] : counts) {
+    if (!n)
+      continue;
+    auto id = ids.emplace(pc, ids.size() + 1).first->second;
+    fprintf(out.get(), ":%" PRIu64 ":%" PRIu64 " ", id, n);
+    n = 0;
+  }
+  fputc('\n', out.get());
+}
@@ -0,0 +1,38 @@
+// See LICENSE for license details.
+#ifndef _RISCV_BBV_H
+#define _RISCV_BBV_H
+
+#include "decode.h"
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+
+class processor_t;
+
+// SimPoint basic-block vectors of one hart. Every interval retired
+// instructions, a line "T:<id>:<count> :<id>:<count> ..." is written, where
+// id (from 1, in order of first execution) stands for the pc a block of the
+// block cache starts at, and count is the instructions retired through it
+// during the interval. The block cache is turned on if it was off; blocks
+// end at jumps, so they can span several SimPoint basic blocks, which only
+// coarsens the vectors. Instructions run outside the fast loop (-l,
+// --log-commits, -g) are not attributed to blocks.
+class bbv_profiler_t {
+ public:
+  // Throws std::runtime_error if path cannot be opened.
+  bbv_profiler_t(processor_t* proc, const char* path, uint64_t interval);
+  ~bbv_profiler_t();  // writes the final, partial interval
+  void retired(uint64_t insns);
+
+ private:
+  void emit();
+
+  processor_t* proc;
+  std::unique_ptr<FILE, int(*)(FILE*)> out;
+  uint64_t interval;
+  uint64_t pending;
+  std::unordered_map<reg_t, uint64_t> counts;
+  std::unordered_map<reg_t, uint64_t> ids;
+};
+
+#endif
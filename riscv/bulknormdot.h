@@ -2,7 +2,7 @@
 #define _RISCV_BULKNORMDOT_H
 
 #include <cstdint>
-#include <vector>
+#include <algorithm>
 #include "softfloat.h"
 
 struct bulk_norm_out_t {
@@ -170,20 +170,18 @@ class ofp8_e4m3 final : public IEEEFloatFormat<uint8_t, uint8_t, uint8_t, 4, 3>
 
 /** bulk-normalization dot product (without accumulation) with binary32 result
  *
- * The actual products of significands is provided as an argument such that the model can be used
- * to match against RTL implementations with external product implementation.
+ * Operands are read through accessors (get_a(i), get_b(i) and get_prod_sig(i)) so that
+ * callers can feed raw register contents without building temporary arrays. The
+ * per-product exponents are recomputed in the accumulation pass rather than stored.
  *
  * @param cfg dot-product configuration
- * @param a left-hand-side operand array
- * @param b right-hand-side operand array
- * @param prod_signs array of products of significands
+ * @param get_a left-hand-side operand accessor
+ * @param get_b right-hand-side operand accessor
+ * @param get_prod_sig accessor for the products of significands
  *
  */
-template<typename ValueTypeLHS, typename ValueTypeRHS, typename SigProdType> bulk_norm_out_t bulk_norm_dot_no_mult(const DotConfig cfg, const ValueTypeLHS* a, const ValueTypeRHS* b, const SigProdType* prod_sigs)
+template<typename GetLHS, typename GetRHS, typename GetProdSig> bulk_norm_out_t bulk_norm_dot_impl(const DotConfig cfg, GetLHS get_a, GetRHS get_b, GetProdSig get_prod_sig)
 {
-  std::vector<int> approx_prod_exp(cfg.n);
-  std::vector<int> flushed_prods(cfg.n);
-
   bool any_pos_inf     = false;
   bool any_neg_inf     = false;
   bool any_nan         = false;
@@ -191,35 +189,40 @@ template<typename ValueTypeLHS, typename ValueTypeRHS, typename SigProdType> bul
   bool any_sigNan      = false;
 
   // extracting format parameters from the first element in each input arrays
-  int lhs_bias = a[0].bias;
-  int rhs_bias = b[0].bias;
+  int lhs_bias = get_a(0).bias;
+  int rhs_bias = get_b(0).bias;
+
+  int lhs_mant_bits = get_a(0).mant_bits;
+  int rhs_mant_bits = get_b(0).mant_bits;
 
-  int lhs_mant_bits = a[0].mant_bits;
-  int rhs_mant_bits = b[0].mant_bits;
+  auto flushed_prod = [&](const auto& a, const auto& b) {
+    return cfg.flushSub && (a.subOrZero() || b.subOrZero());
+  };
+  auto approx_prod_exp = [&](const auto& a, const auto& b) {
+    return flushed_prod(a, b) ? 0 : // flush input subnormals
+           a.isZero() || b.isZero() ? (f32_exp_bias - (lhs_bias + rhs_bias)) : // minimalize exp of zero product
+           a.expSubFixed() + b.expSubFixed() + (f32_exp_bias - (lhs_bias + rhs_bias));
+  };
 
+  // find largest exponent
+  int max_approx_prod_exp = 0;
   for (int i = 0; i < cfg.n; i++) {
-    flushed_prods[i] = (cfg.flushSub && (a[i].subOrZero() || b[i].subOrZero()));
-    approx_prod_exp[i] = flushed_prods[i] ? 0 : // flush input subnormals
-                         a[i].isZero() || b[i].isZero() ? (f32_exp_bias - (lhs_bias + rhs_bias)) : // minimalize exp of zero product
-                         a[i].expSubFixed() + b[i].expSubFixed() + (f32_exp_bias - (lhs_bias + rhs_bias));
+    const auto a = get_a(i);
+    const auto b = get_b(i);
+    int prod_exp = approx_prod_exp(a, b);
+    max_approx_prod_exp = i == 0 ? prod_exp : std::max(max_approx_prod_exp, prod_exp);
 
-    bool either_inf = a[i].inf() || b[i].inf();
-    any_pos_inf |= either_inf && a[i].sign() == b[i].sign();
-    any_neg_inf |= either_inf && a[i].sign() != b[i].sign();
+    bool either_inf = a.inf() || b.inf();
+    any_pos_inf |= either_inf && a.sign() == b.sign();
+    any_neg_inf |= either_inf && a.sign() != b.sign();
 
     any_invalid_nan |=
-      (a[i].inf() && ((b[i].subOrZero() && cfg.flushSub) || b[i].isZero())) ||
-      (b[i].inf() && ((a[i].subOrZero() && cfg.flushSub) || a[i].isZero()));
+      (a.inf() && ((b.subOrZero() && cfg.flushSub) || b.isZero())) ||
+      (b.inf() && ((a.subOrZero() && cfg.flushSub) || a.isZero()));
 
-    any_nan |= any_invalid_nan || a[i].nan() || b[i].nan();
+    any_nan |= any_invalid_nan || a.nan() || b.nan();
 
-    any_sigNan |= a[i].sigNan() || b[i].sigNan();
-  }
-
-  // find largest exponent
-  int max_approx_prod_exp = approx_prod_exp[0];
-  for (int i = 1; i < cfg.n; i++) {
-    max_approx_prod_exp = std::max(max_approx_prod_exp, approx_prod_exp[i]);
+    any_sigNan |= a.sigNan() || b.sigNan();
   }
 
   bool acc_sign = false; // assuming the accumulator is positive
@@ -228,15 +231,19 @@ template<typename ValueTypeLHS, typename ValueTypeRHS, typename SigProdType> bul
 
   // compute products, normalize to largest exponent, accumulate
   for (int i = 0; i < cfg.n; i++) {
-    int prod_sign = a[i].sign() ^ b[i].sign();
-    uint64_t prod_sig = uint64_t(prod_sigs[i]); // 16 to 64-bit zero extension
+    const auto a = get_a(i);
+    const auto b = get_b(i);
+    if (flushed_prod(a, b))
+      continue; // flush input subnormals
+
+    int prod_sign = a.sign() ^ b.sign();
+    uint64_t prod_sig = uint64_t(get_prod_sig(i)); // 16 to 64-bit zero extension
     // align the product so the width of its fractional part is: f32_mant_bits(23) + guardBits
     prod_sig <<= f32_mant_bits - lhs_mant_bits - rhs_mant_bits + cfg.guardBits;
 
-    int shiftAmt = max_approx_prod_exp - approx_prod_exp[i];
+    int shiftAmt = max_approx_prod_exp - approx_prod_exp(a, b);
     uint64_t shifted_sig = shift_right_jam(prod_sig, shiftAmt);
-    acc += flushed_prods[i]? 0 : // flush input subnormals
-      (prod_sign != acc_sign ? -shifted_sig : shifted_sig);
+    acc += prod_sign != acc_sign ? -shifted_sig : shifted_sig;
   }
 
   // normalize result to f32
@@ -298,31 +305,43 @@ template<typename ValueTypeLHS, typename ValueTypeRHS, typename SigProdType> bul
   return su;
 }
 
+/** bulk-normalization dot product (without accumulation) with binary32 result
+ *
+ * The actual products of significands is provided as an argument such that the model can be used
+ * to match against RTL implementations with external product implementation.
+ *
+ * @param cfg dot-product configuration
+ * @param a left-hand-side operand array
+ * @param b right-hand-side operand array
+ * @param prod_signs array of products of significands
+ *
+ */
+template<typename ValueTypeLHS, typename ValueTypeRHS, typename SigProdType> bulk_norm_out_t bulk_norm_dot_no_mult(const DotConfig cfg, const ValueTypeLHS* a, const ValueTypeRHS* b, const SigProdType* prod_sigs)
+{
+  return bulk_norm_dot_impl(cfg, [=](int i) { return a[i]; }, [=](int i) { return b[i]; },
+                            [=](int i) { return prod_sigs[i]; });
+}
+
 /** bf16_t dot product (without accumulation) */
 static inline bulk_norm_out_t bulk_norm_dot_bf16(const DotConfig cfg, const bf16_t* a, const bf16_t* b)
 {
-  // product are extracted so that the no-mult version can be more easily matched against the RTL implementation
-  std::vector<uint16_t> prod_sigs(cfg.n);
-
-  // compute products, normalize to largest exponent, accumulate
-  for (int i = 0; i < cfg.n; i++) {
-    prod_sigs[i] = a[i].sig() * (uint16_t) b[i].sig();
-  }
-
-  return bulk_norm_dot_no_mult<bf16_t, bf16_t, uint16_t>(cfg, a, b, &prod_sigs[0]);
+  return bulk_norm_dot_impl(cfg, [=](int i) { return a[i]; }, [=](int i) { return b[i]; },
+                            [=](int i) { return uint16_t(a[i].sig() * (uint16_t) b[i].sig()); });
 }
 
 template <typename L, typename R>
 bulk_norm_out_t bulk_norm_dot_ofp8(const DotConfig cfg, const L* a, const R* b)
 {
-  // products are extracted so that the no-mult version can be more easily matched against the RTL implementation
-  std::vector<uint16_t> prod_sigs(cfg.n);
+  return bulk_norm_dot_impl(cfg, [=](int i) { return a[i]; }, [=](int i) { return b[i]; },
+                            [=](int i) { return uint16_t(a[i].sig() * (uint16_t) b[i].sig()); });
+}
 
-  // compute products, normalize to largest exponent, accumulate
-  for (int i = 0; i < cfg.n; i++) {
-    prod_sigs[i] = a[i].sig() * (uint16_t) b[i].sig();
-  }
-  return bulk_norm_dot_no_mult<L, R, uint16_t>(cfg, a, b, &prod_sigs[0]);
+/** dot product (without accumulation) of raw encodings, e.g. straight from a vector register */
+template <typename L, typename R, typename U>
+bulk_norm_out_t bulk_norm_dot_raw(const DotConfig cfg, const U* a, const U* b)
+{
+  return bulk_norm_dot_impl(cfg, [=](int i) { return L(a[i]); }, [=](int i) { return R(b[i]); },
+                            [=](int i) { return uint16_t(L(a[i]).sig() * (uint16_t) R(b[i]).sig()); });
 }
 
 #endif
@@ -0,0 +1,53 @@
+// See LICENSE for license details.
+
+#include "cache_sampler.h"
+#include "cachesim.h"
+#include "processor.h"
+#include "mmu.h"
+
+cache_sampler_t::cache_sampler_t(const std::vector<cache_memtracer_t*>& tracers,
+                                 uint64_t period, uint64_t window)
+  : tracers(tracers), period(period), window(window), pos(0), total(0), traced(0),
+    tracing(true)
+{
+}
+
+cache_sampler_t::~cache_sampler_t()
+{
+  for (auto proc : procs)
+    proc->set_cache_sampler(nullptr);
+  set_tracing(true);
+}
+
+void cache_sampler_t::attach(processor_t* proc)
+{
+  procs.push_back(proc);
+  proc->set_cache_sampler(this);
+}
+
+void cache_sampler_t::retired(uint64_t insns)
+{
+  total += insns;
+  if (tracing)
+    traced += insns;
+
+  pos += insns;
+  if (tracing && pos >= window)
+    set_tracing(false);
+  if (pos >= period) {
+    pos %= period;
+    set_tracing(true);
+  }
+}
+
+void cache_sampler_t::set_tracing(bool on)
+{
+  if (on == tracing)
+    return;
+  tracing = on;
+  for (auto t : tracers)
+    t->set_enabled(on);
+  // TLB entries and the icache remember whether the tracers were interested
+  for (auto proc : procs)
+    proc->get_mmu()->flush_tlb();
+}
@@ -0,0 +1,41 @@
+// See LICENSE for license details.
+#ifndef _RISCV_CACHE_SAMPLER_H
+#define _RISCV_CACHE_SAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+class processor_t;
+class cache_memtracer_t;
+
+// Time sampling of cache models: the tracers see the accesses of window
+// out of every period instructions retired by the attached harts, starting
+// with a window, and stay disabled in between, so that the MMUs keep their
+// fast paths. Windows open and close on step() boundaries, so they grow to
+// whole interleave quanta. The harts must not run in parallel.
+class cache_sampler_t {
+ public:
+  cache_sampler_t(const std::vector<cache_memtracer_t*>& tracers, uint64_t period, uint64_t window);
+  ~cache_sampler_t();
+
+  void attach(processor_t* proc);
+  void retired(uint64_t insns);
+
+  // Ratio of all instructions to traced ones so far, to extrapolate
+  // statistics by.
+  double scale() const { return traced ? double(total) / traced : 1; }
+
+ private:
+  void set_tracing(bool on);
+
+  std::vector<cache_memtracer_t*> tracers;
+  std::vector<processor_t*> procs;
+  uint64_t period;
+  uint64_t window;
+  uint64_t pos;       // instructions into the current period
+  uint64_t total;
+  uint64_t traced;
+  bool tracing;
+};
+
+#endif
@@ -6,8 +6,20 @@
 #include <iostream>
 #include <iomanip>
 
-cache_sim_t::cache_sim_t(size_t _sets, size_t _ways, size_t _linesz, const char* _name)
-: sets(_sets), ways(_ways), linesz(_linesz), name(_name), log(false)
+// Tags compared at once by cache_sim_t::check_tag
+#if defined(__AVX512F__)
+# define CACHE_TAG_VEC_BYTES 64
+#elif defined(__AVX2__)
+# define CACHE_TAG_VEC_BYTES 32
+#else
+# define CACHE_TAG_VEC_BYTES 16
+#endif
+typedef uint64_t tag_vec_t __attribute__((vector_size(CACHE_TAG_VEC_BYTES)));
+static const size_t TAG_VEC_WAYS = CACHE_TAG_VEC_BYTES / sizeof(uint64_t);
+
+cache_sim_t::cache_sim_t(size_t _sets, size_t _ways, size_t _linesz, const char* _name,
+                         repl_policy_t _policy)
+: policy(_policy), sets(_sets), ways(_ways), linesz(_linesz), name(_name), log(false)
 {
   init();
 }
@@ -15,9 +27,11 @@ cache_sim_t::cache_sim_t(size_t _sets, size_t _ways, size_t _linesz, const char*
 static void help()
 {
   std::cerr << "Cache configurations must be of the form" << std::endl;
-  std::cerr << "  sets:ways:blocksize" << std::endl;
+  std::cerr << "  sets:ways:blocksize[:policy]" << std::endl;
   std::cerr << "where sets, ways, and blocksize are positive integers, with" << std::endl;
-  std::cerr << "sets and blocksize both powers of two and blocksize at least 8." << std::endl;
+  std::cerr << "sets and blocksize both powers of two and blocksize at least 8," << std::endl;
+  std::cerr << "and policy is random (the default), lru, plru or srrip. plru" << std::endl;
+  std::cerr << "needs ways to be a power of two, at most 64, and lru at most 256 ways." << std::endl;
   exit(1);
 }
 
@@ -27,14 +41,24 @@ cache_sim_t* cache_sim_t::construct(const char* config, const char* name)
   if (!wp++) help();
   const char* bp = strchr(wp, ':');
   if (!bp++) help();
+  const char* pp = strchr(bp, ':');
 
   size_t sets = atoi(std::string(config, wp).c_str());
   size_t ways = atoi(std::string(wp, bp).c_str());
   size_t linesz = atoi(bp);
 
-  if (ways > 4 /* empirical */ && sets == 1)
+  repl_policy_t policy = REPL_RANDOM;
+  if (pp++) {
+    std::string p(pp);
+    if (p == "lru") policy = REPL_LRU;
+    else if (p == "plru") policy = REPL_PLRU;
+    else if (p == "srrip") policy = REPL_SRRIP;
+    else if (p != "random") help();
+  }
+
+  if (ways > 4 /* empirical */ && sets == 1 && policy == REPL_RANDOM)
     return new fa_cache_sim_t(ways, linesz, name);
-  return new cache_sim_t(sets, ways, linesz, name);
+  return new cache_sim_t(sets, ways, linesz, name, policy);
 }
 
 void cache_sim_t::init()
@@ -43,12 +67,18 @@ void cache_sim_t::init()
     help();
   if (linesz < 8 || (linesz & (linesz-1)))
     help();
+  if (ways == 0 || (policy == REPL_PLRU && (ways > 64 || (ways & (ways-1)))) ||
+      (policy == REPL_LRU && ways > 256))
+    help();
 
   idx_shift = 0;
   for (size_t x = linesz; x>1; x >>= 1)
     idx_shift++;
 
-  tags = new uint64_t[sets*ways]();
+  // sets too narrow for a vector are scanned one way at a time
+  way_stride = ways < TAG_VEC_WAYS ? ways : (ways + TAG_VEC_WAYS - 1) / TAG_VEC_WAYS * TAG_VEC_WAYS;
+  tags.assign(sets*way_stride, 0);
+  state.assign(sets*way_stride, 0);
   read_accesses = 0;
   read_misses = 0;
   bytes_read = 0;
@@ -56,22 +86,46 @@ void cache_sim_t::init()
   write_misses = 0;
   bytes_written = 0;
   writebacks = 0;
+  upgrades = 0;
+  invalidations = 0;
+  interventions = 0;
+  sample_mask = 0;
+  stat_scale = 1;
 
   miss_handler = NULL;
+  miss_tracer = NULL;
+  bus = NULL;
+
+  if (policy == REPL_LRU || policy == REPL_SRRIP) {
+    repl.resize(sets*ways);
+    for (size_t i = 0; i < sets*ways; i++)
+      repl[i] = policy == REPL_LRU ? i % ways : 3;
+  }
+  if (policy == REPL_PLRU)
+    plru.resize(sets);
 }
 
 cache_sim_t::cache_sim_t(const cache_sim_t& rhs)
- : sets(rhs.sets), ways(rhs.ways), linesz(rhs.linesz),
-   idx_shift(rhs.idx_shift), name(rhs.name), log(false)
+ : miss_handler(NULL), miss_tracer(NULL), bus(NULL), policy(rhs.policy), repl(rhs.repl), plru(rhs.plru),
+   sets(rhs.sets), ways(rhs.ways), way_stride(rhs.way_stride), linesz(rhs.linesz),
+   idx_shift(rhs.idx_shift), tags(rhs.tags), state(rhs.state), sample_mask(rhs.sample_mask),
+   stat_scale(rhs.stat_scale), name(rhs.name), log(false)
 {
-  tags = new uint64_t[sets*ways];
-  memcpy(tags, rhs.tags, sets*ways*sizeof(uint64_t));
 }
 
 cache_sim_t::~cache_sim_t()
 {
   print_stats();
-  delete [] tags;
+}
+
+void cache_sim_t::sample_sets(size_t ratio)
+{
+  if (ratio == 0 || (ratio & (ratio-1)) || sets % ratio) {
+    std::cerr << name << ": set sampling ratio must be a power of two at most " << sets << std::endl;
+    exit(1);
+  }
+  sample_mask = ratio - 1;
+  stat_scale *= ratio;
 }
 
 void cache_sim_t::print_stats()
@@ -95,39 +149,193 @@ void cache_sim_t::print_stats()
   std::cout << "Writebacks:            " << writebacks << std::endl;
   std::cout << name << " ";
   std::cout << "Miss Rate:             " << mr << '%' << std::endl;
+  if (bus) {
+    std::cout << name << " ";
+    std::cout << "Upgrades:              " << upgrades << std::endl;
+    std::cout << name << " ";
+    std::cout << "Invalidations:         " << invalidations << std::endl;
+    std::cout << name << " ";
+    std::cout << "Interventions:         " << interventions << std::endl;
+  }
+  if (stat_scale != 1) {
+    std::cout << name << " ";
+    std::cout << "Sample Scale:          " << stat_scale << std::endl;
+    std::cout << name << " ";
+    std::cout << "Est. Read Accesses:    " << uint64_t(read_accesses * stat_scale) << std::endl;
+    std::cout << name << " ";
+    std::cout << "Est. Write Accesses:   " << uint64_t(write_accesses * stat_scale) << std::endl;
+    std::cout << name << " ";
+    std::cout << "Est. Read Misses:      " << uint64_t(read_misses * stat_scale) << std::endl;
+    std::cout << name << " ";
+    std::cout << "Est. Write Misses:     " << uint64_t(write_misses * stat_scale) << std::endl;
+    std::cout << name << " ";
+    std::cout << "Est. Writebacks:       " << uint64_t(writebacks * stat_scale) << std::endl;
+  }
 }
 
-uint64_t* cache_sim_t::check_tag(uint64_t addr)
+size_t cache_sim_t::check_tag(uint64_t addr)
 {
   size_t idx = (addr >> idx_shift) & (sets-1);
-  size_t tag = (addr >> idx_shift) | VALID;
+  uint64_t tag = (addr >> idx_shift) | VALID;
+  const uint64_t* set = &tags[idx*way_stride];
+
+  if (ways < TAG_VEC_WAYS) {
+    for (size_t i = 0; i < ways; i++)
+      if (set[i] == tag)
+        return idx*way_stride + i;
+    return NO_LINE;
+  }
+
+  for (size_t way = 0; way < way_stride; way += TAG_VEC_WAYS) {
+    tag_vec_t v;
+    memcpy(&v, set + way, sizeof(v));
+    tag_vec_t eq = v == tag;
+    uint64_t any = 0;
+    for (size_t i = 0; i < TAG_VEC_WAYS; i++)
+      any |= eq[i];
+    if (unlikely(any)) {
+      for (size_t i = 0; ; i++)
+        if (eq[i])
+          return idx*way_stride + way + i;
+    }
+  }
+  return NO_LINE;
+}
+
+void cache_sim_t::invalidate(size_t line)
+{
+  tags[line] = 0;
+  state[line] = 0;
+}
+
+void cache_sim_t::touch(size_t idx, size_t way, bool fill)
+{
+  switch (policy) {
+    case REPL_RANDOM:
+      break;
+    case REPL_LRU: {
+      uint8_t* rank = &repl[idx*ways];
+      for (size_t i = 0; i < ways; i++)
+        rank[i] += rank[i] < rank[way];
+      rank[way] = 0;
+      break;
+    }
+    case REPL_PLRU: {
+      // point every node on the path away from way
+      size_t node = 1;
+      for (size_t half = ways / 2; half; half /= 2) {
+        bool right = way & half;
+        plru[idx] = (plru[idx] & ~(1ULL << node)) | (uint64_t(!right) << node);
+        node = 2*node + right;
+      }
+      break;
+    }
+    case REPL_SRRIP:
+      repl[idx*ways + way] = fill ? 2 : 0;
+      break;
+  }
+}
+
+size_t cache_sim_t::pick_victim(size_t idx)
+{
+  if (policy == REPL_RANDOM)
+    return lfsr.next() % ways;
 
   for (size_t i = 0; i < ways; i++)
-    if (tag == (tags[idx*ways + i] & ~DIRTY))
-      return &tags[idx*ways + i];
+    if (!tags[idx*way_stride + i])
+      return i;
 
-  return NULL;
+  switch (policy) {
+    case REPL_LRU:
+      for (size_t i = 0; i < ways; i++)
+        if (repl[idx*ways + i] == ways - 1)
+          return i;
+      break;
+    case REPL_PLRU: {
+      size_t node = 1;
+      while (node < ways)
+        node = 2*node + ((plru[idx] >> node) & 1);
+      return node - ways;
+    }
+    case REPL_SRRIP: {
+      uint8_t* rrpv = &repl[idx*ways];
+      while (true) {
+        for (size_t i = 0; i < ways; i++)
+          if (rrpv[i] == 3)
+            return i;
+        for (size_t i = 0; i < ways; i++)
+          rrpv[i]++;
+      }
+    }
+    default:
+      break;
+  }
+  abort();
 }
 
-uint64_t cache_sim_t::victimize(uint64_t addr)
+size_t cache_sim_t::victimize(uint64_t addr, uint64_t& victim, uint8_t& victim_state)
 {
   size_t idx = (addr >> idx_shift) & (sets-1);
-  size_t way = lfsr.next() % ways;
-  uint64_t victim = tags[idx*ways + way];
-  tags[idx*ways + way] = (addr >> idx_shift) | VALID;
-  return victim;
+  size_t way = pick_victim(idx);
+  size_t line = idx*way_stride + way;
+  victim = tags[line];
+  victim_state = state[line];
+  tags[line] = (addr >> idx_shift) | VALID;
+  state[line] = 0;
+  touch(idx, way, true);
+  return line;
+}
+
+void cache_sim_t::writeback(uint64_t tag)
+{
+  uint64_t dirty_addr = (tag & ~VALID) << idx_shift;
+  if (miss_handler)
+    miss_handler->access(dirty_addr, linesz, true);
+  else if (miss_tracer)
+    miss_tracer->trace(dirty_addr, linesz, STORE);
+  writebacks++;
+}
+
+bool cache_sim_t::snoop(uint64_t addr, bool exclusive)
+{
+  size_t line = check_tag(addr);
+  if (line == NO_LINE)
+    return false;
+
+  if (state[line] & DIRTY) {
+    writeback(tags[line]);
+    interventions++;
+  }
+  if (exclusive) {
+    invalidate(line);
+    invalidations++;
+  } else {
+    state[line] = SHARED;
+  }
+  return true;
 }
 
 void cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
 {
+  if (unlikely((addr >> idx_shift) & sample_mask))
+    return;
+
   store ? write_accesses++ : read_accesses++;
   (store ? bytes_written : bytes_read) += bytes;
 
-  uint64_t* hit_way = check_tag(addr);
-  if (likely(hit_way != NULL))
+  size_t line = check_tag(addr);
+  if (likely(line != NO_LINE))
   {
+    if (policy != REPL_RANDOM) {
+      size_t idx = (addr >> idx_shift) & (sets-1);
+      touch(idx, line - idx*way_stride, false);
+    }
+    if (store && bus && (state[line] & SHARED)) {
+      upgrades++;
+      bus->request(this, addr, true);
+    }
     if (store)
-      *hit_way |= DIRTY;
+      state[line] = DIRTY;
     return;
   }
 
@@ -139,21 +347,21 @@ void cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
               << std::hex << addr << std::endl;
   }
 
-  uint64_t victim = victimize(addr);
+  uint64_t victim;
+  uint8_t victim_state;
+  line = victimize(addr, victim, victim_state);
 
-  if ((victim & (VALID | DIRTY)) == (VALID | DIRTY))
-  {
-    uint64_t dirty_addr = (victim & ~(VALID | DIRTY)) << idx_shift;
-    if (miss_handler)
-      miss_handler->access(dirty_addr, linesz, true);
-    writebacks++;
-  }
+  if ((victim & VALID) && (victim_state & DIRTY))
+    writeback(victim);
+
+  bool shared = bus && bus->request(this, addr, store);
 
   if (miss_handler)
     miss_handler->access(addr & ~(linesz-1), linesz, false);
+  else if (miss_tracer)
+    miss_tracer->trace(addr & ~(linesz-1), linesz, LOAD);
 
-  if (store)
-    *check_tag(addr) |= DIRTY;
+  state[line] = store ? DIRTY : shared ? SHARED : 0;
 }
 
 void cache_sim_t::clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval)
@@ -162,18 +370,20 @@ void cache_sim_t::clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool
   uint64_t end_addr = (addr + bytes + linesz-1) & ~(linesz-1);
   uint64_t cur_addr = start_addr;
   while (cur_addr < end_addr) {
-    uint64_t* hit_way = check_tag(cur_addr);
-    if (likely(hit_way != NULL))
+    size_t line = (cur_addr >> idx_shift) & sample_mask ? NO_LINE : check_tag(cur_addr);
+    if (likely(line != NO_LINE))
     {
       if (clean) {
-        if (*hit_way & DIRTY) {
+        if (state[line] & DIRTY) {
+          if (!miss_handler && miss_tracer)
+            miss_tracer->trace(cur_addr, linesz, STORE);
           writebacks++;
-          *hit_way &= ~DIRTY;
+          state[line] &= ~DIRTY;
         }
       }
 
       if (inval)
-        *hit_way &= ~VALID;
+        invalidate(line);
     }
     cur_addr += linesz;
   }
@@ -184,24 +394,38 @@ void cache_sim_t::clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool
 fa_cache_sim_t::fa_cache_sim_t(size_t ways, size_t linesz, const char* name)
   : cache_sim_t(1, ways, linesz, name)
 {
+  lines.reserve(ways);
+  for (size_t i = ways; i > 0; i--)
+    free_lines.push_back(i - 1);
 }
 
-uint64_t* fa_cache_sim_t::check_tag(uint64_t addr)
+size_t fa_cache_sim_t::check_tag(uint64_t addr)
 {
-  auto it = tags.find(addr >> idx_shift);
-  return it == tags.end() ? NULL : &it->second;
+  auto it = lines.find(addr >> idx_shift);
+  return it == lines.end() ? NO_LINE : it->second;
 }
 
-uint64_t fa_cache_sim_t::victimize(uint64_t addr)
+size_t fa_cache_sim_t::victimize(uint64_t addr, uint64_t& victim, uint8_t& victim_state)
 {
-  uint64_t old_tag = 0;
-  if (tags.size() == ways)
-  {
-    auto it = tags.begin();
-    std::advance(it, lfsr.next() % ways);
-    old_tag = it->second;
-    tags.erase(it);
+  size_t line;
+  if (!free_lines.empty()) {
+    line = free_lines.back();
+    free_lines.pop_back();
+  } else {
+    line = lfsr.next() % ways;
+    lines.erase(tags[line] & ~VALID);
   }
-  tags[addr >> idx_shift] = (addr >> idx_shift) | VALID;
-  return old_tag;
+  victim = tags[line];
+  victim_state = state[line];
+  tags[line] = (addr >> idx_shift) | VALID;
+  state[line] = 0;
+  lines[addr >> idx_shift] = line;
+  return line;
+}
+
+void fa_cache_sim_t::invalidate(size_t line)
+{
+  lines.erase(tags[line] & ~VALID);
+  cache_sim_t::invalidate(line);
+  free_lines.push_back(line);
 }
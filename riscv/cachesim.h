@@ -7,8 +7,9 @@
 #include "common.h"
 #include <cstring>
 #include <string>
-#include <map>
+#include <unordered_map>
 #include <cstdint>
+#include <vector>
 
 class lfsr_t
 {
@@ -20,10 +21,22 @@ class lfsr_t
   uint32_t reg;
 };
 
+// Replacement policies: random (the default, via lfsr_t), true LRU,
+// tree pseudo-LRU (power-of-2 ways, at most 64) and 2-bit SRRIP.
+enum repl_policy_t {
+  REPL_RANDOM,
+  REPL_LRU,
+  REPL_PLRU,
+  REPL_SRRIP,
+};
+
+class coherence_bus_t;
+
 class cache_sim_t
 {
  public:
-  cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name);
+  cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name,
+              repl_policy_t policy = REPL_RANDOM);
   cache_sim_t(const cache_sim_t& rhs);
   virtual ~cache_sim_t();
 
@@ -31,27 +44,68 @@ class cache_sim_t
   void clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval);
   void print_stats();
   void set_miss_handler(cache_sim_t* mh) { miss_handler = mh; }
+  // Fills (as loads) and writebacks (as stores) of a cache without a miss
+  // handler go to t, such as a DRAM trace.
+  void set_miss_tracer(memtracer_t* t) { miss_tracer = t; }
   void set_log(bool _log) { log = _log; }
 
+  // Simulates only the sets whose index is a multiple of ratio (a power of
+  // 2 dividing sets), ignoring the other accesses, and scales the printed
+  // statistics to match.
+  void sample_sets(size_t ratio);
+  // Multiplies the statistics print_stats() estimates for the whole run,
+  // for a cache seeing a sample of the accesses.
+  void scale_stats(double factor) { stat_scale *= factor; }
+
+  // Configurations are sets:ways:blocksize[:random|lru|plru|srrip].
   static cache_sim_t* construct(const char* config, const char* name);
 
  protected:
+  friend class coherence_bus_t;
+
+  // Lines are numbered set * way_stride + way. tags[] holds
+  // (addr >> idx_shift) | VALID for a valid line and 0 otherwise, so a set
+  // is matched with whole-vector compares; state[] holds the rest. A valid
+  // line is Modified if DIRTY, Shared if SHARED, else Exclusive.
   static const uint64_t VALID = 1ULL << 63;
-  static const uint64_t DIRTY = 1ULL << 62;
+  static const uint8_t DIRTY = 1;
+  static const uint8_t SHARED = 2;
+  static const size_t NO_LINE = SIZE_MAX;
+
+  // Returns the line holding addr, or NO_LINE.
+  virtual size_t check_tag(uint64_t addr);
+  // Fills a line with addr and returns it, leaving the tag and state it
+  // had in victim and victim_state.
+  virtual size_t victimize(uint64_t addr, uint64_t& victim, uint8_t& victim_state);
+  virtual void invalidate(size_t line);
 
-  virtual uint64_t* check_tag(uint64_t addr);
-  virtual uint64_t victimize(uint64_t addr);
+  // Replacement state of way in set idx, after a hit or a fill.
+  void touch(size_t idx, size_t way, bool fill);
+  size_t pick_victim(size_t idx);
+
+  // A peer on the bus wants the line at addr (exclusively, for a store);
+  // returns whether this cache held it, writing it back first if Modified.
+  bool snoop(uint64_t addr, bool exclusive);
+  void writeback(uint64_t tag);
 
   lfsr_t lfsr;
   cache_sim_t* miss_handler;
+  memtracer_t* miss_tracer;
+  coherence_bus_t* bus;
+
+  repl_policy_t policy;
+  std::vector<uint8_t> repl;    // per line: LRU rank (0 is MRU) or SRRIP RRPV
+  std::vector<uint64_t> plru;   // per set: tree bits, node n at bit n
 
   size_t sets;
   size_t ways;
+  size_t way_stride;  // ways, rounded up to whole tag vectors for wide sets
   size_t linesz;
   size_t idx_shift;
 
-  uint64_t* tags;
-  
+  std::vector<uint64_t> tags;
+  std::vector<uint8_t> state;
+
   uint64_t read_accesses;
   uint64_t read_misses;
   uint64_t bytes_read;
@@ -60,21 +114,60 @@ class cache_sim_t
   uint64_t bytes_written;
   uint64_t writebacks;
 
+  // coherence (with a bus)
+  uint64_t upgrades;          // stores to Shared lines
+  uint64_t invalidations;     // lines taken away by a peer's store
+  uint64_t interventions;     // Modified lines written back for a peer
+
+  // sampling
+  uint64_t sample_mask;       // lines (addr >> idx_shift) with these bits set are ignored
+  double stat_scale;
+
   std::string name;
   bool log;
 
   void init();
 };
 
+// Fully-associative cache with random replacement, looked up through a
+// hash of the valid tags rather than a scan.
 class fa_cache_sim_t : public cache_sim_t
 {
  public:
   fa_cache_sim_t(size_t ways, size_t linesz, const char* name);
-  uint64_t* check_tag(uint64_t addr);
-  uint64_t victimize(uint64_t addr);
+  size_t check_tag(uint64_t addr);
+  size_t victimize(uint64_t addr, uint64_t& victim, uint8_t& victim_state);
+  void invalidate(size_t line);
+ private:
+  std::unordered_map<uint64_t, size_t> lines;  // addr >> idx_shift to line
+  std::vector<size_t> free_lines;
+};
+
+// Snooping MESI-style coherence between private caches (one per hart) in
+// front of shared levels: a cache that misses or stores to a Shared line
+// asks the bus, and peers holding the line downgrade it to Shared or, for a
+// store, invalidate it, writing Modified lines back to their miss handler.
+class coherence_bus_t
+{
+ public:
+  void attach(cache_sim_t* c)
+  {
+    caches.push_back(c);
+    c->bus = this;
+  }
+
+  // Returns whether a peer of requester held the line.
+  bool request(cache_sim_t* requester, uint64_t addr, bool store)
+  {
+    bool held = false;
+    for (auto c : caches)
+      if (c != requester)
+        held |= c->snoop(addr, store);
+    return held;
+  }
+
  private:
-  static bool cmp(uint64_t a, uint64_t b);
-  std::map<uint64_t, uint64_t> tags;
+  std::vector<cache_sim_t*> caches;
 };
 
 class cache_memtracer_t : public memtracer_t
@@ -92,6 +185,10 @@ class cache_memtracer_t : public memtracer_t
   {
     cache->set_miss_handler(mh);
   }
+  void set_miss_tracer(memtracer_t* t)
+  {
+    cache->set_miss_tracer(t);
+  }
   void clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval)
   {
     cache->clean_invalidate(addr, bytes, clean, inval);
@@ -100,6 +197,24 @@ class cache_memtracer_t : public memtracer_t
   {
     cache->set_log(log);
   }
+  void sample_sets(size_t ratio)
+  {
+    cache->sample_sets(ratio);
+  }
+  void scale_stats(double factor)
+  {
+    cache->scale_stats(factor);
+  }
+  // A disabled tracer wants no accesses; MMUs only notice the change once
+  // their TLBs are flushed.
+  void set_enabled(bool _enabled)
+  {
+    enabled = _enabled;
+  }
+  void attach_to(coherence_bus_t* bus)
+  {
+    bus->attach(cache);
+  }
   void print_stats()
   {
     cache->print_stats();
@@ -107,6 +222,7 @@ class cache_memtracer_t : public memtracer_t
 
  protected:
   cache_sim_t* cache;
+  bool enabled = true;
 };
 
 class icache_sim_t : public cache_memtracer_t
@@ -116,7 +232,7 @@ class icache_sim_t : public cache_memtracer_t
 	  : cache_memtracer_t(config, name) {}
   bool interested_in_range(uint64_t UNUSED begin, uint64_t UNUSED end, access_type type)
   {
-    return type == FETCH;
+    return enabled && type == FETCH;
   }
   void trace(uint64_t addr, size_t bytes, access_type type)
   {
@@ -131,7 +247,7 @@ class dcache_sim_t : public cache_memtracer_t
 	  : cache_memtracer_t(config, name) {}
   bool interested_in_range(uint64_t UNUSED begin, uint64_t UNUSED end, access_type type)
   {
-    return type == LOAD || type == STORE;
+    return enabled && (type == LOAD || type == STORE);
   }
   void trace(uint64_t addr, size_t bytes, access_type type)
   {
@@ -0,0 +1,73 @@
+// See LICENSE for license details.
+
+#include "call_tracer.h"
+#include "processor.h"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+call_tracer_t::call_tracer_t(processor_t* proc, const char* path, const ranges_t& ranges)
+  : proc(proc), out(fopen(path, "wb"), &fclose), ranges(ranges)
+{
+  if (!out) {
+    std::ostringstream oss;
+    oss << "Failed to open call trace `" << path << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+  fwrite("SPKCALL1", 1, 8, out.get());
+  proc->set_call_tracer(this);
+}
+
+call_tracer_t::~call_tracer_t()
+{
+  proc->set_call_tracer(nullptr);
+}
+
+static bool is_link(reg_t r)
+{
+  return r == 1 || r == 5;
+}
+
+void call_tracer_t::jumped(insn_t insn, reg_t pc, reg_t next_pc, reg_t instret)
+{
+  if (!ranges.empty()) {
+    bool traced = false;
+    for (auto& [base, size] : ranges)
+      traced |= pc - base < size || next_pc - base < size;
+    if (!traced)
+      return;
+  }
+
+  reg_t rd, rs1;
+  uint64_t bits = insn.bits();
+  if ((bits & 3) == 3) {
+    rd = insn.rd();
+    rs1 = (bits & 0x7f) == 0x67 ? insn.rs1() : 0;
+  } else if ((bits & 0xe003) == 0x2001) {
+    // c.addiw outside RV32
+    if (proc->get_xlen() != 32)
+      return;
+    rd = 1;
+    rs1 = 0;
+  } else {
+    // c.jr and c.jalr have no rs2; c.ebreak has no rs1 either
+    if (insn.rvc_rs2() != 0 || insn.rvc_rs1() == 0)
+      return;
+    rd = (bits >> 12) & 1;
+    rs1 = insn.rvc_rs1();
+  }
+
+  bool push = is_link(rd);
+  bool pop = is_link(rs1) && (!push || rs1 != rd);
+  if (pop)
+    emit(instret, pc | 1, next_pc);
+  if (push)
+    emit(instret, pc, next_pc);
+}
+
+void call_tracer_t::emit(reg_t instret, reg_t pc, reg_t target)
+{
+  uint64_t rec[3] = { instret, pc, target };
+  fwrite(rec, sizeof(rec), 1, out.get());
+}
@@ -0,0 +1,55 @@
+// See LICENSE for license details.
+#ifndef _RISCV_CALL_TRACER_H
+#define _RISCV_CALL_TRACER_H
+
+#include "decode.h"
+#include <cstdio>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class processor_t;
+
+// Function entry/exit events of one hart, told apart by their ra/t0
+// linkage as the psABI defines it: a jal/jalr writing x1 or x5 is a call, a
+// jalr through x1 or x5 that writes neither is a return, and one that both
+// pops one link register and pushes the other is a return then a call.
+// Tail calls through other registers are not seen.
+//
+// Only jumps whose pc or target falls in one of the ranges (all of them if
+// none are given) are kept. The hart runs its slow path while a tracer is
+// attached, with one opcode test per instruction on top.
+//
+// The file starts with the 8 bytes "SPKCALL1", then one 24-byte record per
+// event, in the host's byte order:
+//   uint64_t instret  minstret before the jump retired
+//   uint64_t pc       pc of the jump; bit 0 is set for a return
+//   uint64_t target   pc it went to
+class call_tracer_t {
+ public:
+  // [base, base + size) address ranges
+  typedef std::vector<std::pair<reg_t, reg_t>> ranges_t;
+
+  // Throws std::runtime_error if path cannot be opened.
+  call_tracer_t(processor_t* proc, const char* path, const ranges_t& ranges);
+  ~call_tracer_t();
+
+  // A retired instruction at pc that went to next_pc
+  void retired(insn_t insn, reg_t pc, reg_t next_pc, reg_t instret) {
+    uint64_t bits = insn.bits();
+    // jal, jalr, and the quadrant 1 and 2 encodings c.jal, c.jr and c.jalr
+    if ((bits & 0x7f) == 0x6f || (bits & 0x707f) == 0x67 ||
+        (bits & 0xe003) == 0x2001 || (bits & 0xe003) == 0x8002)
+      jumped(insn, pc, next_pc, instret);
+  }
+
+ private:
+  void jumped(insn_t insn, reg_t pc, reg_t next_pc, reg_t instret);
+  void emit(reg_t instret, reg_t pc, reg_t target);
+
+  processor_t* proc;
+  std::unique_ptr<FILE, int(*)(FILE*)> out;
+  ranges_t ranges;
+};
+
+#endif
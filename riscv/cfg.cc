@@ -3,6 +3,7 @@
 #include "config.h"
 #include "cfg.h"
 #include "mmu.h"
+#include "log_file.h"
 #include "decode.h"
 #include "encoding.h"
 #include "platform.h"
@@ -48,4 +49,17 @@ cfg_t::cfg_t()
   real_time_clint  = false;
   trigger_count    = 4;
   cache_blocksz    = 64;
+  tlb_entries      = 256;
+  tlb_ways         = 1;
+  icache_entries   = 1024;
+  block_cache_entries = 0;
+  machine_only_handlers = false;
+  parallel_harts = false;
+  vector_threads = 1;
+  interleave = 5000;
+  insns_per_rtc_tick = 100;
+  skip_idle_harts = false;
+  wfi_fast_forward = false;
+  log_buffer_size = log_file_t::DEFAULT_BUFFER_SIZE;
+  log_writer_thread = false;
 }
@@ -79,6 +79,20 @@ public:
   bool                    real_time_clint;
   reg_t                   trigger_count;
   reg_t                   cache_blocksz;
+  size_t                  tlb_entries;
+  size_t                  tlb_ways;
+  size_t                  icache_entries;
+  size_t                  block_cache_entries;
+  bool                    machine_only_handlers;
+  bool                    parallel_harts;
+  std::vector<size_t>     hart_cpus;
+  size_t                  vector_threads;
+  size_t                  interleave;
+  size_t                  insns_per_rtc_tick;
+  bool                    skip_idle_harts;
+  bool                    wfi_fast_forward;
+  size_t                  log_buffer_size;
+  bool                    log_writer_thread;
   std::optional<abstract_sim_if_t*> external_simulator;
 
   size_t nprocs() const { return hartids.size(); }
@@ -0,0 +1,84 @@
+// See LICENSE for license details.
+#ifndef _RISCV_CHECKPOINT_H
+#define _RISCV_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// sim_t checkpoint file (sim_t::save_checkpoint). All integers are
+// little-endian.
+//
+//   magic   CHECKPOINT_MAGIC
+//   u32     n_harts, then per hart: u32 hartid, processor_t::save_state
+//   u32     n_devices, then per device (in sim_t order):
+//             u64 length, abstract_device_t::save_state
+//   u32     n_mems, then per memory region:
+//             u64 base, u64 size
+//             per page holding nonzero bytes: u64 offset, PGSIZE bytes
+//             u64 -1
+//
+// A checkpoint can only be loaded into a simulator built with the same
+// configuration (harts, devices and memory layout).
+#define CHECKPOINT_MAGIC "SPKCKPT1"
+#define CHECKPOINT_MAGIC_LEN 8
+
+class checkpoint_writer_t {
+ public:
+  void put_u8(uint8_t v) { buf.push_back(v); }
+  void put_u32(uint32_t v) { put_le(v, 4); }
+  void put_u64(uint64_t v) { put_le(v, 8); }
+  void put_bytes(const void* p, size_t n)
+  {
+    buf.insert(buf.end(), (const uint8_t*)p, (const uint8_t*)p + n);
+  }
+
+  std::vector<uint8_t>& data() { return buf; }
+
+ private:
+  void put_le(uint64_t v, size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+      buf.push_back(uint8_t(v >> (8 * i)));
+  }
+
+  std::vector<uint8_t> buf;
+};
+
+// Throws std::runtime_error when reading past the end.
+class checkpoint_reader_t {
+ public:
+  checkpoint_reader_t(const uint8_t* data, size_t len) : data(data), len(len), pos(0) {}
+
+  uint8_t get_u8() { return *get_bytes(1); }
+  uint32_t get_u32() { return uint32_t(get_le(4)); }
+  uint64_t get_u64() { return get_le(8); }
+  const uint8_t* get_bytes(size_t n)
+  {
+    if (n > len - pos)
+      throw std::runtime_error("truncated checkpoint");
+    const uint8_t* p = data + pos;
+    pos += n;
+    return p;
+  }
+
+  size_t remaining() const { return len - pos; }
+
+ private:
+  uint64_t get_le(size_t n)
+  {
+    const uint8_t* p = get_bytes(n);
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++)
+      v |= uint64_t(p[i]) << (8 * i);
+    return v;
+  }
+
+  const uint8_t* data;
+  size_t len;
+  size_t pos;
+};
+
+#endif
@@ -1,21 +1,68 @@
-#include <sys/time.h>
+#include <time.h>
 #include <sstream>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CLINT_HAVE_TSC
+#endif
 #include "devices.h"
 #include "processor.h"
 #include "simif.h"
 #include "sim.h"
 #include "dts.h"
+#include "checkpoint.h"
+#include "input_log.h"
 
 clint_t::clint_t(const simif_t* sim, uint64_t freq_hz, bool real_time)
-  : sim(sim), freq_hz(freq_hz), real_time(real_time), mtime(0)
+  : sim(sim), freq_hz(freq_hz), real_time(real_time), mtime(0), tsc_base(0),
+    tsc_base_ns(0), tsc_anchor(0), tsc_anchor_ns(0), tsc_resync(0), ns_per_tsc(0)
 {
-  struct timeval base;
+  real_time_start_ns = host_ns();
+  tick(0);
+}
+
+uint64_t clint_t::host_ns()
+{
+#ifdef CLINT_HAVE_TSC
+  uint64_t tsc = __rdtsc();
+  uint64_t estimate = tsc_anchor_ns + uint64_t((unsigned __int128)(tsc - tsc_anchor) * ns_per_tsc >> 32);
+  if (likely(ns_per_tsc) && tsc - tsc_anchor < tsc_resync)
+    return estimate;
+#endif
 
-  gettimeofday(&base, NULL);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t ns = uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
 
-  real_time_ref_secs = base.tv_sec;
-  real_time_ref_usecs = base.tv_usec;
-  tick(0);
+#ifdef CLINT_HAVE_TSC
+  if (!tsc_base) {
+    tsc_base = tsc_anchor = tsc;
+    tsc_base_ns = tsc_anchor_ns = ns;
+  } else if (ns - tsc_base_ns >= TSC_CALIBRATION_NS && tsc > tsc_base) {
+    // Continue from the later of the clock and the estimate, so that
+    // mtime never steps back
+    if (ns_per_tsc)
+      ns = std::max(ns, estimate);
+    ns_per_tsc = ((unsigned __int128)(ns - tsc_base_ns) << 32) / (tsc - tsc_base);
+    tsc_resync = (uint64_t(1000000000) << 32) / ns_per_tsc;
+    tsc_anchor = tsc;
+    tsc_anchor_ns = ns;
+  }
+#endif
+  return ns;
+}
+
+clint_t::mtime_t clint_t::real_time_mtime()
+{
+  return (unsigned __int128)(host_ns() - real_time_start_ns) * freq_hz / 1000000000;
+}
+
+void clint_t::sync_harts()
+{
+  for (const auto& [hart_id, hart] : sim->get_harts()) {
+    hart->state.time->sync(mtime);
+    hart->state.mip->backdoor_write_with_mask(MIP_MTIP, mtime >= mtimecmp[hart_id] ? MIP_MTIP : 0);
+  }
 }
 
 /* 0000 msip hart 0
@@ -37,7 +84,14 @@ bool clint_t::load(reg_t addr, size_t len, uint8_t* bytes)
   if (len > 8)
     return false;
 
-  tick(0);
+  // Stores already synced the harts; only a moving clock needs it again
+  if (real_time) {
+    mtime_t now = real_time_mtime();
+    if (now != mtime) {
+      mtime = now;
+      sync_harts();
+    }
+  }
 
   static_assert(MSIP_BASE == 0);
   if (/* addr >= MSIP_BASE && */ addr < MTIMECMP_BASE) {
@@ -47,7 +101,8 @@ bool clint_t::load(reg_t addr, size_t len, uint8_t* bytes)
     }
 
     const auto hart_id = (addr - MSIP_BASE) / sizeof(msip_t);
-    const msip_t res = sim->get_harts().count(hart_id) && (sim->get_harts().at(hart_id)->state.mip->read() & MIP_MSIP);
+    processor_t* hart = sim->get_hart(hart_id);
+    const msip_t res = hart && (hart->state.mip->read() & MIP_MSIP);
     read_little_endian_reg(res, addr, len, bytes);
     return true;
   } else if (addr >= MTIMECMP_BASE && addr < MTIME_BASE) {
@@ -81,8 +136,8 @@ bool clint_t::store(reg_t addr, size_t len, const uint8_t* bytes)
       write_little_endian_reg(&msip, addr, len, bytes);
 
       const auto hart_id = (addr - MSIP_BASE) / sizeof(msip_t);
-      if (sim->get_harts().count(hart_id))
-        sim->get_harts().at(hart_id)->state.mip->backdoor_write_with_mask(MIP_MSIP, msip & 1 ? MIP_MSIP : 0);
+      if (processor_t* hart = sim->get_hart(hart_id))
+        hart->state.mip->backdoor_write_with_mask(MIP_MSIP, msip & 1 ? MIP_MSIP : 0);
     }
   } else if (addr >= MTIMECMP_BASE && addr < MTIME_BASE) {
     const auto hart_id = (addr - MTIMECMP_BASE) / sizeof(mtimecmp_t);
@@ -99,30 +154,83 @@ bool clint_t::store(reg_t addr, size_t len, const uint8_t* bytes)
   return true;
 }
 
-void clint_t::tick(reg_t rtc_ticks)
+uint64_t clint_t::ticks_to_next_deadline() const
 {
-  if (real_time) {
-   struct timeval now;
-   uint64_t diff_usecs;
+  if (real_time)
+    return 0;
 
-   gettimeofday(&now, NULL);
-   diff_usecs = ((now.tv_sec - real_time_ref_secs) * 1000000) + (now.tv_usec - real_time_ref_usecs);
-   mtime = diff_usecs * freq_hz / 1000000;
-  } else {
-    mtime += rtc_ticks;
+  // A compare value of all ones, as firmware writes to disarm a timer, is
+  // never reached and so arms nothing
+  uint64_t next = UINT64_MAX;
+  auto arm = [&](uint64_t cmp, uint64_t now) {
+    if (cmp == UINT64_MAX)
+      return true;
+    if (cmp <= now)
+      return false;
+    next = std::min(next, cmp - now);
+    return true;
+  };
+
+  const auto& harts = sim->get_harts();
+  for (const auto& [hart_id, cmp] : mtimecmp) {
+    auto hart = harts.find(hart_id);
+    if (hart == harts.end())
+      continue;
+    if (!arm(cmp, mtime))
+      return 0;
+
+    // Sstc timers count the same time, the VS one offset by htimedelta
+    processor_t* p = hart->second;
+    if (!p->extension_enabled(EXT_SSTC))
+      continue;
+    state_t* state = p->get_state();
+    if ((state->menvcfg->read() & MENVCFG_STCE) && !arm(state->stimecmp->read(), mtime))
+      return 0;
+    if ((state->henvcfg->read() & HENVCFG_STCE) &&
+        !arm(state->vstimecmp->read(), mtime + state->htimedelta->read()))
+      return 0;
   }
+  return next == UINT64_MAX ? 0 : next;
+}
 
-  for (const auto& [hart_id, hart] : sim->get_harts()) {
-    hart->state.time->sync(mtime);
-    hart->state.mip->backdoor_write_with_mask(MIP_MTIP, mtime >= mtimecmp[hart_id] ? MIP_MTIP : 0);
+void clint_t::save_state(checkpoint_writer_t& out) const
+{
+  out.put_u64(mtime);
+  out.put_u32(mtimecmp.size());
+  for (const auto& [hart_id, cmp] : mtimecmp) {
+    out.put_u64(hart_id);
+    out.put_u64(cmp);
+  }
+}
+
+void clint_t::load_state(checkpoint_reader_t& in)
+{
+  mtime = in.get_u64();
+  mtimecmp.clear();
+  for (uint32_t n = in.get_u32(); n > 0; n--) {
+    size_t hart_id = in.get_u64();
+    mtimecmp[hart_id] = in.get_u64();
   }
+  tick(0);
+}
+
+void clint_t::tick(reg_t rtc_ticks)
+{
+  if (real_time && sim->input_log)
+    mtime = sim->input_log->mtime([this] { return real_time_mtime(); });
+  else if (real_time)
+    mtime = real_time_mtime();
+  else
+    mtime += rtc_ticks;
+
+  sync_harts();
 }
 
 clint_t* clint_parse_from_fdt(const void* fdt, const sim_t* sim, reg_t* base,
     const std::vector<std::string>& sargs UNUSED) {
   if (fdt_parse_clint(fdt, base, "riscv,clint0") == 0 || fdt_parse_clint(fdt, base, "sifive,clint0") == 0)
     return new clint_t(sim,
-                       sim->CPU_HZ / sim->INSNS_PER_RTC_TICK,
+                       sim->CPU_HZ / sim->insns_per_rtc_tick,
                        sim->get_cfg().real_time_clint);
   else
     return nullptr;
@@ -0,0 +1,51 @@
+// See LICENSE for license details.
+#ifndef _RISCV_COMMIT_LOG_FILTER_H
+#define _RISCV_COMMIT_LOG_FILTER_H
+
+#include "decode.h"
+#include "encoding.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Which commits --log-commits prints: those at a pc in one of ranges (any
+// pc if there are none), in a privilege of privs, and among instructions
+// [window_begin, window_end) of the hart, counted from its reset. Outside
+// the filter the hart stays on the fast path, with commit logging off (so
+// the unlogged handlers, and data pages cached in the TLB), which
+// instructions in ranges are kept out of the icache chains and blocks of,
+// so that it leaves there for the slow path as the filter is entered.
+struct commit_log_filter_t
+{
+  std::vector<std::pair<reg_t, reg_t>> ranges;  // [begin, end) of pcs
+  std::vector<std::string> symbols;  // added to ranges once the ELF is loaded
+  unsigned privs = ~0U;  // bit per PRV_U, PRV_S and PRV_M
+  uint64_t window_begin = 0, window_end = UINT64_MAX;
+
+  bool covers(reg_t pc) const
+  {
+    for (auto& r : ranges)
+      if (pc >= r.first && pc < r.second)
+        return true;
+    return false;
+  }
+
+  bool accepts(reg_t pc, reg_t prv, uint64_t retired) const
+  {
+    return (privs >> prv & 1) && retired >= window_begin && retired < window_end &&
+           (ranges.empty() && symbols.empty() ? true : covers(pc));
+  }
+
+  // Instructions until retired next crosses an edge of the window
+  uint64_t window_left(uint64_t retired) const
+  {
+    if (retired < window_begin)
+      return window_begin - retired;
+    if (retired < window_end)
+      return window_end - retired;
+    return UINT64_MAX;
+  }
+};
+
+#endif
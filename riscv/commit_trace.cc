@@ -0,0 +1,401 @@
+// See LICENSE for license details.
+
+#include "commit_trace.h"
+#include "disasm.h"
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+static void put_u8(std::vector<uint8_t>& buf, uint8_t v)
+{
+  buf.push_back(v);
+}
+
+static void put_uvarint(std::vector<uint8_t>& buf, uint64_t v)
+{
+  while (v >= 0x80) {
+    buf.push_back(uint8_t(v) | 0x80);
+    v >>= 7;
+  }
+  buf.push_back(uint8_t(v));
+}
+
+static void put_svarint(std::vector<uint8_t>& buf, int64_t v)
+{
+  put_uvarint(buf, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+commit_trace_writer_t::commit_trace_writer_t(const char* path, size_t buffer_size)
+  : out(fopen(path, "wb"), &fclose), buffer_size(buffer_size),
+    pending_full(false), stop(false)
+{
+  if (!out) {
+    std::ostringstream oss;
+    oss << "Failed to open commit trace at `" << path << "': "
+        << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+
+  active.reserve(buffer_size + 4096);
+  pending.reserve(buffer_size + 4096);
+  active.insert(active.end(), COMMIT_TRACE_MAGIC, COMMIT_TRACE_MAGIC + COMMIT_TRACE_MAGIC_LEN);
+  writer = std::thread(&commit_trace_writer_t::drain, this);
+}
+
+commit_trace_writer_t::~commit_trace_writer_t()
+{
+  flush();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stop = true;
+  }
+  cv.notify_all();
+  writer.join();
+}
+
+void commit_trace_writer_t::on_commit(processor_t* p, reg_t pc, insn_t insn)
+{
+  state_t* state = p->get_state();
+  auto& reg = state->log_reg_write;
+  auto& load = state->log_mem_read;
+  auto& store = state->log_mem_write;
+  uint32_t id = p->get_id();
+
+  if (id >= last_pc.size())
+    last_pc.resize(id + 1, 0);
+
+  put_uvarint(active, id);
+  put_u8(active, state->last_inst_priv);
+  put_u8(active, state->last_inst_xlen);
+  put_u8(active, state->last_inst_flen);
+  put_svarint(active, int64_t(pc - last_pc[id]));
+  last_pc[id] = pc;
+  put_uvarint(active, insn.bits());
+  put_u8(active, insn.length());
+
+  size_t n_regs = 0;
+  bool has_vec = false;
+  for (auto& item : reg) {
+    if (item.first == 0)
+      continue;
+    n_regs++;
+    has_vec |= (item.first & 0xf) == 2 || (item.first & 0xf) == 3;
+  }
+
+  put_u8(active, has_vec);
+  if (has_vec) {
+    put_uvarint(active, p->VU.vsew);
+    put_svarint(active, std::lround(std::log2(p->VU.vflmul)));
+    put_uvarint(active, p->VU.vl->read());
+    put_uvarint(active, p->VU.vlenb);
+  }
+
+  put_uvarint(active, n_regs);
+  for (auto& item : reg) {
+    if (item.first == 0)
+      continue;
+
+    put_uvarint(active, item.first);
+    switch (item.first & 0xf) {
+    case 0:
+    case 4:
+      put_uvarint(active, item.second.v[0]);
+      break;
+    case 1:
+      put_uvarint(active, item.second.v[0]);
+      put_uvarint(active, item.second.v[1]);
+      break;
+    case 2: {
+      const uint8_t* v = &p->VU.elt<uint8_t>(item.first >> 4, 0);
+      active.insert(active.end(), v, v + p->VU.vlenb);
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  put_uvarint(active, load.size());
+  for (auto& item : load) {
+    put_uvarint(active, std::get<0>(item));
+    put_u8(active, std::get<2>(item));
+  }
+
+  put_uvarint(active, store.size());
+  for (auto& item : store) {
+    put_uvarint(active, std::get<0>(item));
+    put_uvarint(active, std::get<1>(item));
+    put_u8(active, std::get<2>(item));
+  }
+
+  if (active.size() >= buffer_size)
+    hand_off();
+}
+
+void commit_trace_writer_t::hand_off()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  cv.wait(guard, [this]{ return !pending_full; });
+  active.swap(pending);
+  pending_full = true;
+  cv.notify_all();
+}
+
+void commit_trace_writer_t::flush()
+{
+  if (!active.empty())
+    hand_off();
+
+  std::unique_lock<std::mutex> guard(lock);
+  cv.wait(guard, [this]{ return !pending_full; });
+  fflush(out.get());
+}
+
+void commit_trace_writer_t::drain()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    cv.wait(guard, [this]{ return pending_full || stop; });
+    if (!pending_full)
+      break;
+
+    guard.unlock();
+    fwrite(pending.data(), 1, pending.size(), out.get());
+    guard.lock();
+
+    pending.clear();
+    pending_full = false;
+    cv.notify_all();
+  }
+}
+
+commit_trace_reader_t::commit_trace_reader_t(const uint8_t* data, size_t len)
+  : data(data), len(len), pos(0), ok(false)
+{
+  if (len >= COMMIT_TRACE_MAGIC_LEN && memcmp(data, COMMIT_TRACE_MAGIC, COMMIT_TRACE_MAGIC_LEN) == 0) {
+    pos = COMMIT_TRACE_MAGIC_LEN;
+    ok = true;
+  }
+}
+
+bool commit_trace_reader_t::get_u8(uint8_t& v)
+{
+  if (pos >= len)
+    return false;
+  v = data[pos++];
+  return true;
+}
+
+bool commit_trace_reader_t::get_uvarint(uint64_t& v)
+{
+  v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t b;
+    if (!get_u8(b))
+      return false;
+    v |= uint64_t(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool commit_trace_reader_t::get_svarint(int64_t& v)
+{
+  uint64_t u;
+  if (!get_uvarint(u))
+    return false;
+  v = int64_t(u >> 1) ^ -int64_t(u & 1);
+  return true;
+}
+
+bool commit_trace_reader_t::next(commit_trace_record_t& rec)
+{
+  if (!ok || pos == len)
+    return false;
+
+  // a short read means a truncated or corrupt trace; stop at its start
+  size_t start = pos;
+  if (!decode(rec)) {
+    pos = start;
+    ok = false;
+    return false;
+  }
+  return true;
+}
+
+bool commit_trace_reader_t::decode(commit_trace_record_t& rec)
+{
+  uint64_t u, n;
+  int64_t d;
+  uint8_t b;
+
+  if (!get_uvarint(u)) return false;
+  rec.hartid = u;
+  if (!get_u8(rec.priv) || !get_u8(rec.xlen) || !get_u8(rec.flen)) return false;
+  if (!get_svarint(d)) return false;
+  if (rec.hartid >= last_pc.size())
+    last_pc.resize(rec.hartid + 1, 0);
+  rec.pc = last_pc[rec.hartid] += d;
+  if (!get_uvarint(rec.insn) || !get_u8(rec.insn_len)) return false;
+
+  if (!get_u8(b)) return false;
+  rec.has_vec = b;
+  rec.vsew = rec.vl = rec.vlenb = 0;
+  rec.lmul_log2 = 0;
+  if (rec.has_vec) {
+    if (!get_uvarint(rec.vsew) || !get_svarint(d) || !get_uvarint(rec.vl) || !get_uvarint(rec.vlenb))
+      return false;
+    rec.lmul_log2 = d;
+  }
+
+  rec.regs.clear();
+  rec.vbytes.clear();
+  if (!get_uvarint(n)) return false;
+  for (uint64_t i = 0; i < n; i++) {
+    commit_trace_record_t::reg_write_t r = {0, {0, 0}, 0};
+    if (!get_uvarint(r.key)) return false;
+    switch (r.key & 0xf) {
+    case 0:
+    case 4:
+      if (!get_uvarint(r.v[0])) return false;
+      break;
+    case 1:
+      if (!get_uvarint(r.v[0]) || !get_uvarint(r.v[1])) return false;
+      break;
+    case 2:
+      if (len - pos < rec.vlenb) return false;
+      r.vdata = rec.vbytes.size();
+      rec.vbytes.insert(rec.vbytes.end(), data + pos, data + pos + rec.vlenb);
+      pos += rec.vlenb;
+      break;
+    default:
+      break;
+    }
+    rec.regs.push_back(r);
+  }
+
+  rec.loads.clear();
+  if (!get_uvarint(n)) return false;
+  for (uint64_t i = 0; i < n; i++) {
+    commit_trace_record_t::mem_access_t m = {0, 0, 0};
+    if (!get_uvarint(m.addr) || !get_u8(m.size)) return false;
+    rec.loads.push_back(m);
+  }
+
+  rec.stores.clear();
+  if (!get_uvarint(n)) return false;
+  for (uint64_t i = 0; i < n; i++) {
+    commit_trace_record_t::mem_access_t m = {0, 0, 0};
+    if (!get_uvarint(m.addr) || !get_uvarint(m.value) || !get_u8(m.size)) return false;
+    rec.stores.push_back(m);
+  }
+
+  return true;
+}
+
+static void print_value(FILE* out, int width, const void* data)
+{
+  switch (width) {
+    case 8:
+      fprintf(out, "0x%02" PRIx8, *(const uint8_t *)data);
+      break;
+    case 16:
+      fprintf(out, "0x%04" PRIx16, *(const uint16_t *)data);
+      break;
+    case 32:
+      fprintf(out, "0x%08" PRIx32, *(const uint32_t *)data);
+      break;
+    case 64:
+      fprintf(out, "0x%016" PRIx64, *(const uint64_t *)data);
+      break;
+    default:
+      assert(width % 8 == 0);
+      fprintf(out, "0x");
+      for (int idx = width / 8 - 1; idx >= 0; --idx)
+        fprintf(out, "%02" PRIx8, ((const uint8_t *)data)[idx]);
+      break;
+  }
+}
+
+static void print_value(FILE* out, int width, uint64_t val)
+{
+  print_value(out, width, &val);
+}
+
+void commit_trace_print_text(FILE* out, const commit_trace_record_t& rec)
+{
+  fprintf(out, "core%4" PRId32 ": ", int32_t(rec.hartid));
+
+  fprintf(out, "%1d ", rec.priv);
+  print_value(out, rec.xlen, rec.pc);
+  fprintf(out, " (");
+  print_value(out, rec.insn_len * 8, rec.insn);
+  fprintf(out, ")");
+  bool show_vec = false;
+
+  for (auto& item : rec.regs) {
+    char prefix = ' ';
+    int size = rec.xlen;
+    int rd = item.key >> 4;
+    bool is_vec = false;
+    bool is_vreg = false;
+    switch (item.key & 0xf) {
+    case 0:
+      prefix = 'x';
+      break;
+    case 1:
+      size = rec.flen;
+      prefix = 'f';
+      break;
+    case 2:
+      size = rec.vlenb * 8;
+      prefix = 'v';
+      is_vreg = true;
+      break;
+    case 3:
+      is_vec = true;
+      break;
+    case 4:
+      prefix = 'c';
+      break;
+    }
+
+    if (!show_vec && (is_vreg || is_vec)) {
+      fprintf(out, " e%ld %s%ld l%ld",
+              (long)rec.vsew,
+              rec.lmul_log2 < 0 ? "mf" : "m",
+              1L << (rec.lmul_log2 < 0 ? -rec.lmul_log2 : rec.lmul_log2),
+              (long)rec.vl);
+      show_vec = true;
+    }
+
+    if (!is_vec) {
+      if (prefix == 'c')
+        fprintf(out, " c%d_%s ", rd, csr_name(rd));
+      else
+        fprintf(out, " %c%-2d ", prefix, rd);
+      if (is_vreg)
+        print_value(out, size, &rec.vbytes[item.vdata]);
+      else
+        print_value(out, size, item.v);
+    }
+  }
+
+  for (auto& item : rec.loads) {
+    fprintf(out, " mem ");
+    print_value(out, rec.xlen, item.addr);
+  }
+
+  for (auto& item : rec.stores) {
+    fprintf(out, " mem ");
+    print_value(out, rec.xlen, item.addr);
+    fprintf(out, " ");
+    print_value(out, item.size << 3, item.value);
+  }
+  fprintf(out, "\n");
+}
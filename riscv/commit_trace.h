@@ -0,0 +1,112 @@
+// See LICENSE for license details.
+#ifndef _RISCV_COMMIT_TRACE_H
+#define _RISCV_COMMIT_TRACE_H
+
+#include "processor.h"
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Binary commit trace. The file starts with COMMIT_TRACE_MAGIC, followed by
+// one record per retired instruction. Integers are LEB128 varints; signed
+// ones are zigzag-encoded first.
+//
+//   uvarint hartid
+//   u8      priv, xlen, flen
+//   svarint pc - previous pc of the same hart (0 before its first record)
+//   uvarint insn bits
+//   u8      insn length in bytes
+//   u8      has_vec; if set: uvarint vsew, svarint log2(lmul), uvarint vl,
+//                            uvarint vlenb
+//   uvarint n_regs, then per register:
+//             uvarint key   (log_reg_write key: index << 4 | type)
+//             type 0, 4: uvarint value
+//             type 1:    uvarint low, uvarint high
+//             type 2:    vlenb raw bytes
+//             type 3:    nothing
+//   uvarint n_loads, then per load:   uvarint addr, u8 size
+//   uvarint n_stores, then per store: uvarint addr, uvarint value, u8 size
+#define COMMIT_TRACE_MAGIC "SPKCTRC1"
+#define COMMIT_TRACE_MAGIC_LEN 8
+
+struct commit_trace_record_t {
+  struct reg_write_t {
+    reg_t key;
+    uint64_t v[2];
+    size_t vdata;       // offset of a vreg value in vbytes
+  };
+  struct mem_access_t {
+    reg_t addr;
+    uint64_t value;
+    uint8_t size;
+  };
+
+  uint32_t hartid;
+  uint8_t priv, xlen, flen;
+  reg_t pc;
+  uint64_t insn;
+  uint8_t insn_len;
+  bool has_vec;
+  reg_t vsew;
+  int lmul_log2;
+  reg_t vl;
+  reg_t vlenb;
+  std::vector<reg_write_t> regs;
+  std::vector<uint8_t> vbytes;
+  std::vector<mem_access_t> loads, stores;
+};
+
+// Prints a record in the same text form as --log-commits.
+void commit_trace_print_text(FILE* out, const commit_trace_record_t& rec);
+
+// Encodes commits into a pair of large buffers; a writer thread drains the
+// full one to the file while the simulator fills the other.
+class commit_trace_writer_t : public commit_observer_t {
+ public:
+  // Throws std::runtime_error if path cannot be opened.
+  commit_trace_writer_t(const char* path, size_t buffer_size = 4 << 20);
+  ~commit_trace_writer_t();
+  void on_commit(processor_t* p, reg_t pc, insn_t insn) override;
+  void flush();
+
+ private:
+  void hand_off();
+  void drain();
+
+  std::unique_ptr<FILE, int(*)(FILE*)> out;
+  size_t buffer_size;
+  std::vector<uint8_t> active, pending;
+  std::vector<reg_t> last_pc;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool pending_full;
+  bool stop;
+  std::thread writer;
+};
+
+// Decodes records from an in-memory (typically mmap'ed) trace.
+class commit_trace_reader_t {
+ public:
+  commit_trace_reader_t(const uint8_t* data, size_t len);
+  bool valid() const { return ok; }
+  // Returns false at the end of the trace or on a malformed record.
+  bool next(commit_trace_record_t& rec);
+  size_t offset() const { return pos; }
+
+ private:
+  bool decode(commit_trace_record_t& rec);
+  bool get_u8(uint8_t& v);
+  bool get_uvarint(uint64_t& v);
+  bool get_svarint(int64_t& v);
+
+  const uint8_t* data;
+  size_t len;
+  size_t pos;
+  bool ok;
+  std::vector<reg_t> last_pc;
+};
+
+#endif
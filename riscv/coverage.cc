@@ -0,0 +1,170 @@
+// See LICENSE for license details.
+
+#include "coverage.h"
+#include "processor.h"
+#include "disasm.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+void coverage_data_t::merge(const coverage_data_t& other)
+{
+  for (size_t i = 0; i < csrs.size(); i++)
+    for (size_t w = 0; w < 2; w++)
+      csrs[i][w] += other.csrs[i][w];
+  for (size_t i = 0; i < 64; i++) {
+    exceptions[i] += other.exceptions[i];
+    interrupts[i] += other.interrupts[i];
+  }
+  for (size_t i = 0; i < 8; i++)
+    for (size_t j = 0; j < 8; j++)
+      privileges[i][j] += other.privileges[i][j];
+  for (size_t i = 0; i < vtypes.size(); i++)
+    for (size_t j = 0; j < 3; j++)
+      vtypes[i][j] += other.vtypes[i][j];
+  for (const auto& [name, count] : other.insns) {
+    auto& c = insns[name];
+    for (size_t i = 0; i < 4; i++)
+      c[i] += count[i];
+  }
+}
+
+void coverage_data_t::write(FILE* out) const
+{
+  fwrite("SPKCOV01", 1, 8, out);
+  fwrite(csrs.data(), sizeof(csrs), 1, out);
+  fwrite(exceptions.data(), sizeof(exceptions), 1, out);
+  fwrite(interrupts.data(), sizeof(interrupts), 1, out);
+  fwrite(privileges.data(), sizeof(privileges), 1, out);
+  fwrite(vtypes.data(), sizeof(vtypes), 1, out);
+  uint64_t n = insns.size();
+  fwrite(&n, sizeof(n), 1, out);
+  for (const auto& [name, count] : insns) {
+    uint64_t len = name.size();
+    fwrite(count.data(), sizeof(count), 1, out);
+    fwrite(&len, sizeof(len), 1, out);
+    fwrite(name.data(), 1, len, out);
+  }
+}
+
+bool coverage_data_t::read(FILE* in)
+{
+  char magic[8];
+  if (fread(magic, 1, 8, in) != 8 || memcmp(magic, "SPKCOV01", 8) != 0)
+    return false;
+  uint64_t n;
+  if (fread(csrs.data(), sizeof(csrs), 1, in) != 1 ||
+      fread(exceptions.data(), sizeof(exceptions), 1, in) != 1 ||
+      fread(interrupts.data(), sizeof(interrupts), 1, in) != 1 ||
+      fread(privileges.data(), sizeof(privileges), 1, in) != 1 ||
+      fread(vtypes.data(), sizeof(vtypes), 1, in) != 1 ||
+      fread(&n, sizeof(n), 1, in) != 1)
+    return false;
+  insns.clear();
+  std::string name;
+  for (uint64_t i = 0; i < n; i++) {
+    std::array<uint64_t, 4> count;
+    uint64_t len;
+    if (fread(count.data(), sizeof(count), 1, in) != 1 ||
+        fread(&len, sizeof(len), 1, in) != 1 || len > 256)
+      return false;
+    name.resize(len);
+    if (fread(name.data(), 1, len, in) != len)
+      return false;
+    insns[name] = count;
+  }
+  return true;
+}
+
+void coverage_data_t::print(FILE* out) const
+{
+  static const char* privs[] = { "U", "S", "H", "M", "VU", "VS", "VH", "VM" };
+
+  for (const auto& [name, c] : insns) {
+    std::string dotted = name;
+    std::replace(dotted.begin(), dotted.end(), '_', '.');
+    fprintf(out, "insn %-16s U %" PRIu64 " S %" PRIu64 " M %" PRIu64 "\n",
+            dotted.c_str(), c[PRV_U], c[PRV_S], c[PRV_M]);
+  }
+  for (size_t i = 0; i < csrs.size(); i++) {
+    if (!(csrs[i][0] | csrs[i][1]))
+      continue;
+    fprintf(out, "csr 0x%03zx %-14s read %" PRIu64 " write %" PRIu64 "\n",
+            i, csr_name(i), csrs[i][0], csrs[i][1]);
+  }
+  for (size_t i = 0; i < 64; i++) {
+    if (exceptions[i])
+      fprintf(out, "exception %zu %" PRIu64 "\n", i, exceptions[i]);
+    if (interrupts[i])
+      fprintf(out, "interrupt %zu %" PRIu64 "\n", i, interrupts[i]);
+  }
+  for (size_t i = 0; i < 8; i++)
+    for (size_t j = 0; j < 8; j++)
+      if (privileges[i][j])
+        fprintf(out, "privilege %s->%s %" PRIu64 "\n", privs[i], privs[j], privileges[i][j]);
+  for (size_t i = 0; i < vtypes.size(); i++) {
+    const auto& v = vtypes[i];
+    if (!(v[VL_ZERO] | v[VL_PARTIAL] | v[VL_MAX]))
+      continue;
+    if (i == VTYPE_ILL) {
+      fprintf(out, "vtype vill");
+    } else {
+      static const char* lmuls[] = { "m1", "m2", "m4", "m8", "m?", "mf8", "mf4", "mf2" };
+      fprintf(out, "vtype e%u,%s,%s,%s", 8u << ((i >> 3) & 7), lmuls[i & 7],
+              i & 0x40 ? "ta" : "tu", i & 0x80 ? "ma" : "mu");
+    }
+    fprintf(out, " vl=0 %" PRIu64 " vl<vlmax %" PRIu64 " vl=vlmax %" PRIu64 "\n",
+            v[VL_ZERO], v[VL_PARTIAL], v[VL_MAX]);
+  }
+}
+
+static std::map<std::string, std::array<uint64_t, 4>> insn_counts(processor_t* proc)
+{
+  std::map<std::string, std::array<uint64_t, 4>> counts;
+  for (const auto& c : proc->get_insn_counts()) {
+    auto& n = counts[c.name];
+    for (size_t i = 0; i < 4; i++)
+      n[i] += c.count[i];
+  }
+  return counts;
+}
+
+coverage_t::coverage_t(processor_t* proc, const char* path)
+  : proc(proc), out(fopen(path, "wb"), &fclose), insn_stats(proc->get_insn_stats())
+{
+  if (!out) {
+    std::ostringstream oss;
+    oss << "Failed to open coverage file `" << path << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+  if (insn_stats)
+    insn_base = insn_counts(proc);
+  else
+    proc->set_insn_stats(true);
+  proc->set_coverage(this);
+}
+
+coverage_t::~coverage_t()
+{
+  proc->set_coverage(nullptr);
+  data.insns = insn_counts(proc);
+  for (auto it = data.insns.begin(); it != data.insns.end(); ) {
+    auto base = insn_base.find(it->first);
+    if (base != insn_base.end())
+      for (size_t i = 0; i < 4; i++)
+        it->second[i] -= base->second[i];
+    auto& c = it->second;
+    if (!(c[0] | c[1] | c[2] | c[3]))
+      it = data.insns.erase(it);
+    else
+      ++it;
+  }
+  if (!insn_stats) {
+    proc->set_insn_stats(false);
+    proc->clear_insn_counts();
+  }
+  data.write(out.get());
+}
@@ -0,0 +1,80 @@
+// See LICENSE for license details.
+#ifndef _RISCV_COVERAGE_H
+#define _RISCV_COVERAGE_H
+
+#include "decode.h"
+#include <array>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+
+class processor_t;
+
+// ISA functional coverage of one or more runs, held in dense counter arrays
+// so that runs merge by addition. Privilege modes are numbered prv | v << 2.
+// vtype configurations are indexed by the low 8 bits of vtype (vlmul, vsew,
+// vta, vma), with VTYPE_ILL for vill, and split by the vl they produced:
+// 0, between 0 and VLMAX, or VLMAX.
+struct coverage_data_t {
+  static const size_t VTYPE_ILL = 256;
+  enum { VL_ZERO, VL_PARTIAL, VL_MAX };
+
+  std::array<std::array<uint64_t, 2>, 4096> csrs{};           // [addr][write]
+  std::array<uint64_t, 64> exceptions{};                      // by cause
+  std::array<uint64_t, 64> interrupts{};                      // by cause
+  std::array<std::array<uint64_t, 8>, 8> privileges{};        // [from][to]
+  std::array<std::array<uint64_t, 3>, VTYPE_ILL + 1> vtypes{}; // [vtype][vl]
+  // retired instructions by mnemonic ('_' for '.'), then by prv
+  std::map<std::string, std::array<uint64_t, 4>> insns;
+
+  void merge(const coverage_data_t& other);
+
+  // The file is the 8 bytes "SPKCOV01", then the arrays above in order as
+  // uint64_t in the host's byte order, then a uint64_t count of insns and
+  // per instruction its 4 counts, a uint64_t name length and the name.
+  void write(FILE* out) const;
+  bool read(FILE* in);  // false if in is not a coverage file
+
+  // What was hit, one line per item
+  void print(FILE* out) const;
+};
+
+// Coverage collection for one hart. Instructions are counted as for
+// --insn-stats, which is turned on meanwhile; CSR accesses, traps,
+// privilege changes and vsetvl configurations are counted where
+// processor_t handles them, one pointer test each otherwise. The destructor
+// writes the counts collected since construction.
+class coverage_t {
+ public:
+  // Throws std::runtime_error if path cannot be opened.
+  coverage_t(processor_t* proc, const char* path);
+  ~coverage_t();
+
+  void csr(int which, bool write) {
+    if (reg_t(which) < data.csrs.size())
+      data.csrs[which][write]++;
+  }
+  void trap(reg_t cause, bool interrupt) {
+    if (cause < 64)
+      (interrupt ? data.interrupts : data.exceptions)[cause]++;
+  }
+  void privilege(reg_t from, bool from_v, reg_t to, bool to_v) {
+    data.privileges[(from & 3) | from_v << 2][(to & 3) | to_v << 2]++;
+  }
+  void vtype(reg_t type, bool vill, reg_t vl, reg_t vlmax) {
+    size_t cls = vl == 0 ? coverage_data_t::VL_ZERO
+               : vl == vlmax ? coverage_data_t::VL_MAX : coverage_data_t::VL_PARTIAL;
+    data.vtypes[vill ? coverage_data_t::VTYPE_ILL : (type & 0xff)][cls]++;
+  }
+
+ private:
+  processor_t* proc;
+  std::unique_ptr<FILE, int(*)(FILE*)> out;
+  bool insn_stats;  // whether --insn-stats counting was already on
+  coverage_data_t data;
+  // instruction counts at construction, subtracted when writing
+  std::map<std::string, std::array<uint64_t, 4>> insn_base;
+};
+
+#endif
@@ -1,9 +1,15 @@
 #include "processor.h"
 #include "debug_defines.h"
+#include <iterator>
+#include <typeinfo>
 
 void state_t::add_csr(reg_t addr, const csr_t_p& csr)
 {
   csrmap[addr] = csr;
+  if (addr < std::size(csr_table)) {
+    csr_table[addr] = csr.get();
+    csr_basic[addr] = csr && typeid(*csr) == typeid(basic_csr_t);
+  }
 }
 
 #define add_const_ext_csr(ext, addr, csr) do { auto csr__ = (csr); if (proc->extension_enabled_const(ext)) { add_csr(addr, csr__); } } while (0)
@@ -20,10 +26,10 @@ void state_t::add_ireg_proxy(processor_t* const proc, sscsrind_reg_csr_t::sscsri
 
   const reg_t iprio0_addr = 0x30;
   for (int i=0; i<16; i+=2) {
-    csr_t_p iprio = std::make_shared<aia_csr_t>(proc, iprio0_addr + i, 0, 0);
+    csr_t_p iprio = make_csr<aia_csr_t>(proc, iprio0_addr + i, 0, 0);
     if (xlen == 32) {
-      ireg->add_ireg_proxy(iprio0_addr + i, std::make_shared<rv32_low_csr_t>(proc, iprio0_addr + i, iprio));
-      ireg->add_ireg_proxy(iprio0_addr + i + 1, std::make_shared<rv32_high_csr_t>(proc, iprio0_addr + i + 1, iprio));
+      ireg->add_ireg_proxy(iprio0_addr + i, make_csr<rv32_low_csr_t>(proc, iprio0_addr + i, iprio));
+      ireg->add_ireg_proxy(iprio0_addr + i + 1, make_csr<rv32_high_csr_t>(proc, iprio0_addr + i + 1, iprio));
     } else {
       ireg->add_ireg_proxy(iprio0_addr + i, iprio);
     }
@@ -36,45 +42,48 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
   // mstatus_csr_t::unlogged_write()):
   auto xlen = proc->get_isa().get_max_xlen();
 
-  add_csr(CSR_MISA, misa = std::make_shared<misa_csr_t>(proc, CSR_MISA, max_isa));
-  mstatus = std::make_shared<mstatus_csr_t>(proc, CSR_MSTATUS);
+  // a fresh arena, as the CSRs of the last reset may still be referenced
+  csr_arena = std::make_shared<csr_arena_t>();
+
+  add_csr(CSR_MISA, misa = make_csr<misa_csr_t>(proc, CSR_MISA, max_isa));
+  mstatus = make_hot_csr<mstatus_csr_t>(proc, CSR_MSTATUS);
 
   if (xlen == 32) {
-    add_csr(CSR_MSTATUS, std::make_shared<rv32_low_csr_t>(proc, CSR_MSTATUS, mstatus));
-    add_csr(CSR_MSTATUSH, mstatush = std::make_shared<rv32_high_csr_t>(proc, CSR_MSTATUSH, mstatus));
+    add_csr(CSR_MSTATUS, make_csr<rv32_low_csr_t>(proc, CSR_MSTATUS, mstatus));
+    add_csr(CSR_MSTATUSH, mstatush = make_csr<rv32_high_csr_t>(proc, CSR_MSTATUSH, mstatus));
   } else {
     add_csr(CSR_MSTATUS, mstatus);
   }
-  add_csr(CSR_MEPC, mepc = std::make_shared<epc_csr_t>(proc, CSR_MEPC));
-  add_csr(CSR_MTVAL, mtval = std::make_shared<basic_csr_t>(proc, CSR_MTVAL, 0));
-  add_csr(CSR_MSCRATCH, std::make_shared<basic_csr_t>(proc, CSR_MSCRATCH, 0));
-  add_csr(CSR_MTVEC, mtvec = std::make_shared<tvec_csr_t>(proc, CSR_MTVEC));
-  add_csr(CSR_MCAUSE, mcause = std::make_shared<cause_csr_t>(proc, CSR_MCAUSE));
+  add_csr(CSR_MEPC, mepc = make_csr<epc_csr_t>(proc, CSR_MEPC));
+  add_csr(CSR_MTVAL, mtval = make_csr<basic_csr_t>(proc, CSR_MTVAL, 0));
+  add_csr(CSR_MSCRATCH, make_csr<basic_csr_t>(proc, CSR_MSCRATCH, 0));
+  add_csr(CSR_MTVEC, mtvec = make_csr<tvec_csr_t>(proc, CSR_MTVEC));
+  add_csr(CSR_MCAUSE, mcause = make_csr<cause_csr_t>(proc, CSR_MCAUSE));
 
   const reg_t minstretcfg_mask = !proc->extension_enabled_const(EXT_SMCNTRPMF) ? 0 :
     MHPMEVENT_MINH | MHPMEVENT_SINH | MHPMEVENT_UINH | MHPMEVENT_VSINH | MHPMEVENT_VUINH;
-  auto minstretcfg = std::make_shared<smcntrpmf_csr_t>(proc, CSR_MINSTRETCFG, minstretcfg_mask, 0);
-  auto mcyclecfg = std::make_shared<smcntrpmf_csr_t>(proc, CSR_MCYCLECFG, minstretcfg_mask, 0);
+  auto minstretcfg = make_csr<smcntrpmf_csr_t>(proc, CSR_MINSTRETCFG, minstretcfg_mask, 0);
+  auto mcyclecfg = make_csr<smcntrpmf_csr_t>(proc, CSR_MCYCLECFG, minstretcfg_mask, 0);
 
-  minstret = std::make_shared<wide_counter_csr_t>(proc, CSR_MINSTRET, minstretcfg);
-  mcycle = std::make_shared<wide_counter_csr_t>(proc, CSR_MCYCLE, mcyclecfg);
-  time = std::make_shared<time_counter_csr_t>(proc, CSR_TIME);
+  minstret = make_hot_csr<wide_counter_csr_t>(proc, CSR_MINSTRET, minstretcfg, MCOUNTINHIBIT_IR);
+  mcycle = make_hot_csr<wide_counter_csr_t>(proc, CSR_MCYCLE, mcyclecfg, MCOUNTINHIBIT_CY);
+  time = make_csr<time_counter_csr_t>(proc, CSR_TIME);
   if (proc->extension_enabled_const(EXT_ZICNTR)) {
-    add_csr(CSR_INSTRET, std::make_shared<counter_proxy_csr_t>(proc, CSR_INSTRET, minstret));
-    add_csr(CSR_CYCLE, std::make_shared<counter_proxy_csr_t>(proc, CSR_CYCLE, mcycle));
-    add_csr(CSR_TIME, time_proxy = std::make_shared<counter_proxy_csr_t>(proc, CSR_TIME, time));
+    add_csr(CSR_INSTRET, make_csr<counter_proxy_csr_t>(proc, CSR_INSTRET, minstret));
+    add_csr(CSR_CYCLE, make_csr<counter_proxy_csr_t>(proc, CSR_CYCLE, mcycle));
+    add_csr(CSR_TIME, time_proxy = make_csr<counter_proxy_csr_t>(proc, CSR_TIME, time));
   }
   if (xlen == 32) {
     csr_t_p minstreth, mcycleh;
-    add_csr(CSR_MINSTRET, std::make_shared<rv32_low_csr_t>(proc, CSR_MINSTRET, minstret));
-    add_csr(CSR_MINSTRETH, minstreth = std::make_shared<rv32_high_csr_t>(proc, CSR_MINSTRETH, minstret));
-    add_csr(CSR_MCYCLE, std::make_shared<rv32_low_csr_t>(proc, CSR_MCYCLE, mcycle));
-    add_csr(CSR_MCYCLEH, mcycleh = std::make_shared<rv32_high_csr_t>(proc, CSR_MCYCLEH, mcycle));
+    add_csr(CSR_MINSTRET, make_csr<rv32_low_csr_t>(proc, CSR_MINSTRET, minstret));
+    add_csr(CSR_MINSTRETH, minstreth = make_csr<rv32_high_csr_t>(proc, CSR_MINSTRETH, minstret));
+    add_csr(CSR_MCYCLE, make_csr<rv32_low_csr_t>(proc, CSR_MCYCLE, mcycle));
+    add_csr(CSR_MCYCLEH, mcycleh = make_csr<rv32_high_csr_t>(proc, CSR_MCYCLEH, mcycle));
     if (proc->extension_enabled_const(EXT_ZICNTR)) {
-      auto timeh = std::make_shared<rv32_high_csr_t>(proc, CSR_TIMEH, time);
-      add_csr(CSR_INSTRETH, std::make_shared<counter_proxy_csr_t>(proc, CSR_INSTRETH, minstreth));
-      add_csr(CSR_CYCLEH, std::make_shared<counter_proxy_csr_t>(proc, CSR_CYCLEH, mcycleh));
-      add_csr(CSR_TIMEH, std::make_shared<counter_proxy_csr_t>(proc, CSR_TIMEH, timeh));
+      auto timeh = make_csr<rv32_high_csr_t>(proc, CSR_TIMEH, time);
+      add_csr(CSR_INSTRETH, make_csr<counter_proxy_csr_t>(proc, CSR_INSTRETH, minstreth));
+      add_csr(CSR_CYCLEH, make_csr<counter_proxy_csr_t>(proc, CSR_CYCLEH, mcycleh));
+      add_csr(CSR_TIMEH, make_csr<counter_proxy_csr_t>(proc, CSR_TIMEH, timeh));
     }
   } else {
     add_csr(CSR_MINSTRET, minstret);
@@ -87,36 +96,36 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
     const reg_t which_mcounterh = CSR_MHPMCOUNTER3H + i;
     const reg_t which_counter = CSR_HPMCOUNTER3 + i;
     const reg_t which_counterh = CSR_HPMCOUNTER3H + i;
-    mevent[i] = std::make_shared<mevent_csr_t>(proc, which_mevent);
-    auto mcounter = std::make_shared<const_csr_t>(proc, which_mcounter, 0);
+    mevent[i] = make_csr<mevent_csr_t>(proc, which_mevent);
+    auto mcounter = make_csr<const_csr_t>(proc, which_mcounter, 0);
     add_csr(which_mcounter, mcounter);
 
-    auto counter = std::make_shared<counter_proxy_csr_t>(proc, which_counter, mcounter);
+    auto counter = make_csr<counter_proxy_csr_t>(proc, which_counter, mcounter);
     add_const_ext_csr(EXT_ZIHPM, which_counter, counter);
 
     if (xlen == 32) {
-      add_csr(which_mevent, std::make_shared<rv32_low_csr_t>(proc, which_mevent, mevent[i]));
-      auto mcounterh = std::make_shared<const_csr_t>(proc, which_mcounterh, 0);
+      add_csr(which_mevent, make_csr<rv32_low_csr_t>(proc, which_mevent, mevent[i]));
+      auto mcounterh = make_csr<const_csr_t>(proc, which_mcounterh, 0);
       add_csr(which_mcounterh, mcounterh);
-      add_const_ext_csr(EXT_ZIHPM, which_counterh, std::make_shared<counter_proxy_csr_t>(proc, which_counterh, mcounterh));
-      add_const_ext_csr(EXT_SSCOFPMF, which_meventh, std::make_shared<rv32_high_csr_t>(proc, which_meventh, mevent[i]));
+      add_const_ext_csr(EXT_ZIHPM, which_counterh, make_csr<counter_proxy_csr_t>(proc, which_counterh, mcounterh));
+      add_const_ext_csr(EXT_SSCOFPMF, which_meventh, make_csr<rv32_high_csr_t>(proc, which_meventh, mevent[i]));
     } else {
       add_csr(which_mevent, mevent[i]);
     }
   }
-  add_const_ext_csr(EXT_SSCOFPMF, CSR_SCOUNTOVF, std::make_shared<scountovf_csr_t>(proc, CSR_SCOUNTOVF));
-  mie = std::make_shared<mie_csr_t>(proc, CSR_MIE);
-  mip = std::make_shared<mip_csr_t>(proc, CSR_MIP);
+  add_const_ext_csr(EXT_SSCOFPMF, CSR_SCOUNTOVF, make_csr<scountovf_csr_t>(proc, CSR_SCOUNTOVF));
+  mie = make_hot_csr<mie_csr_t>(proc, CSR_MIE);
+  mip = make_hot_csr<mip_csr_t>(proc, CSR_MIP);
   if (xlen == 32 && proc->extension_enabled_const(EXT_SMAIA)) {
-    add_csr(CSR_MIE, std::make_shared<rv32_low_csr_t>(proc, CSR_MIE, mie));
-    add_csr(CSR_MIEH, std::make_shared<rv32_high_csr_t>(proc, CSR_MIEH, mie));
-    add_csr(CSR_MIP, std::make_shared<rv32_low_csr_t>(proc, CSR_MIP, mip));
-    add_csr(CSR_MIPH, std::make_shared<rv32_high_csr_t>(proc, CSR_MIPH, mip));
+    add_csr(CSR_MIE, make_csr<rv32_low_csr_t>(proc, CSR_MIE, mie));
+    add_csr(CSR_MIEH, make_csr<rv32_high_csr_t>(proc, CSR_MIEH, mie));
+    add_csr(CSR_MIP, make_csr<rv32_low_csr_t>(proc, CSR_MIP, mip));
+    add_csr(CSR_MIPH, make_csr<rv32_high_csr_t>(proc, CSR_MIPH, mip));
   } else {
     add_csr(CSR_MIE, mie);
     add_csr(CSR_MIP, mip);
   }
-  auto sip_sie_accr = std::make_shared<generic_int_accessor_t>(
+  auto sip_sie_accr = make_csr<generic_int_accessor_t>(
     this,
     ~MIP_HS_MASK,  // read_mask
     MIP_SSIP | MIP_LCOFIP,  // ip_write_mask
@@ -125,7 +134,7 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
     0              // shiftamt
   );
 
-  auto hip_hie_accr = std::make_shared<generic_int_accessor_t>(
+  auto hip_hie_accr = make_csr<generic_int_accessor_t>(
     this,
     MIP_HS_MASK,   // read_mask
     MIP_VSSIP,     // ip_write_mask
@@ -134,7 +143,7 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
     0              // shiftamt
   );
 
-  auto vsip_vsie_accr = std::make_shared<generic_int_accessor_t>(
+  auto vsip_vsie_accr = make_csr<generic_int_accessor_t>(
     this,
     MIP_VS_MASK,   // read_mask
     MIP_VSSIP,     // ip_write_mask
@@ -143,84 +152,84 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
     1              // shiftamt
   );
 
-  nonvirtual_sip = std::make_shared<sip_csr_t>(proc, CSR_SIP, sip_sie_accr);
-  auto vsip = std::make_shared<mip_proxy_csr_t>(proc, CSR_VSIP, vsip_vsie_accr);
-  auto sip = std::make_shared<virtualized_csr_t>(proc, nonvirtual_sip, vsip);
+  nonvirtual_sip = make_csr<sip_csr_t>(proc, CSR_SIP, sip_sie_accr);
+  auto vsip = make_csr<mip_proxy_csr_t>(proc, CSR_VSIP, vsip_vsie_accr);
+  auto sip = make_csr<virtualized_csr_t>(proc, nonvirtual_sip, vsip);
   if (xlen == 32 && proc->extension_enabled_const(EXT_SSAIA)) {
-    add_hypervisor_csr(CSR_VSIP, std::make_shared<rv32_low_csr_t>(proc, CSR_VSIP, vsip));
-    add_hypervisor_csr(CSR_VSIPH, std::make_shared<aia_rv32_high_csr_t>(proc, CSR_VSIPH, vsip));
-    add_supervisor_csr(CSR_SIP, std::make_shared<rv32_low_csr_t>(proc, CSR_SIP, sip));
-    add_supervisor_csr(CSR_SIPH, std::make_shared<aia_rv32_high_csr_t>(proc, CSR_SIPH, sip));
+    add_hypervisor_csr(CSR_VSIP, make_csr<rv32_low_csr_t>(proc, CSR_VSIP, vsip));
+    add_hypervisor_csr(CSR_VSIPH, make_csr<aia_rv32_high_csr_t>(proc, CSR_VSIPH, vsip));
+    add_supervisor_csr(CSR_SIP, make_csr<rv32_low_csr_t>(proc, CSR_SIP, sip));
+    add_supervisor_csr(CSR_SIPH, make_csr<aia_rv32_high_csr_t>(proc, CSR_SIPH, sip));
   } else {
     add_hypervisor_csr(CSR_VSIP, vsip);
     add_supervisor_csr(CSR_SIP, sip);
   }
-  add_hypervisor_csr(CSR_HIP, std::make_shared<mip_proxy_csr_t>(proc, CSR_HIP, hip_hie_accr));
-  hvip = std::make_shared<hvip_csr_t>(proc, CSR_HVIP, 0);
+  add_hypervisor_csr(CSR_HIP, make_csr<mip_proxy_csr_t>(proc, CSR_HIP, hip_hie_accr));
+  hvip = make_csr<hvip_csr_t>(proc, CSR_HVIP, 0);
   if (xlen == 32 && proc->extension_enabled_const(EXT_SSAIA)) {
-    add_hypervisor_csr(CSR_HVIP, std::make_shared<rv32_low_csr_t>(proc, CSR_HVIP, hvip));
-    add_hypervisor_csr(CSR_HVIPH, std::make_shared<aia_rv32_high_csr_t>(proc, CSR_HVIPH, hvip));
+    add_hypervisor_csr(CSR_HVIP, make_csr<rv32_low_csr_t>(proc, CSR_HVIP, hvip));
+    add_hypervisor_csr(CSR_HVIPH, make_csr<aia_rv32_high_csr_t>(proc, CSR_HVIPH, hvip));
   } else {
     add_hypervisor_csr(CSR_HVIP, hvip);
   }
 
-  nonvirtual_sie = std::make_shared<sie_csr_t>(proc, CSR_SIE, sip_sie_accr);
-  auto vsie = std::make_shared<mie_proxy_csr_t>(proc, CSR_VSIE, vsip_vsie_accr);
-  auto sie = std::make_shared<virtualized_csr_t>(proc, nonvirtual_sie, vsie);
+  nonvirtual_sie = make_csr<sie_csr_t>(proc, CSR_SIE, sip_sie_accr);
+  auto vsie = make_csr<mie_proxy_csr_t>(proc, CSR_VSIE, vsip_vsie_accr);
+  auto sie = make_csr<virtualized_csr_t>(proc, nonvirtual_sie, vsie);
   if (xlen == 32 && proc->extension_enabled_const(EXT_SSAIA)) {
-    add_hypervisor_csr(CSR_VSIE, std::make_shared<rv32_low_csr_t>(proc, CSR_VSIE, vsie));
-    add_hypervisor_csr(CSR_VSIEH, std::make_shared<aia_rv32_high_csr_t>(proc, CSR_VSIEH, vsie));
-    add_supervisor_csr(CSR_SIE, std::make_shared<rv32_low_csr_t>(proc, CSR_SIE, sie));
-    add_supervisor_csr(CSR_SIEH, std::make_shared<aia_rv32_high_csr_t>(proc, CSR_SIEH, sie));
+    add_hypervisor_csr(CSR_VSIE, make_csr<rv32_low_csr_t>(proc, CSR_VSIE, vsie));
+    add_hypervisor_csr(CSR_VSIEH, make_csr<aia_rv32_high_csr_t>(proc, CSR_VSIEH, vsie));
+    add_supervisor_csr(CSR_SIE, make_csr<rv32_low_csr_t>(proc, CSR_SIE, sie));
+    add_supervisor_csr(CSR_SIEH, make_csr<aia_rv32_high_csr_t>(proc, CSR_SIEH, sie));
   } else {
     add_hypervisor_csr(CSR_VSIE, vsie);
     add_supervisor_csr(CSR_SIE, sie);
   }
-  add_hypervisor_csr(CSR_HIE, std::make_shared<mie_proxy_csr_t>(proc, CSR_HIE, hip_hie_accr));
+  add_hypervisor_csr(CSR_HIE, make_csr<mie_proxy_csr_t>(proc, CSR_HIE, hip_hie_accr));
 
-  add_supervisor_csr(CSR_MEDELEG, medeleg = std::make_shared<medeleg_csr_t>(proc, CSR_MEDELEG));
-  mideleg = std::make_shared<mideleg_csr_t>(proc, CSR_MIDELEG);
+  add_supervisor_csr(CSR_MEDELEG, medeleg = make_hot_csr<medeleg_csr_t>(proc, CSR_MEDELEG));
+  mideleg = make_hot_csr<mideleg_csr_t>(proc, CSR_MIDELEG);
   if (xlen == 32 && proc->extension_enabled_const(EXT_SMAIA)) {
-    add_supervisor_csr(CSR_MIDELEG, std::make_shared<rv32_low_csr_t>(proc, CSR_MIDELEG, mideleg));
-    add_supervisor_csr(CSR_MIDELEGH, std::make_shared<aia_rv32_high_csr_t>(proc, CSR_MIDELEGH, mideleg));
+    add_supervisor_csr(CSR_MIDELEG, make_csr<rv32_low_csr_t>(proc, CSR_MIDELEG, mideleg));
+    add_supervisor_csr(CSR_MIDELEGH, make_csr<aia_rv32_high_csr_t>(proc, CSR_MIDELEGH, mideleg));
   } else {
     add_supervisor_csr(CSR_MIDELEG, mideleg);
   }
   const reg_t counteren_mask = (proc->extension_enabled_const(EXT_ZICNTR) ? 0x7UL : 0x0) | (proc->extension_enabled_const(EXT_ZIHPM) ? 0xfffffff8ULL : 0x0);
-  add_user_csr(CSR_MCOUNTEREN, mcounteren = std::make_shared<masked_csr_t>(proc, CSR_MCOUNTEREN, counteren_mask, 0));
-  add_csr(CSR_MCOUNTINHIBIT, mcountinhibit = std::make_shared<masked_csr_t>(proc, CSR_MCOUNTINHIBIT, counteren_mask & (~MCOUNTEREN_TIME), 0));
-  add_supervisor_csr(CSR_SCOUNTEREN, scounteren = std::make_shared<masked_csr_t>(proc, CSR_SCOUNTEREN, counteren_mask, 0));
-  nonvirtual_sepc = std::make_shared<epc_csr_t>(proc, CSR_SEPC);
-  add_hypervisor_csr(CSR_VSEPC, vsepc = std::make_shared<epc_csr_t>(proc, CSR_VSEPC));
-  add_supervisor_csr(CSR_SEPC, sepc = std::make_shared<virtualized_csr_t>(proc, nonvirtual_sepc, vsepc));
-  nonvirtual_stval = std::make_shared<basic_csr_t>(proc, CSR_STVAL, 0);
-  add_hypervisor_csr(CSR_VSTVAL, vstval = std::make_shared<basic_csr_t>(proc, CSR_VSTVAL, 0));
-  add_supervisor_csr(CSR_STVAL, stval = std::make_shared<virtualized_csr_t>(proc, nonvirtual_stval, vstval));
-  auto sscratch = std::make_shared<basic_csr_t>(proc, CSR_SSCRATCH, 0);
-  auto vsscratch = std::make_shared<basic_csr_t>(proc, CSR_VSSCRATCH, 0);
+  add_user_csr(CSR_MCOUNTEREN, mcounteren = make_csr<masked_csr_t>(proc, CSR_MCOUNTEREN, counteren_mask, 0));
+  add_csr(CSR_MCOUNTINHIBIT, mcountinhibit = make_csr<masked_csr_t>(proc, CSR_MCOUNTINHIBIT, counteren_mask & (~MCOUNTEREN_TIME), 0));
+  add_supervisor_csr(CSR_SCOUNTEREN, scounteren = make_csr<masked_csr_t>(proc, CSR_SCOUNTEREN, counteren_mask, 0));
+  nonvirtual_sepc = make_csr<epc_csr_t>(proc, CSR_SEPC);
+  add_hypervisor_csr(CSR_VSEPC, vsepc = make_csr<epc_csr_t>(proc, CSR_VSEPC));
+  add_supervisor_csr(CSR_SEPC, sepc = make_csr<virtualized_csr_t>(proc, nonvirtual_sepc, vsepc));
+  nonvirtual_stval = make_csr<basic_csr_t>(proc, CSR_STVAL, 0);
+  add_hypervisor_csr(CSR_VSTVAL, vstval = make_csr<basic_csr_t>(proc, CSR_VSTVAL, 0));
+  add_supervisor_csr(CSR_STVAL, stval = make_csr<virtualized_csr_t>(proc, nonvirtual_stval, vstval));
+  auto sscratch = make_csr<basic_csr_t>(proc, CSR_SSCRATCH, 0);
+  auto vsscratch = make_csr<basic_csr_t>(proc, CSR_VSSCRATCH, 0);
   // Note: if max_isa does not include H, we don't really need this virtualized_csr_t at all (though it doesn't hurt):
-  add_supervisor_csr(CSR_SSCRATCH, std::make_shared<virtualized_csr_t>(proc, sscratch, vsscratch));
+  add_supervisor_csr(CSR_SSCRATCH, make_csr<virtualized_csr_t>(proc, sscratch, vsscratch));
   add_hypervisor_csr(CSR_VSSCRATCH, vsscratch);
-  nonvirtual_stvec = std::make_shared<tvec_csr_t>(proc, CSR_STVEC);
-  add_hypervisor_csr(CSR_VSTVEC, vstvec = std::make_shared<tvec_csr_t>(proc, CSR_VSTVEC));
-  add_supervisor_csr(CSR_STVEC, stvec = std::make_shared<virtualized_csr_t>(proc, nonvirtual_stvec, vstvec));
-  auto nonvirtual_satp = std::make_shared<satp_csr_t>(proc, CSR_SATP);
-  add_hypervisor_csr(CSR_VSATP, vsatp = std::make_shared<base_atp_csr_t>(proc, CSR_VSATP));
-  add_supervisor_csr(CSR_SATP, satp = std::make_shared<virtualized_satp_csr_t>(proc, nonvirtual_satp, vsatp));
-  nonvirtual_scause = std::make_shared<cause_csr_t>(proc, CSR_SCAUSE);
-  add_hypervisor_csr(CSR_VSCAUSE, vscause = std::make_shared<cause_csr_t>(proc, CSR_VSCAUSE));
-  add_supervisor_csr(CSR_SCAUSE, scause = std::make_shared<virtualized_csr_t>(proc, nonvirtual_scause, vscause));
-  mtval2 = std::make_shared<mtval2_csr_t>(proc, CSR_MTVAL2);
+  nonvirtual_stvec = make_csr<tvec_csr_t>(proc, CSR_STVEC);
+  add_hypervisor_csr(CSR_VSTVEC, vstvec = make_csr<tvec_csr_t>(proc, CSR_VSTVEC));
+  add_supervisor_csr(CSR_STVEC, stvec = make_csr<virtualized_csr_t>(proc, nonvirtual_stvec, vstvec));
+  auto nonvirtual_satp = make_hot_csr<satp_csr_t>(proc, CSR_SATP);
+  add_hypervisor_csr(CSR_VSATP, vsatp = make_csr<base_atp_csr_t>(proc, CSR_VSATP));
+  add_supervisor_csr(CSR_SATP, satp = make_hot_csr<virtualized_satp_csr_t>(proc, nonvirtual_satp, vsatp));
+  nonvirtual_scause = make_csr<cause_csr_t>(proc, CSR_SCAUSE);
+  add_hypervisor_csr(CSR_VSCAUSE, vscause = make_csr<cause_csr_t>(proc, CSR_VSCAUSE));
+  add_supervisor_csr(CSR_SCAUSE, scause = make_csr<virtualized_csr_t>(proc, nonvirtual_scause, vscause));
+  mtval2 = make_csr<mtval2_csr_t>(proc, CSR_MTVAL2);
   if (proc->extension_enabled('H') || proc->extension_enabled(EXT_SSDBLTRP))
     add_csr(CSR_MTVAL2, mtval2);
-  add_hypervisor_csr(CSR_MTINST, mtinst = std::make_shared<hypervisor_csr_t>(proc, CSR_MTINST));
-  add_hypervisor_csr(CSR_HSTATUS, hstatus = std::make_shared<hstatus_csr_t>(proc, CSR_HSTATUS));
-  add_hypervisor_csr(CSR_HGEIE, std::make_shared<const_csr_t>(proc, CSR_HGEIE, 0));
-  add_hypervisor_csr(CSR_HGEIP, std::make_shared<const_csr_t>(proc, CSR_HGEIP, 0));
-  hideleg = std::make_shared<hideleg_csr_t>(proc, CSR_HIDELEG, mideleg);
+  add_hypervisor_csr(CSR_MTINST, mtinst = make_csr<hypervisor_csr_t>(proc, CSR_MTINST));
+  add_hypervisor_csr(CSR_HSTATUS, hstatus = make_csr<hstatus_csr_t>(proc, CSR_HSTATUS));
+  add_hypervisor_csr(CSR_HGEIE, make_csr<const_csr_t>(proc, CSR_HGEIE, 0));
+  add_hypervisor_csr(CSR_HGEIP, make_csr<const_csr_t>(proc, CSR_HGEIP, 0));
+  hideleg = make_csr<hideleg_csr_t>(proc, CSR_HIDELEG, mideleg);
   if (xlen == 32 && proc->extension_enabled_const(EXT_SSAIA)) {
-    add_hypervisor_csr(CSR_HIDELEG, std::make_shared<rv32_low_csr_t>(proc, CSR_HIDELEG, hideleg));
-    add_hypervisor_csr(CSR_HIDELEGH, std::make_shared<aia_rv32_high_csr_t>(proc, CSR_HIDELEGH, hideleg));
+    add_hypervisor_csr(CSR_HIDELEG, make_csr<rv32_low_csr_t>(proc, CSR_HIDELEG, hideleg));
+    add_hypervisor_csr(CSR_HIDELEGH, make_csr<aia_rv32_high_csr_t>(proc, CSR_HIDELEGH, hideleg));
   } else {
     add_hypervisor_csr(CSR_HIDELEG, hideleg);
   }
@@ -239,77 +248,77 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
     (1 << CAUSE_STORE_PAGE_FAULT) |
     (1 << CAUSE_SOFTWARE_CHECK_FAULT) |
     (1 << CAUSE_HARDWARE_ERROR_FAULT);
-  add_hypervisor_csr(CSR_HEDELEG, hedeleg = std::make_shared<masked_csr_t>(proc, CSR_HEDELEG, hedeleg_mask, 0));
-  add_hypervisor_csr(CSR_HCOUNTEREN, hcounteren = std::make_shared<masked_csr_t>(proc, CSR_HCOUNTEREN, counteren_mask, 0));
-  htimedelta = std::make_shared<basic_csr_t>(proc, CSR_HTIMEDELTA, 0);
+  add_hypervisor_csr(CSR_HEDELEG, hedeleg = make_csr<masked_csr_t>(proc, CSR_HEDELEG, hedeleg_mask, 0));
+  add_hypervisor_csr(CSR_HCOUNTEREN, hcounteren = make_csr<masked_csr_t>(proc, CSR_HCOUNTEREN, counteren_mask, 0));
+  htimedelta = make_csr<basic_csr_t>(proc, CSR_HTIMEDELTA, 0);
   if (xlen == 32) {
-    add_hypervisor_csr(CSR_HTIMEDELTA, std::make_shared<rv32_low_csr_t>(proc, CSR_HTIMEDELTA, htimedelta));
-    add_hypervisor_csr(CSR_HTIMEDELTAH, std::make_shared<rv32_high_csr_t>(proc, CSR_HTIMEDELTAH, htimedelta));
+    add_hypervisor_csr(CSR_HTIMEDELTA, make_csr<rv32_low_csr_t>(proc, CSR_HTIMEDELTA, htimedelta));
+    add_hypervisor_csr(CSR_HTIMEDELTAH, make_csr<rv32_high_csr_t>(proc, CSR_HTIMEDELTAH, htimedelta));
   } else {
     add_hypervisor_csr(CSR_HTIMEDELTA, htimedelta);
   }
-  add_hypervisor_csr(CSR_HTVAL, htval = std::make_shared<basic_csr_t>(proc, CSR_HTVAL, 0));
-  add_hypervisor_csr(CSR_HTINST, htinst = std::make_shared<basic_csr_t>(proc, CSR_HTINST, 0));
-  add_hypervisor_csr(CSR_HGATP, hgatp = std::make_shared<hgatp_csr_t>(proc, CSR_HGATP));
-  nonvirtual_sstatus = std::make_shared<sstatus_proxy_csr_t>(proc, CSR_SSTATUS, mstatus);
-  add_hypervisor_csr(CSR_VSSTATUS, vsstatus = std::make_shared<vsstatus_csr_t>(proc, CSR_VSSTATUS));
-  add_supervisor_csr(CSR_SSTATUS, sstatus = std::make_shared<sstatus_csr_t>(proc, nonvirtual_sstatus, vsstatus));
-
-  add_csr(CSR_DPC, dpc = std::make_shared<dpc_csr_t>(proc, CSR_DPC));
-  add_csr(CSR_DSCRATCH0, std::make_shared<debug_mode_csr_t>(proc, CSR_DSCRATCH0));
-  add_csr(CSR_DSCRATCH1, std::make_shared<debug_mode_csr_t>(proc, CSR_DSCRATCH1));
-  add_csr(CSR_DCSR, dcsr = std::make_shared<dcsr_csr_t>(proc, CSR_DCSR));
-
-  add_csr(CSR_TSELECT, tselect = std::make_shared<tselect_csr_t>(proc, CSR_TSELECT));
+  add_hypervisor_csr(CSR_HTVAL, htval = make_csr<basic_csr_t>(proc, CSR_HTVAL, 0));
+  add_hypervisor_csr(CSR_HTINST, htinst = make_csr<basic_csr_t>(proc, CSR_HTINST, 0));
+  add_hypervisor_csr(CSR_HGATP, hgatp = make_csr<hgatp_csr_t>(proc, CSR_HGATP));
+  nonvirtual_sstatus = make_csr<sstatus_proxy_csr_t>(proc, CSR_SSTATUS, mstatus);
+  add_hypervisor_csr(CSR_VSSTATUS, vsstatus = make_csr<vsstatus_csr_t>(proc, CSR_VSSTATUS));
+  add_supervisor_csr(CSR_SSTATUS, sstatus = make_csr<sstatus_csr_t>(proc, nonvirtual_sstatus, vsstatus));
+
+  add_csr(CSR_DPC, dpc = make_csr<dpc_csr_t>(proc, CSR_DPC));
+  add_csr(CSR_DSCRATCH0, make_csr<debug_mode_csr_t>(proc, CSR_DSCRATCH0));
+  add_csr(CSR_DSCRATCH1, make_csr<debug_mode_csr_t>(proc, CSR_DSCRATCH1));
+  add_csr(CSR_DCSR, dcsr = make_csr<dcsr_csr_t>(proc, CSR_DCSR));
+
+  add_csr(CSR_TSELECT, tselect = make_csr<tselect_csr_t>(proc, CSR_TSELECT));
   if (proc->get_cfg().trigger_count > 0) {
-    add_csr(CSR_TDATA1, std::make_shared<tdata1_csr_t>(proc, CSR_TDATA1));
-    add_csr(CSR_TDATA2, tdata2 = std::make_shared<tdata2_csr_t>(proc, CSR_TDATA2));
-    add_csr(CSR_TDATA3, std::make_shared<tdata3_csr_t>(proc, CSR_TDATA3));
-    add_csr(CSR_TINFO, std::make_shared<tinfo_csr_t>(proc, CSR_TINFO));
+    add_csr(CSR_TDATA1, make_csr<tdata1_csr_t>(proc, CSR_TDATA1));
+    add_csr(CSR_TDATA2, tdata2 = make_csr<tdata2_csr_t>(proc, CSR_TDATA2));
+    add_csr(CSR_TDATA3, make_csr<tdata3_csr_t>(proc, CSR_TDATA3));
+    add_csr(CSR_TINFO, make_csr<tinfo_csr_t>(proc, CSR_TINFO));
     if (!proc->extension_enabled_const('S')) {
-      add_csr(CSR_TCONTROL, tcontrol = std::make_shared<masked_csr_t>(proc, CSR_TCONTROL, CSR_TCONTROL_MPTE | CSR_TCONTROL_MTE, 0));
+      add_csr(CSR_TCONTROL, tcontrol = make_csr<masked_csr_t>(proc, CSR_TCONTROL, CSR_TCONTROL_MPTE | CSR_TCONTROL_MTE, 0));
     }
   } else {
-    add_csr(CSR_TDATA1, std::make_shared<const_csr_t>(proc, CSR_TDATA1, 0));
-    add_csr(CSR_TDATA2, tdata2 = std::make_shared<const_csr_t>(proc, CSR_TDATA2, 0));
-    add_csr(CSR_TDATA3, std::make_shared<const_csr_t>(proc, CSR_TDATA3, 0));
-    add_csr(CSR_TINFO, std::make_shared<const_csr_t>(proc, CSR_TINFO, 0));
+    add_csr(CSR_TDATA1, make_csr<const_csr_t>(proc, CSR_TDATA1, 0));
+    add_csr(CSR_TDATA2, tdata2 = make_csr<const_csr_t>(proc, CSR_TDATA2, 0));
+    add_csr(CSR_TDATA3, make_csr<const_csr_t>(proc, CSR_TDATA3, 0));
+    add_csr(CSR_TINFO, make_csr<const_csr_t>(proc, CSR_TINFO, 0));
   }
   unsigned scontext_length = (xlen == 32 ? 16 : 32); // debug spec suggests 16-bit for RV32 and 32-bit for RV64
-  add_supervisor_csr(CSR_SCONTEXT, scontext = std::make_shared<masked_csr_t>(proc, CSR_SCONTEXT, (reg_t(1) << scontext_length) - 1, 0));
+  add_supervisor_csr(CSR_SCONTEXT, scontext = make_csr<masked_csr_t>(proc, CSR_SCONTEXT, (reg_t(1) << scontext_length) - 1, 0));
   unsigned hcontext_length = (xlen == 32 ? 6 : 13) + (proc->extension_enabled('H') ? 1 : 0); // debug spec suggest 7-bit (6-bit) for RV32 and 14-bit (13-bit) for RV64 with (without) H extension
-  auto hcontext = std::make_shared<masked_csr_t>(proc, CSR_HCONTEXT, (reg_t(1) << hcontext_length) - 1, 0);
+  auto hcontext = make_csr<masked_csr_t>(proc, CSR_HCONTEXT, (reg_t(1) << hcontext_length) - 1, 0);
   add_hypervisor_csr(CSR_HCONTEXT, hcontext);
-  add_csr(CSR_MCONTEXT, mcontext = std::make_shared<proxy_csr_t>(proc, CSR_MCONTEXT, hcontext));
+  add_csr(CSR_MCONTEXT, mcontext = make_csr<proxy_csr_t>(proc, CSR_MCONTEXT, hcontext));
 
-  mseccfg = std::make_shared<mseccfg_csr_t>(proc, CSR_MSECCFG);
+  mseccfg = make_csr<mseccfg_csr_t>(proc, CSR_MSECCFG);
   if (xlen == 32) {
-    add_csr(CSR_MSECCFG, std::make_shared<rv32_low_csr_t>(proc, CSR_MSECCFG, mseccfg));
-    add_csr(CSR_MSECCFGH, mseccfgh = std::make_shared<rv32_high_csr_t>(proc, CSR_MSECCFGH, mseccfg));
+    add_csr(CSR_MSECCFG, make_csr<rv32_low_csr_t>(proc, CSR_MSECCFG, mseccfg));
+    add_csr(CSR_MSECCFGH, mseccfgh = make_csr<rv32_high_csr_t>(proc, CSR_MSECCFGH, mseccfg));
   } else {
     add_csr(CSR_MSECCFG, mseccfg);
   }
 
   for (int i = 0; i < max_pmp; ++i) {
-    add_csr(CSR_PMPADDR0 + i, pmpaddr[i] = std::make_shared<pmpaddr_csr_t>(proc, CSR_PMPADDR0 + i));
+    add_csr(CSR_PMPADDR0 + i, pmpaddr[i] = make_csr<pmpaddr_csr_t>(proc, CSR_PMPADDR0 + i));
   }
   for (int i = 0; i < max_pmp; i += xlen / 8) {
     reg_t addr = CSR_PMPCFG0 + i / 4;
-    add_csr(addr, std::make_shared<pmpcfg_csr_t>(proc, addr));
+    add_csr(addr, make_csr<pmpcfg_csr_t>(proc, addr));
   }
 
-  add_csr(CSR_FFLAGS, fflags = std::make_shared<float_csr_t>(proc, CSR_FFLAGS, FSR_AEXC >> FSR_AEXC_SHIFT, 0));
-  add_csr(CSR_FRM, frm = std::make_shared<float_csr_t>(proc, CSR_FRM, FSR_RD >> FSR_RD_SHIFT, 0));
+  add_csr(CSR_FFLAGS, fflags = make_csr<float_csr_t>(proc, CSR_FFLAGS, FSR_AEXC >> FSR_AEXC_SHIFT, 0));
+  add_csr(CSR_FRM, frm = make_csr<float_csr_t>(proc, CSR_FRM, FSR_RD >> FSR_RD_SHIFT, 0));
   assert(FSR_AEXC_SHIFT == 0);  // composite_csr_t assumes fflags begins at bit 0
-  add_csr(CSR_FCSR, std::make_shared<composite_csr_t>(proc, CSR_FCSR, frm, fflags, FSR_RD_SHIFT));
+  add_csr(CSR_FCSR, make_csr<composite_csr_t>(proc, CSR_FCSR, frm, fflags, FSR_RD_SHIFT));
 
-  add_ext_csr(EXT_ZKR, CSR_SEED, std::make_shared<seed_csr_t>(proc, CSR_SEED));
+  add_ext_csr(EXT_ZKR, CSR_SEED, make_csr<seed_csr_t>(proc, CSR_SEED));
 
-  add_csr(CSR_MARCHID, std::make_shared<const_csr_t>(proc, CSR_MARCHID, 5));
-  add_csr(CSR_MIMPID, std::make_shared<const_csr_t>(proc, CSR_MIMPID, 0));
-  add_csr(CSR_MVENDORID, std::make_shared<const_csr_t>(proc, CSR_MVENDORID, 0));
-  add_csr(CSR_MHARTID, std::make_shared<const_csr_t>(proc, CSR_MHARTID, proc->get_id()));
-  add_csr(CSR_MCONFIGPTR, std::make_shared<const_csr_t>(proc, CSR_MCONFIGPTR, 0));
+  add_csr(CSR_MARCHID, make_csr<const_csr_t>(proc, CSR_MARCHID, 5));
+  add_csr(CSR_MIMPID, make_csr<const_csr_t>(proc, CSR_MIMPID, 0));
+  add_csr(CSR_MVENDORID, make_csr<const_csr_t>(proc, CSR_MVENDORID, 0));
+  add_csr(CSR_MHARTID, make_csr<const_csr_t>(proc, CSR_MHARTID, proc->get_id()));
+  add_csr(CSR_MCONFIGPTR, make_csr<const_csr_t>(proc, CSR_MCONFIGPTR, 0));
   const reg_t menvcfg_mask = (proc->extension_enabled(EXT_ZICBOM) ? MENVCFG_CBCFE | MENVCFG_CBIE : 0) |
                             (proc->extension_enabled(EXT_ZICBOZ) ? MENVCFG_CBZE : 0) |
                             (proc->extension_enabled(EXT_SMNPM) ? MENVCFG_PMM : 0) |
@@ -320,10 +329,10 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
                             (proc->extension_enabled(EXT_ZICFISS) ? MENVCFG_SSE : 0) |
                             (proc->extension_enabled(EXT_SSDBLTRP) ? MENVCFG_DTE : 0)|
                             (proc->extension_enabled(EXT_SMCDELEG) ? MENVCFG_CDE : 0);
-  menvcfg = std::make_shared<envcfg_csr_t>(proc, CSR_MENVCFG, menvcfg_mask, 0);
+  menvcfg = make_csr<envcfg_csr_t>(proc, CSR_MENVCFG, menvcfg_mask, 0);
   if (xlen == 32) {
-    add_user_csr(CSR_MENVCFG, std::make_shared<rv32_low_csr_t>(proc, CSR_MENVCFG, menvcfg));
-    add_user_csr(CSR_MENVCFGH, std::make_shared<rv32_high_csr_t>(proc, CSR_MENVCFGH, menvcfg));
+    add_user_csr(CSR_MENVCFG, make_csr<rv32_low_csr_t>(proc, CSR_MENVCFG, menvcfg));
+    add_user_csr(CSR_MENVCFGH, make_csr<rv32_high_csr_t>(proc, CSR_MENVCFGH, menvcfg));
   } else {
     add_user_csr(CSR_MENVCFG, menvcfg);
   }
@@ -332,7 +341,7 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
                             (proc->extension_enabled(EXT_SSNPM) ? SENVCFG_PMM : 0) |
                             (proc->extension_enabled(EXT_ZICFILP) ? SENVCFG_LPE : 0) |
                             (proc->extension_enabled(EXT_ZICFISS) ? SENVCFG_SSE : 0);
-  add_supervisor_csr(CSR_SENVCFG, senvcfg = std::make_shared<senvcfg_csr_t>(proc, CSR_SENVCFG, senvcfg_mask, 0));
+  add_supervisor_csr(CSR_SENVCFG, senvcfg = make_csr<senvcfg_csr_t>(proc, CSR_SENVCFG, senvcfg_mask, 0));
   const reg_t henvcfg_mask = (proc->extension_enabled(EXT_ZICBOM) ? HENVCFG_CBCFE | HENVCFG_CBIE : 0) |
                             (proc->extension_enabled(EXT_ZICBOZ) ? HENVCFG_CBZE : 0) |
                             (proc->extension_enabled(EXT_SSNPM) ? HENVCFG_PMM : 0) |
@@ -342,10 +351,10 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
                             (proc->extension_enabled(EXT_ZICFILP) ? HENVCFG_LPE : 0) |
                             (proc->extension_enabled(EXT_ZICFISS) ? HENVCFG_SSE : 0) |
                             (proc->extension_enabled(EXT_SSDBLTRP) ? HENVCFG_DTE : 0);
-  henvcfg = std::make_shared<henvcfg_csr_t>(proc, CSR_HENVCFG, henvcfg_mask, 0, menvcfg);
+  henvcfg = make_csr<henvcfg_csr_t>(proc, CSR_HENVCFG, henvcfg_mask, 0, menvcfg);
   if (xlen == 32) {
-    add_hypervisor_csr(CSR_HENVCFG, std::make_shared<rv32_low_csr_t>(proc, CSR_HENVCFG, henvcfg));
-    add_hypervisor_csr(CSR_HENVCFGH, std::make_shared<rv32_high_csr_t>(proc, CSR_HENVCFGH, henvcfg));
+    add_hypervisor_csr(CSR_HENVCFG, make_csr<rv32_low_csr_t>(proc, CSR_HENVCFG, henvcfg));
+    add_hypervisor_csr(CSR_HENVCFGH, make_csr<rv32_high_csr_t>(proc, CSR_HENVCFGH, henvcfg));
   } else {
     add_hypervisor_csr(CSR_HENVCFG, henvcfg);
   }
@@ -357,86 +366,86 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
     const reg_t mstateen0_mask = hstateen0_mask | (proc->extension_enabled(EXT_SSQOSID) ?  MSTATEEN0_PRIV114 : 0);
     for (int i = 0; i < 4; i++) {
       const reg_t mstateen_mask = i == 0 ? mstateen0_mask : MSTATEEN_HSTATEEN;
-      mstateen[i] = std::make_shared<masked_csr_t>(proc, CSR_MSTATEEN0 + i, mstateen_mask, 0);
+      mstateen[i] = make_csr<masked_csr_t>(proc, CSR_MSTATEEN0 + i, mstateen_mask, 0);
       if (xlen == 32) {
-        add_csr(CSR_MSTATEEN0 + i, std::make_shared<rv32_low_csr_t>(proc, CSR_MSTATEEN0 + i, mstateen[i]));
-        add_csr(CSR_MSTATEEN0H + i, std::make_shared<rv32_high_csr_t>(proc, CSR_MSTATEEN0H + i, mstateen[i]));
+        add_csr(CSR_MSTATEEN0 + i, make_csr<rv32_low_csr_t>(proc, CSR_MSTATEEN0 + i, mstateen[i]));
+        add_csr(CSR_MSTATEEN0H + i, make_csr<rv32_high_csr_t>(proc, CSR_MSTATEEN0H + i, mstateen[i]));
       } else {
         add_csr(CSR_MSTATEEN0 + i, mstateen[i]);
       }
 
       const reg_t hstateen_mask = i == 0 ? hstateen0_mask : HSTATEEN_SSTATEEN;
-      hstateen[i] = std::make_shared<hstateen_csr_t>(proc, CSR_HSTATEEN0 + i, hstateen_mask, 0, i);
+      hstateen[i] = make_csr<hstateen_csr_t>(proc, CSR_HSTATEEN0 + i, hstateen_mask, 0, i);
       if (xlen == 32) {
-        add_hypervisor_csr(CSR_HSTATEEN0 + i, std::make_shared<rv32_low_csr_t>(proc, CSR_HSTATEEN0 + i, hstateen[i]));
-        add_hypervisor_csr(CSR_HSTATEEN0H + i, std::make_shared<rv32_high_csr_t>(proc, CSR_HSTATEEN0H + i, hstateen[i]));
+        add_hypervisor_csr(CSR_HSTATEEN0 + i, make_csr<rv32_low_csr_t>(proc, CSR_HSTATEEN0 + i, hstateen[i]));
+        add_hypervisor_csr(CSR_HSTATEEN0H + i, make_csr<rv32_high_csr_t>(proc, CSR_HSTATEEN0H + i, hstateen[i]));
       } else {
         add_hypervisor_csr(CSR_HSTATEEN0 + i, hstateen[i]);
       }
 
       const reg_t sstateen_mask = i == 0 ? sstateen0_mask : 0;
-      add_supervisor_csr(CSR_SSTATEEN0 + i, sstateen[i] = std::make_shared<sstateen_csr_t>(proc, CSR_SSTATEEN0 + i, sstateen_mask, 0, i));
+      add_supervisor_csr(CSR_SSTATEEN0 + i, sstateen[i] = make_csr<sstateen_csr_t>(proc, CSR_SSTATEEN0 + i, sstateen_mask, 0, i));
     }
   }
 
   if (proc->extension_enabled_const(EXT_SMRNMI)) {
-    add_csr(CSR_MNSCRATCH, std::make_shared<basic_csr_t>(proc, CSR_MNSCRATCH, 0));
-    add_csr(CSR_MNEPC, mnepc = std::make_shared<epc_csr_t>(proc, CSR_MNEPC));
-    add_csr(CSR_MNCAUSE, std::make_shared<const_csr_t>(proc, CSR_MNCAUSE, (reg_t)1 << (xlen - 1)));
-    add_csr(CSR_MNSTATUS, mnstatus = std::make_shared<mnstatus_csr_t>(proc, CSR_MNSTATUS));
+    add_csr(CSR_MNSCRATCH, make_csr<basic_csr_t>(proc, CSR_MNSCRATCH, 0));
+    add_csr(CSR_MNEPC, mnepc = make_csr<epc_csr_t>(proc, CSR_MNEPC));
+    add_csr(CSR_MNCAUSE, make_csr<const_csr_t>(proc, CSR_MNCAUSE, (reg_t)1 << (xlen - 1)));
+    add_csr(CSR_MNSTATUS, mnstatus = make_csr<mnstatus_csr_t>(proc, CSR_MNSTATUS));
   }
 
   if (proc->extension_enabled_const(EXT_SSTC)) {
-    stimecmp = std::make_shared<stimecmp_csr_t>(proc, CSR_STIMECMP, MIP_STIP);
-    vstimecmp = std::make_shared<stimecmp_csr_t>(proc, CSR_VSTIMECMP, MIP_VSTIP);
-    auto virtualized_stimecmp = std::make_shared<virtualized_with_special_permission_csr_t>(proc, stimecmp, vstimecmp);
+    stimecmp = make_csr<stimecmp_csr_t>(proc, CSR_STIMECMP, MIP_STIP);
+    vstimecmp = make_csr<stimecmp_csr_t>(proc, CSR_VSTIMECMP, MIP_VSTIP);
+    auto virtualized_stimecmp = make_csr<virtualized_with_special_permission_csr_t>(proc, stimecmp, vstimecmp);
     if (xlen == 32) {
-      add_supervisor_csr(CSR_STIMECMP, std::make_shared<rv32_low_csr_t>(proc, CSR_STIMECMP, virtualized_stimecmp));
-      add_supervisor_csr(CSR_STIMECMPH, std::make_shared<rv32_high_csr_t>(proc, CSR_STIMECMPH, virtualized_stimecmp));
-      add_hypervisor_csr(CSR_VSTIMECMP, std::make_shared<rv32_low_csr_t>(proc, CSR_VSTIMECMP, vstimecmp));
-      add_hypervisor_csr(CSR_VSTIMECMPH, std::make_shared<rv32_high_csr_t>(proc, CSR_VSTIMECMPH, vstimecmp));
+      add_supervisor_csr(CSR_STIMECMP, make_csr<rv32_low_csr_t>(proc, CSR_STIMECMP, virtualized_stimecmp));
+      add_supervisor_csr(CSR_STIMECMPH, make_csr<rv32_high_csr_t>(proc, CSR_STIMECMPH, virtualized_stimecmp));
+      add_hypervisor_csr(CSR_VSTIMECMP, make_csr<rv32_low_csr_t>(proc, CSR_VSTIMECMP, vstimecmp));
+      add_hypervisor_csr(CSR_VSTIMECMPH, make_csr<rv32_high_csr_t>(proc, CSR_VSTIMECMPH, vstimecmp));
     } else {
       add_supervisor_csr(CSR_STIMECMP, virtualized_stimecmp);
       add_hypervisor_csr(CSR_VSTIMECMP, vstimecmp);
     }
   }
 
-  add_ext_csr(EXT_ZCMT, CSR_JVT, jvt = std::make_shared<jvt_csr_t>(proc, CSR_JVT, 0));
+  add_ext_csr(EXT_ZCMT, CSR_JVT, jvt = make_csr<jvt_csr_t>(proc, CSR_JVT, 0));
 
   const reg_t ssp_mask = -reg_t(xlen / 8);
-  add_ext_csr(EXT_ZICFISS, CSR_SSP, ssp = std::make_shared<ssp_csr_t>(proc, CSR_SSP, ssp_mask, 0));
+  add_ext_csr(EXT_ZICFISS, CSR_SSP, ssp = make_csr<ssp_csr_t>(proc, CSR_SSP, ssp_mask, 0));
 
   // Smcdeleg
   if (proc->extension_enabled_const(EXT_SMCDELEG) || proc->extension_enabled_const(EXT_SSCCFG)) {
-    add_supervisor_csr(CSR_SCOUNTINHIBIT, scountinhibit = std::make_shared<scntinhibit_csr_t>(proc, CSR_SCOUNTINHIBIT, mcountinhibit));
+    add_supervisor_csr(CSR_SCOUNTINHIBIT, scountinhibit = make_csr<scntinhibit_csr_t>(proc, CSR_SCOUNTINHIBIT, mcountinhibit));
   }
 
   // Smcsrind / Sscsrind
   if (proc->extension_enabled_const(EXT_SMCSRIND)) {
-    csr_t_p miselect = std::make_shared<basic_csr_t>(proc, CSR_MISELECT, 0);
+    csr_t_p miselect = make_csr<basic_csr_t>(proc, CSR_MISELECT, 0);
     add_csr(CSR_MISELECT, miselect);
 
     sscsrind_reg_csr_t::sscsrind_reg_csr_t_p mireg;
-    add_csr(CSR_MIREG, mireg = std::make_shared<sscsrind_reg_csr_t>(proc, CSR_MIREG, miselect));
+    add_csr(CSR_MIREG, mireg = make_csr<sscsrind_reg_csr_t>(proc, CSR_MIREG, miselect));
     add_ireg_proxy(proc, mireg);
     const reg_t mireg_csrs[] = { CSR_MIREG2, CSR_MIREG3, CSR_MIREG4, CSR_MIREG5, CSR_MIREG6 };
     for (auto csr : mireg_csrs)
-      add_csr(csr, std::make_shared<sscsrind_reg_csr_t>(proc, csr, miselect));
+      add_csr(csr, make_csr<sscsrind_reg_csr_t>(proc, csr, miselect));
   }
 
   if (proc->extension_enabled_const(EXT_SSCSRIND)) {
-    csr_t_p vsiselect = std::make_shared<siselect_csr_t>(proc, CSR_VSISELECT, 0);
+    csr_t_p vsiselect = make_csr<siselect_csr_t>(proc, CSR_VSISELECT, 0);
     add_hypervisor_csr(CSR_VSISELECT, vsiselect);
 
-    csr_t_p siselect = std::make_shared<siselect_csr_t>(proc, CSR_SISELECT, 0);
-    add_supervisor_csr(CSR_SISELECT, std::make_shared<virtualized_with_special_permission_csr_t>(proc, siselect, vsiselect));
+    csr_t_p siselect = make_csr<siselect_csr_t>(proc, CSR_SISELECT, 0);
+    add_supervisor_csr(CSR_SISELECT, make_csr<virtualized_with_special_permission_csr_t>(proc, siselect, vsiselect));
 
-    auto vsireg = std::make_shared<sscsrind_reg_csr_t>(proc, CSR_VSIREG, vsiselect);
+    auto vsireg = make_csr<sscsrind_reg_csr_t>(proc, CSR_VSIREG, vsiselect);
     add_hypervisor_csr(CSR_VSIREG, vsireg);
 
-    auto sireg = std::make_shared<sscsrind_reg_csr_t>(proc, CSR_SIREG, siselect);
+    auto sireg = make_csr<sscsrind_reg_csr_t>(proc, CSR_SIREG, siselect);
     add_ireg_proxy(proc, sireg);
-    add_supervisor_csr(CSR_SIREG, std::make_shared<virtualized_indirect_csr_t>(proc, sireg, vsireg));
+    add_supervisor_csr(CSR_SIREG, make_csr<virtualized_indirect_csr_t>(proc, sireg, vsireg));
     if (proc->extension_enabled(EXT_SSCCFG) || proc->extension_enabled(EXT_SMCDELEG)) {
       // case CSR_SIREG
       if (proc->extension_enabled_const(EXT_ZICNTR)) {
@@ -452,11 +461,11 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
     const reg_t vsireg_csrs[] = { CSR_VSIREG2, CSR_VSIREG3, CSR_VSIREG4, CSR_VSIREG5, CSR_VSIREG6 };
     const reg_t sireg_csrs[] = { CSR_SIREG2, CSR_SIREG3, CSR_SIREG4, CSR_SIREG5, CSR_SIREG6 };
     for (size_t i = 0; i < std::size(vsireg_csrs); i++) {
-      auto vsireg = std::make_shared<sscsrind_reg_csr_t>(proc, vsireg_csrs[i], vsiselect);
+      auto vsireg = make_csr<sscsrind_reg_csr_t>(proc, vsireg_csrs[i], vsiselect);
       add_hypervisor_csr(vsireg_csrs[i], vsireg);
 
-      auto sireg = std::make_shared<sscsrind_reg_csr_t>(proc, sireg_csrs[i], siselect);
-      add_supervisor_csr(sireg_csrs[i], std::make_shared<virtualized_indirect_csr_t>(proc, sireg, vsireg));
+      auto sireg = make_csr<sscsrind_reg_csr_t>(proc, sireg_csrs[i], siselect);
+      add_supervisor_csr(sireg_csrs[i], make_csr<virtualized_indirect_csr_t>(proc, sireg, vsireg));
 
       // Smcdeleg
       if (proc->extension_enabled(EXT_SSCCFG) || proc->extension_enabled(EXT_SMCDELEG)) {
@@ -505,10 +514,10 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
 
   if (proc->extension_enabled_const(EXT_SMCNTRPMF)) {
     if (xlen == 32) {
-      add_csr(CSR_MCYCLECFG, std::make_shared<rv32_low_csr_t>(proc, CSR_MCYCLECFG, mcyclecfg));
-      add_csr(CSR_MCYCLECFGH, std::make_shared<rv32_high_csr_t>(proc, CSR_MCYCLECFGH, mcyclecfg));
-      add_csr(CSR_MINSTRETCFG, std::make_shared<rv32_low_csr_t>(proc, CSR_MINSTRETCFG, minstretcfg));
-      add_csr(CSR_MINSTRETCFGH, std::make_shared<rv32_high_csr_t>(proc, CSR_MINSTRETCFGH, minstretcfg));
+      add_csr(CSR_MCYCLECFG, make_csr<rv32_low_csr_t>(proc, CSR_MCYCLECFG, mcyclecfg));
+      add_csr(CSR_MCYCLECFGH, make_csr<rv32_high_csr_t>(proc, CSR_MCYCLECFGH, mcyclecfg));
+      add_csr(CSR_MINSTRETCFG, make_csr<rv32_low_csr_t>(proc, CSR_MINSTRETCFG, minstretcfg));
+      add_csr(CSR_MINSTRETCFGH, make_csr<rv32_high_csr_t>(proc, CSR_MINSTRETCFGH, minstretcfg));
     } else {
       add_csr(CSR_MCYCLECFG, mcyclecfg);
       add_csr(CSR_MINSTRETCFG, minstretcfg);
@@ -516,39 +525,39 @@ void state_t::csr_init(processor_t* const proc, reg_t max_isa)
   }
 
   const reg_t srmcfg_mask = SRMCFG_MCID | SRMCFG_RCID;
-  add_const_ext_csr(EXT_SSQOSID, CSR_SRMCFG, std::make_shared<srmcfg_csr_t>(proc, CSR_SRMCFG, srmcfg_mask, 0));
+  add_const_ext_csr(EXT_SSQOSID, CSR_SRMCFG, make_csr<srmcfg_csr_t>(proc, CSR_SRMCFG, srmcfg_mask, 0));
 
-  mvien = std::make_shared<masked_csr_t>(proc, CSR_MVIEN, MIP_SEIP | MIP_SSIP, 0);
-  mvip = std::make_shared<mvip_csr_t>(proc, CSR_MVIP, 0);
+  mvien = make_csr<masked_csr_t>(proc, CSR_MVIEN, MIP_SEIP | MIP_SSIP, 0);
+  mvip = make_csr<mvip_csr_t>(proc, CSR_MVIP, 0);
   if (proc->extension_enabled_const(EXT_SMAIA)) {
-    add_csr(CSR_MTOPI, std::make_shared<mtopi_csr_t>(proc, CSR_MTOPI));
+    add_csr(CSR_MTOPI, make_csr<mtopi_csr_t>(proc, CSR_MTOPI));
     if (xlen == 32) {
-      add_supervisor_csr(CSR_MVIEN, std::make_shared<rv32_low_csr_t>(proc, CSR_MVIEN, mvien));
-      add_supervisor_csr(CSR_MVIENH, std::make_shared<rv32_high_csr_t>(proc, CSR_MVIENH, mvien));
-      add_supervisor_csr(CSR_MVIP, std::make_shared<rv32_low_csr_t>(proc, CSR_MVIP, mvip));
-      add_supervisor_csr(CSR_MVIPH, std::make_shared<rv32_high_csr_t>(proc, CSR_MVIPH, mvip));
+      add_supervisor_csr(CSR_MVIEN, make_csr<rv32_low_csr_t>(proc, CSR_MVIEN, mvien));
+      add_supervisor_csr(CSR_MVIENH, make_csr<rv32_high_csr_t>(proc, CSR_MVIENH, mvien));
+      add_supervisor_csr(CSR_MVIP, make_csr<rv32_low_csr_t>(proc, CSR_MVIP, mvip));
+      add_supervisor_csr(CSR_MVIPH, make_csr<rv32_high_csr_t>(proc, CSR_MVIPH, mvip));
     } else {
       add_supervisor_csr(CSR_MVIEN, mvien);
       add_supervisor_csr(CSR_MVIP, mvip);
     }
   }
 
-  hvictl = std::make_shared<aia_csr_t>(proc, CSR_HVICTL, HVICTL_VTI | HVICTL_IID | HVICTL_DPR | HVICTL_IPRIOM | HVICTL_IPRIO, 0);
-  vstopi = std::make_shared<vstopi_csr_t>(proc, CSR_VSTOPI);
+  hvictl = make_csr<aia_csr_t>(proc, CSR_HVICTL, HVICTL_VTI | HVICTL_IID | HVICTL_DPR | HVICTL_IPRIOM | HVICTL_IPRIO, 0);
+  vstopi = make_csr<vstopi_csr_t>(proc, CSR_VSTOPI);
   if (proc->extension_enabled_const(EXT_SSAIA)) { // Included by EXT_SMAIA
-    csr_t_p nonvirtual_stopi = std::make_shared<nonvirtual_stopi_csr_t>(proc, CSR_STOPI);
-    add_supervisor_csr(CSR_STOPI, std::make_shared<virtualized_with_special_permission_csr_t>(proc, nonvirtual_stopi, vstopi));
-    add_supervisor_csr(CSR_STOPEI, std::make_shared<inaccessible_csr_t>(proc, CSR_STOPEI));
-    auto hvien = std::make_shared<aia_csr_t>(proc, CSR_HVIEN, 0, 0);
-    auto hviprio1 = std::make_shared<aia_csr_t>(proc, CSR_HVIPRIO1, 0, 0);
-    auto hviprio2 = std::make_shared<aia_csr_t>(proc, CSR_HVIPRIO2, 0, 0);
+    csr_t_p nonvirtual_stopi = make_csr<nonvirtual_stopi_csr_t>(proc, CSR_STOPI);
+    add_supervisor_csr(CSR_STOPI, make_csr<virtualized_with_special_permission_csr_t>(proc, nonvirtual_stopi, vstopi));
+    add_supervisor_csr(CSR_STOPEI, make_csr<inaccessible_csr_t>(proc, CSR_STOPEI));
+    auto hvien = make_csr<aia_csr_t>(proc, CSR_HVIEN, 0, 0);
+    auto hviprio1 = make_csr<aia_csr_t>(proc, CSR_HVIPRIO1, 0, 0);
+    auto hviprio2 = make_csr<aia_csr_t>(proc, CSR_HVIPRIO2, 0, 0);
     if (xlen == 32) {
-      add_hypervisor_csr(CSR_HVIEN, std::make_shared<rv32_low_csr_t>(proc, CSR_HVIEN, hvien));
-      add_hypervisor_csr(CSR_HVIENH, std::make_shared<rv32_high_csr_t>(proc, CSR_HVIENH, hvien));
-      add_hypervisor_csr(CSR_HVIPRIO1, std::make_shared<rv32_low_csr_t>(proc, CSR_HVIPRIO1, hviprio1));
-      add_hypervisor_csr(CSR_HVIPRIO1H, std::make_shared<rv32_high_csr_t>(proc, CSR_HVIPRIO1H, hviprio1));
-      add_hypervisor_csr(CSR_HVIPRIO2, std::make_shared<rv32_low_csr_t>(proc, CSR_HVIPRIO2, hviprio2));
-      add_hypervisor_csr(CSR_HVIPRIO2H, std::make_shared<rv32_high_csr_t>(proc, CSR_HVIPRIO2H, hviprio2));
+      add_hypervisor_csr(CSR_HVIEN, make_csr<rv32_low_csr_t>(proc, CSR_HVIEN, hvien));
+      add_hypervisor_csr(CSR_HVIENH, make_csr<rv32_high_csr_t>(proc, CSR_HVIENH, hvien));
+      add_hypervisor_csr(CSR_HVIPRIO1, make_csr<rv32_low_csr_t>(proc, CSR_HVIPRIO1, hviprio1));
+      add_hypervisor_csr(CSR_HVIPRIO1H, make_csr<rv32_high_csr_t>(proc, CSR_HVIPRIO1H, hviprio1));
+      add_hypervisor_csr(CSR_HVIPRIO2, make_csr<rv32_low_csr_t>(proc, CSR_HVIPRIO2, hviprio2));
+      add_hypervisor_csr(CSR_HVIPRIO2H, make_csr<rv32_high_csr_t>(proc, CSR_HVIPRIO2H, hviprio2));
     } else {
       add_hypervisor_csr(CSR_HVIEN, hvien);
       add_hypervisor_csr(CSR_HVIPRIO1, hviprio1);
@@ -17,11 +17,42 @@
 #include "debug_defines.h"
 // For ctz:
 #include "arith.h"
+#include "input_log.h"
+#include "simif.h"
 
 // STATE macro used by require_privilege() macro:
 #undef STATE
 #define STATE (*state)
 
+// implement class csr_arena_t
+csr_arena_t::~csr_arena_t() {
+  for (auto chunk : chunks)
+    delete[] chunk;
+}
+
+void* csr_arena_t::allocate(size_t size, size_t align, bool hot) {
+  if (hot) {
+    size_t at = (hot_used + align - 1) & ~(align - 1);
+    if (at + size <= hot_size) {
+      hot_used = at + size;
+      return hot_region + at;
+    }
+  }
+  // chunks come from new[], so are aligned for anything but over-aligned types
+  assert(align <= alignof(std::max_align_t));
+  size_t at = (chunk_used + align - 1) & ~(align - 1);
+  if (size > chunk_size) {
+    chunks.insert(chunks.begin(), new char[size]);
+    return chunks.front();
+  }
+  if (at + size > chunk_size) {
+    chunks.push_back(new char[chunk_size]);
+    at = 0;
+  }
+  chunk_used = at + size;
+  return chunks.back() + at;
+}
+
 // implement class csr_t
 csr_t::csr_t(processor_t* const proc, const reg_t addr):
   proc(proc),
@@ -54,6 +85,8 @@ csr_t::~csr_t() {
 }
 
 void csr_t::write(const reg_t val) noexcept {
+  // any write may change what minstret and mcycle count
+  state->counters_dirty = true;
   const bool success = unlogged_write(val);
   if (success) {
     log_write();
@@ -125,7 +158,7 @@ bool pmpaddr_csr_t::unlogged_write(const reg_t val) noexcept {
   }
   else
     return false;
-  proc->get_mmu()->flush_tlb();
+  proc->get_mmu()->pmp_changed();
   return true;
 }
 
@@ -160,6 +193,19 @@ bool pmpaddr_csr_t::match4(reg_t addr) const noexcept {
   return ((addr ^ tor_paddr()) & napot_mask()) == 0;
 }
 
+std::optional<std::pair<reg_t, reg_t>> pmpaddr_csr_t::match_range() const noexcept {
+  if ((cfg & PMP_A) == 0) return std::nullopt;
+  bool is_tor = (cfg & PMP_A) == PMP_TOR;
+  if (is_tor) {
+    reg_t base = tor_base_paddr(), tor = tor_paddr();
+    if (base >= tor) return std::nullopt;
+    return std::make_pair(base, tor - 1);
+  }
+  // NAPOT or NA4:
+  reg_t base = tor_paddr() & napot_mask();
+  return std::make_pair(base, base | ~napot_mask());
+}
+
 bool pmpaddr_csr_t::subset_match(reg_t addr, reg_t len) const noexcept {
   if ((addr | len) & (len - 1))
     abort();
@@ -276,7 +322,7 @@ bool pmpcfg_csr_t::unlogged_write(const reg_t val) noexcept {
       write_success = true;
     }
   }
-  proc->get_mmu()->flush_tlb();
+  proc->get_mmu()->pmp_changed();
   return write_success;
 }
 
@@ -331,8 +377,6 @@ bool mseccfg_csr_t::unlogged_write(const reg_t val) noexcept {
 
     new_val |= (val & MSECCFG_MMWP);  //MMWP is sticky
     new_val |= (val & MSECCFG_MML);   //MML is sticky
-
-    proc->get_mmu()->flush_tlb();
   }
 
   if (proc->extension_enabled(EXT_ZKR)) {
@@ -351,7 +395,10 @@ bool mseccfg_csr_t::unlogged_write(const reg_t val) noexcept {
     new_val = set_field(new_val, MSECCFG_PMM, pmm != pmm_reserved ? pmm : 0);
   }
 
-  return basic_csr_t::unlogged_write(new_val);
+  bool ret = basic_csr_t::unlogged_write(new_val);
+  if (proc->n_pmp != 0)
+    proc->get_mmu()->pmp_changed();
+  return ret;
 }
 
 // implement class virtualized_csr_t
@@ -494,7 +541,10 @@ bool vsstatus_csr_t::unlogged_write(const reg_t val) noexcept {
 
   newval = (newval & SSTATUS_SDT) ? (newval & ~SSTATUS_SIE) : newval;
 
-  if (state->v) maybe_flush_tlb(newval);
+  if (state->v)
+    maybe_flush_tlb(newval);
+  else if ((newval ^ this->val) & (MSTATUS_SUM | MSTATUS_MXR))
+    proc->get_mmu()->flush_guest_tlb();  // HLV/HSV translations depend on them
   this->val = adjust_sd(newval);
   return true;
 }
@@ -787,6 +837,7 @@ reg_t mip_or_mie_csr_t::read() const noexcept {
 
 void mip_or_mie_csr_t::write_with_mask(const reg_t mask, const reg_t val) noexcept {
   this->val = (this->val & ~mask) | (val & mask);
+  state->irq_maybe_pending = true;
   log_write();
 }
 
@@ -811,6 +862,7 @@ reg_t mip_csr_t::read() const noexcept {
 
 void mip_csr_t::backdoor_write_with_mask(const reg_t mask, const reg_t val) noexcept {
   this->val = (this->val & ~mask) | (val & mask);
+  state->irq_maybe_pending = true;
 }
 
 reg_t mip_csr_t::write_mask() const noexcept {
@@ -1057,6 +1109,9 @@ bool envcfg_csr_t::unlogged_write(const reg_t val) noexcept {
 
   if (get_field(adjusted_val, MENVCFG_PMM) != get_field(read(), MENVCFG_PMM))
     proc->get_mmu()->flush_tlb();
+  // G-stage walks check menvcfg.PBMTE
+  if (address == CSR_MENVCFG && ((adjusted_val ^ read()) & MENVCFG_PBMTE))
+    proc->get_mmu()->flush_gstage();
 
   return masked_csr_t::unlogged_write(adjusted_val);
 }
@@ -1146,18 +1201,24 @@ bool virtualized_satp_csr_t::unlogged_write(const reg_t val) noexcept {
 }
 
 // implement class wide_counter_csr_t
-wide_counter_csr_t::wide_counter_csr_t(processor_t* const proc, const reg_t addr, smcntrpmf_csr_t_p config_csr):
+wide_counter_csr_t::wide_counter_csr_t(processor_t* const proc, const reg_t addr, smcntrpmf_csr_t_p config_csr,
+                                       const reg_t inhibit_mask):
   csr_t(proc, addr),
   val(0),
+  base(state->lazy_retired),
+  lazy(false),  // decided by the first bump(), as state_t::reset requests
   written(false),
-  config_csr(config_csr) {
+  config_csr(config_csr),
+  inhibit_mask(inhibit_mask) {
 }
 
 reg_t wide_counter_csr_t::read() const noexcept {
-  return val;
+  return lazy ? val + (state->lazy_retired - base) : val;
 }
 
 void wide_counter_csr_t::bump(const reg_t howmuch) noexcept {
+  val = read();
+  base = state->lazy_retired;
   if (written) {
     // Because writing a CSR serializes the simulator, howmuch should
     // reflect exactly one instruction: the explicit CSR write.
@@ -1171,6 +1232,7 @@ void wide_counter_csr_t::bump(const reg_t howmuch) noexcept {
   }
   // Clear cached value
   config_csr->reset_prev();
+  lazy = is_counting_lazily();
 }
 
 bool wide_counter_csr_t::unlogged_write(const reg_t val) noexcept {
@@ -1180,6 +1242,7 @@ bool wide_counter_csr_t::unlogged_write(const reg_t val) noexcept {
   written = true;
 
   this->val = val;
+  base = state->lazy_retired;
   return true;
 }
 
@@ -1197,6 +1260,18 @@ bool wide_counter_csr_t::is_counting_enabled() const noexcept {
   return (config_csr->read_prev() & mask) == 0;
 }
 
+bool wide_counter_csr_t::is_counting_lazily() const noexcept {
+  if (state->mcountinhibit->read() & inhibit_mask)
+    return false;
+  auto mask = MHPMEVENT_MINH;
+  if (state->prv == PRV_S) {
+    mask = state->v ? MHPMEVENT_VSINH : MHPMEVENT_SINH;
+  } else if (state->prv == PRV_U) {
+    mask = state->v ? MHPMEVENT_VUINH : MHPMEVENT_UINH;
+  }
+  return (config_csr->read() & mask) == 0;
+}
+
 // implement class time_counter_csr_t
 time_counter_csr_t::time_counter_csr_t(processor_t* const proc, const reg_t addr):
   csr_t(proc, addr),
@@ -1319,6 +1394,7 @@ void hgatp_csr_t::verify_permissions(insn_t insn, bool write) const {
 
 bool hgatp_csr_t::unlogged_write(const reg_t val) noexcept {
   proc->get_mmu()->flush_tlb();
+  proc->get_mmu()->flush_gstage();
 
   reg_t mask;
   if (proc->get_const_xlen() == 32) {
@@ -1562,6 +1638,8 @@ void seed_csr_t::verify_permissions(insn_t insn, bool write) const {
 }
 
 reg_t seed_csr_t::read() const noexcept {
+  if (input_log_t* log = proc->get_sim()->input_log)
+    return log->seed([this] { return proc->es.get_seed(); });
   return proc->es.get_seed();
 }
 
@@ -1992,6 +2070,7 @@ reg_t hvip_csr_t::read() const noexcept {
 
 bool hvip_csr_t::unlogged_write(const reg_t val) noexcept {
   state->mip->write_with_mask(MIP_VSSIP, val); // hvip.VSSIP is an alias of mip.VSSIP
+  state->irq_maybe_pending = true;
   return basic_csr_t::unlogged_write(val & (MIP_VSEIP | MIP_VSTIP));
 }
 
@@ -2032,6 +2111,8 @@ bool hstatus_csr_t::unlogged_write(const reg_t val) noexcept {
   const reg_t new_hstatus = (read() & ~mask) | (adjusted_val & mask);
   if (get_field(new_hstatus, HSTATUS_HUPMM) != get_field(read(), HSTATUS_HUPMM))
     proc->get_mmu()->flush_tlb();
+  else if ((new_hstatus ^ read()) & HSTATUS_SPVP)
+    proc->get_mmu()->flush_guest_tlb();  // the privilege of HLV/HSV accesses
   return basic_csr_t::unlogged_write(new_hstatus);
 }
 
@@ -2099,11 +2180,13 @@ bool mvip_csr_t::unlogged_write(const reg_t val) noexcept {
     state->mip->write_with_mask(MIP_SSIP, val); // mvip.SSIP is an alias of mip.SSIP when mvien.SSIP=0
 
   const reg_t new_val = (val & MIP_SEIP) | (((state->mvien->read() & MIP_SSIP) ? val : basic_csr_t::read()) & MIP_SSIP);
+  state->irq_maybe_pending = true;
   return basic_csr_t::unlogged_write(new_val);
 }
 
 void mvip_csr_t::write_with_mask(const reg_t mask, const reg_t val) noexcept {
   basic_csr_t::unlogged_write((basic_csr_t::read() & ~mask) | (val & mask));
+  state->irq_maybe_pending = true;
   log_write();
 }
 
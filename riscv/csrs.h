@@ -10,6 +10,8 @@
 #include <unordered_map>
 // For std::shared_ptr
 #include <memory>
+// For std::vector
+#include <vector>
 // For std::optional
 #include <optional>
 // For access_type:
@@ -74,6 +76,47 @@ class csr_t {
 
 typedef std::shared_ptr<csr_t> csr_t_p;
 
+// Bump allocator holding a hart's CSRs (and their shared_ptr control
+// blocks) next to each other rather than scattered over the heap. Hot
+// CSRs, those the step loop and address translation read, are put in a
+// region of their own. Nothing is freed before the arena is, and it is
+// only destroyed once every CSR allocated from it is: each control block
+// keeps a reference through its csr_allocator_t.
+class csr_arena_t {
+ public:
+  ~csr_arena_t();
+  void* allocate(size_t size, size_t align, bool hot);
+
+ private:
+  static const size_t hot_size = 1024;
+  static const size_t chunk_size = 16384;
+
+  alignas(64) char hot_region[hot_size];
+  size_t hot_used = 0;
+  std::vector<char*> chunks;
+  size_t chunk_used = chunk_size;
+};
+
+template <class T>
+struct csr_allocator_t {
+  typedef T value_type;
+
+  csr_allocator_t(std::shared_ptr<csr_arena_t> arena, bool hot) : arena(std::move(arena)), hot(hot) {}
+  template <class U>
+  csr_allocator_t(const csr_allocator_t<U>& other) : arena(other.arena), hot(other.hot) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T), hot)); }
+  void deallocate(T*, size_t) {}
+
+  template <class U>
+  bool operator==(const csr_allocator_t<U>& other) const { return arena == other.arena; }
+  template <class U>
+  bool operator!=(const csr_allocator_t<U>& other) const { return arena != other.arena; }
+
+  std::shared_ptr<csr_arena_t> arena;
+  bool hot;
+};
+
 // Basic CSRs, with XLEN bits fully readable and writable.
 class basic_csr_t: public csr_t {
  public:
@@ -83,6 +126,12 @@ class basic_csr_t: public csr_t {
     return val;
   }
 
+  // write() without virtual calls, for exact basic_csr_t objects only
+  void write_direct(const reg_t val) noexcept {
+    this->val = val;
+    log_special_write(address, val);
+  }
+
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
  private:
@@ -101,6 +150,9 @@ class pmpaddr_csr_t: public csr_t {
   // Does the specified range match only a proper subset of this page?
   bool subset_match(reg_t addr, reg_t len) const noexcept;
 
+  // The addresses [first, second] match4 matches, or nullopt if none
+  std::optional<std::pair<reg_t, reg_t>> match_range() const noexcept;
+
   // Is the specified access allowed given the pmpcfg privileges?
   bool access_ok(access_type type, reg_t mode, bool hlvx) const noexcept;
 
@@ -562,9 +614,15 @@ typedef std::shared_ptr<smcntrpmf_csr_t> smcntrpmf_csr_t_p;
 // For minstret and mcycle, which are always 64 bits, but in RV32 are
 // split into high and low halves. The first class always holds the
 // full 64-bit value.
+//
+// Steps that change nothing affecting the count only advance
+// state_t::lazy_retired; while counting, the counter adds its growth since
+// the last bump() when read. Steps that write a CSR or change privilege
+// call bump() instead, which counts them the way each step used to be.
 class wide_counter_csr_t: public csr_t {
  public:
-  wide_counter_csr_t(processor_t* const proc, const reg_t addr, smcntrpmf_csr_t_p config_csr);
+  wide_counter_csr_t(processor_t* const proc, const reg_t addr, smcntrpmf_csr_t_p config_csr,
+                     const reg_t inhibit_mask);
   // Always returns full 64-bit value
   virtual reg_t read() const noexcept override;
   void bump(const reg_t howmuch) noexcept;
@@ -572,9 +630,14 @@ class wide_counter_csr_t: public csr_t {
   virtual bool unlogged_write(const reg_t val) noexcept override;
  private:
   bool is_counting_enabled() const noexcept;
+  // Whether steps that leave the counter alone count, in the current mode
+  bool is_counting_lazily() const noexcept;
   reg_t val;
+  reg_t base;  // lazy_retired when val was last brought up to date
+  bool lazy;
   bool written;
   smcntrpmf_csr_t_p config_csr;
+  const reg_t inhibit_mask;  // this counter's mcountinhibit bit
 };
 
 typedef std::shared_ptr<wide_counter_csr_t> wide_counter_csr_t_p;
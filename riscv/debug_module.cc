@@ -368,9 +368,33 @@ void debug_module_t::sb_read_start()
   sb_read_wait = 20;
 }
 
+char *debug_module_t::sb_host_addr(reg_t address, unsigned len)
+{
+  if (len > 8 || len > config.max_sba_data_width / 8 || address % len != 0)
+    return nullptr;
+  return sim->addr_to_mem(address);
+}
+
 void debug_module_t::sb_read()
 {
   reg_t address = ((uint64_t) sbaddress[1] << 32) | sbaddress[0];
+  // Memory is read directly: debugger downloads are mostly system bus
+  // accesses, and the debug MMU would translate and check each one.
+  if (char *host = sb_host_addr(address, sb_access_bits() / 8)) {
+    const mmu_t *mmu = sim->debug_mmu;
+    uint64_t value;
+    switch (sbcs.sbaccess) {
+      case 0: value = *(uint8_t *) host; break;
+      case 1: value = mmu->from_target(*(target_endian<uint16_t> *) host); break;
+      case 2: value = mmu->from_target(*(target_endian<uint32_t> *) host); break;
+      default: value = mmu->from_target(*(target_endian<uint64_t> *) host); break;
+    }
+    sbdata[0] = value;
+    if (sbcs.sbaccess == 3)
+      sbdata[1] = value >> 32;
+    D(fprintf(stderr, "sb_read() 0x%x @ 0x%lx\n", sbdata[0], address));
+    return;
+  }
   try {
     if (sbcs.sbaccess == 0 && config.max_sba_data_width >= 8) {
       sbdata[0] = sim->debug_mmu->load<uint8_t>(address);
@@ -408,6 +432,17 @@ void debug_module_t::sb_write()
 {
   reg_t address = ((uint64_t) sbaddress[1] << 32) | sbaddress[0];
   D(fprintf(stderr, "sb_write() 0x%x @ 0x%lx\n", sbdata[0], address));
+  if (char *host = sb_host_addr(address, sb_access_bits() / 8)) {
+    const mmu_t *mmu = sim->debug_mmu;
+    uint64_t value = (((uint64_t) sbdata[1]) << 32) | sbdata[0];
+    switch (sbcs.sbaccess) {
+      case 0: *(uint8_t *) host = value; break;
+      case 1: *(target_endian<uint16_t> *) host = mmu->to_target<uint16_t>(value); break;
+      case 2: *(target_endian<uint32_t> *) host = mmu->to_target<uint32_t>(value); break;
+      default: *(target_endian<uint64_t> *) host = mmu->to_target<uint64_t>(value); break;
+    }
+    return;
+  }
   try {
     if (sbcs.sbaccess == 0 && config.max_sba_data_width >= 8) {
       sim->debug_mmu->store<uint8_t>(address, sbdata[0]);
@@ -678,6 +713,17 @@ void debug_module_t::run_test_idle()
   }
 }
 
+bool debug_module_t::needs_harts() const
+{
+  if (abstractcs.busy || dmcontrol.haltreq)
+    return true;
+  // a resume is acknowledged by the hart leaving the debug ROM
+  for (size_t id = 0; id < std::min(hart_state.size(), std::size(debug_rom_flags)); id++)
+    if (debug_rom_flags[id] & (1 << DEBUG_ROM_FLAG_RESUME))
+      return true;
+  return false;
+}
+
 static bool is_fpu_reg(unsigned regno)
 {
   return (regno >= 0x1020 && regno <= 0x103f) || regno == CSR_FFLAGS ||
@@ -731,7 +777,11 @@ bool debug_module_t::perform_abstract_register_access()
     }
 
   unsigned i = 0;
-  if (get_field(command, AC_ACCESS_REGISTER_TRANSFER)) {
+  if (get_field(command, AC_ACCESS_REGISTER_TRANSFER) &&
+      perform_direct_register_transfer(write, size, regno)) {
+    if (!get_field(command, AC_ACCESS_REGISTER_POSTEXEC))
+      return true;
+  } else if (get_field(command, AC_ACCESS_REGISTER_TRANSFER)) {
 
     if (is_fpu_reg(regno)) {
       // Save S0
@@ -889,6 +939,63 @@ bool debug_module_t::perform_abstract_register_access()
   return true;
 }
 
+// Does what the ROM program for a GPR or FPR transfer would, right away,
+// where it would not raise an exception: the sizes the hart has loads and
+// stores of. While the hart waits in the debug ROM its s0 is in dscratch0.
+// Returns false, to leave the transfer to the ROM, for anything else.
+bool debug_module_t::perform_direct_register_transfer(bool write, unsigned size, unsigned regno)
+{
+  if (!config.support_direct_register_access || config.abstract_rti)
+    return false;
+
+  processor_t* proc = sim->get_harts().at(selected_hart_id());
+  state_t* state = proc->get_state();
+  uint8_t* data = get_dmdata_checked(1U << size);
+  uint64_t value = 0;
+  if (write)
+    memcpy(&value, data, 1U << size);
+
+  if (regno >= 0x1000 && regno < 0x1020) {
+    unsigned regnum = regno - 0x1000;
+    if (size != 2 && (size != 3 || proc->get_xlen() != 64))
+      return false;
+    // under RVE x16-x31 do not exist, and the ROM program's access traps
+    if (regnum >= 16 && proc->extension_enabled('E'))
+      return false;
+    if (write) {
+      reg_t v = size == 2 ? (reg_t)(int32_t)value : value;
+      if (regnum == S0)
+        state->csrmap[CSR_DSCRATCH0]->write(v);
+      else if (regnum != 0)
+        state->XPR.write(regnum, v);
+    } else {
+      value = regnum == S0 ? state->csrmap[CSR_DSCRATCH0]->read() : state->XPR[regnum];
+      memcpy(data, &value, 1U << size);
+    }
+    return true;
+  }
+
+  if (regno >= 0x1020 && regno < 0x1040 && config.support_abstract_fpr_access) {
+    unsigned fprnum = regno - 0x1020;
+    if (!(size == 2 && proc->extension_enabled('F')) &&
+        !(size == 3 && proc->extension_enabled('D')))
+      return false;
+    if (write) {
+      // NaN-boxed, as flw and fld leave them
+      freg_t f;
+      f.v[0] = size == 2 ? ((uint64_t)-1 << 32) | (uint32_t)value : value;
+      f.v[1] = -1;
+      state->FPR.write(fprnum, f);
+    } else {
+      value = state->FPR[fprnum].v[0];
+      memcpy(data, &value, 1U << size);
+    }
+    return true;
+  }
+
+  return false;
+}
+
 static unsigned idx(unsigned xlen)
 {
   return field_width(xlen) - 3U;
@@ -24,6 +24,9 @@ struct debug_module_config_t {
   bool support_abstract_fpr_access = true;
   bool support_haltgroups = true;
   bool support_impebreak = true;
+  // GPR and FPR transfers go straight to the halted hart's registers rather
+  // than through a program in the debug ROM, unless abstract_rti is set
+  bool support_direct_register_access = true;
 };
 
 struct dmcontrol_t {
@@ -135,6 +138,10 @@ class debug_module_t : public abstract_device_t
     // Called for every cycle the JTAG TAP spends in Run-Test/Idle.
     void run_test_idle();
 
+    // Whether a request from the debugger can only complete once a hart
+    // runs: an abstract command, a halt or a resume.
+    bool needs_harts() const;
+
     // Called when one of the attached harts was reset.
     void proc_reset(unsigned id);
 
@@ -176,6 +183,8 @@ class debug_module_t : public abstract_device_t
     /* Actually read/write. */
     void sb_read();
     void sb_write();
+    /* Host memory for the current access, if it is aligned and to memory. */
+    char *sb_host_addr(reg_t address, unsigned len);
 
     /* Return true iff a system bus access is in progress. */
     bool sb_busy() const;
@@ -204,6 +213,7 @@ class debug_module_t : public abstract_device_t
 
     bool perform_abstract_command();
     bool perform_abstract_register_access();
+    bool perform_direct_register_transfer(bool write, unsigned size, unsigned regno);
     bool perform_abstract_memory_access();
 
     unsigned arg(unsigned xlen, unsigned i);
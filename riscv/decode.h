@@ -76,7 +76,7 @@ class insn_t
 {
 public:
   insn_t() = default;
-  insn_t(insn_bits_t bits) : b(bits) {}
+  insn_t(insn_bits_t bits) : b(bits), imm(0) { imm = predecode_imm(); }
   insn_bits_t bits() { return b; }
   int length() { return insn_length(b); }
   [[maybe_unused]] int64_t opcode() { return x(0, 7); }
@@ -86,9 +86,9 @@ public:
   int64_t i_imm() { return xs(20, 12); }
   int64_t shamt() { return x(20, 6); }
   int64_t s_imm() { return x(7, 5) + (xs(25, 7) << 5); }
-  int64_t sb_imm() { return (x(8, 4) << 1) + (x(25, 6) << 5) + (x(7, 1) << 11) + (imm_sign() << 12); }
+  int64_t sb_imm() { return imm; }
   int64_t u_imm() { return xs(12, 20) << 12; }
-  int64_t uj_imm() { return (x(21, 10) << 1) + (x(20, 1) << 11) + (x(12, 8) << 12) + (imm_sign() << 20); }
+  int64_t uj_imm() { return imm; }
   uint64_t rd() { return x(7, 5); }
   uint64_t rs1() { return x(15, 5); }
   uint64_t rs2() { return x(20, 5); }
@@ -110,8 +110,8 @@ public:
   int64_t rvc_sdsp_imm() { return (x(10, 3) << 3) + (x(7, 3) << 6); }
   int64_t rvc_lw_imm() { return (x(6, 1) << 2) + (x(10, 3) << 3) + (x(5, 1) << 6); }
   int64_t rvc_ld_imm() { return (x(10, 3) << 3) + (x(5, 2) << 6); }
-  int64_t rvc_j_imm() { return (x(3, 3) << 1) + (x(11, 1) << 4) + (x(2, 1) << 5) + (x(7, 1) << 6) + (x(6, 1) << 7) + (x(9, 2) << 8) + (x(8, 1) << 10) + (xs(12, 1) << 11); }
-  int64_t rvc_b_imm() { return (x(3, 2) << 1) + (x(10, 2) << 3) + (x(2, 1) << 5) + (x(5, 2) << 6) + (xs(12, 1) << 8); }
+  int64_t rvc_j_imm() { return imm; }
+  int64_t rvc_b_imm() { return imm; }
   int64_t rvc_simm3() { return x(10, 3); }
   uint64_t rvc_rd() { return rd(); }
   uint64_t rvc_rs1() { return rd(); }
@@ -211,9 +211,33 @@ public:
 
 private:
   insn_bits_t b;
+  // The scattered branch and jump offsets are assembled once, when the
+  // instruction is decoded, instead of on every execution. Only the formats
+  // selected by the opcode are kept, so sb_imm() is only meaningful on
+  // BRANCH, uj_imm() on JAL, rvc_j_imm() on c.j/c.jal and rvc_b_imm() on
+  // c.beqz/c.bnez.
+  int64_t imm;
+
   uint64_t x(int lo, int len) { return (b >> lo) & ((insn_bits_t(1) << len) - 1); }
   uint64_t xs(int lo, int len) { return int64_t(b) << (64 - lo - len) >> (64 - len); }
   uint64_t imm_sign() { return xs(31, 1); }
+
+  int64_t predecode_imm()
+  {
+    if ((b & 0x7f) == 0x63) // BRANCH
+      return (x(8, 4) << 1) + (x(25, 6) << 5) + (x(7, 1) << 11) + (imm_sign() << 12);
+    if ((b & 0x7f) == 0x6f) // JAL
+      return (x(21, 10) << 1) + (x(20, 1) << 11) + (x(12, 8) << 12) + (imm_sign() << 20);
+    if ((b & 3) == 1) {
+      switch (x(13, 3)) {
+        case 1: case 5: // c.jal, c.j
+          return (x(3, 3) << 1) + (x(11, 1) << 4) + (x(2, 1) << 5) + (x(7, 1) << 6) + (x(6, 1) << 7) + (x(9, 2) << 8) + (x(8, 1) << 10) + (xs(12, 1) << 11);
+        case 6: case 7: // c.beqz, c.bnez
+          return (x(3, 2) << 1) + (x(10, 2) << 3) + (x(2, 1) << 5) + (x(5, 2) << 6) + (xs(12, 1) << 8);
+      }
+    }
+    return 0;
+  }
 };
 
 template <class T, size_t N, bool zero_reg>
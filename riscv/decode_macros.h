@@ -24,6 +24,14 @@
 #define WRITE_RD(value) WRITE_REG(insn.rd(), value)
 #define CHECK_RD() CHECK_REG(insn.rd())
 
+// Handlers compiled for a hart with neither S nor U mode: it can never leave
+// M-mode or run virtualised, so privilege checks fold away.
+#ifndef DECODE_MACRO_MACHINE_ONLY
+#define DECODE_MACRO_MACHINE_ONLY 0
+#endif
+#define STATE_PRV (DECODE_MACRO_MACHINE_ONLY ? reg_t(PRV_M) : STATE.prv)
+#define STATE_V (DECODE_MACRO_MACHINE_ONLY ? false : STATE.v)
+
 /* 0 : int
  * 1 : floating
  * 2 : vector reg
@@ -155,10 +163,10 @@ static inline bool is_aligned(const unsigned val, const unsigned pos)
   return pos ? (val & (pos - 1)) == 0 : true;
 }
 
-#define require_privilege(p) require(STATE.prv >= (p))
-#define require_novirt() (unlikely(STATE.v) ? throw trap_virtual_instruction(insn.bits()) : (void) 0)
-#define require_hs_qualified(cond) (STATE.v && !(cond) ? require_novirt() : require(cond))
-#define require_privilege_hs_qualified(p) require_hs_qualified(STATE.prv >= (p))
+#define require_privilege(p) require(STATE_PRV >= (p))
+#define require_novirt() (unlikely(STATE_V) ? throw trap_virtual_instruction(insn.bits()) : (void) 0)
+#define require_hs_qualified(cond) (STATE_V && !(cond) ? require_novirt() : require(cond))
+#define require_privilege_hs_qualified(p) require_hs_qualified(STATE_PRV >= (p))
 #define require_rv64 require(xlen == 64)
 #define require_rv32 require(xlen == 32)
 #define require_extension(s) require(p->extension_enabled(s))
@@ -191,11 +199,11 @@ static inline bool is_aligned(const unsigned val, const unsigned pos)
 #define require_vm do { if (insn.v_vm() == 0) require(insn.rd() != 0); } while (0);
 #define require_envcfg(field) \
   do { \
-    if (((STATE.prv != PRV_M) && (m##field == 0)) || \
-        ((STATE.prv == PRV_U && !STATE.v) && (s##field == 0))) \
+    if (((STATE_PRV != PRV_M) && (m##field == 0)) || \
+        ((STATE_PRV == PRV_U && !STATE_V) && (s##field == 0))) \
       throw trap_illegal_instruction(insn.bits()); \
-    else if (STATE.v && ((h##field == 0) || \
-                        ((STATE.prv == PRV_U) && (s##field == 0)))) \
+    else if (STATE_V && ((h##field == 0) || \
+                        ((STATE_PRV == PRV_U) && (s##field == 0)))) \
       throw trap_virtual_instruction(insn.bits()); \
   } while (0);
 
@@ -247,8 +255,17 @@ class wait_for_interrupt_t {};
 /* Sentinel PC values to serialize simulator pipeline */
 #define PC_SERIALIZE_BEFORE 3
 #define PC_SERIALIZE_AFTER 5
+/* Returned by an instruction that raised a trap with raise_trap */
+#define PC_TRAP 7
 #define invalid_pc(pc) ((pc) & 1)
 
+/* Like throw t, without the exception machinery: for the traps common
+   enough (ecall, ebreak, unknown opcodes) to dominate trap-heavy code */
+#define raise_trap(t) \
+  do { p->stash_trap(t); \
+       return PC_TRAP; \
+     } while (0)
+
 /* Convenience wrappers to simplify softfloat code sequences */
 #define isBoxedF16(r) (isBoxedF32(r) && ((uint64_t)((r.v[0] >> 16) + 1) == ((uint64_t)1 << 48)))
 #define unboxF16(r) (isBoxedF16(r) ? (uint16_t)r.v[0] : defaultNaNF16UI)
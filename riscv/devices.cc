@@ -1,6 +1,10 @@
 #include "devices.h"
 #include "mmu.h"
 #include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 mmio_device_map_t& mmio_device_map()
 {
@@ -16,7 +20,7 @@ bus_t::bus_t()
 }
 
 bus_t::bus_t(abstract_device_t* fallback)
-  : fallback(fallback)
+  : fallback(fallback), last_hit(0)
 {
 }
 
@@ -44,6 +48,16 @@ void bus_t::add_device(reg_t addr, abstract_device_t* dev)
   }
 
   devices[addr] = dev;
+
+  bases.clear();
+  sizes.clear();
+  devs.clear();
+  for (auto [base, d] : devices) {
+    bases.push_back(base);
+    sizes.push_back(d->size());
+    devs.push_back(d);
+  }
+  last_hit = 0;
 }
 
 bool bus_t::load(reg_t addr, size_t len, uint8_t* bytes)
@@ -72,23 +86,33 @@ std::pair<reg_t, abstract_device_t*> bus_t::find_device(reg_t addr, size_t len)
   if (unlikely(!len || addr + len - 1 < addr))
     return std::make_pair(0, nullptr);
 
-  // Obtain iterator to device immediately after the one that might match
-  auto it_after = devices.upper_bound(addr);
-  reg_t base, size;
-  if (likely(it_after != devices.begin())) {
-    // Obtain iterator to device that might match
-    auto it = std::prev(it_after);
-    base = it->first;
-    size = it->second->size();
-    if (likely(addr - base + len - 1 < size)) {
-      // it fully contains [addr, addr + len)
-      return std::make_pair(it->first, it->second);
-    }
+  // Polling loops keep hitting the same device
+  size_t n = bases.size();
+  size_t i = last_hit.load(std::memory_order_relaxed);
+  if (likely(i < n && addr - bases[i] + len - 1 < sizes[i]))
+    return std::make_pair(bases[i], devs[i]);
+
+  if (unlikely(n == 0))
+    return std::make_pair(0, fallback);
+
+  // Branchless search for the last device starting at or below addr
+  const reg_t* b = bases.data();
+  for (size_t m = n; m > 1; m -= m / 2)
+    b = b[m / 2] <= addr ? b + m / 2 : b;
+  i = b - bases.data();
+
+  bool below = addr >= bases[i];
+  if (likely(below && addr - bases[i] + len - 1 < sizes[i])) {
+    // it fully contains [addr, addr + len)
+    last_hit.store(i, std::memory_order_relaxed);
+    return std::make_pair(bases[i], devs[i]);
   }
 
-  if (unlikely((it_after != devices.end() && addr + len - 1 >= it_after->first)
-      || (it_after != devices.begin() && addr - base < size))) {
-    // it_after or it contains part of, but not all of, [addr, add + len)
+  size_t after = below ? i + 1 : 0;
+  if (unlikely((after < n && addr + len - 1 >= bases[after])
+      || (below && addr - bases[i] < sizes[i]))) {
+    // the device after, or the one below, contains part of, but not all
+    // of, [addr, addr + len)
     return std::make_pair(0, nullptr);
   }
 
@@ -97,7 +121,7 @@ std::pair<reg_t, abstract_device_t*> bus_t::find_device(reg_t addr, size_t len)
 }
 
 mem_t::mem_t(reg_t size)
-  : sz(size)
+  : arena_size(std::min(ARENA_SIZE, size)), arena_used(arena_size), sz(size)
 {
   if (size == 0 || size % PGSIZE != 0)
     throw std::runtime_error("memory size must be a positive multiple of 4 KiB");
@@ -105,8 +129,59 @@ mem_t::mem_t(reg_t size)
 
 mem_t::~mem_t()
 {
-  for (auto& entry : sparse_memory_map)
-    free(entry.second);
+  clear();
+}
+
+char* mem_t::alloc_page()
+{
+  if (arena_used == arena_size) {
+    void* p = mmap(nullptr, arena_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+    arenas.push_back((char*)p);
+    arena_used = 0;
+  }
+  char* page = arenas.back() + arena_used;
+  arena_used += PGSIZE;
+  return page;
+}
+
+void mem_t::release_arenas()
+{
+  for (char* arena : arenas)
+    munmap(arena, arena_size);
+  arenas.clear();
+  arena_used = arena_size;
+}
+
+void mem_t::clear()
+{
+  sparse_memory_map.clear();
+  release_arenas();
+  for (auto& m : file_maps)
+    munmap(m.first, m.second);
+  file_maps.clear();
+}
+
+reg_t mem_t::touched_bytes()
+{
+  std::lock_guard<std::mutex> lock(map_lock);
+  return sparse_memory_map.size() * PGSIZE;
+}
+
+bool mem_t::map_file(reg_t addr, size_t len, int fd, uint64_t offset)
+{
+  if (addr + len < addr || addr + len > sz)
+    return false;
+  void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+  if (p == MAP_FAILED)
+    return false;
+  file_maps.emplace_back((char*)p, len);
+  // Pages touched before are replaced, their old contents overwritten anyway
+  for (reg_t pos = 0; pos < len; pos += PGSIZE)
+    sparse_memory_map[(addr + pos) >> PGSHIFT] = (char*)p + pos;
+  return true;
 }
 
 bool mem_t::load_store(reg_t addr, size_t len, uint8_t* bytes, bool store)
@@ -132,17 +207,187 @@ bool mem_t::load_store(reg_t addr, size_t len, uint8_t* bytes, bool store)
 
 char* mem_t::contents(reg_t addr) {
   reg_t ppn = addr >> PGSHIFT, pgoff = addr % PGSIZE;
+  std::unique_lock<std::mutex> lock(map_lock, std::defer_lock);
+  if (unlikely(concurrent))
+    lock.lock();
   auto search = sparse_memory_map.find(ppn);
   if (search == sparse_memory_map.end()) {
-    auto res = (char*)calloc(PGSIZE, 1);
-    if (res == nullptr)
-      throw std::bad_alloc();
+    auto res = alloc_page();
     sparse_memory_map[ppn] = res;
     return res + pgoff;
   }
   return search->second + pgoff;
 }
 
+void flat_mem_t::map(reg_t size)
+{
+  if (size == 0 || size % PGSIZE != 0)
+    throw std::runtime_error("memory size must be a positive multiple of 4 KiB");
+
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::bad_alloc();
+  base = (char*)p;
+}
+
+flat_mem_t::flat_mem_t(reg_t size, bool hugepages)
+  : sz(size), shared(false), hugepages(hugepages)
+{
+  map(size);
+  advise();
+}
+
+void flat_mem_t::advise()
+{
+#ifdef MADV_HUGEPAGE
+  if (hugepages)
+    madvise(base, sz, MADV_HUGEPAGE);
+#endif
+}
+
+flat_mem_t::flat_mem_t(reg_t size, const std::string& image)
+  : sz(size), shared(true)
+{
+  map(size);
+
+  int fd = open(image.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("could not open memory image " + image);
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    throw std::runtime_error("could not stat memory image " + image);
+  }
+
+  // Pages past the end of the image stay anonymous; the bytes of the last
+  // image page beyond end-of-file read as zero.
+  reg_t len = std::min(reg_t(st.st_size), size);
+  len = (len + PGSIZE - 1) & ~reg_t(PGSIZE - 1);
+  if (len && mmap(base, len, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    close(fd);
+    munmap(base, sz);
+    throw std::runtime_error("could not map memory image " + image);
+  }
+  close(fd);
+}
+
+flat_mem_t::~flat_mem_t()
+{
+  munmap(base, sz);
+}
+
+bool flat_mem_t::load(reg_t addr, size_t len, uint8_t* bytes)
+{
+  if (addr + len < addr || addr + len > sz)
+    return false;
+  memcpy(bytes, base + addr, len);
+  return true;
+}
+
+bool flat_mem_t::store(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  if (addr + len < addr || addr + len > sz)
+    return false;
+  if (!shared || memcmp(base + addr, bytes, len) != 0)
+    memcpy(base + addr, bytes, len);
+  return true;
+}
+
+void flat_mem_t::dump(std::ostream& o) {
+  o.write(base, sz);
+}
+
+bool flat_mem_t::map_file(reg_t addr, size_t len, int fd, uint64_t offset)
+{
+  if (shared || addr + len < addr || addr + len > sz)
+    return false;
+  if (mmap(base + addr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           fd, offset) == MAP_FAILED)
+    return false;
+  file_mapped = true;
+  return true;
+}
+
+reg_t flat_mem_t::touched_bytes()
+{
+#ifdef __linux__
+  std::vector<unsigned char> resident(sz / PGSIZE);
+  if (sysconf(_SC_PAGESIZE) == PGSIZE && mincore(base, sz, resident.data()) == 0) {
+    reg_t pages = 0;
+    for (unsigned char r : resident)
+      pages += r & 1;
+    return pages * PGSIZE;
+  }
+#endif
+  return sz;
+}
+
+void flat_mem_t::clear()
+{
+  if (file_mapped) {
+    // madvise() would send file pages back to the file, not to zero
+    if (mmap(base, sz, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+      throw std::bad_alloc();
+    file_mapped = false;
+    advise();
+    return;
+  }
+#ifdef __linux__
+  // Drops the private copies of written pages: anonymous ones read as zero
+  // again and those of an image go back to the file.
+  if (madvise(base, sz, MADV_DONTNEED) == 0)
+    return;
+#endif
+  if (shared)
+    throw std::runtime_error("cannot restore memory image");
+  abstract_mem_t::clear();
+}
+
+void abstract_mem_t::for_each_page(const std::function<void(reg_t addr, char* page)>& f)
+{
+  for (reg_t addr = 0; addr < size(); addr += PGSIZE)
+    f(addr, contents(addr));
+}
+
+void abstract_mem_t::clear()
+{
+  static const char zero_page[PGSIZE] = {0};
+  // without dirtying pages that are already zero
+  for_each_page([&](reg_t UNUSED addr, char* page) {
+    if (memcmp(page, zero_page, PGSIZE) != 0)
+      memset(page, 0, PGSIZE);
+  });
+}
+
+void abstract_mem_t::dump_sparse(std::ostream& o)
+{
+  uint64_t size = this->size();
+  o.write("SPKSPARS", 8);
+  o.write((const char*)&size, sizeof(size));
+  for_each_page([&](reg_t addr, char* page) {
+    const uint64_t* words = (const uint64_t*)page;
+    uint64_t any = 0;
+    for (size_t i = 0; i < PGSIZE / sizeof(uint64_t); i++)
+      any |= words[i];
+    if (any) {
+      uint64_t index = addr >> PGSHIFT;
+      o.write((const char*)&index, sizeof(index));
+      o.write(page, PGSIZE);
+    }
+  });
+}
+
+void mem_t::for_each_page(const std::function<void(reg_t addr, char* page)>& f)
+{
+  // only pages touched so far exist
+  for (auto& entry : sparse_memory_map)
+    f(entry.first << PGSHIFT, entry.second);
+}
+
 void mem_t::dump(std::ostream& o) {
   const char empty[PGSIZE] = {0};
   for (reg_t i = 0; i < sz; i += PGSIZE) {
@@ -5,7 +5,10 @@
 #include "abstract_device.h"
 #include "abstract_interrupt_controller.h"
 #include "platform.h"
+#include <atomic>
+#include <functional>
 #include <map>
+#include <mutex>
 #include <queue>
 #include <vector>
 #include <utility>
@@ -31,6 +34,13 @@ class bus_t : public abstract_device_t {
  private:
   std::map<reg_t, abstract_device_t*> devices;
   abstract_device_t* fallback;
+
+  // devices, flattened in address order for find_device, with the sizes
+  // they had when added, and the index of the last one found
+  std::vector<reg_t> bases;
+  std::vector<reg_t> sizes;
+  std::vector<abstract_device_t*> devs;
+  std::atomic<size_t> last_hit;
 };
 
 class rom_device_t : public abstract_device_t {
@@ -39,6 +49,7 @@ class rom_device_t : public abstract_device_t {
   bool load(reg_t addr, size_t len, uint8_t* bytes) override;
   bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
   reg_t size() override { return data.size(); }
+  reg_t next_tick(reg_t UNUSED now) override { return NO_TICK; }
   const std::vector<char>& contents() { return data; }
  private:
   std::vector<char> data;
@@ -49,9 +60,35 @@ class abstract_mem_t : public abstract_device_t {
   virtual ~abstract_mem_t() = default;
 
   virtual char* contents(reg_t addr) = 0;
+  char* host_contents(reg_t addr) override { return contents(addr); }
   virtual void dump(std::ostream& o) = 0;
+  // Visits, in ascending order, every page that may hold nonzero bytes
+  virtual void for_each_page(const std::function<void(reg_t addr, char* page)>& f);
+  // Writes only the pages holding nonzero bytes: the magic "SPKSPARS" and
+  // size(), then per page its index and its PGSIZE bytes, in ascending
+  // order (integers as host-endian uint64_t)
+  void dump_sparse(std::ostream& o);
+  // Returns the memory to the contents it was created with, touching only
+  // the pages that may have been written since
+  virtual void clear();
+  // Maps the len bytes of file fd at offset to [addr, addr + len) privately,
+  // so that the host's page cache backs them until the first store copies a
+  // page, as chunked_memif_t::map_file describes. All three are multiples of
+  // the host page, which is PGSIZE. Returns false if this memory cannot.
+  virtual bool map_file(reg_t UNUSED addr, size_t UNUSED len, int UNUSED fd,
+                        uint64_t UNUSED offset) { return false; }
+  // Whether contents() may be called by several threads at once, as the
+  // harts of --parallel-harts do
+  virtual void set_concurrent(bool UNUSED concurrent) {}
+  // Bytes of the memory that have host pages behind them so far: all of
+  // size() unless the memory materialises pages lazily
+  virtual reg_t touched_bytes() { return size(); }
 };
 
+// Sparse memory: a page exists once it is first touched. Pages are carved
+// in order out of ARENA_SIZE chunks of zero-filled anonymous memory, so
+// touching many costs no per-page heap allocation, and destruction or
+// clear() hands back whole chunks at once.
 class mem_t : public abstract_mem_t {
  public:
   mem_t(reg_t size);
@@ -63,12 +100,73 @@ class mem_t : public abstract_mem_t {
   char* contents(reg_t addr) override;
   reg_t size() override { return sz; }
   void dump(std::ostream& o) override;
+  void for_each_page(const std::function<void(reg_t addr, char* page)>& f) override;
+  void clear() override;
+  bool map_file(reg_t addr, size_t len, int fd, uint64_t offset) override;
+  reg_t touched_bytes() override;
+  void set_concurrent(bool concurrent) override { this->concurrent = concurrent; }
 
  private:
   bool load_store(reg_t addr, size_t len, uint8_t* bytes, bool store);
+  char* alloc_page();
+  void release_arenas();
+
+  // 2 MiB, so the kernel can back a chunk with one huge page
+  static const reg_t ARENA_SIZE = reg_t(1) << 21;
 
   std::map<reg_t, char*> sparse_memory_map;
+  // Held while contents() looks up or allocates a page if concurrent, as
+  // harts running on their own threads (--parallel-harts) can
+  std::mutex map_lock;
+  bool concurrent = false;
+  std::vector<char*> arenas;
+  // Mappings of files that map_file made, each page of which is in
+  // sparse_memory_map unless a later map_file replaced it
+  std::vector<std::pair<char*, size_t>> file_maps;
+  reg_t arena_size;  // ARENA_SIZE, or less for a smaller memory
+  reg_t arena_used;
+  reg_t sz;
+};
+
+// Memory backed by one contiguous anonymous mapping: contents() is a single
+// add, and untouched pages cost nothing until the OS zero-fills them on first
+// access. With hugepages set, the kernel is asked to back it with huge pages.
+//
+// Given an image (e.g. one written by the interactive dumpmems command), its
+// pages are mapped copy-on-write instead, so every instance started from the
+// same file shares them until it writes. Stores of bytes the memory already
+// holds are dropped, which keeps reloading the same program from dirtying
+// the image.
+class flat_mem_t : public abstract_mem_t {
+ public:
+  flat_mem_t(reg_t size, bool hugepages = false);
+  flat_mem_t(reg_t size, const std::string& image);
+  flat_mem_t(const flat_mem_t& that) = delete;
+  ~flat_mem_t() override;
+
+  bool load(reg_t addr, size_t len, uint8_t* bytes) override;
+  bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
+  char* contents(reg_t addr) override { return base + addr; }
+  reg_t size() override { return sz; }
+  void dump(std::ostream& o) override;
+  void clear() override;
+  // Not for memories made from an image, which clear() returns to it
+  bool map_file(reg_t addr, size_t len, int fd, uint64_t offset) override;
+  // The pages resident now, as mincore() reports them (all on failure);
+  // an image's count whether or not this instance has read them
+  reg_t touched_bytes() override;
+
+ private:
+  void map(reg_t size);
+  void advise();
+
+  char* base;
   reg_t sz;
+  bool shared;
+  bool hugepages = false;
+  // Whether map_file has mapped any file pages, which clear() must replace
+  // with zero-fill ones
+  bool file_mapped = false;
 };
 
 class abstract_sim_if_t {
@@ -90,6 +188,46 @@ private:
   abstract_sim_if_t* external_simulator;
 };
 
+// MMIO window and interrupt lines driven by an external model, typically the
+// DUT of a co-simulation. A load consumes the oldest value queued with
+// push_load when its offset matches, and otherwise returns the last value
+// seen at that address. Interrupt events set or clear mip bits on a hart
+// once its minstret reaches the requested count; sync() applies them.
+class dut_sync_device_t : public abstract_device_t {
+ public:
+  dut_sync_device_t(const simif_t* sim, reg_t size);
+  bool load(reg_t addr, size_t len, uint8_t* bytes) override;
+  bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
+  reg_t size() override { return shadow.size(); }
+  void set_size(reg_t size) { shadow.assign(size, 0); }
+
+  void push_load(reg_t addr, uint64_t value);
+  size_t pending_loads() const { return loads.size(); }
+
+  void schedule_interrupt(reg_t hartid, reg_t instret, reg_t mask, bool raise);
+  size_t pending_interrupts() const { return irq_events.size(); }
+  // The minstret count at which the next event for hartid is due, or
+  // reg_t(-1) if there is none
+  reg_t next_due(reg_t hartid) const;
+
+  // Applies every interrupt event that is due. Returns how many more
+  // instructions may retire before the next event, or reg_t(-1) if none.
+  reg_t sync();
+
+ private:
+  struct irq_event_t {
+    reg_t hartid;
+    reg_t instret;
+    reg_t mask;
+    bool raise;
+  };
+
+  const simif_t* sim;
+  std::vector<uint8_t> shadow;
+  std::queue<std::pair<reg_t, uint64_t>> loads;
+  std::vector<irq_event_t> irq_events;  // ordered by instret
+};
+
 class clint_t : public abstract_device_t {
  public:
   clint_t(const simif_t*, uint64_t freq_hz, bool real_time);
@@ -99,6 +237,12 @@ class clint_t : public abstract_device_t {
   void tick(reg_t rtc_ticks) override;
   uint64_t get_mtimecmp(reg_t hartid) { return mtimecmp[hartid]; }
   uint64_t get_mtime() { return mtime; }
+  // Ticks until the earliest armed mtimecmp, or Sstc stimecmp/vstimecmp
+  // where STCE enables them; 0 if a timer interrupt is already due, no
+  // timer is armed, or mtime follows the host clock.
+  uint64_t ticks_to_next_deadline() const;
+  void save_state(checkpoint_writer_t& out) const override;
+  void load_state(checkpoint_reader_t& in) override;
  private:
   typedef uint64_t mtime_t;
   typedef uint64_t mtimecmp_t;
@@ -106,10 +250,22 @@ class clint_t : public abstract_device_t {
   const simif_t* sim;
   uint64_t freq_hz;
   bool real_time;
-  uint64_t real_time_ref_secs;
-  uint64_t real_time_ref_usecs;
   mtime_t mtime;
   std::map<size_t, mtimecmp_t> mtimecmp;
+
+  // With real_time, mtime follows CLOCK_MONOTONIC, read from the TSC once
+  // its rate has been calibrated against the clock over the first
+  // TSC_CALIBRATION_NS; before that, or without a TSC, through the vDSO.
+  // The clock is read again about once a second to refine the rate.
+  static const uint64_t TSC_CALIBRATION_NS = 50000000;
+  uint64_t host_ns();
+  mtime_t real_time_mtime();
+  void sync_harts();
+  uint64_t real_time_start_ns;
+  uint64_t tsc_base, tsc_base_ns;      // first reading
+  uint64_t tsc_anchor, tsc_anchor_ns;  // last reading of the clock
+  uint64_t tsc_resync;                 // TSC ticks between clock readings
+  uint64_t ns_per_tsc;                 // 32.32 fixed point; 0 until calibrated
 };
 
 #define PLIC_MAX_DEVICES 1024
@@ -127,6 +283,14 @@ struct plic_context_t {
   uint32_t pending[PLIC_MAX_DEVICES/32] {};
   uint8_t pending_priority[PLIC_MAX_DEVICES] {};
   uint32_t claimed[PLIC_MAX_DEVICES/32] {};
+
+  // Sources that are pending, unclaimed and of nonzero priority, bucketed
+  // by that priority, so that the best one is found with a ctz per word of
+  // the highest nonempty bucket instead of a scan of every source.
+  uint8_t active_prio[PLIC_MAX_DEVICES] {};  // bucket holding the source, or 0
+  uint64_t active[1 << PLIC_PRIO_BITS][PLIC_MAX_DEVICES/64] {};
+  uint32_t active_count[1 << PLIC_PRIO_BITS] {};
+  uint32_t active_prios {};  // bit p set if active[p] is nonempty
 };
 
 class plic_t : public abstract_device_t, public abstract_interrupt_controller_t {
@@ -136,6 +300,9 @@ class plic_t : public abstract_device_t, public abstract_interrupt_controller_t
   bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
   void set_interrupt_level(uint32_t id, int lvl) override;
   reg_t size() override { return PLIC_SIZE; }
+  reg_t next_tick(reg_t UNUSED now) override { return NO_TICK; }
+  void save_state(checkpoint_writer_t& out) const override;
+  void load_state(checkpoint_reader_t& in) override;
  private:
   std::vector<plic_context_t> contexts;
   uint32_t num_ids;
@@ -144,6 +311,7 @@ class plic_t : public abstract_device_t, public abstract_interrupt_controller_t
   uint8_t priority[PLIC_MAX_DEVICES];
   uint32_t level[PLIC_MAX_DEVICES/32];
   uint32_t context_best_pending(const plic_context_t *c);
+  void context_refresh(plic_context_t *c, uint32_t id);
   void context_update(const plic_context_t *context);
   uint32_t context_claim(plic_context_t *c);
   bool priority_read(reg_t offset, uint32_t *val);
@@ -167,6 +335,8 @@ class ns16550_t : public abstract_device_t {
   bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
   void tick(reg_t rtc_ticks) override;
   reg_t size() override { return NS16550_SIZE; }
+  void save_state(checkpoint_writer_t& out) const override;
+  void load_state(checkpoint_reader_t& in) override;
  private:
   abstract_interrupt_controller_t *intctrl;
   uint32_t interrupt_id;
@@ -191,6 +361,51 @@ class ns16550_t : public abstract_device_t {
   static const int MAX_BACKOFF = 16;
 };
 
+// A virtio-mmio block device backed by a memory-mapped image file. Queue
+// buffers are copied straight between guest RAM and the mapping; with
+// copy_on_write, writes stay private to this process.
+class virtio_blk_t : public abstract_device_t {
+ public:
+  virtio_blk_t(simif_t* sim, abstract_interrupt_controller_t *intctrl,
+               uint32_t interrupt_id, const std::string& path, bool copy_on_write);
+  ~virtio_blk_t();
+  bool load(reg_t addr, size_t len, uint8_t* bytes) override;
+  bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
+  reg_t size() override { return VIRTIO_BLK_SIZE; }
+  void save_state(checkpoint_writer_t& out) const override;
+  void load_state(checkpoint_reader_t& in) override;
+  bool checkpointable() const override { return false; }
+ private:
+  simif_t* sim;
+  abstract_interrupt_controller_t *intctrl;
+  uint32_t interrupt_id;
+  uint8_t* image;
+  size_t image_size;
+
+  uint32_t status;
+  uint32_t device_features_sel;
+  uint32_t driver_features_sel;
+  uint64_t driver_features;
+  uint32_t queue_sel;
+  uint32_t queue_num;
+  uint32_t queue_ready;
+  uint64_t queue_desc;
+  uint64_t queue_avail;
+  uint64_t queue_used;
+  uint16_t last_avail_idx;
+  uint32_t interrupt_status;
+
+  static const uint32_t VIRTIO_BLK_QUEUE_SIZE = 256;
+
+  void reset();
+  uint64_t device_features() const;
+  // Copy between buf and guest RAM; false if any of it is not RAM.
+  bool dma(reg_t addr, size_t len, void* buf, bool to_guest);
+  void process_queue();
+  // Serve the descriptor chain at head; false if it is malformed.
+  bool handle_request(uint16_t head, uint32_t* written);
+};
+
 template<typename T>
 void write_little_endian_reg(T* word, reg_t addr, size_t len, const uint8_t* bytes)
 {
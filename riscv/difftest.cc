@@ -0,0 +1,263 @@
+// See LICENSE for license details.
+
+#include "difftest.h"
+#include "sim.h"
+#include "processor.h"
+#include "term.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Compares the commits of a forked copy with the trace from its boundary
+class difftest_t::checker_t : public commit_observer_t {
+ public:
+  checker_t(const commit_trace_reader_t& reader, uint64_t index, uint64_t end)
+    : reader(reader), index(index), end(end) {}
+  void on_commit(processor_t* p, reg_t pc, insn_t insn) override;
+  uint64_t end_index() const { return end; }
+
+ private:
+  void mismatch(processor_t* p, reg_t pc, insn_t insn, const std::string& why);
+
+  commit_trace_reader_t reader;
+  uint64_t index;
+  uint64_t end;
+  commit_trace_record_t rec;
+};
+
+static std::string reg_str(reg_t key)
+{
+  return ((key & 0xf) == 0 ? "x" : "f") + std::to_string(key >> 4);
+}
+
+void difftest_t::checker_t::on_commit(processor_t* p, reg_t pc, insn_t insn)
+{
+  if (!reader.next(rec)) {
+    fprintf(stderr, "spike-difftest: trace ends at record %" PRIu64 "\n", index);
+    fflush(nullptr);
+    _exit(0);
+  }
+
+  std::ostringstream why;
+  if (rec.pc != pc)
+    why << "pc dut 0x" << std::hex << rec.pc;
+  else if (rec.insn != insn.bits())
+    why << "insn dut 0x" << std::hex << rec.insn;
+
+  state_t* st = p->get_state();
+  reg_t xmask = rec.xlen >= 64 ? ~reg_t(0) : (reg_t(1) << rec.xlen) - 1;
+  reg_t fmask = rec.flen >= 64 ? ~reg_t(0) : (reg_t(1) << rec.flen) - 1;
+  auto find = [this](reg_t key) {
+    return std::find_if(rec.regs.begin(), rec.regs.end(),
+                        [key](const auto& r) { return r.key == key; });
+  };
+  for (auto& [key, value] : st->log_reg_write) {
+    if (!why.str().empty())
+      break;
+    reg_t type = key & 0xf;
+    if (key == 0 || type > 1)
+      continue;
+    auto d = find(key);
+    if (d == rec.regs.end()) {
+      why << reg_str(key) << " written by spike, not by dut";
+    } else if (type == 0 ? ((d->v[0] ^ value.v[0]) & xmask) != 0
+                         : ((d->v[0] ^ value.v[0]) & fmask) != 0 ||
+                           (rec.flen > 64 && d->v[1] != value.v[1])) {
+      why << reg_str(key) << " spike 0x" << std::hex << value.v[0] << " dut 0x" << d->v[0];
+    }
+  }
+  for (auto& r : rec.regs) {
+    if (!why.str().empty())
+      break;
+    reg_t type = r.key & 0xf;
+    if (r.key == 0 || type > 1)
+      continue;
+    bool spike_wrote = std::any_of(st->log_reg_write.begin(), st->log_reg_write.end(),
+                                   [&](const auto& w) { return w.first == r.key; });
+    if (!spike_wrote)
+      why << reg_str(r.key) << " written by dut, not by spike";
+  }
+  if (why.str().empty()) {
+    const auto& stores = st->log_mem_write;
+    if (stores.size() != rec.stores.size()) {
+      why << stores.size() << " stores by spike, " << rec.stores.size() << " by dut";
+    } else {
+      for (size_t i = 0; i < stores.size(); i++) {
+        auto& [addr, value, size] = stores[i];
+        auto& d = rec.stores[i];
+        if (d.addr != addr || d.size != size || d.value != value) {
+          why << "store spike " << std::dec << (unsigned)size << "@0x" << std::hex << addr
+              << "=0x" << value << " dut " << std::dec << (unsigned)d.size << "@0x"
+              << std::hex << d.addr << "=0x" << d.value;
+          break;
+        }
+      }
+    }
+  }
+
+  if (!why.str().empty())
+    mismatch(p, pc, insn, why.str());
+  index++;
+}
+
+void difftest_t::checker_t::mismatch(processor_t* p, reg_t pc, insn_t insn, const std::string& why)
+{
+  fprintf(stderr, "spike-difftest: record %" PRIu64 " pc 0x%016" PRIx64 " (0x%08" PRIx64 ") %s: %s\n",
+          index, pc, insn.bits(), p->disassemble(insn).c_str(), why.c_str());
+  fflush(nullptr);
+  _exit(1);
+}
+
+difftest_t::difftest_t(sim_t* sim, const char* path, uint64_t segment, unsigned jobs)
+  : sim(sim), proc(nullptr), data(nullptr), len(0), segment(segment), jobs(std::max(jobs, 1u)),
+    base(0), reader(nullptr, 0), index(0), next_boundary(0), trace_done(false),
+    any_failed(false), segments(0), failed_segments(0), reported(false), checker(nullptr)
+{
+  if (sim->get_harts().size() != 1)
+    throw std::runtime_error("--difftest needs a single hart");
+  if (segment == 0)
+    throw std::runtime_error("difftest segment length must be positive");
+
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    std::ostringstream oss;
+    oss << "Failed to open DUT trace `" << path << "': " << strerror(errno);
+    if (fd >= 0)
+      close(fd);
+    throw std::runtime_error(oss.str());
+  }
+  len = st.st_size;
+  void* m = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+  close(fd);
+  if (m == MAP_FAILED)
+    throw std::runtime_error(std::string("Failed to map DUT trace `") + path + "'");
+  data = (const uint8_t*)m;
+  madvise(m, len, MADV_SEQUENTIAL);
+
+  reader = commit_trace_reader_t(data, len);
+  if (!reader.valid()) {
+    munmap(m, len);
+    throw std::runtime_error(std::string("`") + path + "' is not a commit trace");
+  }
+
+  proc = sim->get_harts().begin()->second;
+  base = proc->get_state()->minstret->read();
+  sim->set_difftest(this);
+}
+
+difftest_t::~difftest_t()
+{
+  finish();
+  sim->set_difftest(nullptr);
+  if (len)
+    munmap((void*)data, len);
+}
+
+reg_t difftest_t::retired() const
+{
+  return proc->get_state()->minstret->read() - base;
+}
+
+void difftest_t::poll()
+{
+  reg_t n = retired();
+  if (checker) {
+    if (n >= checker->end_index()) {
+      fflush(nullptr);
+      _exit(0);
+    }
+    return;
+  }
+  if (trace_done || n < next_boundary)
+    return;
+
+  commit_trace_record_t rec;
+  while (index < n && reader.next(rec))
+    index++;
+  if (index < n || reader.offset() == len) {
+    // nothing left to check
+    trace_done = true;
+    sim->htif_exit(finish() ? 0 : 1);
+    return;
+  }
+  fork_segment(n);
+  next_boundary = n + segment;
+}
+
+void difftest_t::fork_segment(uint64_t start)
+{
+  reap(false);
+  while (children.size() >= jobs)
+    reap(true);
+
+  fflush(nullptr);
+  pid_t pid = fork();
+  if (pid < 0) {
+    fprintf(stderr, "spike-difftest: fork failed: %s\n", strerror(errno));
+    any_failed = true;
+    return;
+  }
+  if (pid == 0) {
+    // The parent already shows the console and takes its input; the copy's
+    // output would repeat it and its reads would steal keystrokes.
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDIN_FILENO);
+      dup2(null_fd, STDOUT_FILENO);
+      close(null_fd);
+    }
+    canonical_terminal_t::set_output("/dev/null");
+    children.clear();
+    checker = new checker_t(reader, start, start + segment);
+    proc->add_commit_observer(checker);
+    return;
+  }
+  children.push_back(pid);
+  segments++;
+}
+
+void difftest_t::reap(bool block)
+{
+  while (!children.empty()) {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, block ? 0 : WNOHANG);
+    if (pid <= 0)
+      return;
+    auto it = std::find(children.begin(), children.end(), pid);
+    if (it == children.end())
+      continue;
+    children.erase(it);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      any_failed = true;
+      failed_segments++;
+    }
+    if (block)
+      return;
+  }
+}
+
+bool difftest_t::finish()
+{
+  if (checker) {
+    // a copy whose segment outlived the program
+    fflush(nullptr);
+    _exit(0);
+  }
+  while (!children.empty())
+    reap(true);
+  if (!reported) {
+    reported = true;
+    fprintf(stderr, "spike-difftest: %" PRIu64 " segments checked up to record %" PRIu64
+            ", %" PRIu64 " failed\n", segments, index, failed_segments);
+  }
+  return !any_failed;
+}
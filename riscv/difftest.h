@@ -0,0 +1,64 @@
+// See LICENSE for license details.
+#ifndef _RISCV_DIFFTEST_H
+#define _RISCV_DIFFTEST_H
+
+#include "commit_trace.h"
+#include <sys/types.h>
+#include <vector>
+
+class sim_t;
+
+// Offline comparison of a recorded DUT trace, in the --commit-trace format,
+// against the simulator. The simulator runs ahead without commit logging;
+// at the first scheduling quantum starting at least segment instructions
+// after the last boundary (and at the first one) it forks a copy, which
+// turns commit logging on and checks the trace records from there up to the
+// next boundary (the same quantum, as the simulation is deterministic)
+// before exiting, while the simulator itself only skips the trace ahead.
+// Up to jobs copies run at once, so checking scales with host cores.
+//
+// Each record is compared with the commit at the same position: pc,
+// instruction bits, the x and f register writes in both directions, and the
+// stores in order. Positions come from minstret, so there must be one hart
+// and the guest must not write minstret. A copy prints the first mismatch
+// and exits nonzero. The run ends, with exit code 1 if any segment failed,
+// when the trace does, or earlier if the program exits first.
+class difftest_t {
+ public:
+  // Throws std::runtime_error if path is not a readable commit trace.
+  difftest_t(sim_t* sim, const char* path, uint64_t segment, unsigned jobs);
+  ~difftest_t();  // as finish()
+
+  // Called by sim_t::idle before every scheduling quantum
+  void poll();
+  // Waits for the copies still running and prints a summary. Returns true
+  // if every segment checked so far matched.
+  bool finish();
+
+ private:
+  class checker_t;
+
+  reg_t retired() const;
+  void fork_segment(uint64_t start);
+  void reap(bool block);
+
+  sim_t* sim;
+  processor_t* proc;
+  const uint8_t* data;
+  size_t len;
+  uint64_t segment;
+  unsigned jobs;
+  reg_t base;                     // minstret at construction
+  commit_trace_reader_t reader;   // positioned at record index
+  uint64_t index;
+  uint64_t next_boundary;
+  bool trace_done;
+  bool any_failed;
+  uint64_t segments;
+  uint64_t failed_segments;
+  bool reported;
+  std::vector<pid_t> children;
+  checker_t* checker;             // in a forked copy only
+};
+
+#endif
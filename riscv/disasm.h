@@ -9,6 +9,8 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <list>
+#include <unordered_map>
 #include <vector>
 
 extern const char* xpr_name[NXPR];
@@ -83,6 +85,13 @@ class disassembler_t
 {
  public:
   disassembler_t(const isa_parser_t *isa, bool strict = false);
+  // For tools that only disassemble: no processor_t needed, and the ISA
+  // string is parsed once per process
+  disassembler_t(const char* isa_str, const char* priv_str, bool strict = false)
+    : disassembler_t(isa_parser_t::get(isa_str, priv_str).get(), strict) {}
+  // Starts empty: instructions added to it take priority, and everything
+  // else is looked up in base, which must outlive it
+  explicit disassembler_t(const disassembler_t* base) : base(base), built(true) {}
   ~disassembler_t();
 
   std::string disassemble(insn_t insn) const;
@@ -91,20 +100,65 @@ class disassembler_t
   void add_insn(disasm_insn_t* insn);
 
  private:
-  static const int HASH_SIZE = 255;
-  std::vector<const disasm_insn_t*> chain[HASH_SIZE+1];
-
-  void add_instructions(const isa_parser_t* isa, bool strict);
-
-  const disasm_insn_t* probe_once(insn_t insn, size_t idx) const;
+  // Each instruction is chained under the most opcode fields its mask
+  // covers: the major opcode, funct3 and bits 31:26 (funct6, or funct7
+  // without its low bit), the first two, the major opcode alone, the
+  // compressed opcode and funct3, or none. Chains are in priority order,
+  // lowest prio first: what the constructor adds in the order it is added,
+  // and what is added later ahead of that, the latest first.
+  struct entry_t {
+    int64_t prio;
+    const disasm_insn_t* insn;
+  };
+  typedef std::vector<entry_t> chain_t;
 
   static const unsigned int MASK1 = 0x7f;
+  static const unsigned int MASK_F3 = 0x707f;
+  static const unsigned int MASK_F6 = 0xfc00707f;
   static const unsigned int MASK2 = 0xe003;
+  static const size_t F6_SIZE = 2048;  // hashed; (opcode, funct3, bits 31:26) has 16 bits
+
+  chain_t by_op[128];
+  chain_t by_f3[1024];
+  std::vector<chain_t> by_f6 = std::vector<chain_t>(F6_SIZE);
+  chain_t by_rvc[32];
+  chain_t other;
+  const disassembler_t* base = nullptr;
+  bool built = false;
+  int64_t next_prio = 0, late_prio = 0;
 
-  static unsigned int hash(insn_bits_t insn, unsigned int mask)
+  void add_instructions(const isa_parser_t* isa, bool strict);
+
+  static size_t f3_index(insn_bits_t insn) { return (insn & 0x7f) | (insn >> 5 & 0x380); }
+  static size_t f6_index(insn_bits_t insn)
   {
-    return (insn & mask) % HASH_SIZE;
+    uint32_t key = (insn & 0x7f) | (insn >> 5 & 0x380) | (insn >> 16 & 0xfc00);
+    return (key * 0x9e3779b1u) >> 21;
   }
+  static size_t rvc_index(insn_bits_t insn) { return (insn >> 11 & 0x1c) | (insn & 3); }
+  static const entry_t* first_match(const chain_t& chain, insn_t insn);
+  template<typename F> void for_each_chain(F f);
+};
+
+// Memoised disassembler_t::disassemble, keyed by instruction bits and
+// bounded to the capacity most recently used. Not thread-safe; clear() it
+// after instructions are added to the disassembler.
+class disasm_cache_t
+{
+ public:
+  disasm_cache_t(const disassembler_t* disasm, size_t capacity = 4096)
+    : disasm(disasm), capacity(capacity) {}
+
+  const std::string& disassemble(insn_t insn);
+  void clear() { lru.clear(); index.clear(); }
+
+ private:
+  typedef std::list<std::pair<insn_bits_t, std::string>> lru_t;
+
+  const disassembler_t* disasm;
+  size_t capacity;
+  lru_t lru;      // most recently used first
+  std::unordered_map<insn_bits_t, lru_t::iterator> index;
 };
 
 #endif
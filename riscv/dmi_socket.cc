@@ -0,0 +1,191 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef AF_INET
+#include <sys/socket.h>
+#endif
+#ifndef INADDR_ANY
+#include <netinet/in.h>
+#endif
+
+#include <cstdio>
+
+#include "dmi_socket.h"
+#include "debug_module.h"
+
+static uint32_t get_le32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+dmi_socket_t::dmi_socket_t(uint16_t port, debug_module_t *dm) :
+  dm(dm),
+  socket_fd(0),
+  client_fd(0),
+  recv_start(0),
+  recv_end(0)
+{
+  socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (socket_fd == -1) {
+    fprintf(stderr, "dmi_socket failed to make socket: %s (%d)\n",
+        strerror(errno), errno);
+    abort();
+  }
+
+  fcntl(socket_fd, F_SETFL, O_NONBLOCK);
+  int reuseaddr = 1;
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
+        sizeof(int)) == -1) {
+    fprintf(stderr, "dmi_socket failed setsockopt: %s (%d)\n",
+        strerror(errno), errno);
+    abort();
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(port);
+
+  if (bind(socket_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+    fprintf(stderr, "dmi_socket failed to bind socket: %s (%d)\n",
+        strerror(errno), errno);
+    abort();
+  }
+
+  if (listen(socket_fd, 1) == -1) {
+    fprintf(stderr, "dmi_socket failed to listen on socket: %s (%d)\n",
+        strerror(errno), errno);
+    abort();
+  }
+
+  socklen_t addrlen = sizeof(addr);
+  if (getsockname(socket_fd, (struct sockaddr *) &addr, &addrlen) == -1) {
+    fprintf(stderr, "dmi_socket getsockname failed: %s (%d)\n",
+        strerror(errno), errno);
+    abort();
+  }
+
+  printf("Listening for DMI connection on port %d.\n",
+      ntohs(addr.sin_port));
+  fflush(stdout);
+}
+
+void dmi_socket_t::accept()
+{
+  client_fd = ::accept(socket_fd, NULL, NULL);
+  if (client_fd == -1) {
+    if (errno == EAGAIN) {
+      // No client waiting to connect right now.
+    } else {
+      fprintf(stderr, "failed to accept on socket: %s (%d)\n", strerror(errno),
+          errno);
+      abort();
+    }
+  } else {
+    fcntl(client_fd, F_SETFL, O_NONBLOCK);
+    recv_start = recv_end = 0;
+  }
+}
+
+void dmi_socket_t::tick()
+{
+  if (client_fd > 0) {
+    execute_requests();
+  } else {
+    this->accept();
+  }
+}
+
+void dmi_socket_t::send(const uint8_t *buf, size_t len)
+{
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t bytes = write(client_fd, buf + sent, len - sent);
+    if (bytes == -1) {
+      if (errno == EAGAIN)
+        continue;
+      fprintf(stderr, "failed to write to socket: %s (%d)\n", strerror(errno), errno);
+      abort();
+    }
+    sent += bytes;
+  }
+}
+
+void dmi_socket_t::execute_requests()
+{
+  size_t total_processed = 0;
+  while (1) {
+    size_t send_offset = 0;
+    bool run_harts = false;
+    while (recv_end - recv_start >= (ssize_t) request_size) {
+      const uint8_t *req = recv_buf + recv_start;
+      uint32_t op = get_le32(req);
+      uint32_t address = get_le32(req + 4);
+      uint32_t data = get_le32(req + 8);
+
+      bool success = true;
+      uint32_t value = 0;
+      if (op == 1)
+        success = dm->dmi_read(address, &value);
+      else if (op == 2)
+        success = dm->dmi_write(address, data);
+      for (unsigned i = 0; i < rti_cycles_per_access; i++)
+        dm->run_test_idle();
+
+      put_le32(send_buf + send_offset, success ? 0 : 2);
+      put_le32(send_buf + send_offset + 4, value);
+      send_offset += reply_size;
+      recv_start += request_size;
+      total_processed++;
+
+      // Give the harts their quantum before going on, as the JTAG
+      // transport would.
+      if (dm->needs_harts()) {
+        run_harts = true;
+        break;
+      }
+    }
+    send(send_buf, send_offset);
+
+    // Don't go forever, because that could starve the main simulation.
+    if (run_harts || total_processed > buf_size / request_size)
+      break;
+
+    // keep a partial request for the next read
+    memmove(recv_buf, recv_buf + recv_start, recv_end - recv_start);
+    recv_end -= recv_start;
+    recv_start = 0;
+
+    ssize_t bytes = read(client_fd, recv_buf + recv_end, buf_size - recv_end);
+    if (bytes == -1) {
+      if (errno == EAGAIN) {
+        break;
+      } else {
+        fprintf(stderr, "dmi_socket failed to read on socket: %s (%d)\n",
+            strerror(errno), errno);
+        abort();
+      }
+    }
+
+    if (bytes == 0) {
+      // The remote disconnected.
+      close(client_fd);
+      client_fd = 0;
+      break;
+    }
+    recv_end += bytes;
+  }
+}
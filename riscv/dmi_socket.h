@@ -0,0 +1,52 @@
+#ifndef DMI_SOCKET_H
+#define DMI_SOCKET_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+class debug_module_t;
+
+// A debug transport for test harnesses: DMI accesses arrive over a TCP
+// socket and go straight to the debug module, without a JTAG TAP and its
+// thousands of bit-level messages per access.
+//
+// Requests are 12 bytes, little-endian: u32 op (1 read, 2 write, anything
+// else a no-op), u32 address, u32 data. Each request gets an 8-byte reply:
+// u32 status (0 success, 2 failed, as in the DTM's dmi.op), u32 data (the
+// value read, else 0). Requests may be pipelined; they are handled in
+// order, and replies for a batch are sent together.
+//
+// Each access also counts as the Run-Test/Idle cycles a JTAG debugger
+// would spend after it, so system bus accesses complete; a busy abstract
+// command still reads back as busy until a hart has run it.
+class dmi_socket_t
+{
+public:
+  // Listen for a connection on the given port (0 picks one).
+  dmi_socket_t(uint16_t port, debug_module_t *dm);
+
+  // Do a bit of work.
+  void tick();
+
+private:
+  debug_module_t *dm;
+
+  int socket_fd;
+  int client_fd;
+
+  static const size_t request_size = 12;
+  static const size_t reply_size = 8;
+  static const unsigned rti_cycles_per_access = 32;
+  static const ssize_t buf_size = 64 * 1024;
+  uint8_t recv_buf[buf_size];
+  uint8_t send_buf[buf_size / request_size * reply_size];
+  ssize_t recv_start, recv_end;
+
+  // Check for a client connecting, and accept if there is one.
+  void accept();
+  // Execute any requests the client has for us.
+  void execute_requests();
+  void send(const uint8_t *buf, size_t len);
+};
+
+#endif
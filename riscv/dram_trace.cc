@@ -0,0 +1,47 @@
+// See LICENSE for license details.
+
+#include "dram_trace.h"
+#include "processor.h"
+#include <cinttypes>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+dram_trace_t::dram_trace_t(const char* path, const char* format)
+  : format(parse_format(format)), out(path, log_file_t::DEFAULT_BUFFER_SIZE, true),
+    now(0)
+{
+}
+
+dram_trace_t::~dram_trace_t()
+{
+  for (auto proc : procs)
+    proc->set_dram_trace(nullptr);
+}
+
+dram_trace_t::format_t dram_trace_t::parse_format(const char* format)
+{
+  if (strcmp(format, "ramulator") == 0)
+    return RAMULATOR;
+  if (strcmp(format, "dramsim3") == 0)
+    return DRAMSIM3;
+  throw std::runtime_error(std::string("Unknown DRAM trace format `") + format +
+                           "' (expected ramulator or dramsim3)");
+}
+
+void dram_trace_t::attach(processor_t* proc)
+{
+  procs.push_back(proc);
+  proc->set_dram_trace(this);
+}
+
+void dram_trace_t::trace(uint64_t addr, size_t UNUSED bytes, access_type type)
+{
+  if (type == FETCH)
+    return;
+  bool write = type == STORE;
+  if (format == RAMULATOR)
+    fprintf(out.get(), "0x%" PRIx64 " %s %" PRIu64 "\n", addr, write ? "W" : "R", now);
+  else
+    fprintf(out.get(), "0x%" PRIx64 " %s %" PRIu64 "\n", addr, write ? "WRITE" : "READ", now);
+}
@@ -0,0 +1,55 @@
+// See LICENSE for license details.
+#ifndef _RISCV_DRAM_TRACE_H
+#define _RISCV_DRAM_TRACE_H
+
+#include "memtracer.h"
+#include "common.h"
+#include "log_file.h"
+#include <cstdint>
+#include <vector>
+
+class processor_t;
+
+// Memory requests written as a trace for a DRAM simulator, one line each:
+//
+//   ramulator: 0x<addr> R|W <insns>       (Ramulator's DRAM-mode trace,
+//                                          which ignores the count)
+//   dramsim3:  0x<addr> READ|WRITE <insns>
+//
+// Given to a cache model with set_miss_tracer(), it sees the fills (reads)
+// and writebacks (writes) of the lowest level; registered with the MMUs,
+// the loads and stores themselves. insns, standing in for the cycle, is how
+// many instructions the attached harts had retired by the start of the
+// step() a request falls in, so it advances in whole interleave quanta.
+// Lines go through a buffer written by a thread of its own. The harts must
+// not run in parallel, nor the caches on threads of their own.
+class dram_trace_t : public memtracer_t
+{
+ public:
+  enum format_t { RAMULATOR, DRAMSIM3 };
+
+  // Throws std::runtime_error if path cannot be opened or format is not
+  // one of "ramulator" and "dramsim3".
+  dram_trace_t(const char* path, const char* format);
+  ~dram_trace_t();
+
+  void attach(processor_t* proc);
+  void retired(uint64_t insns) { now += insns; }
+
+  bool interested_in_range(uint64_t UNUSED begin, uint64_t UNUSED end, access_type type)
+  {
+    return type != FETCH;
+  }
+  void trace(uint64_t addr, size_t bytes, access_type type);
+  void clean_invalidate(uint64_t UNUSED addr, size_t UNUSED bytes, bool UNUSED clean, bool UNUSED inval) {}
+
+ private:
+  static format_t parse_format(const char* format);
+
+  format_t format;
+  log_file_t out;
+  std::vector<processor_t*> procs;
+  uint64_t now;
+};
+
+#endif
@@ -5,7 +5,10 @@
 #include "libfdt.h"
 #include "platform.h"
 #include <cassert>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <signal.h>
 #include <unistd.h>
@@ -22,7 +25,7 @@ std::string make_dts(size_t insns_per_rtc_tick, size_t cpu_hz,
   const char* bootargs = cfg->bootargs;
   reg_t pmpregions = cfg->pmpregions;
   reg_t pmpgranularity = cfg->pmpgranularity;
-  isa_parser_t isa(cfg->isa, cfg->priv);
+  const isa_parser_t& isa = *isa_parser_t::get(cfg->isa, cfg->priv);
 
   std::stringstream s;
   s << std::dec <<
@@ -183,6 +186,285 @@ static std::string dtc_compile(const std::string& dtc_input, bool compile)
   return dtc_output.str();
 }
 
+// Built-in compiler for the DTS subset Spike generates: labelled nodes and
+// properties, strings, <cells> with &label phandle references, [bytes] and
+// &label path references. Anything else makes it give up, and dts_to_dtb()
+// falls back to the external dtc.
+namespace {
+
+struct dts_part_t {
+  enum { BYTES, PHANDLE, PATH } kind;
+  std::string data;           // raw bytes, or the referenced label
+};
+
+struct dts_prop_t {
+  std::string name;
+  std::vector<dts_part_t> value;
+};
+
+struct dts_node_t {
+  std::string name;
+  dts_node_t* parent = nullptr;
+  uint32_t phandle = 0;
+  std::vector<dts_prop_t> props;
+  std::vector<std::unique_ptr<dts_node_t>> children;
+
+  std::string path() const {
+    if (!parent)
+      return "/";
+    std::string p = parent->path();
+    return (p == "/" ? "" : p) + "/" + name;
+  }
+};
+
+class dts_parser_t {
+ public:
+  dts_parser_t(const std::string& s) : s(s), pos(0) {}
+
+  bool parse(dts_node_t& root) {
+    skip();
+    if (!eat("/dts-v1/") || !eat(";") || !eat("/") || !eat("{"))
+      return false;
+    if (!parse_body(root) || !eat(";"))
+      return false;
+    skip();
+    return pos == s.size();
+  }
+
+  std::map<std::string, dts_node_t*> labels;
+
+ private:
+  void skip() {
+    while (pos < s.size()) {
+      if (isspace((unsigned char)s[pos])) {
+        pos++;
+      } else if (s.compare(pos, 2, "//") == 0) {
+        pos = s.find('\n', pos);
+        if (pos == std::string::npos)
+          pos = s.size();
+      } else if (s.compare(pos, 2, "/*") == 0) {
+        pos = s.find("*/", pos + 2);
+        pos = pos == std::string::npos ? s.size() : pos + 2;
+      } else {
+        break;
+      }
+    }
+  }
+
+  bool eat(const char* tok) {
+    size_t n = strlen(tok);
+    if (s.compare(pos, n, tok) != 0)
+      return false;
+    pos += n;
+    skip();
+    return true;
+  }
+
+  std::string name() {
+    size_t start = pos;
+    while (pos < s.size() && (isalnum((unsigned char)s[pos]) || strchr(",._+*#?@-", s[pos])))
+      pos++;
+    std::string n = s.substr(start, pos - start);
+    skip();
+    return n;
+  }
+
+  // Node and property names, each optionally preceded by "label:".
+  std::string labelled_name(std::string& label) {
+    std::string n = name();
+    if (!n.empty() && eat(":")) {
+      label = n;
+      n = name();
+    }
+    return n;
+  }
+
+  bool parse_body(dts_node_t& node) {
+    while (!eat("}")) {
+      std::string label;
+      std::string n = labelled_name(label);
+      if (n.empty())
+        return false;
+      if (eat("{")) {
+        node.children.emplace_back(new dts_node_t());
+        dts_node_t* child = node.children.back().get();
+        child->name = n;
+        child->parent = &node;
+        if (!label.empty() && !labels.emplace(label, child).second)
+          return false;
+        if (!parse_body(*child) || !eat(";"))
+          return false;
+        continue;
+      }
+      dts_prop_t prop;
+      prop.name = n;
+      if (eat("=")) {
+        do {
+          if (!parse_value(prop.value))
+            return false;
+        } while (eat(","));
+      }
+      if (!eat(";"))
+        return false;
+      node.props.push_back(std::move(prop));
+    }
+    return true;
+  }
+
+  static void append_cell(std::vector<dts_part_t>& v, uint32_t cell) {
+    char be[4] = { char(cell >> 24), char(cell >> 16), char(cell >> 8), char(cell) };
+    if (v.empty() || v.back().kind != dts_part_t::BYTES)
+      v.push_back({dts_part_t::BYTES, ""});
+    v.back().data.append(be, 4);
+  }
+
+  bool parse_value(std::vector<dts_part_t>& v) {
+    if (pos < s.size() && s[pos] == '"') {
+      std::string str;
+      for (pos++; pos < s.size() && s[pos] != '"'; pos++) {
+        char c = s[pos];
+        if (c == '\\') {
+          if (++pos == s.size())
+            return false;
+          c = s[pos] == 'n' ? '\n' : s[pos] == 't' ? '\t' : s[pos];
+          if (c != '\n' && c != '\t' && c != '"' && c != '\\')
+            return false;
+        }
+        str += c;
+      }
+      if (pos == s.size())
+        return false;
+      pos++;
+      skip();
+      str += '\0';
+      v.push_back({dts_part_t::BYTES, str});
+      return true;
+    }
+    if (eat("<")) {
+      while (!eat(">")) {
+        if (eat("&")) {
+          std::string label = name();
+          if (label.empty())
+            return false;
+          v.push_back({dts_part_t::PHANDLE, label});
+          continue;
+        }
+        const char* start = s.c_str() + pos;
+        char* end;
+        unsigned long long cell = strtoull(start, &end, 0);
+        if (end == start || cell > UINT32_MAX)
+          return false;
+        pos += end - start;
+        skip();
+        append_cell(v, cell);
+      }
+      // An empty <> still yields a (zero-length) value.
+      if (v.empty())
+        v.push_back({dts_part_t::BYTES, ""});
+      return true;
+    }
+    if (eat("[")) {
+      std::string bytes;
+      while (!eat("]")) {
+        if (pos + 2 > s.size() || !isxdigit((unsigned char)s[pos]) || !isxdigit((unsigned char)s[pos + 1]))
+          return false;
+        bytes += char(strtoul(s.substr(pos, 2).c_str(), nullptr, 16));
+        pos += 2;
+        skip();
+      }
+      v.push_back({dts_part_t::BYTES, bytes});
+      return true;
+    }
+    if (eat("&")) {
+      std::string label = name();
+      if (label.empty())
+        return false;
+      v.push_back({dts_part_t::PATH, label});
+      return true;
+    }
+    return false;
+  }
+
+  const std::string& s;
+  size_t pos;
+};
+
+// Gives every node referenced from a cell list a phandle, in tree order.
+bool assign_phandles(dts_node_t& node, std::map<std::string, dts_node_t*>& labels, uint32_t& next)
+{
+  for (auto& prop : node.props)
+    for (auto& part : prop.value) {
+      if (part.kind == dts_part_t::BYTES)
+        continue;
+      auto it = labels.find(part.data);
+      if (it == labels.end())
+        return false;
+      if (part.kind == dts_part_t::PHANDLE && !it->second->phandle)
+        it->second->phandle = next++;
+    }
+  for (auto& child : node.children)
+    if (!assign_phandles(*child, labels, next))
+      return false;
+  return true;
+}
+
+int emit_node(void* fdt, const dts_node_t& node, std::map<std::string, dts_node_t*>& labels)
+{
+  int rc = fdt_begin_node(fdt, node.parent ? node.name.c_str() : "");
+  for (auto& prop : node.props) {
+    std::string value;
+    for (auto& part : prop.value) {
+      if (part.kind == dts_part_t::BYTES) {
+        value += part.data;
+      } else if (part.kind == dts_part_t::PATH) {
+        value += labels[part.data]->path();
+        value += '\0';
+      } else {
+        uint32_t ph = labels[part.data]->phandle;
+        char be[4] = { char(ph >> 24), char(ph >> 16), char(ph >> 8), char(ph) };
+        value.append(be, 4);
+      }
+    }
+    if (rc == 0)
+      rc = fdt_property(fdt, prop.name.c_str(), value.data(), value.size());
+  }
+  if (rc == 0 && node.phandle)
+    rc = fdt_property_u32(fdt, "phandle", node.phandle);
+  for (auto& child : node.children)
+    if (rc == 0)
+      rc = emit_node(fdt, *child, labels);
+  return rc == 0 ? fdt_end_node(fdt) : rc;
+}
+
+bool builtin_dts_to_dtb(const std::string& dts, std::string& dtb)
+{
+  dts_node_t root;
+  dts_parser_t parser(dts);
+  uint32_t next_phandle = 1;
+  if (!parser.parse(root) || !assign_phandles(root, parser.labels, next_phandle))
+    return false;
+
+  for (size_t size = dts.size() * 2 + 1024; ; size *= 2) {
+    std::vector<char> buf(size);
+    void* fdt = buf.data();
+    int rc = fdt_create(fdt, size);
+    if (rc == 0)
+      rc = fdt_finish_reservemap(fdt);
+    if (rc == 0)
+      rc = emit_node(fdt, root, parser.labels);
+    if (rc == 0)
+      rc = fdt_finish(fdt);
+    if (rc == -FDT_ERR_NOSPACE)
+      continue;
+    if (rc != 0)
+      return false;
+    dtb.assign(buf.data(), fdt_totalsize(fdt));
+    return true;
+  }
+}
+
+} // namespace
+
 std::string dtb_to_dts(const std::string& dtc_input)
 {
   return dtc_compile(dtc_input, false);
@@ -190,6 +472,9 @@ std::string dtb_to_dts(const std::string& dtc_input)
 
 std::string dts_to_dtb(const std::string& dtc_input)
 {
+  std::string dtb;
+  if (builtin_dts_to_dtb(dtc_input, dtb))
+    return dtb;
   return dtc_compile(dtc_input, true);
 }
 
@@ -353,6 +638,32 @@ int fdt_parse_ns16550(const void *fdt, reg_t *ns16550_addr,
   return 0;
 }
 
+int fdt_parse_virtio_mmio(const void *fdt, reg_t *addr, uint32_t *int_id,
+                          const char *compatible)
+{
+  int nodeoffset, len, rc;
+  const fdt32_t *reg_p;
+
+  nodeoffset = fdt_node_offset_by_compatible(fdt, -1, compatible);
+  if (nodeoffset < 0)
+    return nodeoffset;
+
+  rc = fdt_get_node_addr_size(fdt, nodeoffset, addr, NULL, "reg");
+  if (rc < 0 || !addr)
+    return -ENODEV;
+
+  reg_p = (fdt32_t *)fdt_getprop(fdt, nodeoffset, "interrupts", &len);
+  if (int_id) {
+    if (reg_p) {
+      *int_id = fdt32_to_cpu(*reg_p);
+    } else {
+      *int_id = VIRTIO_BLK_INTERRUPT_ID;
+    }
+  }
+
+  return 0;
+}
+
 int fdt_parse_pmp_num(const void *fdt, int cpu_offset, reg_t *pmp_num)
 {
   int rc;
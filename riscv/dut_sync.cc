@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cstring>
+#include "devices.h"
+#include "processor.h"
+#include "simif.h"
+#include "input_log.h"
+
+dut_sync_device_t::dut_sync_device_t(const simif_t* sim, reg_t size)
+  : sim(sim), shadow(size, 0)
+{
+}
+
+bool dut_sync_device_t::load(reg_t addr, size_t len, uint8_t* bytes)
+{
+  if (len > sizeof(uint64_t) || addr + len > shadow.size())
+    return false;
+
+  if (!loads.empty() && loads.front().first == addr && !(sim->input_log && sim->input_log->replaying())) {
+    uint64_t value = loads.front().second;
+    loads.pop();
+    for (size_t i = 0; i < len; i++)
+      shadow[addr + i] = value >> (8 * i);
+  }
+
+  if (sim->input_log) {
+    uint64_t value = sim->input_log->mmio_load(addr, [&] {
+      uint64_t v = 0;
+      memcpy(&v, &shadow[addr], len);
+      return v;
+    });
+    for (size_t i = 0; i < len; i++)
+      shadow[addr + i] = value >> (8 * i);
+  }
+
+  memcpy(bytes, &shadow[addr], len);
+  return true;
+}
+
+bool dut_sync_device_t::store(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  if (len > sizeof(uint64_t) || addr + len > shadow.size())
+    return false;
+
+  memcpy(&shadow[addr], bytes, len);
+  return true;
+}
+
+void dut_sync_device_t::push_load(reg_t addr, uint64_t value)
+{
+  loads.push(std::make_pair(addr, value));
+}
+
+void dut_sync_device_t::schedule_interrupt(reg_t hartid, reg_t instret, reg_t mask, bool raise)
+{
+  auto it = std::upper_bound(irq_events.begin(), irq_events.end(), instret,
+                             [](reg_t n, const irq_event_t& e) { return n < e.instret; });
+  irq_events.insert(it, irq_event_t{hartid, instret, mask, raise});
+}
+
+reg_t dut_sync_device_t::next_due(reg_t hartid) const
+{
+  for (auto& e : irq_events)
+    if (e.hartid == hartid)
+      return e.instret;
+  return reg_t(-1);
+}
+
+reg_t dut_sync_device_t::sync()
+{
+  reg_t next = reg_t(-1);
+
+  for (auto it = irq_events.begin(); it != irq_events.end(); ) {
+    processor_t* hart = sim->get_hart(it->hartid);
+    if (!hart) {
+      it = irq_events.erase(it);
+      continue;
+    }
+
+    state_t* state = hart->get_state();
+    reg_t instret = state->minstret->read();
+    if (it->instret <= instret) {
+      state->mip->backdoor_write_with_mask(it->mask, it->raise ? it->mask : 0);
+      it = irq_events.erase(it);
+    } else {
+      next = std::min(next, it->instret - instret);
+      ++it;
+    }
+  }
+
+  return next;
+}
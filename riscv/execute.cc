@@ -5,6 +5,11 @@
 #include "mmu.h"
 #include "disasm.h"
 #include "decode_macros.h"
+#include "bbv.h"
+#include "call_tracer.h"
+#include "cache_sampler.h"
+#include "dram_trace.h"
+#include <algorithm>
 #include <cassert>
 
 static void commit_log_reset(processor_t* p)
@@ -150,6 +155,14 @@ static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
   fprintf(log_file, "\n");
 }
 
+static void commit_log_commit(processor_t *p, reg_t pc, insn_t insn)
+{
+  if (p->get_log_commits_printed() && p->commit_log_accepts(pc))
+    commit_log_print_insn(p, pc, insn);
+  for (auto observer : p->get_commit_observers())
+    observer->on_commit(p, pc, insn);
+}
+
 inline void processor_t::update_histogram(reg_t pc)
 {
   if (histogram_enabled)
@@ -157,7 +170,8 @@ inline void processor_t::update_histogram(reg_t pc)
 }
 
 // These two functions are expected to be inlined by the compiler separately in
-// the processor_t::step() loop. The logged variant is used in the slow path
+// the processor_t::step() loop. The logged variant is used in the slow path,
+// and in the fast path when commits are captured for observers only
 static inline reg_t execute_insn_fast(processor_t* p, reg_t pc, insn_fetch_t fetch) {
   return fetch.func(p, fetch.insn, pc);
 }
@@ -172,14 +186,14 @@ static inline reg_t execute_insn_logged(processor_t* p, reg_t pc, insn_fetch_t f
 
   try {
     npc = fetch.func(p, fetch.insn, pc);
-    if (npc != PC_SERIALIZE_BEFORE) {
+    if (npc != PC_SERIALIZE_BEFORE && npc != PC_TRAP) {
       if (p->get_log_commits_enabled()) {
-        commit_log_print_insn(p, pc, fetch.insn);
+        commit_log_commit(p, pc, fetch.insn);
       }
      }
   } catch (wait_for_interrupt_t &t) {
       if (p->get_log_commits_enabled()) {
-        commit_log_print_insn(p, pc, fetch.insn);
+        commit_log_commit(p, pc, fetch.insn);
       }
       throw;
   } catch(mem_trap_t& t) {
@@ -187,7 +201,7 @@ static inline reg_t execute_insn_logged(processor_t* p, reg_t pc, insn_fetch_t f
       if (p->get_log_commits_enabled()) {
         for (auto item : p->get_state()->log_reg_write) {
           if ((item.first & 3) == 3) {
-            commit_log_print_insn(p, pc, fetch.insn);
+            commit_log_commit(p, pc, fetch.insn);
             break;
           }
         }
@@ -196,19 +210,66 @@ static inline reg_t execute_insn_logged(processor_t* p, reg_t pc, insn_fetch_t f
   } catch(...) {
     throw;
   }
-  p->update_histogram(pc);
 
   return npc;
 }
 
+void processor_t::handle_trap(trap_t& t, reg_t epc)
+{
+  take_trap(t, epc);
+  if (unlikely(state.pc == stop_pc))
+    stop_hit = true;
+
+  // If critical error then enter debug mode critical error trigger enabled
+  if (state.critical_error) {
+    if (state.dcsr->read() & DCSR_CETRIG) {
+      enter_debug_mode(DCSR_CAUSE_EXTCAUSE, DCSR_EXTCAUSE_CRITERR);
+    } else {
+      // Handling of critical error is implementation defined
+      // For now just enter debug mode
+      enter_debug_mode(DCSR_CAUSE_HALT, 0);
+    }
+  }
+  // Trigger action takes priority over single step
+  auto match = TM.detect_trap_match(t);
+  if (match.has_value())
+    take_trigger_action(match->action, 0, state.pc, 0);
+  else if (unlikely(state.single_step == state.STEP_STEPPED)) {
+    state.single_step = state.STEP_NONE;
+    enter_debug_mode(DCSR_CAUSE_STEP, 0);
+  }
+}
+
+// The integer registers an instruction's register fields might name,
+// whatever the instruction, as a mask. Compressed ones also add sp and ra,
+// which c.jal, c.jalr and the stack-pointer forms use without naming; the
+// Zcmp/Zcmt space (cm.push, cm.popret, cm.mvsa01, cm.jalt) could touch any.
+static reg_t xpr_fields(insn_t insn)
+{
+  auto bit = [](reg_t r) { return reg_t(1) << r; };
+  switch (insn_length(insn.bits())) {
+    case 2:
+      if ((insn.bits() & 0xe003) == 0xa002)
+        return -1;
+      return bit(1) | bit(2) | bit(insn.rvc_rd()) | bit(insn.rvc_rs2()) |
+             bit(insn.rvc_rs1s()) | bit(insn.rvc_rs2s());
+    case 4:
+      return bit(insn.rd()) | bit(insn.rs1()) | bit(insn.rs2()) | bit(insn.rs3());
+    default:
+      return -1;
+  }
+}
+
 bool processor_t::slow_path() const
 {
   return debug || state.single_step != state.STEP_NONE || state.debug_mode ||
-         log_commits_enabled || histogram_enabled || in_wfi || check_triggers_icount;
+         (log_commits_printed && !log_filter) || call_tracer || mmu->get_observer() || xpr_pending ||
+         ((histogram_enabled || insn_stats_enabled) && !mmu->block_cache_enabled()) ||
+         in_wfi;
 }
 
 // fetch/decode/execute loop
-void processor_t::step(size_t n)
+size_t processor_t::step(size_t n)
 {
   mmu_t* _mmu = mmu;
 
@@ -225,16 +286,32 @@ void processor_t::step(size_t n)
 
   if (extension_enabled(EXT_ZICCID)) {
     // Ziccid requires stores eventually become visible to instruction fetch,
-    // so periodically flush the I$
+    // so periodically drop what other writers may have made stale
     if (ziccid_flush_count-- == 0) {
       ziccid_flush_count += ZICCID_FLUSH_PERIOD;
-      _mmu->flush_icache();
+      _mmu->fence_i();
     }
   }
 
+  mmio_barrier_hit = false;
+  stop_hit = false;
+  size_t retired = 0;
+
   while (n > 0) {
     size_t instret = 0;
+    // Instructions to run before returning to the top of this loop
+    size_t chunk = n;
+    // Whether chunk was cut short of the next icount trigger firing, to be
+    // run without per-instruction checks
+    bool icount_chunk = false;
+    // Whether an instruction started but neither retired nor was abandoned
+    // for re-execution
+    bool aborted = true;
     reg_t pc = state.pc;
+    // Block being executed by block_loop, if an instruction in it throws
+    // and a profile is counting block exits.
+    insn_block_t* cur_block = nullptr;
+    size_t block_start = 0;
     state.prv_changed = false;
     state.v_changed = false;
 
@@ -243,6 +320,7 @@ void processor_t::step(size_t n)
         switch (pc) { \
           case PC_SERIALIZE_BEFORE: state.serialized = true; break; \
           case PC_SERIALIZE_AFTER: ++instret; break; \
+          case PC_TRAP: break; \
           default: abort(); \
         } \
         pc = state.pc; \
@@ -252,16 +330,58 @@ void processor_t::step(size_t n)
         instret++; \
       }
 
+    // The fast loops only get here at the end of an icache chain or block;
+    // the stop pc is kept out of both, and request_stop breaks the chain.
+    #define check_stop() \
+      if (unlikely(pc == stop_pc || stop_requested)) { \
+        stop_requested = false; \
+        stop_hit = true; \
+        n = chunk = instret; \
+      }
+
+    // ... and, with a filtered commit log, at the ranges' pcs, which are
+    // never chained either; the chunk ends there if the filter accepts.
+    #define check_log_filter() \
+      if (unlikely(log_filter != nullptr) && log_commits_printed && \
+          log_filter->covers(pc) && commit_log_accepts(pc)) \
+        chunk = instret;
+
     try
     {
       take_pending_interrupt();
 
       check_if_lpad_required();
 
-      if (unlikely(slow_path()))
+      bool slow = slow_path();
+      // A filtered commit log takes the slow path only while the filter
+      // accepts, and its window's edges end chunks.
+      bool log_slow = false;
+      if (unlikely(log_filter != nullptr) && log_commits_printed) {
+        chunk = std::min<uint64_t>(chunk, log_filter->window_left(log_filter_retired));
+        bool accepts = commit_log_accepts(pc);
+        // outside the filter the TLB caches data pages and the fast
+        // handlers run; the slow path logs throughout, as it may enter it
+        update_log_commits(accepts || slow);
+        log_slow = !slow && accepts;
+        slow |= log_slow;
+      }
+      if (unlikely(check_triggers_icount) && !slow) {
+        // Step one instruction at a time only when a trigger is about to
+        // fire; a serialized instruction is done on its own regardless.
+        reg_t budget = state.serialized ? 0 : TM.icount_budget();
+        if (budget == 0) {
+          slow = true;
+          chunk = 1;
+        } else {
+          icount_chunk = true;
+          chunk = std::min<reg_t>(chunk, budget);
+        }
+      }
+
+      if (unlikely(slow))
       {
         // Main simulation loop, slow path.
-        while (instret < n)
+        while (instret < chunk)
         {
           if (unlikely(!state.serialized && state.single_step == state.STEP_STEPPED)) {
             state.single_step = state.STEP_NONE;
@@ -289,12 +409,29 @@ void processor_t::step(size_t n)
             throw wait_for_interrupt_t();
           }
 
+          if (unlikely(log_slow) && !commit_log_accepts(pc))
+            break;
+
           in_wfi = false;
           insn_fetch_t fetch = mmu->load_insn(pc);
+          if (unlikely(xpr_pending & xpr_fields(fetch.insn))) {
+            stop_hit = true;
+            n = chunk = instret;
+            break;
+          }
           if (debug && !state.serialized)
             disasm(fetch.insn);
+          reg_t insn_pc = pc, insn_prv = state.prv;
           pc = execute_insn_logged(this, pc, fetch);
+          if (likely(pc != PC_TRAP)) {
+            update_histogram(insn_pc);
+            if (unlikely(insn_stats_enabled))
+              count_insns(fetch.insn.bits(), insn_prv, 1);
+          }
+          if (unlikely(call_tracer != nullptr) && !invalid_pc(pc))
+            call_tracer->retired(fetch.insn, insn_pc, pc, state.minstret->read() + instret);
           advance_pc();
+          check_stop();
 
           // Resume from debug mode in critical error
           if (state.critical_error && !state.debug_mode) {
@@ -308,47 +445,84 @@ void processor_t::step(size_t n)
           }
         }
       }
-      else while (instret < n)
+      else
       {
-        // Main simulation loop, fast path.
-        for (auto ic_entry = _mmu->access_icache(pc); ; ) {
-          auto fetch = ic_entry->data;
-          pc = execute_insn_fast(this, pc, fetch);
-          ic_entry = ic_entry->next;
-          if (unlikely(ic_entry->tag != pc))
-            break;
-          if (unlikely(instret + 1 == n))
-            break;
-          instret++;
-          state.pc = pc;
+        #define fast_loop(execute_insn) \
+          while (instret < chunk) { \
+            size_t chain_start = instret; \
+            for (auto ic_entry = _mmu->access_icache(pc); ; ) { \
+              auto fetch = ic_entry->data; \
+              pc = execute_insn(this, pc, fetch); \
+              ic_entry = ic_entry->next; \
+              if (unlikely(ic_entry->tag != pc)) \
+                break; \
+              if (unlikely(instret + 1 == chunk)) \
+                break; \
+              instret++; \
+              state.pc = pc; \
+            } \
+            _mmu->count_icache_chain_hits(instret - chain_start); \
+            advance_pc(); \
+            check_stop(); \
+            check_log_filter(); \
+          }
+
+        // Same, over decoded blocks: a block is entered with one lookup, or
+        // none when linked from a hot predecessor, and left early when an
+        // instruction does not fall through.
+        #define block_loop(execute_insn) \
+          for (insn_block_t* block = nullptr; instret < chunk; ) { \
+            block_start = instret; \
+            block = _mmu->next_block(block, pc); \
+            if (unlikely(count_exits)) \
+              cur_block = block; \
+            for (size_t i = 0; ; ) { \
+              pc = execute_insn(this, pc, block->insns[i]); \
+              if (unlikely(pc != block->next_pc[i])) \
+                break; \
+              if (++i == block->n) \
+                break; \
+              if (unlikely(instret + 1 == chunk)) \
+                break; \
+              instret++; \
+              state.pc = pc; \
+            } \
+            /* a raised trap leaves like a thrown one, below */ \
+            if (unlikely(count_exits) && (likely(pc != PC_TRAP) || instret > block_start)) \
+              block->exits[instret - block_start - (pc == PC_TRAP)]++; \
+            cur_block = nullptr; \
+            _mmu->count_icache_chain_hits(instret - block_start); \
+            advance_pc(); \
+            check_stop(); \
+            check_log_filter(); \
+          }
+
+        // Main simulation loop, fast path. Commit observers are still served
+        // here: only the capture itself is added per instruction.
+        if (_mmu->block_cache_enabled()) {
+          const bool count_exits = _mmu->block_counts_enabled();
+          if (unlikely(log_commits_enabled))
+            block_loop(execute_insn_logged)
+          else
+            block_loop(execute_insn_fast)
+        } else {
+          if (unlikely(log_commits_enabled))
+            fast_loop(execute_insn_logged)
+          else
+            fast_loop(execute_insn_fast)
         }
 
-        advance_pc();
+        #undef fast_loop
+        #undef block_loop
+        #undef check_stop
+        #undef check_log_filter
       }
+      aborted = false;
     }
     catch(trap_t& t)
     {
-      take_trap(t, pc);
+      handle_trap(t, pc);
       n = instret;
-
-      // If critical error then enter debug mode critical error trigger enabled
-      if (state.critical_error) {
-        if (state.dcsr->read() & DCSR_CETRIG) {
-          enter_debug_mode(DCSR_CAUSE_EXTCAUSE, DCSR_EXTCAUSE_CRITERR);
-        } else {
-          // Handling of critical error is implementation defined
-          // For now just enter debug mode
-          enter_debug_mode(DCSR_CAUSE_HALT, 0);
-        }
-      }
-      // Trigger action takes priority over single step
-      auto match = TM.detect_trap_match(t);
-      if (match.has_value())
-        take_trigger_action(match->action, 0, state.pc, 0);
-      else if (unlikely(state.single_step == state.STEP_STEPPED)) {
-        state.single_step = state.STEP_NONE;
-        enter_debug_mode(DCSR_CAUSE_STEP, 0);
-      }
     }
     catch (triggers::matched_t& t)
     {
@@ -358,6 +532,12 @@ void processor_t::step(size_t n)
     {
       enter_debug_mode(DCSR_CAUSE_SWBP, 0);
     }
+    catch (mmio_barrier_t&)
+    {
+      // state.pc still names the abandoned instruction
+      n = instret;
+      mmio_barrier_hit = true;
+    }
     catch (wait_for_interrupt_t &t)
     {
       // Return to the outer simulation loop, which gives other devices/harts a
@@ -368,13 +548,52 @@ void processor_t::step(size_t n)
       // there is activity.
       n = ++instret;
       in_wfi = true;
+      aborted = false;
     }
 
-    state.minstret->bump((state.mcountinhibit->read() & MCOUNTINHIBIT_IR) ? 0 : instret);
+    // A trap raised by an instruction returning PC_TRAP ends the step as a
+    // thrown one would.
+    if (unlikely(stashed_trap != nullptr)) {
+      trap_t* t = stashed_trap;
+      stashed_trap = nullptr;
+      aborted = true;
+      handle_trap(*t, pc);
+      t->~trap_t();
+      n = instret;
+    }
 
-    // Model a hart whose CPI is 1.
-    state.mcycle->bump((state.mcountinhibit->read() & MCOUNTINHIBIT_CY) ? 0 : instret);
+    // Count down the icount triggers by the instructions the slow path
+    // would have checked: those retired, plus one abandoned for
+    // serialization or stopped by an exception.
+    if (unlikely(icount_chunk))
+      TM.icount_retire(instret + (aborted || state.serialized));
+
+    // Credit the instructions of a block that retired before it was left
+    // by an exception.
+    if (unlikely(cur_block != nullptr) && instret > block_start)
+      cur_block->exits[instret - block_start - 1]++;
+
+    if (likely(!state.counters_dirty)) {
+      // Nothing the counters depend on changed; they catch up when read.
+      state.lazy_retired += instret;
+    } else {
+      state.counters_dirty = false;
+      state.minstret->bump((state.mcountinhibit->read() & MCOUNTINHIBIT_IR) ? 0 : instret);
+
+      // Model a hart whose CPI is 1.
+      state.mcycle->bump((state.mcountinhibit->read() & MCOUNTINHIBIT_CY) ? 0 : instret);
+    }
 
+    retired += instret;
+    log_filter_retired += instret;
     n -= instret;
   }
+
+  if (unlikely(bbv_profiler != nullptr))
+    bbv_profiler->retired(retired);
+  if (unlikely(cache_sampler != nullptr))
+    cache_sampler->retired(retired);
+  if (unlikely(dram_trace != nullptr))
+    dram_trace->retired(retired);
+  return retired;
 }
@@ -0,0 +1,119 @@
+// See LICENSE for license details.
+
+#include "guest_profiler.h"
+#include "sim.h"
+#include "processor.h"
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+guest_profiler_t::guest_profiler_t(sim_t* sim, const char* path, unsigned hz, bool unwind)
+  : sim(sim), out(fopen(path, "w"), &fclose), unwind(unwind), due(false), stopping(false)
+{
+  if (!out) {
+    std::ostringstream oss;
+    oss << "Failed to open guest profile `" << path << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+  if (hz == 0)
+    throw std::runtime_error("guest profile rate must be positive");
+
+  timer = std::thread(&guest_profiler_t::timer_main, this, hz);
+  sim->set_guest_profiler(this);
+}
+
+guest_profiler_t::~guest_profiler_t()
+{
+  sim->set_guest_profiler(nullptr);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  timer.join();
+  write();
+}
+
+void guest_profiler_t::timer_main(unsigned hz)
+{
+  auto period = std::chrono::nanoseconds(1000000000 / hz);
+  auto next = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> guard(lock);
+  while (!stopping) {
+    next += period;
+    if (wake.wait_until(guard, next, [this] { return stopping; }))
+      break;
+    due.store(true, std::memory_order_relaxed);
+  }
+}
+
+void guest_profiler_t::sample()
+{
+  due.store(false, std::memory_order_relaxed);
+
+  std::vector<reg_t> stack;
+  for (const auto& [id, p] : sim->get_harts()) {
+    state_t* state = p->get_state();
+    stack.clear();
+    stack.push_back(id);
+    stack.push_back(state->debug_mode ? 8 : state->prv + (state->v ? 4 : 0));
+    stack.push_back(state->pc);
+
+    // Frame records are {saved fp, ra} just below fp. Only read them when
+    // data accesses see physical memory.
+    unsigned xlen = p->get_xlen();
+    reg_t satp_mode = get_field(state->satp->read(), xlen == 32 ? SATP32_MODE : SATP64_MODE);
+    bool bare = !state->v && (state->prv == PRV_M ? !(state->mstatus->read() & MSTATUS_MPRV)
+                                                  : satp_mode == 0);
+    if (unwind && bare && !state->debug_mode) {
+      size_t word = xlen / 8;
+      reg_t fp = state->XPR[8];
+      simif_t* mem = sim;
+      while (stack.size() < MAX_DEPTH + 3 && fp >= 2 * word && fp % word == 0) {
+        char* frame = mem->addr_to_mem(fp - 2 * word);
+        if (!frame || !mem->addr_to_mem(fp - 1))
+          break;
+        reg_t next_fp = 0, ra = 0;
+        memcpy(&next_fp, frame, word);
+        memcpy(&ra, frame + word, word);
+        if (!ra)
+          break;
+        stack.push_back(ra);
+        if (next_fp <= fp)
+          break;
+        fp = next_fp;
+      }
+    }
+    stacks[stack]++;
+  }
+}
+
+void guest_profiler_t::write()
+{
+  static const char* privs[] = { "U", "S", "H", "M", "VU", "VS", "VH", "VM", "D" };
+
+  std::map<std::string, uint64_t> folded;
+  for (const auto& [stack, count] : stacks) {
+    std::string line = "core" + std::to_string(stack[0]) + ";" +
+                       privs[std::min<reg_t>(stack[1], 8)];
+    // outermost frame first, and return addresses are after the call
+    for (size_t i = stack.size(); i-- > 2; ) {
+      reg_t addr = i == 2 ? stack[i] : stack[i] - 1;
+      const char* name = sim->find_symbol(addr);
+      char hex[24];
+      if (!name) {
+        snprintf(hex, sizeof(hex), "0x%" PRIx64, stack[i]);
+        name = hex;
+      }
+      line += ";";
+      line += name;
+    }
+    folded[line] += count;
+  }
+
+  for (const auto& [line, count] : folded)
+    fprintf(out.get(), "%s %" PRIu64 "\n", line.c_str(), count);
+}
@@ -0,0 +1,60 @@
+// See LICENSE for license details.
+#ifndef _RISCV_GUEST_PROFILER_H
+#define _RISCV_GUEST_PROFILER_H
+
+#include "common.h"
+#include "decode.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class sim_t;
+
+// Timer-driven sampling of guest pcs, for guest-level flame graphs. A host
+// thread marks a sample due hz times a second of host time; the next
+// scheduling round (sim_t::end_round) then records the pc of every hart,
+// so the cost is one flag test per round. With unwind, return addresses
+// are followed up the s0/fp frame chain (code built with
+// -fno-omit-frame-pointer) while data accesses are untranslated.
+//
+// The destructor writes the samples in folded-stack form, one line
+// "core<n>;<priv>;<outer>;...;<leaf> <count>" per distinct stack, with
+// addresses named by the nearest ELF symbol below them, ready for
+// flamegraph.pl or speedscope.
+class guest_profiler_t {
+ public:
+  // Throws std::runtime_error if path cannot be opened.
+  guest_profiler_t(sim_t* sim, const char* path, unsigned hz, bool unwind);
+  ~guest_profiler_t();
+
+  void poll() {
+    if (unlikely(due.load(std::memory_order_relaxed)))
+      sample();
+  }
+
+ private:
+  void sample();
+  void timer_main(unsigned hz);
+  void write();
+
+  static const size_t MAX_DEPTH = 64;
+
+  sim_t* sim;
+  std::unique_ptr<FILE, int(*)(FILE*)> out;
+  bool unwind;
+  // hart, privilege, then pcs from the leaf outwards
+  std::map<std::vector<reg_t>, uint64_t> stacks;
+
+  std::atomic<bool> due;
+  std::mutex lock;
+  std::condition_variable wake;
+  bool stopping;
+  std::thread timer;
+};
+
+#endif
@@ -0,0 +1,61 @@
+// See LICENSE for license details.
+
+#include "host_aes.h"
+#include "host_cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("aes,sse2")))
+static void aesni_round(host_aes_round_t round, uint8_t* state, const uint8_t* key)
+{
+  __m128i s = _mm_loadu_si128((const __m128i*)state);
+  __m128i k = _mm_loadu_si128((const __m128i*)key);
+  switch (round) {
+    case HOST_AES_ENC_MIDDLE: s = _mm_aesenc_si128(s, k); break;
+    case HOST_AES_ENC_FINAL: s = _mm_aesenclast_si128(s, k); break;
+    // aesdec adds the key before InvMixColumns, Zvkned after it
+    case HOST_AES_DEC_MIDDLE: s = _mm_aesdec_si128(s, _mm_aesimc_si128(k)); break;
+    case HOST_AES_DEC_FINAL: s = _mm_aesdeclast_si128(s, k); break;
+  }
+  _mm_storeu_si128((__m128i*)state, s);
+}
+
+static const bool have_aesni = host_cpu().aes;
+
+bool host_aes_round(host_aes_round_t round, uint8_t* state, const uint8_t* key)
+{
+  if (!have_aesni)
+    return false;
+  aesni_round(round, state, key);
+  return true;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_AES)
+#include <arm_neon.h>
+
+bool host_aes_round(host_aes_round_t round, uint8_t* state, const uint8_t* key)
+{
+  // aese/aesd add the key first, so they are given zero and the round
+  // key is added at the point Zvkned does it
+  uint8x16_t s = vld1q_u8(state);
+  uint8x16_t k = vld1q_u8(key);
+  uint8x16_t zero = vdupq_n_u8(0);
+  switch (round) {
+    case HOST_AES_ENC_MIDDLE: s = veorq_u8(vaesmcq_u8(vaeseq_u8(s, zero)), k); break;
+    case HOST_AES_ENC_FINAL: s = veorq_u8(vaeseq_u8(s, zero), k); break;
+    case HOST_AES_DEC_MIDDLE: s = vaesimcq_u8(veorq_u8(vaesdq_u8(s, zero), k)); break;
+    case HOST_AES_DEC_FINAL: s = veorq_u8(vaesdq_u8(s, zero), k); break;
+  }
+  vst1q_u8(state, s);
+  return true;
+}
+
+#else
+
+bool host_aes_round(host_aes_round_t, uint8_t*, const uint8_t*)
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,22 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_HOST_AES_H
+#define _RISCV_HOST_AES_H
+
+#include <cstdint>
+
+// The four Zvkned round instructions (vaes{e,d}{m,f}).
+enum host_aes_round_t {
+  HOST_AES_ENC_MIDDLE,
+  HOST_AES_ENC_FINAL,
+  HOST_AES_DEC_MIDDLE,
+  HOST_AES_DEC_FINAL,
+};
+
+// Runs one AES round on the 16-byte state with the host's AES
+// instructions (AES-NI, found by CPUID, or the ARMv8 cryptography
+// extension when built for it). Returns false, leaving state untouched,
+// if the host has none; the caller then uses the portable code.
+bool host_aes_round(host_aes_round_t round, uint8_t* state, const uint8_t* key);
+
+#endif
@@ -0,0 +1,117 @@
+// See LICENSE for license details.
+
+#include "host_bitmanip.h"
+#include "host_cpu.h"
+#include "arith.h"
+
+#if !defined(__aarch64__) || !defined(__ARM_FEATURE_AES)
+static void portable_clmul(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi)
+{
+  uint64_t l = 0, h = 0;
+  for (; b; b &= b - 1) {
+    int i = ctz(b);
+    l ^= a << i;
+    if (i)
+      h ^= a >> (64 - i);
+  }
+  *lo = l;
+  *hi = h;
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("pclmul,sse2")))
+static void pclmul_clmul(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi)
+{
+  __m128i p = _mm_clmulepi64_si128(_mm_set_epi64x(0, a), _mm_set_epi64x(0, b), 0);
+  *lo = _mm_cvtsi128_si64(p);
+  *hi = _mm_cvtsi128_si64(_mm_unpackhi_epi64(p, p));
+}
+
+__attribute__((target("ssse3")))
+static uint64_t pshufb_xperm8(uint64_t rs1, uint64_t rs2, unsigned xlen)
+{
+  if (xlen == 32) {
+    rs1 = uint32_t(rs1);
+    rs2 = uint32_t(rs2);
+  }
+  // indices of 16 and up get the top bit, so select zero; those from
+  // xlen / 8 to 15 select the zero upper bytes of the table
+  __m128i idx = _mm_adds_epu8(_mm_set_epi64x(0, rs2), _mm_set1_epi8(0x70));
+  uint64_t r = _mm_cvtsi128_si64(_mm_shuffle_epi8(_mm_set_epi64x(0, rs1), idx));
+  return xlen == 32 ? uint32_t(r) : r;
+}
+
+static const bool have_pclmul = host_cpu().pclmul;
+static const bool have_ssse3 = host_cpu().ssse3;
+
+void host_clmul(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi)
+{
+  if (have_pclmul)
+    pclmul_clmul(a, b, lo, hi);
+  else
+    portable_clmul(a, b, lo, hi);
+}
+
+uint64_t host_xperm8(uint64_t rs1, uint64_t rs2, unsigned xlen)
+{
+  if (have_ssse3)
+    return pshufb_xperm8(rs1, rs2, xlen);
+  return xperm(rs1, rs2, 3, xlen);
+}
+
+#else
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_AES)
+#include <arm_neon.h>
+
+void host_clmul(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi)
+{
+  poly128_t p = vmull_p64(a, b);
+  uint64x2_t v = vreinterpretq_u64_p128(p);
+  *lo = vgetq_lane_u64(v, 0);
+  *hi = vgetq_lane_u64(v, 1);
+}
+
+#else
+
+void host_clmul(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi)
+{
+  portable_clmul(a, b, lo, hi);
+}
+
+#endif
+
+uint64_t host_xperm8(uint64_t rs1, uint64_t rs2, unsigned xlen)
+{
+  return xperm(rs1, rs2, 3, xlen);
+}
+
+#endif
+
+void host_gf128_mul(const uint64_t a[2], const uint64_t b[2], uint64_t r[2])
+{
+  uint64_t lo[3], hi[3];
+  host_clmul(a[0], b[0], &lo[0], &hi[0]);
+  host_clmul(a[1], b[1], &lo[1], &hi[1]);
+  host_clmul(a[0], b[1], &lo[2], &hi[2]);
+  uint64_t mid_lo, mid_hi;
+  host_clmul(a[1], b[0], &mid_lo, &mid_hi);
+  mid_lo ^= lo[2];
+  mid_hi ^= hi[2];
+
+  // the 256-bit product p
+  uint64_t p0 = lo[0];
+  uint64_t p1 = hi[0] ^ mid_lo;
+  uint64_t p2 = lo[1] ^ mid_hi;
+  uint64_t p3 = hi[1];
+
+  // x^128 = x^7 + x^2 + x + 1, so p3:p2 times that is added to p1:p0; the
+  // few bits it carries past x^128 are folded the same way once more
+  uint64_t over = (p3 >> 63) ^ (p3 >> 62) ^ (p3 >> 57);
+  over ^= over << 1 ^ over << 2 ^ over << 7;
+  r[0] = p0 ^ p2 ^ p2 << 1 ^ p2 << 2 ^ p2 << 7 ^ over;
+  r[1] = p1 ^ p3 ^ (p3 << 1 | p2 >> 63) ^ (p3 << 2 | p2 >> 62) ^ (p3 << 7 | p2 >> 57);
+}
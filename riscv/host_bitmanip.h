@@ -0,0 +1,25 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_HOST_BITMANIP_H
+#define _RISCV_HOST_BITMANIP_H
+
+#include <cstdint>
+
+// The 128-bit carry-less product of a and b, for clmul, clmulh, clmulr
+// and the Zvbc instructions: with PCLMULQDQ when CPUID reports it, with
+// PMULL when built for the ARMv8 cryptography extension, and in portable
+// code otherwise.
+void host_clmul(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi);
+
+// The product of a and b in GF(2^128) modulo x^128 + x^7 + x^2 + x + 1,
+// for vghsh and vgmul: each is two words, the low one first, with bit i
+// the coefficient of x^i (the element groups after brev8). Built from four
+// host_clmul products and a shift-and-xor reduction.
+void host_gf128_mul(const uint64_t a[2], const uint64_t b[2], uint64_t r[2]);
+
+// xperm8 on the xlen (32 or 64) bits of rs1 and rs2: byte i of the result
+// is byte rs2[i] of rs1, or zero if that is past xlen. A byte shuffle
+// (PSHUFB) where CPUID reports SSSE3, a loop otherwise.
+uint64_t host_xperm8(uint64_t rs1, uint64_t rs2, unsigned xlen);
+
+#endif
@@ -0,0 +1,62 @@
+// See LICENSE for license details.
+
+#include "host_cpu.h"
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+static host_cpu_t detect()
+{
+  host_cpu_t cpu;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  cpu.sse2 = __builtin_cpu_supports("sse2");
+  cpu.ssse3 = __builtin_cpu_supports("ssse3");
+  cpu.avx2 = __builtin_cpu_supports("avx2");
+  cpu.avx512bw = __builtin_cpu_supports("avx512bw");
+  cpu.fma = __builtin_cpu_supports("fma");
+  cpu.aes = __builtin_cpu_supports("aes");
+  cpu.pclmul = __builtin_cpu_supports("pclmul");
+#elif defined(__aarch64__) && defined(__linux__)
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  cpu.neon = hwcap & HWCAP_ASIMD;
+  cpu.fma = hwcap & HWCAP_FP;
+  cpu.neon_aes = hwcap & HWCAP_AES;
+#elif defined(__aarch64__)
+  cpu.neon = true;
+  cpu.fma = true;
+#endif
+  return cpu;
+}
+
+const host_cpu_t& host_cpu()
+{
+  static const host_cpu_t cpu = detect();
+  return cpu;
+}
+
+const char* host_simd_name()
+{
+#if HOST_SIMD_CLONES
+  // the checks the HOST_SIMD_TARGETS resolver makes
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("x86-64-v4"))
+    return "avx512";
+  if (__builtin_cpu_supports("x86-64-v3"))
+    return "avx2";
+  return "sse2";
+#elif defined(__AVX512BW__)
+  return "avx512";
+#elif defined(__AVX2__)
+  return "avx2";
+#else
+  const host_cpu_t& cpu = host_cpu();
+  if (cpu.sse2)
+    return "sse2";
+  if (cpu.neon)
+    return "neon";
+  return "scalar";
+#endif
+}
@@ -0,0 +1,47 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_HOST_CPU_H
+#define _RISCV_HOST_CPU_H
+
+// Features of the machine spike is running on, found once at startup
+// (CPUID on x86, getauxval(AT_HWCAP) on Linux/AArch64), so that one build
+// can pick its host fast paths on whichever machine it lands.
+struct host_cpu_t {
+  bool sse2 = false;
+  bool ssse3 = false;
+  bool avx2 = false;
+  bool avx512bw = false;
+  bool fma = false;
+  bool aes = false;
+  bool pclmul = false;
+  bool neon = false;
+  bool neon_aes = false;
+};
+
+const host_cpu_t& host_cpu();
+
+// The SIMD level the vector fast paths run at on this host: "avx512",
+// "avx2", "sse2", "neon" or "scalar".
+const char* host_simd_name();
+
+// Functions marked HOST_SIMD_TARGETS are compiled once per x86 SIMD level
+// and the dynamic loader binds the best one for the host (an ifunc), so
+// plain GCC/Clang vector-extension code in them uses AVX-512 or AVX2 where
+// it can without the whole build needing -mavx2. Not done when the build
+// already targets AVX-512, if SPIKE_NO_MULTIVERSION is defined, or with
+// compilers that do not know the x86-64-v3/v4 levels.
+#if defined(__x86_64__) && defined(__linux__) && !defined(__AVX512BW__) && \
+    !defined(SPIKE_NO_MULTIVERSION) && \
+    ((defined(__clang__) && __clang_major__ >= 16) || \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 12))
+# define HOST_SIMD_CLONES 1
+#endif
+
+#ifdef HOST_SIMD_CLONES
+# define HOST_SIMD_TARGETS __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+# define HOST_SIMD_CLONES 0
+# define HOST_SIMD_TARGETS
+#endif
+
+#endif
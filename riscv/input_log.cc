@@ -0,0 +1,179 @@
+// See LICENSE for license details.
+
+#include "input_log.h"
+#include "simif.h"
+#include "term.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+static const char* kind_name(uint8_t kind)
+{
+  static const char* names[] = { "mtime", "terminal idle", "terminal byte", "seed", "mmio load" };
+  return kind < sizeof(names) / sizeof(names[0]) ? names[kind] : "unknown";
+}
+
+input_log_t::input_log_t(simif_t* sim, const char* path, bool replay)
+  : sim(sim), path(path), replay(replay), file(fopen(path, replay ? "rb" : "wb")),
+    events(0), last_mtime(0), idle_reads(0)
+{
+  if (!file) {
+    std::ostringstream oss;
+    oss << "Failed to open input log `" << path << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+
+  char magic[8];
+  if (!replay) {
+    fwrite("SPKINP01", 1, 8, file);
+  } else if (fread(magic, 1, 8, file) != 8 || memcmp(magic, "SPKINP01", 8) != 0) {
+    fclose(file);
+    throw std::runtime_error(std::string("`") + path + "' is not an input log");
+  }
+
+  sim->input_log = this;
+  canonical_terminal_t::set_input_hook([this] {
+    return terminal(canonical_terminal_t::read_stdin);
+  });
+}
+
+input_log_t::~input_log_t()
+{
+  canonical_terminal_t::set_input_hook(nullptr);
+  sim->input_log = nullptr;
+  if (!replay)
+    flush_idle();
+  fclose(file);
+}
+
+void input_log_t::put(kind_t kind)
+{
+  if (kind != TERM_IDLE)
+    flush_idle();
+  fputc(kind, file);
+  events++;
+}
+
+void input_log_t::put_uvarint(uint64_t v)
+{
+  while (v >= 0x80) {
+    fputc(uint8_t(v) | 0x80, file);
+    v >>= 7;
+  }
+  fputc(uint8_t(v), file);
+}
+
+void input_log_t::flush_idle()
+{
+  if (idle_reads == 0)
+    return;
+  uint64_t n = idle_reads;
+  idle_reads = 0;
+  put(TERM_IDLE);
+  put_uvarint(n);
+}
+
+void input_log_t::expect(kind_t kind)
+{
+  if (idle_reads != 0)
+    diverged(kind_name(kind));
+  int c = fgetc(file);
+  if (c == EOF)
+    diverged("end of log");
+  if (c != kind)
+    diverged(kind_name(c));
+  events++;
+}
+
+uint64_t input_log_t::get_uvarint()
+{
+  uint64_t v = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(file);
+    if (c == EOF)
+      diverged("end of log");
+    v |= uint64_t(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return v;
+  }
+  diverged("bad record");
+}
+
+void input_log_t::diverged(const char* why)
+{
+  fprintf(stderr, "spike: replay of `%s' diverged at record %" PRIu64 ": %s\n",
+          path.c_str(), events, why);
+  abort();
+}
+
+uint64_t input_log_t::mtime(const std::function<uint64_t()>& read)
+{
+  if (!replay) {
+    uint64_t t = read();
+    put(MTIME);
+    put_uvarint(t - last_mtime);
+    last_mtime = t;
+    return t;
+  }
+  expect(MTIME);
+  last_mtime += get_uvarint();
+  return last_mtime;
+}
+
+int input_log_t::terminal(const std::function<int()>& read)
+{
+  if (!replay) {
+    int c = read();
+    if (c < 0) {
+      idle_reads++;
+    } else {
+      put(TERM_BYTE);
+      put_uvarint(uint8_t(c));
+    }
+    return c;
+  }
+  if (idle_reads != 0) {
+    idle_reads--;
+    return -1;
+  }
+  int c = fgetc(file);
+  if (c == TERM_IDLE) {
+    events++;
+    idle_reads = get_uvarint() - 1;
+    return -1;
+  }
+  if (c != TERM_BYTE)
+    diverged(c == EOF ? "end of log" : kind_name(c));
+  events++;
+  return uint8_t(get_uvarint());
+}
+
+reg_t input_log_t::seed(const std::function<reg_t()>& read)
+{
+  if (!replay) {
+    reg_t v = read();
+    put(SEED);
+    put_uvarint(v);
+    return v;
+  }
+  expect(SEED);
+  return get_uvarint();
+}
+
+uint64_t input_log_t::mmio_load(reg_t offset, const std::function<uint64_t()>& read)
+{
+  if (!replay) {
+    uint64_t v = read();
+    put(MMIO_LOAD);
+    put_uvarint(offset);
+    put_uvarint(v);
+    return v;
+  }
+  expect(MMIO_LOAD);
+  if (get_uvarint() != offset)
+    diverged("mmio load from another address");
+  return get_uvarint();
+}
@@ -0,0 +1,66 @@
+// See LICENSE for license details.
+#ifndef _RISCV_INPUT_LOG_H
+#define _RISCV_INPUT_LOG_H
+
+#include "decode.h"
+#include <cstdio>
+#include <functional>
+#include <string>
+
+class simif_t;
+
+// Record and replay of the inputs that make a run differ from the last:
+// --real-time-clint mtime samples, terminal input (the UART and the HTIF
+// console), seed CSR values and loads from the DUT window of
+// spike_map_dut_mmio. As the simulation is otherwise deterministic, each
+// source asks for its inputs in the same order on a rerun, so replaying
+// them in log order reproduces the run exactly.
+//
+// The file is the 8 bytes "SPKINP01", then one record per input, a u8
+// kind then uvarints:
+//   MTIME      mtime minus that of the previous MTIME record
+//   TERM_IDLE  the number of terminal reads in a row that found nothing
+//   TERM_BYTE  the byte read
+//   SEED       the seed CSR value
+//   MMIO_LOAD  offset in the DUT window, value
+// A replay that asks for an input of another kind than the next record, or
+// past the end, has diverged from the recording and aborts.
+class input_log_t {
+ public:
+  enum kind_t : uint8_t { MTIME, TERM_IDLE, TERM_BYTE, SEED, MMIO_LOAD };
+
+  // Records to path, or replays from it. Registers as sim->input_log and
+  // takes over canonical_terminal_t input until destroyed. Throws
+  // std::runtime_error if path cannot be opened or is not an input log.
+  input_log_t(simif_t* sim, const char* path, bool replay);
+  ~input_log_t();
+
+  bool replaying() const { return replay; }
+
+  // What the source should use as its next input: while recording, what
+  // read returns, which is logged; while replaying, the logged value,
+  // without calling read.
+  uint64_t mtime(const std::function<uint64_t()>& read);
+  int terminal(const std::function<int()>& read);
+  reg_t seed(const std::function<reg_t()>& read);
+  uint64_t mmio_load(reg_t offset, const std::function<uint64_t()>& read);
+
+ private:
+  void put(kind_t kind);
+  void put_uvarint(uint64_t v);
+  void flush_idle();
+  // the next record, which must be of kind
+  void expect(kind_t kind);
+  uint64_t get_uvarint();
+  [[noreturn]] void diverged(const char* why);
+
+  simif_t* sim;
+  std::string path;
+  bool replay;
+  FILE* file;
+  uint64_t events;      // records written or read
+  uint64_t last_mtime;
+  uint64_t idle_reads;  // recording: not yet written; replay: still to return
+};
+
+#endif
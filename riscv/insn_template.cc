@@ -3,16 +3,22 @@
 #include "insn_template.h"
 #include "insn_macros.h"
 
+#ifdef INSN_HOST_SIMD
+# define INSN_TARGETS HOST_SIMD_TARGETS
+#else
+# define INSN_TARGETS
+#endif
+
 #define DECODE_MACRO_USAGE_LOGGED 0
 
 #define PROLOGUE \
   reg_t npc = sext_xlen(pc + insn_length(OPCODE))
 
 #define EPILOGUE \
-  trace_opcode(p, OPCODE, insn); \
+  trace_opcode(p, OPCODE, insn, pc, npc); \
   return npc
 
-reg_t fast_rv32i_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t fast_rv32i_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 32
   PROLOGUE;
@@ -21,7 +27,7 @@ reg_t fast_rv32i_NAME(processor_t* p, insn_t insn, reg_t pc)
   #undef xlen
 }
 
-reg_t fast_rv64i_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t fast_rv64i_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 64
   PROLOGUE;
@@ -30,10 +36,25 @@ reg_t fast_rv64i_NAME(processor_t* p, insn_t insn, reg_t pc)
   #undef xlen
 }
 
+#undef DECODE_MACRO_MACHINE_ONLY
+#define DECODE_MACRO_MACHINE_ONLY 1
+
+INSN_TARGETS reg_t machine_rv64i_NAME(processor_t* p, insn_t insn, reg_t pc)
+{
+  #define xlen 64
+  PROLOGUE;
+  #include "insns/NAME.h"
+  EPILOGUE;
+  #undef xlen
+}
+
+#undef DECODE_MACRO_MACHINE_ONLY
+#define DECODE_MACRO_MACHINE_ONLY 0
+
 #undef DECODE_MACRO_USAGE_LOGGED
 #define DECODE_MACRO_USAGE_LOGGED 1
 
-reg_t logged_rv32i_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t logged_rv32i_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 32
   PROLOGUE;
@@ -42,7 +63,7 @@ reg_t logged_rv32i_NAME(processor_t* p, insn_t insn, reg_t pc)
   #undef xlen
 }
 
-reg_t logged_rv64i_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t logged_rv64i_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 64
   PROLOGUE;
@@ -57,7 +78,7 @@ reg_t logged_rv64i_NAME(processor_t* p, insn_t insn, reg_t pc)
 #undef DECODE_MACRO_USAGE_LOGGED
 #define DECODE_MACRO_USAGE_LOGGED 0
 
-reg_t fast_rv32e_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t fast_rv32e_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 32
   PROLOGUE;
@@ -66,7 +87,7 @@ reg_t fast_rv32e_NAME(processor_t* p, insn_t insn, reg_t pc)
   #undef xlen
 }
 
-reg_t fast_rv64e_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t fast_rv64e_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 64
   PROLOGUE;
@@ -78,7 +99,7 @@ reg_t fast_rv64e_NAME(processor_t* p, insn_t insn, reg_t pc)
 #undef DECODE_MACRO_USAGE_LOGGED
 #define DECODE_MACRO_USAGE_LOGGED 1
 
-reg_t logged_rv32e_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t logged_rv32e_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 32
   PROLOGUE;
@@ -87,7 +108,7 @@ reg_t logged_rv32e_NAME(processor_t* p, insn_t insn, reg_t pc)
   #undef xlen
 }
 
-reg_t logged_rv64e_NAME(processor_t* p, insn_t insn, reg_t pc)
+INSN_TARGETS reg_t logged_rv64e_NAME(processor_t* p, insn_t insn, reg_t pc)
 {
   #define xlen 64
   PROLOGUE;
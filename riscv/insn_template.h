@@ -9,4 +9,7 @@
 #include "tracer.h"
 #include "v_ext_macros.h"
 #include "debug_defines.h"
+#include "host_aes.h"
+#include "host_bitmanip.h"
+#include "host_cpu.h"
 #include <assert.h>
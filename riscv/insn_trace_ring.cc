@@ -0,0 +1,50 @@
+// See LICENSE for license details.
+
+#include "insn_trace_ring.h"
+#include "processor.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static_assert(sizeof(insn_trace_ring_t::header_t) == 192, "ring header layout");
+
+insn_trace_ring_t::insn_trace_ring_t(processor_t* proc, const char* path, uint64_t capacity)
+  : proc(proc), mask(capacity - 1), head(0), tail(0)
+{
+  if (capacity == 0 || (capacity & mask) != 0)
+    throw std::runtime_error("instruction trace ring capacity must be a power of 2");
+
+  map_size = sizeof(header_t) + capacity * sizeof(record_t);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  void* p = MAP_FAILED;
+  if (fd >= 0 && ftruncate(fd, map_size) == 0)
+    p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int err = errno;
+  if (fd >= 0)
+    close(fd);
+  if (p == MAP_FAILED) {
+    std::ostringstream oss;
+    oss << "Failed to map instruction trace ring `" << path << "': " << strerror(err);
+    throw std::runtime_error(oss.str());
+  }
+
+  header = (header_t*)p;
+  records = (record_t*)(header + 1);
+  header->capacity = capacity;
+  header->head.store(0, std::memory_order_relaxed);
+  header->tail.store(0, std::memory_order_relaxed);
+  // the magic last, so a reader polling for it sees the rest initialised
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(header->magic, "SPKRING1", 8);
+  proc->set_insn_trace_ring(this);
+}
+
+insn_trace_ring_t::~insn_trace_ring_t()
+{
+  proc->set_insn_trace_ring(nullptr);
+  munmap(header, map_size);
+}
@@ -0,0 +1,70 @@
+// See LICENSE for license details.
+#ifndef _RISCV_INSN_TRACE_RING_H
+#define _RISCV_INSN_TRACE_RING_H
+
+#include "common.h"
+#include "decode.h"
+#include <atomic>
+#include <sched.h>
+
+class processor_t;
+
+// One hart's retired instructions, as a single-producer single-consumer
+// ring in a shared file that another process maps and drains while spike
+// runs. It is fed from the instruction handlers' epilogue, which only calls
+// it in a build configured with --enable-insn-trace-ring (see tracer.h).
+//
+// The file holds the header, then capacity records:
+//   0    char magic[8]      "SPKRING1"
+//   8    uint64_t capacity  records, a power of 2
+//   64   uint64_t head      records written; spike store-releases it
+//   128  uint64_t tail      records consumed; the reader store-releases it
+//   192  record[capacity]   record n at index n % capacity
+// A record is {pc, next pc, instruction bits}, three host-endian uint64_t.
+// When the ring is full, the hart waits for the reader.
+class insn_trace_ring_t {
+ public:
+  struct record_t {
+    uint64_t pc;
+    uint64_t npc;
+    uint64_t insn;
+  };
+  struct header_t {
+    char magic[8];
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+  };
+
+  // Throws std::runtime_error if path cannot be created or mapped, or
+  // capacity is not a power of 2.
+  insn_trace_ring_t(processor_t* proc, const char* path, uint64_t capacity);
+  ~insn_trace_ring_t();
+
+  void push(reg_t pc, insn_t insn, reg_t npc) {
+    if (unlikely(head - tail == mask + 1))
+      wait();
+    record_t& r = records[head & mask];
+    r.pc = pc;
+    r.npc = npc;
+    r.insn = insn.bits();
+    header->head.store(++head, std::memory_order_release);
+  }
+
+ private:
+  void wait() {
+    while ((tail = header->tail.load(std::memory_order_acquire)) + mask + 1 == head)
+      sched_yield();
+  }
+
+  processor_t* proc;
+  header_t* header;
+  record_t* records;
+  size_t map_size;
+  uint64_t mask;
+  // local copies of the shared counters
+  uint64_t head;
+  uint64_t tail;
+};
+
+#endif
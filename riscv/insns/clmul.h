@@ -1,6 +1,4 @@
 require_either_extension(EXT_ZBC, EXT_ZBKC);
-reg_t a = zext_xlen(RS1), b = zext_xlen(RS2), x = 0;
-for (int i = 0; i < xlen; i++)
-  if ((b >> i) & 1)
-    x ^= a << i;
-WRITE_RD(sext_xlen(x));
+reg_t lo, hi;
+host_clmul(zext_xlen(RS1), zext_xlen(RS2), &lo, &hi);
+WRITE_RD(sext_xlen(lo));
@@ -1 +1 @@
-MMU.flush_icache();
+MMU.fence_i();
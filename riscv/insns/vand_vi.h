@@ -1,5 +1,5 @@
 // vand.vi vd, simm5, vs2, vm
-VI_VI_LOOP
+VI_VI_LOOP_SIMD
 ({
   vd = simm5 & vs2;
 })
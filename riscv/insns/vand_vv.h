@@ -1,5 +1,5 @@
 // vand.vv vd, vs1, vs2, vm
-VI_VV_LOOP
+VI_VV_LOOP_SIMD
 ({
   vd = vs1 & vs2;
 })
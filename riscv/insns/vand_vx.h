@@ -1,5 +1,5 @@
 // vand.vx vd, rs1, vs2, vm
-VI_VX_LOOP
+VI_VX_LOOP_SIMD
 ({
   vd = rs1 & vs2;
 })
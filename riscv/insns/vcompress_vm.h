@@ -8,6 +8,37 @@ require_noover(insn.rd(), P.VU.vflmul, insn.rs1(), 1);
 
 reg_t pos = 0;
 
+if (VI_MASK_FAST_PATH) {
+  require(P.VU.vsew >= e8 && P.VU.vsew <= e64);
+  require_vector(true);
+  reg_t vl = P.VU.vl->read();
+  reg_t sew = P.VU.vsew;
+  // vs2 element by set bit of vs1, a word of them at a time
+  auto compress = [&](auto *vd_p, const auto *vs2_p) {
+    for (reg_t n = 0; n * 64 < vl; ++n) {
+      for (uint64_t vs1 = P.VU.mask_word(insn.rs1(), n, vl); vs1; vs1 &= vs1 - 1)
+        vd_p[pos++] = vs2_p[n * 64 + __builtin_ctzll(vs1)];
+    }
+  };
+  // only the registers taking elements are written, as below
+  reg_t count = 0;
+  for (reg_t n = 0; n * 64 < vl; ++n)
+    count += __builtin_popcountll(P.VU.mask_word(insn.rs1(), n, vl));
+  switch (sew) {
+  case e8:
+    compress(P.VU.elt_span<uint8_t>(insn.rd(), count, true), P.VU.elt_span<uint8_t>(insn.rs2(), vl));
+    break;
+  case e16:
+    compress(P.VU.elt_span<uint16_t>(insn.rd(), count, true), P.VU.elt_span<uint16_t>(insn.rs2(), vl));
+    break;
+  case e32:
+    compress(P.VU.elt_span<uint32_t>(insn.rd(), count, true), P.VU.elt_span<uint32_t>(insn.rs2(), vl));
+    break;
+  default:
+    compress(P.VU.elt_span<uint64_t>(insn.rd(), count, true), P.VU.elt_span<uint64_t>(insn.rs2(), vl));
+    break;
+  }
+} else {
 VI_GENERAL_LOOP_BASE
   if (P.VU.mask_elt(rs1_num, i)) {
     switch (sew) {
@@ -28,3 +59,4 @@ VI_GENERAL_LOOP_BASE
     ++pos;
   }
 VI_LOOP_END_BASE;
+}
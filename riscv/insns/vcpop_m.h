@@ -5,8 +5,17 @@ reg_t vl = P.VU.vl->read();
 reg_t rs2_num = insn.rs2();
 require(P.VU.vstart->read() == 0);
 reg_t popcount = 0;
-for (reg_t i=P.VU.vstart->read(); i<vl; ++i) {
-  bool vs2_bit = P.VU.mask_elt(rs2_num, i);
-  popcount += vs2_bit && (insn.v_vm() || P.VU.mask_elt(0, i));
+if (VI_MASK_FAST_PATH) {
+  for (reg_t n = 0; n * 64 < vl; ++n) {
+    uint64_t vs2 = P.VU.mask_word(rs2_num, n, vl);
+    if (!insn.v_vm())
+      vs2 &= P.VU.mask_word(0, n, vl);
+    popcount += __builtin_popcountll(vs2);
+  }
+} else {
+  for (reg_t i=P.VU.vstart->read(); i<vl; ++i) {
+    bool vs2_bit = P.VU.mask_elt(rs2_num, i);
+    popcount += vs2_bit && (insn.v_vm() || P.VU.mask_elt(0, i));
+  }
 }
 WRITE_RD(popcount);
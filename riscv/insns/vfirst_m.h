@@ -5,12 +5,24 @@ reg_t vl = P.VU.vl->read();
 reg_t rs2_num = insn.rs2();
 require(P.VU.vstart->read() == 0);
 reg_t pos = -1;
-for (reg_t i=P.VU.vstart->read(); i < vl; ++i) {
-  VI_LOOP_ELEMENT_SKIP()
+if (VI_MASK_FAST_PATH) {
+  for (reg_t n = 0; n * 64 < vl; ++n) {
+    uint64_t vs2 = P.VU.mask_word(rs2_num, n, vl);
+    if (!insn.v_vm())
+      vs2 &= P.VU.mask_word(0, n, vl);
+    if (vs2) {
+      pos = n * 64 + __builtin_ctzll(vs2);
+      break;
+    }
+  }
+} else {
+  for (reg_t i=P.VU.vstart->read(); i < vl; ++i) {
+    VI_LOOP_ELEMENT_SKIP()
 
-  if (P.VU.mask_elt(rs2_num, i)) {
-    pos = i;
-    break;
+    if (P.VU.mask_elt(rs2_num, i)) {
+      pos = i;
+      break;
+    }
   }
 }
 WRITE_RD(pos);
@@ -5,7 +5,7 @@ switch (P.VU.vsew) {
   case 16: {
     if (P.VU.altfmt) {
       require_extension(EXT_ZVFWBDOT16BF);
-      ZVBDOT_LOOP(uint16_t, uint16_t, float32_t, zvfwbdot16bf_dot_acc);
+      ZVBDOT_ODD_LOOP(uint16_t, uint16_t, zvfwbdot16bf_dot_acc);
     } else {
       require(false);
     }
@@ -10,38 +10,66 @@ require_vm;
 require_align(rd_num, P.VU.vflmul);
 require_noover(rd_num, P.VU.vflmul, rs2_num, 1);
 
-int cnt = 0;
-for (reg_t i = 0; i < vl; ++i) {
-  bool do_mask = P.VU.mask_elt(0, i);
-
-  bool has_one = false;
-  if (insn.v_vm() == 1 || (insn.v_vm() == 0 && do_mask)) {
-    if (P.VU.mask_elt(rs2_num, i)) {
-      has_one = true;
+if (VI_MASK_FAST_PATH && insn.v_vm() == 1) {
+  // the count of set elements before each, a word of them at a time
+  auto iota = [&](auto *vd_p) {
+    reg_t cnt = 0;
+    for (reg_t n = 0; n * 64 < vl; ++n) {
+      uint64_t vs2 = P.VU.mask_word(rs2_num, n, vl);
+      for (reg_t i = n * 64; i < std::min(vl, n * 64 + 64); ++i) {
+        vd_p[i] = cnt;
+        cnt += vs2 & 1;
+        vs2 >>= 1;
+      }
     }
-  }
-
-  // Bypass masked-off elements
-  if ((insn.v_vm() == 0) && !do_mask)
-    continue;
-
+  };
   switch (sew) {
   case e8:
-    P.VU.elt<uint8_t>(rd_num, i, true) = cnt;
+    iota(P.VU.elt_span<uint8_t>(rd_num, vl, true));
     break;
   case e16:
-    P.VU.elt<uint16_t>(rd_num, i, true) = cnt;
+    iota(P.VU.elt_span<uint16_t>(rd_num, vl, true));
     break;
   case e32:
-    P.VU.elt<uint32_t>(rd_num, i, true) = cnt;
+    iota(P.VU.elt_span<uint32_t>(rd_num, vl, true));
     break;
   default:
-    P.VU.elt<uint64_t>(rd_num, i, true) = cnt;
+    iota(P.VU.elt_span<uint64_t>(rd_num, vl, true));
     break;
   }
+} else {
+  int cnt = 0;
+  for (reg_t i = 0; i < vl; ++i) {
+    bool do_mask = P.VU.mask_elt(0, i);
+
+    bool has_one = false;
+    if (insn.v_vm() == 1 || (insn.v_vm() == 0 && do_mask)) {
+      if (P.VU.mask_elt(rs2_num, i)) {
+        has_one = true;
+      }
+    }
 
-  if (has_one) {
-    cnt++;
+    // Bypass masked-off elements
+    if ((insn.v_vm() == 0) && !do_mask)
+      continue;
+
+    switch (sew) {
+    case e8:
+      P.VU.elt<uint8_t>(rd_num, i, true) = cnt;
+      break;
+    case e16:
+      P.VU.elt<uint16_t>(rd_num, i, true) = cnt;
+      break;
+    case e32:
+      P.VU.elt<uint32_t>(rd_num, i, true) = cnt;
+      break;
+    default:
+      P.VU.elt<uint64_t>(rd_num, i, true) = cnt;
+      break;
+    }
+
+    if (has_one) {
+      cnt++;
+    }
   }
 }
-
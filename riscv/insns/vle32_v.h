@@ -1,2 +1,2 @@
 // vle32.v and vlseg[2-8]e32.v
-VI_LD(0, (i * nf + fn), int32, false);
+VI_LD_UNIT_STRIDE(int32, false);
@@ -1,2 +1,2 @@
 // vlse16.v and vlsseg[2-8]e16.v
-VI_LD(i * RS2, fn, int16, false);
+VI_LD_STRIDED(int16);
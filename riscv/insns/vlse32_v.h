@@ -1,2 +1,2 @@
 // vlse32.v and vlsseg[2-8]e32.v
-VI_LD(i * RS2, fn, int32, false);
+VI_LD_STRIDED(int32);
@@ -1,2 +1,2 @@
 // vlse64.v and vlsseg[2-8]e64.v
-VI_LD(i * RS2, fn, int64, false);
+VI_LD_STRIDED(int64);
@@ -1,2 +1,2 @@
 // vlse8.v and vlsseg[2-8]e8.v
-VI_LD(i * RS2, fn, int8, false);
+VI_LD_STRIDED(int8);
@@ -9,18 +9,31 @@ reg_t vl = P.VU.vl->read();
 reg_t rd_num = insn.rd();
 reg_t rs2_num = insn.rs2();
 
-bool has_one = false;
-for (reg_t i = P.VU.vstart->read() ; i < vl; ++i) {
-  bool vs2_lsb = P.VU.mask_elt(rs2_num, i);
-  bool do_mask = P.VU.mask_elt(0, i);
+if (VI_MASK_FAST_PATH) {
+  bool found = false;
+  for (reg_t n = 0; n * 64 < vl; ++n) {
+    uint64_t active = insn.v_vm() ? ~uint64_t(0) : P.VU.mask_word(0, n, vl);
+    uint64_t vs2 = P.VU.mask_word(rs2_num, n, vl) & active;
+    uint64_t first = vs2 & -vs2;
+    // the first set element alone
+    uint64_t res = found ? 0 : first;
+    found = found || first;
+    P.VU.set_mask_word(rd_num, n, vl, res, active);
+  }
+} else {
+  bool has_one = false;
+  for (reg_t i = P.VU.vstart->read() ; i < vl; ++i) {
+    bool vs2_lsb = P.VU.mask_elt(rs2_num, i);
+    bool do_mask = P.VU.mask_elt(0, i);
 
-  if (insn.v_vm() == 1 || (insn.v_vm() == 0 && do_mask)) {
-    bool res = false;
-    if (!has_one && vs2_lsb) {
-      has_one = true;
-      res = true;
-    }
+    if (insn.v_vm() == 1 || (insn.v_vm() == 0 && do_mask)) {
+      bool res = false;
+      if (!has_one && vs2_lsb) {
+        has_one = true;
+        res = true;
+      }
 
-    P.VU.set_mask_elt(rd_num, i, res);
+      P.VU.set_mask_elt(rd_num, i, res);
+    }
   }
 }
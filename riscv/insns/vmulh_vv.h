@@ -1,5 +1,5 @@
 // vmulh vd, vs2, vs1
 VI_VV_LOOP
 ({
-  vd = ((int128_t)vs2 * vs1) >> sew;
+  vd = mulh_elt(vs2, vs1);
 })
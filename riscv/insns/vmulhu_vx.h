@@ -1,5 +1,5 @@
 // vmulhu vd ,vs2, rs1
 VI_VX_ULOOP
 ({
-  vd = ((uint128_t)vs2 * rs1) >> sew;
+  vd = mulh_elt(vs2, rs1);
 })
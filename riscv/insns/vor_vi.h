@@ -1,5 +1,5 @@
 // vor
-VI_VI_LOOP
+VI_VI_LOOP_SIMD
 ({
   vd = simm5 | vs2;
 })
@@ -1,5 +1,5 @@
 // vor
-VI_VV_LOOP
+VI_VV_LOOP_SIMD
 ({
   vd = vs1 | vs2;
 })
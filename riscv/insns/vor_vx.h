@@ -1,5 +1,5 @@
 // vor
-VI_VX_LOOP
+VI_VX_LOOP_SIMD
 ({
   vd = rs1 | vs2;
 })
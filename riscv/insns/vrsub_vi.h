@@ -1,5 +1,5 @@
 // vrsub.vi vd, vs2, imm, vm   # vd[i] = imm - vs2[i]
-VI_VI_LOOP
+VI_VI_LOOP_SIMD
 ({
   vd = simm5 - vs2;
 })
@@ -1,5 +1,5 @@
 // vrsub.vx vd, vs2, rs1, vm   # vd[i] = rs1 - vs2[i]
-VI_VX_LOOP
+VI_VX_LOOP_SIMD
 ({
   vd = rs1 - vs2;
 })
@@ -1,2 +1,2 @@
 // vse8.v and vsseg[2-8]e8.v
-VI_ST(0, (i * nf + fn), uint8, false);
+VI_ST_UNIT_STRIDE(uint8, false);
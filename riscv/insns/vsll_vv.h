@@ -1,5 +1,5 @@
 // vsll
-VI_VV_ULOOP
+VI_VV_ULOOP_SIMD
 ({
   vd = vs2 << (vs1 & (sew - 1));
 })
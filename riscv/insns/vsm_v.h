@@ -1,2 +1,2 @@
 // vse1.v
-VI_ST(0, (i * nf + fn), uint8, true);
+VI_ST_UNIT_STRIDE(uint8, true);
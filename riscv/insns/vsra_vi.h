@@ -1,5 +1,5 @@
 // vsra.vi vd, vs2, zimm5
-VI_VI_LOOP
+VI_VI_LOOP_SIMD
 ({
   vd = vs2 >> (insn.v_zimm5() & (sew - 1));
 })
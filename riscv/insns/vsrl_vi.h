@@ -1,5 +1,5 @@
 // vsrl.vi vd, vs2, zimm5
-VI_VI_ULOOP
+VI_VI_ULOOP_SIMD
 ({
   vd = vs2 >> (zimm5 & (sew - 1));
 })
@@ -1,5 +1,5 @@
 // vsrl.vv  vd, vs2, vs1
-VI_VV_ULOOP
+VI_VV_ULOOP_SIMD
 ({
   vd = vs2 >> (vs1 & (sew - 1));
 })
@@ -1,2 +1,2 @@
 // vsse16v and vssseg[2-8]e16.v
-VI_ST(i * RS2, fn, uint16, false);
+VI_ST_STRIDED(uint16);
@@ -1,2 +1,2 @@
 // vsse32.v and vssseg[2-8]e32.v
-VI_ST(i * RS2, fn, uint32, false);
+VI_ST_STRIDED(uint32);
@@ -1,2 +1,2 @@
 // vsse64.v and vssseg[2-8]e64.v
-VI_ST(i * RS2, fn, uint64, false);
+VI_ST_STRIDED(uint64);
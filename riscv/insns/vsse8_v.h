@@ -1,2 +1,2 @@
 // vsse8.v and vssseg[2-8]e8.v
-VI_ST(i * RS2, fn, uint8, false);
+VI_ST_STRIDED(uint8);
@@ -1,5 +1,5 @@
 // vsub
-VI_VV_LOOP
+VI_VV_LOOP_SIMD
 ({
   vd = vs2 - vs1;
 })
@@ -1,5 +1,5 @@
 // vsub: vd[i] = (vd[i] * x[rs1]) - vs2[i]
-VI_VX_LOOP
+VI_VX_LOOP_SIMD
 ({
   vd = vs2 - rs1;
 })
@@ -1,5 +1,5 @@
 // vxor
-VI_VI_LOOP
+VI_VI_LOOP_SIMD
 ({
   vd = simm5 ^ vs2;
 })
@@ -1,5 +1,5 @@
 // vxor
-VI_VV_LOOP
+VI_VV_LOOP_SIMD
 ({
   vd = vs1 ^ vs2;
 })
@@ -1,2 +1,2 @@
 require_extension(EXT_ZBKX);
-WRITE_RD(sext_xlen(xperm(RS1, RS2, 3, xlen)));
+WRITE_RD(sext_xlen(host_xperm8(RS1, RS2, xlen)));
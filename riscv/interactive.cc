@@ -10,6 +10,7 @@
 #include "socketif.h"
 #include <sys/mman.h>
 #include <termios.h>
+#include <functional>
 #include <map>
 #include <iostream>
 #include <iomanip>
@@ -290,6 +291,7 @@ void sim_t::interactive()
   funcs["untiln"] = &sim_t::interactive_until_noisy;
   funcs["while"] = &sim_t::interactive_until_silent;
   funcs["dump"] = &sim_t::interactive_dumpmems;
+  funcs["stats"] = &sim_t::interactive_stats;
   funcs["quit"] = &sim_t::interactive_quit;
   funcs["q"] = funcs["quit"];
   funcs["help"] = &sim_t::interactive_help;
@@ -378,6 +380,9 @@ void sim_t::interactive_help(const std::string& cmd, const std::vector<std::stri
     "mem [core] <hex addr>           # Show contents of virtual memory <hex addr> in [core] (physical memory <hex addr> if omitted)\n"
     "str [core] <hex addr>           # Show NUL-terminated C string at virtual address <hex addr> in [core] (physical address <hex addr> if omitted)\n"
     "dump                            # Dump physical memory to binary files\n"
+    "dump sparse                     # Dump only nonzero pages, with their page indices\n"
+    "stats [core]                    # Show hot-path counters of [core] (all if omitted)\n"
+    "stats clear                     # Reset the hot-path counters\n"
     "mtime                           # Show mtime\n"
     "mtimecmp <core>                 # Show mtimecmp for <core>\n"
     "until reg <core> <reg> <val>    # Stop when <reg> in <core> hits <val>\n"
@@ -417,7 +422,7 @@ void sim_t::interactive_run(const std::string& cmd, const std::vector<std::strin
   size_t steps = args.size() ? atoll(args[0].c_str()) : -1;
   set_procs_debug(noisy);
 
-  const size_t actual_steps = std::min(INTERLEAVE, steps);
+  const size_t actual_steps = std::min(interleave, steps);
   for (size_t i = 0; i < actual_steps && !ctrlc_pressed && !done(); i++)
     step(1);
 
@@ -480,7 +485,7 @@ void sim_t::interactive_insn(const std::string& cmd, const std::vector<std::stri
   std::ostream out(sout_.rdbuf());
   insn_t insn(get_insn(args)); // ensure this is outside of ostream to not pollute output on non-interactive trap
   out << std::hex << std::setfill('0') << "0x" << std::setw(max_xlen/4)
-      << zext(insn.bits(), max_xlen) << " " << p->get_disassembler()->disassemble(insn) << std::endl;
+      << zext(insn.bits(), max_xlen) << " " << p->disassemble(insn) << std::endl;
 }
 
 void sim_t::interactive_priv(const std::string& cmd, const std::vector<std::string>& args)
@@ -493,6 +498,26 @@ void sim_t::interactive_priv(const std::string& cmd, const std::vector<std::stri
   out << p->get_privilege_string() << std::endl;
 }
 
+void sim_t::interactive_stats(const std::string& cmd, const std::vector<std::string>& args)
+{
+  if (args.size() > 1)
+    throw trap_interactive();
+
+  if (args.size() == 1 && args[0] == "clear") {
+    clear_hart_stats();
+    return;
+  }
+
+  std::ostream out(sout_.rdbuf());
+  if (args.empty()) {
+    for (size_t i = 0; i < procs.size(); i++)
+      print_hart_stats(out, i);
+  } else {
+    get_core(args[0]);  // validates the index
+    print_hart_stats(out, strtoul(args[0].c_str(), nullptr, 10));
+  }
+}
+
 reg_t sim_t::get_reg(const std::vector<std::string>& args)
 {
   if (args.size() != 2)
@@ -791,11 +816,47 @@ void sim_t::interactive_until(const std::string& cmd, const std::vector<std::str
   if (func == NULL)
     throw trap_interactive();
 
-  for (size_t i = 0; i < INTERLEAVE; i++)
+  // With "until pc", the target core stops itself when it reaches the pc,
+  // so whole quanta run at full speed; the stop pc stays armed across the
+  // chunks this command is resumed in.
+  if (cmd_until && args[0] == "pc" && args.size() == 3) {
+    processor_t *p = get_core(args[1]);
+    reg_t current = p->get_state()->pc;
+    if (max_xlen == 32) current &= 0xFFFFFFFF;
+    const reg_t stop = max_xlen == 32 ? sext32(val) : val;
+    if (current == val || ctrlc_pressed) {
+      if (p->get_stop_pc() == stop)
+        p->set_stop_pc(reg_t(-1));
+      return;
+    }
+    if (p->get_stop_pc() != stop)
+      p->set_stop_pc(stop);
+
+    set_procs_debug(noisy);
+    step(interleave);
+
+    next_interactive_action = [=, this](){ interactive_until(cmd, args, noisy); };
+    return;
+  }
+
+  // Otherwise the condition is checked after every instruction; read the
+  // common operands directly rather than re-parsing them each time.
+  std::function<reg_t()> read = [this, func, args2]() { return (this->*func)(args2); };
+  if (args[0] == "pc" && args.size() == 3) {
+    processor_t *p = get_core(args[1]);
+    read = [p]() { return p->get_state()->pc; };
+  } else if (args[0] == "reg" && args.size() == 4) {
+    processor_t *p = get_core(args[1]);
+    size_t r = std::find(xpr_name, xpr_name + NXPR, args[2]) - xpr_name;
+    if (r < NXPR)
+      read = [p, r]() { return p->get_state()->XPR[r]; };
+  }
+
+  for (size_t i = 0; i < interleave; i++)
   {
     try
     {
-      reg_t current = (this->*func)(args2);
+      reg_t current = read();
 
       // mask bits above max_xlen
       if (max_xlen == 32) current &= 0xFFFFFFFF;
@@ -816,12 +877,19 @@ void sim_t::interactive_until(const std::string& cmd, const std::vector<std::str
 
 void sim_t::interactive_dumpmems(const std::string& cmd, const std::vector<std::string>& args)
 {
+  if (args.size() > 1 || (args.size() == 1 && args[0] != "sparse"))
+    throw trap_interactive();
+  bool sparse = args.size() == 1;
+
   for (unsigned i = 0; i < mems.size(); i++) {
     std::stringstream mem_fname;
-    mem_fname << "mem.0x" << std::hex << mems[i].first << ".bin";
+    mem_fname << "mem.0x" << std::hex << mems[i].first << (sparse ? ".sparse" : ".bin");
 
     std::ofstream mem_file(mem_fname.str());
-    mems[i].second->dump(mem_file);
+    if (sparse)
+      mems[i].second->dump_sparse(mem_file);
+    else
+      mems[i].second->dump(mem_file);
     mem_file.close();
   }
 }
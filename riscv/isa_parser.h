@@ -5,6 +5,7 @@
 #include "decode.h"
 
 #include <bitset>
+#include <memory>
 #include <string>
 #include <set>
 
@@ -124,6 +125,9 @@ class isa_parser_t {
 public:
   isa_parser_t(const char* str, const char *priv);
   ~isa_parser_t() {};
+  // The parse of str and priv, shared by every caller in the process that
+  // asks for the same pair
+  static std::shared_ptr<const isa_parser_t> get(const char* str, const char *priv);
   unsigned get_max_xlen() const { return max_xlen; }
   reg_t get_max_isa() const { return max_isa; }
   std::string get_isa_string() const { return isa_string; }
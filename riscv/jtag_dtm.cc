@@ -49,6 +49,11 @@ jtag_dtm_t::jtag_dtm_t(debug_module_t *dm, unsigned required_rti_cycles) :
 {
 }
 
+bool jtag_dtm_t::dm_needs_harts() const
+{
+  return dm->needs_harts();
+}
+
 void jtag_dtm_t::reset() {
   _state = TEST_LOGIC_RESET;
   busy_stuck = false;
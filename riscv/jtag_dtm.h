@@ -38,6 +38,9 @@ class jtag_dtm_t
 
     jtag_state_t state() const { return _state; }
 
+    // Whether the debug module is waiting for a hart to run.
+    bool dm_needs_harts() const;
+
   private:
     debug_module_t *dm;
     // The number of Run-Test/Idle cycles required before a DMI access is
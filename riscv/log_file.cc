@@ -0,0 +1,93 @@
+// See LICENSE for license details.
+
+#include "log_file.h"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+log_file_t::log_file_t(const char *path, size_t buffer_size, bool writer_thread)
+  : wrapped_file(nullptr, &fclose), stream(nullptr), pending_full(false), stop(false)
+{
+  if (!path)
+    return;
+
+  wrapped_file.reset(fopen(path, "w"));
+  if (! wrapped_file) {
+    std::ostringstream oss;
+    oss << "Failed to open log file at `" << path << "': "
+        << strerror (errno);
+    throw std::runtime_error(oss.str());
+  }
+  stream = wrapped_file.get();
+
+#ifdef __GLIBC__
+  if (writer_thread) {
+    // Logging goes to a cookie stream, whose buffer is copied out whole
+    // when it fills; the file itself is written unbuffered by drain().
+    setvbuf(wrapped_file.get(), nullptr, _IONBF, 0);
+    cookie_io_functions_t io = {nullptr, &cookie_write, nullptr, &cookie_close};
+    stream = fopencookie(this, "w", io);
+    if (!stream)
+      throw std::runtime_error("Failed to create log writer stream");
+    pending.reserve(buffer_size);
+    writer = std::thread(&log_file_t::drain, this);
+  }
+#endif
+
+  if (buffer_size) {
+    buffer.reset(new char[buffer_size]);
+    setvbuf(stream, buffer.get(), _IOFBF, buffer_size);
+    this->buffer_size = buffer_size;
+  }
+}
+
+log_file_t::~log_file_t()
+{
+  if (stream && stream != wrapped_file.get()) {
+    fclose(stream);  // hands off the rest, then waits in cookie_close
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+    }
+    cv.notify_all();
+    writer.join();
+  }
+}
+
+ssize_t log_file_t::cookie_write(void* cookie, const char* buf, size_t size)
+{
+  log_file_t* log = (log_file_t*)cookie;
+  std::unique_lock<std::mutex> guard(log->lock);
+  log->cv.wait(guard, [log]{ return !log->pending_full; });
+  log->pending.assign(buf, buf + size);
+  log->pending_full = true;
+  log->cv.notify_all();
+  return size;
+}
+
+int log_file_t::cookie_close(void* cookie)
+{
+  log_file_t* log = (log_file_t*)cookie;
+  std::unique_lock<std::mutex> guard(log->lock);
+  log->cv.wait(guard, [log]{ return !log->pending_full; });
+  return 0;
+}
+
+void log_file_t::drain()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    cv.wait(guard, [this]{ return pending_full || stop; });
+    if (!pending_full)
+      break;
+
+    guard.unlock();
+    fwrite(pending.data(), 1, pending.size(), wrapped_file.get());
+    guard.lock();
+
+    pending.clear();
+    pending_full = false;
+    cv.notify_all();
+  }
+}
@@ -3,35 +3,49 @@
 #define _RISCV_LOGFILE_H
 
 #include <stdio.h>
+#include <sys/types.h>
+#include <condition_variable>
 #include <memory>
-#include <sstream>
-#include <stdexcept>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-// Header-only class wrapping a log file. When constructed with an
-// actual path, it opens the named file for writing. When constructed
-// with the null path, it wraps stderr.
+// Class wrapping a log file. When constructed with an actual path, it
+// opens the named file for writing through a buffer of buffer_size bytes.
+// With writer_thread (glibc only), full buffers are handed to a thread that
+// writes them while logging goes on; the stream must then not be used across
+// fork(). When constructed with the null path, it wraps stderr.
 class log_file_t
 {
 public:
-  log_file_t(const char *path)
-    : wrapped_file (nullptr, &fclose)
-  {
-    if (!path)
-      return;
-
-    wrapped_file.reset(fopen(path, "w"));
-    if (! wrapped_file) {
-      std::ostringstream oss;
-      oss << "Failed to open log file at `" << path << "': "
-          << strerror (errno);
-      throw std::runtime_error(oss.str());
-    }
-  }
-
-  FILE *get() { return wrapped_file ? wrapped_file.get() : stderr; }
+  static const size_t DEFAULT_BUFFER_SIZE = 4 << 20;
+
+  // Throws std::runtime_error if path cannot be opened.
+  log_file_t(const char *path, size_t buffer_size = DEFAULT_BUFFER_SIZE,
+             bool writer_thread = false);
+  ~log_file_t();
+
+  FILE *get() { return stream ? stream : stderr; }
+  // Host bytes of the stream buffer and the writer thread's hand-off buffer
+  size_t buffer_bytes() const { return buffer_size + pending.capacity(); }
 
 private:
+  static ssize_t cookie_write(void* cookie, const char* buf, size_t size);
+  static int cookie_close(void* cookie);
+  void drain();
+
+  std::unique_ptr<char[]> buffer;  // outlives the stream that uses it
+  size_t buffer_size = 0;
   std::unique_ptr<FILE, int(*)(FILE*)> wrapped_file;
+  FILE* stream;
+
+  // writer thread
+  std::vector<char> pending;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool pending_full;
+  bool stop;
+  std::thread writer;
 };
 
 #endif
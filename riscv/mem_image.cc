@@ -0,0 +1,280 @@
+// See LICENSE for license details.
+
+#include "mem_image.h"
+#include "mmu.h"
+#include "byteorder.h"
+#include "../fesvr/elf.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// The whole file, mapped read-only, and kept open for map_mem
+struct mapped_file_t {
+  explicit mapped_file_t(const std::string& path) : data(nullptr), size(0)
+  {
+    fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      if (fd >= 0)
+        close(fd);
+      throw std::runtime_error("cannot open memory image " + path);
+    }
+    size = st.st_size;
+    if (size) {
+      void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("cannot map memory image " + path);
+      }
+      madvise(p, size, MADV_SEQUENTIAL);
+      data = (const char*)p;
+    }
+  }
+  ~mapped_file_t()
+  {
+    if (data)
+      munmap((void*)data, size);
+    close(fd);
+  }
+
+  const char* data;
+  size_t size;
+  int fd;
+};
+
+void write_mem(const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems, const std::string& path,
+               reg_t addr, size_t len, const uint8_t* bytes)
+{
+  while (len > 0) {
+    abstract_mem_t* mem = nullptr;
+    reg_t mem_base = 0;
+    for (auto& m : mems) {
+      if (addr >= m.first && addr - m.first < m.second->size()) {
+        mem = m.second;
+        mem_base = m.first;
+        break;
+      }
+    }
+    if (!mem) {
+      std::stringstream s;
+      s << "memory image " << path << " does not fit in memory at 0x" << std::hex << addr;
+      throw std::runtime_error(s.str());
+    }
+
+    size_t n = std::min(reg_t(len), mem_base + mem->size() - addr);
+    mem->store(addr - mem_base, n, bytes);
+    addr += n;
+    bytes += n;
+    len -= n;
+  }
+}
+
+// Maps the len bytes of fd at offset to [addr, addr + len) copy-on-write,
+// as sim_t::map_file does; false, mapping nothing, unless the range lies in
+// one memory that can map it and target pages are host pages.
+bool map_mem(const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems,
+             reg_t addr, size_t len, int fd, uint64_t offset)
+{
+  if (sysconf(_SC_PAGESIZE) != PGSIZE || (addr | len | offset) % PGSIZE)
+    return false;
+  for (auto& m : mems)
+    if (addr >= m.first && addr - m.first < m.second->size())
+      return len <= m.first + m.second->size() - addr &&
+             m.second->map_file(addr - m.first, len, fd, offset);
+  return false;
+}
+
+// Whether [addr, addr + len) lies in memory, possibly across regions
+bool fits_mem(const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems, reg_t addr, reg_t len)
+{
+  while (len > 0) {
+    auto m = std::find_if(mems.begin(), mems.end(), [&](const std::pair<reg_t, abstract_mem_t*>& m) {
+      return addr >= m.first && addr - m.first < m.second->size();
+    });
+    if (m == mems.end())
+      return false;
+    reg_t n = std::min(len, m->first + m->second->size() - addr);
+    addr += n;
+    len -= n;
+  }
+  return true;
+}
+
+template<typename ehdr_t, typename phdr_t>
+std::vector<std::pair<reg_t, reg_t>> preload_segments(const char* buf, size_t size, int fd, const std::string& path,
+                                                      const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems)
+{
+  std::vector<std::pair<reg_t, reg_t>> ranges;
+  const ehdr_t* eh = (const ehdr_t*)buf;
+  reg_t phoff = from_le(eh->e_phoff), phnum = from_le(eh->e_phnum);
+  if (phoff > size || phnum > (size - phoff) / sizeof(phdr_t))
+    return ranges;
+  const phdr_t* ph = (const phdr_t*)(buf + phoff);
+
+  for (reg_t i = 0; i < phnum; i++) {
+    reg_t memsz = from_le(ph[i].p_memsz), filesz = from_le(ph[i].p_filesz);
+    reg_t offset = from_le(ph[i].p_offset), addr = from_le(ph[i].p_paddr);
+    if (from_le(ph[i].p_type) != PT_LOAD || !memsz)
+      continue;
+    if (filesz > memsz || offset > size || filesz > size - offset || !fits_mem(mems, addr, memsz))
+      return {};
+    ranges.emplace_back(addr, addr + memsz);
+  }
+
+  static const uint8_t zeros[4096] = {0};
+  for (reg_t i = 0, r = 0; i < phnum; i++) {
+    if (from_le(ph[i].p_type) != PT_LOAD || !from_le(ph[i].p_memsz))
+      continue;
+    reg_t addr = ranges[r].first, end = ranges[r++].second;
+    reg_t filesz = from_le(ph[i].p_filesz), offset = from_le(ph[i].p_offset);
+    // the whole pages of read-only segments are mapped from the file, as
+    // load_elf does, so that instances loading it share them
+    reg_t mapped = 0;
+    if (!(from_le(ph[i].p_flags) & PF_W) && filesz >= PGSIZE &&
+        map_mem(mems, addr, filesz / PGSIZE * PGSIZE, fd, offset))
+      mapped = filesz / PGSIZE * PGSIZE;
+    write_mem(mems, path, addr + mapped, filesz - mapped, (const uint8_t*)buf + offset + mapped);
+    for (addr += filesz; addr < end; addr += sizeof(zeros))
+      write_mem(mems, path, addr, std::min<reg_t>(end - addr, sizeof(zeros)), zeros);
+  }
+  return ranges;
+}
+
+// hex digit values, 0xff for anything else
+struct hex_table_t {
+  hex_table_t()
+  {
+    memset(value, 0xff, sizeof(value));
+    for (int i = 0; i < 10; i++)
+      value['0' + i] = i;
+    for (int i = 0; i < 6; i++)
+      value['a' + i] = value['A' + i] = 10 + i;
+  }
+  uint8_t value[256];
+};
+
+void load_hex(const char* p, const char* end, const std::string& path, reg_t base,
+              const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems)
+{
+  static const hex_table_t hex;
+  const char* start = p;
+  auto error = [&](const char* what) {
+    std::stringstream s;
+    s << "memory image " << path << ": " << what << " at offset " << (p - start);
+    throw std::runtime_error(s.str());
+  };
+
+  size_t width = 0;             // bytes per word, from the first word
+  reg_t run_word = 0;           // word index where run starts
+  std::vector<uint8_t> run;     // the words since the last @, in memory order
+  std::vector<uint8_t> digits;
+  auto flush = [&]() {
+    write_mem(mems, path, base + run_word * width, run.size(), run.data());
+    run.clear();
+  };
+
+  while (p < end) {
+    char c = *p;
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      p++;
+      continue;
+    }
+    if (c == '/' && end - p >= 2 && p[1] == '/') {
+      const char* eol = (const char*)memchr(p, '\n', end - p);
+      p = eol ? eol : end;
+      continue;
+    }
+    if (c == '/' && end - p >= 2 && p[1] == '*') {
+      const char* q = p + 2;
+      while (q < end - 1 && !(q[0] == '*' && q[1] == '/'))
+        q++;
+      if (q >= end - 1)
+        error("unterminated comment");
+      p = q + 2;
+      continue;
+    }
+
+    bool addr = c == '@';
+    if (addr)
+      p++;
+    digits.clear();
+    for (; p < end; p++) {
+      uint8_t v = hex.value[(uint8_t)*p];
+      if (v != 0xff)
+        digits.push_back(v);
+      else if (*p != '_')
+        break;
+    }
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' && *p != '/')
+      error("bad character");
+    if (digits.empty())
+      error("missing digits");
+
+    if (addr) {
+      if (digits.size() > 16)
+        error("address too large");
+      reg_t word = 0;
+      for (uint8_t d : digits)
+        word = word << 4 | d;
+      if (!run.empty())
+        flush();
+      run_word = word;
+      continue;
+    }
+
+    if (!width)
+      width = (digits.size() + 1) / 2;
+    if (digits.size() > 2 * width)
+      error("word wider than the first");
+    // the last digit pair is the lowest-addressed byte
+    size_t n = digits.size();
+    for (size_t i = 0; i < width; i++) {
+      uint8_t lo = 2 * i < n ? digits[n - 1 - 2 * i] : 0;
+      uint8_t hi = 2 * i + 1 < n ? digits[n - 2 - 2 * i] : 0;
+      run.push_back(hi << 4 | lo);
+    }
+  }
+  if (!run.empty())
+    flush();
+}
+
+bool is_hex_image(const std::string& path)
+{
+  for (const char* ext : {".hex", ".vhx"}) {
+    size_t len = strlen(ext);
+    if (path.size() >= len && path.compare(path.size() - len, len, ext) == 0)
+      return true;
+  }
+  return false;
+}
+
+}
+
+void load_mem_image(const std::string& path, reg_t base,
+                    const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems)
+{
+  mapped_file_t file(path);
+  if (is_hex_image(path))
+    load_hex(file.data, file.data + file.size, path, base, mems);
+  else
+    write_mem(mems, path, base, file.size, (const uint8_t*)file.data);
+}
+
+std::vector<std::pair<reg_t, reg_t>> preload_elf(const std::string& path,
+                                                  const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems)
+{
+  mapped_file_t file(path);
+  const Elf64_Ehdr* eh = (const Elf64_Ehdr*)file.data;
+  if (file.size < sizeof(Elf64_Ehdr) || !IS_ELFLE(*eh) || !IS_ELF_EXEC(*eh))
+    return {};
+  if (IS_ELF32(*eh))
+    return preload_segments<Elf32_Ehdr, Elf32_Phdr>(file.data, file.size, file.fd, path, mems);
+  return preload_segments<Elf64_Ehdr, Elf64_Phdr>(file.data, file.size, file.fd, path, mems);
+}
@@ -0,0 +1,34 @@
+// See LICENSE for license details.
+#ifndef _RISCV_MEM_IMAGE_H
+#define _RISCV_MEM_IMAGE_H
+
+#include "devices.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// Loads a memory image the way RTL preloads its memories, without an ELF
+// file or HTIF: files named *.hex or *.vhx are Verilog hex ($readmemh, as
+// written by elf2hex), anything else is a raw binary. The image is placed at
+// physical address base and must fit within the memory regions in mems.
+//
+// In hex files, each word is stored little-endian with as many bytes as the
+// first word has digit pairs, and @<addr> moves to word addr (relative to
+// base). Comments and underscores are skipped.
+//
+// Throws std::runtime_error on errors.
+void load_mem_image(const std::string& path, reg_t base,
+                    const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems);
+
+// Copies the loadable segments of the executable ELF at path into mems, as
+// htif_t would, so that this may be done while the rest of a simulator is
+// built and htif_t then told to skip them (sim_t::set_preloaded). The whole
+// pages of read-only segments are mapped from the file copy-on-write where
+// the memory allows, as load_elf does. Returns
+// the [begin, end) ranges written, or none, writing nothing, for what it
+// leaves to htif_t: shared objects, big-endian ELFs and segments outside
+// mems. Throws std::runtime_error if path cannot be read.
+std::vector<std::pair<reg_t, reg_t>> preload_elf(const std::string& path,
+                                                  const std::vector<std::pair<reg_t, abstract_mem_t*>>& mems);
+
+#endif
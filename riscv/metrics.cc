@@ -0,0 +1,139 @@
+// See LICENSE for license details.
+
+#include "metrics.h"
+#include "sim.h"
+#include "processor.h"
+#include "mmu.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+metrics_writer_t::metrics_writer_t(sim_t* sim, const char* path, unsigned interval_ms)
+  : sim(sim), path(path), tmp_path(std::string(path) + ".tmp"),
+    start(host_clock::now()), last(start), due(false), stopping(false)
+{
+  if (interval_ms == 0)
+    throw std::runtime_error("metrics interval must be positive");
+  FILE* f = fopen(tmp_path.c_str(), "w");
+  if (!f) {
+    std::ostringstream oss;
+    oss << "Failed to open metrics file `" << tmp_path << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+  fclose(f);
+
+  timer = std::thread(&metrics_writer_t::timer_main, this, interval_ms);
+  sim->set_metrics_writer(this);
+}
+
+metrics_writer_t::~metrics_writer_t()
+{
+  sim->set_metrics_writer(nullptr);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  timer.join();
+  write();
+}
+
+void metrics_writer_t::timer_main(unsigned interval_ms)
+{
+  auto period = std::chrono::milliseconds(interval_ms);
+  auto next = host_clock::now();
+  std::unique_lock<std::mutex> guard(lock);
+  while (!stopping) {
+    next += period;
+    if (wake.wait_until(guard, next, [this] { return stopping; }))
+      break;
+    due.store(true, std::memory_order_relaxed);
+  }
+}
+
+void metrics_writer_t::write()
+{
+  due.store(false, std::memory_order_relaxed);
+
+  FILE* f = fopen(tmp_path.c_str(), "w");
+  if (!f)
+    return;
+
+  auto now = host_clock::now();
+  double seconds = std::chrono::duration<double>(now - start).count();
+  double interval = std::chrono::duration<double>(now - last).count();
+  last = now;
+
+  const auto& harts = sim->get_harts();
+  if (last_instret.size() < harts.size())
+    last_instret.resize(harts.size());
+
+  fprintf(f, "# TYPE spike_host_seconds gauge\n");
+  fprintf(f, "spike_host_seconds %.3f\n", seconds);
+
+  // one family at a time, as OpenMetrics wants them contiguous
+  auto family = [&](const char* name, const char* type, auto value) {
+    fprintf(f, "# TYPE %s %s\n", name, type);
+    for (const auto& [id, p] : harts)
+      value(id, p);
+  };
+
+  size_t i = 0;
+  std::vector<uint64_t> instret(harts.size());
+  for (const auto& [id, p] : harts)
+    instret[i++] = p->get_state()->minstret->read();
+
+  i = 0;
+  family("spike_instructions", "counter", [&](reg_t id, processor_t* UNUSED p) {
+    fprintf(f, "spike_instructions_total{hart=\"%" PRIu64 "\"} %" PRIu64 "\n", id, instret[i++]);
+  });
+  i = 0;
+  family("spike_mips", "gauge", [&](reg_t id, processor_t* UNUSED p) {
+    // minstret may have been written by the guest since the last snapshot
+    uint64_t delta = instret[i] >= last_instret[i] ? instret[i] - last_instret[i] : instret[i];
+    last_instret[i] = instret[i];
+    i++;
+    fprintf(f, "spike_mips{hart=\"%" PRIu64 "\"} %.3f\n", id, interval > 0 ? delta / interval / 1e6 : 0.0);
+  });
+
+  auto mmu_counter = [&](const char* name, uint64_t mmu_stats_t::* field) {
+    family(name, "counter", [&](reg_t id, processor_t* p) {
+      fprintf(f, "%s_total{hart=\"%" PRIu64 "\"} %" PRIu64 "\n", name, id, p->get_mmu()->get_stats().*field);
+    });
+  };
+#ifdef RISCV_ENABLE_TLB_HIT_STATS
+  mmu_counter("spike_tlb_hits", &mmu_stats_t::tlb_hits);
+#endif
+  mmu_counter("spike_tlb_misses", &mmu_stats_t::tlb_misses);
+#ifdef RISCV_ENABLE_ICACHE_STATS
+  mmu_counter("spike_icache_hits", &mmu_stats_t::icache_hits);
+  mmu_counter("spike_icache_refills", &mmu_stats_t::icache_refills);
+#endif
+  mmu_counter("spike_page_walks", &mmu_stats_t::walks);
+
+  family("spike_mmio_accesses", "counter", [&](reg_t id, processor_t* p) {
+    const mmu_stats_t& m = p->get_mmu()->get_stats();
+    fprintf(f, "spike_mmio_accesses_total{hart=\"%" PRIu64 "\"} %" PRIu64 "\n", id,
+            m.mmio_loads + m.mmio_stores + m.mmio_fetches);
+  });
+
+  family("spike_traps", "counter", [&](reg_t id, processor_t* p) {
+    const hart_stats_t& h = p->get_stats();
+    uint64_t exceptions = 0, interrupts = 0;
+    for (size_t cause = 0; cause < 64; cause++) {
+      exceptions += h.exceptions[cause];
+      interrupts += h.interrupts[cause];
+    }
+    fprintf(f, "spike_traps_total{hart=\"%" PRIu64 "\",kind=\"exception\"} %" PRIu64 "\n", id, exceptions);
+    fprintf(f, "spike_traps_total{hart=\"%" PRIu64 "\",kind=\"interrupt\"} %" PRIu64 "\n", id, interrupts);
+  });
+
+  if (extra)
+    extra(f);
+  fprintf(f, "# EOF\n");
+
+  if (fclose(f) == 0)
+    rename(tmp_path.c_str(), path.c_str());
+}
@@ -0,0 +1,69 @@
+// See LICENSE for license details.
+#ifndef _RISCV_METRICS_H
+#define _RISCV_METRICS_H
+
+#include "common.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class sim_t;
+
+// Throughput metrics for farm dashboards, rewritten as a whole every
+// interval of host time in OpenMetrics text form:
+//
+//   spike_host_seconds                           since the writer started
+//   spike_instructions_total{hart}               minstret
+//   spike_mips{hart}                             over the last interval
+//   spike_tlb_hits_total{hart}                   with --enable-tlb-hit-stats
+//   spike_tlb_misses_total{hart}
+//   spike_icache_{hits,refills}_total{hart}      with --enable-icache-stats
+//   spike_page_walks_total{hart}
+//   spike_mmio_accesses_total{hart}
+//   spike_traps_total{hart,kind="exception"|"interrupt"}
+//
+// followed by what the extra callback writes, if any. As with the guest
+// profiler, a host thread marks a snapshot due and the next scheduling
+// round (sim_t::end_round) writes it, so that the counters are read on the
+// thread that runs the harts. The file is written next to path and renamed
+// over it, so readers never see half a snapshot. The destructor writes a
+// last one.
+class metrics_writer_t {
+ public:
+  // Throws std::runtime_error if interval_ms is 0 or path cannot be written.
+  metrics_writer_t(sim_t* sim, const char* path, unsigned interval_ms);
+  ~metrics_writer_t();
+
+  void set_extra(std::function<void(FILE*)> f) { extra = std::move(f); }
+
+  void poll() {
+    if (unlikely(due.load(std::memory_order_relaxed)))
+      write();
+  }
+  void write();
+
+ private:
+  void timer_main(unsigned interval_ms);
+
+  typedef std::chrono::steady_clock host_clock;
+
+  sim_t* sim;
+  std::string path, tmp_path;
+  std::function<void(FILE*)> extra;
+  host_clock::time_point start, last;
+  std::vector<uint64_t> last_instret;  // by hart, at the last snapshot
+
+  std::atomic<bool> due;
+  std::mutex lock;
+  std::condition_variable wake;
+  bool stopping;
+  std::thread timer;
+};
+
+#endif
@@ -7,9 +7,14 @@
 #include "processor.h"
 #include "decode_macros.h"
 #include "platform.h"
+#include <algorithm>
+#include <stdexcept>
 
 mmu_t::mmu_t(simif_t* sim, endianness_t endianness, processor_t* proc, reg_t cache_blocksz)
- : sim(sim), proc(proc), blocksz(cache_blocksz),
+ : sim(sim), proc(proc), trace_ring(nullptr), observer(nullptr), load_reservation_value(0), shared_memory(false),
+  probing(false),
+  blocksz(cache_blocksz), block_profiling(false), pc_profiling(false),
+  insn_profiling(false), code_untracked(false), last_code_vpn(-1), external_writes_seen(0),
 #ifdef RISCV_ENABLE_DUAL_ENDIAN
   target_big_endian(endianness == endianness_big),
 #endif
@@ -20,7 +25,12 @@ mmu_t::mmu_t(simif_t* sim, endianness_t endianness, processor_t* proc, reg_t cac
 #ifndef RISCV_ENABLE_DUAL_ENDIAN
   assert(endianness == endianness_little);
 #endif
-  flush_tlb();
+  for (auto& victim : superpage_victim)
+    victim = 0;
+  configure_icache(DEFAULT_ICACHE_ENTRIES);
+  configure_block_cache(0);
+  configure_tlb(DEFAULT_TLB_ENTRIES, 1);
+  flush_gstage();
   yield_load_reservation();
 }
 
@@ -30,19 +40,469 @@ mmu_t::~mmu_t()
 
 void mmu_t::flush_icache()
 {
-  for (size_t i = 0; i < ICACHE_ENTRIES; i++)
-    icache[i].tag = -1;
+  for (auto& entry : icache)
+    entry.tag = -1;
+  for (auto& block : blocks) {
+    evict_block_counts(block);
+    block.pc = -1;
+  }
+
+  if (!code_pages.empty())
+    for (auto tlb : {&tlb_store, &tlb_ss_store, &tlb_guest_store})
+      for (auto& e : *tlb)
+        if (e.tag != reg_t(-1))
+          e.tag &= ~TLB_CODE;
+  code_pages.clear();
+  code_untracked = false;
+  last_code_vpn = -1;
+  external_writes_seen = sim ? sim->external_writes : 0;
+}
+
+void mmu_t::fence_i()
+{
+  if (code_untracked || sim->nprocs() > 1 || sim->external_writes != external_writes_seen)
+    flush_icache();
+}
+
+void mmu_t::set_code_flag(reg_t ppn, bool code)
+{
+  for (auto tlb : {&tlb_store, &tlb_ss_store, &tlb_guest_store}) {
+    for (auto& e : *tlb) {
+      if (e.tag == reg_t(-1) || e.data.target_addr / PGSIZE != ppn)
+        continue;
+      e.tag = code ? e.tag | TLB_CODE : e.tag & ~TLB_CODE;
+    }
+  }
+}
+
+void mmu_t::note_code(reg_t vaddr, reg_t len)
+{
+  last_code_vpn = vaddr / PGSIZE;
+  for (reg_t vpn = vaddr / PGSIZE; vpn <= (vaddr + len - 1) / PGSIZE; vpn++) {
+    const dtlb_entry_t* set = &tlb_insn[(vpn & tlb_set_mask) * tlb_ways];
+    const dtlb_entry_t* e = nullptr;
+    for (size_t way = 0; way < tlb_ways && !e; way++)
+      if ((set[way].tag & ~(TLB_FLAGS | TLB_PMP_SPLIT)) == vpn)
+        e = &set[way];
+    // stores to MMIO are not seen here; neither are pages past the limit
+    if (!e || (e->tag & TLB_MMIO) || code_pages.size() >= MAX_CODE_PAGES) {
+      code_untracked = true;
+      continue;
+    }
+
+    reg_t ppn = e->data.target_addr / PGSIZE;
+    auto& vpns = code_pages[ppn];
+    if (vpns.empty())
+      set_code_flag(ppn, true);
+    if (std::find(vpns.begin(), vpns.end(), vpn) == vpns.end())
+      vpns.push_back(vpn);
+  }
+}
+
+// Drops the icache entries and blocks holding instructions that overlap
+// the len bytes at paddr, which lie within one page.
+void mmu_t::invalidate_code(reg_t paddr, reg_t len)
+{
+  auto it = code_pages.find(paddr / PGSIZE);
+  if (it == code_pages.end())
+    return;
+
+  static const reg_t MAX_BLOCK_BYTES = insn_block_t::MAX_INSNS * sizeof(insn_bits_t);
+  for (reg_t vpn : it->second) {
+    reg_t vaddr = vpn * PGSIZE + paddr % PGSIZE;
+    reg_t first = vaddr - (sizeof(insn_bits_t) - PC_ALIGN);
+    for (reg_t pc = first; pc - first < vaddr + len - first; pc += PC_ALIGN) {
+      icache_entry_t& entry = icache[icache_index(pc)];
+      if (entry.tag == pc && pc + insn_length(entry.data.insn.bits()) > vaddr)
+        entry.tag = -1;
+    }
+    if (blocks.empty())
+      continue;
+    first = vaddr - (MAX_BLOCK_BYTES - PC_ALIGN);
+    for (reg_t pc = first; pc - first < vaddr + len - first; pc += PC_ALIGN) {
+      insn_block_t& block = blocks[(pc / PC_ALIGN) & block_mask];
+      if (block.pc == pc && block.n && block.next_pc[block.n - 1] > vaddr) {
+        evict_block_counts(block);
+        block.pc = -1;
+      }
+    }
+  }
+}
+
+void mmu_t::configure_icache(size_t entries)
+{
+  assert(entries > 0 && (entries & (entries - 1)) == 0);
+
+  icache.resize(entries);
+  icache_mask = entries - 1;
+  flush_icache();
+}
+
+size_t mmu_t::tlb_bytes() const
+{
+  size_t entries = tlb_load.capacity() + tlb_store.capacity() + tlb_insn.capacity() +
+                   tlb_ss_load.capacity() + tlb_ss_store.capacity() +
+                   tlb_guest_load.capacity() + tlb_guest_store.capacity();
+  return entries * sizeof(dtlb_entry_t) + sizeof(ptw_cache) + sizeof(gstage_cache) +
+         sizeof(superpage_tlb);
+}
+
+size_t mmu_t::icache_bytes() const
+{
+  size_t bytes = icache.capacity() * sizeof(icache_entry_t) +
+                 blocks.capacity() * sizeof(insn_block_t);
+  // roughly: a node per page, plus the pcs listed under it
+  for (auto& page : code_pages)
+    bytes += sizeof(page) + 2 * sizeof(void*) + page.second.capacity() * sizeof(reg_t);
+  return bytes;
+}
+
+void mmu_t::configure_block_cache(size_t entries)
+{
+  assert((entries & (entries - 1)) == 0);
+#ifdef MMU_OBSERVE_FETCH_HOOKED
+  entries = 0;
+#endif
+
+  flush_icache();
+  blocks.resize(entries);
+  blocks.shrink_to_fit();
+  block_mask = entries - 1;
+  flush_icache();
+}
+
+void mmu_t::set_block_profiling(bool enable)
+{
+  flush_icache();
+  block_profiling = enable;
+  evicted_block_counts.clear();
+}
+
+void mmu_t::flush_block_counts()
+{
+  for (auto& block : blocks)
+    evict_block_counts(block);
+}
+
+void mmu_t::take_block_counts(std::unordered_map<reg_t, uint64_t>& counts)
+{
+  flush_block_counts();
+  for (auto& [pc, n] : evicted_block_counts)
+    counts[pc] += n;
+  evicted_block_counts.clear();
+}
+
+void mmu_t::set_pc_profiling(bool enable)
+{
+  flush_icache();
+  pc_profiling = enable;
+  evicted_pc_counts.clear();
+}
+
+void mmu_t::set_insn_profiling(bool enable)
+{
+  flush_icache();
+  insn_profiling = enable;
+}
+
+void mmu_t::take_pc_counts(std::unordered_map<reg_t, uint64_t>& counts)
+{
+  flush_block_counts();
+  for (auto& [pc, n] : evicted_pc_counts)
+    counts[pc] += n;
+  evicted_pc_counts.clear();
+}
+
+// A block left after instruction i retired instructions 0..i, so each
+// instruction's count is the sum of the exits at or after it. The block's
+// last instruction may have flushed it, so its tag cannot be used.
+void mmu_t::evict_block_counts(insn_block_t& block)
+{
+  if (block_counts_enabled()) {
+    uint64_t through = 0, retired = 0;
+    for (size_t i = block.n; i-- > 0; ) {
+      through += block.exits[i];
+      retired += through;
+      if (!through)
+        continue;
+      if (pc_profiling)
+        evicted_pc_counts[i ? block.next_pc[i - 1] : block.start] += through;
+      if (insn_profiling)
+        proc->count_insns(block.insns[i].insn.bits(), block.prv, through);
+    }
+    if (block_profiling && retired)
+      evicted_block_counts[block.start] += retired;
+  }
+  memset(block.exits, 0, sizeof(block.exits));
+}
+
+// Whether the instruction after insn must start a new block: jumps, and
+// SYSTEM, MISC-MEM (fence.i, CBOs) and custom opcodes, which may flush the
+// icache or change the translation or decoding of what follows.
+static bool insn_ends_block(insn_bits_t insn, int xlen)
+{
+  if ((insn & 3) != 3) {
+    reg_t funct3 = (insn >> 13) & 7;
+    switch (insn & 3) {
+      case 1: return funct3 == 5 || (funct3 == 1 && xlen == 32);  // c.j, c.jal
+      case 2: return funct3 == 4 && ((insn >> 2) & 0x1f) == 0;     // c.jr, c.jalr, c.ebreak
+      default: return false;
+    }
+  }
+
+  switch (insn & 0x7f) {
+    case 0x6f: // JAL
+    case 0x67: // JALR
+    case 0x73: // SYSTEM
+    case 0x0f: // MISC-MEM
+    case 0x0b: case 0x2b: case 0x5b: case 0x7b: // custom-0..3
+      return true;
+    default:
+      return insn_length(insn) != 4;
+  }
+}
+
+void mmu_t::prefill_icache(icache_entry_t* entry)
+{
+  static const size_t MAX_PREFILL = 8;
+
+  // As for blocks, decoding ahead is only side-effect free while the page
+  // has a plain TLB entry.
+  reg_t addr = entry->tag;
+  auto [plain, host_addr, _] = access_tlb(tlb_insn, addr);
+  if (!plain)
+    return;
+
+  const char* page = (const char*)host_addr - (addr % PGSIZE);
+  reg_t page_end = (addr & ~reg_t(PGSIZE - 1)) + PGSIZE;
+  insn_bits_t insn = entry->data.insn.bits();
+  reg_t pc = addr + insn_length(insn);
+  for (size_t i = 0; i < MAX_PREFILL && !insn_ends_block(insn, proc->get_xlen()); i++) {
+    icache_entry_t* slot = &icache[icache_index(pc)];
+    if (slot->tag == pc || slot == entry || pc + sizeof(insn_parcel_t) > page_end ||
+        pc == proc->get_stop_pc() || proc->commit_log_covers(pc))
+      break;
+    insn_parcel_t parcels[2];
+    memcpy(&parcels[0], page + pc % PGSIZE, sizeof(insn_parcel_t));
+    insn = from_le(parcels[0]);
+    int length = insn_length(insn);
+    if (length > 4 || pc + length > page_end)
+      break;
+    if (length == 4) {
+      memcpy(&parcels[1], page + pc % PGSIZE + 2, sizeof(insn_parcel_t));
+      insn |= (insn_bits_t)from_le(parcels[1]) << 16;
+    }
+
+    slot->tag = pc;
+    slot->next = &icache[icache_index(pc + length)];
+    slot->data = {proc->decode_insn(insn), insn};
+    pc += length;
+  }
+}
+
+insn_block_t* mmu_t::refill_block(reg_t addr, insn_block_t* block)
+{
+  // The first instruction is fetched as usual, with its traps, triggers and
+  // tracing. An uncacheable fetch leaves the block tagged invalid.
+  icache_entry_t first;
+  refill_icache(addr, &first);
+  evict_block_counts(*block);
+  block->pc = first.tag;
+  block->start = addr;
+  block->prv = proc->get_state()->prv;
+  block->execs = 0;
+  block->succ = nullptr;
+  block->insns[0] = first.data;
+  block->next_pc[0] = addr + insn_length(first.data.insn.bits());
+  block->n = 1;
+
+  // The rest is decoded ahead from host memory, which is only side-effect
+  // free while the page has a plain TLB entry: no MMIO, triggers or tracer.
+  auto [plain, host_addr, _] = access_tlb(tlb_insn, addr);
+  if (block->pc != addr || !plain)
+    return block;
+
+  const char* page = (const char*)host_addr - (addr % PGSIZE);
+  reg_t page_end = (addr & ~reg_t(PGSIZE - 1)) + PGSIZE;
+  insn_bits_t insn = first.data.insn.bits();
+  reg_t pc = block->next_pc[0];
+  while (block->n < insn_block_t::MAX_INSNS && !insn_ends_block(insn, proc->get_xlen())) {
+    if (pc + sizeof(insn_parcel_t) > page_end || pc == proc->get_stop_pc() ||
+        proc->commit_log_covers(pc))
+      break;
+    insn_parcel_t parcels[2];
+    memcpy(&parcels[0], page + pc % PGSIZE, sizeof(insn_parcel_t));
+    insn = from_le(parcels[0]);
+    int length = insn_length(insn);
+    if (length > 4 || pc + length > page_end)
+      break;
+    if (length == 4) {
+      memcpy(&parcels[1], page + pc % PGSIZE + 2, sizeof(insn_parcel_t));
+      insn |= (insn_bits_t)from_le(parcels[1]) << 16;
+    }
+
+    block->insns[block->n] = {proc->decode_insn(insn), insn};
+    pc += length;
+    block->next_pc[block->n++] = pc;
+  }
+  return block;
 }
 
 void mmu_t::flush_tlb()
 {
-  memset(tlb_insn, -1, sizeof(tlb_insn));
-  memset(tlb_load, -1, sizeof(tlb_load));
-  memset(tlb_store, -1, sizeof(tlb_store));
+  memset(tlb_insn.data(), -1, tlb_insn.size() * sizeof(dtlb_entry_t));
+  memset(tlb_load.data(), -1, tlb_load.size() * sizeof(dtlb_entry_t));
+  memset(tlb_store.data(), -1, tlb_store.size() * sizeof(dtlb_entry_t));
+  memset(tlb_ss_load.data(), -1, tlb_ss_load.size() * sizeof(dtlb_entry_t));
+  memset(tlb_ss_store.data(), -1, tlb_ss_store.size() * sizeof(dtlb_entry_t));
+  flush_guest_tlb();
+  for (auto& e : ptw_cache)
+    e.level = -1;
+  for (auto& tlb : superpage_tlb)
+    for (auto& e : tlb)
+      e.valid = false;
+  superpage_fills.clear();
+  superpage_fills_overflow = false;
 
   flush_icache();
 }
 
+void mmu_t::flush_guest_tlb()
+{
+  memset(tlb_guest_load.data(), -1, tlb_guest_load.size() * sizeof(dtlb_entry_t));
+  memset(tlb_guest_store.data(), -1, tlb_guest_store.size() * sizeof(dtlb_entry_t));
+}
+
+void mmu_t::flush_gstage()
+{
+  for (auto& e : gstage_cache)
+    e.valid = false;
+}
+
+void mmu_t::note_superpage_fill(reg_t vbase, reg_t mask)
+{
+  for (auto& r : superpage_fills)
+    if (r.first == vbase && r.second == mask)
+      return;
+  if (superpage_fills.size() == SUPERPAGE_FILLS)
+    superpage_fills_overflow = true;
+  else
+    superpage_fills.emplace_back(vbase, mask);
+}
+
+void mmu_t::flush_tlb_page(reg_t vaddr)
+{
+  if (superpage_fills_overflow) {
+    flush_tlb();
+    return;
+  }
+
+  // TLB entries refilled from a larger leaf cover only their own 4 KiB, so
+  // drop every page of the largest such range containing vaddr
+  reg_t base = vaddr & ~(PGSIZE - 1), size = PGSIZE;
+  for (auto& r : superpage_fills) {
+    if (((vaddr ^ r.first) & ~r.second) == 0 && r.second + 1 > size) {
+      base = r.first;
+      size = r.second + 1;
+    }
+  }
+
+  reg_t vpn = base / PGSIZE, pages = size / PGSIZE;
+  for (auto tlb : {&tlb_insn, &tlb_load, &tlb_store, &tlb_ss_load, &tlb_ss_store, &tlb_guest_load, &tlb_guest_store}) {
+    if (pages == 1) {
+      dtlb_entry_t* set = &(*tlb)[(vpn & tlb_set_mask) * tlb_ways];
+      for (size_t way = 0; way < tlb_ways; way++)
+        if ((set[way].tag & ~(TLB_FLAGS | TLB_PMP_SPLIT)) == vpn)
+          set[way].tag = -1;
+    } else {
+      for (auto& e : *tlb)
+        if ((e.tag & ~(TLB_FLAGS | TLB_PMP_SPLIT)) - vpn < pages)
+          e.tag = -1;
+    }
+  }
+  for (auto& tlb : superpage_tlb)
+    for (auto& e : tlb)
+      if (e.valid && ((vaddr ^ e.vbase) & ~e.mask) == 0)
+        e.valid = false;
+  if (pages > 1) {
+    superpage_fills.erase(std::remove_if(superpage_fills.begin(), superpage_fills.end(),
+                                         [&](const std::pair<reg_t, reg_t>& r) {
+                                           return r.first - base < size;
+                                         }),
+                          superpage_fills.end());
+  }
+
+  // Include the instructions that start in the previous page and end in
+  // this one; a block's decoded-ahead instructions stay within its first.
+  reg_t first = base - sizeof(insn_bits_t);
+  size += sizeof(insn_bits_t);
+  last_code_vpn = -1;  // the page may map elsewhere now
+  for (auto& entry : icache)
+    if (entry.tag - first < size)
+      entry.tag = -1;
+  for (auto& block : blocks) {
+    if (block.pc - first < size) {
+      evict_block_counts(block);
+      block.pc = -1;
+    }
+  }
+}
+
+void mmu_t::sfence_vma(std::optional<reg_t> vaddr, std::optional<reg_t> asid)
+{
+  // The TLBs only hold translations of the current address space at the
+  // current privilege, since a satp or privilege change flushes them. A
+  // fence for another ASID thus has nothing to drop: it does not order
+  // global mappings.
+  state_t* state = proc->get_state();
+  if (asid && proc->supports_impl(IMPL_MMU_ASID)) {
+    reg_t field = proc->get_xlen() == 32 ? SATP32_ASID : SATP64_ASID;
+    reg_t satp = state->satp->readvirt(state->v);
+    if (get_field(satp, field) != (*asid & get_field(field, field)))
+      return;
+  }
+
+  // With pointer masking, several tagged addresses share a page.
+  if (!vaddr || get_pmlen(state->v, state->prv, {}) != 0) {
+    flush_tlb();
+    return;
+  }
+
+  flush_tlb_page(*vaddr);
+  if (proc->get_xlen() == 32) {
+    // RV32 addresses reach the TLB either sign- or zero-extended.
+    flush_tlb_page(zext32(*vaddr));
+    flush_tlb_page(sext32(*vaddr));
+  }
+}
+
+void mmu_t::configure_tlb(size_t entries, size_t ways)
+{
+  assert(ways > 0 && entries >= ways);
+  assert((entries & (entries - 1)) == 0 && (ways & (ways - 1)) == 0);
+
+  tlb_load.resize(entries);
+  tlb_store.resize(entries);
+  tlb_insn.resize(entries);
+  for (auto tlb : {&tlb_ss_load, &tlb_ss_store, &tlb_guest_load, &tlb_guest_store})
+    tlb->resize(entries);
+  tlb_set_mask = entries / ways - 1;
+  tlb_ways = ways;
+  flush_tlb();
+}
+
+void mmu_t::rehome()
+{
+  // evict the block counts while the blocks are still where they were
+  flush_tlb();
+  for (auto tlb : {&tlb_load, &tlb_store, &tlb_insn, &tlb_ss_load, &tlb_ss_store,
+                   &tlb_guest_load, &tlb_guest_store})
+    std::vector<dtlb_entry_t>(tlb->begin(), tlb->end()).swap(*tlb);
+  std::vector<icache_entry_t>(icache.begin(), icache.end()).swap(icache);
+  std::vector<insn_block_t>(blocks.begin(), blocks.end()).swap(blocks);
+  flush_tlb();
+}
+
 void throw_access_exception(bool virt, reg_t addr, access_type type)
 {
   switch (type) {
@@ -63,7 +523,9 @@ reg_t mmu_t::translate(mem_access_info_t access_info, reg_t len)
   bool virt = access_info.effective_virt;
   reg_t mode = (reg_t) access_info.effective_priv;
 
-  reg_t paddr = walk(access_info) | (addr & (PGSIZE-1));
+  reg_t paddr;
+  if (!lookup_superpage(access_info, &paddr))
+    paddr = walk(access_info) | (addr & (PGSIZE-1));
   if (!pmp_ok(paddr, len, access_info.flags.ss_access ? STORE : type, mode, access_info.flags.hlvx))
     throw_access_exception(virt, addr, access_info.flags.ss_access ? STORE : type);
   return paddr;
@@ -89,12 +551,12 @@ mmu_t::insn_parcel_t mmu_t::fetch_slow_path(reg_t vaddr)
     throw trig;
   }
 
-  if  (auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_insn, vaddr, TLB_FLAGS & ~TLB_CHECK_TRIGGERS); tlb_hit) {
+  if  (auto [tlb_hit, host_addr, paddr] = access_split_tlb(tlb_insn, vaddr, sizeof(insn_parcel_t), TLB_FLAGS & ~TLB_CHECK_TRIGGERS); tlb_hit) {
     // Fast path for simple cases
     return perform_intrapage_fetch(vaddr, host_addr, paddr);
   }
 
-  auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_insn, vaddr, TLB_FLAGS);
+  auto [tlb_hit, host_addr, paddr] = access_split_tlb(tlb_insn, vaddr, sizeof(insn_parcel_t), TLB_FLAGS);
   auto access_info = generate_access_info(vaddr, FETCH, {});
   check_triggers(triggers::OPERATION_EXECUTE, vaddr, access_info.effective_virt);
 
@@ -153,21 +615,32 @@ bool mmu_t::mmio_fetch(reg_t paddr, size_t len, uint8_t* bytes)
   if (!mmio_ok(paddr, FETCH))
     return false;
 
+  stats.mmio_fetches++;
   return sim->mmio_fetch(paddr, len, bytes);
 }
 
 bool mmu_t::mmio_load(reg_t paddr, size_t len, uint8_t* bytes)
 {
+  if (unlikely(proc && proc->get_mmio_barrier()))
+    throw mmio_barrier_t();
+
+  stats.mmio_loads++;
   return mmio(paddr, len, bytes, LOAD);
 }
 
 bool mmu_t::mmio_store(reg_t paddr, size_t len, const uint8_t* bytes)
 {
+  if (unlikely(proc && proc->get_mmio_barrier()))
+    throw mmio_barrier_t();
+
+  stats.mmio_stores++;
   return mmio(paddr, len, const_cast<uint8_t*>(bytes), STORE);
 }
 
 bool mmu_t::mmio(reg_t paddr, size_t len, uint8_t* bytes, access_type type)
 {
+  auto guard = shared_memory_guard();
+
   bool power_of_2 = (len & (len - 1)) == 0;
   bool naturally_aligned = (paddr & (len - 1)) == 0;
 
@@ -224,22 +697,25 @@ inline void mmu_t::perform_intrapage_load(reg_t vaddr, uintptr_t host_addr, reg_
 
   if (tracer.interested_in_range(paddr, paddr + len, LOAD))
     tracer.trace(paddr, len, LOAD);
+  if (trace_ring)
+    trace_ring->trace(paddr, len, LOAD);
 }
 
 void mmu_t::load_slow_path_intrapage(reg_t len, uint8_t* bytes, mem_access_info_t access_info)
 {
   reg_t vaddr = access_info.vaddr;
-  auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_load, vaddr, TLB_FLAGS);
-  if (!tlb_hit || access_info.flags.is_special_access()) {
+  bool cached = access_info.flags.tlb_cached();
+  auto [tlb_hit, host_addr, paddr] = access_split_tlb(data_tlb(LOAD, access_info.flags), vaddr, len, TLB_FLAGS);
+  if (!tlb_hit || !cached) {
     paddr = translate(access_info, len);
     host_addr = (uintptr_t)sim->addr_to_mem(paddr);
 
-    if (!access_info.flags.is_special_access())
-      refill_tlb(vaddr, paddr, (char*)host_addr, LOAD);
+    if (cached)
+      refill_tlb(vaddr, paddr, (char*)host_addr, LOAD, access_info.flags);
+  }
 
-    if (access_info.flags.lr && !sim->reservable(paddr)) {
-      throw trap_load_access_fault(access_info.effective_virt, access_info.transformed_vaddr, 0, 0);
-    }
+  if (access_info.flags.lr && !sim->reservable(paddr)) {
+    throw trap_load_access_fault(access_info.effective_virt, access_info.transformed_vaddr, 0, 0);
   }
 
   perform_intrapage_load(vaddr, host_addr, paddr, len, bytes, access_info.flags);
@@ -249,17 +725,30 @@ void mmu_t::load_slow_path_intrapage(reg_t len, uint8_t* bytes, mem_access_info_
   }
 }
 
+void mmu_t::count_slow_path(const std::vector<dtlb_entry_t>& tlb, reg_t vaddr, reg_t len, bool tlb_hit)
+{
+  if (tlb_hit)
+    stats.slow_misaligned++;
+  else if (std::get<0>(access_split_tlb(tlb, vaddr, len, TLB_FLAGS)))
+    stats.slow_flagged++;
+  else
+    stats.slow_tlb_miss++;
+}
+
 void mmu_t::load_slow_path(reg_t original_addr, reg_t len, uint8_t* bytes, xlate_flags_t xlate_flags)
 {
   if (likely(!xlate_flags.is_special_access())) {
     // Fast path for simple cases
-    auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_load, original_addr, TLB_FLAGS & ~TLB_CHECK_TRIGGERS);
+    auto [tlb_hit, host_addr, paddr] = access_split_tlb(tlb_load, original_addr, len, TLB_FLAGS & ~TLB_CHECK_TRIGGERS);
     bool intrapage = (original_addr % PGSIZE) + len <= PGSIZE;
     bool aligned = (original_addr & (len - 1)) == 0;
 
     if (likely(tlb_hit && (aligned || (intrapage && is_misaligned_enabled())))) {
       return perform_intrapage_load(original_addr, host_addr, paddr, len, bytes, xlate_flags);
     }
+    count_slow_path(tlb_load, original_addr, len, tlb_hit);
+  } else {
+    stats.slow_special++;
   }
 
   auto access_info = generate_access_info(original_addr, LOAD, xlate_flags);
@@ -284,21 +773,41 @@ void mmu_t::load_slow_path(reg_t original_addr, reg_t len, uint8_t* bytes, xlate
     }
   }
 
-  while (len > sizeof(reg_t)) {
-    check_triggers(triggers::OPERATION_LOAD, transformed_addr, access_info.effective_virt, reg_from_bytes(sizeof(reg_t), bytes));
-    len -= sizeof(reg_t);
-    bytes += sizeof(reg_t);
+  const uint8_t* data = bytes;
+  reg_t rest = len;
+  while (rest > sizeof(reg_t)) {
+    check_triggers(triggers::OPERATION_LOAD, transformed_addr, access_info.effective_virt, reg_from_bytes(sizeof(reg_t), data));
+    rest -= sizeof(reg_t);
+    data += sizeof(reg_t);
   }
-  check_triggers(triggers::OPERATION_LOAD, transformed_addr, access_info.effective_virt, reg_from_bytes(len, bytes));
+  check_triggers(triggers::OPERATION_LOAD, transformed_addr, access_info.effective_virt, reg_from_bytes(rest, data));
+
+  if (unlikely(observer != nullptr))
+    observer->load(original_addr, bytes, len);
 
-  if (proc && unlikely(proc->get_log_commits_enabled()))
-    proc->state.log_mem_read.push_back(std::make_tuple(original_addr, 0, len));
+  if (proc && unlikely(proc->get_log_commits_enabled())) {
+    // as for stores, wider loads are logged a register's width at a time
+    reg_t offset = 0;
+    const auto reg_size = sizeof(reg_t);
+    while (unlikely(len > reg_size)) {
+      proc->state.log_mem_read.push_back(std::make_tuple(original_addr + offset, reg_from_bytes(reg_size, bytes + offset), reg_size));
+      offset += reg_size;
+      len -= reg_size;
+    }
+    proc->state.log_mem_read.push_back(std::make_tuple(original_addr + offset, reg_from_bytes(len, bytes + offset), len));
+  }
 }
 
 inline void mmu_t::perform_intrapage_store(reg_t vaddr, uintptr_t host_addr, reg_t paddr, reg_t len, const uint8_t* bytes, xlate_flags_t xlate_flags)
 {
   if (host_addr) {
      memcpy((char*)host_addr, bytes, len);
+     if (store_set)
+       store_set->add(paddr, len);
+     if (!proc)
+       sim->external_writes++;
+     else if (!code_pages.empty())
+       invalidate_code(paddr, len);
   } else if (!mmio_store(paddr, len, bytes)) {
     auto access_info = generate_access_info(vaddr, STORE, xlate_flags);
     throw trap_store_access_fault(access_info.effective_virt, access_info.transformed_vaddr, 0, 0);
@@ -306,18 +815,21 @@ inline void mmu_t::perform_intrapage_store(reg_t vaddr, uintptr_t host_addr, reg
 
   if (tracer.interested_in_range(paddr, paddr + len, STORE))
     tracer.trace(paddr, len, STORE);
+  if (trace_ring)
+    trace_ring->trace(paddr, len, STORE);
 }
 
 void mmu_t::store_slow_path_intrapage(reg_t len, const uint8_t* bytes, mem_access_info_t access_info, bool actually_store)
 {
   reg_t vaddr = access_info.vaddr;
-  auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_store, vaddr, TLB_FLAGS);
-  if (!tlb_hit || access_info.flags.is_special_access()) {
+  bool cached = access_info.flags.tlb_cached();
+  auto [tlb_hit, host_addr, paddr] = access_split_tlb(data_tlb(STORE, access_info.flags), vaddr, len, TLB_FLAGS);
+  if (!tlb_hit || !cached) {
     paddr = translate(access_info, len);
     host_addr = (uintptr_t)sim->addr_to_mem(paddr);
 
-    if (!access_info.flags.is_special_access())
-      refill_tlb(vaddr, paddr, (char*)host_addr, STORE);
+    if (cached)
+      refill_tlb(vaddr, paddr, (char*)host_addr, STORE, access_info.flags);
   }
 
   if (actually_store)
@@ -328,7 +840,7 @@ void mmu_t::store_slow_path(reg_t original_addr, reg_t len, const uint8_t* bytes
 {
   if (likely(!xlate_flags.is_special_access())) {
     // Fast path for simple cases
-    auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_store, original_addr, TLB_FLAGS & ~TLB_CHECK_TRIGGERS);
+    auto [tlb_hit, host_addr, paddr] = access_split_tlb(tlb_store, original_addr, len, TLB_FLAGS & ~TLB_CHECK_TRIGGERS);
     bool intrapage = (original_addr % PGSIZE) + len <= PGSIZE;
     bool aligned = (original_addr & (len - 1)) == 0;
 
@@ -337,6 +849,11 @@ void mmu_t::store_slow_path(reg_t original_addr, reg_t len, const uint8_t* bytes
         perform_intrapage_store(original_addr, host_addr, paddr, len, bytes, xlate_flags);
       return;
     }
+    // AMOs and LR/SC only probe here; their real accesses are counted
+    if (actually_store)
+      count_slow_path(tlb_store, original_addr, len, tlb_hit);
+  } else if (actually_store) {
+    stats.slow_special++;
   }
 
   auto access_info = generate_access_info(original_addr, STORE, xlate_flags);
@@ -370,6 +887,9 @@ void mmu_t::store_slow_path(reg_t original_addr, reg_t len, const uint8_t* bytes
     store_slow_path_intrapage(len, bytes, access_info, actually_store);
   }
 
+  if (actually_store && unlikely(observer != nullptr))
+    observer->store(original_addr, bytes, len);
+
   if (actually_store && proc && unlikely(proc->get_log_commits_enabled())) {
     // amocas.q sends len == 16, reg_from_bytes only supports up to 8
     // bytes per conversion.  Make multiple entries in the log
@@ -384,72 +904,243 @@ void mmu_t::store_slow_path(reg_t original_addr, reg_t len, const uint8_t* bytes
   }
 }
 
-tlb_entry_t mmu_t::refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type)
+bool mmu_t::load_bulk(reg_t addr, reg_t len, uint8_t* bytes)
+{
+  // a traced access must be seen element by element
+  if (target_big_endian || (trace_ring && trace_ring->wants(LOAD)))
+    return false;
+
+  while (len) {
+    reg_t chunk = std::min(len, PGSIZE - addr % PGSIZE);
+    auto [tlb_hit, host_addr, _] = access_tlb(tlb_load, addr);
+    if (!tlb_hit)
+      return false;
+    memcpy(bytes, (const void*)host_addr, chunk);
+    addr += chunk;
+    bytes += chunk;
+    len -= chunk;
+  }
+  return true;
+}
+
+bool mmu_t::store_bulk(reg_t addr, reg_t len, const uint8_t* bytes)
+{
+  if (target_big_endian || (trace_ring && trace_ring->wants(STORE)))
+    return false;
+
+  while (len) {
+    reg_t chunk = std::min(len, PGSIZE - addr % PGSIZE);
+    auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_store, addr);
+    if (!tlb_hit)
+      return false;
+    memcpy((void*)host_addr, bytes, chunk);
+    if (store_set)
+      store_set->add(paddr, chunk);
+    addr += chunk;
+    bytes += chunk;
+    len -= chunk;
+  }
+  return true;
+}
+
+bool mmu_t::load_strided(reg_t addr, reg_t stride, reg_t count, reg_t size, uint8_t* bytes)
+{
+  if (target_big_endian || (trace_ring && trace_ring->wants(LOAD)))
+    return false;
+
+  reg_t vpn = -1;
+  uintptr_t host_page = 0;
+  for (reg_t n = 0; n < count; n++, addr += stride, bytes += size) {
+    for (reg_t done = 0; done < size; ) {
+      reg_t a = addr + done;
+      reg_t chunk = std::min(size - done, PGSIZE - a % PGSIZE);
+      if (a >> PGSHIFT != vpn) {
+        auto [tlb_hit, host_addr, _] = access_tlb(tlb_load, a);
+        if (!tlb_hit)
+          return false;
+        vpn = a >> PGSHIFT;
+        host_page = host_addr - a % PGSIZE;
+      }
+      memcpy(bytes + done, (const void*)(host_page + a % PGSIZE), chunk);
+      done += chunk;
+    }
+  }
+  return true;
+}
+
+bool mmu_t::store_strided(reg_t addr, reg_t stride, reg_t count, reg_t size, const uint8_t* bytes)
+{
+  if (target_big_endian || (trace_ring && trace_ring->wants(STORE)))
+    return false;
+
+  reg_t vpn = -1;
+  uintptr_t host_page = 0;
+  reg_t paddr_page = 0;
+  for (reg_t n = 0; n < count; n++, addr += stride, bytes += size) {
+    for (reg_t done = 0; done < size; ) {
+      reg_t a = addr + done;
+      reg_t chunk = std::min(size - done, PGSIZE - a % PGSIZE);
+      if (a >> PGSHIFT != vpn) {
+        auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_store, a);
+        if (!tlb_hit)
+          return false;
+        vpn = a >> PGSHIFT;
+        host_page = host_addr - a % PGSIZE;
+        paddr_page = paddr - a % PGSIZE;
+      }
+      memcpy((void*)(host_page + a % PGSIZE), bytes + done, chunk);
+      if (store_set)
+        store_set->add(paddr_page + a % PGSIZE, chunk);
+      done += chunk;
+    }
+  }
+  return true;
+}
+
+bool mmu_t::page_may_trigger(triggers::operation_t operation, reg_t vaddr)
+{
+  // Triggers see addresses after pointer masking (PMLEN 7 or 16) and RV32
+  // truncation, so every form the page can take is looked up.
+  reg_t page = vaddr & ~reg_t(PGSIZE - 1);
+  const reg_t forms[] = {
+    page, page & 0xffffffff,
+    reg_t(sreg_t(page << 7) >> 7), (page << 7) >> 7,
+    reg_t(sreg_t(page << 16) >> 16), (page << 16) >> 16,
+  };
+  for (reg_t form : forms)
+    if (proc->TM.may_match(operation, form, form + PGSIZE - 1))
+      return true;
+  return false;
+}
+
+tlb_entry_t mmu_t::refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type, xlate_flags_t xlate_flags)
 {
-  reg_t idx = (vaddr >> PGSHIFT) % TLB_ENTRIES;
+  stats.tlb_misses++;
+  if (type == FETCH)
+    stats.tlb_misses_fetch++;
+  else if (type == LOAD)
+    stats.tlb_misses_load++;
+  else
+    stats.tlb_misses_store++;
+
   reg_t expected_tag = vaddr >> PGSHIFT;
   reg_t base_paddr = paddr & ~reg_t(PGSIZE - 1);
 
   tlb_entry_t entry = {uintptr_t(host_addr) - (vaddr % PGSIZE), paddr - (vaddr % PGSIZE)};
 
   if (in_mprv()
-      || !pmp_homogeneous(base_paddr, PGSIZE)
-      || (proc && proc->get_log_commits_enabled()))
+      || (type != FETCH && proc && proc->get_log_commits_enabled())  // fetches are not logged
+      || (type != FETCH && observer))  // nor observed through the TLB
     return entry;
 
-  auto trace_flag = tracer.interested_in_range(base_paddr, base_paddr + PGSIZE, type) ? TLB_CHECK_TRACER : 0;
+  uint64_t pmp_blocks = -1;
+  reg_t split_flag = 0;
+  if (!pmp_homogeneous(base_paddr, PGSIZE)) {
+    if (xlate_flags.ss_access || xlate_flags.forced_virt)
+      return entry;
+    pmp_blocks = pmp_page_blocks(base_paddr, type);
+    if (pmp_blocks == 0)
+      return entry;
+    split_flag = TLB_PMP_SPLIT;
+  }
+
+  // Loads and stores reach an async tracer from the fast path; fetches
+  // bypass the instruction cache as for any other tracer.
+  bool traced = tracer.interested_in_range(base_paddr, base_paddr + PGSIZE, type) ||
+                (type == FETCH && trace_ring && trace_ring->wants(FETCH));
+  auto trace_flag = traced ? TLB_CHECK_TRACER : 0;
   auto mmio_flag = host_addr ? 0 : TLB_MMIO;
+  // Without a hart (the debug MMU), every store counts as an external write
+  bool code = type == STORE && (!proc || code_pages.count(base_paddr / PGSIZE));
+  auto code_flag = code ? TLB_CODE : 0;
 
+  std::vector<dtlb_entry_t>* tlb;
+  bool check_triggers;
   switch (type) {
     case FETCH:
-      tlb_insn[idx].data = entry;
-      tlb_insn[idx].tag = expected_tag | (check_triggers_fetch ? TLB_CHECK_TRIGGERS : 0) | trace_flag | mmio_flag;
+      tlb = &tlb_insn;
+      check_triggers = check_triggers_fetch && page_may_trigger(triggers::OPERATION_EXECUTE, vaddr);
       break;
     case LOAD:
-      tlb_load[idx].data = entry;
-      tlb_load[idx].tag = expected_tag | (check_triggers_load ? TLB_CHECK_TRIGGERS : 0) | trace_flag | mmio_flag;
+      tlb = &data_tlb(LOAD, xlate_flags);
+      check_triggers = check_triggers_load && page_may_trigger(triggers::OPERATION_LOAD, vaddr);
       break;
     case STORE:
-      tlb_store[idx].data = entry;
-      tlb_store[idx].tag = expected_tag | (check_triggers_store ? TLB_CHECK_TRIGGERS : 0) | trace_flag | mmio_flag;
+      tlb = &data_tlb(STORE, xlate_flags);
+      check_triggers = check_triggers_store && page_may_trigger(triggers::OPERATION_STORE, vaddr);
       break;
-    default:
-      abort();
+    default: abort();
+  }
+
+  // Insert at way 0, shifting the set down over either a stale entry for
+  // this page or the least recently filled way.
+  dtlb_entry_t* set = &(*tlb)[(expected_tag & tlb_set_mask) * tlb_ways];
+  size_t victim = tlb_ways - 1;
+  for (size_t way = 0; way < victim; way++) {
+    if ((set[way].tag & ~(TLB_FLAGS | TLB_PMP_SPLIT)) == expected_tag) {
+      victim = way;
+      break;
+    }
   }
+  std::copy_backward(set, set + victim, set + victim + 1);
+  set[0].data = entry;
+  set[0].tag = expected_tag | (check_triggers ? TLB_CHECK_TRIGGERS : 0) | trace_flag | mmio_flag | code_flag | split_flag;
+  set[0].pmp_blocks = pmp_blocks;
 
   return entry;
 }
 
-bool mmu_t::pmp_ok(reg_t addr, reg_t len, access_type type, reg_t mode, bool hlvx)
+std::tuple<bool, uintptr_t, reg_t> mmu_t::access_split_tlb(const std::vector<dtlb_entry_t>& tlb, reg_t vaddr, reg_t len, reg_t allowed_flags)
 {
-  if (!proc || proc->n_pmp == 0)
-    return true;
-
-  for (size_t i = 0; i < proc->n_pmp; i++) {
-    // Check each 4-byte sector of the access
-    bool any_match = false;
-    bool all_match = true;
-    for (reg_t offset = 0; offset < len; offset += 1 << PMP_SHIFT) {
-      reg_t cur_addr = addr + offset;
-      bool match = proc->state.pmpaddr[i]->match4(cur_addr);
-      any_match |= match;
-      all_match &= match;
-    }
+  auto res = access_tlb(tlb, vaddr, allowed_flags);
+  if (std::get<0>(res))
+    return res;
+
+  auto vpn = vaddr / PGSIZE, pgoff = vaddr % PGSIZE;
+  auto tag_mask = ~(allowed_flags | TLB_PMP_SPLIT), want = vpn;
+  auto set = &tlb[(vpn & tlb_set_mask) * tlb_ways];
+  for (size_t way = 0; way < tlb_ways; way++) {
+    const dtlb_entry_t& entry = set[way];
+    if ((entry.tag & tag_mask) != want || !(entry.tag & TLB_PMP_SPLIT))
+      continue;
+
+    reg_t first = pgoff >> PMP_BLOCK_SHIFT;
+    reg_t last = (std::min(pgoff + len, PGSIZE) - 1) >> PMP_BLOCK_SHIFT;
+    uint64_t blocks = (~uint64_t(0) >> (63 - last)) & (~uint64_t(0) << first);
+    if ((entry.pmp_blocks & blocks) != blocks)
+      break;
 
-    if (any_match) {
-      // If the PMP matches only a strict subset of the access, fail it
-      if (!all_match)
-        return false;
+#ifdef RISCV_ENABLE_TLB_HIT_STATS
+    stats.tlb_hits++;
+#endif
+    bool mmio = allowed_flags & TLB_MMIO & entry.tag;
+    return std::make_tuple(true, mmio ? 0 : entry.data.host_addr + pgoff, entry.data.target_addr + pgoff);
+  }
+  return res;
+}
 
-      return proc->state.pmpaddr[i]->access_ok(type, mode, hlvx);
-    }
+uint64_t mmu_t::pmp_page_blocks(reg_t paddr, access_type type)
+{
+  static_assert(PGSIZE >> PMP_BLOCK_SHIFT == 64, "one bit per block");
+
+  // A block no PMP entry splits is allowed or not as a whole; the TLB is
+  // flushed on a privilege change, so the current one is what counts.
+  uint64_t blocks = 0;
+  for (reg_t i = 0; i < PGSIZE >> PMP_BLOCK_SHIFT; i++) {
+    reg_t addr = paddr + (i << PMP_BLOCK_SHIFT);
+    if (pmp_homogeneous(addr, reg_t(1) << PMP_BLOCK_SHIFT) &&
+        pmp_ok(addr, 1 << PMP_SHIFT, type, proc->state.prv, false))
+      blocks |= uint64_t(1) << i;
   }
+  return blocks;
+}
+
+bool mmu_t::pmp_ok(reg_t addr, reg_t len, access_type type, reg_t mode, bool hlvx)
+{
+  if (!proc || proc->n_pmp == 0)
+    return true;
 
-  // in case matching region is not found
-  const bool mseccfg_mml = proc->state.mseccfg->get_mml();
-  const bool mseccfg_mmwp = proc->state.mseccfg->get_mmwp();
-  return ((mode == PRV_M) && !mseccfg_mmwp
-          && (!mseccfg_mml || ((type == LOAD) || (type == STORE))));
+  return pmp_table.access_ok(addr, len, type, mode, hlvx);
 }
 
 reg_t mmu_t::pmp_homogeneous(reg_t addr, reg_t len)
@@ -457,14 +1148,46 @@ reg_t mmu_t::pmp_homogeneous(reg_t addr, reg_t len)
   if ((addr | len) & (len - 1))
     abort();
 
-  if (!proc)
+  if (!proc || proc->n_pmp == 0)
     return true;
 
-  for (size_t i = 0; i < proc->n_pmp; i++)
-    if (proc->state.pmpaddr[i]->subset_match(addr, len))
-      return false;
+  return pmp_table.homogeneous(addr, len);
+}
 
-  return true;
+void mmu_t::pmp_changed()
+{
+  pmp_table_t old = pmp_table;
+  pmp_table.build(proc);
+
+  std::vector<std::pair<reg_t, reg_t>> changed;
+  pmp_table.diff(old, &changed);
+  if (changed.empty())
+    return;
+
+  // TLB entries are dropped only for the pages whose checks changed; the
+  // walk caches skip PTE checks, and the instruction caches fetch checks,
+  // so those are flushed whole.
+  for (auto tlb : {&tlb_insn, &tlb_load, &tlb_store, &tlb_ss_load, &tlb_ss_store, &tlb_guest_load, &tlb_guest_store}) {
+    for (auto& e : *tlb) {
+      if (e.tag == reg_t(-1))
+        continue;
+      reg_t first = e.data.target_addr, last = first + PGSIZE - 1;
+      for (auto& c : changed) {
+        if (first <= c.second && c.first <= last) {
+          e.tag = -1;
+          break;
+        }
+      }
+    }
+  }
+  for (auto& e : ptw_cache)
+    e.level = -1;
+  for (auto& tlb : superpage_tlb)
+    for (auto& e : tlb)
+      e.valid = false;
+  flush_gstage();
+
+  flush_icache();
 }
 
 reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_type, bool virt, bool hlvx, bool is_for_vs_pt_addr)
@@ -472,7 +1195,8 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
   if (!virt)
     return gpa;
 
-  vm_info vm = decode_vm_info(proc->get_const_xlen(), true, 0, proc->get_state()->hgatp->read());
+  reg_t hgatp = proc->get_state()->hgatp->read();
+  vm_info vm = decode_vm_info(proc->get_const_xlen(), true, 0, hgatp);
   if (vm.levels == 0)
     return gpa;
 
@@ -480,6 +1204,17 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
   reg_t maxgpa = (1ULL << maxgpabits) - 1;
 
   bool mxr = !is_for_vs_pt_addr && (proc->state.sstatus->readvirt(false) & MSTATUS_MXR);
+
+  // Only successful translations are cached, so hits have their A and D
+  // bits set already; faults are always found by a walk.
+  reg_t gpn = gpa >> PGSHIFT;
+  unsigned kind = type | (hlvx << 2) | (mxr << 3);
+  gstage_entry_t& cached = gstage_cache_slot(gpn, kind);
+  if (cached.valid && cached.gpn == gpn && cached.kind == kind && cached.hgatp == hgatp) {
+    stats.gstage_hits++;
+    return (cached.hpn << PGSHIFT) | (gpa & (PGSIZE - 1));
+  }
+  stats.gstage_walks++;
   // tinst is set to 0x3000/0x3020 - for RV64 read/write respectively for
   // VS-stage address translation (for spike HSXLEN == VSXLEN always) else
   // tinst is set to 0x2000/0x2020 - for RV32 read/write respectively for
@@ -499,6 +1234,7 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
       // check that physical address of PTE is legal
       auto pte_paddr = base + idx * vm.ptesize;
       reg_t pte = pte_load(pte_paddr, gva, virt, trap_type, vm.ptesize);
+      stats.gstage_pte_loads++;
       reg_t ppn = (pte & ~reg_t(PTE_ATTR)) >> PTE_PPN_SHIFT;
       bool pbmte = proc->get_state()->menvcfg->read() & MENVCFG_PBMTE;
       bool hade = proc->get_state()->menvcfg->read() & MENVCFG_ADUE;
@@ -532,12 +1268,13 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
         reg_t ad = PTE_A | ((type == STORE) * PTE_D);
 
         if ((pte & ad) != ad) {
-          if (hade) {
-            // set accessed and possibly dirty bits
-            pte_store(pte_paddr, pte | ad, gva, virt, trap_type, vm.ptesize);
-          } else {
+          if (!hade) {
             // take exception if access or possibly dirty bit is not set.
             break;
+          } else if (!probing) {
+            // set accessed and possibly dirty bits; a probe leaves them to
+            // the access
+            pte_store(pte_paddr, pte | ad, gva, virt, trap_type, vm.ptesize);
           }
         }
 
@@ -547,6 +1284,8 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
         reg_t page_base = ((ppn & ~((reg_t(1) << napot_bits) - 1))
                           | (vpn & ((reg_t(1) << napot_bits) - 1))
                           | (vpn & ((reg_t(1) << ptshift) - 1))) << PGSHIFT;
+        if (!probing)
+          cached = {hgatp, gpn, page_base >> PGSHIFT, kind, true};
         return page_base | (gpa & page_mask);
       }
     }
@@ -560,6 +1299,25 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
   }
 }
 
+bool mmu_t::lookup_superpage(const mem_access_info_t& access_info, reg_t* paddr)
+{
+  if (!superpage_cacheable(access_info))
+    return false;
+
+  reg_t addr = access_info.transformed_vaddr;
+  reg_t satp = proc->get_state()->satp->readvirt(false);
+  reg_t status = superpage_status();
+  for (auto& e : superpage_tlb[access_info.type]) {
+    if (e.valid && (addr & ~e.mask) == e.vbase && e.satp == satp &&
+        e.priv == access_info.effective_priv && e.status == status) {
+      *paddr = e.pbase | (addr & e.mask);
+      stats.superpage_hits++;
+      return true;
+    }
+  }
+  return false;
+}
+
 reg_t mmu_t::walk(mem_access_info_t access_info)
 {
   access_type type = access_info.type;
@@ -593,8 +1351,27 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
   if (masked_msbs != 0 && masked_msbs != mask)
     vm.levels = 0;
 
+  stats.walks++;
+
+  // Resume from the deepest table a previous walk reached through the same
+  // upper-level PTEs. Those were valid non-leaf entries, whose checks do not
+  // depend on the access, so only the remaining levels need to be read.
+  reg_t hgatp = virt ? proc->get_state()->hgatp->read() : 0;
   reg_t base = vm.ptbase;
-  for (int i = vm.levels - 1; i >= 0; i--) {
+  int start = vm.levels - 1;
+  for (int level = 0; level < vm.levels - 1; level++) {
+    reg_t vpn_prefix = addr >> (PGSHIFT + (level + 1) * vm.idxbits);
+    const ptw_cache_entry_t& e = ptw_cache_slot(vpn_prefix, level);
+    if (e.level == level && e.vpn_prefix == vpn_prefix && e.satp == satp &&
+        e.virt == virt && e.hgatp == hgatp) {
+      base = e.base;
+      start = level;
+      stats.walk_cache_hits++;
+      break;
+    }
+  }
+
+  for (int i = start; i >= 0; i--) {
     int ptshift = i * vm.idxbits;
     reg_t idx = (addr >> (PGSHIFT + ptshift)) & ((1 << vm.idxbits) - 1);
 
@@ -620,6 +1397,10 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
       if (pte & (PTE_D | PTE_A | PTE_U | PTE_N | PTE_PBMT))
         break;
       base = ppn << PGSHIFT;
+      if (i > 0) {
+        reg_t vpn_prefix = addr >> (PGSHIFT + ptshift);
+        ptw_cache_slot(vpn_prefix, i - 1) = {satp, hgatp, vpn_prefix, base, i - 1, virt};
+      }
     } else if ((pte & PTE_U) ? s_mode && (type == FETCH || !sum) : !s_mode) {
       break;
     } else if (!(pte & PTE_V) ||
@@ -649,15 +1430,16 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
       reg_t ad = PTE_A | ((type == STORE) * PTE_D);
 
       if ((pte & ad) != ad) {
-        if (hade) {
+        if (!hade) {
+          // take exception if access or possibly dirty bit is not set.
+          break;
+        } else if (!probing) {
           // Check for write permission to the first-stage PT in second-stage
           // PTE and set the D bit in the second-stage PTE if needed
           s2xlate(addr, base + idx * vm.ptesize, STORE, type, virt, false, true);
-          // set accessed and possibly dirty bits.
+          // set accessed and possibly dirty bits; a probe leaves them to
+          // the access
           pte_store(pte_paddr, pte | ad, addr, virt, type, vm.ptesize);
-        } else {
-          // take exception if access or possibly dirty bit is not set.
-          break;
         }
       }
 
@@ -668,6 +1450,20 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
                         | (vpn & ((reg_t(1) << napot_bits) - 1))
                         | (vpn & ((reg_t(1) << ptshift) - 1))) << PGSHIFT;
       reg_t phys = page_base | (addr & page_mask);
+
+      if ((ptshift || napot_bits) && !probing) {
+        reg_t leaf_mask = (reg_t(1) << (PGSHIFT + ptshift + napot_bits)) - 1;
+        note_superpage_fill(addr & ~leaf_mask, leaf_mask);
+      }
+
+      if (ptshift && !napot_bits && superpage_cacheable(access_info) && !probing) {
+        reg_t offset_mask = (reg_t(1) << (PGSHIFT + ptshift)) - 1;
+        size_t& victim = superpage_victim[type];
+        superpage_tlb[type][victim] = {satp, mode, superpage_status(),
+                                       addr & ~offset_mask, ppn << PGSHIFT, offset_mask, true};
+        victim = (victim + 1) % SUPERPAGE_ENTRIES;
+      }
+
       return s2xlate(addr, phys, type, type, virt, hlvx, false) & ~page_mask;
     }
   }
@@ -680,12 +1476,89 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
   }
 }
 
+bool mmu_t::probe(access_type type, reg_t vaddr, reg_t len, uint8_t* bytes)
+{
+  const auto& tlb = type == FETCH ? tlb_insn : tlb_load;
+  while (len > 0) {
+    reg_t n = std::min(len, PGSIZE - vaddr % PGSIZE);
+    auto [tlb_hit, host_addr, _] = access_tlb(tlb, vaddr, TLB_CHECK_TRIGGERS | TLB_CHECK_TRACER);
+    char* host = (char*)host_addr;
+    if (!tlb_hit) {
+      probing = true;
+      try {
+        reg_t paddr = translate(generate_access_info(vaddr, type, {}), n);
+        host = sim->addr_to_mem(paddr);
+      } catch (trap_t&) {
+        host = nullptr;
+      }
+      probing = false;
+    }
+    if (!host)
+      return false;
+
+    memcpy(bytes, host, n);
+    vaddr += n;
+    bytes += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool mmu_t::probe_insn(reg_t pc, insn_bits_t* insn)
+{
+  // parcel by parcel, as a fetch would, so a short instruction at the end
+  // of a page does not need the next
+  insn_bits_t bits = 0;
+  for (int i = 0; i == 0 || i < insn_length(bits); i += 2) {
+    target_endian<uint16_t> parcel;
+    if (!probe(FETCH, pc + i, 2, (uint8_t*)&parcel))
+      return false;
+    bits |= (insn_bits_t)from_target(parcel) << (8 * i);
+  }
+  *insn = bits;
+  return true;
+}
+
 void mmu_t::register_memtracer(memtracer_t* t)
 {
   flush_tlb();
   tracer.hook(t);
 }
 
+void mmu_t::set_observer(mmu_observer_t* o)
+{
+  observer = o;
+  flush_tlb();
+  flush_icache();
+}
+
+void mmu_t::register_async_memtracer(async_memtracer_t* t)
+{
+  if (trace_ring)
+    throw std::runtime_error("mmu_t: only one async memtracer can be registered");
+  flush_tlb();
+  trace_ring = t->attach();
+}
+
+void mmu_t::track_stores(reg_t line_size)
+{
+  if (line_size & (line_size - 1) || line_size > PGSIZE)
+    throw std::runtime_error("mmu_t: store tracking line size must be a power of 2 up to the page size");
+  store_set.reset(line_size ? new store_set_t(line_size) : nullptr);
+}
+
+void mmu_t::take_stores(std::vector<reg_t>& lines)
+{
+  if (store_set)
+    store_set->take(lines);
+}
+
+void mmu_t::take_store_pages(std::vector<reg_t>& pages)
+{
+  if (store_set)
+    store_set->take_pages(pages);
+}
+
 reg_t mmu_t::get_pmlen(bool effective_virt, reg_t effective_priv, xlate_flags_t flags) const {
   if (!proc || proc->get_xlen() != 64 || flags.hlvx)
     return 0;
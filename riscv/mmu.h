@@ -9,10 +9,16 @@
 #include "simif.h"
 #include "processor.h"
 #include "memtracer.h"
+#include "async_memtracer.h"
 #include "../fesvr/byteorder.h"
 #include "triggers.h"
 #include "cfg.h"
+#include "pmp_table.h"
+#include "store_set.h"
 #include <stdlib.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 // virtual memory configuration
@@ -21,9 +27,11 @@ const reg_t PGSIZE = 1 << PGSHIFT;
 
 // observability hooks for load, store and fetch
 // intentionally empty not to cause runtime overhead
-// can be redefined if needed 
+// can be redefined if needed; mmu_observer_t does the same at run time
 #ifndef MMU_OBSERVE_FETCH
 #define MMU_OBSERVE_FETCH(addr, insn, length)
+#else
+#define MMU_OBSERVE_FETCH_HOOKED
 #endif
 
 #ifndef MMU_OBSERVE_LOAD
@@ -32,8 +40,31 @@ const reg_t PGSIZE = 1 << PGSHIFT;
 
 #ifndef MMU_OBSERVE_STORE
 #define MMU_OBSERVE_STORE(addr, data, length)
+#else
+#define MMU_OBSERVE_STORE_HOOKED
 #endif
 
+// Sees every access of one hart, attached with mmu_t::set_observer while
+// the build stays the same. Addresses are virtual, and the bytes are as
+// they are in target memory (target byte order), len of them. Only
+// accesses that complete are reported: loads once read and stores once
+// written, each access once (AMOs as a load then a store), and a fetch per
+// instruction the hart fetches to execute, with its bits.
+//
+// mmu_t has no observer by default, and its TLB refills then work as if
+// this did not exist. With one, data pages are no longer entered in the
+// TLB, so loads and stores take the slow paths where the observer is
+// called, and instructions are fetched without the instruction cache's
+// reuse and run one at a time. That costs about what --log-commits does.
+class mmu_observer_t
+{
+ public:
+  virtual ~mmu_observer_t() = default;
+  virtual void fetch(reg_t UNUSED addr, insn_bits_t UNUSED insn, reg_t UNUSED len) {}
+  virtual void load(reg_t UNUSED addr, const uint8_t UNUSED *bytes, reg_t UNUSED len) {}
+  virtual void store(reg_t UNUSED addr, const uint8_t UNUSED *bytes, reg_t UNUSED len) {}
+};
+
 struct insn_fetch_t
 {
   insn_func_t func;
@@ -46,6 +77,24 @@ struct icache_entry_t {
   insn_fetch_t data;
 };
 
+// A straight-line run of decoded instructions, executed by the fast loop
+// without a lookup per instruction. It ends at a jump, and after anything
+// that may flush the icache or change how the following bytes decode.
+struct insn_block_t {
+  static const size_t MAX_INSNS = 16;
+  // entries after which a block links to its successors
+  static const uint32_t HOT_THRESHOLD = 64;
+  reg_t pc;                       // -1 if invalid
+  uint32_t execs;                 // entries since filled, up to HOT_THRESHOLD
+  insn_block_t* succ;             // last block entered from a hot block
+  uint64_t exits[MAX_INSNS];      // times left after each instruction, for profiling
+  reg_t start;                    // pc of insns[0], kept when the block is flushed
+  reg_t prv;                      // privilege it was filled in (a change flushes)
+  size_t n;
+  reg_t next_pc[MAX_INSNS];       // fall-through pc of each instruction
+  insn_fetch_t insns[MAX_INSNS];
+};
+
 struct tlb_entry_t {
   uintptr_t host_addr;
   reg_t target_addr;
@@ -54,6 +103,65 @@ struct tlb_entry_t {
 struct dtlb_entry_t {
   tlb_entry_t data;
   reg_t tag;
+  uint64_t pmp_blocks;  // with TLB_PMP_SPLIT, the 64-byte blocks PMP allows
+};
+
+// A non-leaf PTE remembered by the page-table walk: walks of the same
+// address space that share vpn_prefix resume at the table at base.
+struct ptw_cache_entry_t {
+  reg_t satp;         // root, mode and ASID of the first stage
+  reg_t hgatp;        // G-stage root if virt, else 0
+  reg_t vpn_prefix;   // VPN bits above level
+  reg_t base;         // (guest-)physical address of the level table
+  int level;          // -1 if invalid
+  bool virt;
+};
+
+// A megapage or gigapage translation kept whole, so that its 4 KiB pages
+// refill the TLB without a walk.
+struct superpage_entry_t {
+  reg_t satp;
+  reg_t priv;         // effective privilege the permissions were checked at
+  reg_t status;       // sstatus SUM and MXR at that time
+  reg_t vbase;        // vaddr & ~mask
+  reg_t pbase;
+  reg_t mask;         // offset bits within the superpage
+  bool valid;
+};
+
+// A G-stage translation remembered for the access kind it was checked for.
+struct gstage_entry_t {
+  reg_t hgatp;        // root, mode and VMID
+  reg_t gpn;          // guest-physical page
+  reg_t hpn;          // host-physical page
+  unsigned kind;      // access type, HLVX and MXR
+  bool valid;
+};
+
+// Cumulative MMU counters, cleared by mmu_t::clear_stats.
+struct mmu_stats_t {
+  uint64_t tlb_hits = 0;      // TLB lookups that hit (--enable-tlb-hit-stats)
+  uint64_t tlb_misses = 0;    // TLB refills after a failed lookup
+  uint64_t tlb_misses_fetch = 0;  // ... of which for fetches
+  uint64_t tlb_misses_load = 0;   // ... for loads
+  uint64_t tlb_misses_store = 0;  // ... for stores and AMOs
+  uint64_t walks = 0;         // first-stage page-table walks
+  uint64_t walk_cache_hits = 0; // walks resumed below the root
+  uint64_t superpage_hits = 0;  // TLB refills served without a walk
+  uint64_t icache_hits = 0;     // fast-path fetches served by the icache (--enable-icache-stats)
+  uint64_t icache_refills = 0;  // icache lookups that had to decode (--enable-icache-stats)
+  uint64_t block_links = 0;     // blocks entered through a hot predecessor
+  uint64_t gstage_walks = 0;    // G-stage walks, from VS-stage walks and guest accesses
+  uint64_t gstage_hits = 0;     // G-stage translations served by the G-stage cache
+  uint64_t gstage_pte_loads = 0;  // PTEs read by G-stage walks
+  // Loads and stores that went down the slow path, by the first reason
+  uint64_t slow_tlb_miss = 0;     // no TLB entry for the page
+  uint64_t slow_misaligned = 0;   // misaligned across a page, or trapping
+  uint64_t slow_flagged = 0;      // page marked for MMIO, a tracer, triggers or code
+  uint64_t slow_special = 0;      // H-mode, LR, shadow-stack or CMO access
+  uint64_t mmio_loads = 0;        // device accesses, counted before splitting
+  uint64_t mmio_stores = 0;
+  uint64_t mmio_fetches = 0;
 };
 
 struct xlate_flags_t {
@@ -66,6 +174,13 @@ struct xlate_flags_t {
   bool is_special_access() const {
     return forced_virt || hlvx || lr || ss_access || clean_inval;
   }
+
+  // Whether the translation may come from a TLB: LR shares the load TLB,
+  // shadow-stack and guest accesses have their own; HLVX and CBO accesses
+  // are always translated.
+  bool tlb_cached() const {
+    return !hlvx && !clean_inval;
+  }
 };
 
 struct mem_access_info_t {
@@ -95,10 +210,16 @@ public:
   T ALWAYS_INLINE load(reg_t addr, xlate_flags_t xlate_flags = {}) {
     target_endian<T> res;
     bool aligned = (addr & (sizeof(T) - 1)) == 0;
-    auto [tlb_hit, host_addr, _] = access_tlb(tlb_load, addr);
-
-    if (likely(!xlate_flags.is_special_access() && aligned && tlb_hit)) {
-      res = *(target_endian<T>*)host_addr;
+    auto [tlb_hit, host_addr, paddr] = access_tlb(data_tlb(LOAD, xlate_flags), addr);
+
+    if (likely(xlate_flags.tlb_cached() && tlb_hit &&
+               (aligned || (!xlate_flags.is_special_access() && misaligned_in_page(addr, sizeof(T)))))) {
+      memcpy(&res, (const void*)host_addr, sizeof(T));
+      // the TLB only holds plain memory, which is reservable
+      if (xlate_flags.lr)
+        load_reservation_address = paddr;
+      if (unlikely(trace_ring != nullptr))
+        trace_ring->trace(paddr, sizeof(T), LOAD);
     } else {
       load_slow_path(addr, sizeof(T), (uint8_t*)&res, xlate_flags);
     }
@@ -110,7 +231,9 @@ public:
 
   template<typename T>
   T load_reserved(reg_t addr) {
-    return load<T>(addr, {.lr = true});
+    T res = load<T>(addr, {.lr = true});
+    load_reservation_value = (uint64_t)res;
+    return res;
   }
 
   template<typename T>
@@ -135,10 +258,16 @@ public:
   void ALWAYS_INLINE store(reg_t addr, T val, xlate_flags_t xlate_flags = {}) {
     MMU_OBSERVE_STORE(addr, val, sizeof(T));
     bool aligned = (addr & (sizeof(T) - 1)) == 0;
-    auto [tlb_hit, host_addr, _] = access_tlb(tlb_store, addr);
+    auto [tlb_hit, host_addr, paddr] = access_tlb(data_tlb(STORE, xlate_flags), addr);
 
-    if (!xlate_flags.is_special_access() && likely(aligned && tlb_hit)) {
-      *(target_endian<T>*)host_addr = to_target(val);
+    if (xlate_flags.tlb_cached() && likely(tlb_hit) &&
+        likely(aligned || (!xlate_flags.is_special_access() && misaligned_in_page(addr, sizeof(T))))) {
+      target_endian<T> target_val = to_target(val);
+      memcpy((void*)host_addr, &target_val, sizeof(T));
+      if (unlikely(trace_ring != nullptr))
+        trace_ring->trace(paddr, sizeof(T), STORE);
+      if (unlikely(store_set != nullptr))
+        store_set->add(paddr, sizeof(T));
     } else {
       target_endian<T> target_val = to_target(val);
       store_slow_path(addr, sizeof(T), (const uint8_t*)&target_val, xlate_flags, true, false);
@@ -174,8 +303,40 @@ public:
     }
 
   // template for functions that perform an atomic memory operation
+  // The host location of an aligned AMO at addr that both the load and
+  // the store TLB let through without checks, or nullptr if the AMO must
+  // take the slow paths.
+  template<typename T>
+  target_endian<T>* ALWAYS_INLINE amo_host_addr(reg_t addr) {
+    if (addr & (sizeof(T) - 1))
+      return nullptr;
+    auto [store_hit, host_addr, paddr] = access_tlb(tlb_store, addr);
+    if (!store_hit)
+      return nullptr;
+    // load triggers and tracers are recorded against the load entry
+    auto [load_hit, load_host_addr, _] = access_tlb(tlb_load, addr);
+    if (!load_hit || load_host_addr != host_addr)
+      return nullptr;
+    if (unlikely(trace_ring != nullptr)) {
+      trace_ring->trace(paddr, sizeof(T), LOAD);
+      trace_ring->trace(paddr, sizeof(T), STORE);
+    }
+    if (unlikely(store_set != nullptr))
+      store_set->add(paddr, sizeof(T));
+    return (target_endian<T>*)host_addr;
+  }
+
   template<typename T, typename op>
   T amo(reg_t addr, op f) {
+    auto guard = shared_memory_guard();
+    if (auto host = amo_host_addr<T>(addr); likely(host != nullptr)) {
+      T lhs = from_target(*host);
+      MMU_OBSERVE_LOAD(addr, lhs, sizeof(T));
+      T rhs = f(lhs);
+      MMU_OBSERVE_STORE(addr, rhs, sizeof(T));
+      *host = to_target(rhs);
+      return lhs;
+    }
     convert_load_traps_to_store_traps({
       store_slow_path(addr, sizeof(T), nullptr, {}, false, true);
       auto lhs = load<T>(addr);
@@ -187,6 +348,7 @@ public:
   // for shadow stack amoswap
   template<typename T>
   T ssamoswap(reg_t addr, reg_t value) {
+      auto guard = shared_memory_guard();
       bool forced_virt = false;
       bool hlvx = false;
       bool lr = false;
@@ -199,6 +361,16 @@ public:
 
   template<typename T>
   T amo_compare_and_swap(reg_t addr, T comp, T swap) {
+    auto guard = shared_memory_guard();
+    if (auto host = amo_host_addr<T>(addr); likely(host != nullptr)) {
+      T lhs = from_target(*host);
+      MMU_OBSERVE_LOAD(addr, lhs, sizeof(T));
+      if (lhs == comp) {
+        MMU_OBSERVE_STORE(addr, swap, sizeof(T));
+        *host = to_target(swap);
+      }
+      return lhs;
+    }
     convert_load_traps_to_store_traps({
       store_slow_path(addr, sizeof(T), nullptr, {}, false, true);
       auto lhs = load<T>(addr);
@@ -230,11 +402,37 @@ public:
     return res;
   }
 
+  // Copies the len bytes at addr in one memcpy per page, for unit-stride
+  // vector accesses, if each page is in the TLB for plain accesses (no
+  // triggers, tracing, MMIO or commit logging) and the target is
+  // little-endian. Returns false at the first page that is not; the pages
+  // before it may already have been copied, so the caller redoes the whole
+  // access element by element.
+  bool load_bulk(reg_t addr, reg_t len, uint8_t* bytes);
+  bool store_bulk(reg_t addr, reg_t len, const uint8_t* bytes);
+  // As load_bulk and store_bulk, for the count runs of size bytes at addr,
+  // addr + stride, ..., packed together in bytes: for strided and segment
+  // vector accesses, each page being looked up once per run of runs on it
+  bool load_strided(reg_t addr, reg_t stride, reg_t count, reg_t size, uint8_t* bytes);
+  bool store_strided(reg_t addr, reg_t stride, reg_t count, reg_t size, const uint8_t* bytes);
+
   void cbo_zero(reg_t addr) {
     auto access_info = generate_access_info(addr, STORE, {});
     reg_t transformed_addr = access_info.transformed_vaddr;
 
     auto base = transformed_addr & ~(blocksz - 1);
+#ifndef MMU_OBSERVE_STORE_HOOKED
+    // A store TLB entry without flags has no triggers, tracer or code to
+    // tell about the block, which it holds whole.
+    auto [tlb_hit, host_addr, paddr] = access_tlb(tlb_store, base);
+    if (likely(tlb_hit && !(trace_ring && trace_ring->wants(STORE)))) {
+      memset((void*)host_addr, 0, blocksz);
+      if (unlikely(store_set != nullptr))
+        store_set->add(paddr, blocksz);
+      return;
+    }
+#endif
+
     for (size_t offset = 0; offset < blocksz; offset += 1) {
       check_triggers(triggers::OPERATION_STORE, base + offset, false, transformed_addr, std::nullopt);
       store<uint8_t>(base + offset, 0);
@@ -253,15 +451,23 @@ public:
       if (sim->reservable(paddr)) {
         if (tracer.interested_in_range(paddr, paddr + PGSIZE, LOAD))
           tracer.clean_invalidate(paddr, blocksz, clean, inval);
+        if (trace_ring)
+          trace_ring->clean_invalidate(paddr, blocksz, clean, inval);
       } else {
         throw trap_store_access_fault((proc) ? proc->state.v : false, transformed_addr, 0, 0);
       }
     })
   }
 
+  // Set while harts run concurrently on separate host threads: atomics,
+  // store-conditionals and MMIO are then serialised across all harts.
+  void set_shared_memory(bool shared) { shared_memory = shared; }
+
   inline void yield_load_reservation()
   {
-    load_reservation_address = (reg_t)-1;
+    // called for every hart every quantum; most hold no reservation
+    if (load_reservation_address != (reg_t)-1)
+      load_reservation_address = (reg_t)-1;
   }
 
   inline bool check_load_reservation(reg_t vaddr, size_t size)
@@ -271,7 +477,10 @@ public:
       store_slow_path(vaddr, size, nullptr, {}, false, true);
     }
 
-    reg_t paddr = translate(generate_access_info(vaddr, STORE, {}), 1);
+    // a store TLB entry means the translation would succeed
+    auto [tlb_hit, _, paddr] = access_tlb(tlb_store, vaddr, TLB_FLAGS);
+    if (!tlb_hit)
+      paddr = translate(generate_access_info(vaddr, STORE, {}), 1);
     if (sim->reservable(paddr))
       return load_reservation_address == paddr;
     else
@@ -281,8 +490,14 @@ public:
   template<typename T>
   bool store_conditional(reg_t addr, T val)
   {
+    auto guard = shared_memory_guard();
     bool have_reservation = check_load_reservation(addr, sizeof(T));
 
+    // Other harts' stores do not clear our reservation while they run
+    // concurrently, so also require the reserved value to be unchanged.
+    if (have_reservation && shared_memory)
+      have_reservation = (uint64_t)load<T>(addr) == load_reservation_value;
+
     if (have_reservation)
       store(addr, val);
 
@@ -291,11 +506,25 @@ public:
     return have_reservation;
   }
 
-  static const reg_t ICACHE_ENTRIES = 1024;
+  static const reg_t DEFAULT_ICACHE_ENTRIES = 1024;
 
   inline size_t icache_index(reg_t addr)
   {
-    return (addr / PC_ALIGN) % ICACHE_ENTRIES;
+    return (addr / PC_ALIGN) & icache_mask;
+  }
+
+  // Resizes the decoded-instruction cache to entries (a power of 2) and
+  // flushes it. It stays direct-mapped: each entry links to the one slot
+  // its successor can occupy, which is what the chained fast loop follows.
+  void configure_icache(size_t entries);
+  size_t get_icache_entries() const { return icache.size(); }
+  // Fast-loop instructions reached through an icache link or within a
+  // block, instead of by a lookup of their own
+  void count_icache_chain_hits(size_t n)
+  {
+#ifdef RISCV_ENABLE_ICACHE_STATS
+    stats.icache_hits += n;
+#endif
   }
 
   template<typename T>
@@ -329,29 +558,107 @@ public:
     }
 
     insn_fetch_t fetch = {proc->decode_insn(insn), insn};
-    entry->tag = addr;
+    entry->tag = unlikely(addr == proc->get_stop_pc() || proc->commit_log_covers(addr)) ? -1 : addr;
     entry->next = &icache[icache_index(addr + length)];
     entry->data = fetch;
 
-    auto [check_tracer, _, paddr] = access_tlb(tlb_insn, addr, TLB_FLAGS, TLB_CHECK_TRACER);
+    auto [check_tracer, _, paddr] = access_tlb(tlb_insn, addr, TLB_FLAGS | TLB_PMP_SPLIT, TLB_CHECK_TRACER);
     if (unlikely(check_tracer)) {
       if (tracer.interested_in_range(paddr, paddr + 1, FETCH)) {
         entry->tag = -1;
-        tracer.trace(paddr, paddr + length, FETCH);
+        tracer.trace(paddr, length, FETCH);
+      }
+      if (trace_ring && trace_ring->wants(FETCH)) {
+        entry->tag = -1;
+        trace_ring->trace(paddr, length, FETCH);
       }
     }
+    if (unlikely(observer != nullptr)) {
+      entry->tag = -1;
+      observer->fetch(addr, insn, length);
+    }
     MMU_OBSERVE_FETCH(addr, insn, length);
+    if (likely(entry->tag == addr) &&
+        unlikely(addr / PGSIZE != last_code_vpn || (addr + length - 1) / PGSIZE != last_code_vpn))
+      note_code(addr, length);
     return entry;
   }
 
+  // After a refill, decodes the straight-line run that follows entry into
+  // the slots it links to, so a cold run is followed by the chained fast
+  // loop rather than refilled one break at a time.
+  void prefill_icache(icache_entry_t* entry);
+
   inline icache_entry_t* access_icache(reg_t addr)
   {
     icache_entry_t* entry = &icache[icache_index(addr)];
     if (likely(entry->tag == addr)){
+#ifdef RISCV_ENABLE_ICACHE_STATS
+      stats.icache_hits++;
+#endif
       MMU_OBSERVE_FETCH(addr, entry->data.insn, insn_length(entry->data.insn.bits()));
       return entry;
     }
-    return refill_icache(addr, entry);
+#ifdef RISCV_ENABLE_ICACHE_STATS
+    stats.icache_refills++;
+#endif
+    refill_icache(addr, entry);
+    if (likely(entry->tag == addr))
+      prefill_icache(entry);
+    return entry;
+  }
+
+  // Resizes the block cache to entries blocks (a power of 2), or disables
+  // it with 0. Not available when MMU_OBSERVE_FETCH is hooked, since blocks
+  // are decoded ahead of execution.
+  void configure_block_cache(size_t entries);
+  bool block_cache_enabled() const { return !blocks.empty(); }
+  static const size_t DEFAULT_BLOCK_CACHE_ENTRIES = 4096;
+
+  // Profiles over the block cache, from the exit counts of each block.
+  // While enabled, the counts of blocks that are replaced or flushed are
+  // kept; take_block_counts adds the instructions retired so far keyed by
+  // block pc, take_pc_counts the retirements keyed by instruction pc, and
+  // both clear what they return. Instruction profiling instead hands the
+  // counts to processor_t::count_insns, which flush_block_counts forces.
+  void set_block_profiling(bool enable);
+  void take_block_counts(std::unordered_map<reg_t, uint64_t>& counts);
+  void set_pc_profiling(bool enable);
+  void take_pc_counts(std::unordered_map<reg_t, uint64_t>& counts);
+  void set_insn_profiling(bool enable);
+  void flush_block_counts();
+  // Whether a profile needs the exit counts of blocks kept
+  bool block_counts_enabled() const { return block_profiling || pc_profiling || insn_profiling; }
+
+  // Looks up the block at addr, entered from prev (or null). Hot blocks
+  // remember their last successor, which is then reused without a lookup.
+  inline insn_block_t* next_block(insn_block_t* prev, reg_t addr)
+  {
+    if (prev && prev->succ && prev->succ->pc == addr) {
+      stats.block_links++;
+      return prev->succ;
+    }
+    insn_block_t* block = access_block(addr);
+    if (block->execs < insn_block_t::HOT_THRESHOLD)
+      block->execs++;
+    else if (prev && prev->execs == insn_block_t::HOT_THRESHOLD)
+      prev->succ = block;
+    return block;
+  }
+
+  inline insn_block_t* access_block(reg_t addr)
+  {
+    insn_block_t* block = &blocks[(addr / PC_ALIGN) & block_mask];
+    if (likely(block->pc == addr)) {
+#ifdef RISCV_ENABLE_ICACHE_STATS
+      stats.icache_hits++;
+#endif
+      return block;
+    }
+#ifdef RISCV_ENABLE_ICACHE_STATS
+    stats.icache_refills++;
+#endif
+    return refill_block(addr, block);
   }
 
   inline insn_fetch_t load_insn(reg_t addr)
@@ -360,27 +667,101 @@ public:
     return refill_icache(addr, &entry)->data;
   }
 
-  std::tuple<bool, uintptr_t, reg_t> ALWAYS_INLINE access_tlb(const dtlb_entry_t* tlb, reg_t vaddr, reg_t allowed_flags = 0, reg_t required_flags = 0)
+  std::tuple<bool, uintptr_t, reg_t> ALWAYS_INLINE access_tlb(const std::vector<dtlb_entry_t>& tlb, reg_t vaddr, reg_t allowed_flags = 0, reg_t required_flags = 0)
   {
     auto vpn = vaddr / PGSIZE, pgoff = vaddr % PGSIZE;
-    auto& entry = tlb[vpn % TLB_ENTRIES];
-    auto hit = likely((entry.tag & (~allowed_flags | required_flags)) == (vpn | required_flags));
-    bool mmio = allowed_flags & TLB_MMIO & entry.tag;
-    auto host_addr = mmio ? 0 : entry.data.host_addr + pgoff;
-    auto paddr = entry.data.target_addr + pgoff;
+    auto tag_mask = ~allowed_flags | required_flags, want = vpn | required_flags;
+    // ways are kept most-recently-filled first, so way 0 usually hits
+    auto set = &tlb[(vpn & tlb_set_mask) * tlb_ways];
+    auto entry = set;
+    for (size_t way = 1; way < tlb_ways && (entry->tag & tag_mask) != want; way++)
+      entry = &set[way];
+    auto hit = likely((entry->tag & tag_mask) == want);
+#ifdef RISCV_ENABLE_TLB_HIT_STATS
+    stats.tlb_hits += hit;
+#endif
+    bool mmio = allowed_flags & TLB_MMIO & entry->tag;
+    auto host_addr = mmio ? 0 : entry->data.host_addr + pgoff;
+    auto paddr = entry->data.target_addr + pgoff;
     return std::make_tuple(hit, host_addr, paddr);
   }
 
   void flush_tlb();
+  // Drops the guest (HLV/HSV) translations only, after a change to what
+  // they depend on while not virtualised: hstatus.SPVP, vsstatus.SUM/MXR.
+  void flush_guest_tlb();
+  // Drops the G-stage translation cache, which otherwise survives TLB
+  // flushes: the G-stage does not depend on the privilege or satp. Needed
+  // after hgatp or G-stage page-table changes (hfence.gvma) and PMP or
+  // menvcfg.PBMTE changes.
+  void flush_gstage();
+  // sfence.vma: a fence for one address (vaddr set) or address space (asid
+  // set) drops only the translations it orders.
+  void sfence_vma(std::optional<reg_t> vaddr, std::optional<reg_t> asid);
+  // Rebuilds the PMP table after a pmpaddr, pmpcfg or mseccfg write, and
+  // drops the translations whose checks it changes.
+  void pmp_changed();
+  // Resizes the TLBs to entries translations each, in sets of ways; both
+  // must be powers of 2. Flushes the TLBs.
+  void configure_tlb(size_t entries, size_t ways);
+  size_t get_tlb_entries() const { return tlb_load.size(); }
+  // Host bytes of the TLBs and walk caches, and of the icache, block cache
+  // and code-page index, for footprint reports
+  size_t tlb_bytes() const;
+  size_t icache_bytes() const;
+  size_t get_tlb_ways() const { return tlb_ways; }
+  // Moves the TLBs, icache and block cache to fresh allocations made by
+  // the calling thread, so that first touch puts them on its NUMA node.
+  // Flushes them all.
+  void rehome();
+
+  const mmu_stats_t& get_stats() const { return stats; }
+  void clear_stats() { stats = mmu_stats_t(); }
   void flush_icache();
+  // fence.i: drops the decoded instructions that stores may have made
+  // stale. This MMU's own stores already dropped the ones they overwrote
+  // (see code_pages), so the icache is only flushed whole for writes it
+  // cannot see: by other harts, by the host or devices (external_writes),
+  // or to code fetched from a page it does not track.
+  void fence_i();
 
   void register_memtracer(memtracer_t*);
+  // Hands this MMU's accesses to t's consumer threads instead of tracing
+  // them inline; loads and stores then stay on the TLB fast path.
+  void register_async_memtracer(async_memtracer_t* t);
+  // Hands every fetch, load and store to observer, or stops with null
+  void set_observer(mmu_observer_t* observer);
+  mmu_observer_t* get_observer() const { return observer; }
+  // Reads len bytes at vaddr as a load by the hart would see them, for
+  // checking another model's loads, but without setting A/D bits, firing
+  // triggers or tracing. Returns false if the load would fault or any byte
+  // is not memory.
+  bool probe_load(reg_t vaddr, reg_t len, uint8_t* bytes) { return probe(LOAD, vaddr, len, bytes); }
+  // The same for the instruction at pc as the hart would fetch it, also
+  // leaving the TLB, icache and fetch observers alone; for reporting the
+  // instruction about to run
+  bool probe_insn(reg_t pc, insn_bits_t* insn);
+  // Starts recording which memory lines of line_size bytes this MMU writes
+  // (line_size 0 stops); take_stores returns them.
+  void track_stores(reg_t line_size);
+  // Appends the lines written since the last call and forgets them.
+  void take_stores(std::vector<reg_t>& lines);
+  // ... and the pages, independently of the lines
+  void take_store_pages(std::vector<reg_t>& pages);
 
   int is_misaligned_enabled()
   {
     return proc && proc->get_cfg().misaligned;
   }
 
+  // Whether a misaligned access of len bytes at addr is done as one from
+  // the page's TLB entry: misaligned accesses are enabled and it does not
+  // cross into the next page.
+  bool ALWAYS_INLINE misaligned_in_page(reg_t addr, reg_t len)
+  {
+    return (addr % PGSIZE) + len <= PGSIZE && is_misaligned_enabled();
+  }
+
   bool is_target_big_endian()
   {
     return target_big_endian;
@@ -400,26 +781,155 @@ private:
   simif_t* sim;
   processor_t* proc;
   memtracer_list_t tracer;
+  memtrace_ring_t* trace_ring;  // from register_async_memtracer, or null
+  mmu_observer_t* observer;
+  std::unique_ptr<store_set_t> store_set;  // from track_stores, or null
   reg_t load_reservation_address;
+  uint64_t load_reservation_value;
+  bool shared_memory;
+  bool probe(access_type type, reg_t vaddr, reg_t len, uint8_t* bytes);
+  bool probing;  // in probe: translate, faulting as the access would, without updating A/D bits
   reg_t blocksz;
 
+  static std::recursive_mutex& shared_memory_lock() {
+    static std::recursive_mutex lock;
+    return lock;
+  }
+  std::unique_lock<std::recursive_mutex> shared_memory_guard() {
+    if (likely(!shared_memory))
+      return std::unique_lock<std::recursive_mutex>();
+    return std::unique_lock<std::recursive_mutex>(shared_memory_lock());
+  }
+
   // implement an instruction cache for simulator performance
-  icache_entry_t icache[ICACHE_ENTRIES];
+  std::vector<icache_entry_t> icache;
+  reg_t icache_mask;
+
+  std::vector<insn_block_t> blocks;
+  reg_t block_mask;
+  insn_block_t* refill_block(reg_t addr, insn_block_t* block);
+  bool block_profiling;
+  bool pc_profiling;
+  bool insn_profiling;
+  std::unordered_map<reg_t, uint64_t> evicted_block_counts;
+  std::unordered_map<reg_t, uint64_t> evicted_pc_counts;
+  void evict_block_counts(insn_block_t& block);
+
+  // The physical pages the icache and blocks hold instructions from, with
+  // the virtual pages they were fetched at. Stores to them miss the inline
+  // TLB path on TLB_CODE and reach perform_intrapage_store, which drops the
+  // decoded instructions they overlap, so rewriting code costs in
+  // proportion to what was rewritten. Cleared by flush_icache.
+  static const size_t MAX_CODE_PAGES = 4096;
+  std::unordered_map<reg_t, std::vector<reg_t>> code_pages;
+  bool code_untracked;           // decoded from MMIO, or past MAX_CODE_PAGES
+  reg_t last_code_vpn;           // last page note_code saw, or -1
+  uint64_t external_writes_seen; // sim->external_writes at the last flush
+  void note_code(reg_t vaddr, reg_t len);
+  void invalidate_code(reg_t paddr, reg_t len);
+  void set_code_flag(reg_t ppn, bool code);
 
   // implement a TLB for simulator performance
-  static const reg_t TLB_ENTRIES = 256;
+  static const reg_t DEFAULT_TLB_ENTRIES = 256;
   // If a TLB tag has TLB_CHECK_TRIGGERS set, then the MMU must check for a
   // trigger match before completing an access.
   static const reg_t TLB_CHECK_TRIGGERS = reg_t(1) << 63;
   static const reg_t TLB_CHECK_TRACER = reg_t(1) << 62;
   static const reg_t TLB_MMIO = reg_t(1) << 61;
-  static const reg_t TLB_FLAGS = TLB_CHECK_TRIGGERS | TLB_CHECK_TRACER | TLB_MMIO;
-  dtlb_entry_t tlb_load[TLB_ENTRIES];
-  dtlb_entry_t tlb_store[TLB_ENTRIES];
-  dtlb_entry_t tlb_insn[TLB_ENTRIES];
+  // A store TLB entry for a page in code_pages
+  static const reg_t TLB_CODE = reg_t(1) << 59;
+  static const reg_t TLB_FLAGS = TLB_CHECK_TRIGGERS | TLB_CHECK_TRACER | TLB_MMIO | TLB_CODE;
+  // A page split by a PMP boundary is only used, from the slow path, for
+  // accesses within the blocks in pmp_blocks.
+  static const reg_t TLB_PMP_SPLIT = reg_t(1) << 60;
+  static const reg_t PMP_BLOCK_SHIFT = 6;
+  std::vector<dtlb_entry_t> tlb_load;
+  std::vector<dtlb_entry_t> tlb_store;
+  std::vector<dtlb_entry_t> tlb_insn;
+  // Shadow-stack and guest (HLV/HSV) translations, which are checked
+  // differently from the normal ones for the same page. Filled only for
+  // pages PMP allows whole, since they need not be checked at the current
+  // privilege.
+  std::vector<dtlb_entry_t> tlb_ss_load;
+  std::vector<dtlb_entry_t> tlb_ss_store;
+  std::vector<dtlb_entry_t> tlb_guest_load;
+  std::vector<dtlb_entry_t> tlb_guest_store;
+  reg_t tlb_set_mask;
+  size_t tlb_ways;
+
+  // partial-walk cache, flushed with the TLB
+  static const reg_t PTW_CACHE_ENTRIES = 256;
+  ptw_cache_entry_t ptw_cache[PTW_CACHE_ENTRIES];
+  ptw_cache_entry_t& ptw_cache_slot(reg_t vpn_prefix, int level)
+  {
+    return ptw_cache[(vpn_prefix ^ (vpn_prefix >> 9) ^ (reg_t(level) << 6)) % PTW_CACHE_ENTRIES];
+  }
+
+  // G-stage translations, direct-mapped
+  static const size_t GSTAGE_CACHE_ENTRIES = 256;
+  gstage_entry_t gstage_cache[GSTAGE_CACHE_ENTRIES];
+  gstage_entry_t& gstage_cache_slot(reg_t gpn, unsigned kind)
+  {
+    return gstage_cache[(gpn ^ (gpn >> 8) ^ (reg_t(kind) << 5)) % GSTAGE_CACHE_ENTRIES];
+  }
+
+  // superpage translations, one small fully-associative array per access
+  // type; flushed with the TLB
+  static const size_t SUPERPAGE_ENTRIES = 16;
+  superpage_entry_t superpage_tlb[FETCH + 1][SUPERPAGE_ENTRIES];
+  size_t superpage_victim[FETCH + 1];
+  bool superpage_cacheable(const mem_access_info_t& access_info) const
+  {
+    // the G stage may map a superpage with smaller pages; shadow-stack,
+    // HLVX and CBO accesses are checked differently
+    return !access_info.effective_virt && !access_info.flags.ss_access &&
+           !access_info.flags.hlvx && !access_info.flags.clean_inval;
+  }
+  reg_t superpage_status() const
+  {
+    return proc->get_state()->sstatus->readvirt(false) & (MSTATUS_SUM | MSTATUS_MXR);
+  }
+  bool lookup_superpage(const mem_access_info_t& access_info, reg_t* paddr);
+
+  mmu_stats_t stats;
+
+  // The megapages, gigapages and NAPOT ranges (vbase, offset mask) the TLB
+  // has been refilled from since the last flush; an sfence.vma of any page
+  // in one drops all of it. Once more than SUPERPAGE_FILLS have been seen,
+  // such a fence flushes everything instead.
+  static const size_t SUPERPAGE_FILLS = 64;
+  std::vector<std::pair<reg_t, reg_t>> superpage_fills;
+  bool superpage_fills_overflow = false;
+  void note_superpage_fill(reg_t vbase, reg_t mask);
+
+  // drop the cached translations and decoded instructions of the page at
+  // vaddr, as seen by the current privilege, or of the whole superpage
+  // that the TLB saw it mapped by
+  void flush_tlb_page(reg_t vaddr);
+
+  pmp_table_t pmp_table;
+
+  // access_tlb for len bytes at vaddr, also hitting a TLB_PMP_SPLIT entry
+  // whose allowed blocks cover them
+  std::tuple<bool, uintptr_t, reg_t> access_split_tlb(const std::vector<dtlb_entry_t>& tlb, reg_t vaddr, reg_t len, reg_t allowed_flags);
+  // counts why a load or store with a normal translation took the slow
+  // path; tlb_hit is the lookup that ignored trigger marks
+  void count_slow_path(const std::vector<dtlb_entry_t>& tlb, reg_t vaddr, reg_t len, bool tlb_hit);
+  // the 64-byte blocks of the page at paddr PMP allows type accesses to
+  uint64_t pmp_page_blocks(reg_t paddr, access_type type);
+
+  // the TLB that loads or stores with xlate_flags look up
+  std::vector<dtlb_entry_t>& ALWAYS_INLINE data_tlb(access_type type, xlate_flags_t xlate_flags)
+  {
+    if (xlate_flags.ss_access)
+      return type == LOAD ? tlb_ss_load : tlb_ss_store;
+    if (xlate_flags.forced_virt)
+      return type == LOAD ? tlb_guest_load : tlb_guest_store;
+    return type == LOAD ? tlb_load : tlb_store;
+  }
 
   // finish translation on a TLB miss and update the TLB
-  tlb_entry_t refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type);
+  tlb_entry_t refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type, xlate_flags_t xlate_flags = {});
   const char* fill_from_mmio(reg_t vaddr, reg_t paddr);
 
   // perform a stage2 translation for a given guest address
@@ -447,6 +957,9 @@ private:
     check_triggers(operation, address, virt, address, data);
   }
   void check_triggers(triggers::operation_t operation, reg_t address, bool virt, reg_t tval, std::optional<reg_t> data);
+  // Whether an armed trigger may match an access to the page at vaddr;
+  // other pages keep TLB entries without TLB_CHECK_TRIGGERS.
+  bool page_may_trigger(triggers::operation_t operation, reg_t vaddr);
   reg_t translate(mem_access_info_t access_info, reg_t len);
 
   reg_t pte_load(reg_t pte_paddr, reg_t addr, bool virt, access_type trap_type, size_t ptesize) {
@@ -491,6 +1004,8 @@ private:
     target_endian<T> target_pte = to_target((T)new_pte);
     if (host_pte_addr) {
       memcpy(host_pte_addr, &target_pte, ptesize);
+      if (store_set)
+        store_set->add(pte_paddr, ptesize);
     } else if (!mmio_store(pte_paddr, ptesize, (uint8_t*)&target_pte)) {
       throw_access_exception(virt, addr, trap_type);
     }
@@ -6,6 +6,7 @@
 #include "term.h"
 #include "sim.h"
 #include "dts.h"
+#include "checkpoint.h"
 
 #define UART_QUEUE_SIZE         64
 
@@ -302,6 +303,27 @@ bool ns16550_t::store(reg_t addr, size_t len, const uint8_t* bytes)
   return ret;
 }
 
+void ns16550_t::save_state(checkpoint_writer_t& out) const
+{
+  for (uint8_t r : {dll, dlm, iir, ier, fcr, lcr, mcr, lsr, msr, scr})
+    out.put_u8(r);
+  auto rx = rx_queue;
+  out.put_u32(rx.size());
+  for (; !rx.empty(); rx.pop())
+    out.put_u8(rx.front());
+}
+
+void ns16550_t::load_state(checkpoint_reader_t& in)
+{
+  for (uint8_t* r : {&dll, &dlm, &iir, &ier, &fcr, &lcr, &mcr, &lsr, &msr, &scr})
+    *r = in.get_u8();
+  rx_queue = std::queue<uint8_t>();
+  for (uint32_t n = in.get_u32(); n > 0; n--)
+    rx_queue.push(in.get_u8());
+  backoff_counter = 0;
+  update_interrupt();
+}
+
 void ns16550_t::tick(reg_t UNUSED rtc_ticks)
 {
   if (!(fcr & UART_FCR_ENABLE_FIFO) ||
@@ -334,7 +356,7 @@ std::string ns16550_generate_dts(const sim_t* sim, const std::vector<std::string
   s << std::hex
     << "    SERIAL0: ns16550@" << NS16550_BASE << " {\n"
        "      compatible = \"ns16550a\";\n"
-       "      clock-frequency = <" << std::dec << (sim->CPU_HZ/sim->INSNS_PER_RTC_TICK) << ">;\n"
+       "      clock-frequency = <" << std::dec << (sim->CPU_HZ/sim->insns_per_rtc_tick) << ">;\n"
        "      interrupt-parent = <&PLIC>;\n"
        "      interrupts = <" << std::dec << NS16550_INTERRUPT_ID;
   reg_t ns16550bs = NS16550_BASE;
@@ -17,6 +17,9 @@
 #define NS16550_REG_SHIFT  0
 #define NS16550_REG_IO_WIDTH 1
 #define NS16550_INTERRUPT_ID 1
+#define VIRTIO_BLK_BASE    0x10001000
+#define VIRTIO_BLK_SIZE    0x1000
+#define VIRTIO_BLK_INTERRUPT_ID 2
 #define EXT_IO_BASE        0x40000000
 #define DRAM_BASE          0x80000000
 #define DEBUG_START        0x0
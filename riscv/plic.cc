@@ -5,6 +5,7 @@
 #include "simif.h"
 #include "sim.h"
 #include "dts.h"
+#include "checkpoint.h"
 
 #define PLIC_MAX_CONTEXTS 15872
 
@@ -89,40 +90,46 @@ plic_t::plic_t(const simif_t* sim, uint32_t ndev)
 
 uint32_t plic_t::context_best_pending(const plic_context_t *c)
 {
-  uint8_t best_id_prio = 0;
-  uint32_t best_id = 0;
-
-  for (uint32_t i = 0; i < num_ids_word; i++) {
-    if (!c->pending[i]) {
-      continue;
-    }
-
-    for (uint32_t j = 0; j < 32; j++) {
-      uint32_t id = i * 32 + j;
-      if ((num_ids <= id) ||
-          !(c->pending[i] & (1 << j)) ||
-          (c->claimed[i] & (1 << j))) {
-        continue;
-      }
-
-      if (!best_id ||
-          (best_id_prio < c->pending_priority[id])) {
-        best_id = id;
-        best_id_prio = c->pending_priority[id];
-      }
-    }
-  }
-
   /*
   From Spec 1.0.0: 6. Priority Thresholds
   The PLIC will mask all PLIC interrupts of a priority less than or equal to
   threshold.
   */
-  if (best_id_prio <= c->priority_threshold) {
+  if (!c->active_prios)
+    return 0;
+  uint32_t best_id_prio = 31 - __builtin_clz(c->active_prios);
+  if (best_id_prio <= c->priority_threshold)
     return 0;
-  }
 
-  return best_id;
+  // Ties go to the lowest id
+  const uint64_t* bucket = c->active[best_id_prio];
+  for (uint32_t i = 0; ; i++)
+    if (bucket[i])
+      return i * 64 + __builtin_ctzll(bucket[i]);
+}
+
+void plic_t::context_refresh(plic_context_t *c, uint32_t id)
+{
+  uint32_t id_word = id / 32;
+  uint32_t id_mask = 1 << (id % 32);
+  uint8_t prio = (c->pending[id_word] & id_mask) && !(c->claimed[id_word] & id_mask) ?
+                 c->pending_priority[id] : 0;
+  uint8_t old = c->active_prio[id];
+  if (prio == old)
+    return;
+
+  uint64_t bit = uint64_t(1) << (id % 64);
+  if (old) {
+    c->active[old][id / 64] &= ~bit;
+    if (!--c->active_count[old])
+      c->active_prios &= ~(1U << old);
+  }
+  if (prio) {
+    c->active[prio][id / 64] |= bit;
+    if (!c->active_count[prio]++)
+      c->active_prios |= 1U << prio;
+  }
+  c->active_prio[id] = prio;
 }
 
 void plic_t::context_update(const plic_context_t *c)
@@ -141,6 +148,7 @@ uint32_t plic_t::context_claim(plic_context_t *c)
 
   if (best_id) {
     c->claimed[best_id_word] |= best_id_mask;
+    context_refresh(c, best_id);
   }
 
   context_update(c);
@@ -229,6 +237,7 @@ bool plic_t::context_enable_write(plic_context_t *c,
       c->pending_priority[id] = 0;
       c->claimed[id_word] &= ~id_mask;
     }
+    context_refresh(c, id);
   }
 
   context_update(c);
@@ -271,6 +280,7 @@ bool plic_t::context_write(plic_context_t *c,
       if ((val < num_ids) &&
           (c->enable[id_word] & id_mask)) {
         c->claimed[id_word] &= ~id_mask;
+        context_refresh(c, val);
         update = true;
       }
       break;
@@ -287,6 +297,44 @@ bool plic_t::context_write(plic_context_t *c,
   return ret;
 }
 
+void plic_t::save_state(checkpoint_writer_t& out) const
+{
+  out.put_bytes(priority, sizeof(priority));
+  for (auto l : level)
+    out.put_u32(l);
+  out.put_u32(contexts.size());
+  for (const auto& c : contexts) {
+    out.put_u8(c.priority_threshold);
+    for (size_t i = 0; i < PLIC_MAX_DEVICES / 32; i++) {
+      out.put_u32(c.enable[i]);
+      out.put_u32(c.pending[i]);
+      out.put_u32(c.claimed[i]);
+    }
+    out.put_bytes(c.pending_priority, sizeof(c.pending_priority));
+  }
+}
+
+void plic_t::load_state(checkpoint_reader_t& in)
+{
+  memcpy(priority, in.get_bytes(sizeof(priority)), sizeof(priority));
+  for (auto& l : level)
+    l = in.get_u32();
+  if (in.get_u32() != contexts.size())
+    throw std::runtime_error("checkpoint PLIC contexts do not match");
+  for (auto& c : contexts) {
+    c.priority_threshold = in.get_u8();
+    for (size_t i = 0; i < PLIC_MAX_DEVICES / 32; i++) {
+      c.enable[i] = in.get_u32();
+      c.pending[i] = in.get_u32();
+      c.claimed[i] = in.get_u32();
+    }
+    memcpy(c.pending_priority, in.get_bytes(sizeof(c.pending_priority)), sizeof(c.pending_priority));
+    for (uint32_t id = 1; id < num_ids; id++)
+      context_refresh(&c, id);
+    context_update(&c);
+  }
+}
+
 void plic_t::set_interrupt_level(uint32_t id, int lvl)
 {
   if (id <= 0 || num_ids <= id) {
@@ -321,6 +369,7 @@ void plic_t::set_interrupt_level(uint32_t id, int lvl)
         c->pending_priority[id] = 0;
         c->claimed[id_word] &= ~id_mask;
       }
+      context_refresh(c, id);
       context_update(c);
       break;
     }
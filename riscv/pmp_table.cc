@@ -0,0 +1,95 @@
+// See LICENSE for license details.
+
+#include "pmp_table.h"
+#include "processor.h"
+#include <algorithm>
+#include <optional>
+
+void pmp_table_t::build(processor_t* proc)
+{
+  state_t* state = proc->get_state();
+  std::vector<std::optional<std::pair<reg_t, reg_t>>> spans(proc->n_pmp);
+  std::vector<reg_t> starts = {0};
+  for (size_t i = 0; i < proc->n_pmp; i++) {
+    spans[i] = state->pmpaddr[i]->match_range();
+    if (spans[i]) {
+      starts.push_back(spans[i]->first);
+      if (spans[i]->second != reg_t(-1))
+        starts.push_back(spans[i]->second + 1);
+    }
+  }
+  std::sort(starts.begin(), starts.end());
+  starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+  const bool mml = state->mseccfg->get_mml();
+  const bool mmwp = state->mseccfg->get_mmwp();
+  ranges.clear();
+  for (reg_t start : starts) {
+    int entry = -1;
+    for (size_t i = 0; i < spans.size() && entry < 0; i++)
+      if (spans[i] && spans[i]->first <= start && start <= spans[i]->second)
+        entry = i;
+    if (!ranges.empty() && ranges.back().entry == entry)
+      continue;
+
+    static const std::pair<access_type, bool> kinds[] = {{LOAD, false}, {STORE, false}, {FETCH, false}, {LOAD, true}};
+    uint16_t perms = 0;
+    for (reg_t mode : {PRV_U, PRV_S, PRV_M}) {
+      for (auto [type, hlvx] : kinds) {
+        // in case matching region is not found, as in mmu_t::pmp_ok
+        bool ok = entry >= 0 ? state->pmpaddr[entry]->access_ok(type, mode, hlvx)
+                             : mode == PRV_M && !mmwp && (!mml || type == LOAD || type == STORE);
+        perms |= uint16_t(ok) << perm_bit(type, mode, hlvx);
+      }
+    }
+    ranges.push_back({start, entry, perms});
+  }
+}
+
+size_t pmp_table_t::find(reg_t addr) const
+{
+  auto it = std::upper_bound(ranges.begin(), ranges.end(), addr,
+                             [](reg_t a, const range_t& r) { return a < r.start; });
+  return it - ranges.begin() - 1;
+}
+
+bool pmp_table_t::access_ok(reg_t addr, reg_t len, access_type type, reg_t mode, bool hlvx) const
+{
+  // Each 4-byte sector of the access is checked, so it is refused if its
+  // sectors see different first matching entries: the first of those does
+  // not match them all.
+  size_t i = find(addr);
+  size_t last = i + 1 == ranges.size() ? i : find(addr + ((len - 1) & ~reg_t((1 << PMP_SHIFT) - 1)));
+  if (i != last)
+    return false;
+  return (ranges[i].perms >> perm_bit(type, mode, hlvx)) & 1;
+}
+
+bool pmp_table_t::homogeneous(reg_t addr, reg_t len) const
+{
+  size_t i = find(addr);
+  return i + 1 == ranges.size() || addr + len - 1 < ranges[i + 1].start;
+}
+
+void pmp_table_t::diff(const pmp_table_t& other, std::vector<std::pair<reg_t, reg_t>>* changed) const
+{
+  std::vector<reg_t> starts;
+  for (auto& r : ranges)
+    starts.push_back(r.start);
+  for (auto& r : other.ranges)
+    starts.push_back(r.start);
+  std::sort(starts.begin(), starts.end());
+  starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+  for (size_t k = 0; k < starts.size(); k++) {
+    const range_t& a = ranges[find(starts[k])];
+    const range_t& b = other.ranges[other.find(starts[k])];
+    if (a.entry == b.entry && a.perms == b.perms)
+      continue;
+    reg_t last = k + 1 < starts.size() ? starts[k + 1] - 1 : reg_t(-1);
+    if (!changed->empty() && changed->back().second + 1 == starts[k])
+      changed->back().second = last;
+    else
+      changed->push_back({starts[k], last});
+  }
+}
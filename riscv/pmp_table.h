@@ -0,0 +1,49 @@
+// See LICENSE for license details.
+#ifndef _RISCV_PMP_TABLE_H
+#define _RISCV_PMP_TABLE_H
+
+#include "decode.h"
+#include "memtracer.h"
+#include <utility>
+#include <vector>
+
+class processor_t;
+
+// The PMP configuration flattened into sorted, disjoint address ranges over
+// each of which the first matching entry is the same, with the accesses it
+// allows in every privilege mode, so that a check is one binary search.
+class pmp_table_t
+{
+ public:
+  pmp_table_t() : ranges{{0, -1, 0}} {}
+
+  // Recomputes the table from proc's pmpaddr, pmpcfg and mseccfg CSRs.
+  void build(processor_t* proc);
+
+  // As mmu_t::pmp_ok, for an access of len bytes at addr
+  bool access_ok(reg_t addr, reg_t len, access_type type, reg_t mode, bool hlvx) const;
+
+  // Whether no PMP entry matches only part of [addr, addr + len)
+  bool homogeneous(reg_t addr, reg_t len) const;
+
+  // Appends the address ranges [first, last] over which other checks
+  // accesses differently from this table.
+  void diff(const pmp_table_t& other, std::vector<std::pair<reg_t, reg_t>>* changed) const;
+
+ private:
+  struct range_t {
+    reg_t start;      // up to the next range's start
+    int entry;        // first matching PMP entry, or -1 if none
+    uint16_t perms;   // bits for perm_bit() of the allowed accesses
+  };
+
+  static unsigned perm_bit(access_type type, reg_t mode, bool hlvx)
+  {
+    return mode * 4 + (type == LOAD && hlvx ? 3 : type);
+  }
+  size_t find(reg_t addr) const;
+
+  std::vector<range_t> ranges;  // ranges[0].start is 0
+};
+
+#endif
@@ -12,6 +12,8 @@
 #include "platform.h"
 #include "vector_unit.h"
 #include "debug_defines.h"
+#include "checkpoint.h"
+#include "coverage.h"
 #include <cinttypes>
 #include <cmath>
 #include <cstdlib>
@@ -22,6 +24,8 @@
 #include <stdexcept>
 #include <string>
 #include <algorithm>
+#include <iterator>
+#include <mutex>
 
 #ifdef __GNUC__
 # pragma GCC diagnostic ignored "-Wunused-variable"
@@ -34,10 +38,14 @@ processor_t::processor_t(const char* isa_str, const char* priv_str,
                          const cfg_t *cfg,
                          simif_t* sim, uint32_t id, bool halt_on_reset,
                          FILE* log_file, std::ostream& sout_)
-: debug(false), halt_request(HR_NONE), isa(isa_str, priv_str), cfg(cfg),
+: debug(false), halt_request(HR_NONE), isa(*isa_parser_t::get(isa_str, priv_str)), cfg(cfg),
   sim(sim), id(id), xlen(isa.get_max_xlen()),
   histogram_enabled(false), log_commits_enabled(false),
-  log_file(log_file), sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
+  log_commits_printed(false), log_filter(nullptr), log_filter_retired(0),
+  mmio_barrier(false), mmio_barrier_hit(false),
+  stop_pc(-1), stop_requested(false), stop_hit(false), xpr_pending(0), bbv_profiler(nullptr),
+  call_tracer(nullptr), insn_trace_ring(nullptr), cache_sampler(nullptr), dram_trace(nullptr),
+  coverage(nullptr), log_file(log_file), sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
   in_wfi(false), check_triggers_icount(false),
   impl_table(256, false), extension_enable_table(isa.get_extension_table()),
   last_pc(1), executions(1), TM(cfg->trigger_count)
@@ -61,13 +69,29 @@ processor_t::processor_t(const char* isa_str, const char* priv_str,
   VU.ELEN = isa.get_elen();
   VU.vlenb = isa.get_vlen() / 8;
   VU.vstart_alu = 0;
+  VU.set_threads(cfg->vector_threads);
+
+  // Without S or U the hart can never leave M-mode, so handlers compiled
+  // with the privilege checks folded away are safe to use.
+  machine_only_handlers = cfg->machine_only_handlers &&
+    isa.get_max_xlen() == 64 &&
+    !isa.extension_enabled('S') && !isa.extension_enabled('U');
+
+  isa_tables = find_isa_tables(this, std::string(isa_str) + ":" + priv_str);
+  disassembler = isa_tables->disassembler.get();
+  build_opcode_map();
+  startup_profile.mark("decode tables");
 
-  register_base_instructions();
   mmu = new mmu_t(sim, cfg->endianness, this, cfg->cache_blocksz);
+  mmu->configure_tlb(cfg->tlb_entries, cfg->tlb_ways);
+  mmu->configure_icache(cfg->icache_entries);
+  mmu->configure_block_cache(cfg->block_cache_entries);
+  startup_profile.mark("mmu");
 
-  disassembler = new disassembler_t(&isa);
+  disasm_cache = new disasm_cache_t(disassembler);
   for (auto e : isa.get_extensions())
     register_extension(find_extension(e.c_str())());
+  startup_profile.mark("extensions");
 
   set_pmp_granularity(cfg->pmpgranularity);
   set_pmp_num(cfg->pmpregions);
@@ -81,12 +105,14 @@ processor_t::processor_t(const char* isa_str, const char* priv_str,
   set_impl(IMPL_MMU_VMID, true);
 
   reset();
+  startup_profile.mark("csr init");
 }
 
 processor_t::~processor_t()
 {
   if (histogram_enabled)
   {
+    mmu->take_pc_counts(pc_histogram);
     std::vector<std::pair<reg_t, uint64_t>> ordered_histo(pc_histogram.begin(), pc_histogram.end());
     std::sort(ordered_histo.begin(), ordered_histo.end(),
               [](auto& lhs, auto& rhs) { return lhs.second < rhs.second; });
@@ -97,7 +123,7 @@ processor_t::~processor_t()
   }
 
   delete mmu;
-  delete disassembler;
+  delete disasm_cache;
 }
 
 void state_t::reset(processor_t* const proc, reg_t max_isa)
@@ -110,14 +136,22 @@ void state_t::reset(processor_t* const proc, reg_t max_isa)
   v = prev_v = false;
   prv_changed = false;
   v_changed = false;
+  lazy_retired = 0;
+  counters_dirty = true;
 
   serialized = false;
+  irq_maybe_pending = true;
   debug_mode = false;
   single_step = STEP_NONE;
 
+  // size the commit logs once so that logged instructions never allocate;
+  // a vector register group write at LMUL=8 is the common worst case
   log_reg_write.clear();
+  log_reg_write.reserve(64);
   log_mem_read.clear();
+  log_mem_read.reserve(64);
   log_mem_write.clear();
+  log_mem_write.reserve(64);
   last_inst_priv = 0;
   last_inst_xlen = 0;
   last_inst_flen = 0;
@@ -139,19 +173,82 @@ void processor_t::set_debug(bool value)
 
 void processor_t::set_histogram(bool value)
 {
+  // Counted per block in the fast loop where possible; without a block
+  // cache, -g stays on the slow path.
   histogram_enabled = value;
+  if (value && !mmu->block_cache_enabled())
+    mmu->configure_block_cache(mmu_t::DEFAULT_BLOCK_CACHE_ENTRIES);
+  mmu->set_pc_profiling(value);
+}
+
+void processor_t::update_log_commits(bool filter_accepts)
+{
+  bool on = !commit_observers.empty() || (log_commits_printed && (!log_filter || filter_accepts));
+  if (on != log_commits_enabled) {
+    log_commits_enabled = on;
+    mmu->flush_tlb(); // the TLB and decoded handlers cache this setting
+  }
 }
 
 void processor_t::enable_log_commits()
 {
-  log_commits_enabled = true;
-  mmu->flush_tlb(); // the TLB caches this setting
+  log_commits_printed = true;
+  update_log_commits(false);
+}
+
+void processor_t::set_commit_log_filter(const commit_log_filter_t* filter)
+{
+  log_filter = filter;
+  // step() turns logging on as the filter starts accepting
+  update_log_commits(false);
+  // the pcs it covers are kept out of the icache and blocks
+  mmu->flush_icache();
+}
+
+void processor_t::add_commit_observer(commit_observer_t* observer)
+{
+  commit_observers.push_back(observer);
+  update_log_commits(log_commits_enabled);
+}
+
+void processor_t::remove_commit_observer(commit_observer_t* observer)
+{
+  commit_observers.erase(std::remove(commit_observers.begin(), commit_observers.end(), observer),
+                         commit_observers.end());
+  // back to the fast handlers once nothing is left to capture commits for;
+  // a filter that was accepting keeps logging until step() checks it again
+  update_log_commits(log_commits_enabled);
+}
+
+void processor_t::set_stop_pc(reg_t pc)
+{
+  stop_pc = pc;
+  stop_requested = false;
+  stop_hit = false;
+  // the stop pc is never cached, so fast-loop chains always end there
+  mmu->flush_icache();
+}
+
+void processor_t::request_stop()
+{
+  stop_requested = true;
+  // breaks the fast loop's chain at the next instruction
+  mmu->flush_icache();
+}
+
+void processor_t::rehome()
+{
+  VU.rehome();
+  mmu->rehome();
 }
 
 void processor_t::reset()
 {
   xlen = isa.get_max_xlen();
   state.reset(this, isa.get_max_isa());
+  xpr_pending = 0;
+  log_filter_retired = 0;
+  mmu->flush_gstage();
   if (any_vector_extensions())
     VU.reset();
   in_wfi = false;
@@ -173,6 +270,108 @@ void processor_t::reset()
     sim->proc_reset(id);
 }
 
+void processor_t::save_state(checkpoint_writer_t& out) const
+{
+  out.put_u64(state.pc);
+  out.put_u8(state.prv);
+  out.put_u8(state.v);
+  out.put_u8(state.debug_mode);
+  for (size_t i = 0; i < NXPR; i++)
+    out.put_u64(state.XPR[i]);
+  for (size_t i = 0; i < NFPR; i++) {
+    out.put_u64(state.FPR[i].v[0]);
+    out.put_u64(state.FPR[i].v[1]);
+  }
+
+  std::vector<reg_t> addrs;
+  for (auto& c : state.csrmap)
+    addrs.push_back(c.first);
+  std::sort(addrs.begin(), addrs.end());
+  out.put_u32(addrs.size());
+  for (reg_t addr : addrs) {
+    out.put_u32(addr);
+    out.put_u64(state.csrmap.at(addr)->read());
+  }
+
+  bool has_v = VU.reg_file && VU.vlenb;
+  out.put_u64(has_v ? VU.vlenb : 0);
+  if (has_v) {
+    out.put_u64(VU.vl->read());
+    out.put_u64(VU.vtype->read());
+    out.put_bytes(VU.reg_file, NVPR * VU.vlenb);
+  }
+}
+
+void processor_t::load_state(checkpoint_reader_t& in)
+{
+  reg_t pc = in.get_u64();
+  reg_t prv = in.get_u8();
+  bool virt = in.get_u8();
+  bool debug_mode = in.get_u8();
+  for (size_t i = 0; i < NXPR; i++)
+    state.XPR.write(i, in.get_u64());
+  for (size_t i = 0; i < NFPR; i++) {
+    freg_t f;
+    f.v[0] = in.get_u64();
+    f.v[1] = in.get_u64();
+    state.FPR.write(i, f);
+  }
+
+  std::vector<std::pair<reg_t, reg_t>> csrs(in.get_u32());
+  for (auto& c : csrs) {
+    c.first = in.get_u32();
+    c.second = in.get_u64();
+  }
+
+  // vl and vtype first, since setting them clears vstart
+  reg_t vlenb = in.get_u64();
+  if (vlenb) {
+    if (!VU.reg_file || vlenb != VU.vlenb)
+      throw std::runtime_error("checkpoint vector length does not match");
+    reg_t vl = in.get_u64();
+    reg_t vtype = in.get_u64();
+    VU.set_vl(0, 1, vl, vtype);
+    memcpy(VU.reg_file, in.get_bytes(NVPR * vlenb), NVPR * vlenb);
+    VU.dirty = ~0U;
+  }
+
+  // Written from M-mode so virtualized CSRs reach their own copies, twice so
+  // a CSR whose legal values depend on a later one settles, and with PMP
+  // configurations last, since a locked entry ignores its address writes.
+  // Read-only CSRs are derived from the rest.
+  set_privilege(PRV_M, false);
+  auto is_pmpcfg = [](reg_t a) { return a >= CSR_PMPCFG0 && a < CSR_PMPCFG0 + 16; };
+  auto restore = [&](bool pmpcfg) {
+    for (auto& c : csrs) {
+      auto it = state.csrmap.find(c.first);
+      if (it == state.csrmap.end() || get_field(c.first, 0xC00) == 3 || is_pmpcfg(c.first) != pmpcfg)
+        continue;
+      try {
+        it->second->write(c.second);
+      } catch (trap_t&) {
+      }
+      // a counter write also cancels the next increment
+      state.minstret->bump(0);
+      state.mcycle->bump(0);
+    }
+  };
+  restore(false);
+  restore(false);
+  restore(true);
+  for (auto& c : csrs)
+    if (c.first == CSR_MIP)
+      state.mip->backdoor_write_with_mask(MIP_MSIP | MIP_MTIP | MIP_MEIP | MIP_SEIP, c.second);
+
+  set_privilege(prv, virt);
+  state.debug_mode = debug_mode;
+  state.pc = pc;
+  in_wfi = false;
+  mmu->yield_load_reservation();
+  mmu->flush_tlb();
+  mmu->flush_gstage();
+  mmu->flush_icache();
+}
+
 extension_t* processor_t::get_extension()
 {
   switch (custom_extensions.size()) {
@@ -343,6 +542,10 @@ void processor_t::set_privilege(reg_t prv, bool virt)
   state.v = virt && state.prv != PRV_M;
   state.prv_changed = state.prv != state.prev_prv;
   state.v_changed = state.v != state.prev_v;
+  if (state.prv_changed || state.v_changed)
+    state.counters_dirty = true;
+  if (unlikely(coverage != nullptr))
+    coverage->privilege(state.prev_prv, state.prev_v, state.prv, state.v);
 }
 
 const char* processor_t::get_privilege_string() const
@@ -419,6 +622,10 @@ void processor_t::take_trap(trap_t& t, reg_t epc)
   const reg_t interrupt_bit = (reg_t)1 << (max_xlen - 1);
   bool interrupt = (bit & interrupt_bit) != 0;
   bool supv_double_trap = false;
+  if ((bit & ~interrupt_bit) < 64)
+    (interrupt ? stats.interrupts : stats.exceptions)[bit & ~interrupt_bit]++;
+  if (unlikely(coverage != nullptr))
+    coverage->trap(bit & ~interrupt_bit, interrupt);
   if (interrupt) {
     vsdeleg = (curr_virt && state.prv <= PRV_S) ? state.hideleg->read() : 0;
     hsdeleg = (state.prv <= PRV_S) ? (state.mideleg->read() | state.nonvirtual_sip->read()) : 0;
@@ -563,13 +770,16 @@ const char* processor_t::get_symbol(uint64_t addr)
   return sim->get_symbol(addr);
 }
 
-void processor_t::check_if_lpad_required()
+void processor_t::check_lpad()
 {
-  if (unlikely(state.elp == elp_t::LP_EXPECTED)) {
-    // also see insns/lpad.h for more checks performed
-    insn_fetch_t fetch = mmu->load_insn(state.pc);
-    software_check((fetch.insn.bits() & MASK_LPAD) == MATCH_LPAD, LANDING_PAD_FAULT);
-  }
+  // also see insns/lpad.h for more checks performed
+  insn_fetch_t fetch = mmu->load_insn(state.pc);
+  software_check((fetch.insn.bits() & MASK_LPAD) == MATCH_LPAD, LANDING_PAD_FAULT);
+}
+
+const std::string& processor_t::disassemble(insn_t insn)
+{
+  return disasm_cache->disassemble(insn);
 }
 
 void processor_t::disasm(insn_t insn)
@@ -595,7 +805,7 @@ void processor_t::disasm(insn_t insn)
     s << "core " << std::dec << std::setfill(' ') << std::setw(3) << id
       << std::hex << ": 0x" << std::setfill('0') << std::setw(max_xlen / 4)
       << zext(state.pc, max_xlen) << " (0x" << std::setw(8) << bits << ") "
-      << disassembler->disassemble(insn) << std::endl;
+      << disasm_cache->disassemble(insn) << std::endl;
 
     debug_output_log(&s);
 
@@ -610,6 +820,15 @@ void processor_t::disasm(insn_t insn)
 void processor_t::put_csr(int which, reg_t val)
 {
   val = zext_xlen(val);
+  if (reg_t(which) < std::size(state.csr_table)) {
+    if (csr_t* csr = state.csr_table[which]) {
+      if (state.csr_basic[which])
+        static_cast<basic_csr_t*>(csr)->basic_csr_t::write_direct(val);
+      else
+        csr->write(val);
+    }
+    return;
+  }
   auto search = state.csrmap.find(which);
   if (search != state.csrmap.end()) {
     search->second->write(val);
@@ -622,11 +841,26 @@ void processor_t::put_csr(int which, reg_t val)
 // side effects on reads.
 reg_t processor_t::get_csr(int which, insn_t insn, bool write, bool peek)
 {
-  auto search = state.csrmap.find(which);
-  if (search != state.csrmap.end()) {
+  csr_t* csr = nullptr;
+  if (unlikely(coverage != nullptr) && !peek)
+    coverage->csr(which, write);
+  if (reg_t(which) < std::size(state.csr_table)) {
+    csr = state.csr_table[which];
+    if (csr && state.csr_basic[which]) {
+      auto basic = static_cast<basic_csr_t*>(csr);
+      if (!peek)
+        basic->csr_t::verify_permissions(insn, write);
+      return basic->basic_csr_t::read();
+    }
+  } else {
+    auto search = state.csrmap.find(which);
+    if (search != state.csrmap.end())
+      csr = search->second.get();
+  }
+  if (csr) {
     if (!peek)
-      search->second->verify_permissions(insn, write);
-    return search->second->read();
+      csr->verify_permissions(insn, write);
+    return csr->read();
   }
   // If we get here, the CSR doesn't exist.  Unimplemented CSRs always throw
   // illegal-instruction exceptions, not virtual-instruction exceptions.
@@ -636,66 +870,255 @@ reg_t processor_t::get_csr(int which, insn_t insn, bool write, bool peek)
 const insn_desc_t insn_desc_t::illegal_instruction = {
   0, 0,
   &::illegal_instruction, &::illegal_instruction, &::illegal_instruction, &::illegal_instruction,
-  &::illegal_instruction, &::illegal_instruction, &::illegal_instruction, &::illegal_instruction
+  &::illegal_instruction, &::illegal_instruction, &::illegal_instruction, &::illegal_instruction,
+  &::illegal_instruction
 };
 
-reg_t illegal_instruction(processor_t UNUSED *p, insn_t insn, reg_t UNUSED pc)
+reg_t illegal_instruction(processor_t *p, insn_t insn, reg_t UNUSED pc)
 {
   // The illegal instruction can be longer than ILEN bits, where the tval will
   // contain the first ILEN bits of the faulting instruction. We hard-code the
   // ILEN to 32 bits since all official instructions have at most 32 bits.
-  throw trap_illegal_instruction(insn.bits() & 0xffffffffULL);
+  p->stash_trap(trap_illegal_instruction(insn.bits() & 0xffffffffULL));
+  return PC_TRAP;
 }
 
-insn_func_t processor_t::decode_insn(insn_t insn)
+const insn_desc_t* processor_t::lookup_insn_desc(insn_bits_t bits)
 {
   // look up opcode in hash table
-  size_t idx = insn.bits() % OPCODE_CACHE_SIZE;
-  auto [hit, desc] = opcode_cache[idx].lookup(insn.bits());
+  size_t idx = bits % OPCODE_CACHE_SIZE;
+  auto [hit, desc] = opcode_cache[idx].lookup(bits);
+
+  if (unlikely(!hit)) {
+    // fall back to the decode table
+    stats.opcode_cache_misses++;
+    const decode_list_t& candidates = decode_candidates(bits);
+    auto p = std::find_if(candidates.begin(), candidates.end(),
+                          [bits](const insn_desc_t *d) {
+                            return (bits & d->mask) == d->match;
+                          });
+    assert(p != candidates.end());
+    desc = *p;
+    opcode_cache[idx].replace(bits, desc);
+  }
+
+  return desc;
+}
 
+insn_func_t processor_t::decode_insn(insn_t insn)
+{
+  const insn_desc_t* desc = lookup_insn_desc(insn.bits());
   bool rve = extension_enabled('E');
+  return desc->func(xlen, rve, log_commits_enabled, machine_only_handlers);
+}
 
-  if (unlikely(!hit)) {
-    // fall back to linear search
-    auto matching = [insn_bits = insn.bits()](const insn_desc_t &d) {
-      return (insn_bits & d.mask) == d.match;
-    };
-    auto p = std::find_if(custom_instructions.begin(),
-                          custom_instructions.end(), matching);
-    if (p == custom_instructions.end()) {
-      p = std::find_if(instructions.begin(), instructions.end(), matching);
-      assert(p != instructions.end());
+void processor_t::set_insn_stats(bool value)
+{
+  // As for -g: counted per block where possible, else on the slow path.
+  insn_stats_enabled = value;
+  if (value && !mmu->block_cache_enabled())
+    mmu->configure_block_cache(mmu_t::DEFAULT_BLOCK_CACHE_ENTRIES);
+  mmu->set_insn_profiling(value);
+}
+
+void processor_t::count_insns(insn_bits_t bits, reg_t prv, uint64_t n)
+{
+  const insn_desc_t* desc = lookup_insn_desc(bits);
+  const std::vector<insn_desc_t>& instructions = isa_tables->instructions;
+  size_t index;
+  if (desc >= instructions.data() && desc < instructions.data() + instructions.size())
+    index = desc - instructions.data();
+  else if (desc >= custom_instructions.data() &&
+           desc < custom_instructions.data() + custom_instructions.size())
+    index = instructions.size() + (desc - custom_instructions.data());
+  else
+    return;  // the opcode cache's empty entries; never retires
+  insn_counts[index * 4 + (prv & 3)] += n;
+}
+
+std::vector<processor_t::insn_count_t> processor_t::get_insn_counts()
+{
+  mmu->flush_block_counts();
+
+  std::vector<insn_count_t> counts;
+  const std::vector<insn_desc_t>& instructions = isa_tables->instructions;
+  size_t n = instructions.size() + custom_instructions.size();
+  for (size_t i = 0; i < n; i++) {
+    const uint64_t* c = &insn_counts[i * 4];
+    if (!(c[0] | c[1] | c[2] | c[3]))
+      continue;
+    const insn_desc_t& desc = i < instructions.size() ? instructions[i]
+                                                      : custom_instructions[i - instructions.size()];
+    const char* name = desc.name;
+    if (!name) {
+      auto disasm_insn = disassembler->lookup(insn_t(desc.match));
+      name = disasm_insn ? disasm_insn->get_name() : "unknown";
     }
-    desc = &*p;
-    opcode_cache[idx].replace(insn.bits(), desc);
+    counts.push_back({name, desc.group ? desc.group : "custom", {c[0], c[1], c[2], c[3]}});
   }
+  return counts;
+}
 
-  return desc->func(xlen, rve, log_commits_enabled);
+void processor_t::clear_insn_counts()
+{
+  mmu->flush_block_counts();
+  std::fill(insn_counts.begin(), insn_counts.end(), 0);
 }
 
-void processor_t::register_insn(insn_desc_t desc, bool is_custom) {
+void processor_t::print_insn_stats(FILE* out)
+{
+  std::vector<insn_count_t> counts = get_insn_counts();
+  auto total = [](const uint64_t c[4]) { return c[PRV_U] + c[PRV_S] + c[PRV_M]; };
+  std::sort(counts.begin(), counts.end(),
+            [&](auto& lhs, auto& rhs) { return total(lhs.count) > total(rhs.count); });
+
+  uint64_t all[4] = {0, 0, 0, 0};
+  std::vector<std::pair<std::string, uint64_t>> groups;
+  for (auto& c : counts) {
+    for (int prv : {PRV_U, PRV_S, PRV_M})
+      all[prv] += c.count[prv];
+    auto it = std::find_if(groups.begin(), groups.end(),
+                           [&](auto& g) { return g.first == c.group; });
+    if (it == groups.end())
+      groups.emplace_back(c.group, total(c.count));
+    else
+      it->second += total(c.count);
+  }
+  std::sort(groups.begin(), groups.end(),
+            [](auto& lhs, auto& rhs) { return lhs.second > rhs.second; });
+
+  fprintf(out, "core%4" PRIu32 ": retired %" PRIu64 " (U %" PRIu64 ", S %" PRIu64
+          ", M %" PRIu64 ")\n", id, total(all), all[PRV_U], all[PRV_S], all[PRV_M]);
+  for (auto& [group, n] : groups)
+    fprintf(out, "core%4" PRIu32 ": group %-12s %" PRIu64 "\n", id, group.c_str(), n);
+  for (auto& c : counts) {
+    std::string name = c.name;
+    std::replace(name.begin(), name.end(), '_', '.');
+    fprintf(out, "core%4" PRIu32 ": %-16s %" PRIu64 " (U %" PRIu64 ", S %" PRIu64
+            ", M %" PRIu64 ")\n", id, name.c_str(), total(c.count),
+            c.count[PRV_U], c.count[PRV_S], c.count[PRV_M]);
+  }
+}
+
+void processor_t::register_insn(insn_desc_t desc) {
   assert(desc.fast_rv32i && desc.fast_rv64i && desc.fast_rv32e && desc.fast_rv64e &&
          desc.logged_rv32i && desc.logged_rv64i && desc.logged_rv32e && desc.logged_rv64e);
 
-  if (is_custom)
-    custom_instructions.push_back(desc);
-  else
-    instructions.push_back(desc);
+  // room for a few extensions before the decode table must be rebuilt
+  if (custom_instructions.empty())
+    custom_instructions.reserve(64);
+  custom_instructions.push_back(desc);
+}
+
+// A descriptor belongs in every bucket whose key agrees with it on the key
+// bits it actually constrains.
+static bool compatible(const insn_desc_t &d, insn_bits_t key_mask, insn_bits_t key_bits)
+{
+  return ((key_bits ^ d.match) & d.mask & key_mask) == 0;
+}
+
+const processor_t::decode_list_t& processor_t::decode_candidates(insn_bits_t bits) const
+{
+  const decode_bucket_t& bucket = (*decode_table)[decode_key(bits)];
+  if (bucket.split.empty())
+    return bucket.insns;
+  return bucket.split[(bits >> 25) & (DECODE_SPLIT_SIZE - 1)];
 }
 
 void processor_t::build_opcode_map()
 {
   for (size_t i = 0; i < OPCODE_CACHE_SIZE; i++)
     opcode_cache[i].reset();
+
+  // Custom instructions are appended, so existing counts keep their index.
+  insn_counts.resize((isa_tables->instructions.size() + custom_instructions.size()) * 4);
+
+  if (custom_instructions.empty()) {
+    decode_table = &isa_tables->decode_table;
+    return;
+  }
+
+  if (decode_table != &custom_decode_table || custom_decoded_base != custom_instructions.data()) {
+    custom_decode_table = isa_tables->decode_table;
+    custom_decoded_base = custom_instructions.data();
+    custom_decoded = 0;
+    decode_table = &custom_decode_table;
+  }
+  for (; custom_decoded < custom_instructions.size(); custom_decoded++)
+    insert_custom_decode(&custom_instructions[custom_decoded]);
+}
+
+void processor_t::insert_custom_decode(const insn_desc_t* d)
+{
+  auto is_custom = [&](const insn_desc_t* x) {
+    return x >= custom_instructions.data() && x < custom_instructions.data() + custom_instructions.size();
+  };
+  auto insert = [&](decode_list_t& list) {
+    auto pos = std::find_if_not(list.begin(), list.end(), is_custom);
+    list.insert(pos, d);
+  };
+
+  for (size_t key = 0; key < DECODE_TABLE_SIZE; key++) {
+    insn_bits_t key_bits = (key & 0x7f) | ((key & 0x380) << 5);
+    if (!compatible(*d, 0x707f, key_bits))
+      continue;
+    decode_bucket_t& bucket = custom_decode_table[key];
+    insert(bucket.insns);
+    if (bucket.split.empty()) {
+      if (bucket.insns.size() > DECODE_SPLIT_THRESHOLD)
+        split_decode_bucket(bucket);
+      continue;
+    }
+    for (size_t sub = 0; sub < DECODE_SPLIT_SIZE; sub++)
+      if (compatible(*d, insn_bits_t(0x7f) << 25, insn_bits_t(sub) << 25))
+        insert(bucket.split[sub]);
+  }
+}
+
+void processor_t::build_decode_table(std::vector<decode_bucket_t>& table,
+                                     std::initializer_list<const std::vector<insn_desc_t>*> lists)
+{
+  table.assign(DECODE_TABLE_SIZE, decode_bucket_t());
+  for (size_t key = 0; key < DECODE_TABLE_SIZE; key++) {
+    insn_bits_t key_bits = (key & 0x7f) | ((key & 0x380) << 5);
+    decode_bucket_t& bucket = table[key];
+    for (auto list : lists)
+      for (const insn_desc_t &d : *list)
+        if (compatible(d, 0x707f, key_bits))
+          bucket.insns.push_back(&d);
+
+    if (bucket.insns.size() > DECODE_SPLIT_THRESHOLD)
+      split_decode_bucket(bucket);
+  }
+}
+
+void processor_t::split_decode_bucket(decode_bucket_t& bucket)
+{
+  bucket.split.assign(DECODE_SPLIT_SIZE, decode_list_t());
+  for (size_t sub = 0; sub < DECODE_SPLIT_SIZE; sub++)
+    for (const insn_desc_t *d : bucket.insns)
+      if (compatible(*d, insn_bits_t(0x7f) << 25, insn_bits_t(sub) << 25))
+        bucket.split[sub].push_back(d);
 }
 
 void processor_t::register_extension(extension_t *x) {
-  for (auto insn : x->get_instructions(*this))
+  for (auto insn : x->get_instructions(*this)) {
+    if (!insn.group)
+      insn.group = x->name();
     register_custom_insn(insn);
+  }
   build_opcode_map();
 
-  for (auto disasm_insn : x->get_disasms(this))
-    disassembler->add_insn(disasm_insn);
+  auto disasms = x->get_disasms(this);
+  if (!disasms.empty() && !custom_disassembler) {
+    custom_disassembler.reset(new disassembler_t(isa_tables->disassembler.get()));
+    disassembler = custom_disassembler.get();
+    delete disasm_cache;
+    disasm_cache = new disasm_cache_t(disassembler);
+  }
+  for (auto disasm_insn : disasms)
+    custom_disassembler->add_insn(disasm_insn);
+  disasm_cache->clear();
 
   if (!custom_extensions.insert(std::make_pair(x->name(), x)).second) {
     fprintf(stderr, "extensions must have unique names (got two named \"%s\"!)\n", x->name());
@@ -703,7 +1126,26 @@ void processor_t::register_extension(extension_t *x) {
   }
 }
 
-void processor_t::register_base_instructions()
+std::shared_ptr<const processor_t::isa_tables_t>
+processor_t::find_isa_tables(const processor_t* proc, const std::string& key)
+{
+  static std::mutex lock;
+  static std::map<std::string, std::weak_ptr<const isa_tables_t>> cache;
+
+  std::lock_guard<std::mutex> guard(lock);
+  auto& entry = cache[key];
+  if (auto tables = entry.lock())
+    return tables;
+
+  auto tables = std::make_shared<isa_tables_t>();
+  proc->register_base_instructions(tables->instructions);
+  build_decode_table(tables->decode_table, { &tables->instructions });
+  tables->disassembler.reset(new disassembler_t(&proc->isa));
+  entry = tables;
+  return tables;
+}
+
+void processor_t::register_base_instructions(std::vector<insn_desc_t>& out) const
 {
   #define DECLARE_INSN(name, match, mask) \
     insn_bits_t name##_match = (match), name##_mask = (mask); \
@@ -721,10 +1163,16 @@ void processor_t::register_base_instructions()
     extern reg_t logged_rv32i_##name(processor_t*, insn_t, reg_t); \
     extern reg_t logged_rv64i_##name(processor_t*, insn_t, reg_t); \
     extern reg_t logged_rv32e_##name(processor_t*, insn_t, reg_t); \
-    extern reg_t logged_rv64e_##name(processor_t*, insn_t, reg_t);
+    extern reg_t logged_rv64e_##name(processor_t*, insn_t, reg_t); \
+    extern reg_t machine_rv64i_##name(processor_t*, insn_t, reg_t);
   #include "insn_list.h"
   #undef DEFINE_INSN
 
+  #define DEFINE_INSN_GROUP(name, group) \
+    const char* name##_group = group;
+  #include "insn_group_list.h"
+  #undef DEFINE_INSN_GROUP
+
   #define DEFINE_INSN_UNCOND(name) { \
     insn_desc_t insn = { \
       name##_match, \
@@ -736,9 +1184,12 @@ void processor_t::register_base_instructions()
       logged_rv32i_##name, \
       logged_rv64i_##name, \
       logged_rv32e_##name, \
-      logged_rv64e_##name \
+      logged_rv64e_##name, \
+      machine_rv64i_##name, \
+      #name, \
+      name##_group \
     }; \
-    register_base_insn(insn); \
+    out.push_back(insn); \
   }
 
   // add overlapping instructions first, in order
@@ -760,9 +1211,7 @@ void processor_t::register_base_instructions()
   #undef DEFINE_INSN_UNCOND
 
   // terminate instruction list with a catch-all
-  register_base_insn(insn_desc_t::illegal_instruction);
-
-  build_opcode_map();
+  out.push_back(insn_desc_t::illegal_instruction);
 }
 
 bool processor_t::load(reg_t addr, size_t len, uint8_t* bytes)
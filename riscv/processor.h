@@ -9,7 +9,10 @@
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <memory>
+#include <algorithm>
 #include <cassert>
+#include <new>
 #include "debug_rom_defines.h"
 #include "entropy_source.h"
 #include "csrs.h"
@@ -17,6 +20,8 @@
 #include "triggers.h"
 #include "../fesvr/memif.h"
 #include "vector_unit.h"
+#include "startup_profile.h"
+#include "commit_log_filter.h"
 
 #define FIRST_HPMCOUNTER 3
 #define N_HPMCOUNTERS 29
@@ -28,6 +33,13 @@ class simif_t;
 class trap_t;
 class extension_t;
 class disassembler_t;
+class disasm_cache_t;
+class bbv_profiler_t;
+class call_tracer_t;
+class insn_trace_ring_t;
+class coverage_t;
+class cache_sampler_t;
+class dram_trace_t;
 
 reg_t illegal_instruction(processor_t* p, insn_t insn, reg_t pc);
 
@@ -43,9 +55,17 @@ struct insn_desc_t
   insn_func_t logged_rv64i;
   insn_func_t logged_rv32e;
   insn_func_t logged_rv64e;
-
-  insn_func_t func(int xlen, bool rve, bool logged) const
+  // Optional: RV64I without logging, for harts that only ever run in M-mode.
+  insn_func_t machine_rv64i;
+  // Optional: mnemonic (with '_' for '.') and instruction group, for
+  // --insn-stats. Custom instructions default to their extension's name.
+  const char* name;
+  const char* group;
+
+  insn_func_t func(int xlen, bool rve, bool logged, bool machine_only = false) const
   {
+    if (machine_only && machine_rv64i && !logged && !rve && xlen == 64)
+      return machine_rv64i;
     if (logged)
       if (rve)
         return xlen == 64 ? logged_rv64e : logged_rv32e;
@@ -61,8 +81,41 @@ struct insn_desc_t
   static const insn_desc_t illegal_instruction;
 };
 
-// regnum, data
-typedef std::map<reg_t, freg_t> commit_log_reg_t;
+// regnum, data. Kept sorted by regnum and iterated like a std::map, but flat:
+// it is cleared for every logged instruction, and clearing keeps the storage.
+class commit_log_reg_t
+{
+public:
+  typedef std::pair<reg_t, freg_t> value_type;
+  typedef std::vector<value_type>::iterator iterator;
+  typedef std::vector<value_type>::const_iterator const_iterator;
+
+  freg_t& operator[](reg_t key)
+  {
+    // instructions mostly write one register, or ascending groups of them
+    if (items.empty() || items.back().first < key) {
+      items.emplace_back(key, freg_t());
+      return items.back().second;
+    }
+    auto it = std::lower_bound(items.begin(), items.end(), key,
+                               [](const value_type& a, reg_t k) { return a.first < k; });
+    if (it == items.end() || it->first != key)
+      it = items.emplace(it, key, freg_t());
+    return it->second;
+  }
+
+  void clear() { items.clear(); }
+  void reserve(size_t n) { items.reserve(n); }
+  bool empty() const { return items.empty(); }
+  size_t size() const { return items.size(); }
+  iterator begin() { return items.begin(); }
+  iterator end() { return items.end(); }
+  const_iterator begin() const { return items.begin(); }
+  const_iterator end() const { return items.end(); }
+
+private:
+  std::vector<value_type> items;
+};
 
 // addr, value, size
 typedef std::vector<std::tuple<reg_t, uint64_t, uint8_t>> commit_log_mem_t;
@@ -74,12 +127,29 @@ struct state_t
   void reset(processor_t* const proc, reg_t max_isa);
   void add_csr(reg_t addr, const csr_t_p& csr);
 
+  // CSRs are made in csr_arena, which each csr_init replaces; hot ones
+  // share its hot region
+  template <class T, class... Args>
+  std::shared_ptr<T> make_csr(Args&&... args) {
+    return std::allocate_shared<T>(csr_allocator_t<T>(csr_arena, false), std::forward<Args>(args)...);
+  }
+  template <class T, class... Args>
+  std::shared_ptr<T> make_hot_csr(Args&&... args) {
+    return std::allocate_shared<T>(csr_allocator_t<T>(csr_arena, true), std::forward<Args>(args)...);
+  }
+
   reg_t pc;
   regfile_t<reg_t, NXPR, true> XPR;
   regfile_t<freg_t, NFPR, false> FPR;
 
   // control and status registers
+  std::shared_ptr<csr_arena_t> csr_arena;
   std::unordered_map<reg_t, csr_t_p> csrmap;
+  // csrmap indexed by address, so the CSR instructions need not hash;
+  // csrmap owns the entries. csr_basic marks exact basic_csr_t entries,
+  // which are accessed without virtual calls.
+  csr_t* csr_table[1 << 12] = {};
+  bool csr_basic[1 << 12] = {};
   reg_t prv;    // TODO: Can this be an enum instead?
   reg_t prev_prv;
   bool prv_changed;
@@ -95,6 +165,11 @@ struct state_t
   csr_t_p mcause;
   wide_counter_csr_t_p minstret;
   wide_counter_csr_t_p mcycle;
+  // Instructions retired by steps that left minstret and mcycle to count
+  // lazily; see wide_counter_csr_t. counters_dirty makes the current step
+  // bump them instead.
+  reg_t lazy_retired;
+  bool counters_dirty;
   mie_csr_t_p mie;
   mip_csr_t_p mip;
   csr_t_p nonvirtual_sip;
@@ -183,6 +258,9 @@ struct state_t
   csr_t_p vstopi;
 
   bool serialized; // whether timer CSRs are in a well-defined state
+  // Set by every write to mip, mie or their aliases; clear only while
+  // mip & mie is known to be zero, so no interrupt can be pending
+  bool irq_maybe_pending;
 
   // When true, execute a single instruction and then enter debug mode.  This
   // can only be set by executing dret.
@@ -248,6 +326,28 @@ class opcode_cache_entry_t {
   const insn_desc_t* contents[associativity];
 };
 
+// Receives each committed instruction while commit logging is enabled. The
+// state_t log_reg_write/log_mem_read/log_mem_write records describe its
+// effects and are only valid for the duration of the call.
+class commit_observer_t {
+ public:
+  virtual ~commit_observer_t() = default;
+  virtual void on_commit(processor_t* p, reg_t pc, insn_t insn) = 0;
+};
+
+// Cumulative per-hart counters, cleared by processor_t::clear_stats. The
+// MMU keeps its own in mmu_stats_t.
+struct hart_stats_t {
+  uint64_t exceptions[64] = {};     // traps taken, by cause
+  uint64_t interrupts[64] = {};     // interrupts taken, by cause
+  uint64_t opcode_cache_misses = 0; // decodes that fell back to the decode table
+};
+
+// Thrown in place of an MMIO load or store while the MMIO barrier is set.
+// The instruction is abandoned before the access and re-executes on the
+// next step.
+class mmio_barrier_t {};
+
 // this class represents one processor in a RISC-V machine.
 class processor_t : public abstract_device_t
 {
@@ -265,13 +365,88 @@ public:
   void set_histogram(bool value);
   void enable_log_commits();
   bool get_log_commits_enabled() const { return log_commits_enabled; }
+  bool get_log_commits_printed() const { return log_commits_printed; }
+  // Limits what enable_log_commits() prints to the commits filter accepts
+  // (or none, to print them all). filter must outlive the hart, and be
+  // set again whenever its ranges change.
+  void set_commit_log_filter(const commit_log_filter_t* filter);
+  bool commit_log_accepts(reg_t pc) const
+  {
+    return !log_filter || log_filter->accepts(pc, state.prv, log_filter_retired);
+  }
+  // Whether pc is in one of the filter's ranges, so never to be chained
+  bool commit_log_covers(reg_t pc) const { return log_filter && log_filter->covers(pc); }
+  // Turns on commit logging without printing to the log file unless asked;
+  // commits are delivered to every registered observer.
+  void add_commit_observer(commit_observer_t* observer);
+  void remove_commit_observer(commit_observer_t* observer);
+  const std::vector<commit_observer_t*>& get_commit_observers() const { return commit_observers; }
+  // While set, step() stops in front of any instruction that would access
+  // MMIO, so a driver can perform that access under its own control.
+  void set_mmio_barrier(bool value) { mmio_barrier = value; mmio_barrier_hit = false; }
+  bool get_mmio_barrier() const { return mmio_barrier; }
+  bool get_mmio_barrier_hit() const { return mmio_barrier_hit; }
+  // Run-until support: step() returns early once an instruction retires
+  // with pc at the stop pc (reg_t(-1) disarms), or after request_stop(),
+  // which may be called while an instruction executes. get_stop_hit() then
+  // holds until the next step().
+  void set_stop_pc(reg_t pc);
+  reg_t get_stop_pc() const { return stop_pc; }
+  void request_stop();
+  bool get_stop_hit() const { return stop_hit; }
+  // Integer registers (a bit mask) whose values an agent outside the hart,
+  // such as a co-simulated accelerator, has yet to write. While any are
+  // pending the hart runs its slow loop and stops, as if at the stop pc,
+  // before an instruction whose register fields might name one of them.
+  void set_xpr_pending(reg_t mask) { xpr_pending = mask; }
+  reg_t get_xpr_pending() const { return xpr_pending; }
+  // Reports retired instructions to a basic-block vector profiler (or none)
+  void set_bbv_profiler(bbv_profiler_t* profiler) { bbv_profiler = profiler; }
+  void set_call_tracer(call_tracer_t* tracer) { call_tracer = tracer; }
+  // Fed by the instruction handlers in a build with the ring tracer only
+  void set_insn_trace_ring(insn_trace_ring_t* ring) { insn_trace_ring = ring; }
+  insn_trace_ring_t* get_insn_trace_ring() const { return insn_trace_ring; }
+  // ... and to a cache sampler (or none)
+  void set_cache_sampler(cache_sampler_t* sampler) { cache_sampler = sampler; }
+  // ... and to a DRAM trace, for its timestamps (or none)
+  void set_dram_trace(dram_trace_t* trace) { dram_trace = trace; }
+  // Counts CSR accesses, traps, privilege changes and vtypes (or none)
+  void set_coverage(coverage_t* c) { coverage = c; }
+  coverage_t* get_coverage() const { return coverage; }
+  // Instruction mix: retirements per decoded instruction and privilege
+  // mode, kept in a dense table indexed like instructions then
+  // custom_instructions. Counted per block in the fast loop, like -g.
+  struct insn_count_t {
+    const char* name;
+    const char* group;
+    uint64_t count[4];   // by privilege mode (PRV_U, PRV_S, -, PRV_M)
+  };
+  void set_insn_stats(bool value);
+  bool get_insn_stats() const { return insn_stats_enabled; }
+  void count_insns(insn_bits_t bits, reg_t prv, uint64_t n);
+  // Returns the instructions retired at least once since enabled.
+  std::vector<insn_count_t> get_insn_counts();
+  void clear_insn_counts();
+  void print_insn_stats(FILE* out);
+  const hart_stats_t& get_stats() const { return stats; }
+  void clear_stats() { stats = hart_stats_t(); }
   void reset();
-  void step(size_t n); // run for n cycles
+  // Reallocates the vector registers, TLBs and icache from the calling
+  // thread (see mmu_t::rehome), which is to step this hart from now on
+  void rehome();
+  // Architectural state for sim_t checkpoints (see checkpoint.h): pc,
+  // privilege, X/F/V registers and every CSR. load_state throws
+  // std::runtime_error on a malformed checkpoint.
+  void save_state(checkpoint_writer_t& out) const override;
+  void load_state(checkpoint_reader_t& in) override;
+  size_t step(size_t n); // run for n cycles; returns those run, fewer after a trap or stop
   void put_csr(int which, reg_t val);
   uint32_t get_id() const { return id; }
   reg_t get_csr(int which, insn_t insn, bool write, bool peek = 0);
   reg_t get_csr(int which) { return get_csr(which, insn_t(0), false, true); }
   mmu_t* get_mmu() { return mmu; }
+  simif_t* get_sim() { return sim; }
+  const startup_profile_t& get_startup_profile() const { return startup_profile; }
   state_t* get_state() { return &state; }
   unsigned get_xlen() const { return xlen; }
   unsigned paddr_bits() { return isa.get_max_xlen() == 64 ? 56 : 34; }
@@ -339,15 +514,15 @@ public:
   void set_privilege(reg_t, bool);
   const char* get_privilege_string() const;
   void update_histogram(reg_t pc);
+  const insn_desc_t* lookup_insn_desc(insn_bits_t bits);
   const disassembler_t* get_disassembler() { return disassembler; }
+  // Formatted disassembly, memoised per hart
+  const std::string& disassemble(insn_t insn);
 
   FILE *get_log_file() { return log_file; }
 
-  void register_base_insn(insn_desc_t insn) {
-    register_insn(insn, false /* is_custom */);
-  }
   void register_custom_insn(insn_desc_t insn) {
-    register_insn(insn, true /* is_custom */);
+    register_insn(insn);
   }
   void register_extension(extension_t*);
 
@@ -377,8 +552,26 @@ public:
 
   void clear_waiting_for_interrupt() { in_wfi = false; };
   bool is_waiting_for_interrupt() { return in_wfi; };
+  // In WFI with no interrupt that would wake it, so step() would only spin.
+  // Hypervisor interrupt sources are not covered and never count as idle.
+  bool is_idle() const {
+    return in_wfi && !state.debug_mode && halt_request == HR_NONE &&
+           !extension_enabled('H') && !(state.mip->read() & state.mie->read());
+  }
 
-  void check_if_lpad_required();
+  void check_if_lpad_required()
+  {
+    if (unlikely(state.elp == elp_t::LP_EXPECTED))
+      check_lpad();
+  }
+
+  // Keeps t for step() to take when the instruction returns PC_TRAP (see
+  // raise_trap), which costs neither an allocation nor an unwind.
+  template<typename T> void stash_trap(const T& t)
+  {
+    static_assert(sizeof(T) <= sizeof(stashed_trap_storage) && alignof(T) <= alignof(mem_trap_t));
+    stashed_trap = new (stashed_trap_storage) T(t);
+  }
 
   reg_t select_an_interrupt_with_default_priority(reg_t enabled_interrupts) const;
 
@@ -389,12 +582,37 @@ private:
   simif_t* sim;
   mmu_t* mmu; // main memory is always accessed via the mmu
   std::unordered_map<std::string, extension_t*> custom_extensions;
-  disassembler_t* disassembler;
+  // The ISA's shared disassembler, or one of this hart's own on top of
+  // it once an extension adds instructions
+  const disassembler_t* disassembler;
+  std::unique_ptr<disassembler_t> custom_disassembler;
+  disasm_cache_t* disasm_cache;
   state_t state;
   uint32_t id;
   unsigned xlen;
   bool histogram_enabled;
+  // Whether commits are logged: with observers, or when printed and the
+  // filter (if any) accepts. The TLB and decoded handlers depend on it.
   bool log_commits_enabled;
+  bool log_commits_printed;
+  // Sets log_commits_enabled for a filter that does or does not accept now,
+  // flushing the TLB if it changes
+  void update_log_commits(bool filter_accepts);
+  const commit_log_filter_t* log_filter;
+  uint64_t log_filter_retired;  // instructions retired since reset
+  std::vector<commit_observer_t*> commit_observers;
+  bool mmio_barrier;
+  bool mmio_barrier_hit;
+  reg_t stop_pc;
+  bool stop_requested;
+  bool stop_hit;
+  reg_t xpr_pending;
+  bbv_profiler_t* bbv_profiler;
+  call_tracer_t* call_tracer;
+  insn_trace_ring_t* insn_trace_ring;
+  cache_sampler_t* cache_sampler;
+  dram_trace_t* dram_trace;
+  coverage_t* coverage;
   FILE *log_file;
   std::ostream sout_; // needed for socket command interface -s, also used for -d and -l, but not for --log
   bool halt_on_reset;
@@ -407,22 +625,90 @@ private:
   std::bitset<NUM_ISA_EXTENSIONS> extension_dynamic;
   mutable std::bitset<NUM_ISA_EXTENSIONS> extension_assumed_const;
 
-  std::vector<insn_desc_t> instructions;
   std::vector<insn_desc_t> custom_instructions;
+  bool machine_only_handlers;
+  startup_profile_t startup_profile;
   std::unordered_map<reg_t,uint64_t> pc_histogram;
+  bool insn_stats_enabled = false;
+  std::vector<uint64_t> insn_counts;   // [descriptor index * 4 + prv]
+  hart_stats_t stats;
 
   static const size_t OPCODE_CACHE_SIZE = 4095;
   opcode_cache_entry_t opcode_cache[OPCODE_CACHE_SIZE];
 
+  // Decode table consulted on opcode_cache misses. The first level is keyed
+  // on opcode[6:0] and funct3[14:12]; buckets that are still crowded (e.g.
+  // OP-V) are split again on funct7[31:25]. Each list holds every descriptor
+  // that can match an instruction with that key, custom ones first, in
+  // registration order, so the first hit is the same one a linear search of
+  // custom_instructions then instructions would find.
+  typedef std::vector<const insn_desc_t*> decode_list_t;
+  struct decode_bucket_t {
+    decode_list_t insns;
+    std::vector<decode_list_t> split;
+  };
+  static const size_t DECODE_TABLE_SIZE = 1 << 10;
+  static const size_t DECODE_SPLIT_SIZE = 1 << 7;
+  static const size_t DECODE_SPLIT_THRESHOLD = 16;
+  static void build_decode_table(std::vector<decode_bucket_t>& table,
+                                 std::initializer_list<const std::vector<insn_desc_t>*> lists);
+  static void split_decode_bucket(decode_bucket_t& bucket);
+  // Adds d to every bucket it can match, after the custom instructions
+  // already there
+  void insert_custom_decode(const insn_desc_t* d);
+
+  // The base instructions, their decode table and the disassembler depend
+  // only on the ISA and privilege strings, and never change once built, so
+  // every hart (of every simulator in the process) with the same strings
+  // shares one copy. The opcode cache and anything extensions add stay
+  // per hart.
+  struct isa_tables_t {
+    std::vector<insn_desc_t> instructions;
+    std::vector<decode_bucket_t> decode_table;
+    std::unique_ptr<const disassembler_t> disassembler;
+  };
+  std::shared_ptr<const isa_tables_t> isa_tables;
+  // isa_tables->decode_table, or custom_decode_table with custom instructions.
+  // That starts as a copy of the shared table; each extension's
+  // instructions are then inserted into the buckets they can match, unless
+  // custom_instructions has moved, which rebuilds it.
+  const std::vector<decode_bucket_t>* decode_table;
+  std::vector<decode_bucket_t> custom_decode_table;
+  const insn_desc_t* custom_decoded_base = nullptr;
+  size_t custom_decoded = 0;
+  static std::shared_ptr<const isa_tables_t> find_isa_tables(const processor_t* proc,
+                                                             const std::string& key);
+  static size_t decode_key(insn_bits_t bits) {
+    return (bits & 0x7f) | ((bits >> 5) & 0x380);
+  }
+  const decode_list_t& decode_candidates(insn_bits_t bits) const;
+
+  alignas(mem_trap_t) char stashed_trap_storage[sizeof(mem_trap_t)];
+  trap_t* stashed_trap = nullptr;
+
   unsigned ziccid_flush_count = 0;
   static const unsigned ZICCID_FLUSH_PERIOD = 10;
 
-  void take_pending_interrupt() { take_interrupt(state.mip->read() & state.mie->read()); }
+  void take_pending_interrupt()
+  {
+    if (likely(!state.irq_maybe_pending))
+      return;
+    // cleared first, so that a write racing with the reads below sets it again
+    state.irq_maybe_pending = false;
+    reg_t pending = state.mip->read() & state.mie->read();
+    // pending but disabled interrupts, and AIA's other sources, are checked
+    // on every step
+    if (pending || extension_enabled_const(EXT_SSAIA))
+      state.irq_maybe_pending = true;
+    take_interrupt(pending);
+  }
+  void check_lpad();
   void take_interrupt(reg_t mask); // take first enabled interrupt in mask
   void take_trap(trap_t& t, reg_t epc); // take an exception
+  void handle_trap(trap_t& t, reg_t epc); // take_trap, then debug and trigger follow-ups
   void take_trigger_action(triggers::action_t action, reg_t breakpoint_tval, reg_t epc, bool virt);
   void disasm(insn_t insn); // disassemble and print an instruction
-  void register_insn(insn_desc_t, bool);
+  void register_insn(insn_desc_t);
 
   void enter_debug_mode(uint8_t cause, uint8_t ext_cause);
 
@@ -435,7 +721,7 @@ private:
 
   void parse_priv_string(const char*);
   void build_opcode_map();
-  void register_base_instructions();
+  void register_base_instructions(std::vector<insn_desc_t>& out) const;
   insn_func_t decode_insn(insn_t insn);
 
   // Track repeated executions for processor_t::disasm()
@@ -136,7 +136,11 @@ void remote_bitbang_t::execute_commands()
         }
         recv_start++;
         total_processed++;
-        if (!in_rti && tap->state() == RUN_TEST_IDLE) {
+        // Let the harts run when a DMI access completes, but only if it
+        // started something they must finish; memory accesses over the
+        // system bus complete here, so a download is not held to one
+        // access per simulation quantum.
+        if (!in_rti && tap->state() == RUN_TEST_IDLE && tap->dm_needs_harts()) {
           entered_rti = true;
           break;
         }
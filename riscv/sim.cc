@@ -2,24 +2,39 @@
 
 #include "config.h"
 #include "sim.h"
+#include "difftest.h"
 #include "mmu.h"
 #include "dts.h"
 #include "remote_bitbang.h"
+#include "dmi_socket.h"
 #include "byteorder.h"
 #include "platform.h"
 #include "libfdt.h"
 #include "socketif.h"
+#include "checkpoint.h"
+#include "state_export.h"
+#include <algorithm>
 #include <fstream>
 #include <map>
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <cinttypes>
 #include <climits>
 #include <cstdlib>
 #include <cassert>
 #include <signal.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
 
 volatile bool ctrlc_pressed = false;
 static void handle_signal(int sig)
@@ -30,8 +45,6 @@ static void handle_signal(int sig)
   signal(sig, &handle_signal);
 }
 
-const size_t sim_t::INTERLEAVE;
-
 extern device_factory_t* clint_factory;
 extern device_factory_t* plic_factory;
 extern device_factory_t* ns16550_factory;
@@ -47,27 +60,42 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
              FILE *cmd_file, // needed for command line option --cmd
              std::optional<unsigned long long> instruction_limit)
   : htif_t(args),
+    interleave(cfg->interleave),
+    insns_per_rtc_tick(cfg->insns_per_rtc_tick),
     cfg(cfg),
     mems(mems),
     dtb_enabled(dtb_enabled),
-    log_file(log_path),
+    log_file(log_path, cfg->log_buffer_size, cfg->log_writer_thread),
     cmd_file(cmd_file),
     instruction_limit(instruction_limit),
+    instruction_budget(instruction_limit),
     sout_(nullptr),
     current_step(0),
     current_proc(0),
+    rtc_remainder(0),
+    guest_profiler(nullptr),
+    metrics_writer(nullptr),
+    difftest(nullptr),
+    rtc_now(0),
+    parallel_budget(0), round_budget(0),
+    hart_round(0),
+    harts_running(0),
+    hart_threads_stop(false),
     debug(false),
     histogram_enabled(false),
     log(false),
     remote_bitbang(NULL),
+    dmi_socket(NULL),
     debug_module(this, dm_config)
 {
   signal(SIGINT, &handle_signal);
 
   sout_.rdbuf(std::cerr.rdbuf()); // debug output goes to stderr by default
 
-  for (auto& x : mems)
+  for (auto& x : mems) {
     bus.add_device(x.first, x.second);
+    x.second->set_concurrent(cfg->parallel_harts);
+  }
 
   bus.add_device(DEBUG_START, &debug_module);
 
@@ -97,15 +125,31 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
 #endif
 
   debug_mmu = new mmu_t(this, cfg->endianness, NULL, cfg->cache_blocksz);
+  startup_profile.mark("bus");
 
-  // When running without using a dtb, skip the fdt-based configuration steps
-  if (!dtb_enabled) {
+  // Unless a DTB file or plugin devices have to be parsed, the harts and
+  // built-in devices come straight from cfg, as the generated DTS would
+  // describe them; that DTS and its DTB are made when first needed
+  // (get_dts, set_rom). Without a dtb there are no devices at all.
+  if (!dtb_enabled || (!dtb_file && plugin_device_factories.empty())) {
     for (size_t i = 0; i < cfg->nprocs(); i++) {
       procs.push_back(new processor_t(cfg->isa, cfg->priv,
                                       cfg, this, cfg->hartids[i], halted,
                                       log_file.get(), sout_));
       harts[cfg->hartids[i]] = procs[i];
     }
+    index_harts();
+    startup_profile.mark("harts");
+    if (!dtb_enabled)
+      return;
+
+    clint.reset(new clint_t(this, CPU_HZ / insns_per_rtc_tick, cfg->real_time_clint));
+    add_device(CLINT_BASE, clint);
+    plic.reset(new plic_t(this, PLIC_NDEV));
+    add_device(PLIC_BASE, plic);
+    add_device(NS16550_BASE, std::make_shared<ns16550_t>(plic.get(), NS16550_INTERRUPT_ID,
+                                                         NS16550_REG_SHIFT, NS16550_REG_IO_WIDTH));
+    save_initial_device_state();
     return;
   } // otherwise, generate the procs by parsing the DTS
 
@@ -143,9 +187,11 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
       const std::vector<std::string>& sargs = factory_sargs.second;
       device_nodes.append(factory->generate_dts(this, sargs));
     }
-    dts = make_dts(INSNS_PER_RTC_TICK, CPU_HZ, cfg, mems, device_nodes);
+    dts = make_dts(insns_per_rtc_tick, CPU_HZ, cfg, mems, device_nodes);
+    startup_profile.mark("dts");
     dtb = dts_to_dtb(dts);
   }
+  startup_profile.mark("dtb");
 
   int fdt_code = fdt_check_header(dtb.c_str());
   if (fdt_code) {
@@ -241,6 +287,8 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
 
     cpu_idx++;
   }
+  index_harts();
+  startup_profile.mark("harts");
 
   // must be located after procs/harts are set (devices might use sim_t get_* member functions)
   for (size_t i = 0; i < device_factories.size(); i++) {
@@ -264,15 +312,230 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
       }
     }
   }
+
+  save_initial_device_state();
+}
+
+void sim_t::save_initial_device_state()
+{
+  for (auto& dev : devices) {
+    checkpoint_writer_t w;
+    dev->save_state(w);
+    initial_device_state.push_back(std::move(w.data()));
+  }
+  startup_profile.mark("devices");
+}
+
+const char* sim_t::get_dts()
+{
+  if (dts.empty() && dtb_enabled) {
+    std::string device_nodes;
+    for (const device_factory_t* factory : {clint_factory, plic_factory, ns16550_factory})
+      device_nodes.append(factory->generate_dts(this, {}));
+    dts = make_dts(insns_per_rtc_tick, CPU_HZ, cfg, mems, device_nodes);
+  }
+  return dts.c_str();
+}
+
+const std::string& sim_t::get_dtb()
+{
+  if (dtb.empty()) {
+    dtb = dts_to_dtb(get_dts());
+    if (int fdt_code = fdt_check_header(dtb.c_str())) {
+      std::cerr << "Failed to read DTB from auto-generated DTS string: "
+                << fdt_strerror(fdt_code) << ".\n";
+      exit(-1);
+    }
+  }
+  return dtb;
 }
 
 sim_t::~sim_t()
 {
+  if (!hart_threads.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(hart_lock);
+      hart_threads_stop = true;
+    }
+    hart_start.notify_all();
+    for (auto &t : hart_threads)
+      t.join();
+  }
+
   for (size_t i = 0; i < procs.size(); i++)
     delete procs[i];
   delete debug_mmu;
 }
 
+// Pins the calling thread, which is to step hart i, to its CPU in
+// cfg->hart_cpus (round robin), then moves the hart's big tables to memory
+// it touches first, so that they sit on the node of the CPU running it.
+void sim_t::place_hart(size_t i)
+{
+  if (!cfg->hart_cpus.empty()) {
+    size_t cpu = cfg->hart_cpus[i % cfg->hart_cpus.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err)
+      fprintf(stderr, "warning: can't pin hart %zu to CPU %zu: %s\n",
+              i, cpu, strerror(err));
+  }
+  procs[i]->rehome();
+}
+
+void sim_t::hart_thread_main(size_t i)
+{
+  place_hart(i);
+
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(hart_lock);
+      hart_start.wait(lock, [&] { return hart_threads_stop || hart_round != seen; });
+      if (hart_threads_stop)
+        return;
+      seen = hart_round;
+    }
+
+    if (!cfg->skip_idle_harts || !procs[i]->is_idle())
+      procs[i]->step(round_quantum(i));
+
+    std::lock_guard<std::mutex> lock(hart_lock);
+    if (--harts_running == 0)
+      hart_finish.notify_one();
+  }
+}
+
+// Hart i's share of round_budget: a whole quantum in a full round, and
+// in a last, partial one what is left once the harts before it had theirs.
+size_t sim_t::round_quantum(size_t i) const
+{
+  size_t before = std::min(round_budget, i * interleave);
+  return std::min(interleave, round_budget - before);
+}
+
+void sim_t::run_parallel_round(size_t budget)
+{
+  if (hart_threads.empty()) {
+    for (auto p : procs)
+      p->get_mmu()->set_shared_memory(true);
+    for (size_t i = 1; i < procs.size(); i++)
+      hart_threads.emplace_back(&sim_t::hart_thread_main, this, i);
+    place_hart(0);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(hart_lock);
+    harts_running = procs.size() - 1;
+    round_budget = budget;
+    hart_round++;
+  }
+  hart_start.notify_all();
+
+  if (!cfg->skip_idle_harts || !procs[0]->is_idle())
+    procs[0]->step(round_quantum(0));
+
+  {
+    std::unique_lock<std::mutex> lock(hart_lock);
+    hart_finish.wait(lock, [&] { return harts_running == 0; });
+  }
+
+  for (auto p : procs)
+    p->get_mmu()->yield_load_reservation();
+  // a partial round only ever ends a run, as the sequential loop's would
+  if (budget == procs.size() * interleave)
+    end_round();
+}
+
+void sim_t::end_round()
+{
+  // Carry the remainder so that quanta shorter than a tick still advance time.
+  rtc_remainder += interleave;
+  reg_t rtc_ticks = rtc_remainder / insns_per_rtc_tick;
+  rtc_remainder %= insns_per_rtc_tick;
+  advance_rtc(rtc_ticks);
+
+  if (cfg->wfi_fast_forward)
+    fast_forward_idle();
+
+  if (unlikely(guest_profiler != nullptr))
+    guest_profiler->poll();
+  if (unlikely(metrics_writer != nullptr))
+    metrics_writer->poll();
+}
+
+void sim_t::fast_forward_idle()
+{
+  // With every hart asleep in WFI nothing can change until the next timer
+  // interrupt, so jump time straight to it instead of spinning rounds.
+  if (!clint)
+    return;
+  for (auto p : procs)
+    if (!p->is_idle())
+      return;
+
+  reg_t rtc_ticks = clint->ticks_to_next_deadline();
+  if (!rtc_ticks)
+    return;
+  // A far deadline is reached over several rounds, each jump small enough
+  // that the cycle count it adds cannot wrap
+  rtc_ticks = std::min<reg_t>(rtc_ticks, MAX_IDLE_SKIP_TICKS);
+
+  advance_rtc(rtc_ticks);
+
+  // Model the skipped time as CPI-1 cycles; nothing retired.
+  for (auto p : procs) {
+    state_t *state = p->get_state();
+    if (!(state->mcountinhibit->read() & MCOUNTINHIBIT_CY))
+      state->mcycle->bump(rtc_ticks * insns_per_rtc_tick);
+  }
+}
+
+void sim_t::advance_rtc(reg_t rtc_ticks)
+{
+  rtc_now += rtc_ticks;
+  // Devices due again now are queued after the loop, for the next round
+  while (!tick_events.empty() && tick_events.top().first <= rtc_now) {
+    size_t i = tick_events.top().second;
+    tick_events.pop();
+    devices[i]->tick(rtc_now - last_tick[i]);
+    last_tick[i] = rtc_now;
+    reg_t due = devices[i]->next_tick(rtc_now);
+    if (due != abstract_device_t::NO_TICK)
+      tick_rescheduled.emplace_back(due, i);
+  }
+  for (auto& e : tick_rescheduled)
+    tick_events.push(e);
+  tick_rescheduled.clear();
+}
+
+void sim_t::reschedule_devices()
+{
+  tick_events = decltype(tick_events)();
+  for (size_t i = 0; i < devices.size(); i++) {
+    last_tick[i] = rtc_now;
+    tick_events.emplace(rtc_now, i);
+  }
+}
+
+size_t sim_t::step_parallel(size_t n)
+{
+  const size_t round = procs.size() * interleave;
+  for (parallel_budget += n; parallel_budget >= round; parallel_budget -= round)
+    run_parallel_round(round);
+  return n;
+}
+
+void sim_t::flush_parallel_budget()
+{
+  if (parallel_budget) {
+    run_parallel_round(parallel_budget);
+    parallel_budget = 0;
+  }
+}
+
 int sim_t::run()
 {
   if (!debug && log)
@@ -285,30 +548,47 @@ int sim_t::run()
   return htif_t::run();
 }
 
-void sim_t::step(size_t n)
+size_t sim_t::step(size_t n)
 {
-  for (size_t i = 0, steps = 0; i < n; i += steps)
+  if (cfg->parallel_harts && procs.size() > 1)
+    return step_parallel(n);
+
+  size_t i = 0;
+  while (i < n)
   {
-    steps = std::min(n - i, INTERLEAVE - current_step);
-    procs[current_proc]->step(steps);
+    size_t steps = std::min(n - i, interleave - current_step);
+    bool stopped = false;
+    if (!cfg->skip_idle_harts || !procs[current_proc]->is_idle()) {
+      size_t run = procs[current_proc]->step(steps);
+      // the hart's quantum resumes after what it ran before stopping
+      if (unlikely(procs[current_proc]->get_stop_hit())) {
+        stopped = true;
+        steps = run;
+      }
+    }
 
     current_step += steps;
-    if (current_step == INTERLEAVE)
+    if (current_step == interleave)
     {
       current_step = 0;
       procs[current_proc]->get_mmu()->yield_load_reservation();
       if (++current_proc == procs.size()) {
         current_proc = 0;
-        reg_t rtc_ticks = INTERLEAVE / INSNS_PER_RTC_TICK;
-        for (auto &dev : devices) dev->tick(rtc_ticks);
+        end_round();
       }
     }
+    i += steps;
+    if (unlikely(stopped))
+      break;
   }
+  return i;
 }
 
 void sim_t::add_device(reg_t addr, std::shared_ptr<abstract_device_t> dev) {
   bus.add_device(addr, dev.get());
   devices.push_back(dev);
+  last_tick.push_back(rtc_now);
+  tick_events.emplace(rtc_now, devices.size() - 1);
 }
 
 void sim_t::set_debug(bool value)
@@ -336,6 +616,31 @@ void sim_t::configure_log(bool enable_log, bool enable_commitlog)
   }
 }
 
+void sim_t::set_commit_log_filter(const commit_log_filter_t& filter)
+{
+  commit_log_filter = filter;
+  commit_log_pc_ranges = filter.ranges;
+  // the symbols are added once the program is loaded
+  for (processor_t* proc : procs)
+    proc->set_commit_log_filter(&*commit_log_filter);
+}
+
+void sim_t::resolve_commit_log_filter()
+{
+  if (!commit_log_filter)
+    return;
+
+  commit_log_filter->ranges = commit_log_pc_ranges;
+  for (auto& name : commit_log_filter->symbols) {
+    if (auto range = get_symbol_range(name))
+      commit_log_filter->ranges.push_back(*range);
+    else
+      fprintf(stderr, "warning: commit log filter symbol %s not in ELF\n", name.c_str());
+  }
+  for (processor_t* proc : procs)
+    proc->set_commit_log_filter(&*commit_log_filter);
+}
+
 void sim_t::set_procs_debug(bool value)
 {
   for (size_t i=0; i< procs.size(); i++)
@@ -393,6 +698,7 @@ void sim_t::set_rom()
 
   std::vector<char> rom((char*)reset_vec, (char*)reset_vec + sizeof(reset_vec));
 
+  const std::string& dtb = get_dtb();
   rom.insert(rom.end(), dtb.begin(), dtb.end());
   const int align = 0x1000;
   rom.resize((rom.size() + align - 1) / align * align);
@@ -403,8 +709,8 @@ void sim_t::set_rom()
 
 char* sim_t::addr_to_mem(reg_t paddr) {
   auto desc = bus.find_device(paddr >> PGSHIFT << PGSHIFT, PGSIZE);
-  if (auto mem = dynamic_cast<abstract_mem_t*>(desc.second))
-    return mem->contents(paddr - desc.first);
+  if (desc.second)
+    return desc.second->host_contents(paddr - desc.first);
   return NULL;
 }
 
@@ -415,40 +721,342 @@ const char* sim_t::get_symbol(uint64_t paddr)
 
 // htif
 
+bool sim_t::is_address_preloaded(addr_t taddr, size_t len)
+{
+  for (auto& r : preloaded)
+    if (taddr >= r.first && taddr < r.second && len <= r.second - taddr)
+      return true;
+  return false;
+}
+
 void sim_t::reset()
 {
+  // the program that was preloaded has been loaded
+  preloaded.clear();
+  resolve_commit_log_filter();
+  if (dtb_enabled)
+    set_rom();
+  if (initial_checkpoint)
+    load_checkpoint(*initial_checkpoint);
+}
+
+void sim_t::reload(const std::string& path)
+{
+  rewind();
+  replace_program(path);
+  resolve_commit_log_filter();
   if (dtb_enabled)
     set_rom();
 }
 
+void sim_t::rewind()
+{
+  for (auto& [base, mem] : mems)
+    mem->clear();
+
+  for (size_t i = 0; i < initial_device_state.size(); i++) {
+    const std::vector<uint8_t>& state = initial_device_state[i];
+    checkpoint_reader_t r(state.data(), state.size());
+    devices[i]->load_state(r);
+  }
+
+  for (processor_t* p : procs) {
+    p->reset();
+    mmu_t* mmu = p->get_mmu();
+    mmu->flush_tlb();
+    mmu->flush_icache();
+    mmu->yield_load_reservation();
+  }
+
+  forget_program();
+  instruction_limit = instruction_budget;
+  current_step = 0;
+  current_proc = 0;
+  rtc_remainder = 0;
+  reschedule_devices();
+}
+
+void sim_t::print_hart_stats(std::ostream& out, size_t i)
+{
+  static const std::map<reg_t, const char*> cause_names = {
+#define DECLARE_CAUSE(name, code) { code, name },
+#include "encoding.h"
+#undef DECLARE_CAUSE
+  };
+
+  processor_t* p = get_core(i);
+  const mmu_stats_t& m = p->get_mmu()->get_stats();
+  const hart_stats_t& h = p->get_stats();
+  char line[256];
+  auto print = [&](const char* fmt, auto... args) {
+    snprintf(line, sizeof(line), fmt, args...);
+    out << "core" << std::setw(4) << i << ": " << line << std::endl;
+  };
+
+  print("tlb hits %" PRIu64 " misses %" PRIu64 " (fetch %" PRIu64 ", load %" PRIu64
+        ", store %" PRIu64 "; %" PRIu64 " from superpages), walks %" PRIu64
+        " (%" PRIu64 " from walk cache)",
+        m.tlb_hits, m.tlb_misses, m.tlb_misses_fetch, m.tlb_misses_load,
+        m.tlb_misses_store, m.superpage_hits, m.walks, m.walk_cache_hits);
+  print("icache hits %" PRIu64 " refills %" PRIu64 ", block links %" PRIu64
+        ", opcode cache misses %" PRIu64,
+        m.icache_hits, m.icache_refills, m.block_links, h.opcode_cache_misses);
+  print("slow path: tlb miss %" PRIu64 ", misaligned %" PRIu64 ", flagged page %" PRIu64
+        ", special %" PRIu64 "; mmio loads %" PRIu64 " stores %" PRIu64 " fetches %" PRIu64,
+        m.slow_tlb_miss, m.slow_misaligned, m.slow_flagged, m.slow_special,
+        m.mmio_loads, m.mmio_stores, m.mmio_fetches);
+  if (m.gstage_walks || m.gstage_hits)
+    print("g-stage walks %" PRIu64 " (%" PRIu64 " PTE loads), cache hits %" PRIu64,
+          m.gstage_walks, m.gstage_pte_loads, m.gstage_hits);
+  for (reg_t cause = 0; cause < 64; cause++) {
+    if (h.exceptions[cause]) {
+      auto it = cause_names.find(cause);
+      print("trap %s (%" PRIu64 "): %" PRIu64,
+            it != cause_names.end() ? it->second : "reserved", cause, h.exceptions[cause]);
+    }
+  }
+  for (reg_t cause = 0; cause < 64; cause++) {
+    if (h.interrupts[cause])
+      print("interrupt %" PRIu64 ": %" PRIu64, cause, h.interrupts[cause]);
+  }
+}
+
+void sim_t::clear_hart_stats()
+{
+  for (processor_t* p : procs) {
+    p->get_mmu()->clear_stats();
+    p->clear_stats();
+  }
+}
+
+// VmRSS and VmHWM of /proc/self/status, falling back to getrusage() for the
+// peak where there is no /proc
+static void process_rss(size_t& rss, size_t& peak)
+{
+  rss = peak = 0;
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmRSS:") == 0)
+      rss = strtoull(line.c_str() + 6, nullptr, 10) << 10;
+    else if (line.compare(0, 6, "VmHWM:") == 0)
+      peak = strtoull(line.c_str() + 6, nullptr, 10) << 10;
+  }
+  struct rusage ru;
+  if (!peak && getrusage(RUSAGE_SELF, &ru) == 0)
+    peak = size_t(ru.ru_maxrss) << 10;
+}
+
+footprint_t sim_t::get_footprint()
+{
+  footprint_t f;
+  for (auto& mem : mems) {
+    f.mem_bytes += mem.second->size();
+    f.mem_touched_bytes += mem.second->touched_bytes();
+  }
+  for (processor_t* p : procs) {
+    f.tlb_bytes += p->get_mmu()->tlb_bytes();
+    f.icache_bytes += p->get_mmu()->icache_bytes();
+    f.vreg_bytes += p->VU.VLEN / 8 * NVPR;
+  }
+  f.log_buffer_bytes = log_file.buffer_bytes();
+  process_rss(f.rss_bytes, f.peak_rss_bytes);
+  return f;
+}
+
+void sim_t::print_footprint(std::ostream& out)
+{
+  char line[256];
+  auto print = [&](const char* fmt, auto... args) {
+    snprintf(line, sizeof(line), fmt, args...);
+    out << "footprint: " << line << std::endl;
+  };
+  auto kib = [](uint64_t bytes) { return (bytes + 1023) >> 10; };
+
+  for (auto& mem : mems) {
+    reg_t size = mem.second->size(), touched = mem.second->touched_bytes();
+    print("mem 0x%" PRIx64 "+0x%" PRIx64 ": %" PRIu64 " KiB of %" PRIu64 " KiB touched (%.1f%%)",
+          mem.first, size, kib(touched), kib(size), size ? 100.0 * touched / size : 0.0);
+  }
+  for (size_t i = 0; i < procs.size(); i++) {
+    mmu_t* mmu = procs[i]->get_mmu();
+    print("core %zu: tlb %zu KiB, icache %zu KiB, vregs %zu KiB", i, kib(mmu->tlb_bytes()),
+          kib(mmu->icache_bytes()), kib(procs[i]->VU.VLEN / 8 * NVPR));
+  }
+  footprint_t f = get_footprint();
+  print("total: mem %" PRIu64 " KiB touched, tlb %zu KiB, icache %zu KiB, vregs %zu KiB, log buffers %zu KiB",
+        kib(f.mem_touched_bytes), kib(f.tlb_bytes), kib(f.icache_bytes), kib(f.vreg_bytes),
+        kib(f.log_buffer_bytes));
+  print("rss %zu KiB, peak %zu KiB", kib(f.rss_bytes), kib(f.peak_rss_bytes));
+}
+
+static std::runtime_error checkpoint_error(const std::string& what, const std::string& path)
+{
+  return std::runtime_error(what + " `" + path + "': " + strerror(errno));
+}
+
+bool sim_t::can_checkpoint() const
+{
+  for (auto& dev : devices)
+    if (!dev->checkpointable())
+      return false;
+  return true;
+}
+
+void sim_t::save_checkpoint(const std::string& path)
+{
+  if (!can_checkpoint())
+    throw std::runtime_error("Cannot checkpoint `" + path + "': a disk image is attached");
+
+  std::unique_ptr<FILE, int(*)(FILE*)> out(fopen(path.c_str(), "wb"), &fclose);
+  if (!out)
+    throw checkpoint_error("Failed to open checkpoint", path);
+
+  checkpoint_writer_t w;
+  w.put_bytes(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN);
+  w.put_u32(procs.size());
+  for (processor_t* p : procs) {
+    w.put_u32(p->get_id());
+    p->save_state(w);
+  }
+  w.put_u32(devices.size());
+  for (auto& dev : devices) {
+    checkpoint_writer_t d;
+    dev->save_state(d);
+    w.put_u64(d.data().size());
+    w.put_bytes(d.data().data(), d.data().size());
+  }
+
+  // Pages are streamed; all-zero ones are left out.
+  static const char zero_page[PGSIZE] = {0};
+  w.put_u32(mems.size());
+  for (auto& [base, mem] : mems) {
+    w.put_u64(base);
+    w.put_u64(mem->size());
+    mem->for_each_page([&](reg_t addr, char* page) {
+      if (memcmp(page, zero_page, PGSIZE) == 0)
+        return;
+      w.put_u64(addr);
+      w.put_bytes(page, PGSIZE);
+      if (w.data().size() >= (1 << 20)) {
+        fwrite(w.data().data(), 1, w.data().size(), out.get());
+        w.data().clear();
+      }
+    });
+    w.put_u64(reg_t(-1));
+  }
+  fwrite(w.data().data(), 1, w.data().size(), out.get());
+  if (ferror(out.get()) || fclose(out.release()) != 0)
+    throw checkpoint_error("Failed to write checkpoint", path);
+}
+
+void sim_t::load_checkpoint(const std::string& path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0)
+      close(fd);
+    throw checkpoint_error("Failed to open checkpoint", path);
+  }
+  size_t len = st.st_size;
+  void* data = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED)
+    throw checkpoint_error("Failed to map checkpoint", path);
+  std::unique_ptr<void, std::function<void(void*)>> mapping(data, [len](void* p) { munmap(p, len); });
+
+  checkpoint_reader_t r((const uint8_t*)data, len);
+  if (memcmp(r.get_bytes(CHECKPOINT_MAGIC_LEN), CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN) != 0)
+    throw std::runtime_error("`" + path + "' is not a checkpoint");
+
+  if (r.get_u32() != procs.size())
+    throw std::runtime_error("checkpoint harts do not match");
+  for (processor_t* p : procs) {
+    if (r.get_u32() != p->get_id())
+      throw std::runtime_error("checkpoint harts do not match");
+    p->load_state(r);
+  }
+
+  if (r.get_u32() != devices.size())
+    throw std::runtime_error("checkpoint devices do not match");
+  for (auto& dev : devices) {
+    size_t n = r.get_u64();
+    checkpoint_reader_t d(r.get_bytes(n), n);
+    dev->load_state(d);
+    if (d.remaining())
+      throw std::runtime_error("checkpoint device state does not match");
+  }
+
+  static const char zero_page[PGSIZE] = {0};
+  if (r.get_u32() != mems.size())
+    throw std::runtime_error("checkpoint memory layout does not match");
+  for (auto& [base, mem] : mems) {
+    if (r.get_u64() != base || r.get_u64() != mem->size())
+      throw std::runtime_error("checkpoint memory layout does not match");
+    // clear without dirtying pages that are already zero
+    mem->for_each_page([&](reg_t UNUSED addr, char* page) {
+      if (memcmp(page, zero_page, PGSIZE) != 0)
+        memset(page, 0, PGSIZE);
+    });
+    for (reg_t addr; (addr = r.get_u64()) != reg_t(-1); ) {
+      if (addr % PGSIZE != 0 || addr >= mem->size())
+        throw std::runtime_error("checkpoint memory layout does not match");
+      mem->store(addr, PGSIZE, r.get_bytes(PGSIZE));
+    }
+  }
+  external_writes++;
+
+  current_step = 0;
+  current_proc = 0;
+  rtc_remainder = 0;
+  reschedule_devices();
+}
+
 void sim_t::idle()
 {
   if (done())
     return;
 
+  if (unlikely(difftest != nullptr)) {
+    difftest->poll();
+    if (done())
+      return;
+  }
+
   if (debug || ctrlc_pressed)
     interactive();
   else {
     if (instruction_limit.has_value()) {
-      if (*instruction_limit < INTERLEAVE) {
-        // Final step.
-        step(*instruction_limit);
+      // a step cut short at a stop pc is only charged for the quanta it
+      // ran, and the run ends in the call that uses the budget up
+      size_t n = std::min<unsigned long long>(*instruction_limit, interleave);
+      *instruction_limit -= step(n);
+      if (*instruction_limit == 0) {
+        flush_parallel_budget();
         htif_exit(0);
-        *instruction_limit = 0;
         return;
       }
-      *instruction_limit -= INTERLEAVE;
+    } else {
+      step(interleave);
     }
-    step(INTERLEAVE);
   }
 
   if (remote_bitbang)
     remote_bitbang->tick();
+  if (dmi_socket)
+    dmi_socket->tick();
 }
 
 void sim_t::read_chunk(addr_t taddr, size_t len, void* dst)
 {
   assert(len == 8);
+  // Chunks are aligned, so one in RAM lies within a page; tohost polling
+  // and small transfers skip the debug MMU that way.
+  if (char* host = addr_to_mem(taddr)) {
+    memcpy(dst, host, len);
+    return;
+  }
   auto data = debug_mmu->to_target(debug_mmu->load<uint64_t>(taddr));
   memcpy(dst, &data, sizeof data);
 }
@@ -456,11 +1064,97 @@ void sim_t::read_chunk(addr_t taddr, size_t len, void* dst)
 void sim_t::write_chunk(addr_t taddr, size_t len, const void* src)
 {
   assert(len == 8);
+  if (char* host = addr_to_mem(taddr)) {
+    memcpy(host, src, len);
+    external_writes++;
+    return;
+  }
   target_endian<uint64_t> data;
   memcpy(&data, src, sizeof data);
   debug_mmu->store<uint64_t>(taddr, debug_mmu->from_target(data));
 }
 
+void sim_t::clear_chunk(addr_t taddr, size_t len)
+{
+  // Clear RAM a page at a time, leaving pages that are already zero
+  // untouched; anything else goes through chunks.
+  while (len > 0) {
+    size_t n = std::min(PGSIZE - (taddr % PGSIZE), reg_t(len));
+    char* host = addr_to_mem(taddr);
+    if (!host) {
+      htif_t::clear_chunk(taddr, n);
+    } else if (std::any_of(host, host + n, [](char c) { return c != 0; })) {
+      memset(host, 0, n);
+      external_writes++;
+    }
+    taddr += n;
+    len -= n;
+  }
+}
+
+bool sim_t::write_bulk(addr_t taddr, size_t len, const void* src)
+{
+  // Target memory holds bytes in target order, so copying raw bytes matches
+  // what write_chunk does through debug_mmu. Every page must be RAM.
+  if (taddr + len < taddr)
+    return false;
+  for (reg_t addr = taddr & ~reg_t(PGSIZE - 1); addr < taddr + len; addr += PGSIZE)
+    if (!addr_to_mem(addr))
+      return false;
+
+  const char* bytes = (const char*)src;
+  while (len > 0) {
+    size_t n = std::min(PGSIZE - (taddr % PGSIZE), reg_t(len));
+    char* host = addr_to_mem(taddr);
+    // Skipping unchanged bytes leaves zero-fill and shared image pages clean.
+    if (memcmp(host, bytes, n) != 0) {
+      memcpy(host, bytes, n);
+      external_writes++;
+    }
+    taddr += n;
+    bytes += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool sim_t::map_file(addr_t taddr, size_t len, int fd, uint64_t offset)
+{
+  // Target pages must be host pages for a memory to map them one by one
+  if (sysconf(_SC_PAGESIZE) != PGSIZE || (taddr | len | offset) % PGSIZE)
+    return false;
+  auto desc = bus.find_device(taddr, len);
+  auto mem = dynamic_cast<abstract_mem_t*>(desc.second);
+  if (!mem || !mem->map_file(taddr - desc.first, len, fd, offset))
+    return false;
+
+  // Host pointers into the pages replaced may be cached
+  external_writes++;
+  for (auto p : procs)
+    p->get_mmu()->flush_tlb();
+  return true;
+}
+
+bool sim_t::read_bulk(addr_t taddr, size_t len, void* dst)
+{
+  // As write_bulk: raw bytes are in target order, and every page must be RAM.
+  if (taddr + len < taddr)
+    return false;
+  for (reg_t addr = taddr & ~reg_t(PGSIZE - 1); addr < taddr + len; addr += PGSIZE)
+    if (!addr_to_mem(addr))
+      return false;
+
+  char* bytes = (char*)dst;
+  while (len > 0) {
+    size_t n = std::min(PGSIZE - (taddr % PGSIZE), reg_t(len));
+    memcpy(bytes, addr_to_mem(taddr), n);
+    taddr += n;
+    bytes += n;
+    len -= n;
+  }
+  return true;
+}
+
 endianness_t sim_t::get_target_endianness() const
 {
   return debug_mmu->is_target_big_endian()? endianness_big : endianness_little;
@@ -471,13 +1165,22 @@ void sim_t::proc_reset(unsigned id)
   debug_module.proc_reset(id);
 }
 
+void sim_t::index_harts()
+{
+  hart_table.clear();
+  for (auto [id, p] : harts) {
+    if (id >= HART_TABLE_LIMIT)
+      break;
+    hart_table.resize(id + 1, nullptr);
+    hart_table[id] = p;
+  }
+}
+
 // --- DPI / external helper API implementations ---
 
 processor_t* sim_t::get_core_by_id(unsigned hartid)
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return nullptr;
-  return it->second;
+  return get_hart(hartid);
 }
 
 int sim_t::dpi_step(size_t n)
@@ -487,6 +1190,15 @@ int sim_t::dpi_step(size_t n)
   return 0;
 }
 
+int sim_t::dpi_step_hart(unsigned hartid, size_t n)
+{
+  processor_t* p = get_hart(hartid);
+  if (!p)
+    return -1;
+  p->step(n);
+  return 0;
+}
+
 char* sim_t::dpi_addr_to_mem(reg_t paddr)
 {
   return addr_to_mem(paddr);
@@ -494,26 +1206,61 @@ char* sim_t::dpi_addr_to_mem(reg_t paddr)
 
 bool sim_t::dpi_read_mem(reg_t paddr, size_t len, void* dst)
 {
-  char* src = addr_to_mem(paddr);
-  if (!src) return false;
-  memcpy(dst, src, len);
+  // a range may span pages of different memories, or of a sparse mem_t
+  char* bytes = (char*)dst;
+  while (len > 0) {
+    size_t n = std::min(PGSIZE - (paddr % PGSIZE), reg_t(len));
+    char* src = addr_to_mem(paddr);
+    if (!src) return false;
+    memcpy(bytes, src, n);
+    paddr += n;
+    bytes += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool sim_t::dpi_write_mem(reg_t paddr, size_t len, const void* src)
+{
+  if (paddr + len < paddr)
+    return false;
+  for (reg_t addr = paddr & ~reg_t(PGSIZE - 1); addr < paddr + len; addr += PGSIZE)
+    if (!addr_to_mem(addr))
+      return false;
+
+  const char* bytes = (const char*)src;
+  bool changed = false;
+  while (len > 0) {
+    size_t n = std::min(PGSIZE - (paddr % PGSIZE), reg_t(len));
+    char* host = addr_to_mem(paddr);
+    if (memcmp(host, bytes, n) != 0) {
+      memcpy(host, bytes, n);
+      changed = true;
+    }
+    paddr += n;
+    bytes += n;
+    len -= n;
+  }
+
+  // the harts may have decoded the old bytes
+  if (changed) {
+    external_writes++;
+    for (auto p : procs)
+      p->get_mmu()->flush_icache();
+  }
   return true;
 }
 
 uint64_t sim_t::dpi_get_pc(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   return (uint64_t)p->get_state()->pc;
 }
 
 int sim_t::dpi_get_all_gprs(unsigned hartid, uint64_t out[32]) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   for (int i = 0; i < 32; ++i) {
     out[i] = (uint64_t)p->get_state()->XPR[i];
@@ -523,9 +1270,7 @@ int sim_t::dpi_get_all_gprs(unsigned hartid, uint64_t out[32]) const
 
 uint64_t sim_t::dpi_get_csr(unsigned hartid, uint32_t csr_addr) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   insn_t dummy(0);
   try {
@@ -546,86 +1291,68 @@ void sim_t::dpi_set_pc(reg_t addr) const
     procs[i]->get_state()->pc = addr;
 }
 
-// --- Add these to sim.cc (sim_t member implementations) ---
-
 int sim_t::dpi_get_all_fprs(unsigned hartid, uint64_t out[32]) const
 {
-  if (!out) return 0;
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
-  if (!p) return 0;
-  state_t* st = p->get_state();
-  if (!st) return 0;
-
-  // Copy raw representation of each FPR into out[i] (zero-extended)
-  for (int i = 0; i < 32; ++i) {
-    // sizeof element
-    size_t elem_bytes = sizeof(st->FPR[i]);
-    uint64_t val = 0;
-    size_t copy_bytes = elem_bytes > sizeof(uint64_t) ? sizeof(uint64_t) : elem_bytes;
-    std::memcpy(&val, &st->FPR[i], copy_bytes);
-    out[i] = val;
-  }
-  return 32;
+  processor_t* p = get_hart(hartid);
+  if (!out || !p) return 0;
+  return export_fprs(p, out, 1, nullptr);
 }
 
 int sim_t::dpi_get_all_vregs(unsigned hartid, uint64_t *out, int max_qwords) const
 {
-  if (!out || max_qwords <= 0) return 0;
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
-  if (!p) return 0;
+  processor_t* p = get_hart(hartid);
+  if (!out || max_qwords <= 0 || !p) return 0;
+  return export_vregs(p, out, max_qwords);
+}
 
-  vectorUnit_t &VU = p->VU;
-  if (!VU.reg_file) return 0;
-  reg_t VLEN = VU.get_vlen(); // bits
-  if (VLEN == 0) return 0;
+int sim_t::dpi_get_dirty_vregs(unsigned hartid, uint64_t *out, int max_qwords, uint32_t *mask)
+{
+  if (mask) *mask = 0;
+  if (!out || max_qwords < 0) return -1;
+  processor_t* p = get_hart(hartid);
+  if (!p) return -1;
 
-  size_t bytes_per_reg = (size_t)(VLEN >> 3);
-  const int nregs = 32; // architectural number of vector registers
-  size_t total_bytes = bytes_per_reg * (size_t)nregs;
-  size_t total_qwords = (total_bytes + 7) / 8;
+  vectorUnit_t &VU = p->VU;
+  if (!VU.reg_file || VU.get_vlen() == 0) return -1;
 
-  int to_write = (int) std::min<size_t>((size_t)max_qwords, total_qwords);
+  size_t bytes_per_reg = (size_t)(VU.get_vlen() >> 3);
+  size_t qwords_per_reg = (bytes_per_reg + 7) / 8;
   const uint8_t *base = reinterpret_cast<const uint8_t*>(VU.reg_file);
 
-  for (int q = 0; q < to_write; ++q) {
-    size_t byte_idx = (size_t)q * 8;
-    uint64_t val = 0;
-    if (byte_idx < total_bytes) {
-      size_t copy_bytes = std::min<size_t>(8, total_bytes - byte_idx);
-      std::memcpy(&val, base + byte_idx, copy_bytes);
-    }
-    out[q] = val;
+  // registers that don't fit stay dirty for the next call
+  uint32_t taken = 0;
+  int n = 0;
+  for (uint32_t d = VU.dirty; d; d &= d - 1) {
+    int r = __builtin_ctz(d);
+    if ((size_t)(n + 1) * qwords_per_reg > (size_t)max_qwords) break;
+    uint64_t *dst = out + (size_t)n * qwords_per_reg;
+    dst[qwords_per_reg - 1] = 0;
+    std::memcpy(dst, base + (size_t)r * bytes_per_reg, bytes_per_reg);
+    taken |= 1U << r;
+    n++;
   }
-  return to_write;
+  VU.take_dirty(taken);
+  if (mask) *mask = taken;
+  return n;
 }
 
 int sim_t::dpi_get_vlen(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   return (int) p->VU.get_vlen();
 }
 
 uint64_t sim_t::dpi_get_vlenb(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   return (uint64_t) p->VU.vlenb;
 }
 
 uint64_t sim_t::dpi_get_vxsat(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   // try VU csr pointer first
   if (p->VU.vxsat) return (uint64_t) p->VU.vxsat->read();
@@ -642,9 +1369,7 @@ uint64_t sim_t::dpi_get_vxsat(unsigned hartid) const
 
 uint64_t sim_t::dpi_get_vxrm(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   if (p->VU.vxrm) return (uint64_t) p->VU.vxrm->read();
   return 0;
@@ -652,9 +1377,7 @@ uint64_t sim_t::dpi_get_vxrm(unsigned hartid) const
 
 uint64_t sim_t::dpi_get_vstart(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   if (p->VU.vstart) return (uint64_t) p->VU.vstart->read();
   return 0;
@@ -662,9 +1385,7 @@ uint64_t sim_t::dpi_get_vstart(unsigned hartid) const
 
 uint64_t sim_t::dpi_get_vl(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   if (p->VU.vl) return (uint64_t) p->VU.vl->read();
   // fallback to vlmax
@@ -673,9 +1394,7 @@ uint64_t sim_t::dpi_get_vl(unsigned hartid) const
 
 uint64_t sim_t::dpi_get_vtype(unsigned hartid) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   if (p->VU.vtype) return (uint64_t) p->VU.vtype->read();
   // fallback: construct a basic vtype from vsew (encode in low bits)
@@ -686,9 +1405,7 @@ uint64_t sim_t::dpi_get_vtype(unsigned hartid) const
 
 uint64_t sim_t::dpi_get_vcsr(unsigned hartid, uint32_t csr_addr) const
 {
-  auto it = harts.find(hartid);
-  if (it == harts.end()) return 0;
-  processor_t* p = it->second;
+  processor_t* p = get_hart(hartid);
   if (!p) return 0;
   state_t* st = p->get_state();
   if (!st) return 0;
@@ -9,21 +9,40 @@
 #include "log_file.h"
 #include "processor.h"
 #include "simif.h"
+#include "guest_profiler.h"
+#include "metrics.h"
 
 #include <fesvr/htif.h>
 #include <vector>
 #include <map>
+#include <queue>
 #include <string>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <sys/types.h>
 
 class mmu_t;
 class remote_bitbang_t;
+class dmi_socket_t;
 class socketif_t;
+class difftest_t;
 
 // Type for holding a pair of device factory and device specialization arguments.
 using device_factory_sargs_t = std::pair<const device_factory_t*, std::vector<std::string>>;
 
+// Host memory the simulator is using, in bytes: the memory regions against
+// the pages of them touched so far, the TLBs, icaches and vector register
+// files summed over the harts, the log's buffers, and the process's RSS now
+// and at its peak (0 where the host does not say).
+struct footprint_t {
+  reg_t mem_bytes = 0, mem_touched_bytes = 0;
+  size_t tlb_bytes = 0, icache_bytes = 0, vreg_bytes = 0;
+  size_t log_buffer_bytes = 0;
+  size_t rss_bytes = 0, peak_rss_bytes = 0;
+};
+
 // this class encapsulates the processors and memory in a RISC-V machine.
 class sim_t : public htif_t, public simif_t
 {
@@ -44,39 +63,98 @@ public:
   void set_histogram(bool value);
   void add_device(reg_t addr, std::shared_ptr<abstract_device_t> dev);
 
+  // Checkpoints (format in checkpoint.h) hold every hart, device and memory
+  // region. Loading requires a simulator built with the same configuration;
+  // both throw std::runtime_error on failure. An initial checkpoint is
+  // loaded when the simulation starts, after the program. Saving is refused
+  // while a device that is not checkpointable (a disk) is attached.
+  bool can_checkpoint() const;
+  void save_checkpoint(const std::string& path);
+  void load_checkpoint(const std::string& path);
+  void set_initial_checkpoint(const std::string& path) { initial_checkpoint = path; }
+
+  // Back to power-on without rebuilding the simulator: every memory goes
+  // back to its initial contents (only the pages in use are touched), the
+  // devices present at construction are restored to their state then,
+  // every hart is reset and the program at path (the current one when
+  // empty) is loaded in place of the current program. Throws
+  // std::runtime_error on failure.
+  void reload(const std::string& path);
+  // The same, but with no program loaded: the next run() loads the one
+  // set with set_program
+  void rewind();
+  // Memory the first program load is to leave alone, its segments having
+  // been copied in already (see preload_elf); later loads write it all.
+  void set_preloaded(const std::vector<std::pair<reg_t, reg_t>>& ranges) { preloaded = ranges; }
+
   // Configure logging
   //
   // If enable_log is true, an instruction trace will be generated. If
   // enable_commitlog is true, so will the commit results
   void configure_log(bool enable_log, bool enable_commitlog);
+  // Limits the commit log to what filter accepts; its symbols are looked up
+  // each time a program is loaded, with a warning for those not found.
+  void set_commit_log_filter(const commit_log_filter_t& filter);
 
   void set_procs_debug(bool value);
   void set_remote_bitbang(remote_bitbang_t* remote_bitbang) {
     this->remote_bitbang = remote_bitbang;
   }
-  const char* get_dts() { return dts.c_str(); }
+  void set_dmi_socket(dmi_socket_t* dmi_socket) {
+    this->dmi_socket = dmi_socket;
+  }
+  // The device tree, generated on first use if it was not given
+  const char* get_dts();
   processor_t* get_core(size_t i) { return procs.at(i); }
   abstract_interrupt_controller_t* get_intctrl() const { assert(plic.get()); return plic.get(); }
   virtual const cfg_t &get_cfg() const override { return *cfg; }
 
   virtual const std::map<size_t, processor_t*>& get_harts() const override { return harts; }
+  virtual processor_t* get_hart(size_t hartid) const override {
+    if (likely(hartid < hart_table.size()))
+      return hart_table[hartid];
+    return hartid < HART_TABLE_LIMIT ? nullptr : simif_t::get_hart(hartid);
+  }
+  // Phases of the constructor; each hart keeps its own breakdown.
+  const startup_profile_t& get_startup_profile() const { return startup_profile; }
+  // Hot-path counters of core i: TLB, page walks, icache, slow-path
+  // reasons, MMIO, opcode-cache misses and traps by cause. clear_hart_stats
+  // resets them on every core.
+  void print_hart_stats(std::ostream& out, size_t i);
+  void clear_hart_stats();
+  // print_footprint lists each memory region and hart as well as the totals
+  footprint_t get_footprint();
+  void print_footprint(std::ostream& out);
+  // Polled at the end of every scheduling round (or none)
+  void set_guest_profiler(guest_profiler_t* profiler) { guest_profiler = profiler; }
+  void set_metrics_writer(metrics_writer_t* writer) { metrics_writer = writer; }
+  // Polled before every scheduling quantum of run() (or none)
+  void set_difftest(difftest_t* d) { difftest = d; }
 
   // Callback for processors to let the simulation know they were reset.
   virtual void proc_reset(unsigned id) override;
 
-  static const size_t INTERLEAVE = 5000;
-  static const size_t INSNS_PER_RTC_TICK = 100; // 10 MHz clock for 1 BIPS core
+  const size_t interleave;          // instructions per hart per round
+  const size_t insns_per_rtc_tick;  // 100: 10 MHz clock for 1 BIPS core
   static const size_t CPU_HZ = 1000000000; // 1GHz CPU
 
 private:
+  startup_profile_t startup_profile;
   const cfg_t * const cfg;
   std::vector<std::pair<reg_t, abstract_mem_t*>> mems;
   std::vector<processor_t*> procs;
   std::map<size_t, processor_t*> harts;
+  // harts indexed by hartid, up to the highest below HART_TABLE_LIMIT;
+  // only the few larger hartids are looked up in the map
+  static const size_t HART_TABLE_LIMIT = 4096;
+  std::vector<processor_t*> hart_table;
+  void index_harts();
   std::pair<reg_t, reg_t> initrd_range;
   std::string dts;
   std::string dtb;
   bool dtb_enabled;
+  const std::string& get_dtb();
+  void save_initial_device_state();
   std::vector<std::shared_ptr<abstract_device_t>> devices;
   std::shared_ptr<clint_t> clint;
   std::shared_ptr<plic_t> plic;
@@ -86,18 +164,68 @@ private:
   FILE *cmd_file; // pointer to debug command input file
 
   std::optional<unsigned long long> instruction_limit;
+  const std::optional<unsigned long long> instruction_budget; // the limit per run
+  std::optional<std::string> initial_checkpoint;
+  // save_state of each device at construction, for reload
+  std::vector<std::vector<uint8_t>> initial_device_state;
 
   socketif_t *socketif;
   std::ostream sout_; // used for socket and terminal interface
 
   processor_t* get_core(const std::string& i);
-  void step(size_t n); // step through simulation
+  // Steps through n instructions of simulation and returns how many it
+  // took: fewer when a hart stops at its stop pc
+  size_t step(size_t n);
   size_t current_step;
   size_t current_proc;
+
+  // With cfg->parallel_harts, every hart runs its interleave quantum on its
+  // own host thread and they meet at a barrier before reservations are
+  // yielded and devices tick, so a round is the same whatever the host
+  // timing as long as harts do not race on memory within one quantum.
+  // step(n) banks n and runs whole rounds of procs.size() * interleave;
+  // flush_parallel_budget() runs what is left as a last, partial round, in
+  // which the harts get what they would have in turn without threads.
+  size_t step_parallel(size_t n);
+  void flush_parallel_budget();
+  void end_round();
+  // the most ticks one fast_forward_idle jumps
+  static const reg_t MAX_IDLE_SKIP_TICKS = reg_t(1) << 32;
+  void fast_forward_idle();
+  size_t rtc_remainder;
+  guest_profiler_t* guest_profiler;
+  metrics_writer_t* metrics_writer;
+  std::optional<commit_log_filter_t> commit_log_filter;
+  std::vector<std::pair<reg_t, reg_t>> commit_log_pc_ranges;  // as given
+  void resolve_commit_log_filter();
+  difftest_t* difftest;
+
+  // Device ticks are events (due time, index in devices) in a heap, so a
+  // round only visits the devices that asked to be ticked by its end.
+  void advance_rtc(reg_t rtc_ticks);
+  void reschedule_devices();
+  typedef std::pair<reg_t, size_t> tick_event_t;
+  std::priority_queue<tick_event_t, std::vector<tick_event_t>, std::greater<tick_event_t>> tick_events;
+  std::vector<reg_t> last_tick;  // per device
+  std::vector<tick_event_t> tick_rescheduled;
+  reg_t rtc_now;
+  void run_parallel_round(size_t budget);
+  size_t round_quantum(size_t i) const;
+  void hart_thread_main(size_t i);
+  void place_hart(size_t i);
+  size_t parallel_budget;
+  size_t round_budget;  // of the round the hart threads are running
+  std::vector<std::thread> hart_threads;
+  std::mutex hart_lock;
+  std::condition_variable hart_start, hart_finish;
+  uint64_t hart_round;
+  size_t harts_running;
+  bool hart_threads_stop;
   bool debug;
   bool histogram_enabled; // provide a histogram of PCs
   bool log;
   remote_bitbang_t* remote_bitbang;
+  dmi_socket_t* dmi_socket;
   std::optional<std::function<void()>> next_interactive_action;
 
   // If padd corresponds to memory (as opposed to an I/O device), return a
@@ -131,6 +259,7 @@ private:
   void interactive_pc(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_insn(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_priv(const std::string& cmd, const std::vector<std::string>& args);
+  void interactive_stats(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_mem(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_str(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_dumpmems(const std::string& cmd, const std::vector<std::string>& args);
@@ -153,9 +282,15 @@ private:
   virtual void idle() override;
   virtual void read_chunk(addr_t taddr, size_t len, void* dst) override;
   virtual void write_chunk(addr_t taddr, size_t len, const void* src) override;
+  virtual void clear_chunk(addr_t taddr, size_t len) override;
   virtual size_t chunk_align() override { return 8; }
   virtual size_t chunk_max_size() override { return 8; }
+  virtual bool write_bulk(addr_t taddr, size_t len, const void* src) override;
+  virtual bool read_bulk(addr_t taddr, size_t len, void* dst) override;
+  virtual bool map_file(addr_t taddr, size_t len, int fd, uint64_t offset) override;
   virtual endianness_t get_target_endianness() const override;
+  virtual bool is_address_preloaded(addr_t taddr, size_t len) override;
+  std::vector<std::pair<reg_t, reg_t>> preloaded;
 
 public:
   // Initialize this after procs, because in debug_module_t::reset() we
@@ -176,6 +311,12 @@ public:
   // Step the simulator by n "steps" (calls private step()).
   // Return 0 on ok.
   int dpi_step(size_t n);
+  // Advances one hart by n instructions, outside the round-robin: no other
+  // hart runs and devices do not tick. Returns -1 for an unknown hartid.
+  int dpi_step_hart(unsigned hartid, size_t n);
+
+  // Processor that the next dpi_step will advance.
+  processor_t* dpi_next_proc() const { return procs[current_proc]; }
 
   // Return pointer to memory backing for physical address paddr (may be null).
   // This internally calls the private addr_to_mem(reg_t) helper.
@@ -183,6 +324,9 @@ public:
 
   // Read len bytes from physical address paddr into dst. Return true on success.
   bool dpi_read_mem(reg_t paddr, size_t len, void* dst);
+  // Write len bytes from src to physical address paddr, which must all be
+  // memory; nothing is written otherwise. Return true on success.
+  bool dpi_write_mem(reg_t paddr, size_t len, const void* src);
 
   // Convenience: get PC for hart (0 if not found).
   uint64_t dpi_get_pc(unsigned hartid) const;
@@ -199,6 +343,10 @@ public:
 
   int dpi_get_all_fprs(unsigned hartid, uint64_t out[32]) const;
   int dpi_get_all_vregs(unsigned hartid, uint64_t *out, int max_qwords) const;
+  // Copy only the vregs written since the previous call, packed in ascending
+  // order, and clear their dirty bits. *mask receives the registers copied.
+  // Returns the number of registers copied, or -1 on error.
+  int dpi_get_dirty_vregs(unsigned hartid, uint64_t *out, int max_qwords, uint32_t *mask);
   int dpi_get_vlen(unsigned hartid) const;
   uint64_t dpi_get_vlenb(unsigned hartid) const;
   uint64_t dpi_get_vxsat(unsigned hartid) const;
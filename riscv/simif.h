@@ -9,6 +9,7 @@
 
 class processor_t;
 class mmu_t;
+class input_log_t;
 
 // this is the interface to the simulator used by the processors and memory
 class simif_t
@@ -26,6 +27,12 @@ public:
 
   virtual const cfg_t &get_cfg() const = 0;
   virtual const std::map<size_t, processor_t*>& get_harts() const = 0;
+  // The hart with this hartid, or nullptr: get_harts().find, which
+  // implementations may answer from a table instead
+  virtual processor_t* get_hart(size_t hartid) const {
+    auto it = get_harts().find(hartid);
+    return it == get_harts().end() ? nullptr : it->second;
+  }
 
   virtual const char* get_symbol(uint64_t paddr) = 0;
 
@@ -34,6 +41,13 @@ public:
   unsigned nprocs() const { return get_cfg().nprocs(); }
 
   mmu_t* debug_mmu;  // debug port into main memory, for use by debug_module
+
+  // Bumped when memory is written other than by a hart (the host, DMA, the
+  // debug MMU), since fence.i only tracks a hart's own stores
+  uint64_t external_writes = 0;
+
+  // Records or replays the nondeterministic inputs, or null
+  input_log_t* input_log = nullptr;
 };
 
 #endif
@@ -34,24 +34,39 @@ std::string socketif_t::rin(std::ostream &sout_)
 {
   std::string s;
   try {
-    socket_ptr.reset(new boost::asio::ip::tcp::socket(*io_service_ptr));
-    acceptor_ptr->accept(*socket_ptr); // wait for someone to open connection
-    boost::asio::streambuf buf;
-    boost::asio::read_until(*socket_ptr, buf, "\n"); // wait for command
-    s = boost::asio::buffer_cast<const char*>(buf.data());
+    if (pending.empty()) {
+      socket_ptr.reset(new boost::asio::ip::tcp::socket(*io_service_ptr));
+      acceptor_ptr->accept(*socket_ptr); // wait for someone to open connection
+      boost::asio::streambuf buf;
+      boost::asio::read_until(*socket_ptr, buf, "\n"); // wait for command
+      // take whatever else has already arrived, up to a complete line
+      size_t more = socket_ptr->available();
+      if (more)
+        buf.commit(boost::asio::read(*socket_ptr, buf.prepare(more)));
+      std::string data(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_end(buf.data()));
+      if (data.back() != '\n') {
+        boost::asio::streambuf rest;
+        boost::asio::read_until(*socket_ptr, rest, "\n");
+        data.append(boost::asio::buffers_begin(rest.data()), boost::asio::buffers_end(rest.data()));
+      }
+      for (size_t start = 0, end; (end = data.find('\n', start)) != std::string::npos; start = end + 1)
+        pending.push_back(data.substr(start, end - start));
+    }
+    s = pending.front();
+    pending.pop_front();
     boost::erase_all(s, "\r");  // get rid off any cr and lf
-    boost::erase_all(s, "\n");
     // The socket client is a web server and it appends the IP of the computer
     // that sent the command from its web browser.
 
     // For now, erase the IP if it is there.
-    boost::regex re(" ((25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])\\.){3}"
-                    "(25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])$");
+    static const boost::regex re(" ((25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])\\.){3}"
+                                 "(25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])$");
     s = boost::regex_replace(s, re, (std::string)"");
 
     // TODO: check the IP against the IP used to upload RISC-V source files
   } catch (std::exception& e) {
     std::cerr << e.what() << std::endl;
+    pending.clear();
   }
   // output goes to socket
   sout_.rdbuf(&bout);
@@ -60,6 +75,9 @@ std::string socketif_t::rin(std::ostream &sout_)
 
 // write sout_ to socket (via bout)
 void socketif_t::wout() {
+  // the rest of the batch answers with this command
+  if (!pending.empty())
+    return;
   try {
     boost::system::error_code ignored_error;
     boost::asio::write(*socket_ptr, bout, boost::asio::transfer_all(), ignored_error);
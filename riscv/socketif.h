@@ -10,6 +10,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/regex.hpp>
 #include <boost/asio.hpp>
+#include <deque>
 
 class socketif_t
 {
@@ -17,10 +18,16 @@ public:
   socketif_t();
   ~socketif_t();
 
+  // A connection may carry several newline-terminated commands; they are
+  // returned one by one, and their output goes back in one reply when the
+  // last has run.
   std::string rin(std::ostream &sout_); // read input command string
   void wout(); // write output to socket
 
 private:
+  // commands received on the open connection but not returned yet
+  std::deque<std::string> pending;
+
   // the following are needed for command socket interface
   boost::asio::io_service *io_service_ptr;
   boost::asio::ip::tcp::acceptor *acceptor_ptr;
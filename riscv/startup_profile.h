@@ -0,0 +1,32 @@
+// See LICENSE for license details.
+#ifndef _RISCV_STARTUP_PROFILE_H
+#define _RISCV_STARTUP_PROFILE_H
+
+#include <chrono>
+#include <utility>
+#include <vector>
+
+// Wall-clock cost of the phases of constructing a simulator. Each mark()
+// records the time since the previous mark (or since construction).
+class startup_profile_t
+{
+public:
+  typedef std::vector<std::pair<const char*, double>> phases_t; // name, us
+
+  startup_profile_t() : last(clock_t::now()) {}
+
+  void mark(const char* phase) {
+    auto now = clock_t::now();
+    phases.emplace_back(phase, std::chrono::duration<double, std::micro>(now - last).count());
+    last = now;
+  }
+  const phases_t& get_phases() const { return phases; }
+
+private:
+  typedef std::chrono::steady_clock clock_t;
+
+  phases_t phases;
+  clock_t::time_point last;
+};
+
+#endif
@@ -0,0 +1,68 @@
+// See LICENSE for license details.
+
+#include "state_export.h"
+#include "processor.h"
+#include <algorithm>
+#include <cstring>
+
+template<unsigned FLEN>
+static uint8_t nan_boxing(const freg_t& f)
+{
+  if (FLEN == 128 && f.v[1] != UINT64_MAX)
+    return 0;
+  // Below Q only the low FLEN bits are the register's
+  const uint64_t lo = FLEN == 32 ? f.v[0] | 0xffffffff00000000 : f.v[0];
+  uint8_t b = FLEN == 128 ? FPR_BOXED_D : 0;
+  if (FLEN > 32 && lo >> 32 == 0xffffffff)
+    b |= FPR_BOXED_S;
+  if (lo >> 16 == 0xffffffffffff)
+    b |= FPR_BOXED_H;
+  return b;
+}
+
+template<unsigned FLEN, unsigned WORDS>
+static void export_fprs(const state_t* st, uint64_t* out, uint8_t* boxed)
+{
+  for (int i = 0; i < NFPR; i++) {
+    const freg_t& f = st->FPR[i];
+    out[i * WORDS] = f.v[0];
+    if (WORDS > 1)
+      out[i * WORDS + 1] = f.v[1];
+  }
+  if (boxed)
+    for (int i = 0; i < NFPR; i++)
+      boxed[i] = nan_boxing<FLEN>(st->FPR[i]);
+}
+
+template<unsigned WORDS>
+static void export_fprs(processor_t* p, uint64_t* out, uint8_t* boxed)
+{
+  const state_t* st = p->get_state();
+  switch (p->get_flen()) {
+    case 128: export_fprs<128, WORDS>(st, out, boxed); break;
+    case 64: export_fprs<64, WORDS>(st, out, boxed); break;
+    default: export_fprs<32, WORDS>(st, out, boxed); break;
+  }
+}
+
+int export_fprs(processor_t* p, uint64_t* out, unsigned words, uint8_t* boxed)
+{
+  if (words > 1)
+    export_fprs<2>(p, out, boxed);
+  else
+    export_fprs<1>(p, out, boxed);
+  return NFPR;
+}
+
+int export_vregs(processor_t* p, uint64_t* out, size_t max_qwords)
+{
+  const vectorUnit_t& VU = p->VU;
+  if (!VU.reg_file || !VU.VLEN)
+    return 0;
+  const size_t bytes = (VU.VLEN >> 3) * NVPR;
+  const size_t qwords = std::min(max_qwords, (bytes + 7) / 8);
+  const size_t copied = std::min(bytes, qwords * 8);
+  memcpy(out, VU.reg_file, copied);
+  memset((char*)out + copied, 0, qwords * 8 - copied);
+  return (int)qwords;
+}
@@ -0,0 +1,28 @@
+// See LICENSE for license details.
+#ifndef _RISCV_STATE_EXPORT_H
+#define _RISCV_STATE_EXPORT_H
+
+#include <cstddef>
+#include <cstdint>
+
+class processor_t;
+
+// Copies of a hart's register files into flat buffers, for the DPI getters:
+// written straight into the caller's buffer, with the loop picked once per
+// call by FLEN rather than per register.
+
+// Set in a boxed[] entry when the FPR holds a value NaN-boxed into FLEN
+// bits from half, single or double precision (from the narrower ones, too,
+// if those upper bits are ones as well)
+enum { FPR_BOXED_H = 1, FPR_BOXED_S = 2, FPR_BOXED_D = 4 };
+
+// Writes FPR i to out[i * words], as words 64-bit words, low first: 1 keeps
+// the low 64 bits, 2 all 128 of Q. boxed, if not null, gets the FPR_BOXED_*
+// bits of each FPR. Returns NFPR.
+int export_fprs(processor_t* p, uint64_t* out, unsigned words, uint8_t* boxed);
+
+// Writes the vector register file, v0 first, to out as up to max_qwords
+// 64-bit words, and returns how many it wrote (0 without V).
+int export_vregs(processor_t* p, uint64_t* out, size_t max_qwords);
+
+#endif
@@ -0,0 +1,70 @@
+// See LICENSE for license details.
+#ifndef _RISCV_STORE_SET_H
+#define _RISCV_STORE_SET_H
+
+#include "decode.h"
+#include <unordered_set>
+#include <vector>
+
+// The memory lines one MMU has written since they were last taken, so that
+// memory can be compared against another model at a cost proportional to
+// the stores rather than to its size, and apart from them the pages, taken
+// on their own by whoever caches something per page. Only the hart owning
+// the MMU adds.
+class store_set_t
+{
+ public:
+  // line_size must be a power of 2
+  explicit store_set_t(reg_t line_size) : line_shift(0), last_line(-1)
+  {
+    while ((reg_t(1) << line_shift) < line_size)
+      line_shift++;
+    page_shift = PAGE_SHIFT - line_shift;
+  }
+
+  reg_t line_size() const { return reg_t(1) << line_shift; }
+
+  void add(reg_t paddr, reg_t len)
+  {
+    reg_t first = paddr >> line_shift, last = (paddr + len - 1) >> line_shift;
+    // consecutive stores usually hit the line just added
+    if (first == last_line && last == last_line)
+      return;
+    for (reg_t line = first; line <= last; line++)
+      lines.insert(line);
+    for (reg_t page = first >> page_shift; page <= last >> page_shift; page++)
+      pages.insert(page);
+    last_line = last;
+  }
+
+  // Appends the address of every line written since the last take(), in
+  // no particular order, and forgets them.
+  void take(std::vector<reg_t>& out)
+  {
+    for (reg_t line : lines)
+      out.push_back(line << line_shift);
+    lines.clear();
+    last_line = -1;
+  }
+
+  // As take(), for the pages written since the last take_pages()
+  void take_pages(std::vector<reg_t>& out)
+  {
+    for (reg_t page : pages)
+      out.push_back(page << PAGE_SHIFT);
+    pages.clear();
+    // the next store to the last line must record its page again
+    last_line = -1;
+  }
+
+  size_t size() const { return lines.size(); }
+
+ private:
+  static const unsigned PAGE_SHIFT = 12;
+  unsigned line_shift, page_shift;
+  reg_t last_line;
+  std::unordered_set<reg_t> lines;
+  std::unordered_set<reg_t> pages;
+};
+
+#endif
@@ -3,9 +3,43 @@
 #ifndef _RISCV_TRACER_H
 #define _RISCV_TRACER_H
 
+#include "config.h"
 #include "processor.h"
 
-static inline void trace_opcode(processor_t UNUSED *p, insn_bits_t UNUSED opc, insn_t UNUSED insn) {
+// The per-instruction hook: every instruction handler calls trace_opcode
+// once the instruction has executed without trapping, with its pc, its bits
+// and the pc it goes to (PC_SERIALIZE_AFTER for one that serializes, whose
+// next pc is then in state.pc). In the logged handlers (--log-commits), the
+// processor's state.log_reg_write and log_mem_* also hold what it wrote.
+//
+// What the hook does is chosen when spike is built, as the policy class
+// insn_tracer_t with a static void retire(processor_t*, reg_t pc, insn_t,
+// reg_t npc): by default null_insn_tracer_t, which compiles to nothing, or
+// with --enable-insn-trace-ring one feeding the hart's insn_trace_ring_t,
+// if it has one. Another policy can be dropped in here the same way.
+struct null_insn_tracer_t {
+  static void retire(processor_t UNUSED *p, reg_t UNUSED pc, insn_t UNUSED insn,
+                     reg_t UNUSED npc) {}
+};
+
+#ifdef RISCV_ENABLE_INSN_TRACE_RING
+#include "insn_trace_ring.h"
+
+struct ring_insn_tracer_t {
+  static void retire(processor_t *p, reg_t pc, insn_t insn, reg_t npc) {
+    if (unlikely(p->get_insn_trace_ring() != nullptr))
+      p->get_insn_trace_ring()->push(pc, insn, invalid_pc(npc) ? p->get_state()->pc : npc);
+  }
+};
+
+typedef ring_insn_tracer_t insn_tracer_t;
+#else
+typedef null_insn_tracer_t insn_tracer_t;
+#endif
+
+static inline void trace_opcode(processor_t *p, insn_bits_t UNUSED opc, insn_t insn,
+                                reg_t pc, reg_t npc) {
+  insn_tracer_t::retire(p, pc, insn, npc);
 }
 
 #endif
@@ -2,6 +2,7 @@
 #include "debug_defines.h"
 #include "processor.h"
 #include "triggers.h"
+#include <algorithm>
 
 #define ASIDMAX(SXLEN) (SXLEN == 32 ? 9 : 16)
 #define SATP_ASID(SXLEN) (SXLEN == 32 ? SATP32_ASID : SATP64_ASID)
@@ -238,6 +239,34 @@ bool mcontrol_common_t::simple_match(unsigned xlen, reg_t value) const {
   assert(0);
 }
 
+std::optional<std::pair<reg_t, reg_t>> mcontrol_common_t::address_range() const
+{
+  if (select)
+    return std::nullopt;
+
+  switch (match) {
+    case MATCH_EQUAL:
+      return std::make_pair(tdata2, tdata2);
+    case MATCH_NAPOT:
+      {
+        // as simple_match computes the mask, in int
+        int bits = cto(tdata2) + 1;
+        if (bits >= 31)
+          return std::nullopt;
+        reg_t mask = ~((1 << bits) - 1);
+        return std::make_pair(tdata2 & mask, tdata2 | ~mask);
+      }
+    case MATCH_GE:
+      return std::make_pair(tdata2, reg_t(-1));
+    case MATCH_LT:
+      if (tdata2 == 0)
+        return std::make_pair(reg_t(1), reg_t(0));  // never
+      return std::make_pair(reg_t(0), tdata2 - 1);
+    default:
+      return std::nullopt;
+  }
+}
+
 std::optional<match_result_t> mcontrol_common_t::detect_memory_access_match(processor_t * const proc, operation_t operation, reg_t address, std::optional<reg_t> data) noexcept {
   if ((operation == triggers::OPERATION_EXECUTE && !execute) ||
       (operation == triggers::OPERATION_STORE && !store) ||
@@ -379,6 +408,33 @@ void icount_t::detect_icount_decrement(processor_t * const proc) noexcept
   }
 }
 
+reg_t icount_t::icount_budget(processor_t * const proc) noexcept
+{
+  budget_match = common_match(proc);
+  if (!budget_match || (count == 0 && !pending))
+    return -1;
+
+  // The instruction after the one that takes count to 0 fires
+  return pending ? 0 : count;
+}
+
+void icount_t::icount_retire(reg_t n) noexcept
+{
+  if (n == 0)
+    return;
+
+  if (budget_match && count > 0) {
+    // As if detect_icount_match() had run before each of them
+    count_read_value = count - (n - 1);
+    pending_read_value = false;
+    count -= n;
+    if (count == 0)
+      pending = true;
+  } else {
+    stash_read_values();
+  }
+}
+
 reg_t icount_t::tdata1_read(const processor_t * const proc) const noexcept
 {
   auto xlen = proc->get_xlen();
@@ -566,7 +622,7 @@ bool module_t::tdata1_write(unsigned index, const reg_t val) noexcept
   triggers[index]->tdata1_write(proc, tdata1, allow_chain);
   triggers[index]->tdata2_write(proc, tdata2);
   triggers[index]->tdata3_write(proc, tdata3);
-  proc->trigger_updated(triggers);
+  updated();
   return true;
 }
 
@@ -581,7 +637,7 @@ bool module_t::tdata2_write(unsigned index, const reg_t val) noexcept
     return false;
   }
   triggers[index]->tdata2_write(proc, val);
-  proc->trigger_updated(triggers);
+  updated();
   return true;
 }
 
@@ -596,16 +652,70 @@ bool module_t::tdata3_write(unsigned index, const reg_t val) noexcept
     return false;
   }
   triggers[index]->tdata3_write(proc, val);
-  proc->trigger_updated(triggers);
+  updated();
   return true;
 }
 
+void module_t::updated() noexcept
+{
+  for (auto& i : index) {
+    i.any = false;
+    i.ranges.clear();
+  }
+
+  for (auto trigger : triggers) {
+    bool ops[3];
+    ops[OPERATION_EXECUTE] = trigger->get_execute();
+    ops[OPERATION_STORE] = trigger->get_store();
+    ops[OPERATION_LOAD] = trigger->get_load();
+    auto range = trigger->address_range();
+    for (int op = 0; op < 3; op++) {
+      if (!ops[op])
+        continue;
+      if (!range)
+        index[op].any = true;
+      else if (range->first <= range->second)
+        index[op].ranges.push_back(*range);
+    }
+  }
+
+  for (auto& i : index) {
+    std::sort(i.ranges.begin(), i.ranges.end());
+    size_t n = 0;
+    for (auto& r : i.ranges) {
+      reg_t last = n ? i.ranges[n - 1].second : 0;
+      if (n && (r.first <= last || r.first - last == 1))
+        i.ranges[n - 1].second = std::max(last, r.second);
+      else
+        i.ranges[n++] = r;
+    }
+    i.ranges.resize(n);
+  }
+
+  proc->trigger_updated(triggers);
+}
+
+bool module_t::may_match(operation_t operation, reg_t lo, reg_t hi) const noexcept
+{
+  const range_index_t& i = index[operation];
+  if (i.any)
+    return true;
+  // the last range starting at or below hi is the only candidate
+  auto it = std::upper_bound(i.ranges.begin(), i.ranges.end(), std::make_pair(hi, reg_t(-1)));
+  return it != i.ranges.begin() && std::prev(it)->second >= lo;
+}
+
 std::optional<match_result_t> module_t::detect_memory_access_match(operation_t operation, reg_t address, std::optional<reg_t> data) noexcept
 {
   state_t * const state = proc->get_state();
   if (state->debug_mode)
     return std::nullopt;
 
+  // No trigger can match, so none sets hit either
+  reg_t value = proc->get_xlen() == 32 ? address & 0xffffffff : address;
+  if (!may_match(operation, value, value))
+    return std::nullopt;
+
   bool chain_ok = true;
 
   std::optional<match_result_t> ret = std::nullopt;
@@ -651,6 +761,23 @@ std::optional<match_result_t> module_t::detect_icount_match() noexcept
   return ret;
 }
 
+reg_t module_t::icount_budget() noexcept
+{
+  if (proc->get_state()->debug_mode)
+    return 0;
+
+  reg_t budget = -1;
+  for (auto trigger: triggers)
+    budget = std::min(budget, trigger->icount_budget(proc));
+  return budget;
+}
+
+void module_t::icount_retire(reg_t n) noexcept
+{
+  for (auto trigger: triggers)
+    trigger->icount_retire(n);
+}
+
 std::optional<match_result_t> module_t::detect_trap_match(const trap_t& t) noexcept
 {
   state_t * const state = proc->get_state();
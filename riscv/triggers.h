@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <optional>
+#include <utility>
 
 #include "decode.h"
 
@@ -89,11 +90,18 @@ public:
   virtual action_t get_action() const { return ACTION_DEBUG_EXCEPTION; }
   virtual bool icount_check_needed() const { return false; }
   virtual void stash_read_values() {}
+  // The addresses [first, second] outside which the trigger never matches
+  // a memory access, or nullopt if it may match any address
+  virtual std::optional<std::pair<reg_t, reg_t>> address_range() const { return std::nullopt; }
 
   virtual std::optional<match_result_t> detect_memory_access_match(processor_t UNUSED * const proc,
       operation_t UNUSED operation, reg_t UNUSED address, std::optional<reg_t> UNUSED data) noexcept { return std::nullopt; }
   virtual std::optional<match_result_t> detect_icount_fire(processor_t UNUSED * const proc) { return std::nullopt; }
   virtual void detect_icount_decrement(processor_t UNUSED * const proc) {}
+  // How many instructions may start in the current mode before the trigger
+  // fires, and the effect of n of them having started
+  virtual reg_t icount_budget(processor_t UNUSED * const proc) noexcept { return -1; }
+  virtual void icount_retire(reg_t UNUSED n) noexcept {}
   virtual std::optional<match_result_t> detect_trap_match(processor_t UNUSED * const proc, const trap_t UNUSED & t) noexcept { return std::nullopt; }
 
 protected:
@@ -212,6 +220,7 @@ public:
   virtual bool get_load() const override { return load; }
   virtual action_t get_action() const override { return action; }
   virtual void set_hit(hit_t val) = 0;
+  virtual std::optional<std::pair<reg_t, reg_t>> address_range() const override;
 
   virtual std::optional<match_result_t> detect_memory_access_match(processor_t * const proc,
       operation_t operation, reg_t address, std::optional<reg_t> data) noexcept override;
@@ -268,9 +277,12 @@ public:
 
   virtual std::optional<match_result_t> detect_icount_fire(processor_t * const proc) noexcept override;
   virtual void detect_icount_decrement(processor_t * const proc) noexcept override;
+  virtual reg_t icount_budget(processor_t * const proc) noexcept override;
+  virtual void icount_retire(reg_t n) noexcept override;
 
 private:
   bool dmode = false;
+  bool budget_match = false;  // common_match() when icount_budget() was taken
   bool hit = false;
   unsigned count = 1, count_read_value = 1;
   bool pending = false, pending_read_value = false;
@@ -296,9 +308,30 @@ public:
   std::optional<match_result_t> detect_icount_match() noexcept;
   std::optional<match_result_t> detect_trap_match(const trap_t& t) noexcept;
 
+  // Instead of detect_icount_match() before every instruction: the number
+  // of instructions that can start, without a privilege or trigger state
+  // change, before an icount trigger may fire; and, once up to that many
+  // have started, their combined effect on the counts.
+  reg_t icount_budget() noexcept;
+  void icount_retire(reg_t n) noexcept;
+
+  // Whether a trigger for operation may match an address in [lo, hi]
+  // (as seen by the triggers, after pointer masking and RV32 truncation).
+  bool may_match(operation_t operation, reg_t lo, reg_t hi) const noexcept;
+
   processor_t *proc;
 private:
+  void updated() noexcept;
+
   std::vector<trigger_t *> triggers;
+
+  // Per operation_t, the merged, sorted address ranges of the triggers
+  // armed for it, so that most accesses are rejected with a lookup
+  struct range_index_t {
+    bool any = false;  // some trigger may match any address
+    std::vector<std::pair<reg_t, reg_t>> ranges;
+  };
+  range_index_t index[3];
 };
 
 }
@@ -5,6 +5,7 @@
 
 #include "vector_unit.h"
 #include "zvbdot.h"
+#include "host_cpu.h"
 #include <functional>
 
 //
@@ -665,42 +666,234 @@ static inline bool is_overlapped_widen(const int astart, int asize,
     REDUCTION_ULOOP(e64, BODY) \
   }
 
-// genearl VXI signed/unsigned loop
-#define VI_VV_ULOOP(BODY) \
-  VI_CHECK_SSS(true) \
-  VI_LOOP_BASE \
+//
+// vector: whole-group fast path of the VXI loops below, for unmasked
+// instructions starting at element 0. The body runs over contiguous
+// elements without a per-element lookup; vd may only overlap a source
+// exactly, so the iterations are independent.
+//
+#ifdef WORDS_BIGENDIAN
+# define VI_GROUP_FAST_PATH false
+#else
+# define VI_GROUP_FAST_PATH (insn.v_vm() == 1 && P.VU.vstart->read() == 0)
+#endif
+
+//
+// vector: mask instructions a word of elements at a time with mask_word()
+// and set_mask_word(), on the hosts where mask bits are in word order
+//
+#ifdef WORDS_BIGENDIAN
+# define VI_MASK_FAST_PATH false
+#else
+# define VI_MASK_FAST_PATH true
+#endif
+
+//
+// vector: VI_GROUP_FAST_PATH of vrgather, vd[i] = vs2[INDEX] with INDEX
+// below vlmax and 0 otherwise. vd overlaps no source.
+//
+#define VI_GATHER_EI16_SETUP(T) \
+  const uint16_t *vs1_p = P.VU.elt_span<uint16_t>(rs1_num, vl);
+#define VI_GATHER_SCALAR_SETUP(T)
+
+#define VI_GATHER_GROUP_LOOP_SEW(x, SETUP, INDEX) \
+  { \
+    typedef type_usew_t<x>::type elt_t; \
+    elt_t *vd_p = P.VU.elt_span<elt_t>(rd_num, vl, true); \
+    const elt_t *vs2_p = P.VU.elt_span<elt_t>(rs2_num, vlmax); \
+    SETUP(elt_t) \
+    for (reg_t i = 0; i < vl; ++i) { \
+      reg_t index = INDEX; \
+      vd_p[i] = index >= vlmax ? 0 : vs2_p[index]; \
+    } \
+  }
+
+#define VI_GATHER_GROUP_LOOP(SETUP, INDEX) \
+  require(P.VU.vsew >= e8 && P.VU.vsew <= e64); \
+  require_vector(true); \
+  { \
+    reg_t vl = P.VU.vl->read(); \
+    reg_t vlmax = P.VU.vlmax; \
+    reg_t sew = P.VU.vsew; \
+    reg_t rd_num = insn.rd(); \
+    reg_t UNUSED rs1_num = insn.rs1(); \
+    reg_t rs2_num = insn.rs2(); \
+    if (sew == e8) { \
+      VI_GATHER_GROUP_LOOP_SEW(e8, SETUP, INDEX) \
+    } else if (sew == e16) { \
+      VI_GATHER_GROUP_LOOP_SEW(e16, SETUP, INDEX) \
+    } else if (sew == e32) { \
+      VI_GATHER_GROUP_LOOP_SEW(e32, SETUP, INDEX) \
+    } else { \
+      VI_GATHER_GROUP_LOOP_SEW(e64, SETUP, INDEX) \
+    } \
+  } \
+  P.VU.vstart->write(0);
+
+#define VV_GROUP_SETUP(T) \
+  const T *vs1_p = P.VU.elt_span<T>(rs1_num, vl);
+#define VX_GROUP_SETUP(T) \
+  T rs1 = (T)RS1;
+#define VI_GROUP_SETUP(T) \
+  T UNUSED simm5 = (T)insn.v_simm5();
+#define VI_U_GROUP_SETUP(T) \
+  T UNUSED zimm5 = (T)insn.v_zimm5();
+
+#define VV_GROUP_PARAMS(T) \
+  T UNUSED &vd = vd_p[i]; \
+  T vs1 = vs1_p[i]; \
+  T UNUSED vs2 = vs2_p[i];
+#define VX_GROUP_PARAMS(T) \
+  T UNUSED &vd = vd_p[i]; \
+  T UNUSED vs2 = vs2_p[i];
+
+#define VI_GROUP_LOOP_SEW(TYPE, x, SETUP, PARAMS, BODY) \
+  { \
+    typedef TYPE<x>::type elt_t; \
+    elt_t *vd_p = P.VU.elt_span<elt_t>(rd_num, vl, true); \
+    const elt_t *vs2_p = P.VU.elt_span<elt_t>(rs2_num, vl); \
+    SETUP(elt_t) \
+    for (reg_t i = 0; i < vl; ++i) { \
+      PARAMS(elt_t) \
+      BODY; \
+    } \
+  }
+
+#define VI_GROUP_LOOP_BASE \
+  require(P.VU.vsew >= e8 && P.VU.vsew <= e64); \
+  require_vector(true); \
+  reg_t vl = P.VU.vl->read(); \
+  reg_t UNUSED sew = P.VU.vsew; \
+  reg_t UNUSED rd_num = insn.rd(); \
+  reg_t UNUSED rs1_num = insn.rs1(); \
+  reg_t rs2_num = insn.rs2();
+
+#define VI_GROUP_LOOP_END \
+  P.VU.vstart->write(0);
+
+#define VI_GROUP_LOOP(TYPE, SETUP, PARAMS, BODY) \
+  VI_GROUP_LOOP_BASE \
   if (sew == e8) { \
-    VV_U_PARAMS(e8); \
-    BODY; \
+    VI_GROUP_LOOP_SEW(TYPE, e8, SETUP, PARAMS, BODY) \
   } else if (sew == e16) { \
-    VV_U_PARAMS(e16); \
-    BODY; \
+    VI_GROUP_LOOP_SEW(TYPE, e16, SETUP, PARAMS, BODY) \
   } else if (sew == e32) { \
-    VV_U_PARAMS(e32); \
-    BODY; \
+    VI_GROUP_LOOP_SEW(TYPE, e32, SETUP, PARAMS, BODY) \
   } else if (sew == e64) { \
-    VV_U_PARAMS(e64); \
-    BODY; \
+    VI_GROUP_LOOP_SEW(TYPE, e64, SETUP, PARAMS, BODY) \
   } \
-  VI_LOOP_END
+  VI_GROUP_LOOP_END
 
-#define VI_VV_LOOP(BODY) \
-  VI_CHECK_SSS(true) \
-  VI_LOOP_BASE \
+//
+// vector: the same over host SIMD vectors (GCC/Clang vector extensions),
+// for bodies that are plain element-wise arithmetic: BODY is evaluated on
+// whole host vectors, then on the remaining elements. sew is narrowed to
+// a constant of the element type so that it can be combined with a vector.
+// With HOST_SIMD_CLONES the vectors are 64 bytes and each clone lowers
+// them to its own registers; 16-byte vectors then pick up what is left,
+// so short groups still run on SIMD.
+//
+#if defined(__AVX512BW__) || HOST_SIMD_CLONES
+# define VI_GROUP_SIMD_BYTES 64
+#elif defined(__AVX2__)
+# define VI_GROUP_SIMD_BYTES 32
+#else
+# define VI_GROUP_SIMD_BYTES 16
+#endif
+
+#define VV_SIMD_LOAD(V) \
+  V vs1; \
+  memcpy(&vs1, vs1_p + i, sizeof(V));
+#define VX_SIMD_LOAD(V)
+
+#define VI_GROUP_SIMD_CHUNKS(BYTES, LOAD, BODY) \
+    { \
+      typedef elt_t vec_t __attribute__((vector_size(BYTES))); \
+      const reg_t lanes = sizeof(vec_t) / sizeof(elt_t); \
+      for (; i + lanes <= vl; i += lanes) { \
+        vec_t vd, vs2; \
+        memcpy(&vd, vd_p + i, sizeof(vec_t)); \
+        memcpy(&vs2, vs2_p + i, sizeof(vec_t)); \
+        LOAD(vec_t) \
+        BODY; \
+        memcpy(vd_p + i, &vd, sizeof(vec_t)); \
+      } \
+    }
+
+#define VI_GROUP_SIMD_LOOP_SEW(TYPE, x, SETUP, LOAD, PARAMS, BODY) \
+  { \
+    typedef TYPE<x>::type elt_t; \
+    constexpr elt_t UNUSED sew = x; \
+    elt_t *vd_p = P.VU.elt_span<elt_t>(rd_num, vl, true); \
+    const elt_t *vs2_p = P.VU.elt_span<elt_t>(rs2_num, vl); \
+    SETUP(elt_t) \
+    reg_t i = 0; \
+    VI_GROUP_SIMD_CHUNKS(VI_GROUP_SIMD_BYTES, LOAD, BODY) \
+    if (VI_GROUP_SIMD_BYTES > 16) \
+      VI_GROUP_SIMD_CHUNKS(16, LOAD, BODY) \
+    for (; i < vl; ++i) { \
+      PARAMS(elt_t) \
+      BODY; \
+    } \
+  }
+
+#define VI_GROUP_SIMD_LOOP(TYPE, SETUP, LOAD, PARAMS, BODY) \
+  VI_GROUP_LOOP_BASE \
   if (sew == e8) { \
-    VV_PARAMS(e8); \
-    BODY; \
+    VI_GROUP_SIMD_LOOP_SEW(TYPE, e8, SETUP, LOAD, PARAMS, BODY) \
   } else if (sew == e16) { \
-    VV_PARAMS(e16); \
-    BODY; \
+    VI_GROUP_SIMD_LOOP_SEW(TYPE, e16, SETUP, LOAD, PARAMS, BODY) \
   } else if (sew == e32) { \
-    VV_PARAMS(e32); \
-    BODY; \
+    VI_GROUP_SIMD_LOOP_SEW(TYPE, e32, SETUP, LOAD, PARAMS, BODY) \
   } else if (sew == e64) { \
-    VV_PARAMS(e64); \
-    BODY; \
+    VI_GROUP_SIMD_LOOP_SEW(TYPE, e64, SETUP, LOAD, PARAMS, BODY) \
   } \
-  VI_LOOP_END
+  VI_GROUP_LOOP_END
+
+// genearl VXI signed/unsigned loop
+#define VI_VV_ULOOP(BODY) \
+  VI_CHECK_SSS(true) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_GROUP_LOOP(type_usew_t, VV_GROUP_SETUP, VV_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_LOOP_BASE \
+    if (sew == e8) { \
+      VV_U_PARAMS(e8); \
+      BODY; \
+    } else if (sew == e16) { \
+      VV_U_PARAMS(e16); \
+      BODY; \
+    } else if (sew == e32) { \
+      VV_U_PARAMS(e32); \
+      BODY; \
+    } else if (sew == e64) { \
+      VV_U_PARAMS(e64); \
+      BODY; \
+    } \
+    VI_LOOP_END \
+  }
+
+#define VI_VV_LOOP(BODY) \
+  VI_CHECK_SSS(true) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_GROUP_LOOP(type_sew_t, VV_GROUP_SETUP, VV_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_LOOP_BASE \
+    if (sew == e8) { \
+      VV_PARAMS(e8); \
+      BODY; \
+    } else if (sew == e16) { \
+      VV_PARAMS(e16); \
+      BODY; \
+    } else if (sew == e32) { \
+      VV_PARAMS(e32); \
+      BODY; \
+    } else if (sew == e64) { \
+      VV_PARAMS(e64); \
+      BODY; \
+    } \
+    VI_LOOP_END \
+  }
 
 #define VI_V_ULOOP(BODY) \
   VI_CHECK_SSS(false) \
@@ -722,75 +915,140 @@ static inline bool is_overlapped_widen(const int astart, int asize,
 
 #define VI_VX_ULOOP(BODY) \
   VI_CHECK_SSS(false) \
-  VI_LOOP_BASE \
-  if (sew == e8) { \
-    VX_U_PARAMS(e8); \
-    BODY; \
-  } else if (sew == e16) { \
-    VX_U_PARAMS(e16); \
-    BODY; \
-  } else if (sew == e32) { \
-    VX_U_PARAMS(e32); \
-    BODY; \
-  } else if (sew == e64) { \
-    VX_U_PARAMS(e64); \
-    BODY; \
-  } \
-  VI_LOOP_END
+  if (VI_GROUP_FAST_PATH) { \
+    VI_GROUP_LOOP(type_usew_t, VX_GROUP_SETUP, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_LOOP_BASE \
+    if (sew == e8) { \
+      VX_U_PARAMS(e8); \
+      BODY; \
+    } else if (sew == e16) { \
+      VX_U_PARAMS(e16); \
+      BODY; \
+    } else if (sew == e32) { \
+      VX_U_PARAMS(e32); \
+      BODY; \
+    } else if (sew == e64) { \
+      VX_U_PARAMS(e64); \
+      BODY; \
+    } \
+    VI_LOOP_END \
+  }
 
 #define VI_VX_LOOP(BODY) \
   VI_CHECK_SSS(false) \
-  VI_LOOP_BASE \
-  if (sew == e8) { \
-    VX_PARAMS(e8); \
-    BODY; \
-  } else if (sew == e16) { \
-    VX_PARAMS(e16); \
-    BODY; \
-  } else if (sew == e32) { \
-    VX_PARAMS(e32); \
-    BODY; \
-  } else if (sew == e64) { \
-    VX_PARAMS(e64); \
-    BODY; \
-  } \
-  VI_LOOP_END
+  if (VI_GROUP_FAST_PATH) { \
+    VI_GROUP_LOOP(type_sew_t, VX_GROUP_SETUP, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_LOOP_BASE \
+    if (sew == e8) { \
+      VX_PARAMS(e8); \
+      BODY; \
+    } else if (sew == e16) { \
+      VX_PARAMS(e16); \
+      BODY; \
+    } else if (sew == e32) { \
+      VX_PARAMS(e32); \
+      BODY; \
+    } else if (sew == e64) { \
+      VX_PARAMS(e64); \
+      BODY; \
+    } \
+    VI_LOOP_END \
+  }
 
 #define VI_VI_ULOOP(BODY) \
   VI_CHECK_SSS(false) \
-  VI_LOOP_BASE \
-  if (sew == e8) { \
-    VI_U_PARAMS(e8); \
-    BODY; \
-  } else if (sew == e16) { \
-    VI_U_PARAMS(e16); \
-    BODY; \
-  } else if (sew == e32) { \
-    VI_U_PARAMS(e32); \
-    BODY; \
-  } else if (sew == e64) { \
-    VI_U_PARAMS(e64); \
-    BODY; \
-  } \
-  VI_LOOP_END
+  if (VI_GROUP_FAST_PATH) { \
+    VI_GROUP_LOOP(type_usew_t, VI_U_GROUP_SETUP, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_LOOP_BASE \
+    if (sew == e8) { \
+      VI_U_PARAMS(e8); \
+      BODY; \
+    } else if (sew == e16) { \
+      VI_U_PARAMS(e16); \
+      BODY; \
+    } else if (sew == e32) { \
+      VI_U_PARAMS(e32); \
+      BODY; \
+    } else if (sew == e64) { \
+      VI_U_PARAMS(e64); \
+      BODY; \
+    } \
+    VI_LOOP_END \
+  }
 
 #define VI_VI_LOOP(BODY) \
   VI_CHECK_SSS(false) \
-  VI_LOOP_BASE \
-  if (sew == e8) { \
-    VI_PARAMS(e8); \
-    BODY; \
-  } else if (sew == e16) { \
-    VI_PARAMS(e16); \
-    BODY; \
-  } else if (sew == e32) { \
-    VI_PARAMS(e32); \
-    BODY; \
-  } else if (sew == e64) { \
-    VI_PARAMS(e64); \
-    BODY; \
-  } \
-  VI_LOOP_END
+  if (VI_GROUP_FAST_PATH) { \
+    VI_GROUP_LOOP(type_sew_t, VI_GROUP_SETUP, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_LOOP_BASE \
+    if (sew == e8) { \
+      VI_PARAMS(e8); \
+      BODY; \
+    } else if (sew == e16) { \
+      VI_PARAMS(e16); \
+      BODY; \
+    } else if (sew == e32) { \
+      VI_PARAMS(e32); \
+      BODY; \
+    } else if (sew == e64) { \
+      VI_PARAMS(e64); \
+      BODY; \
+    } \
+    VI_LOOP_END \
+  }
+
+// element-wise arithmetic loops that also run on host vectors
+#define VI_VV_ULOOP_SIMD(BODY) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_CHECK_SSS(true) \
+    VI_GROUP_SIMD_LOOP(type_usew_t, VV_GROUP_SETUP, VV_SIMD_LOAD, VV_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_VV_ULOOP(BODY) \
+  }
+
+#define VI_VV_LOOP_SIMD(BODY) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_CHECK_SSS(true) \
+    VI_GROUP_SIMD_LOOP(type_sew_t, VV_GROUP_SETUP, VV_SIMD_LOAD, VV_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_VV_LOOP(BODY) \
+  }
+
+#define VI_VX_ULOOP_SIMD(BODY) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_CHECK_SSS(false) \
+    VI_GROUP_SIMD_LOOP(type_usew_t, VX_GROUP_SETUP, VX_SIMD_LOAD, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_VX_ULOOP(BODY) \
+  }
+
+#define VI_VX_LOOP_SIMD(BODY) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_CHECK_SSS(false) \
+    VI_GROUP_SIMD_LOOP(type_sew_t, VX_GROUP_SETUP, VX_SIMD_LOAD, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_VX_LOOP(BODY) \
+  }
+
+#define VI_VI_ULOOP_SIMD(BODY) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_CHECK_SSS(false) \
+    VI_GROUP_SIMD_LOOP(type_usew_t, VI_U_GROUP_SETUP, VX_SIMD_LOAD, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_VI_ULOOP(BODY) \
+  }
+
+#define VI_VI_LOOP_SIMD(BODY) \
+  if (VI_GROUP_FAST_PATH) { \
+    VI_CHECK_SSS(false) \
+    VI_GROUP_SIMD_LOOP(type_sew_t, VI_GROUP_SETUP, VX_SIMD_LOAD, VX_GROUP_PARAMS, BODY) \
+  } else { \
+    VI_VI_LOOP(BODY) \
+  }
 
 // signed unsigned operation loop (e.g. mulhsu)
 #define VI_VV_SU_LOOP(BODY) \
@@ -1201,6 +1459,76 @@ VI_VX_ULOOP({ \
   } \
   P.VU.vstart->write(0);
 
+// unit-stride fast path: an unmasked, unsegmented access from element 0
+// is copied between memory and the register group in one go when every
+// page it touches is in the TLB (see mmu_t::load_bulk)
+#ifdef WORDS_BIGENDIAN
+# define VI_LDST_BULK_HOST false
+#else
+# define VI_LDST_BULK_HOST true
+#endif
+#define VI_LDST_BULK_OK \
+  (VI_LDST_BULK_HOST && insn.v_vm() == 1 && insn.v_nf() == 0 && \
+   P.VU.vstart->read() == 0)
+
+#define VI_LD_UNIT_STRIDE(elt_width, is_mask_ldst) \
+  bool bulk_done = false; \
+  if (VI_LDST_BULK_OK) { \
+    const reg_t UNUSED nf = 1; \
+    VI_CHECK_LOAD(elt_width, is_mask_ldst); \
+    const reg_t vl = is_mask_ldst ? ((P.VU.vl->read() + 7) / 8) : P.VU.vl->read(); \
+    const reg_t baseAddr = RS1; \
+    if ((baseAddr & (sizeof(elt_width##_t) - 1)) == 0) { \
+      elt_width##_t *vd_p = P.VU.elt_span<elt_width##_t>(insn.rd(), vl); \
+      bulk_done = MMU.load_bulk(baseAddr, vl * sizeof(elt_width##_t), (uint8_t*)vd_p); \
+      if (bulk_done) \
+        P.VU.elt_span<elt_width##_t>(insn.rd(), vl, true); \
+    } \
+  } \
+  if (insn.v_nf() != 0) { \
+    VI_LD_STRIDED_BULK((insn.v_nf() + 1) * sizeof(elt_width##_t), elt_width) \
+  } \
+  if (!bulk_done) { \
+    VI_LD(0, (i * nf + fn), elt_width, is_mask_ldst); \
+  }
+
+// strided and segment fast path: an unmasked access from element 0 with
+// aligned elements goes between memory and the register groups without an
+// MMU access per element when every page it touches is in the TLB (see
+// mmu_t::load_strided); segments are (de)interleaved through seg_scratch
+#define VI_LDST_STRIDED_OK(elt_width, seg_stride) \
+  (VI_LDST_BULK_HOST && insn.v_vm() == 1 && P.VU.vstart->read() == 0 && \
+   ((RS1 | (seg_stride)) & (sizeof(elt_width##_t) - 1)) == 0)
+
+#define VI_LD_STRIDED_BULK(seg_stride, elt_width) \
+  if (VI_LDST_STRIDED_OK(elt_width, seg_stride)) { \
+    const reg_t nf = insn.v_nf() + 1; \
+    VI_CHECK_LOAD(elt_width, false); \
+    const reg_t vl = P.VU.vl->read(); \
+    const reg_t esize = sizeof(elt_width##_t); \
+    if (nf == 1) { \
+      elt_width##_t *vd_p = P.VU.elt_span<elt_width##_t>(insn.rd(), vl); \
+      bulk_done = MMU.load_strided(RS1, (seg_stride), vl, esize, (uint8_t*)vd_p); \
+      if (bulk_done) \
+        P.VU.elt_span<elt_width##_t>(insn.rd(), vl, true); \
+    } else { \
+      const elt_width##_t *seg_p = (const elt_width##_t*)P.VU.seg_scratch.data(); \
+      bulk_done = MMU.load_strided(RS1, (seg_stride), vl, nf * esize, (uint8_t*)seg_p); \
+      for (reg_t fn = 0; bulk_done && fn < nf; ++fn) { \
+        elt_width##_t *vd_p = P.VU.elt_span<elt_width##_t>(insn.rd() + fn * emul, vl, true); \
+        for (reg_t i = 0; i < vl; ++i) \
+          vd_p[i] = seg_p[i * nf + fn]; \
+      } \
+    } \
+  }
+
+#define VI_LD_STRIDED(elt_width) \
+  bool bulk_done = false; \
+  VI_LD_STRIDED_BULK(RS2, elt_width) \
+  if (!bulk_done) { \
+    VI_LD(i * RS2, fn, elt_width, false); \
+  }
+
 #define VI_LDST_GET_INDEX(elt_width) \
   reg_t index; \
   switch (elt_width) { \
@@ -1272,6 +1600,51 @@ VI_VX_ULOOP({ \
   } \
   P.VU.vstart->write(0);
 
+#define VI_ST_UNIT_STRIDE(elt_width, is_mask_ldst) \
+  bool bulk_done = false; \
+  if (VI_LDST_BULK_OK) { \
+    const reg_t UNUSED nf = 1; \
+    VI_CHECK_STORE(elt_width, is_mask_ldst); \
+    const reg_t vl = is_mask_ldst ? ((P.VU.vl->read() + 7) / 8) : P.VU.vl->read(); \
+    const reg_t baseAddr = RS1; \
+    if ((baseAddr & (sizeof(elt_width##_t) - 1)) == 0) { \
+      const elt_width##_t *vs3_p = P.VU.elt_span<elt_width##_t>(insn.rd(), vl); \
+      bulk_done = MMU.store_bulk(baseAddr, vl * sizeof(elt_width##_t), (const uint8_t*)vs3_p); \
+    } \
+  } \
+  if (insn.v_nf() != 0) { \
+    VI_ST_STRIDED_BULK((insn.v_nf() + 1) * sizeof(elt_width##_t), elt_width) \
+  } \
+  if (!bulk_done) { \
+    VI_ST(0, (i * nf + fn), elt_width, is_mask_ldst); \
+  }
+
+#define VI_ST_STRIDED_BULK(seg_stride, elt_width) \
+  if (VI_LDST_STRIDED_OK(elt_width, seg_stride)) { \
+    const reg_t nf = insn.v_nf() + 1; \
+    VI_CHECK_STORE(elt_width, false); \
+    const reg_t vl = P.VU.vl->read(); \
+    const reg_t esize = sizeof(elt_width##_t); \
+    const elt_width##_t *seg_p = P.VU.elt_span<elt_width##_t>(insn.rd(), vl); \
+    if (nf > 1) { \
+      elt_width##_t *buf_p = (elt_width##_t*)P.VU.seg_scratch.data(); \
+      for (reg_t fn = 0; fn < nf; ++fn) { \
+        const elt_width##_t *vs3_p = P.VU.elt_span<elt_width##_t>(insn.rd() + fn * emul, vl); \
+        for (reg_t i = 0; i < vl; ++i) \
+          buf_p[i * nf + fn] = vs3_p[i]; \
+      } \
+      seg_p = buf_p; \
+    } \
+    bulk_done = MMU.store_strided(RS1, (seg_stride), vl, nf * esize, (const uint8_t*)seg_p); \
+  }
+
+#define VI_ST_STRIDED(elt_width) \
+  bool bulk_done = false; \
+  VI_ST_STRIDED_BULK(RS2, elt_width) \
+  if (!bulk_done) { \
+    VI_ST(i * RS2, fn, elt_width, false); \
+  }
+
 #define VI_ST_INDEX(elt_width, is_seg) \
   const reg_t nf = insn.v_nf() + 1; \
   VI_CHECK_ST_INDEX(elt_width); \
@@ -1350,7 +1723,13 @@ VI_VX_ULOOP({ \
   require_align(vd, len); \
   const reg_t elt_per_reg = P.VU.vlenb / sizeof(elt_width ## _t); \
   const reg_t size = len * elt_per_reg; \
-  if (P.VU.vstart->read() < size) { \
+  bool bulk_done = VI_LDST_BULK_HOST && P.VU.vstart->read() == 0 && \
+    (baseAddr & (sizeof(elt_width ## _t) - 1)) == 0 && \
+    MMU.load_bulk(baseAddr, len * P.VU.vlenb, \
+                  (uint8_t*)P.VU.elt_span<elt_width ## _t>(vd, size)); \
+  if (bulk_done) { \
+    P.VU.elt_span<elt_width ## _t>(vd, size, true); \
+  } else if (P.VU.vstart->read() < size) { \
     reg_t i = P.VU.vstart->read() / elt_per_reg; \
     reg_t off = P.VU.vstart->read() % elt_per_reg; \
     if (off) { \
@@ -1381,7 +1760,9 @@ VI_VX_ULOOP({ \
   require_align(vs3, len); \
   const reg_t size = len * P.VU.vlenb; \
   \
-  if (P.VU.vstart->read() < size) { \
+  bool bulk_done = VI_LDST_BULK_HOST && P.VU.vstart->read() == 0 && \
+    MMU.store_bulk(baseAddr, size, P.VU.elt_span<uint8_t>(vs3, size)); \
+  if (!bulk_done && P.VU.vstart->read() < size) { \
     reg_t i = P.VU.vstart->read() / P.VU.vlenb; \
     reg_t off = P.VU.vstart->read() % P.VU.vlenb; \
     if (off) { \
@@ -1510,8 +1891,10 @@ VI_VX_ULOOP({ \
   } \
   P.VU.vstart->write(0); \
 
+// The flags of the whole reduction are raised once, after the loop.
 #define VI_VFP_LOOP_REDUCTION_END(x) \
   } \
+  set_fp_exceptions; \
   P.VU.vstart->write(0); \
   if (vl > 0) { \
     if (is_propagate && !is_active) { \
@@ -1576,9 +1959,62 @@ VI_VX_ULOOP({ \
   } \
   P.VU.vstart->write(0);
 
+// vector: VI_VFP_VV_LOOP and VI_VFP_VF_LOOP split between the threads of
+// P.VU.pool, when unmasked from element 0 and long enough to be worth it.
+// The registers written are marked once up front and the elements reached
+// through spans, elt() not being safe to call from the pool's threads; the
+// flags of every element are raised together at the end.
+#define VI_VFP_PARALLEL_PATH \
+  (VI_GROUP_FAST_PATH && P.VU.pool && P.VU.pool->worth(vl))
+
+#define VI_VFP_PARALLEL_LOOP(width, SETUP, PARAMS, BODY) { \
+    float##width##_t *vd_p = P.VU.elt_span<float##width##_t>(rd_num, vl, true); \
+    const float##width##_t *vs2_p = P.VU.elt_span<float##width##_t>(rs2_num, vl); \
+    SETUP; \
+    P.VU.pool->run(vl, [&](reg_t begin, reg_t end) { \
+      for (reg_t i = begin; i < end; ++i) { \
+        PARAMS; \
+        BODY; \
+      } \
+    }); \
+    set_fp_exceptions; \
+    break; \
+  }
+
+#define VFP_VV_SPAN_SETUP(width) \
+  const float##width##_t *vs1_p = P.VU.elt_span<float##width##_t>(rs1_num, vl)
+
+#define VFP_VV_SPAN_PARAMS(width) \
+  float##width##_t &vd = vd_p[i]; \
+  float##width##_t vs1 = vs1_p[i]; \
+  float##width##_t vs2 = vs2_p[i];
+
+#define VFP_VF_SPAN_SETUP(width) \
+  const float##width##_t rs1 = f##width(READ_FREG(rs1_num), P.VU.altfmt)
+
+#define VFP_VF_SPAN_PARAMS(width) \
+  float##width##_t &vd = vd_p[i]; \
+  float##width##_t UNUSED vs2 = vs2_p[i];
+
+#define VI_VFP_PARALLEL_SEW(KIND, BODY16, BODY32, BODY64) \
+  switch (P.VU.vsew) { \
+    case e16: VI_VFP_PARALLEL_LOOP(16, VFP_##KIND##_SPAN_SETUP(16), VFP_##KIND##_SPAN_PARAMS(16), BODY16) \
+    case e32: VI_VFP_PARALLEL_LOOP(32, VFP_##KIND##_SPAN_SETUP(32), VFP_##KIND##_SPAN_PARAMS(32), BODY32) \
+    case e64: VI_VFP_PARALLEL_LOOP(64, VFP_##KIND##_SPAN_SETUP(64), VFP_##KIND##_SPAN_PARAMS(64), BODY64) \
+    default: \
+      require(0); \
+      break; \
+  }; \
+  P.VU.vstart->write(0);
+
 #define VI_VFP_VV_LOOP(BODY16, BODY32, BODY64) \
   VI_CHECK_SSS(true); \
-  VI_VFP_LOOP_BASE \
+  VI_VFP_COMMON \
+  if (VI_VFP_PARALLEL_PATH) { \
+    VI_VFP_PARALLEL_SEW(VV, BODY16, BODY32, BODY64) \
+  } else { \
+  for (reg_t i = P.VU.vstart->read(); i < vl; ++i) { \
+    VI_LOOP_ELEMENT_SKIP(); \
   switch (P.VU.vsew) { \
     case e16: { \
       VFP_VV_PARAMS(16); \
@@ -1603,7 +2039,8 @@ VI_VX_ULOOP({ \
       break; \
   }; \
   DEBUG_RVV_FP_VV; \
-  VI_VFP_LOOP_END
+  VI_VFP_LOOP_END \
+  }
 
 #define VI_VFP_V_LOOP(BODY16, BODY32, BODY64) \
   VI_CHECK_SSS(false); \
@@ -1639,21 +2076,18 @@ VI_VX_ULOOP({ \
     case e16: { \
       VI_VFP_LOOP_REDUCTION_BASE(16) \
         BODY16; \
-        set_fp_exceptions; \
       VI_VFP_LOOP_REDUCTION_END(e16) \
       break; \
     } \
     case e32: { \
       VI_VFP_LOOP_REDUCTION_BASE(32) \
         BODY32; \
-        set_fp_exceptions; \
       VI_VFP_LOOP_REDUCTION_END(e32) \
       break; \
     } \
     case e64: { \
       VI_VFP_LOOP_REDUCTION_BASE(64) \
         BODY64; \
-        set_fp_exceptions; \
       VI_VFP_LOOP_REDUCTION_END(e64) \
       break; \
     } \
@@ -1677,7 +2111,6 @@ VI_VX_ULOOP({ \
         is_active = true; \
         float32_t vs2 = f16_to_f32(P.VU.elt<float16_t>(rs2_num, i)); \
         BODY16; \
-        set_fp_exceptions; \
       VI_VFP_LOOP_REDUCTION_END(e32) \
       break; \
     } \
@@ -1688,7 +2121,6 @@ VI_VX_ULOOP({ \
         is_active = true; \
         float64_t vs2 = f32_to_f64(P.VU.elt<float32_t>(rs2_num, i)); \
         BODY32; \
-        set_fp_exceptions; \
       VI_VFP_LOOP_REDUCTION_END(e64) \
       break; \
     } \
@@ -1705,7 +2137,12 @@ VI_VX_ULOOP({ \
 
 #define VI_VFP_VF_LOOP(BODY16, BODY32, BODY64) \
   VI_CHECK_SSS(false); \
-  VI_VFP_LOOP_BASE \
+  VI_VFP_COMMON \
+  if (VI_VFP_PARALLEL_PATH) { \
+    VI_VFP_PARALLEL_SEW(VF, BODY16, BODY32, BODY64) \
+  } else { \
+  for (reg_t i = P.VU.vstart->read(); i < vl; ++i) { \
+    VI_LOOP_ELEMENT_SKIP(); \
   switch (P.VU.vsew) { \
     case e16: { \
       VFP_VF_PARAMS(16); \
@@ -1730,7 +2167,8 @@ VI_VX_ULOOP({ \
       break; \
   }; \
   DEBUG_RVV_FP_VF; \
-  VI_VFP_LOOP_END
+  VI_VFP_LOOP_END \
+  }
 
 #define VI_VFP_VV_LOOP_CMP(BODY16, BODY32, BODY64) \
   VI_CHECK_MSS(true); \
@@ -2201,27 +2639,54 @@ default: \
   require_noover(insn.rd(), vd_emul, insn.rs1(), 1); \
   require_noover(insn.rd(), vd_emul, vs2, 8)
 
-template<typename a_t, typename b_t, typename c_t>
-c_t generic_dot_product(const std::vector<a_t>& a, const std::vector<b_t>& b, c_t c, std::function<c_t(a_t, b_t, c_t)> macc)
+template<typename a_t, typename b_t, typename c_t, typename macc_t>
+c_t generic_dot_product(const a_t* a, const b_t* b, reg_t n, c_t c, macc_t macc)
 {
-  for (size_t i = 0; i < a.size(); i++)
+  for (reg_t i = 0; i < n; i++)
     c = macc(a[i], b[i], c);
   return c;
 }
 
+// Dot-product operands are handed to the kernels as arrays: the register
+// group itself where the layout allows, else a copy in a stack buffer of
+// ZVDOT_MAX_BYTES (VLEN <= 4096, LMUL <= 8).
+#define ZVDOT_MAX_BYTES (4096 / 8 * 8)
+
+template<typename T>
+static inline const T* zvdot_operand(vectorUnit_t& VU, reg_t vreg, reg_t n, T* buf)
+{
+#ifdef WORDS_BIGENDIAN
+  for (reg_t i = 0; i < n; i++)
+    buf[i] = VU.elt<T>(vreg, i);
+  return buf;
+#else
+  return VU.elt_span<T>(vreg, n);
+#endif
+}
+
 #define ZVLDOT_LOOP(a_t, b_t, c_t, dot) \
-  std::vector<a_t> a(P.VU.vl->read(), a_t()); \
-  std::vector<b_t> b(P.VU.vl->read(), b_t()); \
-  for (reg_t i = 0; i < a.size(); i++) { \
-    VI_LOOP_ELEMENT_SKIP(); \
-    a[i] = P.VU.elt<a_t>(insn.rs1(), i); \
-    b[i] = P.VU.elt<b_t>(insn.rs2(), i); \
+  reg_t len = P.VU.vl->read(); \
+  a_t a_buf[ZVDOT_MAX_BYTES / sizeof(a_t)]; \
+  b_t b_buf[ZVDOT_MAX_BYTES / sizeof(b_t)]; \
+  const a_t *a = a_buf; \
+  const b_t *b = b_buf; \
+  if (VI_GROUP_FAST_PATH) { \
+    a = P.VU.elt_span<a_t>(insn.rs1(), len); \
+    b = P.VU.elt_span<b_t>(insn.rs2(), len); \
+  } else { \
+    for (reg_t i = 0; i < len; i++) { \
+      a_buf[i] = a_t(); \
+      b_buf[i] = b_t(); \
+      VI_LOOP_ELEMENT_SKIP(); \
+      a_buf[i] = P.VU.elt<a_t>(insn.rs1(), i); \
+      b_buf[i] = P.VU.elt<b_t>(insn.rs2(), i); \
+    } \
   } \
   auto& acc = P.VU.elt<c_t>(insn.rd(), 0, true); \
-  acc = dot(a, b, acc)
+  acc = dot(a, b, len, acc)
 
 #define ZVLDOT_GENERIC_LOOP(a_t, b_t, c_t, macc) \
-  auto dot = std::bind(generic_dot_product<a_t, b_t, c_t>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, macc); \
+  auto dot = [&](const a_t* a, const b_t* b, reg_t n, c_t c) { return generic_dot_product(a, b, n, c, macc); }; \
   ZVLDOT_LOOP(a_t, b_t, c_t, dot)
 
 #define ZVLDOT_SIMPLE_LOOP(a_t, b_t, c_t) \
@@ -2229,21 +2694,27 @@ c_t generic_dot_product(const std::vector<a_t>& a, const std::vector<b_t>& b, c_
   ZVLDOT_GENERIC_LOOP(a_t, b_t, c_t, macc)
 
 #define ZVBDOT_LOOP(a_t, b_t, c_t, dot) \
+  reg_t len = P.VU.vl->read(); \
+  a_t a_buf[ZVDOT_MAX_BYTES / sizeof(a_t)]; \
+  b_t b_buf[ZVDOT_MAX_BYTES / sizeof(b_t)]; \
+  const a_t *a = zvdot_operand(P.VU, insn.rs1(), len, a_buf); \
   for (reg_t idx = 0; idx < 8; idx++) { \
     reg_t i = ci + idx; \
     VI_LOOP_ELEMENT_SKIP(); \
-    std::vector<a_t> a(P.VU.vl->read(), a_t()); \
-    std::vector<b_t> b(P.VU.vl->read(), b_t()); \
-    for (reg_t k = 0; k < a.size(); k++) { \
-      a[k] = P.VU.elt<a_t>(insn.rs1(), k); \
-      b[k] = P.VU.elt<b_t>(vs2 + idx, k); \
-    } \
+    const b_t *b = zvdot_operand(P.VU, vs2 + idx, len, b_buf); \
     auto& acc = P.VU.elt<c_t>(insn.rd(), i, true); \
-    acc = dot(a, b, acc); \
+    acc = dot(a, b, len, acc); \
   }
 
+// The eight accumulations of a ZVBDOT instruction share one round-to-odd
+// scope.
+#define ZVBDOT_ODD_LOOP(a_t, b_t, dot) \
+  f32_round_odd_scope_t odd_scope; \
+  auto odd_dot = [&](const a_t* a, const b_t* b, reg_t n, float32_t c) { return dot(a, b, n, c, odd_scope); }; \
+  ZVBDOT_LOOP(a_t, b_t, float32_t, odd_dot)
+
 #define ZVBDOT_GENERIC_LOOP(a_t, b_t, c_t, macc) \
-  auto dot = std::bind(generic_dot_product<a_t, b_t, c_t>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, macc); \
+  auto dot = [&](const a_t* a, const b_t* b, reg_t n, c_t c) { return generic_dot_product(a, b, n, c, macc); }; \
   ZVBDOT_LOOP(a_t, b_t, c_t, dot)
 
 #define ZVBDOT_SIMPLE_LOOP(a_t, b_t, c_t) \
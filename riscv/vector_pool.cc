@@ -0,0 +1,102 @@
+// See LICENSE for license details.
+
+#include "vector_pool.h"
+#include "softfloat.h"
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+vector_pool_t::vector_pool_t(unsigned threads)
+{
+  for (unsigned k = 1; k < std::min(threads, MAX_THREADS); k++)
+    workers.emplace_back(&vector_pool_t::work, this, k);
+}
+
+vector_pool_t::~vector_pool_t()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  start.notify_all();
+  for (auto& t : workers)
+    t.join();
+}
+
+uint_fast8_t vector_pool_t::run_range(unsigned k, unsigned ranges)
+{
+  softfloat_roundingMode = rounding_mode;
+  softfloat_exceptionFlags = 0;
+  (*body)(n * k / ranges, n * (k + 1) / ranges);
+  return softfloat_exceptionFlags;
+}
+
+void vector_pool_t::work(unsigned k)
+{
+  uint64_t seen = 0;
+  for (;;) {
+    uint64_t j = job.load(std::memory_order_acquire);
+    for (unsigned i = 0; i < SPIN && j >> 8 == seen; i++) {
+      cpu_relax();
+      j = job.load(std::memory_order_acquire);
+    }
+    if (j >> 8 == seen) {
+      std::unique_lock<std::mutex> guard(lock);
+      start.wait(guard, [&]{ return stopping || job.load(std::memory_order_relaxed) >> 8 != seen; });
+      if (stopping)
+        return;
+      j = job.load(std::memory_order_relaxed);
+    }
+    seen = j >> 8;
+    unsigned ranges = j & 0xff;
+    if (k >= ranges)
+      continue;
+
+    flags.fetch_or(run_range(k, ranges), std::memory_order_relaxed);
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> guard(lock);
+      done.notify_one();
+    }
+  }
+}
+
+void vector_pool_t::run(reg_t n, const std::function<void(reg_t, reg_t)>& body)
+{
+  unsigned r = std::max<reg_t>(1, std::min<reg_t>(size(), n / GRAIN));
+  if (r == 1) {
+    body(0, n);
+    return;
+  }
+
+  uint_fast8_t caller_flags = softfloat_exceptionFlags;
+  this->body = &body;
+  this->n = n;
+  rounding_mode = softfloat_roundingMode;
+  flags.store(0, std::memory_order_relaxed);
+  pending.store(r - 1, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    job.store(((job.load(std::memory_order_relaxed) >> 8) + 1) << 8 | r, std::memory_order_release);
+  }
+  start.notify_all();
+
+  uint_fast8_t f = run_range(0, r);
+
+  for (unsigned i = 0; i < SPIN && pending.load(std::memory_order_acquire); i++)
+    cpu_relax();
+  if (pending.load(std::memory_order_acquire)) {
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&]{ return pending.load(std::memory_order_acquire) == 0; });
+  }
+  softfloat_exceptionFlags = caller_flags | f | flags.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+// See LICENSE for license details.
+#ifndef _RISCV_VECTOR_POOL_H
+#define _RISCV_VECTOR_POOL_H
+
+#include "decode.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Host threads of a hart that share out the elements of a long vector
+// instruction whose elements are independent of one another. The hart's
+// own thread takes the first range and waits for the rest, so a pool of n
+// threads starts n - 1. An instruction is only a few microseconds of work
+// at VLEN 4096, so the threads hand jobs over by spinning on an atomic for
+// a while before they fall back to sleeping on a condition variable.
+class vector_pool_t
+{
+ public:
+  // Fewest elements worth handing to a thread. With VLEN at most 4096, a
+  // group of 8 registers holds 2048 16-bit, 1024 32-bit or 512 64-bit
+  // elements: 16, 8 or 4 ranges.
+  static constexpr reg_t GRAIN = 128;
+  static constexpr unsigned MAX_THREADS = 255;
+
+  // threads is capped at MAX_THREADS
+  explicit vector_pool_t(unsigned threads);
+  ~vector_pool_t();
+
+  unsigned size() const { return workers.size() + 1; }
+  bool worth(reg_t n) const { return n >= 2 * GRAIN; }
+
+  // Calls body(begin, end) on consecutive ranges covering [0, n), at most
+  // one per thread and each at least GRAIN long, and returns once all have.
+  // Each range runs with the caller's softfloat rounding mode and clear
+  // softfloat exception flags, which are or-ed into the caller's at the
+  // end: the flags being sticky, the instruction raises the same fflags a
+  // loop on one thread would. body must not throw or call elt(), nor touch
+  // anything of the hart's but the elements of its range.
+  void run(reg_t n, const std::function<void(reg_t, reg_t)>& body);
+
+ private:
+  // Polls of an atomic before a thread goes to sleep
+  static constexpr unsigned SPIN = 1 << 12;
+
+  void work(unsigned k);
+  uint_fast8_t run_range(unsigned k, unsigned ranges);
+
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable start, done;
+  bool stopping = false;
+
+  // The generation of the current job above its number of ranges, so that
+  // a worker reads both at once. Advanced by run(), under lock so that
+  // sleeping workers do not miss it.
+  std::atomic<uint64_t> job{0};
+  std::atomic<unsigned> pending{0};
+  std::atomic<uint_fast8_t> flags{0};
+
+  // The current job, set by run() before job is advanced
+  const std::function<void(reg_t, reg_t)>* body = nullptr;
+  reg_t n = 0;
+  uint_fast8_t rounding_mode = 0;
+};
+
+#endif
@@ -4,70 +4,129 @@
 #include "vector_unit.h"
 #include "processor.h"
 #include "arith.h"
+#include "coverage.h"
+#include <cstdlib>
+#include <new>
 
-void vectorUnit_t::vectorUnit_t::reset()
+void vectorUnit_t::alloc_reg_file(size_t size)
+{
+  size_t align = 64;
+  while (align < vlenb && align < 4096)
+    align *= 2;
+  // aligned_alloc wants a multiple of the alignment, and never 0 bytes
+  size_t len = (std::max(size, size_t(1)) + align - 1) & ~(align - 1);
+  reg_file = aligned_alloc(align, len);
+  if (!reg_file)
+    throw std::bad_alloc();
+}
+
+void vectorUnit_t::free_reg_file()
 {
   free(reg_file);
+  reg_file = nullptr;
+}
+
+void vectorUnit_t::rehome()
+{
+  if (!reg_file)
+    return;
+  void* old = reg_file;
+  alloc_reg_file(NVPR * vlenb);
+  memcpy(reg_file, old, NVPR * vlenb);
+  free(old);
+  std::vector<uint8_t>(seg_scratch.begin(), seg_scratch.end()).swap(seg_scratch);
+}
+
+void vectorUnit_t::vectorUnit_t::reset()
+{
+  free_reg_file();
   VLEN = get_vlen();
   ELEN = get_elen();
-  reg_file = malloc(NVPR * vlenb);
+  alloc_reg_file(NVPR * vlenb);
   memset(reg_file, 0, NVPR * vlenb);
+  seg_scratch.assign(NVPR / 4 * vlenb, 0);
+  dirty = ~0U;
 
   auto state = p->get_state();
-  state->add_csr(CSR_VXSAT, vxsat = std::make_shared<vxsat_csr_t>(p, CSR_VXSAT));
-  state->add_csr(CSR_VSTART, vstart = std::make_shared<vector_csr_t>(p, CSR_VSTART, /*mask*/ VLEN - 1));
-  state->add_csr(CSR_VXRM, vxrm = std::make_shared<vector_csr_t>(p, CSR_VXRM, /*mask*/ 0x3ul));
-  state->add_csr(CSR_VL, vl = std::make_shared<vector_csr_t>(p, CSR_VL, /*mask*/ 0));
-  state->add_csr(CSR_VTYPE, vtype = std::make_shared<vector_csr_t>(p, CSR_VTYPE, /*mask*/ 0));
-  state->add_csr(CSR_VLENB, std::make_shared<vector_csr_t>(p, CSR_VLENB, /*mask*/ 0, /*init*/ vlenb));
+  state->add_csr(CSR_VXSAT, vxsat = state->make_csr<vxsat_csr_t>(p, CSR_VXSAT));
+  state->add_csr(CSR_VSTART, vstart = state->make_csr<vector_csr_t>(p, CSR_VSTART, /*mask*/ VLEN - 1));
+  state->add_csr(CSR_VXRM, vxrm = state->make_csr<vector_csr_t>(p, CSR_VXRM, /*mask*/ 0x3ul));
+  state->add_csr(CSR_VL, vl = state->make_csr<vector_csr_t>(p, CSR_VL, /*mask*/ 0));
+  state->add_csr(CSR_VTYPE, vtype = state->make_csr<vector_csr_t>(p, CSR_VTYPE, /*mask*/ 0));
+  state->add_csr(CSR_VLENB, state->make_csr<vector_csr_t>(p, CSR_VLENB, /*mask*/ 0, /*init*/ vlenb));
   assert(VCSR_VXSAT_SHIFT == 0);  // composite_csr_t assumes vxsat begins at bit 0
-  state->add_csr(CSR_VCSR, std::make_shared<composite_csr_t>(p, CSR_VCSR, vxrm, vxsat, VCSR_VXRM_SHIFT));
+  state->add_csr(CSR_VCSR, state->make_csr<composite_csr_t>(p, CSR_VCSR, vxrm, vxsat, VCSR_VXRM_SHIFT));
 
+  // VLEN, ELEN and the extensions may have changed
+  for (auto& t : vtype_cache)
+    t.valid = false;
   vtype->write_raw(0);
   set_vl(0, 0, 0, -1); // default to illegal configuration
 }
 
+const vectorUnit_t::vtype_info_t& vectorUnit_t::decode_vtype(reg_t newType)
+{
+  vtype_info_t& t = vtype_cache[(newType ^ (newType >> 3)) % VTYPE_CACHE_SIZE];
+  if (t.valid && t.vtype == newType)
+    return t;
+
+  int new_vlmul = int8_t(extract64(newType, 0, 3) << 5) >> 5;
+
+  t.vtype = newType;
+  t.valid = true;
+  t.vsew = 1 << (extract64(newType, 3, 3) + 3);
+  t.vflmul = new_vlmul >= 0 ? 1 << new_vlmul : 1.0 / (1 << -new_vlmul);
+  t.vlmax = (VLEN/t.vsew) * t.vflmul;
+  t.vta = extract64(newType, 6, 1);
+  t.vma = extract64(newType, 7, 1);
+  t.altfmt = extract64(newType, 8, 1);
+
+  const reg_t vsew = t.vsew;
+  bool ill_altfmt = true;
+  if (t.altfmt) {
+    if (p->extension_enabled(EXT_ZVQBDOT8I) && vsew == 8)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVQBDOT16I) && vsew == 16)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVFQBDOT8F) && vsew == 8)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVFWBDOT16BF) && vsew == 16)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVQLDOT8I) && vsew == 8)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVQLDOT16I) && vsew == 16)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVFQLDOT8F) && vsew == 8)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVFWLDOT16BF) && vsew == 16)
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVFBFA) && (vsew == 16 || vsew == 8))
+      ill_altfmt = false;
+    else if (p->extension_enabled(EXT_ZVFOFP8MIN) && vsew == 8)
+      ill_altfmt = false;
+  }
+
+  t.vill = !(t.vflmul >= 0.125 && t.vflmul <= 8)
+           || vsew > std::min(t.vflmul, 1.0f) * ELEN
+           || (newType >> 9) != 0
+           || (t.altfmt && ill_altfmt);
+  return t;
+}
+
 reg_t vectorUnit_t::vectorUnit_t::set_vl(int rd, int rs1, reg_t reqVL, reg_t newType)
 {
   if (vtype->read() != newType) {
-    int new_vlmul = int8_t(extract64(newType, 0, 3) << 5) >> 5;
     auto old_vlmax = vlmax;
+    const vtype_info_t& t = decode_vtype(newType);
 
-    vsew = 1 << (extract64(newType, 3, 3) + 3);
-    vflmul = new_vlmul >= 0 ? 1 << new_vlmul : 1.0 / (1 << -new_vlmul);
-    vlmax = (VLEN/vsew) * vflmul;
-    vta = extract64(newType, 6, 1);
-    vma = extract64(newType, 7, 1);
-    altfmt = extract64(newType, 8, 1);
-
-    bool ill_altfmt = true;
-    if (altfmt) {
-      if (p->extension_enabled(EXT_ZVQBDOT8I) && vsew == 8)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVQBDOT16I) && vsew == 16)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVFQBDOT8F) && vsew == 8)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVFWBDOT16BF) && vsew == 16)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVQLDOT8I) && vsew == 8)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVQLDOT16I) && vsew == 16)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVFQLDOT8F) && vsew == 8)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVFWLDOT16BF) && vsew == 16)
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVFBFA) && (vsew == 16 || vsew == 8))
-        ill_altfmt = false;
-      else if (p->extension_enabled(EXT_ZVFOFP8MIN) && vsew == 8)
-        ill_altfmt = false;
-    }
+    vsew = t.vsew;
+    vflmul = t.vflmul;
+    vlmax = t.vlmax;
+    vta = t.vta;
+    vma = t.vma;
+    altfmt = t.altfmt;
 
-    vill = !(vflmul >= 0.125 && vflmul <= 8)
-           || vsew > std::min(vflmul, 1.0f) * ELEN
-           || (newType >> 9) != 0
-           || (altfmt && ill_altfmt)
+    vill = t.vill
            || (rd == 0 && rs1 == 0 && old_vlmax != vlmax);
 
     if (vill) {
@@ -90,6 +149,8 @@ reg_t vectorUnit_t::vectorUnit_t::set_vl(int rd, int rs1, reg_t reqVL, reg_t new
   }
 
   vstart->write_raw(0);
+  if (unlikely(p->get_coverage() != nullptr))
+    p->get_coverage()->vtype(newType, vill, vl->read(), vlmax);
   return vl->read();
 }
 
@@ -2,11 +2,16 @@
 #ifndef _RISCV_VECTOR_UNIT_H
 #define _RISCV_VECTOR_UNIT_H
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 #include "decode.h"
 #include "csrs.h"
+#include "vector_pool.h"
 
 class processor_t;
 
@@ -101,6 +106,15 @@ public:
   reg_t ELEN = 0, VLEN = 0;
   bool vill = false;
   bool vstart_alu = false;
+  // One bit per register written through elt()/elt_group() since the last
+  // take_dirty(), so readers can copy out only what changed.
+  uint32_t dirty = 0;
+  // The segments of a segment load or store on their way between memory
+  // and the register groups, up to the 8 registers they may fill
+  std::vector<uint8_t> seg_scratch;
+  // Threads that long floating-point instructions are split between, or
+  // null to run every instruction on the hart's own thread
+  std::unique_ptr<vector_pool_t> pool;
 
   // vector element for various SEW
   template<typename T> T& elt(reg_t vReg, reg_t n, bool is_write = false) {
@@ -114,13 +128,30 @@ public:
     // bits when changing SEW, thus we need to index from the end on BE.
     n ^= elts_per_reg - 1;
 #endif
-    if (is_write)
+    if (is_write) {
+      dirty |= 1U << (vReg & 31);
       log_elt_write_if_needed(vReg);
+    }
 
     T *regStart = (T*)((char*)reg_file + vReg * (VLEN >> 3));
     return regStart[n];
   }
 
+  // Elements 0..n-1 of the register group at vReg, which are contiguous on
+  // little-endian hosts, for loops over a whole group; is_write marks every
+  // register they cover, as elt() would.
+  template<typename T> T* elt_span(reg_t vReg, reg_t n, bool is_write = false) {
+    assert(vsew != 0);
+    if (is_write) {
+      const reg_t bytes_per_reg = VLEN >> 3;
+      for (reg_t r = 0; r * bytes_per_reg < n * sizeof(T); r++) {
+        dirty |= 1U << ((vReg + r) & 31);
+        log_elt_write_if_needed(vReg + r);
+      }
+    }
+    return (T*)((char*)reg_file + vReg * (VLEN >> 3));
+  }
+
   // vector element group access, where EG is a std::array<T, N>.
   // The logic differences between 'elt()' and 'elt_group()' come from
   // the fact that, while 'elt()' requires that the element is fully
@@ -163,12 +194,45 @@ public:
 
     // Element groups per register groups
     for (reg_t vidx = reg_first; vidx <= reg_last; ++vidx)
-      if (is_write)
+      if (is_write) {
+        dirty |= 1U << (vidx & 31);
         log_elt_write_if_needed(vidx);
+      }
 
     return *(EG*)((char*)reg_file + vReg * (VLEN >> 3) + start_byte);
   }
 
+  // The element groups of the register group at vReg, for a loop over
+  // groups [first, last): the bound is checked, and with is_write the
+  // registers covered are marked and logged, once rather than per group.
+  // The same preconditions as elt_group() are left to the caller.
+  template<typename EG> EG*
+  elt_group_span(reg_t vReg, reg_t first, reg_t last, bool is_write = false) {
+#ifdef WORDS_BIGENDIAN
+    fputs("vectorUnit_t::elt_group_span is not compatible with WORDS_BIGENDIAN setup.\n",
+            stderr);
+    abort();
+#endif
+    assert(vsew != 0);
+    if (first < last) {
+      constexpr reg_t elt_group_size = sizeof(EG);
+      const reg_t reg_group_size = (VLEN >> 3) * vflmul;
+      assert(last * elt_group_size <= reg_group_size);
+
+      const reg_t bytes_per_reg = VLEN >> 3;
+      const reg_t reg_first = vReg + first * elt_group_size / bytes_per_reg;
+      const reg_t reg_last = vReg + (last * elt_group_size - 1) / bytes_per_reg;
+      if (is_write) {
+        for (reg_t vidx = reg_first; vidx <= reg_last; ++vidx) {
+          dirty |= 1U << (vidx & 31);
+          log_elt_write_if_needed(vidx);
+        }
+      }
+    }
+
+    return (EG*)((char*)reg_file + vReg * (VLEN >> 3));
+  }
+
   bool mask_elt(reg_t vReg, reg_t n)
   {
     return (elt<uint8_t>(vReg, n / 8) >> (n % 8)) & 1;
@@ -180,24 +244,89 @@ public:
     e = (e & ~(1U << (n % 8))) | (value << (n % 8));
   }
 
+  // Mask elements 64n..64n+63 of vReg as the bits of a word, those at vl
+  // and above clear, for loops a word at a time. Little-endian hosts only.
+  uint64_t mask_word(reg_t vReg, reg_t n, reg_t vl)
+  {
+    const reg_t bits = std::min<reg_t>(64, vl - n * 64);
+    uint64_t w = 0;
+    memcpy(&w, (char*)reg_file + vReg * (VLEN >> 3) + n * 8, (bits + 7) / 8);
+    return bits == 64 ? w : w & ((uint64_t(1) << bits) - 1);
+  }
+
+  // Sets the mask elements of vReg that are both in word n, as for
+  // mask_word(), and in which to the bits of value; the others, and those
+  // at vl and above, are left alone. Nothing is written if none are.
+  void set_mask_word(reg_t vReg, reg_t n, reg_t vl, uint64_t value, uint64_t which)
+  {
+    const reg_t bits = std::min<reg_t>(64, vl - n * 64);
+    if (bits < 64)
+      which &= (uint64_t(1) << bits) - 1;
+    if (!which)
+      return;
+    dirty |= 1U << (vReg & 31);
+    log_elt_write_if_needed(vReg);
+    char* p = (char*)reg_file + vReg * (VLEN >> 3) + n * 8;
+    uint64_t w = 0;
+    memcpy(&w, p, (bits + 7) / 8);
+    w = (w & ~which) | (value & which);
+    memcpy(p, &w, (bits + 7) / 8);
+  }
+
 private:
 
   void log_elt_write_if_needed(reg_t vReg) const;
 
+  // reg_file is aligned to a cache line, or to a register if larger, so
+  // registers do not straddle lines
+  void alloc_reg_file(size_t size);
+  void free_reg_file();
+
+  // What a vtype value decodes to, apart from the vlmax-preserving rule
+  // for rd=rs1=x0, which depends on the previous configuration
+  struct vtype_info_t {
+    reg_t vtype;
+    bool valid;
+    bool vill;
+    reg_t vsew;
+    float vflmul;
+    reg_t vlmax;
+    reg_t vta, vma, altfmt;
+  };
+  // Recently decoded vtype values, so that loops alternating between a few
+  // configurations skip the decode; indexed by a hash of vtype
+  static constexpr size_t VTYPE_CACHE_SIZE = 4;
+  vtype_info_t vtype_cache[VTYPE_CACHE_SIZE] = {};
+  const vtype_info_t& decode_vtype(reg_t newType);
+
 public:
 
   void reset();
+  // Moves the register file to a fresh allocation made by the calling
+  // thread, keeping its contents, so that first touch puts it on that
+  // thread's NUMA node
+  void rehome();
 
   vectorUnit_t() {}
 
   ~vectorUnit_t() {
-    free(reg_file);
-    reg_file = 0;
+    free_reg_file();
   }
 
   reg_t set_vl(int rd, int rs1, reg_t reqVL, reg_t newType);
 
+  // Splits long floating-point instructions between that many host threads,
+  // at most one per host CPU, from now on, or stops splitting them if that
+  // is 1 or less. Threads beyond the CPUs would only take turns spinning.
+  void set_threads(unsigned threads)
+  {
+    if (unsigned cpus = std::thread::hardware_concurrency())
+      threads = std::min(threads, cpus);
+    pool.reset(threads > 1 ? new vector_pool_t(threads) : nullptr);
+  }
+
   reg_t get_vlen() { return VLEN; }
+  uint32_t take_dirty(uint32_t mask = ~0U) { uint32_t d = dirty & mask; dirty &= ~mask; return d; }
   reg_t get_elen() { return ELEN; }
   reg_t get_slen() { return VLEN; }
 
@@ -0,0 +1,414 @@
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "devices.h"
+#include "mmu.h"
+#include "sim.h"
+#include "dts.h"
+#include "checkpoint.h"
+
+// virtio-mmio (version 2) registers
+#define VIRTIO_MMIO_MAGIC_VALUE         0x000
+#define VIRTIO_MMIO_VERSION             0x004
+#define VIRTIO_MMIO_DEVICE_ID           0x008
+#define VIRTIO_MMIO_VENDOR_ID           0x00c
+#define VIRTIO_MMIO_DEVICE_FEATURES     0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014
+#define VIRTIO_MMIO_DRIVER_FEATURES     0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024
+#define VIRTIO_MMIO_QUEUE_SEL           0x030
+#define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034
+#define VIRTIO_MMIO_QUEUE_NUM           0x038
+#define VIRTIO_MMIO_QUEUE_READY         0x044
+#define VIRTIO_MMIO_QUEUE_NOTIFY        0x050
+#define VIRTIO_MMIO_INTERRUPT_STATUS    0x060
+#define VIRTIO_MMIO_INTERRUPT_ACK       0x064
+#define VIRTIO_MMIO_STATUS              0x070
+#define VIRTIO_MMIO_QUEUE_DESC_LOW      0x080
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH     0x084
+#define VIRTIO_MMIO_QUEUE_AVAIL_LOW     0x090
+#define VIRTIO_MMIO_QUEUE_AVAIL_HIGH    0x094
+#define VIRTIO_MMIO_QUEUE_USED_LOW      0x0a0
+#define VIRTIO_MMIO_QUEUE_USED_HIGH     0x0a4
+#define VIRTIO_MMIO_CONFIG_GENERATION   0x0fc
+#define VIRTIO_MMIO_CONFIG              0x100
+
+#define VIRTIO_MAGIC                    0x74726976 /* "virt" */
+#define VIRTIO_VENDOR                   0x454b4950 /* "PIKE" */
+#define VIRTIO_ID_BLOCK                 2
+
+#define VIRTIO_STATUS_FAILED            0x80
+
+#define VIRTIO_INT_USED_RING            0x1
+
+#define VIRTIO_F_VERSION_1              (1ULL << 32)
+#define VIRTIO_BLK_F_FLUSH              (1ULL << 9)
+
+#define VIRTQ_DESC_F_NEXT               1
+#define VIRTQ_DESC_F_WRITE              2
+
+#define VIRTIO_BLK_T_IN                 0
+#define VIRTIO_BLK_T_OUT                1
+#define VIRTIO_BLK_T_FLUSH              4
+#define VIRTIO_BLK_T_GET_ID             8
+
+#define VIRTIO_BLK_S_OK                 0
+#define VIRTIO_BLK_S_IOERR              1
+#define VIRTIO_BLK_S_UNSUPP             2
+
+#define VIRTIO_BLK_SECTOR_SIZE          512
+#define VIRTIO_BLK_ID_BYTES             20
+
+struct virtq_desc_t {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+};
+
+struct virtio_blk_req_t {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+};
+
+static void set_low(uint64_t& reg, uint32_t val)
+{
+  reg = (reg & ~uint64_t(UINT32_MAX)) | val;
+}
+
+static void set_high(uint64_t& reg, uint32_t val)
+{
+  reg = (reg & UINT32_MAX) | uint64_t(val) << 32;
+}
+
+virtio_blk_t::virtio_blk_t(simif_t* sim, abstract_interrupt_controller_t *intctrl,
+                           uint32_t interrupt_id, const std::string& path,
+                           bool copy_on_write)
+  : sim(sim), intctrl(intctrl), interrupt_id(interrupt_id), image(nullptr)
+{
+  int fd = open(path.c_str(), copy_on_write ? O_RDONLY : O_RDWR);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0)
+      close(fd);
+    throw std::runtime_error("cannot open virtio block image " + path);
+  }
+  image_size = st.st_size;
+  if (image_size) {
+    void* p = mmap(nullptr, image_size, PROT_READ | PROT_WRITE,
+                   copy_on_write ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("cannot map virtio block image " + path);
+    }
+    image = (uint8_t*)p;
+  }
+  close(fd);
+  reset();
+}
+
+virtio_blk_t::~virtio_blk_t()
+{
+  if (image)
+    munmap(image, image_size);
+}
+
+void virtio_blk_t::reset()
+{
+  status = 0;
+  device_features_sel = 0;
+  driver_features_sel = 0;
+  driver_features = 0;
+  queue_sel = 0;
+  queue_num = 0;
+  queue_ready = 0;
+  queue_desc = queue_avail = queue_used = 0;
+  last_avail_idx = 0;
+  interrupt_status = 0;
+  intctrl->set_interrupt_level(interrupt_id, 0);
+}
+
+uint64_t virtio_blk_t::device_features() const
+{
+  return VIRTIO_F_VERSION_1 | VIRTIO_BLK_F_FLUSH;
+}
+
+bool virtio_blk_t::dma(reg_t addr, size_t len, void* buf, bool to_guest)
+{
+  uint8_t* bytes = (uint8_t*)buf;
+  while (len > 0) {
+    size_t n = std::min(len, size_t(PGSIZE - (addr % PGSIZE)));
+    char* host = sim->addr_to_mem(addr);
+    if (!host)
+      return false;
+    if (to_guest) {
+      memcpy(host, bytes, n);
+      sim->external_writes++;
+    } else
+      memcpy(bytes, host, n);
+    addr += n;
+    bytes += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool virtio_blk_t::load(reg_t addr, size_t len, uint8_t* bytes)
+{
+  if (addr >= VIRTIO_MMIO_CONFIG) {
+    // capacity in sectors, the only configuration field we offer
+    reg_t off = addr - VIRTIO_MMIO_CONFIG;
+    uint64_t capacity = image_size / VIRTIO_BLK_SECTOR_SIZE;
+    if (off + len > sizeof(capacity))
+      return false;
+    memcpy(bytes, (uint8_t*)&capacity + off, len);
+    return true;
+  }
+
+  if (len != 4 || (addr & 3))
+    return false;
+
+  uint32_t val = 0;
+  switch (addr) {
+    case VIRTIO_MMIO_MAGIC_VALUE: val = VIRTIO_MAGIC; break;
+    case VIRTIO_MMIO_VERSION: val = 2; break;
+    case VIRTIO_MMIO_DEVICE_ID: val = VIRTIO_ID_BLOCK; break;
+    case VIRTIO_MMIO_VENDOR_ID: val = VIRTIO_VENDOR; break;
+    case VIRTIO_MMIO_DEVICE_FEATURES:
+      val = device_features_sel < 2 ? device_features() >> (32 * device_features_sel) : 0;
+      break;
+    case VIRTIO_MMIO_QUEUE_NUM_MAX: val = queue_sel == 0 ? VIRTIO_BLK_QUEUE_SIZE : 0; break;
+    case VIRTIO_MMIO_QUEUE_READY: val = queue_sel == 0 ? queue_ready : 0; break;
+    case VIRTIO_MMIO_INTERRUPT_STATUS: val = interrupt_status; break;
+    case VIRTIO_MMIO_STATUS: val = status; break;
+    case VIRTIO_MMIO_CONFIG_GENERATION: val = 0; break;
+    default: break;
+  }
+  memcpy(bytes, &val, 4);
+  return true;
+}
+
+bool virtio_blk_t::store(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  if (len != 4 || (addr & 3) || addr >= VIRTIO_MMIO_CONFIG)
+    return false;
+
+  uint32_t val;
+  memcpy(&val, bytes, 4);
+  switch (addr) {
+    case VIRTIO_MMIO_DEVICE_FEATURES_SEL: device_features_sel = val; break;
+    case VIRTIO_MMIO_DRIVER_FEATURES_SEL: driver_features_sel = val; break;
+    case VIRTIO_MMIO_DRIVER_FEATURES:
+      if (driver_features_sel < 2) {
+        driver_features &= ~(uint64_t(UINT32_MAX) << (32 * driver_features_sel));
+        driver_features |= uint64_t(val) << (32 * driver_features_sel);
+      }
+      break;
+    case VIRTIO_MMIO_QUEUE_SEL: queue_sel = val; break;
+    case VIRTIO_MMIO_QUEUE_NUM:
+      if (queue_sel == 0)
+        queue_num = std::min(val, (uint32_t)VIRTIO_BLK_QUEUE_SIZE);
+      break;
+    case VIRTIO_MMIO_QUEUE_READY:
+      if (queue_sel == 0)
+        queue_ready = val & 1;
+      break;
+    case VIRTIO_MMIO_QUEUE_NOTIFY:
+      if (val == 0)
+        process_queue();
+      break;
+    case VIRTIO_MMIO_INTERRUPT_ACK:
+      interrupt_status &= ~val;
+      intctrl->set_interrupt_level(interrupt_id, interrupt_status ? 1 : 0);
+      break;
+    case VIRTIO_MMIO_STATUS:
+      if (val == 0)
+        reset();
+      else
+        status = val;
+      break;
+    case VIRTIO_MMIO_QUEUE_DESC_LOW: set_low(queue_desc, val); break;
+    case VIRTIO_MMIO_QUEUE_DESC_HIGH: set_high(queue_desc, val); break;
+    case VIRTIO_MMIO_QUEUE_AVAIL_LOW: set_low(queue_avail, val); break;
+    case VIRTIO_MMIO_QUEUE_AVAIL_HIGH: set_high(queue_avail, val); break;
+    case VIRTIO_MMIO_QUEUE_USED_LOW: set_low(queue_used, val); break;
+    case VIRTIO_MMIO_QUEUE_USED_HIGH: set_high(queue_used, val); break;
+    default: break;
+  }
+  return true;
+}
+
+void virtio_blk_t::process_queue()
+{
+  if (!queue_ready || !queue_num || (status & VIRTIO_STATUS_FAILED))
+    return;
+
+  uint16_t avail_idx;
+  if (!dma(queue_avail + 2, sizeof(avail_idx), &avail_idx, false)) {
+    status |= VIRTIO_STATUS_FAILED;
+    return;
+  }
+
+  bool completed = false;
+  while (last_avail_idx != avail_idx) {
+    uint16_t head;
+    if (!dma(queue_avail + 4 + 2 * (last_avail_idx % queue_num), sizeof(head), &head, false)) {
+      status |= VIRTIO_STATUS_FAILED;
+      return;
+    }
+
+    uint32_t written = 0;
+    if (!handle_request(head, &written)) {
+      status |= VIRTIO_STATUS_FAILED;
+      return;
+    }
+
+    uint16_t used_idx;
+    uint32_t elem[2] = {head, written};
+    if (!dma(queue_used + 2, sizeof(used_idx), &used_idx, false) ||
+        !dma(queue_used + 4 + 8 * (used_idx % queue_num), sizeof(elem), elem, true)) {
+      status |= VIRTIO_STATUS_FAILED;
+      return;
+    }
+    used_idx++;
+    dma(queue_used + 2, sizeof(used_idx), &used_idx, true);
+
+    last_avail_idx++;
+    completed = true;
+  }
+
+  if (completed) {
+    interrupt_status |= VIRTIO_INT_USED_RING;
+    intctrl->set_interrupt_level(interrupt_id, 1);
+  }
+}
+
+bool virtio_blk_t::handle_request(uint16_t head, uint32_t* written)
+{
+  // Gather the chain: a request header, data buffers, and a status byte.
+  std::vector<virtq_desc_t> chain;
+  for (uint16_t i = head; ; ) {
+    virtq_desc_t desc;
+    if (i >= queue_num || chain.size() >= queue_num ||
+        !dma(queue_desc + i * sizeof(desc), sizeof(desc), &desc, false))
+      return false;
+    chain.push_back(desc);
+    if (!(desc.flags & VIRTQ_DESC_F_NEXT))
+      break;
+    i = desc.next;
+  }
+
+  virtio_blk_req_t req;
+  const virtq_desc_t& last = chain.back();
+  if (chain.size() < 2 || chain[0].len < sizeof(req) ||
+      !(last.flags & VIRTQ_DESC_F_WRITE) || last.len < 1 ||
+      !dma(chain[0].addr, sizeof(req), &req, false))
+    return false;
+
+  uint8_t result = VIRTIO_BLK_S_OK;
+  uint64_t pos = req.sector * VIRTIO_BLK_SECTOR_SIZE;
+  *written = 0;
+  for (size_t i = 1; i + 1 < chain.size() && result == VIRTIO_BLK_S_OK; i++) {
+    const virtq_desc_t& d = chain[i];
+    bool to_guest = d.flags & VIRTQ_DESC_F_WRITE;
+    switch (req.type) {
+      case VIRTIO_BLK_T_IN:
+      case VIRTIO_BLK_T_OUT:
+        if (to_guest != (req.type == VIRTIO_BLK_T_IN) ||
+            pos > image_size || d.len > image_size - pos ||
+            !dma(d.addr, d.len, image + pos, to_guest)) {
+          result = VIRTIO_BLK_S_IOERR;
+          break;
+        }
+        pos += d.len;
+        if (to_guest)
+          *written += d.len;
+        break;
+      case VIRTIO_BLK_T_GET_ID: {
+        char id[VIRTIO_BLK_ID_BYTES] = "spike-virtio-blk";
+        size_t n = std::min(size_t(d.len), sizeof(id));
+        if (!to_guest || !dma(d.addr, n, id, true))
+          result = VIRTIO_BLK_S_IOERR;
+        else
+          *written += n;
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  if (req.type == VIRTIO_BLK_T_FLUSH) {
+    if (image && msync(image, image_size, MS_SYNC) != 0)
+      result = VIRTIO_BLK_S_IOERR;
+  } else if (req.type != VIRTIO_BLK_T_IN && req.type != VIRTIO_BLK_T_OUT &&
+             req.type != VIRTIO_BLK_T_GET_ID) {
+    result = VIRTIO_BLK_S_UNSUPP;
+  }
+
+  if (!dma(last.addr, 1, &result, true))
+    return false;
+  *written += 1;
+  return true;
+}
+
+void virtio_blk_t::save_state(checkpoint_writer_t& out) const
+{
+  for (uint32_t r : {status, device_features_sel, driver_features_sel, queue_sel,
+                     queue_num, queue_ready, interrupt_status, (uint32_t)last_avail_idx})
+    out.put_u32(r);
+  for (uint64_t r : {driver_features, queue_desc, queue_avail, queue_used})
+    out.put_u64(r);
+}
+
+void virtio_blk_t::load_state(checkpoint_reader_t& in)
+{
+  for (uint32_t* r : {&status, &device_features_sel, &driver_features_sel, &queue_sel,
+                      &queue_num, &queue_ready, &interrupt_status})
+    *r = in.get_u32();
+  last_avail_idx = in.get_u32();
+  for (uint64_t* r : {&driver_features, &queue_desc, &queue_avail, &queue_used})
+    *r = in.get_u64();
+  intctrl->set_interrupt_level(interrupt_id, interrupt_status ? 1 : 0);
+}
+
+std::string virtio_blk_generate_dts(const sim_t* UNUSED sim, const std::vector<std::string>& sargs)
+{
+  if (sargs.empty())
+    return "";
+
+  std::stringstream s;
+  reg_t base = VIRTIO_BLK_BASE;
+  reg_t sz = VIRTIO_BLK_SIZE;
+  s << std::hex
+    << "    virtio_mmio@" << base << " {\n"
+       "      compatible = \"virtio,mmio\";\n"
+       "      interrupt-parent = <&PLIC>;\n"
+       "      interrupts = <" << std::dec << VIRTIO_BLK_INTERRUPT_ID;
+  s << std::hex << ">;\n"
+       "      reg = <0x" << (base >> 32) << " 0x" << (base & (uint32_t)-1) <<
+                   " 0x" << (sz >> 32) << " 0x" << (sz & (uint32_t)-1) << ">;\n"
+       "    };\n";
+  return s.str();
+}
+
+virtio_blk_t* virtio_blk_parse_from_fdt(const void* fdt, const sim_t* sim, reg_t* base, const std::vector<std::string>& sargs)
+{
+  if (sargs.empty() || sargs.size() > 2 || (sargs.size() == 2 && sargs[1] != "cow"))
+    throw std::runtime_error("virtio_blk takes <image>[,cow]");
+
+  uint32_t int_id;
+  if (fdt_parse_virtio_mmio(fdt, base, &int_id, "virtio,mmio") != 0)
+    return nullptr;
+
+  // Requests are served by copying straight to and from guest memory.
+  simif_t* simif = const_cast<sim_t*>(sim);
+  return new virtio_blk_t(simif, sim->get_intctrl(), int_id, sargs[0], sargs.size() == 2);
+}
+
+REGISTER_DEVICE(virtio_blk, virtio_blk_parse_from_fdt, virtio_blk_generate_dts)
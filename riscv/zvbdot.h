@@ -2,58 +2,83 @@
 #define _RISCV_ZVBDOT_H
 
 #include "bulknormdot.h"
-#include <vector>
-#include <algorithm>
+#include <cstddef>
 
-static inline float32_t f32_add_odd(float32_t a, float32_t b)
-{
-  auto rm = softfloat_roundingMode;
-  auto flags = softfloat_exceptionFlags;
+/** Rounds to odd for its lifetime, saving and restoring the rounding mode
+ * and flags once for a batch of accumulations rather than once per add.
+ * Only the overflow and invalid flags of the additions are kept.
+ */
+class f32_round_odd_scope_t {
+ public:
+  f32_round_odd_scope_t() : rm(softfloat_roundingMode), flags(softfloat_exceptionFlags)
+  {
+    softfloat_roundingMode = softfloat_round_odd;
+  }
 
-  softfloat_roundingMode = softfloat_round_odd;
-  softfloat_exceptionFlags = 0;
+  ~f32_round_odd_scope_t()
+  {
+    softfloat_roundingMode = rm;
+    softfloat_exceptionFlags = flags;
+  }
 
-  auto res = f32_add(a, b);
+  void raise(uint8_t new_flags) { flags |= new_flags; }
 
-  if (softfloat_exceptionFlags & softfloat_flag_overflow) {
-    res.v++; // FLT_MAX -> INF
-  }
+  float32_t add(float32_t a, float32_t b)
+  {
+    softfloat_exceptionFlags = 0;
 
-  auto new_flags = softfloat_exceptionFlags & (softfloat_flag_overflow | softfloat_flag_invalid);
+    auto res = f32_add(a, b);
 
-  softfloat_roundingMode = rm;
-  softfloat_exceptionFlags = flags | new_flags;
+    if (softfloat_exceptionFlags & softfloat_flag_overflow) {
+      res.v++; // FLT_MAX -> INF
+    }
 
-  return res;
+    flags |= softfloat_exceptionFlags & (softfloat_flag_overflow | softfloat_flag_invalid);
+    return res;
+  }
+
+ private:
+  uint_fast8_t rm;
+  uint_fast8_t flags;
+};
+
+static inline float32_t f32_add_odd(float32_t a, float32_t b)
+{
+  f32_round_odd_scope_t odd;
+  return odd.add(a, b);
 }
 
-static inline float32_t zvfwbdot16bf_dot_acc(const std::vector<uint16_t>& a, const std::vector<uint16_t>& b, float32_t c)
+static inline DotConfig zvbdot_config(size_t n)
 {
-  std::vector<bf16_t> fa(a.size());
-  std::transform(a.begin(), a.end(), fa.begin(), [](auto f) { return f; });
+  return DotConfig(n, int_log2(n) + ((n & (n - 1)) != 0));
+}
 
-  std::vector<bf16_t> fb(b.size());
-  std::transform(b.begin(), b.end(), fb.begin(), [](auto f) { return f; });
+static inline float32_t zvfwbdot16bf_dot_acc(const uint16_t* a, const uint16_t* b, size_t n, float32_t c, f32_round_odd_scope_t& odd)
+{
+  auto res = bulk_norm_dot_raw<bf16_t, bf16_t>(zvbdot_config(n), a, b);
+  odd.raise(res.flags);
+  return odd.add(f32(res.out), c);
+}
 
-  DotConfig cfg(a.size(), int_log2(a.size()) + ((a.size() & (a.size() - 1)) != 0));
-  auto res = bulk_norm_dot_bf16(cfg, &fa[0], &fb[0]);
-  softfloat_exceptionFlags |= res.flags;
-  return f32_add_odd(f32(res.out), c);
+static inline float32_t zvfwbdot16bf_dot_acc(const uint16_t* a, const uint16_t* b, size_t n, float32_t c)
+{
+  f32_round_odd_scope_t odd;
+  return zvfwbdot16bf_dot_acc(a, b, n, c, odd);
 }
 
 template<typename A, typename B>
-float32_t zvfqbdot8f_dot_acc(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, float32_t c)
+float32_t zvfqbdot8f_dot_acc(const uint8_t* a, const uint8_t* b, size_t n, float32_t c, f32_round_odd_scope_t& odd)
 {
-  std::vector<A> fa(a.size());
-  std::transform(a.begin(), a.end(), fa.begin(), [](auto f) { return f; });
-
-  std::vector<B> fb(b.size());
-  std::transform(b.begin(), b.end(), fb.begin(), [](auto f) { return f; });
+  auto res = bulk_norm_dot_raw<A, B>(zvbdot_config(n), a, b);
+  odd.raise(res.flags);
+  return odd.add(f32(res.out), c);
+}
 
-  DotConfig cfg(a.size(), int_log2(a.size()) + ((a.size() & (a.size() - 1)) != 0));
-  auto res = bulk_norm_dot_ofp8(cfg, &fa[0], &fb[0]);
-  softfloat_exceptionFlags |= res.flags;
-  return f32_add_odd(f32(res.out), c);
+template<typename A, typename B>
+float32_t zvfqbdot8f_dot_acc(const uint8_t* a, const uint8_t* b, size_t n, float32_t c)
+{
+  f32_round_odd_scope_t odd;
+  return zvfqbdot8f_dot_acc<A, B>(a, b, n, c, odd);
 }
 
 #endif
@@ -167,43 +167,56 @@
 // Loop Parameters Macros
 //
 
+// Defines 'vd_eg_p', 'vs1_eg_p' and 'vs2_eg_p', the element groups of type
+// EG_T in the registers 'vd_num', 'vs1_num' and 'vs2_num', for the loop over
+// [vstart_eg, vl_eg) that the _PARAMS macros below index.
+#define VV_VD_VS1_VS2_EG_SPANS(EG_T) \
+  EG_T *const vd_eg_p = P.VU.elt_group_span<EG_T>(vd_num, vstart_eg, vl_eg, true); \
+  const EG_T *const vs1_eg_p = P.VU.elt_group_span<EG_T>(vs1_num, vstart_eg, vl_eg); \
+  const EG_T *const vs2_eg_p = P.VU.elt_group_span<EG_T>(vs2_num, vstart_eg, vl_eg)
+
+// As VV_VD_VS1_VS2_EG_SPANS, for 'vd' and 'vs2' only.
+#define VV_VD_VS2_EG_SPANS(EG_T) \
+  EG_T *const vd_eg_p = P.VU.elt_group_span<EG_T>(vd_num, vstart_eg, vl_eg, true); \
+  const EG_T *const vs2_eg_p = P.VU.elt_group_span<EG_T>(vs2_num, vstart_eg, vl_eg)
+
 // Extracts a 32b*4 element group as a EGU32x4_t variables at the given
 // element group index, from register arguments 'vd' (by reference, mutable),
 // 'vs1' and 'vs2' (constant, by value).
-#define VV_VD_VS1_VS2_EGU32x4_PARAMS(VD_NUM, VS1_NUM, VS2_NUM, EG_IDX) \
-  EGU32x4_t &vd = P.VU.elt_group<EGU32x4_t>((VD_NUM), (EG_IDX), true); \
-  const EGU32x4_t vs1 = P.VU.elt_group<EGU32x4_t>((VS1_NUM), (EG_IDX)); \
-  const EGU32x4_t vs2 = P.VU.elt_group<EGU32x4_t>((VS2_NUM), (EG_IDX))
+#define VV_VD_VS1_VS2_EGU32x4_PARAMS(EG_IDX) \
+  EGU32x4_t &vd = vd_eg_p[(EG_IDX)]; \
+  const EGU32x4_t vs1 = vs1_eg_p[(EG_IDX)]; \
+  const EGU32x4_t vs2 = vs2_eg_p[(EG_IDX)]
 
 // Extracts a 32b*8 element group as a EGU32x8_t variables at the given
 // element group index, from register arguments 'vd' (by reference, mutable),
 // 'vs1' and 'vs2' (constant, by value).
-#define VV_VD_VS1_VS2_EGU32x8_PARAMS(VD_NUM, VS1_NUM, VS2_NUM, EG_IDX) \
-  EGU32x8_t &vd = P.VU.elt_group<EGU32x8_t>((VD_NUM), (EG_IDX), true); \
-  const EGU32x8_t vs1 = P.VU.elt_group<EGU32x8_t>((VS1_NUM), (EG_IDX)); \
-  const EGU32x8_t vs2 = P.VU.elt_group<EGU32x8_t>((VS2_NUM), (EG_IDX))
+#define VV_VD_VS1_VS2_EGU32x8_PARAMS(EG_IDX) \
+  EGU32x8_t &vd = vd_eg_p[(EG_IDX)]; \
+  const EGU32x8_t vs1 = vs1_eg_p[(EG_IDX)]; \
+  const EGU32x8_t vs2 = vs2_eg_p[(EG_IDX)]
 
 // Extracts a 32b*4 element group as a EGU32x4_t variables at the given
 // element group index, from register arguments 'vd' (by reference, mutable),
 // and 'vs2' (constant, by value).
-#define VV_VD_VS2_EGU32x4_PARAMS(VD_NUM, VS2_NUM, EG_IDX) \
-  EGU32x4_t &vd = P.VU.elt_group<EGU32x4_t>((VD_NUM), (EG_IDX), true); \
-  const EGU32x4_t vs2 = P.VU.elt_group<EGU32x4_t>((VS2_NUM), (EG_IDX))
+#define VV_VD_VS2_EGU32x4_PARAMS(EG_IDX) \
+  EGU32x4_t &vd = vd_eg_p[(EG_IDX)]; \
+  const EGU32x4_t vs2 = vs2_eg_p[(EG_IDX)]
 
 // Extracts a 32b*8 element group as a EGU32x8_t variables at the given
 // element group index, from register arguments 'vd' (by reference, mutable),
 // and 'vs2' (constant, by value).
-#define VV_VD_VS2_EGU32x8_PARAMS(VD_NUM, VS2_NUM, EG_IDX) \
-  EGU32x8_t &vd = P.VU.elt_group<EGU32x8_t>((VD_NUM), (EG_IDX), true); \
-  const EGU32x8_t vs2 = P.VU.elt_group<EGU32x8_t>((VS2_NUM), (EG_IDX))
+#define VV_VD_VS2_EGU32x8_PARAMS(EG_IDX) \
+  EGU32x8_t &vd = vd_eg_p[(EG_IDX)]; \
+  const EGU32x8_t vs2 = vs2_eg_p[(EG_IDX)]
 
 // Extracts a 64b*4 element group as a EGU64x4_t variables at the given
 // element group index, from register arguments 'vd' (by reference, mutable),
 // 'vs1' and 'vs2' (constant, by value).
-#define VV_VD_VS1_VS2_EGU64x4_PARAMS(VD_NUM, VS1_NUM, VS2_NUM, EG_IDX) \
-  EGU64x4_t &vd = P.VU.elt_group<EGU64x4_t>((VD_NUM), (EG_IDX), true); \
-  const EGU64x4_t vs1 = P.VU.elt_group<EGU64x4_t>((VS1_NUM), (EG_IDX)); \
-  const EGU64x4_t vs2 = P.VU.elt_group<EGU64x4_t>((VS2_NUM), (EG_IDX))
+#define VV_VD_VS1_VS2_EGU64x4_PARAMS(EG_IDX) \
+  EGU64x4_t &vd = vd_eg_p[(EG_IDX)]; \
+  const EGU64x4_t vs1 = vs1_eg_p[(EG_IDX)]; \
+  const EGU64x4_t vs2 = vs2_eg_p[(EG_IDX)]
 
 // Extracts elements from the vector register groups 'vd', 'vs2', and 'vs1',
 // as part of a widening operation where 'vd' has EEW = 2 * SEW.
@@ -310,8 +323,9 @@
     const reg_t vstart_eg = P.VU.vstart->read() / 4; \
     const reg_t vl_eg = P.VU.vl->read() / 4; \
     do { PRELUDE } while (0); \
+    VV_VD_VS1_VS2_EG_SPANS(EGU32x4_t); \
     for (reg_t idx_eg = vstart_eg; idx_eg < vl_eg; ++idx_eg) { \
-      VV_VD_VS1_VS2_EGU32x4_PARAMS(vd_num, vs1_num, vs2_num, idx_eg); \
+      VV_VD_VS1_VS2_EGU32x4_PARAMS(idx_eg); \
       EG_BODY \
     } \
     P.VU.vstart->write(0); \
@@ -365,8 +379,9 @@
     const reg_t vstart_eg = P.VU.vstart->read() / 8; \
     const reg_t vl_eg = P.VU.vl->read() / 8; \
     do { PRELUDE } while (0); \
+    VV_VD_VS1_VS2_EG_SPANS(EGU32x8_t); \
     for (reg_t idx_eg = vstart_eg; idx_eg < vl_eg; ++idx_eg) { \
-      VV_VD_VS1_VS2_EGU32x8_PARAMS(vd_num, vs1_num, vs2_num, idx_eg); \
+      VV_VD_VS1_VS2_EGU32x8_PARAMS(idx_eg); \
       EG_BODY \
     } \
     P.VU.vstart->write(0); \
@@ -548,8 +563,9 @@
     const reg_t vstart_eg = P.VU.vstart->read() / 4; \
     const reg_t vl_eg = P.VU.vl->read() / 4; \
     do { PRELUDE } while (0); \
+    VV_VD_VS2_EG_SPANS(EGU32x4_t); \
     for (reg_t idx_eg = vstart_eg; idx_eg < vl_eg; ++idx_eg) { \
-      VV_VD_VS2_EGU32x4_PARAMS(vd_num, vs2_num, idx_eg); \
+      VV_VD_VS2_EGU32x4_PARAMS(idx_eg); \
       EG_BODY \
     } \
     P.VU.vstart->write(0); \
@@ -603,8 +619,9 @@
     do { PRELUDE } while (0); \
     if (vstart_eg < vl_eg) { \
       PRELOOP \
+      VV_VD_VS2_EG_SPANS(EGU32x4_t); \
       for (reg_t idx_eg = vstart_eg; idx_eg < vl_eg; ++idx_eg) { \
-        VV_VD_VS2_EGU32x4_PARAMS(vd_num, vs2_num, idx_eg); \
+        VV_VD_VS2_EGU32x4_PARAMS(idx_eg); \
         EG_BODY \
       } \
     } \
@@ -659,8 +676,9 @@
     do { PRELUDE } while (0); \
     if (vstart_eg < vl_eg) { \
       PRELOOP \
+      VV_VD_VS2_EG_SPANS(EGU32x8_t); \
       for (reg_t idx_eg = vstart_eg; idx_eg < vl_eg; ++idx_eg) { \
-        VV_VD_VS2_EGU32x8_PARAMS(vd_num, vs2_num, idx_eg); \
+        VV_VD_VS2_EGU32x8_PARAMS(idx_eg); \
         EG_BODY \
       } \
     } \
@@ -714,8 +732,9 @@
     const reg_t vstart_eg = P.VU.vstart->read() / 4; \
     const reg_t vl_eg = P.VU.vl->read() / 4; \
     do { PRELUDE } while (0); \
+    VV_VD_VS1_VS2_EG_SPANS(EGU64x4_t); \
     for (reg_t idx_eg = vstart_eg; idx_eg < vl_eg; ++idx_eg) { \
-      VV_VD_VS1_VS2_EGU64x4_PARAMS(vd_num, vs1_num, vs2_num, idx_eg); \
+      VV_VD_VS1_VS2_EGU64x4_PARAMS(idx_eg); \
       EG_BODY \
     } \
     P.VU.vstart->write(0); \
@@ -1030,6 +1049,19 @@
     ZVK_BREV8_32((X)[bidx]); \
   }
 
+// Performs "DST = A * B;" in GF(2^128) with the reduction polynomial
+// x^128 + x^7 + x^2 + x + 1 (see host_gf128_mul), on groups in the
+// bit order of EGU32x4_ISSET, i.e. after EGU32x4_BREV8.
+#define EGU32x4_GFMUL(DST, A, B) \
+  do { \
+    const uint64_t a__[2] = { (A)[0] | (uint64_t)(A)[1] << 32, (A)[2] | (uint64_t)(A)[3] << 32 }; \
+    const uint64_t b__[2] = { (B)[0] | (uint64_t)(B)[1] << 32, (B)[2] | (uint64_t)(B)[3] << 32 }; \
+    uint64_t r__[2]; \
+    host_gf128_mul(a__, b__, r__); \
+    (DST) = { (uint32_t)r__[0], (uint32_t)(r__[0] >> 32), \
+              (uint32_t)r__[1], (uint32_t)(r__[1] >> 32) }; \
+  } while (0)
+
 // Checks if a given bit is set within a EGU32x4_t group.
 // Assumes LE ordering.
 #define EGU32x4_ISSET(X, BIDX) \
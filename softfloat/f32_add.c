@@ -49,6 +49,14 @@ float32_t f32_add( float32_t a, float32_t b )
 #if ! defined INLINE_LEVEL || (INLINE_LEVEL < 1)
     float32_t (*magsFuncPtr)( uint_fast32_t, uint_fast32_t );
 #endif
+    float32_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF32( softfloat_hostOp_add, a, b, b, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     uA.f = a;
     uiA = uA.ui;
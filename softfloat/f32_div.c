@@ -65,6 +65,14 @@ float32_t f32_div( float32_t a, float32_t b )
 #endif
     uint_fast32_t uiZ;
     union ui32_f32 uZ;
+    float32_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF32( softfloat_hostOp_div, a, b, b, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     /*------------------------------------------------------------------------
     *------------------------------------------------------------------------*/
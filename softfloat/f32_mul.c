@@ -59,6 +59,14 @@ float32_t f32_mul( float32_t a, float32_t b )
     int_fast16_t expZ;
     uint_fast32_t sigZ, uiZ;
     union ui32_f32 uZ;
+    float32_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF32( softfloat_hostOp_mul, a, b, b, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     /*------------------------------------------------------------------------
     *------------------------------------------------------------------------*/
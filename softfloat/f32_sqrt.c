@@ -53,6 +53,14 @@ float32_t f32_sqrt( float32_t a )
     uint_fast32_t sigZ, shiftedSigZ;
     uint32_t negRem;
     union ui32_f32 uZ;
+    float32_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF32( softfloat_hostOp_sqrt, a, a, a, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     /*------------------------------------------------------------------------
     *------------------------------------------------------------------------*/
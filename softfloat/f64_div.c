@@ -62,6 +62,14 @@ float64_t f64_div( float64_t a, float64_t b )
     uint_fast64_t sigZ;
     uint_fast64_t uiZ;
     union ui64_f64 uZ;
+    float64_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF64( softfloat_hostOp_div, a, b, b, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     /*------------------------------------------------------------------------
     *------------------------------------------------------------------------*/
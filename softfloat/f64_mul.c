@@ -64,6 +64,14 @@ float64_t f64_mul( float64_t a, float64_t b )
 #endif
     uint_fast64_t sigZ, uiZ;
     union ui64_f64 uZ;
+    float64_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF64( softfloat_hostOp_mul, a, b, b, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     /*------------------------------------------------------------------------
     *------------------------------------------------------------------------*/
@@ -55,6 +55,14 @@ float64_t f64_sqrt( float64_t a )
     uint32_t q;
     uint_fast64_t sigZ, shiftedSigZ;
     union ui64_f64 uZ;
+    float64_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF64( softfloat_hostOp_sqrt, a, a, a, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     /*------------------------------------------------------------------------
     *------------------------------------------------------------------------*/
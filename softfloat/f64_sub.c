@@ -51,6 +51,14 @@ float64_t f64_sub( float64_t a, float64_t b )
 #if ! defined INLINE_LEVEL || (INLINE_LEVEL < 2)
     float64_t (*magsFuncPtr)( uint_fast64_t, uint_fast64_t, bool );
 #endif
+    float64_t hostZ;
+
+    if (
+        softfloat_hostFP
+            && softfloat_hostF64( softfloat_hostOp_sub, a, b, b, &hostZ )
+    ) {
+        return hostZ;
+    }
 
     uA.f = a;
     uiA = uA.ui;
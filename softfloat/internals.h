@@ -64,6 +64,25 @@ enum {
     softfloat_mulAdd_subProd = 2
 };
 
+/*----------------------------------------------------------------------------
+| Host floating-point fast path (see 'softfloat_hostFP').  Returns false if
+| the result must be computed in software, as it always is for mulAdd.
+*----------------------------------------------------------------------------*/
+enum {
+    softfloat_hostOp_add,
+    softfloat_hostOp_sub,
+    softfloat_hostOp_mul,
+    softfloat_hostOp_div,
+    softfloat_hostOp_sqrt,
+    softfloat_hostOp_mulAdd
+};
+bool
+ softfloat_hostF32(
+     uint_fast8_t, float32_t, float32_t, float32_t, float32_t * );
+bool
+ softfloat_hostF64(
+     uint_fast8_t, float64_t, float64_t, float64_t, float64_t * );
+
 /*----------------------------------------------------------------------------
 *----------------------------------------------------------------------------*/
 uint_fast32_t softfloat_roundToUI32( bool, uint_fast64_t, uint_fast8_t, bool );
@@ -0,0 +1,261 @@
+
+/*============================================================================
+
+This C source file is part of the SoftFloat IEEE Floating-Point Arithmetic
+Package, Release 3d, by John R. Hauser.
+
+Copyright 2025 The Regents of the University of California.  All rights
+reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice,
+    this list of conditions, and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions, and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+ 3. Neither the name of the University nor the names of its contributors may
+    be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS "AS IS", AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ARE
+DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "platform.h"
+#include "internals.h"
+#include "softfloat.h"
+
+bool softfloat_hostFP = false;
+
+/*----------------------------------------------------------------------------
+| The host must evaluate 'float' and 'double' in their own precision, so x87
+| targets are left out.  Reading the host flags is too slow to be worth it
+| (on x86, clearing MXCSR costs more than the softfloat operation), so the
+| inexact flag is instead found from the exact error of the result, which
+| takes a fused multiply-add for mul, div and sqrt.  On x86 those three are
+| only done on the host if CPUID reports FMA.  mulAdd always stays in
+| software, as its error cannot be found cheaply, and never gets here.
+*----------------------------------------------------------------------------*/
+#if defined __x86_64__ || defined __aarch64__
+
+#include <fenv.h>
+#include <float.h>
+
+#ifdef __x86_64__
+#define HOST_FMA_TARGET __attribute__((target( "fma" )))
+static bool hostHasFMA = false;
+#else
+#define HOST_FMA_TARGET
+static const bool hostHasFMA = true;
+#endif
+
+bool softfloat_setHostFP( bool enable )
+{
+    volatile float tiny = FLT_MIN;
+
+#ifdef __x86_64__
+    hostHasFMA = __builtin_cpu_supports( "fma" );
+#endif
+    /*------------------------------------------------------------------------
+    | Refuse hosts that flush subnormals or do not round to nearest even.
+    *------------------------------------------------------------------------*/
+    if ( enable && ((fegetround() != FE_TONEAREST) || (tiny / 2) * 2 != tiny) ) {
+        enable = false;
+    }
+    softfloat_hostFP = enable;
+    return enable;
+
+}
+
+/*----------------------------------------------------------------------------
+| A host result is only used if its exponent is below the largest finite
+| one, so that neither it nor the error computation overflowed, and above
+| 'minExp', which is high enough that it cannot have underflowed and that
+| its error term is exact; the operand of div and sqrt whose error term
+| scales with it must be above 'minExp' too.  That leaves no exception but
+| inexact, which is raised if the error term is nonzero.  Sums use the
+| error-free TwoSum, products, quotients and roots the fused residual.
+*----------------------------------------------------------------------------*/
+HOST_FMA_TARGET
+static void
+ hostFMAOpF32( uint_fast8_t op, float a, float b, float *zPtr, bool *inexactPtr )
+{
+    float z;
+
+    switch ( op ) {
+     case softfloat_hostOp_mul:
+        z = a * b;
+        *inexactPtr = __builtin_fmaf( a, b, -z ) != 0;
+        break;
+     case softfloat_hostOp_div:
+        z = a / b;
+        *inexactPtr = __builtin_fmaf( -z, b, a ) != 0;
+        break;
+     default:
+        z = __builtin_sqrtf( a );
+        *inexactPtr = __builtin_fmaf( -z, z, a ) != 0;
+        break;
+    }
+    *zPtr = z;
+
+}
+
+bool
+ softfloat_hostF32(
+     uint_fast8_t op, float32_t a, float32_t b, float32_t c, float32_t *zPtr )
+{
+    enum { minExp = 2 * 24 + 2 };
+    uint32_t uiA, uiZ;
+    float fA, fB, fZ, s, t;
+    bool inexact;
+
+    if ( softfloat_roundingMode != softfloat_round_near_even ) return false;
+    memcpy( &uiA, &a, sizeof uiA );
+    memcpy( &fA, &a, sizeof fA );
+    memcpy( &fB, &b, sizeof fB );
+    switch ( op ) {
+     case softfloat_hostOp_sub:
+        fB = -fB;
+        /* fall through */
+     case softfloat_hostOp_add:
+        fZ = fA + fB;
+        s = fZ - fA;
+        t = fZ - s;
+        inexact = ((fA - t) + (fB - s)) != 0;
+        break;
+     case softfloat_hostOp_div:
+     case softfloat_hostOp_sqrt:
+        if ( expF32UI( uiA ) <= minExp ) return false;
+        /* fall through */
+     case softfloat_hostOp_mul:
+        if ( ! hostHasFMA ) return false;
+        hostFMAOpF32( op, fA, fB, &fZ, &inexact );
+        break;
+     default:
+        return false;
+    }
+    memcpy( &uiZ, &fZ, sizeof uiZ );
+    if ( (expF32UI( uiZ ) <= minExp) || (0xFE <= expF32UI( uiZ )) ) {
+        return false;
+    }
+    if ( inexact ) softfloat_exceptionFlags |= softfloat_flag_inexact;
+    memcpy( zPtr, &uiZ, sizeof uiZ );
+    return true;
+
+}
+
+HOST_FMA_TARGET
+static void
+ hostFMAOpF64(
+     uint_fast8_t op, double a, double b, double *zPtr, bool *inexactPtr )
+{
+    double z;
+
+    switch ( op ) {
+     case softfloat_hostOp_mul:
+        z = a * b;
+        *inexactPtr = __builtin_fma( a, b, -z ) != 0;
+        break;
+     case softfloat_hostOp_div:
+        z = a / b;
+        *inexactPtr = __builtin_fma( -z, b, a ) != 0;
+        break;
+     default:
+        z = __builtin_sqrt( a );
+        *inexactPtr = __builtin_fma( -z, z, a ) != 0;
+        break;
+    }
+    *zPtr = z;
+
+}
+
+bool
+ softfloat_hostF64(
+     uint_fast8_t op, float64_t a, float64_t b, float64_t c, float64_t *zPtr )
+{
+    enum { minExp = 2 * 53 + 2 };
+    uint64_t uiA, uiZ;
+    double fA, fB, fZ, s, t;
+    bool inexact;
+
+    if ( softfloat_roundingMode != softfloat_round_near_even ) return false;
+    memcpy( &uiA, &a, sizeof uiA );
+    memcpy( &fA, &a, sizeof fA );
+    memcpy( &fB, &b, sizeof fB );
+    switch ( op ) {
+     case softfloat_hostOp_sub:
+        fB = -fB;
+        /* fall through */
+     case softfloat_hostOp_add:
+        fZ = fA + fB;
+        s = fZ - fA;
+        t = fZ - s;
+        inexact = ((fA - t) + (fB - s)) != 0;
+        break;
+     case softfloat_hostOp_div:
+     case softfloat_hostOp_sqrt:
+        if ( expF64UI( uiA ) <= minExp ) return false;
+        /* fall through */
+     case softfloat_hostOp_mul:
+        if ( ! hostHasFMA ) return false;
+        hostFMAOpF64( op, fA, fB, &fZ, &inexact );
+        break;
+     default:
+        return false;
+    }
+    memcpy( &uiZ, &fZ, sizeof uiZ );
+    if ( (expF64UI( uiZ ) <= minExp) || (0x7FE <= expF64UI( uiZ )) ) {
+        return false;
+    }
+    if ( inexact ) softfloat_exceptionFlags |= softfloat_flag_inexact;
+    memcpy( zPtr, &uiZ, sizeof uiZ );
+    return true;
+
+}
+
+#else
+
+bool softfloat_setHostFP( bool enable )
+{
+
+    softfloat_hostFP = false;
+    return false;
+
+}
+
+bool
+ softfloat_hostF32(
+     uint_fast8_t op, float32_t a, float32_t b, float32_t c, float32_t *zPtr )
+{
+
+    return false;
+
+}
+
+bool
+ softfloat_hostF64(
+     uint_fast8_t op, float64_t a, float64_t b, float64_t c, float64_t *zPtr )
+{
+
+    return false;
+
+}
+
+#endif
+
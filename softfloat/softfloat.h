@@ -95,6 +95,18 @@ enum {
     softfloat_flag_invalid   = 16
 };
 
+/*----------------------------------------------------------------------------
+| Host floating-point fast path.  While 'softfloat_hostFP' is set, 32- and
+| 64-bit add, sub, mul, div and sqrt rounding to nearest even are done by the
+| host FPU; results it might not reproduce bit for bit, with the same flags,
+| are redone in software.
+| Unlike the rounding mode and flags, the setting is shared by all threads.
+| 'softfloat_setHostFP' returns whether the fast path could be enabled; it
+| cannot on hosts that flush subnormals or evaluate in extended precision.
+*----------------------------------------------------------------------------*/
+extern bool softfloat_hostFP;
+bool softfloat_setHostFP( bool );
+
 /*----------------------------------------------------------------------------
 | Routine to raise any or all of the software floating-point exception flags.
 *----------------------------------------------------------------------------*/
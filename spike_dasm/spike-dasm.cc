@@ -5,21 +5,86 @@
 // in its input, then replaces them with the disassembly
 // enclosed hexadecimal number, interpreted as a RISC-V
 // instruction.
+//
+// The input (stdin, or the files named, which are mapped) is cut into
+// blocks of whole lines that worker threads annotate, each with its own
+// memo of recent disassemblies, and written out in order.
 
 #include "disasm.h"
 #include "extension.h"
 #include "platform.h"
-#include <iostream>
-#include <string>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 #include <fesvr/option_parser.h>
 using namespace std;
 
+static const size_t BLOCK_SIZE = 1 << 20;
+
+struct block_t {
+  string buf;            // stdin blocks own their bytes
+  const char* data;
+  size_t len;
+  string out;
+  bool done = false;
+};
+
+// Appends the n bytes at p, whole lines except perhaps at the end of the
+// input, to out with each DASM(<hex>) replaced
+static void annotate(const char* p, size_t n, string& out, disasm_cache_t& cache)
+{
+  static const char tag[] = "DASM(";
+  static const size_t tag_len = strlen(tag);
+  const char* end = p + n;
+
+  while (p < end) {
+    const char* hit = (const char*)memmem(p, end - p, tag, tag_len);
+    if (!hit) {
+      out.append(p, end);
+      return;
+    }
+
+    const char* q = hit + tag_len;
+    if (end - q >= 2 && q[0] == '0' && (q[1] == 'x' || q[1] == 'X'))
+      q += 2;
+    insn_bits_t bits = 0;
+    const char* digits = q;
+    for (; q < end && isxdigit((unsigned char)*q); q++) {
+      unsigned d = isdigit((unsigned char)*q) ? *q - '0' : (*q | 0x20) - 'a' + 10;
+      // as strtoull, too many digits saturate
+      bits = bits >> 60 ? ~insn_bits_t(0) : bits << 4 | d;
+    }
+    if (q == digits || q == end || *q != ')') {
+      out.append(p, hit + tag_len);
+      p = hit + tag_len;
+      continue;
+    }
+
+    out.append(p, hit);
+    out += cache.disassemble(bits);
+    p = q + 1;
+  }
+}
+
 int main(int UNUSED argc, char** argv)
 {
-  string s;
   const char* isa = DEFAULT_ISA;
   bool strict = false;
+  unsigned nthreads = std::max(1u, std::thread::hardware_concurrency());
 
   std::function<extension_t*()> extension;
   option_parser_t parser;
@@ -28,42 +93,169 @@ int main(int UNUSED argc, char** argv)
 #endif
   parser.option(0, "isa", 1, [&](const char* s){isa = s;});
   parser.option(0, "strict", 0, [&](const char UNUSED *s){strict = true;});
-  parser.parse(argv);
+  parser.option(0, "threads", 1, [&](const char* s){nthreads = std::max(1, atoi(s));});
+  const char* const* files = parser.parse(argv);
 
-  isa_parser_t isa_parser(isa, DEFAULT_PRIV);
-  disassembler_t* disassembler = new disassembler_t(&isa_parser, strict);
+  disassembler_t* disassembler = new disassembler_t(isa, DEFAULT_PRIV, strict);
   if (extension) {
     for (auto disasm_insn : extension()->get_disasms()) {
       disassembler->add_insn(disasm_insn);
     }
   }
 
-  while (getline(cin, s))
-  {
-    for (size_t pos = 0; (pos = s.find("DASM(", pos)) != string::npos; )
-    {
-      size_t start = pos;
+  // Blocks in input order; the first ones are written as they are done
+  mutex lock;
+  condition_variable work_ready, block_done;
+  deque<shared_ptr<block_t>> window;
+  size_t next_work = 0;   // index in window of the next block to annotate
+  bool input_done = false;
 
-      pos += strlen("DASM(");
+  vector<thread> workers;
+  for (unsigned i = 0; i < nthreads; i++) {
+    workers.emplace_back([&] {
+      disasm_cache_t cache(disassembler, 1 << 16);
+      unique_lock<mutex> guard(lock);
+      while (true) {
+        work_ready.wait(guard, [&] { return next_work < window.size() || input_done; });
+        if (next_work == window.size())
+          return;
+        shared_ptr<block_t> b = window[next_work++];
+        guard.unlock();
+        b->out.reserve(b->len + b->len / 2);
+        annotate(b->data, b->len, b->out, cache);
+        guard.lock();
+        b->done = true;
+        block_done.notify_all();
+      }
+    });
+  }
 
-      if (s[pos] == '0' && (s[pos+1] == 'x' || s[pos+1] == 'X'))
-        pos += 2;
+  auto write_done = [&](bool all) {
+    unique_lock<mutex> guard(lock);
+    while (!window.empty()) {
+      if (!window.front()->done) {
+        if (!all && window.size() < 2 * nthreads)
+          return;
+        block_done.wait(guard, [&] { return window.front()->done; });
+      }
+      shared_ptr<block_t> b = window.front();
+      window.pop_front();
+      next_work--;
+      guard.unlock();
+      fwrite(b->out.data(), 1, b->out.size(), stdout);
+      guard.lock();
+    }
+  };
 
-      if (!isxdigit(s[pos]))
-        continue;
+  auto submit = [&](shared_ptr<block_t> b) {
+    write_done(false);
+    lock_guard<mutex> guard(lock);
+    window.push_back(std::move(b));
+    work_ready.notify_one();
+  };
 
-      char* endp;
-      insn_bits_t bits = strtoull(&s[pos], &endp, 16);
-      if (*endp != ')')
-        continue;
+  // Cuts the n bytes at p into blocks of whole lines
+  auto submit_lines = [&](const char* p, size_t n) {
+    for (size_t used = 0; used < n; ) {
+      size_t len = std::min(BLOCK_SIZE, n - used);
+      if (used + len < n) {
+        const char* last = p + used + len - 1;
+        const char* nl = (const char*)memchr(last, '\n', p + n - last);
+        len = nl ? nl + 1 - (p + used) : n - used;
+      }
+      auto b = make_shared<block_t>();
+      b->data = p + used;
+      b->len = len;
+      submit(b);
+      used += len;
+    }
+  };
 
-      string dis = disassembler->disassemble(bits);
-      s = s.substr(0, start) + dis + s.substr(endp - &s[0] + 1);
-      pos = start + dis.length();
+  int status = 0;
+  vector<pair<void*, size_t>> maps;
+  string carry;
+  if (!*files) {
+    while (true) {
+      auto b = make_shared<block_t>();
+      b->buf = std::move(carry);
+      size_t have = b->buf.size();
+      b->buf.resize(have + BLOCK_SIZE);
+      // what is there, so lines piped from a running simulator flow on;
+      // when nothing more is, what has been read is written out first
+      // rather than held until the next block
+      struct pollfd pfd = {0, POLLIN, 0};
+      if (poll(&pfd, 1, 0) == 0) {
+        write_done(true);
+        fflush(stdout);
+      }
+      ssize_t got;
+      while ((got = read(0, &b->buf[have], BLOCK_SIZE)) < 0 && errno == EINTR)
+        ;
+      b->buf.resize(have + std::max(got, ssize_t(0)));
+      bool eof = got <= 0;
+      // a partial last line waits for the rest
+      size_t len = b->buf.size();
+      if (!eof) {
+        size_t nl = b->buf.rfind('\n');
+        if (nl == string::npos) {
+          carry = std::move(b->buf);
+          continue;
+        }
+        len = nl + 1;
+        carry = b->buf.substr(len);
+        b->buf.resize(len);
+      }
+      if (len && b->buf.back() != '\n')
+        b->buf += '\n';
+      b->data = b->buf.data();
+      b->len = b->buf.size();
+      if (b->len)
+        submit(b);
+      if (eof)
+        break;
+    }
+  } else {
+    for (; *files; files++) {
+      int fd = open(*files, O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "spike-dasm: cannot open %s: %s\n", *files, strerror(errno));
+        status = 1;
+        break;
+      }
+      size_t n = st.st_size;
+      void* m = n ? mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+      close(fd);
+      if (m == MAP_FAILED) {
+        fprintf(stderr, "spike-dasm: cannot map %s: %s\n", *files, strerror(errno));
+        status = 1;
+        break;
+      }
+      madvise(m, n, MADV_SEQUENTIAL);
+      maps.emplace_back(m, n);
+      const char* p = (const char*)m;
+      submit_lines(p, n);
+      if (n && p[n - 1] != '\n') {
+        // as for stdin, the last line is terminated
+        auto b = make_shared<block_t>();
+        b->buf = "\n";
+        b->data = b->buf.data();
+        b->len = 1;
+        submit(b);
+      }
     }
+  }
 
-    cout << s << '\n';
+  {
+    lock_guard<mutex> guard(lock);
+    input_done = true;
+    work_ready.notify_all();
   }
+  write_done(true);
+  for (auto& w : workers)
+    w.join();
+  for (auto& [m, n] : maps)
+    munmap(m, n);
 
-  return 0;
+  return status;
 }
@@ -0,0 +1,84 @@
+// See LICENSE for license details.
+
+// Sums coverage files written by spike --coverage, into another coverage
+// file (-o) or as text.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "coverage.h"
+
+static void usage()
+{
+  fprintf(stderr, "usage: spike-cov-merge [-o <out>] [--text] <file>... (- reads names from stdin)\n");
+  exit(1);
+}
+
+static bool merge_file(coverage_data_t& total, coverage_data_t& one, const char* path)
+{
+  FILE* in = fopen(path, "rb");
+  if (!in) {
+    fprintf(stderr, "spike-cov-merge: cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  bool ok = one.read(in);
+  fclose(in);
+  if (!ok) {
+    fprintf(stderr, "spike-cov-merge: %s is not a coverage file\n", path);
+    return false;
+  }
+  total.merge(one);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  const char* out_path = nullptr;
+  bool text = false;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0) {
+      if (++i == argc)
+        usage();
+      out_path = argv[i];
+    } else if (strcmp(argv[i], "--text") == 0) {
+      text = true;
+    } else if (strcmp(argv[i], "-") == 0) {
+      for (std::string line; std::getline(std::cin, line); )
+        if (!line.empty())
+          inputs.push_back(line);
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (inputs.empty())
+    usage();
+
+  // the counter arrays are large, so one scratch copy is reused
+  std::unique_ptr<coverage_data_t> total(new coverage_data_t());
+  std::unique_ptr<coverage_data_t> one(new coverage_data_t());
+  for (const auto& path : inputs)
+    if (!merge_file(*total, *one, path.c_str()))
+      return 1;
+
+  if (out_path) {
+    FILE* out = fopen(out_path, "wb");
+    if (!out) {
+      fprintf(stderr, "spike-cov-merge: cannot open %s: %s\n", out_path, strerror(errno));
+      return 1;
+    }
+    total->write(out);
+    if (fclose(out) != 0) {
+      fprintf(stderr, "spike-cov-merge: cannot write %s: %s\n", out_path, strerror(errno));
+      return 1;
+    }
+  }
+  if (text || !out_path)
+    total->print(stdout);
+  return 0;
+}
@@ -4,11 +4,25 @@
 //   core   0: 0x000000008000c36c (0xfe843783) ld      a5, -24(s0)
 // in its inputs, then output the RISC-V instruction with the disassembly
 // enclosed hexadecimal number.
+//
+// Inputs (files, or stdin) are scanned by hand rather than with a regex,
+// mmap'ed when they are regular files, in windows that are split at line
+// boundaries between --jobs threads. Each thread memoises the mnemonics of
+// the opcodes it has seen.
 
 #include <iostream>
+#include <cctype>
+#include <cerrno>
 #include <string>
 #include <cstdint>
-#include <regex>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "fesvr/option_parser.h"
 
 #include "disasm.h"
@@ -17,47 +31,235 @@
 
 using namespace std;
 
+// Input handed to each thread at a time
+static const size_t JOB_WINDOW = 8 << 20;
+
+class log_scanner_t {
+ public:
+  explicit log_scanner_t(const disassembler_t* disasm) : disasm(disasm) {}
+
+  // Appends the mnemonic of every matching line in [p, end) to out.
+  void scan(const char* p, const char* end, string& out)
+  {
+    while (p < end) {
+      const char* eol = (const char*)memchr(p, '\n', end - p);
+      if (!eol)
+        eol = end;
+      uint64_t opcode;
+      if (match(p, eol, opcode)) {
+        out += mnemonic(opcode);
+        out += '\n';
+      }
+      p = eol + 1;
+    }
+  }
+
+ private:
+  static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+  static int hex_digit(char c)
+  {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+  }
+
+  // Same as matching ^core\s+\d+:\s+0x[0-9a-f]+\s+\(0x([0-9a-f]+)\),
+  // ignoring case, at the start of [p, end).
+  static bool match(const char* p, const char* end, uint64_t& opcode)
+  {
+    auto skip = [&](auto pred) {
+      const char* start = p;
+      while (p < end && pred(*p))
+        p++;
+      return p != start;
+    };
+    auto literal = [&](const char* s) {
+      for (; *s; s++, p++)
+        if (p == end || tolower((unsigned char)*p) != *s)
+          return false;
+      return true;
+    };
+    auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    auto is_hex = [](char c) { return hex_digit(c) >= 0; };
+
+    if (!literal("core") || !skip(is_space) || !skip(is_digit) ||
+        p == end || *p++ != ':' || !skip(is_space) ||
+        !literal("0x") || !skip(is_hex) || !skip(is_space) ||
+        p == end || *p++ != '(' || !literal("0x"))
+      return false;
+
+    // Parsed like strtoull, which saturates on overflow, then truncated
+    // to the digits given.
+    const char* digits = p;
+    uint64_t v = 0;
+    bool overflow = false;
+    for (; p < end && is_hex(*p); p++) {
+      overflow |= v >> 60 != 0;
+      v = v << 4 | hex_digit(*p);
+    }
+    size_t bit_num = (p - digits) * 4;
+    if (bit_num == 0 || p == end || *p != ')')
+      return false;
+    if (overflow)
+      v = UINT64_MAX;
+    if (bit_num < 64)
+      v = v << (64 - bit_num) >> (64 - bit_num);
+    opcode = v;
+    return true;
+  }
+
+  const char* mnemonic(uint64_t opcode)
+  {
+    auto it = memo.find(opcode);
+    if (it != memo.end())
+      return it->second;
+    const disasm_insn_t* insn = disasm->lookup(opcode);
+    const char* name = insn ? insn->get_name() : "unknown_op";
+    memo.emplace(opcode, name);
+    return name;
+  }
+
+  const disassembler_t* disasm;
+  unordered_map<uint64_t, const char*> memo;
+};
+
+// Scans [p, end), which ends at a line boundary, on up to scanners.size()
+// threads and writes the results in input order.
+static void scan_window(const char* p, const char* end, vector<log_scanner_t>& scanners,
+                        vector<string>& outs)
+{
+  size_t jobs = scanners.size();
+  size_t per_job = (end - p + jobs - 1) / jobs;
+  vector<thread> threads;
+  for (size_t i = 0; i < jobs && p < end; i++) {
+    const char* chunk_end = end;
+    if ((size_t)(end - p) > per_job) {
+      chunk_end = (const char*)memchr(p + per_job, '\n', end - p - per_job);
+      chunk_end = chunk_end ? chunk_end + 1 : end;
+    }
+    outs[i].clear();
+    if (jobs == 1)
+      scanners[i].scan(p, chunk_end, outs[i]);
+    else
+      threads.emplace_back([&, i, p, chunk_end] { scanners[i].scan(p, chunk_end, outs[i]); });
+    p = chunk_end;
+  }
+  for (auto& t : threads)
+    t.join();
+  for (size_t i = 0; i < jobs; i++) {
+    cout.write(outs[i].data(), outs[i].size());
+    outs[i].clear();
+  }
+}
+
+// Returns false if fd cannot be mapped (a pipe, or empty).
+static bool scan_mapped(int fd, vector<log_scanner_t>& scanners, vector<string>& outs)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return false;
+  size_t len = st.st_size;
+  void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+  madvise(map, len, MADV_SEQUENTIAL);
+
+  const char* p = (const char*)map;
+  const char* end = p + len;
+  size_t window = JOB_WINDOW * scanners.size();
+  while (p < end) {
+    const char* window_end = end;
+    if ((size_t)(end - p) > window) {
+      window_end = (const char*)memchr(p + window, '\n', end - p - window);
+      window_end = window_end ? window_end + 1 : end;
+    }
+    scan_window(p, window_end, scanners, outs);
+    p = window_end;
+  }
+
+  munmap(map, len);
+  return true;
+}
+
+static void scan_stream(int fd, vector<log_scanner_t>& scanners, vector<string>& outs)
+{
+  vector<char> buf(JOB_WINDOW * scanners.size());
+  size_t held = 0;
+  while (true) {
+    if (held == buf.size())
+      buf.resize(buf.size() * 2);  // a line longer than the window
+    ssize_t got = read(fd, buf.data() + held, buf.size() - held);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      break;
+    held += got;
+
+    size_t lines = held;
+    while (lines > 0 && buf[lines - 1] != '\n')
+      lines--;
+    if (!lines)
+      continue;
+    scan_window(buf.data(), buf.data() + lines, scanners, outs);
+    memmove(buf.data(), buf.data() + lines, held - lines);
+    held -= lines;
+  }
+  if (held)
+    scan_window(buf.data(), buf.data() + held, scanners, outs);
+}
+
 int main(int UNUSED argc, char** argv)
 {
-  string s;
   const char* isa_string = DEFAULT_ISA;
+  size_t jobs = 1;
 
   std::function<extension_t*()> extension;
   option_parser_t parser;
   parser.option(0, "extension", 1, [&](const char* s){extension = find_extension(s);});
   parser.option(0, "isa", 1, [&](const char* s){isa_string = s;});
-  parser.parse(argv);
-
-  cfg_t cfg;
-
-  isa_parser_t isa(isa_string, DEFAULT_PRIV);
-  processor_t p(isa_string, DEFAULT_PRIV, &cfg, 0, 0, false, nullptr, cerr);
-  if (extension) {
-    p.register_extension(extension());
-  }
+  parser.option('j', "jobs", 1, [&](const char* s){
+    jobs = strtoul(s, 0, 0);
+    if (!jobs) {
+      fprintf(stderr, "--jobs expects a positive count\n");
+      exit(-1);
+    }
+  });
+  const char* const* files = parser.parse(argv);
 
-  std::regex reg("^core\\s+\\d+:\\s+0x[0-9a-f]+\\s+\\(0x([0-9a-f]+)\\)", std::regex_constants::icase);
-  std::smatch m;
+  disassembler_t disassembler(isa_string, DEFAULT_PRIV);
+  vector<extension_t*> extensions;
+  for (auto& e : isa_parser_t::get(isa_string, DEFAULT_PRIV)->get_extensions())
+    extensions.push_back(find_extension(e.c_str())());
+  if (extension)
+    extensions.push_back(extension());
+  for (auto e : extensions)
+    for (auto disasm_insn : e->get_disasms())
+      disassembler.add_insn(disasm_insn);
 
-  while (getline(cin,s)){
-    if (regex_search(s, m, reg)){
-      // the opcode string
-      string op = m[1].str();
-      uint32_t bit_num = op.size() * 4;
-      uint64_t opcode = strtoull(op.c_str(), nullptr, 16);
+  vector<log_scanner_t> scanners(jobs, log_scanner_t(&disassembler));
+  vector<string> outs(jobs);
+  ios::sync_with_stdio(false);
 
-      if (bit_num<64){
-          opcode = opcode << (64-bit_num) >> (64-bit_num);
-      }
+  auto scan_fd = [&](int fd) {
+    if (!scan_mapped(fd, scanners, outs))
+      scan_stream(fd, scanners, outs);
+  };
 
-      const disasm_insn_t* disasm = p.get_disassembler()->lookup(opcode);
-      if (disasm) {
-          cout << disasm->get_name() << '\n';
-      } else {
-          cout << "unknown_op\n";
+  if (!*files) {
+    scan_fd(STDIN_FILENO);
+  } else {
+    for (; *files; files++) {
+      int fd = open(*files, O_RDONLY);
+      if (fd < 0) {
+        fprintf(stderr, "spike-log-parser: cannot open %s: %s\n", *files, strerror(errno));
+        return 1;
       }
+      scan_fd(fd);
+      close(fd);
     }
   }
 
+  cout.flush();
   return 0;
 }
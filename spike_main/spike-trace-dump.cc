@@ -0,0 +1,52 @@
+// See LICENSE for license details.
+
+// Converts a binary commit trace written by spike --commit-trace back to
+// the text form produced by --log-commits.
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "commit_trace.h"
+
+int main(int argc, char** argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: spike-trace-dump <trace>\n");
+    return 1;
+  }
+
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "spike-trace-dump: cannot open %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+
+  size_t len = st.st_size;
+  void* data = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "spike-trace-dump: cannot map %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+  madvise(data, len, MADV_SEQUENTIAL);
+
+  commit_trace_reader_t reader((const uint8_t*)data, len);
+  if (!reader.valid()) {
+    fprintf(stderr, "spike-trace-dump: %s is not a commit trace\n", argv[1]);
+    return 1;
+  }
+
+  commit_trace_record_t rec;
+  while (reader.next(rec))
+    commit_trace_print_text(stdout, rec);
+
+  if (reader.offset() != len) {
+    fprintf(stderr, "spike-trace-dump: malformed record at offset %zu\n", reader.offset());
+    return 1;
+  }
+  return 0;
+}
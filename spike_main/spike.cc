@@ -6,12 +6,33 @@
 #include "mmu.h"
 #include "arith.h"
 #include "remote_bitbang.h"
+#include "dmi_socket.h"
 #include "cachesim.h"
+#include "async_memtracer.h"
+#include "dram_trace.h"
+#include "cache_sampler.h"
 #include "extension.h"
+#include "commit_trace.h"
+#include "bbv.h"
+#include "call_tracer.h"
+#include "coverage.h"
+#include "difftest.h"
+#include "input_log.h"
+#include "insn_trace_ring.h"
+#include "mem_image.h"
+#include "softfloat.h"
 #include <dlfcn.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
 #include <fesvr/option_parser.h>
+#include <fesvr/term.h>
 #include <stdexcept>
 #include <stdio.h>
+#include <string.h>
 #include <stdlib.h>
 #include <vector>
 #include <string>
@@ -22,6 +43,8 @@
 #include <sstream>
 #include "../VERSION"
 
+extern device_factory_t* virtio_blk_factory;
+
 static void help(int exit_code = 1)
 {
   fprintf(stderr, "Spike RISC-V ISA Simulator " SPIKE_VERSION "\n\n");
@@ -31,6 +54,9 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  -m<n>                 Provide <n> MiB of target memory [default 2048]\n");
   fprintf(stderr, "  -m<a:m,b:n,...>       Provide memory regions of size m and n bytes\n");
   fprintf(stderr, "                          at base addresses a and b (with 4 KiB alignment)\n");
+  fprintf(stderr, "  --mem-image=<file>    Map the first memory region copy-on-write from a raw image (e.g. from dumpmems)\n");
+  fprintf(stderr, "  --load-image=<file>@<a> Preload a raw binary, or Verilog hex (*.hex, *.vhx) image at address a\n");
+  fprintf(stderr, "  --mem-backend=<kind>  Memory regions are sparse (page map), flat (one mapping) or huge (flat on huge pages) [default sparse]\n");
   fprintf(stderr, "  -d                    Interactive debug mode\n");
   fprintf(stderr, "  -g                    Track histogram of PCs\n");
   fprintf(stderr, "  -l                    Generate a log of execution\n");
@@ -40,6 +66,9 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  -h, --help            Print this help message\n");
   fprintf(stderr, "  --halted              Start halted, allowing a debugger to connect\n");
   fprintf(stderr, "  --log=<name>          File name for option -l\n");
+  fprintf(stderr, "  --console-out=<name>  Write UART and HTIF console output to a file or pipe\n");
+  fprintf(stderr, "  --log-buffer=<bytes>  Buffer for the --log file [default 4 MiB]\n");
+  fprintf(stderr, "  --log-writer-thread   Write the --log file from a separate thread\n");
   fprintf(stderr, "  --debug-cmd=<name>    Read commands from file (use with -d)\n");
   fprintf(stderr, "  --isa=<name>          RISC-V ISA string [default %s]\n", DEFAULT_ISA);
   fprintf(stderr, "  --pmpregions=<n>      Number of PMP regions [default 16]\n");
@@ -49,18 +78,69 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  --hartids=<a,b,...>   Explicitly specify hartids, default is 0,1,...\n");
   fprintf(stderr, "  --ic=<S>:<W>:<B>      Instantiate a cache model with S sets,\n");
   fprintf(stderr, "  --dc=<S>:<W>:<B>        W ways, and B-byte blocks (with S and\n");
-  fprintf(stderr, "  --l2=<S>:<W>:<B>        B both powers of 2).\n");
+  fprintf(stderr, "  --l2=<S>:<W>:<B>        B both powers of 2), optionally\n");
+  fprintf(stderr, "  --llc=<S>:<W>:<B>       followed by :lru, :plru or :srrip\n");
+  fprintf(stderr, "                          instead of random replacement.\n");
+  fprintf(stderr, "  --private-l1          Give each hart its own --ic/--dc, with MESI coherence between the D$s\n");
+  fprintf(stderr, "  --cache-threads       Simulate the --ic/--dc models on their own threads\n");
+  fprintf(stderr, "  --cache-sample=<M>:<N> Simulate the caches for N out of every M instructions\n");
+  fprintf(stderr, "  --cache-sample-sets=<K> Simulate 1/K of the --ic/--dc sets (K a power of 2)\n");
+  fprintf(stderr, "                          Either prints statistics extrapolated to the whole run\n");
   fprintf(stderr, "  --big-endian          Use a big-endian memory system.\n");
   fprintf(stderr, "  --misaligned          Support misaligned memory accesses\n");
   fprintf(stderr, "  --device=<name>       Attach MMIO plugin device from an --extlib library,\n");
   fprintf(stderr, "                          specify --device=<name>,<args> to pass down extra args.\n");
+  fprintf(stderr, "  --virtio-blk=<image>[,cow] Attach a virtio-mmio block device backed by <image>;\n");
+  fprintf(stderr, "                          with cow, writes are not saved back to <image>\n");
   fprintf(stderr, "  --log-cache-miss      Generate a log of cache miss\n");
+  fprintf(stderr, "  --dram-trace=<name>   Write the fills and writebacks of the lowest cache model, or\n");
+  fprintf(stderr, "                          without one the loads and stores, as a DRAM simulator trace\n");
+  fprintf(stderr, "  --dram-trace-format=<ramulator|dramsim3> Format of --dram-trace [default ramulator]\n");
   fprintf(stderr, "  --log-commits         Generate a log of commits info\n");
+  fprintf(stderr, "  --log-commits-range=<begin>:<end>|<symbol> Log only commits at pcs in [begin, end) or\n");
+  fprintf(stderr, "                          in the function symbol; may be repeated (implies --log-commits)\n");
+  fprintf(stderr, "  --log-commits-priv=<m|s|u...> Log only commits in the privileges listed (implies --log-commits)\n");
+  fprintf(stderr, "  --log-commits-window=<begin>:<end> Log only each hart's instructions [begin, end),\n");
+  fprintf(stderr, "                          counted from reset (implies --log-commits)\n");
+  fprintf(stderr, "  --commit-trace=<name> Write commits to a binary trace (see spike-trace-dump)\n");
+  fprintf(stderr, "  --bbv=<name>          Write SimPoint basic-block vectors (name.<hart> with several harts)\n");
+  fprintf(stderr, "  --bbv-interval=<n>    Instructions per basic-block vector [default 100000000]\n");
+  fprintf(stderr, "  --call-trace=<name>   Write function call/return events to a binary trace\n");
+  fprintf(stderr, "                          (name.<hart> with several harts)\n");
+  fprintf(stderr, "  --call-trace-range=<base>:<size>,... Only trace jumps from or to these ranges\n");
+  fprintf(stderr, "  --coverage=<name>     Write ISA functional coverage (see spike-cov-merge)\n");
+  fprintf(stderr, "                          (name.<hart> with several harts)\n");
+  fprintf(stderr, "  --insn-trace-ring=<name> Stream retired instructions to a shared-memory ring\n");
+  fprintf(stderr, "                          (name.<hart> with several harts; needs a build\n");
+  fprintf(stderr, "                          configured with --enable-insn-trace-ring)\n");
+  fprintf(stderr, "  --insn-trace-ring-size=<n> Ring capacity in records, a power of 2 [default 65536]\n");
+  fprintf(stderr, "  --guest-profile=<file> Sample guest pcs on a host timer and write folded stacks\n");
+  fprintf(stderr, "                          named by ELF symbol, for flame graphs\n");
+  fprintf(stderr, "  --guest-profile-hz=<n> Samples per second of host time [default 997]\n");
+  fprintf(stderr, "  --guest-profile-unwind Also follow the guest frame-pointer chain\n");
+  fprintf(stderr, "  --metrics=<file>      Keep instructions, MIPS, TLB, icache and trap counts per hart\n");
+  fprintf(stderr, "                          in <file> as OpenMetrics text, rewritten periodically\n");
+  fprintf(stderr, "  --metrics-interval=<ms> Host time between rewrites [default 10000]\n");
+  fprintf(stderr, "  --record-inputs=<name> Log mtime under --real-time-clint, terminal input and seed\n");
+  fprintf(stderr, "                          CSR values, so --replay-inputs can rerun exactly\n");
+  fprintf(stderr, "  --replay-inputs=<name> Take those inputs from a --record-inputs log instead\n");
+  fprintf(stderr, "  --save-checkpoint=<name> Write harts, devices and memory to a checkpoint on exit\n");
+  fprintf(stderr, "  --load-checkpoint=<name> Start from a checkpoint of the same configuration\n");
+  fprintf(stderr, "  --zygote=<socket>     Load the program once, then run each test sent to the Unix\n");
+  fprintf(stderr, "                          socket in a forked copy (see README)\n");
+  fprintf(stderr, "  --batch=<file>        Run each \"<elf> [<signature>]\" line of file in turn in this\n");
+  fprintf(stderr, "                          simulator, resetting it in between (see README)\n");
+  fprintf(stderr, "  --batch-jobs=<n>      Split the --batch list over n forked simulators [default 1]\n");
+  fprintf(stderr, "  --difftest=<trace>    Check a recorded DUT commit trace (--commit-trace format)\n");
+  fprintf(stderr, "                          against this run, in segments checked by forked copies\n");
+  fprintf(stderr, "  --difftest-segment=<n> Instructions per --difftest segment [default 10000000]\n");
+  fprintf(stderr, "  --difftest-jobs=<n>   Segments checked at once [default: host cores]\n");
   fprintf(stderr, "  --extension=<name>    Specify RoCC Extension\n");
   fprintf(stderr, "                          This flag can be used multiple times.\n");
   fprintf(stderr, "  --extlib=<name>       Shared library to load\n");
   fprintf(stderr, "                        This flag can be used multiple times.\n");
   fprintf(stderr, "  --rbb-port=<port>     Listen on <port> for remote bitbang connection\n");
+  fprintf(stderr, "  --dmi-port=<port>     Listen on <port> for direct DMI read/write requests\n");
   fprintf(stderr, "  --dump-dts            Print device tree string and exit\n");
   fprintf(stderr, "  --dtb=<path>          Use specified device tree blob [default: auto-generate]\n");
   fprintf(stderr, "  --disable-dtb         Don't write the device tree blob into memory\n");
@@ -82,9 +162,28 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  --dm-no-hasel         Debug module won't support hasel\n");
   fprintf(stderr, "  --dm-no-abstract-csr  Debug module won't support abstract CSR access\n");
   fprintf(stderr, "  --dm-no-abstract-fpr  Debug module won't support abstract FPR access\n");
+  fprintf(stderr, "  --dm-no-direct-access Debug module runs GPR and FPR transfers in the debug ROM, too\n");
   fprintf(stderr, "  --dm-no-halt-groups   Debug module won't support halt groups\n");
   fprintf(stderr, "  --dm-no-impebreak     Debug module won't support implicit ebreak in program buffer\n");
   fprintf(stderr, "  --blocksz=<size>      Cache block size (B) for CMO operations(powers of 2) [default 64]\n");
+  fprintf(stderr, "  --tlb=<E>:<W>         Software TLB with E entries in W-way sets (powers of 2) [default 256:1]\n");
+  fprintf(stderr, "  --icache=<n>          Decoded-instruction cache entries (power of 2) [default 1024]\n");
+  fprintf(stderr, "  --block-cache=<n>     Execute from n cached basic blocks instead of the icache [default 0, off]\n");
+  fprintf(stderr, "  --interleave=<n>      Instructions each hart runs before the next one [default 5000]\n");
+  fprintf(stderr, "  --rtc-tick=<n>        Instructions per real-time-clock tick [default 100]\n");
+  fprintf(stderr, "  --skip-idle-harts     Do not step harts sitting in WFI with no interrupt pending\n");
+  fprintf(stderr, "  --wfi-fast-forward    When every hart waits in WFI, jump time to the next timer interrupt\n");
+  fprintf(stderr, "  --parallel-harts      Run each hart's interleave quantum on its own host thread\n");
+  fprintf(stderr, "  --hart-cpus=<a,b,...> With --parallel-harts, pin hart i's thread to the i'th CPU listed (round robin)\n");
+  fprintf(stderr, "  --vector-threads=<n>  Split long vector floating-point instructions between n host threads per hart,\n");
+  fprintf(stderr, "                          at most one per host CPU [default 1]\n");
+  fprintf(stderr, "  --machine-only        Use handlers without privilege checks when the ISA has no S or U mode\n");
+  fprintf(stderr, "  --mmu-stats           Print per-hart TLB, page-walk, icache, slow-path, MMIO\n");
+  fprintf(stderr, "                          and trap counters on exit\n");
+  fprintf(stderr, "  --footprint           Print the pages of each memory region touched, the TLB, icache,\n");
+  fprintf(stderr, "                          vector register and log buffer sizes, and the peak RSS on exit\n");
+  fprintf(stderr, "  --insn-stats          Print per-hart instruction counts by group, mnemonic and mode on exit\n");
+  fprintf(stderr, "  --host-fp             Do round-to-nearest F/D add, sub, mul, div and sqrt on the host FPU\n");
   fprintf(stderr, "  --instructions=<n>    Stop after n instructions\n");
 
   exit(exit_code);
@@ -255,16 +354,170 @@ static std::vector<mem_cfg_t> parse_mem_layout(const char* arg)
   return merged_mem;
 }
 
-static std::vector<std::pair<reg_t, abstract_mem_t*>> make_mems(const std::vector<mem_cfg_t> &layout)
+static std::vector<std::pair<reg_t, abstract_mem_t*>> make_mems(const std::vector<mem_cfg_t> &layout,
+                                                                const std::string &backend,
+                                                                const char *image)
 {
   std::vector<std::pair<reg_t, abstract_mem_t*>> mems;
   mems.reserve(layout.size());
   for (const auto &cfg : layout) {
-    mems.push_back(std::make_pair(cfg.get_base(), new mem_t(cfg.get_size())));
+    abstract_mem_t *mem;
+    if (image && mems.empty())
+      mem = new flat_mem_t(cfg.get_size(), std::string(image));
+    else if (backend == "flat" || backend == "huge")
+      mem = new flat_mem_t(cfg.get_size(), backend == "huge");
+    else
+      mem = new mem_t(cfg.get_size());
+    mems.push_back(std::make_pair(cfg.get_base(), mem));
   }
   return mems;
 }
 
+// --zygote: the simulator is built and its program (typically base
+// firmware, or "none") loaded once, then each test runs in a fork of this
+// warmed process and so starts from a copy-on-write image. A client
+// connects to the socket and sends one line, "<program> [<dir>]"; the copy
+// loads program over the warmed memory and runs it in dir, with its stdout
+// and stderr on the connection, after which the line
+// "spike-zygote: exit <code>" is sent. Returns only in the copies; the
+// server runs until killed.
+static void serve_zygote(sim_t& s, const char* path)
+{
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "--zygote socket path is too long: %s\n", path);
+    exit(1);
+  }
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0 || bind(server, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(server, SOMAXCONN) < 0) {
+    fprintf(stderr, "--zygote: can't listen on %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  s.set_expected_xlen(s.get_core(0)->get_isa().get_max_xlen());
+  s.start();
+  fprintf(stderr, "spike: zygote ready on %s\n", path);
+  fflush(nullptr);
+  // The harts keep the htif handlers; the server just stops.
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  // Each connection gets a process that waits for its test.
+  signal(SIGCHLD, SIG_IGN);
+
+  while (true) {
+    int conn = accept(server, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      fprintf(stderr, "--zygote: accept failed: %s\n", strerror(errno));
+      exit(1);
+    }
+    pid_t waiter = fork();
+    if (waiter != 0) {
+      if (waiter < 0)
+        dprintf(conn, "spike-zygote: fork failed: %s\n", strerror(errno));
+      close(conn);
+      continue;
+    }
+
+    close(server);
+    signal(SIGCHLD, SIG_DFL);
+    std::string line;
+    for (char c; read(conn, &c, 1) == 1 && c != '\n'; )
+      line += c;
+    std::istringstream request(line);
+    std::string program, dir;
+    request >> program >> dir;
+
+    pid_t test = program.empty() ? -1 : fork();
+    if (test == 0) {
+      if (!dir.empty() && chdir(dir.c_str()) != 0) {
+        dprintf(conn, "spike-zygote: can't enter %s: %s\n", dir.c_str(), strerror(errno));
+        _exit(1);
+      }
+      dup2(conn, STDOUT_FILENO);
+      dup2(conn, STDERR_FILENO);
+      close(conn);
+      s.set_program(program);
+      return;
+    }
+
+    int status = 0;
+    if (test > 0)
+      waitpid(test, &status, 0);
+    int code = test < 0 ? -1 : WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    dprintf(conn, "spike-zygote: exit %d\n", code);
+    _exit(0);
+  }
+}
+
+// --batch: the tests listed in file, one "<elf> [<signature>]" per line
+// (blank lines and #-comments skipped), run one after another in the one
+// simulator. Before each test after the first, sim_t::rewind() returns
+// memory, devices and harts to their state after construction, so a test
+// pays only for loading its ELF. With jobs above 1, that many forked copies
+// of the built simulator each take every jobs-th test. A line
+// "spike-batch: <elf> exit <code>" goes to stderr per test. Returns 1 if
+// any test failed, else 0.
+static int run_batch(sim_t& s, const char* file, unsigned jobs)
+{
+  std::ifstream list(file);
+  if (!list) {
+    fprintf(stderr, "--batch: can't open %s\n", file);
+    exit(1);
+  }
+  std::vector<std::pair<std::string, std::string>> tests;
+  for (std::string line; std::getline(list, line); ) {
+    std::istringstream fields(line);
+    std::string elf, signature;
+    fields >> elf >> signature;
+    if (!elf.empty() && elf[0] != '#')
+      tests.emplace_back(elf, signature);
+  }
+
+  std::vector<pid_t> workers;
+  unsigned worker = 0;
+  for (unsigned i = 1; i < jobs && i < tests.size(); i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "--batch: fork failed: %s\n", strerror(errno));
+      break;
+    }
+    if (pid == 0) {
+      worker = i;
+      workers.clear();
+      break;
+    }
+    workers.push_back(pid);
+  }
+
+  bool failed = false;
+  for (size_t i = worker; i < tests.size(); i += jobs) {
+    if (i != worker)
+      s.rewind();
+    s.set_program(tests[i].first);
+    s.set_signature_file(tests[i].second);
+    int code = s.run();
+    fprintf(stderr, "spike-batch: %s exit %d\n", tests[i].first.c_str(), code);
+    failed |= code != 0;
+  }
+
+  if (worker != 0) {
+    fflush(nullptr);
+    _exit(failed);
+  }
+  for (pid_t pid : workers) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  return failed;
+}
+
 static unsigned long atoul_safe(const char* s)
 {
   char* e;
@@ -327,19 +580,65 @@ int main(int argc, char** argv)
   const char* kernel = NULL;
   reg_t kernel_offset, kernel_size;
   std::vector<device_factory_sargs_t> plugin_device_factories;
+  coherence_bus_t l1_bus;
   std::unique_ptr<icache_sim_t> ic;
   std::unique_ptr<dcache_sim_t> dc;
+  const char* ic_config = nullptr;
+  const char* dc_config = nullptr;
+  bool private_l1 = false;
+  std::vector<std::unique_ptr<icache_sim_t>> private_ic;
+  std::vector<std::unique_ptr<dcache_sim_t>> private_dc;
   std::unique_ptr<cache_sim_t> l2;
+  std::unique_ptr<cache_sim_t> llc;
+  bool cache_threads = false;
+  std::unique_ptr<async_memtracer_t> cache_tracer;  // drained before the models print their stats
+  uint64_t cache_sample_period = 0;
+  uint64_t cache_sample_window = 0;
+  size_t cache_sample_sets = 1;
   bool log_cache = false;
+  const char *dram_trace_path = nullptr;
+  const char *dram_trace_format = "ramulator";
   bool log_commits = false;
+  std::optional<commit_log_filter_t> log_filter;
   const char *log_path = nullptr;
+  const char *commit_trace_path = nullptr;
+  const char *bbv_path = nullptr;
+  uint64_t bbv_interval = 100000000;
+  const char *call_trace_path = nullptr;
+  const char *insn_ring_path = nullptr;
+  const char *coverage_path = nullptr;
+  uint64_t insn_ring_size = 65536;
+  call_tracer_t::ranges_t call_trace_ranges;
+  const char *guest_profile_path = nullptr;
+  unsigned guest_profile_hz = 997;
+  bool guest_profile_unwind = false;
+  const char *metrics_path = nullptr;
+  unsigned metrics_interval = 10000;
+  const char *save_checkpoint = nullptr;
+  const char *zygote_path = nullptr;
+  const char *batch_path = nullptr;
+  unsigned batch_jobs = 1;
+  const char *difftest_path = nullptr;
+  const char *input_log_path = nullptr;
+  bool replay_inputs = false;
+  uint64_t difftest_segment = 10000000;
+  unsigned difftest_jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  const char *load_checkpoint = nullptr;
   std::vector<std::function<extension_t*()>> extensions;
   const char* initrd = NULL;
   const char* dtb_file = NULL;
   uint16_t rbb_port = 0;
   bool use_rbb = false;
+  uint16_t dmi_port = 0;
+  bool use_dmi_socket = false;
   unsigned dmi_rti = 0;
   reg_t blocksz = 64;
+  bool mmu_stats = false;
+  bool footprint = false;
+  bool insn_stats = false;
+  std::string mem_backend = "sparse";
+  const char* mem_image = NULL;
+  std::vector<std::pair<std::string, reg_t>> load_images;
   std::optional<unsigned long long> instructions;
   debug_module_config_t dm_config;
   cfg_arg_t<size_t> nprocs(1);
@@ -380,22 +679,47 @@ int main(int argc, char** argv)
   parser.option('m', 0, 1, [&](const char* s){cfg.mem_layout = parse_mem_layout(s);});
   parser.option(0, "halted", 0, [&](const char UNUSED *s){halted = true;});
   parser.option(0, "rbb-port", 1, [&](const char* s){use_rbb = true; rbb_port = atoul_safe(s);});
+  parser.option(0, "dmi-port", 1, [&](const char* s){use_dmi_socket = true; dmi_port = atoul_safe(s);});
   parser.option(0, "pc", 1, [&](const char* s){cfg.start_pc = strtoull(s, 0, 0);});
   parser.option(0, "hartids", 1, [&](const char* s){
     cfg.hartids = parse_hartids(s);
     cfg.explicit_hartids = true;
   });
-  parser.option(0, "ic", 1, [&](const char* s){ic.reset(new icache_sim_t(s));});
-  parser.option(0, "dc", 1, [&](const char* s){dc.reset(new dcache_sim_t(s));});
+  parser.option(0, "ic", 1, [&](const char* s){ic.reset(new icache_sim_t(s)); ic_config = s;});
+  parser.option(0, "dc", 1, [&](const char* s){dc.reset(new dcache_sim_t(s)); dc_config = s;});
   parser.option(0, "l2", 1, [&](const char* s){l2.reset(cache_sim_t::construct(s, "L2$"));});
+  parser.option(0, "llc", 1, [&](const char* s){llc.reset(cache_sim_t::construct(s, "LLC$"));});
+  parser.option(0, "private-l1", 0, [&](const char UNUSED *s){private_l1 = true;});
+  parser.option(0, "cache-threads", 0, [&](const char UNUSED *s){cache_threads = true;});
+  parser.option(0, "cache-sample", 1, [&](const char* s){
+    char* end;
+    cache_sample_period = strtoull(s, &end, 0);
+    if (*end == ':')
+      cache_sample_window = strtoull(end + 1, &end, 0);
+    if (*end || !cache_sample_window || cache_sample_window > cache_sample_period) {
+      fprintf(stderr, "--cache-sample expects <period>:<window> with 0 < window <= period\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "cache-sample-sets", 1,
+                [&](const char* s){cache_sample_sets = strtoull(s, 0, 0);});
   parser.option(0, "big-endian", 0, [&](const char UNUSED *s){cfg.endianness = endianness_big;});
   parser.option(0, "misaligned", 0, [&](const char UNUSED *s){cfg.misaligned = true;});
   parser.option(0, "log-cache-miss", 0, [&](const char UNUSED *s){log_cache = true;});
+  parser.option(0, "dram-trace", 1, [&](const char* s){dram_trace_path = s;});
+  parser.option(0, "dram-trace-format", 1, [&](const char* s){dram_trace_format = s;});
   parser.option(0, "isa", 1, [&](const char* s){cfg.isa = s;});
   parser.option(0, "pmpregions", 1, [&](const char* s){cfg.pmpregions = atoul_safe(s);});
   parser.option(0, "pmpgranularity", 1, [&](const char* s){cfg.pmpgranularity = atoul_safe(s);});
   parser.option(0, "priv", 1, [&](const char* s){cfg.priv = s;});
   parser.option(0, "device", 1, device_parser);
+  parser.option(0, "virtio-blk", 1, [&](const char* s){
+    std::vector<std::string> args;
+    std::stringstream sstr(s);
+    for (std::string arg; getline(sstr, arg, ',');)
+      args.push_back(arg);
+    plugin_device_factories.push_back(std::make_pair(virtio_blk_factory, args));
+  });
   parser.option(0, "extension", 1, [&](const char* s){extensions.push_back(find_extension(s));});
   parser.option(0, "dump-dts", 0, [&](const char UNUSED *s){dump_dts = true;});
   parser.option(0, "disable-dtb", 0, [&](const char UNUSED *s){dtb_enabled = false;});
@@ -432,12 +756,140 @@ int main(int argc, char** argv)
       [&](const char UNUSED *s){dm_config.support_abstract_csr_access = false;});
   parser.option(0, "dm-no-abstract-fpr", 0,
       [&](const char UNUSED *s){dm_config.support_abstract_fpr_access = false;});
+  parser.option(0, "dm-no-direct-access", 0,
+      [&](const char UNUSED *s){dm_config.support_direct_register_access = false;});
   parser.option(0, "dm-no-halt-groups", 0,
       [&](const char UNUSED *s){dm_config.support_haltgroups = false;});
   parser.option(0, "log-commits", 0,
                 [&](const char UNUSED *s){log_commits = true;});
+  // the --log-commits-* options add to one filter, and log_commits
+  auto commit_filter = [&]() -> commit_log_filter_t& {
+    log_commits = true;
+    if (!log_filter)
+      log_filter.emplace();
+    return *log_filter;
+  };
+  parser.option(0, "log-commits-range", 1, [&](const char* s){
+    commit_log_filter_t& f = commit_filter();
+    char* end;
+    reg_t begin = strtoull(s, &end, 0);
+    if (end != s && *end == ':') {
+      const char* hi = end + 1;
+      reg_t stop = strtoull(hi, &end, 0);
+      if (end == hi || *end || stop <= begin) {
+        fprintf(stderr, "--log-commits-range expects <begin>:<end> with begin < end, or a symbol\n");
+        exit(-1);
+      }
+      f.ranges.emplace_back(begin, stop);
+    } else {
+      f.symbols.push_back(s);
+    }
+  });
+  parser.option(0, "log-commits-priv", 1, [&](const char* s){
+    commit_log_filter_t& f = commit_filter();
+    f.privs = 0;
+    for (const char* c = s; *c; c++) {
+      switch (tolower(*c)) {
+        case 'm': f.privs |= 1U << PRV_M; break;
+        case 's': f.privs |= 1U << PRV_S; break;
+        case 'u': f.privs |= 1U << PRV_U; break;
+        default:
+          fprintf(stderr, "--log-commits-priv expects letters among m, s and u\n");
+          exit(-1);
+      }
+    }
+  });
+  parser.option(0, "log-commits-window", 1, [&](const char* s){
+    commit_log_filter_t& f = commit_filter();
+    char* end;
+    f.window_begin = strtoull(s, &end, 0);
+    if (*end == ':')
+      f.window_end = strtoull(end + 1, &end, 0);
+    if (*end || f.window_begin >= f.window_end) {
+      fprintf(stderr, "--log-commits-window expects <begin>:<end> with begin < end\n");
+      exit(-1);
+    }
+  });
   parser.option(0, "log", 1,
                 [&](const char* s){log_path = s;});
+  parser.option(0, "console-out", 1,
+                [&](const char* s){canonical_terminal_t::set_output(s);});
+  parser.option(0, "log-buffer", 1,
+                [&](const char* s){cfg.log_buffer_size = strtoull(s, 0, 0);});
+  parser.option(0, "log-writer-thread", 0,
+                [&](const char UNUSED *s){cfg.log_writer_thread = true;});
+  parser.option(0, "commit-trace", 1,
+                [&](const char* s){commit_trace_path = s;});
+  parser.option(0, "bbv", 1, [&](const char* s){bbv_path = s;});
+  parser.option(0, "bbv-interval", 1, [&](const char* s){
+    bbv_interval = strtoull(s, 0, 0);
+    if (!bbv_interval) {
+      fprintf(stderr, "--bbv-interval expects a positive count\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "call-trace", 1, [&](const char* s){call_trace_path = s;});
+  parser.option(0, "coverage", 1, [&](const char* s){coverage_path = s;});
+  parser.option(0, "insn-trace-ring", 1, [&](const char* s){
+#ifdef RISCV_ENABLE_INSN_TRACE_RING
+    insn_ring_path = s;
+#else
+    fprintf(stderr, "--insn-trace-ring needs spike configured with --enable-insn-trace-ring\n");
+    exit(1);
+#endif
+  });
+  parser.option(0, "insn-trace-ring-size", 1, [&](const char* s){
+    insn_ring_size = strtoull(s, 0, 0);
+  });
+  parser.option(0, "call-trace-range", 1, [&](const char* s){
+    for (const char* p = s; *p; ) {
+      char* end;
+      reg_t base = strtoull(p, &end, 0);
+      reg_t size = *end == ':' ? strtoull(end + 1, &end, 0) : 0;
+      if (!size || (*end && *end != ',')) {
+        fprintf(stderr, "--call-trace-range expects <base>:<size>[,<base>:<size>...]\n");
+        exit(-1);
+      }
+      call_trace_ranges.emplace_back(base, size);
+      p = *end ? end + 1 : end;
+    }
+  });
+  parser.option(0, "guest-profile", 1, [&](const char* s){guest_profile_path = s;});
+  parser.option(0, "guest-profile-hz", 1, [&](const char* s){
+    guest_profile_hz = strtoul(s, 0, 0);
+    if (!guest_profile_hz) {
+      fprintf(stderr, "--guest-profile-hz expects a positive rate\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "guest-profile-unwind", 0,
+                [&](const char UNUSED *s){guest_profile_unwind = true;});
+  parser.option(0, "metrics", 1, [&](const char* s){metrics_path = s;});
+  parser.option(0, "metrics-interval", 1, [&](const char* s){
+    metrics_interval = strtoul(s, 0, 0);
+    if (!metrics_interval) {
+      fprintf(stderr, "--metrics-interval expects a positive interval\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "zygote", 1, [&](const char* s){zygote_path = s;});
+  parser.option(0, "batch", 1, [&](const char* s){batch_path = s;});
+  parser.option(0, "batch-jobs", 1, [&](const char* s){
+    batch_jobs = atoul_nonzero_safe(s);
+  });
+  parser.option(0, "difftest", 1, [&](const char* s){difftest_path = s;});
+  parser.option(0, "record-inputs", 1, [&](const char* s){input_log_path = s; replay_inputs = false;});
+  parser.option(0, "replay-inputs", 1, [&](const char* s){input_log_path = s; replay_inputs = true;});
+  parser.option(0, "difftest-segment", 1, [&](const char* s){
+    difftest_segment = atoul_nonzero_safe(s);
+  });
+  parser.option(0, "difftest-jobs", 1, [&](const char* s){
+    difftest_jobs = atoul_nonzero_safe(s);
+  });
+  parser.option(0, "save-checkpoint", 1,
+                [&](const char* s){save_checkpoint = s;});
+  parser.option(0, "load-checkpoint", 1,
+                [&](const char* s){load_checkpoint = s;});
   FILE *cmd_file = NULL;
   parser.option(0, "debug-cmd", 1, [&](const char* s){
      if ((cmd_file = fopen(s, "r"))==NULL) {
@@ -456,6 +908,96 @@ int main(int argc, char** argv)
     }
     cfg.cache_blocksz = blocksz;
   });
+  parser.option(0, "tlb", 1, [&](const char* s){
+    char* p;
+    size_t entries = strtoull(s, &p, 0);
+    size_t ways = *p == ':' ? strtoull(p + 1, &p, 0) : 0;
+    auto pow2 = [](size_t v) { return v && !(v & (v - 1)); };
+    if (*p != 0 || !pow2(entries) || !pow2(ways) || ways > entries) {
+      fprintf(stderr, "--tlb expects <entries>:<ways>, powers of 2 with ways <= entries\n");
+      exit(-1);
+    }
+    cfg.tlb_entries = entries;
+    cfg.tlb_ways = ways;
+  });
+  parser.option(0, "icache", 1, [&](const char* s){
+    char* p;
+    size_t entries = strtoull(s, &p, 0);
+    if (*p != 0 || !entries || (entries & (entries - 1))) {
+      fprintf(stderr, "--icache expects a power of 2\n");
+      exit(-1);
+    }
+    cfg.icache_entries = entries;
+  });
+  parser.option(0, "block-cache", 1, [&](const char* s){
+    char* p;
+    size_t entries = strtoull(s, &p, 0);
+    if (*p != 0 || (entries & (entries - 1))) {
+      fprintf(stderr, "--block-cache expects 0 or a power of 2\n");
+      exit(-1);
+    }
+    cfg.block_cache_entries = entries;
+  });
+  parser.option(0, "interleave", 1, [&](const char* s){
+    cfg.interleave = strtoull(s, 0, 0);
+    if (!cfg.interleave) {
+      fprintf(stderr, "--interleave expects a positive count\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "rtc-tick", 1, [&](const char* s){
+    cfg.insns_per_rtc_tick = strtoull(s, 0, 0);
+    if (!cfg.insns_per_rtc_tick) {
+      fprintf(stderr, "--rtc-tick expects a positive count\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "skip-idle-harts", 0,
+                [&](const char UNUSED *s){cfg.skip_idle_harts = true;});
+  parser.option(0, "wfi-fast-forward", 0,
+                [&](const char UNUSED *s){cfg.wfi_fast_forward = true;});
+  parser.option(0, "parallel-harts", 0,
+                [&](const char UNUSED *s){cfg.parallel_harts = true;});
+  parser.option(0, "vector-threads", 1, [&](const char* s){
+    char* p;
+    cfg.vector_threads = strtoull(s, &p, 0);
+    if (*p != 0 || !cfg.vector_threads) {
+      fprintf(stderr, "--vector-threads expects a positive count\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "hart-cpus", 1,
+                [&](const char* s){cfg.hart_cpus = parse_hartids(s);});
+  parser.option(0, "machine-only", 0,
+                [&](const char UNUSED *s){cfg.machine_only_handlers = true;});
+  parser.option(0, "mem-image", 1, [&](const char* s){mem_image = s;});
+  parser.option(0, "load-image", 1, [&](const char* s){
+    const char* at = strrchr(s, '@');
+    if (!at || !at[1])
+      help();
+    char* end;
+    reg_t base = strtoull(at + 1, &end, 0);
+    if (*end)
+      help();
+    load_images.emplace_back(std::string(s, at - s), base);
+  });
+  parser.option(0, "mem-backend", 1, [&](const char* s){
+    mem_backend = s;
+    if (mem_backend != "sparse" && mem_backend != "flat" && mem_backend != "huge") {
+      fprintf(stderr, "--mem-backend expects sparse, flat or huge\n");
+      exit(-1);
+    }
+  });
+  parser.option(0, "mmu-stats", 0,
+                [&](const char UNUSED *s){mmu_stats = true;});
+  parser.option(0, "footprint", 0,
+                [&](const char UNUSED *s){footprint = true;});
+  parser.option(0, "insn-stats", 0,
+                [&](const char UNUSED *s){insn_stats = true;});
+  parser.option(0, "host-fp", 0, [&](const char UNUSED *s){
+    if (!softfloat_setHostFP(true))
+      fprintf(stderr, "warning: --host-fp is not supported on this host\n");
+  });
   parser.option(0, "instructions", 1, [&](const char* s){
     instructions = strtoull(s, 0, 0);
   });
@@ -463,11 +1005,22 @@ int main(int argc, char** argv)
   auto argv1 = parser.parse(argv);
   std::vector<std::string> htif_args(argv1, (const char*const*)argv + argc);
 
-  if (!*argv1)
+  if (!*argv1 && !batch_path)
     help();
+  if (!*argv1)
+    htif_args.push_back("none");
 
   std::vector<std::pair<reg_t, abstract_mem_t*>> mems =
-      make_mems(cfg.mem_layout);
+      make_mems(cfg.mem_layout, mem_backend, mem_image);
+
+  for (auto& image : load_images) {
+    try {
+      load_mem_image(image.first, image.second, mems);
+    } catch (std::runtime_error& e) {
+      fprintf(stderr, "%s\n", e.what());
+      exit(1);
+    }
+  }
 
   if (kernel && check_file_exists(kernel)) {
     const char *isa = cfg.isa;
@@ -529,29 +1082,293 @@ int main(int argc, char** argv)
     remote_bitbang.reset(new remote_bitbang_t(rbb_port, &(*jtag_dtm)));
     s.set_remote_bitbang(&(*remote_bitbang));
   }
+  std::unique_ptr<dmi_socket_t> dmi_socket;
+  if (use_dmi_socket) {
+    dmi_socket.reset(new dmi_socket_t(dmi_port, &s.debug_module));
+    s.set_dmi_socket(&*dmi_socket);
+  }
 
   if (dump_dts) {
     printf("%s", s.get_dts());
     return 0;
   }
 
-  if (ic && l2) ic->set_miss_handler(&*l2);
-  if (dc && l2) dc->set_miss_handler(&*l2);
+  cache_sim_t* l1_miss_handler = l2 ? &*l2 : llc ? &*llc : nullptr;
+  if (l2 && llc) l2->set_miss_handler(&*llc);
+  if (private_l1 && (ic || dc)) {
+    if (cache_threads) {
+      fprintf(stderr, "--cache-threads can't be combined with --private-l1\n");
+      exit(1);
+    }
+    for (size_t i = 0; i < cfg.nprocs(); i++) {
+      std::string hart = std::to_string(i);
+      if (ic) {
+        private_ic.emplace_back(new icache_sim_t(ic_config, ("I$" + hart).c_str()));
+        if (l1_miss_handler) private_ic.back()->set_miss_handler(l1_miss_handler);
+        private_ic.back()->set_log(log_cache);
+      }
+      if (dc) {
+        private_dc.emplace_back(new dcache_sim_t(dc_config, ("D$" + hart).c_str()));
+        if (l1_miss_handler) private_dc.back()->set_miss_handler(l1_miss_handler);
+        private_dc.back()->set_log(log_cache);
+        private_dc.back()->attach_to(&l1_bus);
+      }
+    }
+    ic.reset();
+    dc.reset();
+  }
+  if (ic && l1_miss_handler) ic->set_miss_handler(l1_miss_handler);
+  if (dc && l1_miss_handler) dc->set_miss_handler(l1_miss_handler);
   if (ic) ic->set_log(log_cache);
   if (dc) dc->set_log(log_cache);
+  if (cache_threads && (ic || dc)) {
+    // I$ and D$ share a thread when they share the L2
+    cache_tracer.reset(new async_memtracer_t());
+    if (l1_miss_handler && ic && dc) {
+      cache_tracer->add_consumer({&*ic, &*dc});
+    } else {
+      if (ic) cache_tracer->add_consumer({&*ic});
+      if (dc) cache_tracer->add_consumer({&*dc});
+    }
+  }
+  std::vector<cache_memtracer_t*> l1s;
+  for (cache_memtracer_t* c : {(cache_memtracer_t*)ic.get(), (cache_memtracer_t*)dc.get()})
+    if (c) l1s.push_back(c);
+  for (auto& c : private_ic) l1s.push_back(&*c);
+  for (auto& c : private_dc) l1s.push_back(&*c);
+  if (cache_sample_sets != 1) {
+    for (auto c : l1s)
+      c->sample_sets(cache_sample_sets);
+    // the L1 misses are already a sample of the lower levels' sets
+    if (l2) l2->scale_stats(cache_sample_sets);
+    if (llc) llc->scale_stats(cache_sample_sets);
+  }
+  if (!cfg.hart_cpus.empty() && !cfg.parallel_harts) {
+    fprintf(stderr, "--hart-cpus needs --parallel-harts\n");
+    exit(1);
+  }
+  if (cfg.parallel_harts && (!l1s.empty() || l2 || llc || commit_trace_path)) {
+    // the cache models and the trace writer are shared by every hart
+    fprintf(stderr, "--ic, --dc, --l2, --llc and --commit-trace can't be combined with --parallel-harts\n");
+    exit(1);
+  }
+
+  std::unique_ptr<cache_sampler_t> cache_sampler;
+  if (cache_sample_period && !l1s.empty()) {
+    if (cache_tracer || cfg.parallel_harts) {
+      fprintf(stderr, "--cache-sample can't be combined with --cache-threads or --parallel-harts\n");
+      exit(1);
+    }
+    cache_sampler.reset(new cache_sampler_t(l1s, cache_sample_period, cache_sample_window));
+  }
+
+  std::unique_ptr<dram_trace_t> dram_trace;
+  if (dram_trace_path) {
+    if (cache_tracer || cfg.parallel_harts) {
+      fprintf(stderr, "--dram-trace can't be combined with --cache-threads or --parallel-harts\n");
+      exit(1);
+    }
+    try {
+      dram_trace.reset(new dram_trace_t(dram_trace_path, dram_trace_format));
+    } catch (std::runtime_error& e) {
+      fprintf(stderr, "%s\n", e.what());
+      exit(1);
+    }
+    // the lowest level is the one without a miss handler
+    if (llc)
+      llc->set_miss_tracer(&*dram_trace);
+    else if (l2)
+      l2->set_miss_tracer(&*dram_trace);
+    else
+      for (auto c : l1s)
+        c->set_miss_tracer(&*dram_trace);
+  }
+
   for (size_t i = 0; i < cfg.nprocs(); i++)
   {
-    if (ic) s.get_core(i)->get_mmu()->register_memtracer(&*ic);
-    if (dc) s.get_core(i)->get_mmu()->register_memtracer(&*dc);
+    if (cache_sampler)
+      cache_sampler->attach(s.get_core(i));
+    if (dram_trace) {
+      dram_trace->attach(s.get_core(i));
+      if (l1s.empty() && !l2 && !llc)
+        s.get_core(i)->get_mmu()->register_memtracer(&*dram_trace);
+    }
+    if (cache_tracer) {
+      s.get_core(i)->get_mmu()->register_async_memtracer(&*cache_tracer);
+    } else {
+      if (ic) s.get_core(i)->get_mmu()->register_memtracer(&*ic);
+      if (dc) s.get_core(i)->get_mmu()->register_memtracer(&*dc);
+      if (!private_ic.empty()) s.get_core(i)->get_mmu()->register_memtracer(&*private_ic[i]);
+      if (!private_dc.empty()) s.get_core(i)->get_mmu()->register_memtracer(&*private_dc[i]);
+    }
     for (auto e : extensions)
       s.get_core(i)->register_extension(e());
   }
 
   s.set_debug(debug);
   s.configure_log(log, log_commits);
+  if (log_filter)
+    s.set_commit_log_filter(*log_filter);
   s.set_histogram(histogram);
+  if (insn_stats) {
+    for (size_t i = 0; i < cfg.nprocs(); i++)
+      s.get_core(i)->set_insn_stats(true);
+  }
+  if (load_checkpoint)
+    s.set_initial_checkpoint(load_checkpoint);
+
+  if (zygote_path && batch_path) {
+    fprintf(stderr, "--zygote and --batch can't be combined\n");
+    exit(1);
+  }
+  if (save_checkpoint && !s.can_checkpoint()) {
+    // the disk image is not in the checkpoint, so it could not be restored
+    fprintf(stderr, "--save-checkpoint can't be combined with a virtio-blk disk\n");
+    exit(1);
+  }
+
+  if (input_log_path && (zygote_path || cfg.parallel_harts || s.has_service_thread())) {
+    // the copies, or the harts' and the devices' threads, would take the
+    // inputs in any order
+    fprintf(stderr, "--%s-inputs can't be combined with --zygote, --parallel-harts or +htif-thread\n",
+            replay_inputs ? "replay" : "record");
+    exit(1);
+  }
+
+  if (zygote_path) {
+    // threads would not survive the fork
+    if (cache_tracer || cfg.log_writer_thread || cfg.parallel_harts || dram_trace) {
+      fprintf(stderr, "--zygote can't be combined with --cache-threads, --log-writer-thread,\n"
+                      "--parallel-harts or --dram-trace\n");
+      exit(1);
+    }
+    serve_zygote(s, zygote_path);
+  }
+
+  if (difftest_path && (zygote_path || batch_path)) {
+    fprintf(stderr, "--difftest can't be combined with --zygote or --batch\n");
+    exit(1);
+  }
+
+  if ((batch_path && batch_jobs > 1) || difftest_path) {
+    // as for --zygote, and the copies would share the per-run outputs
+    if (cache_tracer || cfg.log_writer_thread || cfg.parallel_harts ||
+        commit_trace_path || bbv_path || call_trace_path || insn_ring_path || guest_profile_path ||
+        metrics_path || coverage_path || input_log_path || save_checkpoint || dram_trace) {
+      fprintf(stderr, "%s can't be combined with --cache-threads, --log-writer-thread,\n"
+                      "--parallel-harts or trace, profile and checkpoint outputs\n",
+              difftest_path ? "--difftest" : "--batch-jobs");
+      exit(1);
+    }
+  }
+
+  std::unique_ptr<commit_trace_writer_t> commit_trace;
+  std::vector<std::unique_ptr<bbv_profiler_t>> bbv;
+  std::vector<std::unique_ptr<call_tracer_t>> call_tracers;
+  std::vector<std::unique_ptr<coverage_t>> coverage;
+  std::vector<std::unique_ptr<insn_trace_ring_t>> insn_rings;
+  std::unique_ptr<guest_profiler_t> guest_profiler;
+  std::unique_ptr<metrics_writer_t> metrics;
+  std::unique_ptr<difftest_t> difftest;
+  std::unique_ptr<input_log_t> input_log;
+  // the outputs are opened up front, so a bad path is reported before the run
+  try {
+    if (commit_trace_path) {
+      commit_trace.reset(new commit_trace_writer_t(commit_trace_path));
+      for (size_t i = 0; i < cfg.nprocs(); i++)
+        s.get_core(i)->add_commit_observer(commit_trace.get());
+    }
+
+    if (bbv_path) {
+      for (size_t i = 0; i < cfg.nprocs(); i++) {
+        std::string path = bbv_path;
+        if (cfg.nprocs() > 1)
+          path += "." + std::to_string(i);
+        bbv.emplace_back(new bbv_profiler_t(s.get_core(i), path.c_str(), bbv_interval));
+      }
+    }
+
+    if (call_trace_path) {
+      for (size_t i = 0; i < cfg.nprocs(); i++) {
+        std::string path = call_trace_path;
+        if (cfg.nprocs() > 1)
+          path += "." + std::to_string(i);
+        call_tracers.emplace_back(new call_tracer_t(s.get_core(i), path.c_str(),
+                                                    call_trace_ranges));
+      }
+    }
+
+    if (coverage_path) {
+      for (size_t i = 0; i < cfg.nprocs(); i++) {
+        std::string path = coverage_path;
+        if (cfg.nprocs() > 1)
+          path += "." + std::to_string(i);
+        coverage.emplace_back(new coverage_t(s.get_core(i), path.c_str()));
+      }
+    }
+
+    if (insn_ring_path) {
+      for (size_t i = 0; i < cfg.nprocs(); i++) {
+        std::string path = insn_ring_path;
+        if (cfg.nprocs() > 1)
+          path += "." + std::to_string(i);
+        insn_rings.emplace_back(new insn_trace_ring_t(s.get_core(i), path.c_str(), insn_ring_size));
+      }
+    }
+
+    if (guest_profile_path)
+      guest_profiler.reset(new guest_profiler_t(&s, guest_profile_path, guest_profile_hz,
+                                                guest_profile_unwind));
+
+    if (metrics_path)
+      metrics.reset(new metrics_writer_t(&s, metrics_path, metrics_interval));
+
+    if (difftest_path)
+      difftest.reset(new difftest_t(&s, difftest_path, difftest_segment, difftest_jobs));
+
+    if (input_log_path)
+      input_log.reset(new input_log_t(&s, input_log_path, replay_inputs));
+  } catch (std::runtime_error& e) {
+    fprintf(stderr, "%s\n", e.what());
+    exit(1);
+  }
+
+  auto return_code = batch_path ? run_batch(s, batch_path, batch_jobs) : s.run();
+  if (difftest && !difftest->finish())
+    return_code = 1;
+  difftest.reset();
+  input_log.reset();
+  commit_trace.reset();
+  bbv.clear();
+  call_tracers.clear();
+  coverage.clear();
+  insn_rings.clear();
+  guest_profiler.reset();
+  metrics.reset();
+  dram_trace.reset();
+  if (cache_sampler) {
+    double scale = cache_sampler->scale();
+    cache_sampler.reset();
+    for (auto c : l1s)
+      c->scale_stats(scale);
+    if (l2) l2->scale_stats(scale);
+    if (llc) llc->scale_stats(scale);
+  }
+  if (save_checkpoint)
+    s.save_checkpoint(save_checkpoint);
+
+  if (insn_stats) {
+    for (size_t i = 0; i < cfg.nprocs(); i++)
+      s.get_core(i)->print_insn_stats(stderr);
+  }
+
+  if (mmu_stats) {
+    for (size_t i = 0; i < cfg.nprocs(); i++)
+      s.print_hart_stats(std::cerr, i);
+  }
 
-  auto return_code = s.run();
+  if (footprint)
+    s.print_footprint(std::cerr);
 
   for (auto& mem : mems)
     delete mem.second;